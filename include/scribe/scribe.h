@@ -78,6 +78,19 @@ void scribe_close(scribe_ctx *ctx);
 scribe_error_t scribe_commit_batch(scribe_ctx *ctx, const scribe_change_batch *batch,
                                    uint8_t out_commit_hash[SCRIBE_HASH_SIZE]);
 
+typedef struct {
+    const char *op;
+    const char *path;
+    size_t path_len;
+    const char *value;
+    size_t value_len;
+} scribe_json_patch_op;
+
+typedef scribe_error_t (*scribe_json_patch_fn)(const scribe_json_patch_op *op, void *user);
+
+scribe_error_t scribe_json_diff(const char *a, size_t a_len, const char *b, size_t b_len, scribe_json_patch_fn emit,
+                                void *user);
+
 #ifdef __cplusplus
 }
 #endif
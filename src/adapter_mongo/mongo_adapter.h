@@ -3,6 +3,30 @@
 
 #include "scribe/scribe.h"
 
+/*
+ * Offline import source. Exactly one of mongodump_dir and ndjson_path is set;
+ * NDJSON input also needs a `<db>/<coll>/{_id}` path template. oplog_ts, when
+ * set, is the `<seconds>[.<increment>]` cluster time mongo-watch resumes from.
+ */
+typedef struct {
+    const char *mongodump_dir;
+    const char *ndjson_path;
+    const char *path_template;
+    const char *oplog_ts;
+} scribe_mongo_import_options;
+
+/*
+ * Commit target and stop flag of a watch session; defined in core/internal.h.
+ * `mongo-watch` uses scribe_mongo_watch_bootstrap(), which owns the process;
+ * the daemon hosts sessions with scribe_mongo_watch_session() between one
+ * scribe_mongo_global_init() and scribe_mongo_global_cleanup().
+ */
+struct scribe_session_sink;
+
 scribe_error_t scribe_mongo_watch_bootstrap(scribe_ctx *ctx, const char *uri);
+scribe_error_t scribe_mongo_watch_session(scribe_ctx *ctx, const char *uri, struct scribe_session_sink *sink);
+void scribe_mongo_global_init(void);
+void scribe_mongo_global_cleanup(void);
+scribe_error_t scribe_mongo_import(scribe_ctx *ctx, const scribe_mongo_import_options *opts);
 
 #endif
@@ -13,7 +13,6 @@
 #include "util/hex.h"
 #include "util/log.h"
 
-#include "blake3.h"
 #include <mongoc/mongoc.h>
 
 #include <signal.h>
@@ -25,8 +24,6 @@
 #include <time.h>
 #include <unistd.h>
 
-#define SCRIBE_MONGO_STATE_INVALID "invalid"
-
 typedef enum {
     MONGO_EVENT_IGNORED = 0,
     MONGO_EVENT_DATA = 1,
@@ -35,12 +32,23 @@ typedef enum {
 
 typedef struct {
     char *database;
+    scribe_session_sink *sink;
 } mongo_watch_scope;
 
+typedef struct {
+    mongoc_client_t *client;
+    scribe_full_document mode;
+    uint64_t post_images;
+    uint64_t server_lookups;
+    uint64_t fallback_lookups;
+    uint64_t vanished;
+} mongo_post_images;
+
 typedef struct mongo_task {
     bson_t *doc;
-    char *db;
-    char *coll;
+    const char *db;
+    const char *coll;
+    size_t reserved;
     struct mongo_task *next;
 } mongo_task;
 
@@ -50,6 +58,7 @@ typedef struct {
     size_t count;
     size_t capacity;
     int closed;
+    scribe_mem_budget *mem;
     pthread_mutex_t mu;
     pthread_cond_t not_empty;
     pthread_cond_t not_full;
@@ -59,25 +68,25 @@ typedef struct {
     const char **path;
     uint8_t *payload;
     size_t payload_len;
-    uint8_t payload_hash[SCRIBE_HASH_SIZE];
 } mongo_result;
 
 typedef struct {
-    mongo_result *items;
+    scribe_snapshot_builder *builder;
     size_t count;
-    size_t cap;
     pthread_mutex_t mu;
 } mongo_results;
 
 typedef struct {
+    scribe_ctx *ctx;
     mongo_task_queue *queue;
     mongo_results *results;
+    scribe_blob_format blob_format;
     scribe_error_t err;
 } mongo_worker_ctx;
 
 /*
- * Releases heap memory inside a watch scope. The scope currently contains only
- * the optional database name parsed from the URI.
+ * Releases heap memory inside a watch scope: the optional database name parsed
+ * from the URI. The sink belongs to the session's owner.
  */
 static void mongo_watch_scope_destroy(mongo_watch_scope *scope) {
     if (scope != NULL) {
@@ -100,6 +109,7 @@ static scribe_error_t mongo_watch_scope_from_uri(const char *uri, mongo_watch_sc
         return scribe_set_error(SCRIBE_EINVAL, "invalid MongoDB watch scope");
     }
     scope->database = NULL;
+    scope->sink = NULL;
     parsed = mongoc_uri_new_with_error(uri, &error);
     if (parsed == NULL) {
         return scribe_set_error(SCRIBE_EADAPTER, "invalid MongoDB URI: %s", error.message);
@@ -239,11 +249,14 @@ static scribe_error_t base64_decode(const char *s, uint8_t **out, size_t *out_le
 
 /*
  * Initializes the bounded bootstrap task queue. The queue coordinates one
- * MongoDB enumeration thread with several BSON canonicalization workers.
+ * MongoDB enumeration thread with several BSON canonicalization workers; each
+ * queued document's BSON size is reserved against `mem` until a worker is done
+ * with it.
  */
-static scribe_error_t task_queue_init(mongo_task_queue *q, size_t capacity) {
+static scribe_error_t task_queue_init(mongo_task_queue *q, size_t capacity, scribe_mem_budget *mem) {
     memset(q, 0, sizeof(*q));
     q->capacity = capacity == 0 ? 64u : capacity;
+    q->mem = mem;
     if (pthread_mutex_init(&q->mu, NULL) != 0 || pthread_cond_init(&q->not_empty, NULL) != 0 ||
         pthread_cond_init(&q->not_full, NULL) != 0) {
         return scribe_set_error(SCRIBE_ERR, "failed to initialize Mongo task queue");
@@ -255,9 +268,10 @@ static scribe_error_t task_queue_init(mongo_task_queue *q, size_t capacity) {
  * Bootstrap is the only v1 workload that does substantial parallel work. The
  * main thread enumerates MongoDB documents and pushes bson copies into this
  * bounded queue. Worker threads pop tasks, canonicalize BSON to deterministic
- * JSON bytes, derive the database/collection/document-id path, and append their
- * results to a mutex-protected vector. The bounded queue prevents a very large
- * collection from being copied entirely into memory before workers catch up.
+ * JSON bytes, derive the database/collection/document-id path, write the blob,
+ * and add a (path, hash) record to the mutex-protected snapshot builder. The
+ * bounded queue prevents a very large collection from being copied entirely
+ * into memory before workers catch up.
  */
 /*
  * Destroys synchronization primitives owned by the bootstrap task queue. Tasks
@@ -293,10 +307,11 @@ static scribe_error_t task_queue_push(mongo_task_queue *q, mongo_task *task) {
 }
 
 /*
- * Pops one document task for a worker. NULL means the queue is both closed and
- * empty, which tells workers to exit.
+ * Pops one document task for a worker and reports how many tasks are left
+ * behind it. NULL means the queue is both closed and empty, which tells
+ * workers to exit.
  */
-static mongo_task *task_queue_pop(mongo_task_queue *q) {
+static mongo_task *task_queue_pop(mongo_task_queue *q, size_t *depth) {
     mongo_task *task;
 
     pthread_mutex_lock(&q->mu);
@@ -312,6 +327,7 @@ static mongo_task *task_queue_pop(mongo_task_queue *q) {
         q->count--;
         pthread_cond_signal(&q->not_full);
     }
+    *depth = q->count;
     pthread_mutex_unlock(&q->mu);
     return task;
 }
@@ -328,25 +344,32 @@ static void task_queue_close(mongo_task_queue *q) {
 }
 
 /*
- * Frees a queued MongoDB document task, including the copied BSON document and
- * duplicated namespace strings.
+ * Frees a queued MongoDB document task, including the copied BSON document, and
+ * returns its reservation to the budget. Namespace strings are interned in the
+ * context and stay alive.
  */
-static void free_task(mongo_task *task) {
+static void free_task(mongo_task_queue *q, mongo_task *task) {
     if (task != NULL) {
+        scribe_mem_release(q->mem, task->reserved);
         bson_destroy(task->doc);
-        free(task->db);
-        free(task->coll);
         free(task);
     }
 }
 
 /*
- * Initializes the thread-safe bootstrap result list. Workers append canonicalized
- * document results here after processing queue tasks.
+ * Initializes the thread-safe bootstrap snapshot. Workers add one record per
+ * document; records beyond the configured memory budget spill to sorted runs.
  */
-static scribe_error_t results_init(mongo_results *results) {
+static scribe_error_t results_init(scribe_ctx *ctx, mongo_results *results) {
+    scribe_error_t err;
+
     memset(results, 0, sizeof(*results));
+    err = scribe_snapshot_builder_new(ctx, ctx->config.snapshot_memory_bytes, &results->builder);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
     if (pthread_mutex_init(&results->mu, NULL) != 0) {
+        scribe_snapshot_builder_free(results->builder);
         return scribe_set_error(SCRIBE_ERR, "failed to initialize Mongo results");
     }
     return SCRIBE_OK;
@@ -358,8 +381,6 @@ static scribe_error_t results_init(mongo_results *results) {
 static void result_free(mongo_result *r) {
     if (r != NULL) {
         if (r->path != NULL) {
-            free((void *)r->path[0]);
-            free((void *)r->path[1]);
             free((void *)r->path[2]);
             free(r->path);
         }
@@ -368,314 +389,37 @@ static void result_free(mongo_result *r) {
 }
 
 /*
- * Frees every result and destroys the result-list mutex. This is used after
- * bootstrap commit creation or after a bootstrap failure.
+ * Releases the snapshot builder and its spilled runs and destroys the mutex.
+ * This is used after bootstrap commit creation or after a bootstrap failure.
  */
 static void results_destroy(mongo_results *results) {
-    size_t i;
-    for (i = 0; i < results->count; i++) {
-        result_free(&results->items[i]);
-    }
-    free(results->items);
+    scribe_snapshot_builder_free(results->builder);
     pthread_mutex_destroy(&results->mu);
 }
 
 /*
- * Appends one worker result to the shared result list. The result ownership
- * moves into the list on success.
- */
-static scribe_error_t results_add(mongo_results *results, mongo_result *result) {
-    mongo_result *grown;
-
-    pthread_mutex_lock(&results->mu);
-    if (results->count == results->cap) {
-        size_t new_cap = results->cap == 0 ? 128u : results->cap * 2u;
-        grown = (mongo_result *)realloc(results->items, sizeof(*grown) * new_cap);
-        if (grown == NULL) {
-            pthread_mutex_unlock(&results->mu);
-            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow Mongo result list");
-        }
-        results->items = grown;
-        results->cap = new_cap;
-    }
-    results->items[results->count++] = *result;
-    pthread_mutex_unlock(&results->mu);
-    return SCRIBE_OK;
-}
-
-typedef struct mongo_snapshot_node mongo_snapshot_node;
-
-typedef struct {
-    char *name;
-    uint8_t type;
-    uint8_t hash[SCRIBE_HASH_SIZE];
-    mongo_snapshot_node *child;
-} mongo_snapshot_entry;
-
-struct mongo_snapshot_node {
-    mongo_snapshot_entry *entries;
-    size_t count;
-    size_t cap;
-};
-
-/*
- * Allocates an empty in-memory snapshot node. Bootstrap uses these nodes to
- * assemble database/collection/document-id trees before writing Scribe objects.
- */
-static mongo_snapshot_node *snapshot_node_new(void) {
-    return (mongo_snapshot_node *)calloc(1, sizeof(mongo_snapshot_node));
-}
-
-/*
- * Recursively frees an in-memory snapshot tree. Child pointers are valid only
- * for tree entries; blob entries have no child to free.
- */
-static void snapshot_node_free(mongo_snapshot_node *node) {
-    size_t i;
-
-    if (node == NULL) {
-        return;
-    }
-    for (i = 0; i < node->count; i++) {
-        free(node->entries[i].name);
-        snapshot_node_free(node->entries[i].child);
-    }
-    free(node->entries);
-    free(node);
-}
-
-/*
- * Finds a snapshot entry by exact name and returns its index, or -1 when absent.
- */
-static ssize_t snapshot_node_find(mongo_snapshot_node *node, const char *name) {
-    size_t i;
-
-    for (i = 0; i < node->count; i++) {
-        if (strcmp(node->entries[i].name, name) == 0) {
-            return (ssize_t)i;
-        }
-    }
-    return -1;
-}
-
-/*
- * Ensures a snapshot node can accept another entry. The snapshot tree uses heap
- * arrays because it survives beyond any one arena parse operation.
- */
-static scribe_error_t snapshot_node_reserve(mongo_snapshot_node *node) {
-    mongo_snapshot_entry *grown;
-    size_t new_cap;
-
-    if (node->count < node->cap) {
-        return SCRIBE_OK;
-    }
-    new_cap = node->cap == 0 ? 8u : node->cap * 2u;
-    grown = (mongo_snapshot_entry *)realloc(node->entries, sizeof(*grown) * new_cap);
-    if (grown == NULL) {
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to grow Mongo snapshot tree");
-    }
-    memset(grown + node->cap, 0, sizeof(*grown) * (new_cap - node->cap));
-    node->entries = grown;
-    node->cap = new_cap;
-    return SCRIBE_OK;
-}
-
-/*
- * Finds or creates a child tree node under a snapshot node. It fails if an
- * existing blob already occupies the requested tree position.
- */
-static scribe_error_t snapshot_node_child(mongo_snapshot_node *node, const char *name, mongo_snapshot_node **out) {
-    ssize_t idx = snapshot_node_find(node, name);
-    mongo_snapshot_node *child;
-
-    if (idx >= 0) {
-        if (node->entries[(size_t)idx].type != SCRIBE_OBJECT_TREE) {
-            return scribe_set_error(SCRIBE_ECORRUPT, "Mongo snapshot path collides with blob");
-        }
-        *out = node->entries[(size_t)idx].child;
-        return SCRIBE_OK;
-    }
-    if (snapshot_node_reserve(node) != SCRIBE_OK) {
-        return SCRIBE_ENOMEM;
-    }
-    child = snapshot_node_new();
-    if (child == NULL) {
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo snapshot tree node");
-    }
-    node->entries[node->count].name = strdup(name);
-    if (node->entries[node->count].name == NULL) {
-        snapshot_node_free(child);
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo snapshot path component");
-    }
-    node->entries[node->count].type = SCRIBE_OBJECT_TREE;
-    node->entries[node->count].child = child;
-    node->count++;
-    *out = child;
-    return SCRIBE_OK;
-}
-
-/*
- * Sets or replaces one blob entry in the in-memory snapshot tree. Replacing a
- * previous tree frees that subtree because the leaf is now a document blob.
+ * Records one written document blob in the shared snapshot. Arrival order is
+ * the record sequence; a document seen twice keeps its later version.
  */
-static scribe_error_t snapshot_node_set_blob(mongo_snapshot_node *node, const char *name,
-                                             const uint8_t hash[SCRIBE_HASH_SIZE]) {
-    ssize_t idx = snapshot_node_find(node, name);
-
-    if (idx >= 0) {
-        mongo_snapshot_entry *entry = &node->entries[(size_t)idx];
-        snapshot_node_free(entry->child);
-        entry->child = NULL;
-        entry->type = SCRIBE_OBJECT_BLOB;
-        scribe_hash_copy(entry->hash, hash);
-        return SCRIBE_OK;
-    }
-    if (snapshot_node_reserve(node) != SCRIBE_OK) {
-        return SCRIBE_ENOMEM;
-    }
-    node->entries[node->count].name = strdup(name);
-    if (node->entries[node->count].name == NULL) {
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo snapshot blob name");
-    }
-    node->entries[node->count].type = SCRIBE_OBJECT_BLOB;
-    scribe_hash_copy(node->entries[node->count].hash, hash);
-    node->count++;
-    return SCRIBE_OK;
-}
-
-/*
- * Writes one canonicalized document result into the snapshot: the payload is
- * stored as a blob, then its hash is installed at database/collection/id.
- */
-static scribe_error_t snapshot_add_result(scribe_ctx *ctx, mongo_snapshot_node *root, const mongo_result *result) {
-    mongo_snapshot_node *db;
-    mongo_snapshot_node *coll;
-    uint8_t blob_hash[SCRIBE_HASH_SIZE];
+static scribe_error_t results_add(mongo_results *results, const mongo_result *result,
+                                  const uint8_t hash[SCRIBE_HASH_SIZE]) {
     scribe_error_t err;
 
-    err = scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, result->payload, result->payload_len, blob_hash);
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    err = snapshot_node_child(root, result->path[0], &db);
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    err = snapshot_node_child(db, result->path[1], &coll);
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    return snapshot_node_set_blob(coll, result->path[2], blob_hash);
-}
-
-/*
- * Adds to a size accumulator with overflow checking. Snapshot tree serialization
- * uses this before allocating fixed-size arenas.
- */
-static scribe_error_t checked_add_size(size_t *total, size_t add) {
-    if (*total > SIZE_MAX - add) {
-        return scribe_set_error(SCRIBE_ENOMEM, "MongoDB snapshot tree arena size is too large");
-    }
-    *total += add;
-    return SCRIBE_OK;
-}
-
-/*
- * Estimates the arena capacity needed to serialize one snapshot node as a
- * Scribe tree object.
- */
-static scribe_error_t snapshot_tree_arena_capacity(const mongo_snapshot_node *node, size_t *out) {
-    size_t i;
-    size_t entry_count;
-    size_t total = 4096u;
-
-    if (node == NULL || out == NULL) {
-        return scribe_set_error(SCRIBE_EINVAL, "invalid MongoDB snapshot tree arena capacity input");
-    }
-    entry_count = node->count == 0 ? 1u : node->count;
-    if (entry_count > SIZE_MAX / sizeof(scribe_tree_entry)) {
-        return scribe_set_error(SCRIBE_ENOMEM, "MongoDB snapshot tree has too many entries");
-    }
-    if (checked_add_size(&total, sizeof(scribe_tree_entry) * entry_count) != SCRIBE_OK ||
-        checked_add_size(&total, sizeof(scribe_tree_entry) * entry_count) != SCRIBE_OK) {
-        return SCRIBE_ENOMEM;
-    }
-    for (i = 0; i < node->count; i++) {
-        size_t name_len = strlen(node->entries[i].name);
-        if (checked_add_size(&total, 1u + SCRIBE_HASH_SIZE + 10u + name_len) != SCRIBE_OK) {
-            return SCRIBE_ENOMEM;
-        }
-    }
-    *out = total;
-    return SCRIBE_OK;
-}
-
-/*
- * Recursively writes a snapshot node as immutable Scribe tree objects. Child
- * trees are written first so parent entries can contain their hashes.
- */
-static scribe_error_t snapshot_write_tree(scribe_ctx *ctx, mongo_snapshot_node *node,
-                                          uint8_t out_hash[SCRIBE_HASH_SIZE]) {
-    scribe_tree_entry *entries;
-    scribe_arena arena;
-    uint8_t *payload;
-    size_t payload_len;
-    size_t i;
-    scribe_error_t err;
-    size_t arena_capacity = 0;
-
-    err = snapshot_tree_arena_capacity(node, &arena_capacity);
-    if (err == SCRIBE_OK) {
-        err = scribe_arena_init(&arena, arena_capacity);
-    }
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    entries = (scribe_tree_entry *)scribe_arena_alloc(&arena, sizeof(*entries) * (node->count == 0 ? 1u : node->count),
-                                                      _Alignof(scribe_tree_entry));
-    if (entries == NULL) {
-        scribe_arena_destroy(&arena);
-        return SCRIBE_ENOMEM;
-    }
-    memset(entries, 0, sizeof(*entries) * (node->count == 0 ? 1u : node->count));
-    for (i = 0; i < node->count; i++) {
-        entries[i].type = node->entries[i].type;
-        entries[i].name = node->entries[i].name;
-        entries[i].name_len = strlen(node->entries[i].name);
-        if (node->entries[i].type == SCRIBE_OBJECT_TREE) {
-            err = snapshot_write_tree(ctx, node->entries[i].child, entries[i].hash);
-            if (err != SCRIBE_OK) {
-                scribe_arena_destroy(&arena);
-                return err;
-            }
-        } else {
-            scribe_hash_copy(entries[i].hash, node->entries[i].hash);
-        }
-    }
-    err = scribe_tree_serialize(entries, node->count, &arena, &payload, &payload_len);
+    pthread_mutex_lock(&results->mu);
+    err = scribe_snapshot_builder_add(results->builder, result->path, 3u, hash, results->count);
     if (err == SCRIBE_OK) {
-        err = scribe_object_write(ctx, SCRIBE_OBJECT_TREE, payload, payload_len, out_hash);
+        results->count++;
     }
-    scribe_arena_destroy(&arena);
+    pthread_mutex_unlock(&results->mu);
     return err;
 }
 
 /*
- * Hashes canonical document payload bytes for deterministic debugging and result
- * ordering checks. Object storage computes its own envelope hash later.
+ * Converts one queued MongoDB document into a Scribe path and canonical payload
+ * in the store's blob format. Workers call this after receiving a copied BSON
+ * document from the queue.
  */
-static void hash_payload(const uint8_t *payload, size_t payload_len, uint8_t out[SCRIBE_HASH_SIZE]) {
-    blake3_hasher hasher;
-    blake3_hasher_init(&hasher);
-    blake3_hasher_update(&hasher, payload, payload_len);
-    blake3_hasher_finalize(&hasher, out, SCRIBE_HASH_SIZE);
-}
-
-/*
- * Converts one queued MongoDB document into a Scribe path and canonical payload.
- * Workers call this after receiving a copied BSON document from the queue.
- */
-static scribe_error_t process_task(mongo_task *task, mongo_result *out) {
+static scribe_error_t process_task(mongo_task *task, scribe_blob_format format, mongo_result *out) {
     char *id = NULL;
     uint8_t *payload = NULL;
     size_t payload_len = 0;
@@ -685,16 +429,14 @@ static scribe_error_t process_task(mongo_task *task, mongo_result *out) {
     /*
      * The Scribe path for MongoDB is always exactly three components:
      * database, collection, canonical _id. The payload is the complete canonical
-     * Extended JSON document. Hashing the payload here is not required for
-     * object storage, but it makes worker results deterministic and was used
-     * during verification/debugging of bootstrap ordering.
+     * Extended JSON document, or sorted BSON when the store is configured so.
      */
     memset(out, 0, sizeof(*out));
     err = scribe_mongo_canonicalize_id(task->doc, &id);
     if (err != SCRIBE_OK) {
         return err;
     }
-    err = scribe_mongo_canonicalize_bson(task->doc, &payload, &payload_len);
+    err = scribe_mongo_encode_document(task->doc, format, &payload, &payload_len);
     if (err != SCRIBE_OK) {
         free(id);
         return err;
@@ -705,27 +447,19 @@ static scribe_error_t process_task(mongo_task *task, mongo_result *out) {
         free(payload);
         return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo path");
     }
-    path[0] = strdup(task->db);
-    path[1] = strdup(task->coll);
+    path[0] = task->db;
+    path[1] = task->coll;
     path[2] = id;
-    if (path[0] == NULL || path[1] == NULL) {
-        free((void *)path[0]);
-        free((void *)path[1]);
-        free(id);
-        free(path);
-        free(payload);
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo path component");
-    }
     out->path = path;
     out->payload = payload;
     out->payload_len = payload_len;
-    hash_payload(payload, payload_len, out->payload_hash);
     return SCRIBE_OK;
 }
 
 /*
  * Worker thread entry point for bootstrap canonicalization. It drains the task
- * queue, records its first error, and appends successful results to the shared list.
+ * queue, records its first error, and writes each document's blob before adding
+ * its record to the shared snapshot.
  */
 static void *worker_main(void *arg) {
     mongo_worker_ctx *ctx = (mongo_worker_ctx *)arg;
@@ -736,21 +470,28 @@ static void *worker_main(void *arg) {
      * the main bootstrap thread reports that error during cleanup.
      */
     for (;;) {
-        mongo_task *task = task_queue_pop(ctx->queue);
+        size_t depth;
+        mongo_task *task = task_queue_pop(ctx->queue, &depth);
         mongo_result result;
         scribe_error_t err;
         if (task == NULL) {
             break;
         }
-        err = process_task(task, &result);
-        free_task(task);
+        /* A full queue means workers, mostly compression, are the bottleneck. */
+        scribe_object_note_queue_depth(ctx->ctx, depth, ctx->queue->capacity);
+        uint8_t hash[SCRIBE_HASH_SIZE];
+        err = process_task(task, ctx->blob_format, &result);
+        free_task(ctx->queue, task);
         if (err != SCRIBE_OK) {
             ctx->err = err;
             continue;
         }
-        err = results_add(ctx->results, &result);
+        err = scribe_object_write(ctx->ctx, SCRIBE_OBJECT_BLOB, result.payload, result.payload_len, hash);
+        if (err == SCRIBE_OK) {
+            err = results_add(ctx->results, &result, hash);
+        }
+        result_free(&result);
         if (err != SCRIBE_OK) {
-            result_free(&result);
             ctx->err = err;
         }
     }
@@ -761,7 +502,7 @@ static void *worker_main(void *arg) {
  * Returns whether a database should be skipped during cluster-scoped bootstrap.
  * The excluded list comes from `.scribe/config` as comma-separated names.
  */
-static int is_excluded_db(scribe_ctx *ctx, const char *db) {
+int scribe_mongo_is_excluded_db(scribe_ctx *ctx, const char *db) {
     char excluded[sizeof(ctx->config.adapter_excluded_databases)];
     char *save = NULL;
     char *tok;
@@ -901,34 +642,32 @@ static scribe_error_t capture_start_resume_token(mongoc_client_t *client, const
 }
 
 /*
- * Chooses the bootstrap worker count. An explicit config value wins; otherwise
- * use the online CPU count with a minimum of one worker.
+ * Chooses the bootstrap worker count; see scribe_worker_count().
  */
-static long worker_count(scribe_ctx *ctx) {
-    long n;
-
-    if (ctx->config.worker_threads > 0) {
-        return ctx->config.worker_threads;
-    }
-    n = sysconf(_SC_NPROCESSORS_ONLN);
-    if (n < 1) {
-        return 1;
-    }
-    return n;
+long scribe_mongo_worker_count(scribe_ctx *ctx) {
+    return (long)scribe_worker_count(ctx);
 }
 
 /*
  * Enumerates every document in one MongoDB collection and pushes copied BSON
- * tasks into the bootstrap queue.
+ * tasks into the bootstrap queue. The namespace is interned once, and every
+ * task shares it.
  */
-static scribe_error_t enqueue_collection(mongo_task_queue *queue, mongoc_collection_t *collection, const char *db_name,
-                                         const char *coll_name) {
+static scribe_error_t enqueue_collection(scribe_ctx *ctx, mongo_task_queue *queue, mongoc_collection_t *collection,
+                                         const char *db_name, const char *coll_name) {
     bson_t query;
     bson_t opts;
     mongoc_cursor_t *cursor;
     const bson_t *doc;
     bson_error_t error;
+    const char *db;
+    const char *coll;
+    scribe_error_t err;
 
+    if ((err = scribe_intern(ctx, db_name, strlen(db_name), &db, NULL)) != SCRIBE_OK ||
+        (err = scribe_intern(ctx, coll_name, strlen(coll_name), &coll, NULL)) != SCRIBE_OK) {
+        return err;
+    }
     bson_init(&query);
     bson_init(&opts);
     BSON_APPEND_INT32(&opts, "batchSize", 1000);
@@ -944,16 +683,26 @@ static scribe_error_t enqueue_collection(mongo_task_queue *queue, mongoc_collect
             mongoc_cursor_destroy(cursor);
             return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo task");
         }
+        /*
+         * Reserve before copying so a full memory budget stalls enumeration
+         * until workers have released earlier documents.
+         */
+        if (scribe_mem_reserve(queue->mem, doc->len) != SCRIBE_OK) {
+            free(task);
+            mongoc_cursor_destroy(cursor);
+            return SCRIBE_ERR;
+        }
+        task->reserved = doc->len;
         task->doc = bson_copy(doc);
-        task->db = strdup(db_name);
-        task->coll = strdup(coll_name);
-        if (task->doc == NULL || task->db == NULL || task->coll == NULL) {
-            free_task(task);
+        task->db = db;
+        task->coll = coll;
+        if (task->doc == NULL) {
+            free_task(queue, task);
             mongoc_cursor_destroy(cursor);
             return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo task contents");
         }
         if (task_queue_push(queue, task) != SCRIBE_OK) {
-            free_task(task);
+            free_task(queue, task);
             mongoc_cursor_destroy(cursor);
             return SCRIBE_ERR;
         }
@@ -970,7 +719,7 @@ static scribe_error_t enqueue_collection(mongo_task_queue *queue, mongoc_collect
  * Lists collections in one database and enqueues all documents from each
  * collection for bootstrap worker processing.
  */
-static scribe_error_t enqueue_database_documents(mongoc_client_t *client, mongo_task_queue *queue,
+static scribe_error_t enqueue_database_documents(scribe_ctx *ctx, mongoc_client_t *client, mongo_task_queue *queue,
                                                  const char *db_name) {
     bson_error_t error;
     mongoc_database_t *db;
@@ -986,7 +735,7 @@ static scribe_error_t enqueue_database_documents(mongoc_client_t *client, mongo_
     }
     for (j = 0; collections[j] != NULL; j++) {
         mongoc_collection_t *collection = mongoc_database_get_collection(db, collections[j]);
-        scribe_error_t err = enqueue_collection(queue, collection, db_name, collections[j]);
+        scribe_error_t err = enqueue_collection(ctx, queue, collection, db_name, collections[j]);
         mongoc_collection_destroy(collection);
         if (err != SCRIBE_OK) {
             bson_strfreev(collections);
@@ -1010,7 +759,7 @@ static scribe_error_t enqueue_all_documents(scribe_ctx *ctx, mongoc_client_t *cl
     size_t i;
 
     if (scope != NULL && scope->database != NULL) {
-        return enqueue_database_documents(client, queue, scope->database);
+        return enqueue_database_documents(ctx, client, queue, scope->database);
     }
     dbs = mongoc_client_get_database_names_with_opts(client, NULL, &error);
     if (dbs == NULL) {
@@ -1018,10 +767,10 @@ static scribe_error_t enqueue_all_documents(scribe_ctx *ctx, mongoc_client_t *cl
     }
     for (i = 0; dbs[i] != NULL; i++) {
         scribe_error_t err;
-        if (is_excluded_db(ctx, dbs[i])) {
+        if (scribe_mongo_is_excluded_db(ctx, dbs[i])) {
             continue;
         }
-        err = enqueue_database_documents(client, queue, dbs[i]);
+        err = enqueue_database_documents(ctx, client, queue, dbs[i]);
         if (err != SCRIBE_OK) {
             bson_strfreev(dbs);
             return err;
@@ -1035,7 +784,7 @@ static scribe_error_t enqueue_all_documents(scribe_ctx *ctx, mongoc_client_t *cl
  * Returns the current wall-clock time as Unix nanoseconds for synthetic commit
  * timestamps such as bootstrap commits.
  */
-static int64_t unix_nanos_now(void) {
+int64_t scribe_mongo_unix_nanos_now(void) {
     struct timespec ts;
     clock_gettime(CLOCK_REALTIME, &ts);
     return (int64_t)ts.tv_sec * INT64_C(1000000000) + (int64_t)ts.tv_nsec;
@@ -1053,12 +802,36 @@ static void iso8601_now(char out[32]) {
 }
 
 /*
- * Writes `.scribe/adapter-state/mongodb` after a successful bootstrap or change
- * stream commit. The file records the resume token, last commit hash, and
- * update timestamp in the strict three-line v1 format.
+ * Returns the heap-owned adapter-state path of a session:
+ * `adapter-state/mongodb` for a store's only watcher, and
+ * `adapter-state/mongodb-<key>` for a session hosted by the daemon.
  */
-static scribe_error_t write_adapter_state(scribe_ctx *ctx, const char *resume_token,
-                                          const uint8_t commit_hash[SCRIBE_HASH_SIZE]) {
+static char *adapter_state_path(scribe_ctx *ctx, const char *key) {
+    size_t len = sizeof("adapter-state/mongodb-") + (key == NULL ? 0u : strlen(key));
+    char *rel = (char *)malloc(len);
+    char *path;
+
+    if (rel == NULL) {
+        return NULL;
+    }
+    if (key == NULL) {
+        snprintf(rel, len, "adapter-state/mongodb");
+    } else {
+        snprintf(rel, len, "adapter-state/mongodb-%s", key);
+    }
+    path = scribe_path_join(ctx->repo_path, rel);
+    free(rel);
+    return path;
+}
+
+/*
+ * Writes `.scribe/adapter-state/mongodb` (or a hosted session's own file, see
+ * adapter_state_path()) after a successful bootstrap or change stream commit.
+ * The file records the resume token, last commit hash, and update timestamp in
+ * the strict three-line v1 format.
+ */
+scribe_error_t scribe_mongo_write_adapter_state(scribe_ctx *ctx, const char *key, const char *resume_token,
+                                                const uint8_t commit_hash[SCRIBE_HASH_SIZE]) {
     char hex[SCRIBE_HEX_HASH_SIZE + 1];
     char ts[32];
     char *body;
@@ -1074,13 +847,15 @@ static scribe_error_t write_adapter_state(scribe_ctx *ctx, const char *resume_to
      * refs/heads/main has advanced. If Scribe exits after the commit but before
      * this file update, restart may replay from an older token, but the commit
      * path is deterministic and ref CAS prevents silent history corruption.
+     * In relaxed durability mode the write is queued behind the pending ref,
+     * so the file never names a commit that is not yet on disk.
      */
     dir = scribe_path_join(ctx->repo_path, "adapter-state");
     if (dir == NULL) {
         return SCRIBE_ENOMEM;
     }
     err = scribe_mkdir_p(dir);
-    path = scribe_path_join(dir, "mongodb");
+    path = adapter_state_path(ctx, key);
     free(dir);
     if (err != SCRIBE_OK) {
         free(path);
@@ -1111,7 +886,7 @@ static scribe_error_t write_adapter_state(scribe_ctx *ctx, const char *resume_to
                    "last_commit %s\n"
                    "last_updated %s\n",
                    resume_token == NULL ? "" : resume_token, hex, ts);
-    err = scribe_write_file_atomic(path, (const uint8_t *)body, body_len);
+    err = scribe_publish_file(ctx, path, (const uint8_t *)body, body_len);
     free(body);
     free(path);
     return err;
@@ -1122,7 +897,7 @@ static scribe_error_t write_adapter_state(scribe_ctx *ctx, const char *resume_to
  * returned as a heap string and the last commit hash is decoded for callers that
  * want to inspect the stored boundary.
  */
-static scribe_error_t read_adapter_state(scribe_ctx *ctx, char **out_resume_token,
+static scribe_error_t read_adapter_state(scribe_ctx *ctx, const char *key, char **out_resume_token,
                                          uint8_t out_last_commit[SCRIBE_HASH_SIZE]) {
     char *path;
     uint8_t *bytes = NULL;
@@ -1143,7 +918,7 @@ static scribe_error_t read_adapter_state(scribe_ctx *ctx, char **out_resume_toke
         return scribe_set_error(SCRIBE_EINVAL, "invalid adapter state output");
     }
     *out_resume_token = NULL;
-    path = scribe_path_join(ctx->repo_path, "adapter-state/mongodb");
+    path = adapter_state_path(ctx, key);
     if (path == NULL) {
         return SCRIBE_ENOMEM;
     }
@@ -1196,46 +971,33 @@ static scribe_error_t read_adapter_state(scribe_ctx *ctx, char **out_resume_toke
  * current HEAD commit hash. This records that a previous resume token can no
  * longer be trusted.
  */
-static scribe_error_t mark_adapter_state_invalid(scribe_ctx *ctx) {
+static scribe_error_t mark_adapter_state_invalid(scribe_ctx *ctx, const char *key) {
     uint8_t head[SCRIBE_HASH_SIZE];
     scribe_error_t err = scribe_refs_read(ctx, "refs/heads/main", head);
 
     if (err != SCRIBE_OK) {
         return err;
     }
-    return write_adapter_state(ctx, SCRIBE_MONGO_STATE_INVALID, head);
+    return scribe_mongo_write_adapter_state(ctx, key, SCRIBE_MONGO_STATE_INVALID, head);
 }
 
 /*
- * Converts all bootstrap worker results into one snapshot commit. It first
- * builds an in-memory tree, writes blobs/trees, then wraps the root in a commit.
+ * Converts the bootstrap snapshot into one commit. Every blob is already
+ * written; the builder merges its sorted records into trees bottom-up, then the
+ * session's sink wraps the root in a commit. A hosted session's snapshot only
+ * replaces the databases it watched.
  */
-static scribe_error_t commit_results(scribe_ctx *ctx, mongo_results *results, uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+static scribe_error_t commit_results(const mongo_watch_scope *scope, mongo_results *results,
+                                     uint8_t out_commit[SCRIBE_HASH_SIZE]) {
     scribe_change_batch batch;
-    mongo_snapshot_node *root;
     uint8_t root_hash[SCRIBE_HASH_SIZE];
-    size_t i;
     scribe_error_t err;
 
     /*
-     * Bootstrap results are first assembled into an in-memory snapshot tree,
-     * then written as immutable Scribe tree objects. The commit contains no
-     * per-document events because a bootstrap is a baseline snapshot, not a
-     * change stream batch.
+     * The commit contains no per-document events because a bootstrap is a
+     * baseline snapshot, not a change stream batch.
      */
-    root = snapshot_node_new();
-    if (root == NULL) {
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo snapshot root");
-    }
-    for (i = 0; i < results->count; i++) {
-        err = snapshot_add_result(ctx, root, &results->items[i]);
-        if (err != SCRIBE_OK) {
-            snapshot_node_free(root);
-            return err;
-        }
-    }
-    err = snapshot_write_tree(ctx, root, root_hash);
-    snapshot_node_free(root);
+    err = scribe_snapshot_builder_finish(results->builder, root_hash);
     if (err != SCRIBE_OK) {
         return err;
     }
@@ -1245,10 +1007,10 @@ static scribe_error_t commit_results(scribe_ctx *ctx, mongo_results *results, ui
     batch.author = (scribe_identity){"unknown", "", "unknown"};
     batch.committer = (scribe_identity){"scribe-mongo", "", "scribe"};
     batch.process = (scribe_process_info){"mongo-bootstrap", SCRIBE_VERSION, "", ""};
-    batch.timestamp_unix_nanos = unix_nanos_now();
+    batch.timestamp_unix_nanos = scribe_mongo_unix_nanos_now();
     batch.message = "mongo bootstrap";
     batch.message_len = strlen(batch.message);
-    return scribe_commit_root_internal(ctx, root_hash, &batch, out_commit);
+    return scope->sink->commit_root(scope->sink, root_hash, scope->database, &batch, out_commit);
 }
 
 /*
@@ -1277,7 +1039,7 @@ static scribe_error_t run_bootstrap(scribe_ctx *ctx, mongoc_client_t *client, co
     if (err != SCRIBE_OK) {
         return err;
     }
-    workers = worker_count(ctx);
+    workers = scribe_mongo_worker_count(ctx);
     if (workers < 1) {
         workers = 1;
     }
@@ -1289,21 +1051,24 @@ static scribe_error_t run_bootstrap(scribe_ctx *ctx, mongoc_client_t *client, co
         free(start_resume_token);
         return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate Mongo worker pool");
     }
-    if ((err = task_queue_init(&queue, ctx->config.event_queue_capacity)) != SCRIBE_OK ||
-        (err = results_init(&results)) != SCRIBE_OK) {
+    if ((err = task_queue_init(&queue, ctx->config.event_queue_capacity, &ctx->mem)) != SCRIBE_OK ||
+        (err = results_init(ctx, &results)) != SCRIBE_OK) {
         free(threads);
         free(worker_ctxs);
         free(start_resume_token);
         return err;
     }
     for (i = 0; i < workers; i++) {
+        worker_ctxs[i].ctx = ctx;
         worker_ctxs[i].queue = &queue;
         worker_ctxs[i].results = &results;
+        worker_ctxs[i].blob_format = ctx->config.adapter_blob_format;
         if (pthread_create(&threads[i], NULL, worker_main, &worker_ctxs[i]) != 0) {
             err = scribe_set_error(SCRIBE_ERR, "failed to start Mongo worker");
             workers = i;
             break;
         }
+        scribe_worker_pin(ctx, threads[i], (unsigned)i);
     }
     if (err == SCRIBE_OK) {
         err = enqueue_all_documents(ctx, client, scope, &queue);
@@ -1316,16 +1081,17 @@ static scribe_error_t run_bootstrap(scribe_ctx *ctx, mongoc_client_t *client, co
         }
     }
     if (err == SCRIBE_OK) {
-        err = commit_results(ctx, &results, commit_hash);
+        err = commit_results(scope, &results, commit_hash);
     }
     if (err == SCRIBE_OK) {
-        err = write_adapter_state(ctx, start_resume_token, commit_hash);
+        err = scribe_mongo_write_adapter_state(ctx, scope->sink->key, start_resume_token, commit_hash);
     }
     if (err == SCRIBE_OK) {
         scribe_hash_to_hex(commit_hash, commit_hex);
         scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo", "bootstrap commit %s with %zu document(s)", commit_hex,
                        results.count);
     }
+    scribe_log_memory(ctx, "bootstrap");
     results_destroy(&results);
     task_queue_destroy(&queue);
     free(threads);
@@ -1346,8 +1112,9 @@ static void mongo_signal_handler(int signo) {
 }
 
 /*
- * Installs SIGTERM/SIGINT handlers for clean adapter shutdown. On shutdown the
- * watch loop drains the current batch before releasing the repository lock.
+ * Installs SIGTERM/SIGINT handlers for a standalone `mongo-watch`. On shutdown
+ * the watch loop drains the current batch before releasing the repository
+ * lock. Sessions hosted by the daemon leave signals to the daemon.
  */
 static scribe_error_t install_signal_handlers(void) {
     struct sigaction sa;
@@ -1375,6 +1142,9 @@ typedef struct {
     char *resume_token;
     char *txn_key;
     int64_t timestamp_unix_nanos;
+    scribe_mem_budget *mem;
+    size_t reserved;
+    scribe_session_sink *sink;
 } mongo_watch_batch;
 
 /*
@@ -1386,8 +1156,6 @@ static void watch_change_free(mongo_watch_change *change) {
         return;
     }
     if (change->path != NULL) {
-        free((void *)change->path[0]);
-        free((void *)change->path[1]);
         free((void *)change->path[2]);
         free(change->path);
     }
@@ -1397,9 +1165,13 @@ static void watch_change_free(mongo_watch_change *change) {
 
 /*
  * Frees all pending changes, resume token, and transaction key owned by a watch
- * batch. It is safe to call for empty batches.
+ * batch and returns its payload reservation to the memory budget. The budget
+ * and sink pointers survive so the batch can be reused. It is safe to call for
+ * empty batches.
  */
 static void watch_batch_clear(mongo_watch_batch *batch) {
+    scribe_mem_budget *mem;
+    scribe_session_sink *sink;
     size_t i;
 
     if (batch == NULL) {
@@ -1411,7 +1183,12 @@ static void watch_batch_clear(mongo_watch_batch *batch) {
     free(batch->items);
     free(batch->resume_token);
     free(batch->txn_key);
+    scribe_mem_release(batch->mem, batch->reserved);
+    mem = batch->mem;
+    sink = batch->sink;
     memset(batch, 0, sizeof(*batch));
+    batch->mem = mem;
+    batch->sink = sink;
 }
 
 /*
@@ -1487,9 +1264,9 @@ static void watch_batch_log_commit_summary(scribe_ctx *ctx, const char *commit_h
 }
 
 /*
- * Commits the current watch batch to Scribe and then persists adapter state.
- * Empty batches are a no-op; nonempty batches transfer their change events into
- * a normal scribe_change_batch.
+ * Commits the current watch batch through the session's sink and then persists
+ * adapter state. Empty batches are a no-op; nonempty batches transfer their
+ * change events into a normal scribe_change_batch.
  */
 static scribe_error_t watch_batch_commit(scribe_ctx *ctx, mongo_watch_batch *watch_batch) {
     scribe_change_event *events;
@@ -1527,12 +1304,12 @@ static scribe_error_t watch_batch_commit(scribe_ctx *ctx, mongo_watch_batch *wat
     batch.timestamp_unix_nanos = watch_batch->timestamp_unix_nanos;
     batch.message = watch_batch->txn_key == NULL ? "mongo change stream" : "mongo transaction";
     batch.message_len = strlen(batch.message);
-    err = scribe_commit_batch(ctx, &batch, commit_hash);
+    err = watch_batch->sink->commit(watch_batch->sink, &batch, commit_hash);
     free(events);
     if (err != SCRIBE_OK) {
         return err;
     }
-    err = write_adapter_state(ctx, watch_batch->resume_token, commit_hash);
+    err = scribe_mongo_write_adapter_state(ctx, watch_batch->sink->key, watch_batch->resume_token, commit_hash);
     if (err != SCRIBE_OK) {
         return err;
     }
@@ -1542,6 +1319,28 @@ static scribe_error_t watch_batch_commit(scribe_ctx *ctx, mongo_watch_batch *wat
     return SCRIBE_OK;
 }
 
+/*
+ * Reserves `bytes` of change payload for a batch. A transaction is never split
+ * across commits: when the memory budget is full the reservation waits for
+ * other holders, and once the batch's own bytes (or those of other sessions
+ * blocked the same way) are all that is reserved it is admitted over the
+ * limit, as one oversized item would be.
+ */
+static scribe_error_t watch_batch_admit(scribe_ctx *ctx, mongo_watch_batch *batch, size_t bytes) {
+    scribe_error_t err;
+
+    if (scribe_mem_try_reserve(batch->mem, bytes)) {
+        batch->reserved += bytes;
+        return SCRIBE_OK;
+    }
+    err = scribe_mem_reserve_more(batch->mem, batch->reserved, bytes);
+    if (err == SCRIBE_OK) {
+        batch->reserved += bytes;
+        scribe_log_memory(ctx, "mongo-watch");
+    }
+    return err;
+}
+
 /*
  * Returns whether an adapter-state resume token should be used. Empty and
  * explicitly invalid tokens force bootstrap instead of stream resume.
@@ -1550,14 +1349,55 @@ static int token_is_usable(const char *resume_token) {
     return resume_token != NULL && resume_token[0] != '\0' && strcmp(resume_token, SCRIBE_MONGO_STATE_INVALID) != 0;
 }
 
+/*
+ * Parses one unsigned 32-bit decimal field of an operation time.
+ */
+static int parse_u32_field(const char *s, const char **end, uint32_t *out) {
+    unsigned long long v = 0;
+    const char *p = s;
+
+    while (*p >= '0' && *p <= '9') {
+        v = v * 10u + (unsigned long long)(*p - '0');
+        if (v > UINT32_MAX) {
+            return 0;
+        }
+        p++;
+    }
+    *end = p;
+    *out = (uint32_t)v;
+    return p != s;
+}
+
+/*
+ * Parses an oplog operation time written as `<seconds>[.<increment>]`, the two
+ * halves of a BSON Timestamp. A missing increment means 0.
+ */
+scribe_error_t scribe_mongo_parse_optime(const char *text, uint32_t *out_seconds, uint32_t *out_increment) {
+    const char *end = NULL;
+
+    if (text == NULL || !parse_u32_field(text, &end, out_seconds)) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid oplog time '%s'", text == NULL ? "" : text);
+    }
+    *out_increment = 0;
+    if (*end == '.' && !parse_u32_field(end + 1, &end, out_increment)) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid oplog time '%s'", text);
+    }
+    if (*end != '\0') {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid oplog time '%s'", text);
+    }
+    return SCRIBE_OK;
+}
+
 /*
  * Recognizes MongoDB errors that mean a saved resume token can no longer be
  * used. These errors trigger invalidate recovery rather than a hard adapter stop.
+ * An imported optime older than the oplog window fails the same way.
  */
 static int mongo_resume_error_is_unusable(const char *message) {
     return message != NULL &&
            (strstr(message, "cannot resume stream") != NULL || strstr(message, "resume token was not found") != NULL ||
-            strstr(message, "Resume token was not found") != NULL);
+            strstr(message, "Resume token was not found") != NULL ||
+            strstr(message, "resume point may no longer be in the oplog") != NULL);
 }
 
 /*
@@ -1576,13 +1416,150 @@ static scribe_error_t resume_token_to_base64(const bson_t *token, char **out) {
 }
 
 /*
- * Opens a MongoDB change stream with v1 options and optional resumeAfter token.
- * When Mongo rejects the token as unusable, resume_token_unusable is set so the
- * caller can restart bootstrap automatically.
+ * Turns on changeStreamPreAndPostImages for one collection with collMod.
+ * MongoDB stores images only for writes made afterwards.
+ */
+static scribe_error_t enable_post_images(scribe_ctx *ctx, mongoc_database_t *db, const char *db_name,
+                                         const char *coll) {
+    bson_t cmd;
+    bson_t child;
+    bson_t reply;
+    bson_error_t error;
+    bool ok;
+
+    bson_init(&cmd);
+    BSON_APPEND_UTF8(&cmd, "collMod", coll);
+    BSON_APPEND_DOCUMENT_BEGIN(&cmd, "changeStreamPreAndPostImages", &child);
+    BSON_APPEND_BOOL(&child, "enabled", true);
+    bson_append_document_end(&cmd, &child);
+    ok = mongoc_database_command_simple(db, &cmd, NULL, &reply, &error);
+    bson_destroy(&cmd);
+    bson_destroy(&reply);
+    if (!ok) {
+        return scribe_set_error(SCRIBE_EADAPTER, "failed to enable change stream post-images on %s.%s: %s", db_name,
+                                coll, error.message);
+    }
+    scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo", "enabled change stream post-images on %s.%s", db_name, coll);
+    return SCRIBE_OK;
+}
+
+/*
+ * Counts the collections of one database with and without stored post-images,
+ * first enabling them when adapter.mongodb.enable_post_images is set. Views,
+ * time series collections, and system collections have no change stream
+ * images and are skipped.
+ */
+static scribe_error_t probe_database_post_images(scribe_ctx *ctx, mongoc_client_t *client, const char *db_name,
+                                                 size_t *with, size_t *without) {
+    mongoc_database_t *db = mongoc_client_get_database(client, db_name);
+    mongoc_cursor_t *cursor = mongoc_database_find_collections_with_opts(db, NULL);
+    const bson_t *info = NULL;
+    bson_error_t error;
+    scribe_error_t err = SCRIBE_OK;
+
+    while (err == SCRIBE_OK && mongoc_cursor_next(cursor, &info)) {
+        bson_iter_t iter;
+        bson_iter_t enabled;
+        const char *name;
+
+        if (!bson_iter_init_find(&iter, info, "name") || !BSON_ITER_HOLDS_UTF8(&iter)) {
+            continue;
+        }
+        name = bson_iter_utf8(&iter, NULL);
+        if (strncmp(name, "system.", 7) == 0 || (bson_iter_init_find(&iter, info, "type") &&
+                                                 BSON_ITER_HOLDS_UTF8(&iter) &&
+                                                 strcmp(bson_iter_utf8(&iter, NULL), "collection") != 0)) {
+            continue;
+        }
+        if (bson_iter_init(&iter, info) &&
+            bson_iter_find_descendant(&iter, "options.changeStreamPreAndPostImages.enabled", &enabled) &&
+            BSON_ITER_HOLDS_BOOL(&enabled) && bson_iter_bool(&enabled)) {
+            (*with)++;
+        } else if (ctx->config.adapter_enable_post_images) {
+            err = enable_post_images(ctx, db, db_name, name);
+            if (err == SCRIBE_OK) {
+                (*with)++;
+            }
+        } else {
+            scribe_log_msg(ctx, ctx->config.adapter_require_pre_post_images ? SCRIBE_LOG_WARN : SCRIBE_LOG_DEBUG,
+                           "mongo", "collection %s.%s has no change stream post-images", db_name, name);
+            (*without)++;
+        }
+    }
+    if (err == SCRIBE_OK && mongoc_cursor_error(cursor, &error)) {
+        err = scribe_set_error(SCRIBE_EADAPTER, "failed to list Mongo collections for database '%s': %s", db_name,
+                               error.message);
+    }
+    mongoc_cursor_destroy(cursor);
+    mongoc_database_destroy(db);
+    return err;
+}
+
+/*
+ * Chooses how update events get their documents for the next change stream by
+ * checking changeStreamPreAndPostImages on every watched collection; see
+ * scribe_choose_full_document for the rule.
+ */
+static scribe_error_t choose_full_document_mode(scribe_ctx *ctx, mongoc_client_t *client,
+                                                const mongo_watch_scope *scope, scribe_full_document *out) {
+    bson_error_t error;
+    char **dbs = NULL;
+    size_t with = 0;
+    size_t without = 0;
+    size_t i;
+    scribe_error_t err;
+
+    if (scope != NULL && scope->database != NULL) {
+        err = probe_database_post_images(ctx, client, scope->database, &with, &without);
+    } else {
+        dbs = mongoc_client_get_database_names_with_opts(client, NULL, &error);
+        if (dbs == NULL) {
+            return scribe_set_error(SCRIBE_EADAPTER, "failed to list Mongo databases: %s", error.message);
+        }
+        err = SCRIBE_OK;
+        for (i = 0; err == SCRIBE_OK && dbs[i] != NULL; i++) {
+            if (!scribe_mongo_is_excluded_db(ctx, dbs[i])) {
+                err = probe_database_post_images(ctx, client, dbs[i], &with, &without);
+            }
+        }
+        bson_strfreev(dbs);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_choose_full_document(&ctx->config, with, without, out);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo", "using fullDocument=%s; %zu of %zu collection(s) store post-images",
+                   scribe_full_document_name(*out), with, with + without);
+    return SCRIBE_OK;
+}
+
+/*
+ * Logs how update events got their documents so far. Every post-image is a
+ * primary read that updateLookup would have made.
+ */
+static void log_post_image_stats(scribe_ctx *ctx, const mongo_post_images *pi) {
+    if (pi->post_images + pi->server_lookups + pi->fallback_lookups == 0) {
+        return;
+    }
+    scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo",
+                   "update documents: %llu from post-images (lookups avoided), %llu server lookups, %llu fallback "
+                   "lookups, %llu already deleted",
+                   (unsigned long long)pi->post_images, (unsigned long long)pi->server_lookups,
+                   (unsigned long long)pi->fallback_lookups, (unsigned long long)pi->vanished);
+}
+
+/*
+ * Opens a MongoDB change stream with v1 options and optional resumeAfter token,
+ * or startAtOperationTime for an optime token left by `scribe import`. When
+ * Mongo rejects either as unusable, resume_token_unusable is set so the caller
+ * can restart bootstrap automatically.
  */
 static scribe_error_t open_change_stream(mongoc_client_t *client, const mongo_watch_scope *scope,
-                                         const char *resume_token, mongoc_change_stream_t **out,
-                                         int *resume_token_unusable) {
+                                         scribe_full_document mode, const char *resume_token,
+                                         mongoc_change_stream_t **out, int *resume_token_unusable) {
     bson_t pipeline;
     bson_t opts;
     bson_t resume_doc;
@@ -1599,17 +1576,29 @@ static scribe_error_t open_change_stream(mongoc_client_t *client, const mongo_wa
     }
     /*
      * The watch is either cluster-scoped or database-scoped depending on the URI.
-     * fullDocument=updateLookup makes updates commit the full post-image
-     * document, while fullDocumentBeforeChange=whenAvailable asks MongoDB for
-     * pre-images without requiring them for all deployments.
+     * fullDocument makes updates carry the full post-change document, from a
+     * stored post-image or a server-side lookup (see scribe_full_document).
+     * Pre-images are not requested: Scribe stores states, not the change
+     * between them, and already holds every previous version.
      */
     bson_init(&pipeline);
     bson_init(&opts);
-    BSON_APPEND_UTF8(&opts, "fullDocument", "updateLookup");
-    BSON_APPEND_UTF8(&opts, "fullDocumentBeforeChange", "whenAvailable");
+    BSON_APPEND_UTF8(&opts, "fullDocument", scribe_full_document_name(mode));
     BSON_APPEND_INT32(&opts, "maxAwaitTimeMS", 500);
     BSON_APPEND_BOOL(&opts, "showExpandedEvents", true);
-    if (token_is_usable(resume_token)) {
+    if (token_is_usable(resume_token) &&
+        strncmp(resume_token, SCRIBE_MONGO_STATE_OPTIME_PREFIX, strlen(SCRIBE_MONGO_STATE_OPTIME_PREFIX)) == 0) {
+        uint32_t seconds = 0;
+        uint32_t increment = 0;
+        err = scribe_mongo_parse_optime(resume_token + strlen(SCRIBE_MONGO_STATE_OPTIME_PREFIX), &seconds, &increment);
+        if (err != SCRIBE_OK) {
+            bson_destroy(&pipeline);
+            bson_destroy(&opts);
+            return err;
+        }
+        has_resume_doc = 1;
+        BSON_APPEND_TIMESTAMP(&opts, "startAtOperationTime", seconds, increment);
+    } else if (token_is_usable(resume_token)) {
         err = base64_decode(resume_token, &decoded, &decoded_len);
         if (err != SCRIBE_OK) {
             bson_destroy(&pipeline);
@@ -1641,7 +1630,7 @@ static scribe_error_t open_change_stream(mongoc_client_t *client, const mongo_wa
         return scribe_set_error(SCRIBE_EADAPTER, "failed to open MongoDB change stream: %s", error.message);
     }
     if (has_resume_doc) {
-        scribe_log_msg(NULL, SCRIBE_LOG_DEBUG, "mongo", "opened MongoDB change stream from saved resume token");
+        scribe_log_msg(NULL, SCRIBE_LOG_DEBUG, "mongo", "opened MongoDB change stream from saved resume point");
     }
     *out = stream;
     return SCRIBE_OK;
@@ -1687,14 +1676,15 @@ static scribe_error_t event_operation(const bson_t *event, const char **out) {
  * Classifies MongoDB operationType values into data events Scribe commits,
  * invalidation events that restart bootstrap, and DDL/schema events that are logged.
  * v1 records document state, not MongoDB catalog metadata, so catalog-only
- * events such as create/createIndexes do not become commits. Destructive DDL is
+ * events such as create/createIndexes/modify do not become commits; modify is
+ * the collMod event, including the one that enables post-images. Destructive DDL is
  * different: drop/rename/dropDatabase can invalidate the stream or change a
  * whole subtree without per-document events, so bootstrap is the conservative
  * way to converge Scribe's root tree to MongoDB's current state.
  */
 static mongo_event_kind classify_operation(const char *op) {
     if (strcmp(op, "insert") == 0 || strcmp(op, "update") == 0 || strcmp(op, "replace") == 0 ||
-        strcmp(op, "modify") == 0 || strcmp(op, "delete") == 0) {
+        strcmp(op, "delete") == 0) {
         return MONGO_EVENT_DATA;
     }
     if (strcmp(op, "invalidate") == 0 || strcmp(op, "drop") == 0 || strcmp(op, "dropDatabase") == 0 ||
@@ -1705,15 +1695,17 @@ static mongo_event_kind classify_operation(const char *op) {
 }
 
 /*
- * Extracts ns.db and ns.coll from a change-stream event and duplicates them for
+ * Extracts ns.db and ns.coll from a change-stream event and interns them for
  * use in a Scribe path.
  */
-static scribe_error_t event_namespace(const bson_t *event, char **out_db, char **out_coll) {
+static scribe_error_t event_namespace(scribe_ctx *ctx, const bson_t *event, const char **out_db,
+                                      const char **out_coll) {
     bson_t ns;
     bson_iter_t iter;
     uint32_t len;
     const char *db;
     const char *coll;
+    scribe_error_t err;
 
     if (event_document(event, "ns", &ns) != SCRIBE_OK) {
         return SCRIBE_EADAPTER;
@@ -1722,22 +1714,15 @@ static scribe_error_t event_namespace(const bson_t *event, char **out_db, char *
         return scribe_set_error(SCRIBE_EADAPTER, "MongoDB change stream event missing ns.db");
     }
     db = bson_iter_utf8(&iter, &len);
-    (void)len;
+    err = scribe_intern(ctx, db, len, out_db, NULL);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
     if (!bson_iter_init_find(&iter, &ns, "coll") || !BSON_ITER_HOLDS_UTF8(&iter)) {
         return scribe_set_error(SCRIBE_EADAPTER, "MongoDB change stream event missing ns.coll");
     }
     coll = bson_iter_utf8(&iter, &len);
-    (void)len;
-    *out_db = strdup(db);
-    *out_coll = strdup(coll);
-    if (*out_db == NULL || *out_coll == NULL) {
-        free(*out_db);
-        free(*out_coll);
-        *out_db = NULL;
-        *out_coll = NULL;
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate MongoDB namespace");
-    }
-    return SCRIBE_OK;
+    return scribe_intern(ctx, coll, len, out_coll, NULL);
 }
 
 /*
@@ -1754,12 +1739,55 @@ static scribe_error_t event_document_id(const bson_t *event, char **out_id) {
 }
 
 /*
- * Converts a MongoDB data event into a Scribe watch change. Deletes become
- * tombstones; inserts/updates/replaces/modifies store the full canonical document.
+ * Reads the current version of an update event's document, as updateLookup
+ * would, for a collection created without post-images after a whenAvailable
+ * stream was opened. *out is NULL when the document has been deleted since;
+ * the delete event follows in the stream.
  */
-static scribe_error_t build_watch_change(const bson_t *event, const char *op, mongo_watch_change *out) {
-    char *db = NULL;
-    char *coll = NULL;
+static scribe_error_t lookup_current_document(mongoc_client_t *client, const bson_t *event, const char *db,
+                                              const char *coll, bson_t **out) {
+    mongoc_collection_t *collection;
+    mongoc_cursor_t *cursor;
+    const bson_t *doc = NULL;
+    bson_t key;
+    bson_t opts;
+    bson_error_t error;
+    scribe_error_t err = event_document(event, "documentKey", &key);
+
+    *out = NULL;
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    collection = mongoc_client_get_collection(client, db, coll);
+    bson_init(&opts);
+    BSON_APPEND_INT64(&opts, "limit", 1);
+    cursor = mongoc_collection_find_with_opts(collection, &key, &opts, NULL);
+    if (mongoc_cursor_next(cursor, &doc)) {
+        *out = bson_copy(doc);
+        if (*out == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to copy MongoDB document");
+        }
+    } else if (mongoc_cursor_error(cursor, &error)) {
+        err = scribe_set_error(SCRIBE_EADAPTER, "failed to look up a %s.%s document: %s", db, coll, error.message);
+    }
+    mongoc_cursor_destroy(cursor);
+    bson_destroy(&opts);
+    mongoc_collection_destroy(collection);
+    return err;
+}
+
+/*
+ * Converts a MongoDB data event into a Scribe watch change. Deletes become
+ * tombstones; inserts/updates/replaces store the full canonical document. An
+ * update without fullDocument means the server lookup found the document
+ * deleted, or, on a whenAvailable stream, that its collection was created
+ * without post-images after the probe and the document must be read here. If
+ * it is gone, out->path stays NULL and the event is skipped.
+ */
+static scribe_error_t build_watch_change(scribe_ctx *ctx, mongo_post_images *pi, const bson_t *event, const char *op,
+                                         scribe_blob_format format, mongo_watch_change *out) {
+    const char *db = NULL;
+    const char *coll = NULL;
     char *id = NULL;
     uint8_t *payload = NULL;
     size_t payload_len = 0;
@@ -1772,37 +1800,60 @@ static scribe_error_t build_watch_change(const bson_t *event, const char *op, mo
      * field-level delta. Core Scribe stays format-agnostic after this point.
      */
     memset(out, 0, sizeof(*out));
-    err = event_namespace(event, &db, &coll);
+    err = event_namespace(ctx, event, &db, &coll);
     if (err != SCRIBE_OK) {
         return err;
     }
     err = event_document_id(event, &id);
     if (err != SCRIBE_OK) {
-        free(db);
-        free(coll);
         return err;
     }
     if (strcmp(op, "delete") != 0) {
-        bson_t full_doc;
-        err = event_document(event, "fullDocument", &full_doc);
-        if (err != SCRIBE_OK) {
-            free(db);
-            free(coll);
-            free(id);
-            return err;
+        bson_t full_doc = BSON_INITIALIZER;
+        bson_t *looked_up = NULL;
+        bson_iter_t iter;
+        int update = strcmp(op, "update") == 0;
+
+        if (update && pi->mode != SCRIBE_FULL_DOCUMENT_REQUIRED &&
+            (!bson_iter_init_find(&iter, event, "fullDocument") || !BSON_ITER_HOLDS_DOCUMENT(&iter))) {
+            if (pi->mode == SCRIBE_FULL_DOCUMENT_WHEN_AVAILABLE) {
+                pi->fallback_lookups++;
+                err = lookup_current_document(pi->client, event, db, coll, &looked_up);
+            } else {
+                pi->server_lookups++;
+            }
+            if (err == SCRIBE_OK && looked_up == NULL) {
+                pi->vanished++;
+                scribe_log_msg(ctx, SCRIBE_LOG_DEBUG, "mongo", "skipped update of deleted document %s/%s/%s", db,
+                               coll, id);
+                free(id);
+                return SCRIBE_OK;
+            }
+        } else {
+            err = event_document(event, "fullDocument", &full_doc);
+            if (update && pi->mode == SCRIBE_FULL_DOCUMENT_LOOKUP) {
+                pi->server_lookups++;
+            } else if (update) {
+                pi->post_images++;
+            }
+        }
+        if (update && (pi->post_images + pi->server_lookups + pi->fallback_lookups) % 100000u == 0) {
+            log_post_image_stats(ctx, pi);
+        }
+        if (err == SCRIBE_OK) {
+            err = scribe_mongo_encode_document(looked_up != NULL ? looked_up : &full_doc, format, &payload,
+                                               &payload_len);
+        }
+        if (looked_up != NULL) {
+            bson_destroy(looked_up);
         }
-        err = scribe_mongo_canonicalize_bson(&full_doc, &payload, &payload_len);
         if (err != SCRIBE_OK) {
-            free(db);
-            free(coll);
             free(id);
             return err;
         }
     }
     path = (const char **)calloc(3u, sizeof(char *));
     if (path == NULL) {
-        free(db);
-        free(coll);
         free(id);
         free(payload);
         return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate MongoDB change path");
@@ -1827,7 +1878,7 @@ static int64_t event_cluster_time_unix_nanos(const bson_t *event) {
     uint32_t increment;
 
     if (!bson_iter_init_find(&iter, event, "clusterTime") || !BSON_ITER_HOLDS_TIMESTAMP(&iter)) {
-        return unix_nanos_now();
+        return scribe_mongo_unix_nanos_now();
     }
     bson_iter_timestamp(&iter, &seconds, &increment);
     /* MongoDB clusterTime is a Timestamp(seconds, increment). This preserves
@@ -1909,11 +1960,12 @@ static scribe_error_t stream_resume_token(mongoc_change_stream_t *stream, const
  * Non-transactional events commit immediately; transaction events stay batched
  * until the transaction key changes or the stream is flushed.
  */
-static scribe_error_t handle_data_event(scribe_ctx *ctx, mongo_watch_batch *batch, const bson_t *event, const char *op,
-                                        char **resume_token) {
+static scribe_error_t handle_data_event(scribe_ctx *ctx, mongo_post_images *pi, mongo_watch_batch *batch,
+                                        const bson_t *event, const char *op, char **resume_token) {
     mongo_watch_change change;
     char *txn_key = NULL;
     int64_t ts = event_cluster_time_unix_nanos(event);
+    int64_t now = scribe_mongo_unix_nanos_now();
     scribe_error_t err;
 
     /*
@@ -1921,11 +1973,18 @@ static scribe_error_t handle_data_event(scribe_ctx *ctx, mongo_watch_batch *batc
      * transaction stays open until a different transaction key appears, a
      * non-data event forces a flush, shutdown drains it, or the stream ends.
      */
+    /* How far the stream trails the cluster drives adaptive compression. */
+    scribe_object_note_lag(ctx, now > ts ? (uint64_t)(now - ts) / UINT64_C(1000000) : 0u);
     memset(&change, 0, sizeof(change));
-    err = build_watch_change(event, op, &change);
+    err = build_watch_change(ctx, pi, event, op, ctx->config.adapter_blob_format, &change);
     if (err != SCRIBE_OK) {
         return err;
     }
+    if (change.path == NULL) {
+        free(*resume_token);
+        *resume_token = NULL;
+        return SCRIBE_OK;
+    }
     txn_key = event_transaction_key(event);
     if (txn_key == NULL) {
         err = watch_batch_commit(ctx, batch);
@@ -1933,7 +1992,10 @@ static scribe_error_t handle_data_event(scribe_ctx *ctx, mongo_watch_batch *batc
             watch_change_free(&change);
             return err;
         }
-        err = watch_batch_add(batch, &change, resume_token, ts);
+        err = watch_batch_admit(ctx, batch, change.payload_len);
+        if (err == SCRIBE_OK) {
+            err = watch_batch_add(batch, &change, resume_token, ts);
+        }
         if (err == SCRIBE_OK) {
             err = watch_batch_commit(ctx, batch);
         }
@@ -1950,6 +2012,12 @@ static scribe_error_t handle_data_event(scribe_ctx *ctx, mongo_watch_batch *batc
             return err;
         }
     }
+    err = watch_batch_admit(ctx, batch, change.payload_len);
+    if (err != SCRIBE_OK) {
+        free(txn_key);
+        watch_change_free(&change);
+        return err;
+    }
     if (batch->count == 0) {
         batch->txn_key = txn_key;
         txn_key = NULL;
@@ -1982,7 +2050,7 @@ static scribe_error_t restart_bootstrap_after_invalidate(scribe_ctx *ctx, mongoc
     if (err != SCRIBE_OK) {
         return err;
     }
-    err = mark_adapter_state_invalid(ctx);
+    err = mark_adapter_state_invalid(ctx, scope->sink->key);
     if (err != SCRIBE_OK) {
         return err;
     }
@@ -1995,7 +2063,7 @@ static scribe_error_t restart_bootstrap_after_invalidate(scribe_ctx *ctx, mongoc
     *resume_token = NULL;
     {
         uint8_t last_commit[SCRIBE_HASH_SIZE];
-        err = read_adapter_state(ctx, resume_token, last_commit);
+        err = read_adapter_state(ctx, scope->sink->key, resume_token, last_commit);
     }
     return err;
 }
@@ -2006,22 +2074,32 @@ static scribe_error_t restart_bootstrap_after_invalidate(scribe_ctx *ctx, mongoc
  */
 static scribe_error_t run_change_stream(scribe_ctx *ctx, mongoc_client_t *client, const mongo_watch_scope *scope,
                                         char **resume_token) {
+    mongo_post_images pi;
     scribe_error_t err;
 
+    memset(&pi, 0, sizeof(pi));
+    pi.client = client;
     /*
      * Outer loop owns stream creation/recreation. Inner loop consumes events
      * from one stream. Shutdown does not interrupt an in-flight transaction or
      * batch: the loop breaks only after watch_batch_commit() has drained the
      * current data into Scribe history and adapter-state.
      */
-    while (!g_shutdown_requested) {
+    while (!scope->sink->stopping(scope->sink)) {
         mongoc_change_stream_t *stream = NULL;
         mongo_watch_batch batch;
         int restart_stream = 0;
         int resume_token_unusable = 0;
 
         memset(&batch, 0, sizeof(batch));
-        err = open_change_stream(client, scope, *resume_token, &stream, &resume_token_unusable);
+        batch.mem = &ctx->mem;
+        batch.sink = scope->sink;
+        /* Bootstrap restarts can change the collection set, so check again per stream. */
+        err = choose_full_document_mode(ctx, client, scope, &pi.mode);
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+        err = open_change_stream(client, scope, pi.mode, *resume_token, &stream, &resume_token_unusable);
         if (err != SCRIBE_OK) {
             if (resume_token_unusable) {
                 err = restart_bootstrap_after_invalidate(ctx, client, scope, &batch, resume_token);
@@ -2043,7 +2121,7 @@ static scribe_error_t run_change_stream(scribe_ctx *ctx, mongoc_client_t *client
             char *event_token = NULL;
             mongo_event_kind kind;
 
-            if (g_shutdown_requested && batch.txn_key == NULL) {
+            if (batch.txn_key == NULL && scope->sink->stopping(scope->sink)) {
                 break;
             }
             if (mongoc_change_stream_next(stream, &event)) {
@@ -2064,7 +2142,7 @@ static scribe_error_t run_change_stream(scribe_ctx *ctx, mongoc_client_t *client
                     }
                 }
                 if (kind == MONGO_EVENT_DATA) {
-                    err = handle_data_event(ctx, &batch, event, op, &event_token);
+                    err = handle_data_event(ctx, &pi, &batch, event, op, &event_token);
                 } else if (kind == MONGO_EVENT_INVALIDATE) {
                     free(event_token);
                     err = restart_bootstrap_after_invalidate(ctx, client, scope, &batch, resume_token);
@@ -2081,7 +2159,7 @@ static scribe_error_t run_change_stream(scribe_ctx *ctx, mongoc_client_t *client
             }
             if (mongoc_change_stream_error_document(stream, &error, &error_doc)) {
                 (void)error_doc;
-                if (g_shutdown_requested) {
+                if (scope->sink->stopping(scope->sink)) {
                     err = watch_batch_commit(ctx, &batch);
                 } else if (token_is_usable(*resume_token) && mongo_resume_error_is_unusable(error.message)) {
                     err = restart_bootstrap_after_invalidate(ctx, client, scope, &batch, resume_token);
@@ -2096,25 +2174,28 @@ static scribe_error_t run_change_stream(scribe_ctx *ctx, mongoc_client_t *client
                 break;
             }
         }
-        if (g_shutdown_requested && err == SCRIBE_OK) {
+        if (err == SCRIBE_OK && scope->sink->stopping(scope->sink)) {
             err = watch_batch_commit(ctx, &batch);
         }
         watch_batch_clear(&batch);
         mongoc_change_stream_destroy(stream);
         if (err != SCRIBE_OK) {
+            log_post_image_stats(ctx, &pi);
             return err;
         }
     }
+    log_post_image_stats(ctx, &pi);
     scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo", "shutdown requested; MongoDB watch stopped cleanly");
     return SCRIBE_OK;
 }
 
 /*
- * Public Mongo adapter entry point used by the CLI. It initializes libmongoc,
- * opens the client, runs bootstrap when state is missing/invalid, then enters
- * steady-state change stream consumption.
+ * Runs one watch session: opens the client, runs bootstrap when the session's
+ * state is missing/invalid, then consumes the change stream until the sink
+ * reports stopping. libmongoc must already be initialized; the daemon hosts
+ * sessions through this entry point directly.
  */
-scribe_error_t scribe_mongo_watch_bootstrap(scribe_ctx *ctx, const char *uri) {
+scribe_error_t scribe_mongo_watch_session(scribe_ctx *ctx, const char *uri, scribe_session_sink *sink) {
     mongoc_client_t *client = NULL;
     mongo_watch_scope scope;
     char *resume_token = NULL;
@@ -2124,40 +2205,35 @@ scribe_error_t scribe_mongo_watch_bootstrap(scribe_ctx *ctx, const char *uri) {
     if (uri == NULL || uri[0] == '\0') {
         return scribe_set_error(SCRIBE_EINVAL, "MongoDB URI is required");
     }
-    g_shutdown_requested = 0;
-    err = install_signal_handlers();
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    mongoc_init();
     err = mongo_watch_scope_from_uri(uri, &scope);
     if (err != SCRIBE_OK) {
-        mongoc_cleanup();
         return err;
     }
+    scope.sink = sink;
+    if (sink->key != NULL) {
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo", "starting hosted session '%s'", sink->key);
+    }
     if (scope.database != NULL) {
         scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo", "using MongoDB database-scoped watch for '%s'", scope.database);
     }
     client = mongoc_client_new(uri);
     if (client == NULL) {
         mongo_watch_scope_destroy(&scope);
-        mongoc_cleanup();
         return scribe_set_error(SCRIBE_EADAPTER, "failed to create MongoDB client");
     }
     err = verify_topology_with_retry(ctx, client);
     if (err != SCRIBE_OK) {
         mongoc_client_destroy(client);
         mongo_watch_scope_destroy(&scope);
-        mongoc_cleanup();
         return err;
     }
-    err = read_adapter_state(ctx, &resume_token, last_commit);
+    err = read_adapter_state(ctx, sink->key, &resume_token, last_commit);
     if (err == SCRIBE_ENOT_FOUND || !token_is_usable(resume_token)) {
         free(resume_token);
         resume_token = NULL;
         err = run_bootstrap(ctx, client, &scope);
         if (err == SCRIBE_OK) {
-            err = read_adapter_state(ctx, &resume_token, last_commit);
+            err = read_adapter_state(ctx, sink->key, &resume_token, last_commit);
         }
     }
     if (err == SCRIBE_OK) {
@@ -2166,6 +2242,76 @@ scribe_error_t scribe_mongo_watch_bootstrap(scribe_ctx *ctx, const char *uri) {
     free(resume_token);
     mongoc_client_destroy(client);
     mongo_watch_scope_destroy(&scope);
+    return err;
+}
+
+/*
+ * Sink of a standalone `mongo-watch`: commits go straight to main, a bootstrap
+ * snapshot becomes the whole root, and the process's own signal flag stops it.
+ */
+static int direct_stopping(const scribe_session_sink *sink) {
+    (void)sink;
+    return g_shutdown_requested;
+}
+
+/*
+ * Commits one watch batch directly for a standalone `mongo-watch`.
+ */
+static scribe_error_t direct_commit(scribe_session_sink *sink, const scribe_change_batch *batch,
+                                    uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    return scribe_commit_batch((scribe_ctx *)sink->user, batch, out_commit);
+}
+
+/*
+ * Publishes a standalone bootstrap snapshot as main's whole root; the scope is
+ * already all the store holds.
+ */
+static scribe_error_t direct_commit_root(scribe_session_sink *sink, const uint8_t root[SCRIBE_HASH_SIZE],
+                                         const char *scope, const scribe_change_batch *metadata,
+                                         uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    (void)scope;
+    return scribe_commit_root_internal((scribe_ctx *)sink->user, root, metadata, out_commit);
+}
+
+/*
+ * Initializes libmongoc for the whole process. The daemon calls this once
+ * before it starts hosted sessions.
+ */
+void scribe_mongo_global_init(void) {
+    mongoc_init();
+}
+
+/*
+ * Releases libmongoc's process-wide state after the last session has ended.
+ */
+void scribe_mongo_global_cleanup(void) {
+    mongoc_cleanup();
+}
+
+/*
+ * Public Mongo adapter entry point used by `mongo-watch`. It owns the process:
+ * it installs the signal handlers, initializes libmongoc, and runs one session
+ * that commits directly and keeps its state in `adapter-state/mongodb`.
+ */
+scribe_error_t scribe_mongo_watch_bootstrap(scribe_ctx *ctx, const char *uri) {
+    scribe_session_sink sink;
+    scribe_error_t err;
+
+    if (uri == NULL || uri[0] == '\0') {
+        return scribe_set_error(SCRIBE_EINVAL, "MongoDB URI is required");
+    }
+    g_shutdown_requested = 0;
+    err = install_signal_handlers();
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    memset(&sink, 0, sizeof(sink));
+    sink.stopping = direct_stopping;
+    sink.commit = direct_commit;
+    sink.commit_root = direct_commit_root;
+    sink.user = ctx;
+    mongoc_init();
+    err = scribe_mongo_watch_session(ctx, uri, &sink);
     mongoc_cleanup();
     return err;
 }
@@ -0,0 +1,758 @@
+/*
+ * Offline bulk import of MongoDB data from mongodump output or NDJSON files.
+ *
+ * A live bootstrap pulls every document through one cursor per collection.
+ * Import instead memory-maps local files, splits them into chunks on document
+ * boundaries, and lets a worker pool canonicalize, hash, and write blobs in
+ * parallel. Workers hand only (path, blob hash) records to a shared snapshot
+ * builder, which sorts them under the snapshot memory budget, so the root hash
+ * equals what a live bootstrap of the same documents produces.
+ */
+#include "adapter_mongo/mongo_adapter.h"
+
+#include "adapter_mongo/mongo_internal.h"
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/log.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define IMPORT_CHUNK_BYTES ((size_t)4u << 20)
+#define IMPORT_OFFSET_BITS 44u
+
+typedef enum {
+    IMPORT_INPUT_BSON = 0,
+    IMPORT_INPUT_NDJSON = 1,
+} import_input;
+
+typedef struct {
+    char *path;
+    char *db;
+    char *coll;
+    int fd;
+    const uint8_t *map;
+    size_t size;
+} import_file;
+
+typedef struct {
+    const import_file *file;
+    size_t file_index;
+    size_t offset;
+    size_t len;
+} import_chunk;
+
+typedef struct {
+    import_chunk *items;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    int closed;
+    int failed;
+    pthread_mutex_t mu;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} import_queue;
+
+typedef struct {
+    import_file *items;
+    size_t count;
+    size_t cap;
+    scribe_ctx *ctx;
+    const char *root;
+    const char *db;
+} import_files;
+
+typedef struct {
+    pthread_mutex_t mu;
+    scribe_snapshot_builder *builder;
+} import_snapshot;
+
+typedef struct {
+    scribe_ctx *ctx;
+    import_queue *queue;
+    import_input input;
+    scribe_blob_format blob_format;
+    import_snapshot *snapshot;
+    scribe_error_t err;
+    char err_detail[512];
+} import_worker;
+
+/*
+ * Initializes the bounded chunk queue shared by the file scanner and workers.
+ */
+static scribe_error_t import_queue_init(import_queue *q, size_t capacity) {
+    memset(q, 0, sizeof(*q));
+    q->capacity = capacity == 0 ? 1u : capacity;
+    q->items = (import_chunk *)calloc(q->capacity, sizeof(*q->items));
+    if (q->items == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate import queue");
+    }
+    if (pthread_mutex_init(&q->mu, NULL) != 0 || pthread_cond_init(&q->not_empty, NULL) != 0 ||
+        pthread_cond_init(&q->not_full, NULL) != 0) {
+        free(q->items);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize import queue");
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Destroys queue synchronization objects after every worker has exited.
+ */
+static void import_queue_destroy(import_queue *q) {
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_mutex_destroy(&q->mu);
+    free(q->items);
+}
+
+/*
+ * Pushes one chunk, blocking while the queue is full. Returns SCRIBE_ERR once a
+ * worker has failed so the scanner stops reading input it would discard.
+ */
+static scribe_error_t import_queue_push(import_queue *q, const import_chunk *chunk) {
+    pthread_mutex_lock(&q->mu);
+    while (q->count == q->capacity && !q->failed) {
+        pthread_cond_wait(&q->not_full, &q->mu);
+    }
+    if (q->failed) {
+        pthread_mutex_unlock(&q->mu);
+        return SCRIBE_ERR;
+    }
+    q->items[(q->head + q->count) % q->capacity] = *chunk;
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->mu);
+    return SCRIBE_OK;
+}
+
+/*
+ * Pops one chunk, blocking until work arrives, and reports the number of
+ * chunks left behind it. Returns 0 when the queue is closed and drained, or
+ * after a worker failure.
+ */
+static int import_queue_pop(import_queue *q, import_chunk *out, size_t *depth) {
+    int ok = 0;
+
+    pthread_mutex_lock(&q->mu);
+    while (q->count == 0 && !q->closed && !q->failed) {
+        pthread_cond_wait(&q->not_empty, &q->mu);
+    }
+    if (q->count != 0 && !q->failed) {
+        *out = q->items[q->head];
+        q->head = (q->head + 1u) % q->capacity;
+        q->count--;
+        *depth = q->count;
+        pthread_cond_signal(&q->not_full);
+        ok = 1;
+    }
+    pthread_mutex_unlock(&q->mu);
+    return ok;
+}
+
+/*
+ * Marks the queue closed (no more input) or failed (stop everything) and wakes
+ * all waiters so they can observe the new state.
+ */
+static void import_queue_finish(import_queue *q, int failed) {
+    pthread_mutex_lock(&q->mu);
+    if (failed) {
+        q->failed = 1;
+    }
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->mu);
+}
+
+/*
+ * Converts one hex digit to its value, or -1 for a non-hex character.
+ */
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Decodes mongodump's percent-escaped file names back to namespace names.
+ * Invalid escapes are kept literally.
+ */
+static char *decode_dump_name(const char *name, size_t len) {
+    char *out = (char *)malloc(len + 1u);
+    size_t i;
+    size_t j = 0;
+
+    if (out == NULL) {
+        (void)scribe_set_error(SCRIBE_ENOMEM, "failed to allocate mongodump namespace");
+        return NULL;
+    }
+    for (i = 0; i < len; i++) {
+        int hi = name[i] == '%' && i + 2u < len ? hex_digit(name[i + 1u]) : -1;
+        int lo = hi >= 0 ? hex_digit(name[i + 2u]) : -1;
+        if (lo >= 0) {
+            out[j++] = (char)((hi << 4) | lo);
+            i += 2u;
+        } else {
+            out[j++] = name[i];
+        }
+    }
+    out[j] = '\0';
+    return out;
+}
+
+/*
+ * Appends one input file descriptor. The file is opened and mapped later, once
+ * enumeration has succeeded.
+ */
+static scribe_error_t import_files_add(import_files *files, const char *path, const char *db, size_t db_len,
+                                       const char *coll, size_t coll_len, int decode) {
+    import_file *f;
+
+    if (files->count == files->cap) {
+        size_t new_cap = files->cap == 0 ? 16u : files->cap * 2u;
+        import_file *grown = (import_file *)realloc(files->items, new_cap * sizeof(*grown));
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow import file list");
+        }
+        files->items = grown;
+        files->cap = new_cap;
+    }
+    f = &files->items[files->count];
+    memset(f, 0, sizeof(*f));
+    f->fd = -1;
+    f->path = strdup(path);
+    f->db = decode ? decode_dump_name(db, db_len) : strndup(db, db_len);
+    f->coll = decode ? decode_dump_name(coll, coll_len) : strndup(coll, coll_len);
+    files->count++;
+    if (f->path == NULL || f->db == NULL || f->coll == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate import file entry");
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Releases every mapping, descriptor, and name owned by the file list.
+ */
+static void import_files_destroy(import_files *files) {
+    size_t i;
+
+    for (i = 0; i < files->count; i++) {
+        import_file *f = &files->items[i];
+        if (f->map != NULL) {
+            munmap((void *)(uintptr_t)f->map, f->size);
+        }
+        if (f->fd >= 0) {
+            close(f->fd);
+        }
+        free(f->path);
+        free(f->db);
+        free(f->coll);
+    }
+    free(files->items);
+}
+
+/*
+ * Returns whether `name` ends with `suffix`.
+ */
+static int has_suffix(const char *name, const char *suffix) {
+    size_t n = strlen(name);
+    size_t s = strlen(suffix);
+
+    return n > s && strcmp(name + n - s, suffix) == 0;
+}
+
+/*
+ * Visits one file inside a mongodump database directory. `<coll>.bson` files
+ * become inputs; metadata files are ignored and compressed output is rejected.
+ */
+static scribe_error_t visit_dump_collection(const char *name, void *vctx) {
+    import_files *files = (import_files *)vctx;
+    char *dir;
+    char *path;
+    scribe_error_t err;
+
+    if (has_suffix(name, ".bson.gz") || has_suffix(name, ".metadata.json.gz")) {
+        return scribe_set_error(SCRIBE_EINVAL, "compressed mongodump file '%s' is not supported; dump without --gzip",
+                                name);
+    }
+    if (!has_suffix(name, ".bson")) {
+        return SCRIBE_OK;
+    }
+    dir = scribe_path_join(files->root, files->db);
+    if (dir == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    path = scribe_path_join(dir, name);
+    free(dir);
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    err = import_files_add(files, path, files->db, strlen(files->db), name, strlen(name) - strlen(".bson"), 1);
+    free(path);
+    return err;
+}
+
+/*
+ * Visits one top-level mongodump entry. Each directory is a database; loose
+ * files such as oplog.bson and prelude.json are not collections and are skipped.
+ * Databases in `adapter.mongodb.excluded_databases` are skipped exactly as a
+ * cluster-scoped live bootstrap would skip them.
+ */
+static scribe_error_t visit_dump_database(const char *name, void *vctx) {
+    import_files *files = (import_files *)vctx;
+    struct stat st;
+    char *path;
+    char *db;
+    scribe_error_t err;
+
+    path = scribe_path_join(files->root, name);
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        free(path);
+        return SCRIBE_OK;
+    }
+    db = decode_dump_name(name, strlen(name));
+    if (db == NULL) {
+        free(path);
+        return SCRIBE_ENOMEM;
+    }
+    if (scribe_mongo_is_excluded_db(files->ctx, db)) {
+        free(db);
+        free(path);
+        return SCRIBE_OK;
+    }
+    free(db);
+    files->db = name;
+    err = scribe_list_dir(path, visit_dump_collection, files);
+    files->db = NULL;
+    free(path);
+    return err;
+}
+
+/*
+ * Orders input files by namespace so logs and chunk order are reproducible.
+ */
+static int import_file_cmp(const void *a, const void *b) {
+    const import_file *fa = (const import_file *)a;
+    const import_file *fb = (const import_file *)b;
+    int c = strcmp(fa->db, fb->db);
+
+    return c != 0 ? c : strcmp(fa->coll, fb->coll);
+}
+
+/*
+ * Parses `--path-template <db>/<coll>/{_id}`. The database and collection are
+ * literal names; the last component must be the `{_id}` placeholder so NDJSON
+ * documents land in the same tree shape as live MongoDB documents.
+ */
+static scribe_error_t parse_path_template(const char *tmpl, const char **db, size_t *db_len, const char **coll,
+                                          size_t *coll_len) {
+    const char *slash1 = tmpl == NULL ? NULL : strchr(tmpl, '/');
+    const char *slash2 = slash1 == NULL ? NULL : strchr(slash1 + 1, '/');
+
+    if (slash1 == NULL || slash2 == NULL || slash1 == tmpl || slash2 == slash1 + 1 ||
+        strcmp(slash2 + 1, "{_id}") != 0 || memchr(tmpl, '{', (size_t)(slash2 - tmpl)) != NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "path template must have the form <db>/<coll>/{_id}");
+    }
+    *db = tmpl;
+    *db_len = (size_t)(slash1 - tmpl);
+    *coll = slash1 + 1;
+    *coll_len = (size_t)(slash2 - slash1 - 1);
+    return SCRIBE_OK;
+}
+
+/*
+ * Opens and read-only maps one input file. Empty files stay unmapped.
+ */
+static scribe_error_t import_file_map(import_file *f) {
+    struct stat st;
+    void *map;
+
+    f->fd = open(f->path, O_RDONLY);
+    if (f->fd < 0) {
+        return scribe_set_error(SCRIBE_EIO, "failed to open import file '%s'", f->path);
+    }
+    if (fstat(f->fd, &st) != 0) {
+        return scribe_set_error(SCRIBE_EIO, "failed to stat import file '%s'", f->path);
+    }
+    f->size = (size_t)st.st_size;
+    if (f->size == 0) {
+        return SCRIBE_OK;
+    }
+    if ((uint64_t)f->size >= ((uint64_t)1 << IMPORT_OFFSET_BITS)) {
+        return scribe_set_error(SCRIBE_EINVAL, "import file '%s' is too large", f->path);
+    }
+    map = mmap(NULL, f->size, PROT_READ, MAP_PRIVATE, f->fd, 0);
+    if (map == MAP_FAILED) {
+        return scribe_set_error(SCRIBE_EIO, "failed to map import file '%s'", f->path);
+    }
+    (void)madvise(map, f->size, MADV_SEQUENTIAL);
+    f->map = (const uint8_t *)map;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads a little-endian int32 BSON length prefix.
+ */
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Splits one mapped file into chunks of roughly IMPORT_CHUNK_BYTES that end on
+ * document boundaries and queues them. BSON files are cut by walking length
+ * prefixes; NDJSON files are cut at the first newline after the target size.
+ */
+static scribe_error_t scan_file(import_queue *queue, const import_file *f, size_t file_index, import_input input) {
+    size_t start = 0;
+    size_t pos = 0;
+
+    while (pos < f->size) {
+        import_chunk chunk;
+        if (input == IMPORT_INPUT_BSON) {
+            uint32_t doc_len;
+            if (f->size - pos < 5u || (doc_len = read_le32(f->map + pos)) < 5u || doc_len > f->size - pos) {
+                return scribe_set_error(SCRIBE_EMALFORMED, "truncated BSON document at offset %zu in '%s'", pos,
+                                        f->path);
+            }
+            pos += doc_len;
+            if (pos - start < IMPORT_CHUNK_BYTES && pos < f->size) {
+                continue;
+            }
+        } else {
+            const uint8_t *nl;
+            pos = f->size - start > IMPORT_CHUNK_BYTES ? start + IMPORT_CHUNK_BYTES : f->size;
+            nl = pos < f->size ? (const uint8_t *)memchr(f->map + pos, '\n', f->size - pos) : NULL;
+            pos = nl == NULL ? f->size : (size_t)(nl - f->map) + 1u;
+        }
+        chunk.file = f;
+        chunk.file_index = file_index;
+        chunk.offset = start;
+        chunk.len = pos - start;
+        if (import_queue_push(queue, &chunk) != SCRIBE_OK) {
+            return SCRIBE_ERR;
+        }
+        start = pos;
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Converts one document into a blob and adds its snapshot record. The record
+ * sequence is the document's input position, so a repeated _id resolves to its
+ * last occurrence however the chunks were scheduled.
+ */
+static scribe_error_t import_document(import_worker *w, const import_chunk *chunk, const bson_t *doc, size_t offset) {
+    char *id = NULL;
+    uint8_t *payload = NULL;
+    size_t payload_len = 0;
+    const char *path[3];
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    scribe_error_t err;
+
+    err = scribe_mongo_canonicalize_id(doc, &id);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_mongo_encode_document(doc, w->blob_format, &payload, &payload_len);
+    if (err == SCRIBE_OK) {
+        err = scribe_object_write(w->ctx, SCRIBE_OBJECT_BLOB, payload, payload_len, hash);
+        free(payload);
+    }
+    if (err == SCRIBE_OK) {
+        path[0] = chunk->file->db;
+        path[1] = chunk->file->coll;
+        path[2] = id;
+        pthread_mutex_lock(&w->snapshot->mu);
+        err = scribe_snapshot_builder_add(w->snapshot->builder, path, 3u, hash,
+                                          ((uint64_t)chunk->file_index << IMPORT_OFFSET_BITS) | (uint64_t)offset);
+        pthread_mutex_unlock(&w->snapshot->mu);
+    }
+    free(id);
+    return err;
+}
+
+/*
+ * Processes every document in one chunk. BSON documents are viewed in place in
+ * the mapping; NDJSON lines are parsed as Extended JSON, and blank lines are
+ * skipped.
+ */
+static scribe_error_t import_chunk_documents(import_worker *w, const import_chunk *chunk) {
+    const uint8_t *base = chunk->file->map + chunk->offset;
+    size_t pos = 0;
+    scribe_error_t err = SCRIBE_OK;
+
+    while (err == SCRIBE_OK && pos < chunk->len) {
+        bson_t doc;
+        if (w->input == IMPORT_INPUT_BSON) {
+            uint32_t doc_len = read_le32(base + pos);
+            if (!bson_init_static(&doc, base + pos, doc_len)) {
+                return scribe_set_error(SCRIBE_EMALFORMED, "invalid BSON document at offset %zu in '%s'",
+                                        chunk->offset + pos, chunk->file->path);
+            }
+            err = import_document(w, chunk, &doc, chunk->offset + pos);
+            pos += doc_len;
+        } else {
+            const uint8_t *nl = (const uint8_t *)memchr(base + pos, '\n', chunk->len - pos);
+            size_t end = nl == NULL ? chunk->len : (size_t)(nl - base);
+            size_t line_end = end;
+            size_t line_start = pos;
+            bson_error_t error;
+            while (line_start < line_end && (base[line_start] == ' ' || base[line_start] == '\t')) {
+                line_start++;
+            }
+            while (line_end > line_start && (base[line_end - 1u] == '\r' || base[line_end - 1u] == ' ' ||
+                                             base[line_end - 1u] == '\t')) {
+                line_end--;
+            }
+            if (line_end > line_start) {
+                if (!bson_init_from_json(&doc, (const char *)base + line_start, (ssize_t)(line_end - line_start),
+                                         &error)) {
+                    return scribe_set_error(SCRIBE_EMALFORMED, "invalid JSON document at offset %zu in '%s': %s",
+                                            chunk->offset + pos, chunk->file->path, error.message);
+                }
+                err = import_document(w, chunk, &doc, chunk->offset + pos);
+                bson_destroy(&doc);
+            }
+            pos = end + 1u;
+        }
+    }
+    return err;
+}
+
+/*
+ * Worker thread entry point. The first failure is recorded with its detail
+ * message, which is thread-local, and the queue is failed so the scanner and
+ * the other workers stop early.
+ */
+static void *import_worker_main(void *arg) {
+    import_worker *w = (import_worker *)arg;
+    import_chunk chunk;
+    size_t depth;
+
+    while (import_queue_pop(w->queue, &chunk, &depth)) {
+        scribe_error_t err;
+
+        /* A full queue means workers, mostly compression, are the bottleneck. */
+        scribe_object_note_queue_depth(w->ctx, depth, w->queue->capacity);
+        err = import_chunk_documents(w, &chunk);
+        if (err != SCRIBE_OK) {
+            w->err = err;
+            snprintf(w->err_detail, sizeof(w->err_detail), "%s", scribe_last_error_detail());
+            import_queue_finish(w->queue, 1);
+            break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Builds the input file list for the requested source.
+ */
+static scribe_error_t collect_inputs(scribe_ctx *ctx, const scribe_mongo_import_options *opts, import_files *files) {
+    scribe_error_t err;
+
+    memset(files, 0, sizeof(*files));
+    files->ctx = ctx;
+    if (opts->mongodump_dir != NULL) {
+        files->root = opts->mongodump_dir;
+        err = scribe_list_dir(opts->mongodump_dir, visit_dump_database, files);
+    } else {
+        const char *db;
+        const char *coll;
+        size_t db_len;
+        size_t coll_len;
+        err = parse_path_template(opts->path_template, &db, &db_len, &coll, &coll_len);
+        if (err == SCRIBE_OK) {
+            err = import_files_add(files, opts->ndjson_path, db, db_len, coll, coll_len, 0);
+        }
+    }
+    if (err == SCRIBE_OK && files->count > 1u) {
+        qsort(files->items, files->count, sizeof(files->items[0]), import_file_cmp);
+    }
+    return err;
+}
+
+/*
+ * Commits the imported snapshot root on top of HEAD, mirroring the metadata
+ * shape of a live bootstrap commit.
+ */
+static scribe_error_t commit_import(scribe_ctx *ctx, const uint8_t root_hash[SCRIBE_HASH_SIZE],
+                                    uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    scribe_change_batch batch;
+
+    memset(&batch, 0, sizeof(batch));
+    batch.author = (scribe_identity){"unknown", "", "unknown"};
+    batch.committer = (scribe_identity){"scribe-mongo", "", "scribe"};
+    batch.process = (scribe_process_info){"mongo-import", SCRIBE_VERSION, "", ""};
+    batch.timestamp_unix_nanos = scribe_mongo_unix_nanos_now();
+    batch.message = "mongo import";
+    batch.message_len = strlen(batch.message);
+    return scribe_commit_root_internal(ctx, root_hash, &batch, out_commit);
+}
+
+/*
+ * Runs one offline import: enumerate and map inputs, fan chunks out to the
+ * worker pool, assemble the snapshot tree from sorted records, commit it, and
+ * record where `mongo-watch` should pick up the change stream.
+ */
+scribe_error_t scribe_mongo_import(scribe_ctx *ctx, const scribe_mongo_import_options *opts) {
+    import_files files;
+    import_queue queue;
+    import_worker *workers = NULL;
+    pthread_t *threads = NULL;
+    import_snapshot snapshot;
+    size_t doc_count = 0;
+    long worker_total;
+    long started = 0;
+    long i;
+    uint32_t seconds = 0;
+    uint32_t increment = 0;
+    uint8_t root_hash[SCRIBE_HASH_SIZE];
+    uint8_t commit_hash[SCRIBE_HASH_SIZE];
+    char commit_hex[SCRIBE_HEX_HASH_SIZE + 1];
+    char *state_token = NULL;
+    import_input input;
+    scribe_error_t err;
+
+    if (ctx == NULL || opts == NULL || (opts->mongodump_dir == NULL) == (opts->ndjson_path == NULL) ||
+        (opts->ndjson_path != NULL && opts->path_template == NULL) ||
+        (opts->mongodump_dir != NULL && opts->path_template != NULL)) {
+        return scribe_set_error(SCRIBE_EINVAL, "import needs --mongodump <dir> or --ndjson <file> --path-template");
+    }
+    if (opts->oplog_ts != NULL && (err = scribe_mongo_parse_optime(opts->oplog_ts, &seconds, &increment)) != SCRIBE_OK) {
+        return err;
+    }
+    input = opts->mongodump_dir != NULL ? IMPORT_INPUT_BSON : IMPORT_INPUT_NDJSON;
+    err = collect_inputs(ctx, opts, &files);
+    for (i = 0; err == SCRIBE_OK && (size_t)i < files.count; i++) {
+        err = import_file_map(&files.items[i]);
+    }
+    if (err != SCRIBE_OK) {
+        import_files_destroy(&files);
+        return err;
+    }
+
+    worker_total = scribe_mongo_worker_count(ctx);
+    if (worker_total < 1) {
+        worker_total = 1;
+    }
+    workers = (import_worker *)calloc((size_t)worker_total, sizeof(*workers));
+    threads = (pthread_t *)calloc((size_t)worker_total, sizeof(*threads));
+    if (workers == NULL || threads == NULL) {
+        free(workers);
+        free(threads);
+        import_files_destroy(&files);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate import worker pool");
+    }
+    snapshot.builder = NULL;
+    err = scribe_snapshot_builder_new(ctx, ctx->config.snapshot_memory_bytes, &snapshot.builder);
+    if (err == SCRIBE_OK && pthread_mutex_init(&snapshot.mu, NULL) != 0) {
+        err = scribe_set_error(SCRIBE_ERR, "failed to initialize import snapshot");
+    }
+    if (err != SCRIBE_OK) {
+        scribe_snapshot_builder_free(snapshot.builder);
+        free(workers);
+        free(threads);
+        import_files_destroy(&files);
+        return err;
+    }
+    err = import_queue_init(&queue, (size_t)worker_total * 4u);
+    if (err != SCRIBE_OK) {
+        pthread_mutex_destroy(&snapshot.mu);
+        scribe_snapshot_builder_free(snapshot.builder);
+        free(workers);
+        free(threads);
+        import_files_destroy(&files);
+        return err;
+    }
+    for (i = 0; i < worker_total; i++) {
+        workers[i].ctx = ctx;
+        workers[i].queue = &queue;
+        workers[i].input = input;
+        workers[i].blob_format = ctx->config.adapter_blob_format;
+        workers[i].snapshot = &snapshot;
+        if (pthread_create(&threads[i], NULL, import_worker_main, &workers[i]) != 0) {
+            err = scribe_set_error(SCRIBE_ERR, "failed to start import worker");
+            break;
+        }
+        scribe_worker_pin(ctx, threads[i], (unsigned)i);
+        started++;
+    }
+
+    /*
+     * The scanner runs on this thread and only touches length prefixes or
+     * chunk-boundary pages; workers fault in the rest of each mapping while
+     * parsing, so reading and canonicalization overlap.
+     */
+    for (i = 0; err == SCRIBE_OK && (size_t)i < files.count; i++) {
+        err = scan_file(&queue, &files.items[i], (size_t)i, input);
+    }
+    import_queue_finish(&queue, err != SCRIBE_OK);
+    for (i = 0; i < started; i++) {
+        (void)pthread_join(threads[i], NULL);
+    }
+    for (i = 0; i < started; i++) {
+        if (workers[i].err != SCRIBE_OK && (err == SCRIBE_OK || err == SCRIBE_ERR)) {
+            err = scribe_set_error(workers[i].err, "%s", workers[i].err_detail);
+        }
+    }
+    doc_count = scribe_snapshot_builder_count(snapshot.builder);
+    if (err == SCRIBE_OK) {
+        err = scribe_snapshot_builder_finish(snapshot.builder, root_hash);
+    }
+    if (err == SCRIBE_OK) {
+        err = commit_import(ctx, root_hash, commit_hash);
+    }
+    if (err == SCRIBE_OK && opts->oplog_ts != NULL) {
+        size_t n = strlen(SCRIBE_MONGO_STATE_OPTIME_PREFIX) + 24u;
+        state_token = (char *)malloc(n);
+        if (state_token == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate import resume point");
+        } else {
+            snprintf(state_token, n, "%s%u.%u", SCRIBE_MONGO_STATE_OPTIME_PREFIX, (unsigned)seconds,
+                     (unsigned)increment);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        /*
+         * Without an oplog time the snapshot has no stream position, so any
+         * previous resume token would replay onto the wrong baseline. Mark the
+         * state invalid; mongo-watch then performs a live bootstrap.
+         */
+        err = scribe_mongo_write_adapter_state(ctx, NULL,
+                                               state_token != NULL ? state_token : SCRIBE_MONGO_STATE_INVALID,
+                                               commit_hash);
+    }
+    if (err == SCRIBE_OK) {
+        scribe_hash_to_hex(commit_hash, commit_hex);
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "mongo", "import commit %s with %zu document(s) from %zu file(s)",
+                       commit_hex, doc_count, files.count);
+        printf("%s\n", commit_hex);
+    }
+    free(state_token);
+    import_queue_destroy(&queue);
+    pthread_mutex_destroy(&snapshot.mu);
+    scribe_snapshot_builder_free(snapshot.builder);
+    free(workers);
+    free(threads);
+    import_files_destroy(&files);
+    return err;
+}
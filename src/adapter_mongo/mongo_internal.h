@@ -5,6 +5,14 @@
 
 #include <bson/bson.h>
 
+/*
+ * Adapter-state resume_token values that are not base64 change-stream tokens:
+ * the invalid marker forces a fresh bootstrap, and an optime token starts the
+ * stream at a cluster time, written as `optime:<seconds>.<increment>`.
+ */
+#define SCRIBE_MONGO_STATE_INVALID "invalid"
+#define SCRIBE_MONGO_STATE_OPTIME_PREFIX "optime:"
+
 typedef struct {
     char *bytes;
     size_t len;
@@ -13,5 +21,15 @@ typedef struct {
 scribe_error_t scribe_mongo_canonicalize_json(const char *json, char **out, size_t *out_len);
 scribe_error_t scribe_mongo_canonicalize_bson(const bson_t *doc, uint8_t **out, size_t *out_len);
 scribe_error_t scribe_mongo_canonicalize_id(const bson_t *doc, char **out);
+scribe_error_t scribe_mongo_sort_bson(const bson_t *doc, uint8_t **out, size_t *out_len);
+scribe_error_t scribe_mongo_encode_document(const bson_t *doc, scribe_blob_format format, uint8_t **out,
+                                            size_t *out_len);
+
+long scribe_mongo_worker_count(scribe_ctx *ctx);
+int scribe_mongo_is_excluded_db(scribe_ctx *ctx, const char *db);
+int64_t scribe_mongo_unix_nanos_now(void);
+scribe_error_t scribe_mongo_write_adapter_state(scribe_ctx *ctx, const char *key, const char *resume_token,
+                                                const uint8_t commit_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_mongo_parse_optime(const char *text, uint32_t *out_seconds, uint32_t *out_increment);
 
 #endif
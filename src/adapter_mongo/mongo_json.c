@@ -5,6 +5,8 @@
  * the canonical Extended JSON representation of `_id` as the leaf tree name.
  * libbson provides Extended JSON rendering; this file adds recursive object-key
  * sorting and whitespace removal so equivalent documents hash deterministically.
+ * Stores configured for sorted BSON skip the JSON round trip and rebuild the
+ * document directly from `bson_iter` with recursively byte-sorted keys.
  */
 #include "adapter_mongo/mongo_internal.h"
 
@@ -14,6 +16,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#define BSON_MAX_RECURSION 128
+
 typedef enum {
     JSON_STRING,
     JSON_ATOM,
@@ -51,6 +55,12 @@ typedef struct {
     size_t cap;
 } sbuf;
 
+typedef struct {
+    const char *key;
+    size_t index;
+    bson_iter_t iter;
+} bson_field;
+
 /*
  * Advances the parser past JSON whitespace. The serializer does not preserve
  * insignificant whitespace, so whitespace only matters between parsed tokens.
@@ -548,6 +558,176 @@ scribe_error_t scribe_mongo_canonicalize_bson(const bson_t *doc, uint8_t **out,
     return SCRIBE_OK;
 }
 
+/*
+ * Orders BSON fields by key bytes. Ties keep source order so documents with
+ * duplicate keys still encode deterministically.
+ */
+static int bson_field_cmp(const void *a, const void *b) {
+    const bson_field *fa = (const bson_field *)a;
+    const bson_field *fb = (const bson_field *)b;
+    int c = strcmp(fa->key, fb->key);
+
+    if (c != 0) {
+        return c;
+    }
+    return fa->index < fb->index ? -1 : (fa->index > fb->index ? 1 : 0);
+}
+
+static scribe_error_t append_sorted(bson_iter_t *iter, bool sort_keys, int depth, bson_t *dst);
+
+/*
+ * Appends one field to `dst`. Documents, arrays, and code-with-scope scopes are
+ * rebuilt recursively so key order is canonical at every nesting level; every
+ * other value is copied verbatim from the source iterator.
+ */
+static scribe_error_t append_sorted_field(const bson_field *field, int depth, bson_t *dst) {
+    bson_iter_t child;
+    bson_t sub;
+    scribe_error_t err;
+
+    switch (bson_iter_type(&field->iter)) {
+    case BSON_TYPE_DOCUMENT:
+    case BSON_TYPE_ARRAY: {
+        bool is_array = BSON_ITER_HOLDS_ARRAY(&field->iter);
+        if (!bson_iter_recurse(&field->iter, &child)) {
+            return scribe_set_error(SCRIBE_EADAPTER, "failed to recurse into BSON field '%s'", field->key);
+        }
+        if (!(is_array ? bson_append_array_begin(dst, field->key, -1, &sub)
+                       : bson_append_document_begin(dst, field->key, -1, &sub))) {
+            return scribe_set_error(SCRIBE_EADAPTER, "failed to append BSON field '%s'", field->key);
+        }
+        err = append_sorted(&child, !is_array, depth + 1, &sub);
+        if (!(is_array ? bson_append_array_end(dst, &sub) : bson_append_document_end(dst, &sub)) &&
+            err == SCRIBE_OK) {
+            err = scribe_set_error(SCRIBE_EADAPTER, "failed to close BSON field '%s'", field->key);
+        }
+        return err;
+    }
+    case BSON_TYPE_CODEWSCOPE: {
+        const char *code;
+        uint32_t code_len = 0;
+        const uint8_t *scope_data = NULL;
+        uint32_t scope_len = 0;
+        bson_t scope;
+        bson_t sorted_scope;
+        code = bson_iter_codewscope(&field->iter, &code_len, &scope_len, &scope_data);
+        if (!bson_init_static(&scope, scope_data, scope_len) || !bson_iter_init(&child, &scope)) {
+            return scribe_set_error(SCRIBE_EADAPTER, "invalid BSON code scope in field '%s'", field->key);
+        }
+        bson_init(&sorted_scope);
+        err = append_sorted(&child, true, depth + 1, &sorted_scope);
+        if (err == SCRIBE_OK &&
+            !bson_append_code_with_scope(dst, field->key, -1, code, &sorted_scope)) {
+            err = scribe_set_error(SCRIBE_EADAPTER, "failed to append BSON field '%s'", field->key);
+        }
+        bson_destroy(&sorted_scope);
+        return err;
+    }
+    default:
+        if (!bson_append_iter(dst, field->key, -1, &field->iter)) {
+            return scribe_set_error(SCRIBE_EADAPTER, "failed to copy BSON field '%s'", field->key);
+        }
+        return SCRIBE_OK;
+    }
+}
+
+/*
+ * Copies every field reachable from `iter` into `dst`, sorting object keys
+ * by byte value. Array elements keep their positional order and keys.
+ */
+static scribe_error_t append_sorted(bson_iter_t *iter, bool sort_keys, int depth, bson_t *dst) {
+    bson_field stack_fields[32];
+    bson_field *fields = stack_fields;
+    size_t cap = sizeof(stack_fields) / sizeof(stack_fields[0]);
+    size_t count = 0;
+    size_t i;
+    scribe_error_t err = SCRIBE_OK;
+
+    /*
+     * Small objects, the common case, sort in a stack array; wider objects
+     * spill to the heap. The iterator copies stay valid because they point
+     * into the source document, which outlives this call.
+     */
+    if (depth > BSON_MAX_RECURSION) {
+        return scribe_set_error(SCRIBE_EADAPTER, "BSON document nests too deeply");
+    }
+    while (bson_iter_next(iter)) {
+        if (count == cap) {
+            bson_field *next = (bson_field *)malloc(cap * 2u * sizeof(*next));
+            if (next == NULL) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate BSON field list");
+                break;
+            }
+            memcpy(next, fields, count * sizeof(*next));
+            if (fields != stack_fields) {
+                free(fields);
+            }
+            fields = next;
+            cap *= 2u;
+        }
+        fields[count].key = bson_iter_key(iter);
+        fields[count].index = count;
+        fields[count].iter = *iter;
+        count++;
+    }
+    if (err == SCRIBE_OK && sort_keys && count > 1u) {
+        qsort(fields, count, sizeof(fields[0]), bson_field_cmp);
+    }
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        err = append_sorted_field(&fields[i], depth, dst);
+    }
+    if (fields != stack_fields) {
+        free(fields);
+    }
+    return err;
+}
+
+/*
+ * Re-encodes a BSON document with object keys sorted recursively. The result
+ * is a heap-owned copy of the BSON bytes, deterministic for logically equal
+ * documents, and is used as the blob payload in `bson-sorted` stores.
+ */
+scribe_error_t scribe_mongo_sort_bson(const bson_t *doc, uint8_t **out, size_t *out_len) {
+    bson_iter_t iter;
+    bson_t sorted;
+    uint8_t *copy;
+    scribe_error_t err;
+
+    if (doc == NULL || out == NULL || out_len == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid BSON sort argument");
+    }
+    if (!bson_iter_init(&iter, doc)) {
+        return scribe_set_error(SCRIBE_EADAPTER, "invalid BSON document");
+    }
+    bson_init(&sorted);
+    err = append_sorted(&iter, true, 0, &sorted);
+    if (err != SCRIBE_OK) {
+        bson_destroy(&sorted);
+        return err;
+    }
+    copy = (uint8_t *)malloc(sorted.len);
+    if (copy == NULL) {
+        bson_destroy(&sorted);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate sorted BSON payload");
+    }
+    memcpy(copy, bson_get_data(&sorted), sorted.len);
+    *out = copy;
+    *out_len = sorted.len;
+    bson_destroy(&sorted);
+    return SCRIBE_OK;
+}
+
+/*
+ * Encodes a document as a blob payload in the store's configured format.
+ */
+scribe_error_t scribe_mongo_encode_document(const bson_t *doc, scribe_blob_format format, uint8_t **out,
+                                            size_t *out_len) {
+    if (format == SCRIBE_BLOB_FORMAT_BSON_SORTED) {
+        return scribe_mongo_sort_bson(doc, out, out_len);
+    }
+    return scribe_mongo_canonicalize_bson(doc, out, out_len);
+}
+
 /*
  * Extracts `_id`, canonicalizes that BSON value, and returns the canonical JSON
  * value text used as the document leaf name in Scribe's Mongo tree shape.
@@ -59,11 +59,26 @@ static void usage(FILE *out) {
           "             repository config. Works even when the store is not initialized.\n"
           "\n"
           "  commit-batch\n"
-          "    Usage:   scribe [--store <path>] commit-batch < frame.stream\n"
-          "    Options: none\n"
+          "    Usage:   scribe [--store <path>] commit-batch [--socket <path>] < frame.stream\n"
+          "    Options: --socket <path>\n"
+          "                 Send the frames to a running daemon instead of opening\n"
+          "                 the store. Responses are the same.\n"
           "    Does:    Read pipe protocol v1 BATCH frames from stdin, validate them,\n"
           "             apply payload/tombstone events to the current tree, write new\n"
           "             objects, and advance refs/heads/main atomically.\n"
+          "\n"
+          "  daemon\n"
+          "    Usage:   scribe [--store <path>] daemon [--socket <path>] [--mongo <name>=<uri>]...\n"
+          "    Options: --socket <path>\n"
+          "                 Unix socket to listen on for pipe protocol clients.\n"
+          "             --mongo <name>=<uri>\n"
+          "                 Host a MongoDB watch session. May be repeated; each\n"
+          "                 session resumes from adapter-state/mongodb-<name>.\n"
+          "    Does:    Hold the writer lock and commit frames from any number of\n"
+          "             clients and hosted sessions. Batches that arrive together\n"
+          "             share one group commit: one commit each, one sync, one ref\n"
+          "             update. Needs --socket or --mongo. Stops cleanly on SIGTERM\n"
+          "             or SIGINT.\n"
           "\n",
           out);
     fputs("  list-objects\n"
@@ -92,13 +107,20 @@ static void usage(FILE *out) {
           "\n",
           out);
     fputs("  log\n"
-          "    Usage:   scribe [--store <path>] log [--oneline] [--paths] [-n <N>]\n"
+          "    Usage:   scribe [--store <path>] log [--oneline] [--paths] [--stat] [-p] [-n <N>]\n"
           "             scribe [--store <path>] log [options] [--] <path>\n"
           "    Options: --oneline\n"
           "                 Print one compact line per emitted commit.\n"
           "             --paths\n"
           "                 Also print changed leaf paths for each emitted commit. In\n"
           "                 oneline mode this appends [N changed].\n"
+          "             --stat\n"
+          "                 Print added/modified/deleted leaf counts per database and\n"
+          "                 collection. In oneline mode this appends [+A ~M -D].\n"
+          "             -p\n"
+          "                 Print each changed leaf path with a JSON Patch for every\n"
+          "                 modified JSON document, as diff --content does. With a\n"
+          "                 path filter only changes at or below that path are shown.\n"
           "             -n <N>\n"
           "                 Limit the number of commits emitted. With a path filter,\n"
           "                 Scribe still scans history until N matching commits appear.\n"
@@ -110,10 +132,13 @@ static void usage(FILE *out) {
           "\n"
           "  show\n"
           "    Usage:   scribe [--store <path>] show <commit>\n"
-          "             scribe [--store <path>] show <commit>:<path>\n"
-          "    Options: none\n"
-          "    Does:    Without :<path>, print commit metadata, message, and touched\n"
-          "             paths. With :<path>, resolve the path inside the commit root;\n"
+          "             scribe [--store <path>] show [--format=raw|json] <commit>:<path>\n"
+          "    Options: --format=raw|json\n"
+          "                 raw (default) writes blob bytes unchanged. json renders\n"
+          "                 sorted-BSON document blobs as canonical Extended JSON and\n"
+          "                 passes other blobs through.\n"
+          "    Does:    Without :<path>, print commit metadata, message, per-collection\n"
+          "             change counts, and touched paths. With :<path>, resolve the path inside the commit root;\n"
           "             blob paths write raw bytes exactly, tree paths list recursively.\n"
           "             Quote the argument in the shell when Mongo _id JSON contains\n"
           "             braces, quotes, or other shell-special characters.\n"
@@ -128,21 +153,124 @@ static void usage(FILE *out) {
           "             and BLAKE3 hash before printing the requested view.\n"
           "\n"
           "  diff\n"
-          "    Usage:   scribe [--store <path>] diff <commit>\n"
-          "             scribe [--store <path>] diff <commit1> <commit2>\n"
-          "    Options: none\n"
+          "    Usage:   scribe [--store <path>] diff [--content] <commit>\n"
+          "             scribe [--store <path>] diff [--content] <commit1> <commit2>\n"
+          "    Options: --content\n"
+          "                 Under each modified document, print the RFC 6902 JSON Patch\n"
+          "                 operations that turn the old version into the new one, one\n"
+          "                 JSON object per line. Sorted-BSON documents are compared as\n"
+          "                 their canonical Extended JSON.\n"
           "    Does:    Compare commit root trees. With one commit, compare its parent to\n"
           "             it. Output is one changed leaf path per line prefixed by A, M, or D.\n"
           "\n"
+          "  grep\n"
+          "    Usage:   scribe [--store <path>] grep [-E] <pattern> [--rev <rev>|<a>..<b>]\n"
+          "                 [-- <path-prefix>]\n"
+          "    Options: -E  Treat the pattern as a POSIX extended regex instead of a\n"
+          "                 fixed string.\n"
+          "             --rev <rev>\n"
+          "                 Search the state at one commit. Defaults to HEAD.\n"
+          "             --rev <a>..<b>\n"
+          "                 Search every commit after a up to b; ..<b> starts at the\n"
+          "                 initial commit.\n"
+          "    Does:    Search document bytes, reading each distinct blob once on\n"
+          "             worker_threads threads. Prints matching paths, or for a range\n"
+          "             <first> <last> <path> for each stretch of commits in which the\n"
+          "             path held a matching document.\n"
+          "\n",
+          out);
+    fputs("  index\n"
+          "    Usage:   scribe [--store <path>] index update\n"
+          "             scribe [--store <path>] index query <coll>.<field> <value>\n"
+          "                 [--rev <rev>|<a>..<b>]\n"
+          "    Options: <value>\n"
+          "                 JSON text of the field value. Anything that is not a\n"
+          "                 number, string, object, array, true, false, or null is\n"
+          "                 taken as a string.\n"
+          "             --rev <rev>\n"
+          "                 Query the state at one commit. Defaults to HEAD.\n"
+          "             --rev <a>..<b>\n"
+          "                 Query every commit after a up to b; ..<b> starts at the\n"
+          "                 initial commit.\n"
+          "    Does:    update brings every index.<coll>.<field> index up to date with\n"
+          "             main. query prints the paths whose document held the value, or\n"
+          "             for a range <first> <last> <path> for each stretch of commits in\n"
+          "             which it did, from the index alone.\n"
+          "\n",
+          out);
+    fputs("  export\n"
+          "    Usage:   scribe [--store <path>] export <rev>|<a>..<b> [--prefix <path>]\n"
+          "                 [--format ndjson|bson]\n"
+          "    Options: --prefix <path>\n"
+          "                 Export only documents at or below this path.\n"
+          "             --format ndjson|bson\n"
+          "                 ndjson (default) writes one JSON document per line,\n"
+          "                 rendering sorted-BSON blobs as canonical Extended JSON.\n"
+          "                 bson writes concatenated BSON and needs BSON blobs.\n"
+          "    Does:    Write every document at <rev> to stdout in path order,\n"
+          "             decompressing on worker_threads threads. A range writes only\n"
+          "             documents that differ between a and b, each wrapped as\n"
+          "             {op, path, doc} with op A, M, or D.\n"
+          "\n"
           "  fsck\n"
           "    Usage:   scribe [--store <path>] fsck\n"
           "    Options: none\n"
           "    Does:    Verify reachable history from refs/heads/main, following parent\n"
           "             commits and tree edges, checking object envelopes and hashes on\n"
           "             read. Then scan loose objects and report unvisited ones as dangling.\n"
+          "\n"
+          "  repack\n"
+          "    Usage:   scribe [--store <path>] repack [--write-bitmap | --incremental]\n"
+          "    Options: --write-bitmap\n"
+          "                 Also rebuild the reachability bitmaps used by\n"
+          "                 list-objects --reachable.\n"
+          "             --incremental\n"
+          "                 Extend the existing bitmaps with commits made since\n"
+          "                 they were written instead of rebuilding them.\n"
+          "    Does:    Recompress objects that were written at adaptive_compression_level\n"
+          "             during a backlog, using repack_compression_level with long-distance\n"
+          "             matching. Object hashes do not change.\n"
+          "\n"
+          "  compact-history\n"
+          "    Usage:   scribe [--store <path>] compact-history --older-than <age>\n"
+          "                 --granularity <window>\n"
+          "    Options: --older-than <age>\n"
+          "                 Compact only commits older than this, e.g. 90d.\n"
+          "             --granularity <window>\n"
+          "                 Keep one commit per window, e.g. 1h. Windows start at\n"
+          "                 the Unix epoch. Durations take an s, m, h, d, or w suffix.\n"
+          "    Does:    Replace each window of old commits with one commit holding\n"
+          "             the window's final root tree, copy newer commits onto the new\n"
+          "             chain, and move refs/heads/main once. Prints <old> <new> for\n"
+          "             every commit whose id changed. Replaced commits become dangling.\n"
+          "\n"
+          "  archive\n"
+          "    Usage:   scribe [--store <path>] archive --older-than <age>\n"
+          "    Options: --older-than <age>\n"
+          "                 Archive objects used only by commits older than this,\n"
+          "                 e.g. 90d. Durations take an s, m, h, d, or w suffix.\n"
+          "    Does:    Store each cold object as a zstd delta against the previous\n"
+          "             version at the same path, using archive_compression_level with\n"
+          "             long-distance matching. Object hashes do not change.\n"
           "\n",
           out);
-    fputs("  mongo-watch\n"
+    fputs("  import\n"
+          "    Usage:   scribe [--store <path>] import --mongodump <dir> [--oplog-ts <t>[.<i>]]\n"
+          "             scribe [--store <path>] import --ndjson <file>\n"
+          "                 --path-template <db>/<coll>/{_id} [--oplog-ts <t>[.<i>]]\n"
+          "    Options: --mongodump <dir>\n"
+          "                 Uncompressed mongodump output: <dir>/<db>/<coll>.bson.\n"
+          "             --ndjson <file> --path-template <db>/<coll>/{_id}\n"
+          "                 One Extended JSON document per line, stored under the\n"
+          "                 given database and collection.\n"
+          "             --oplog-ts <t>[.<i>]\n"
+          "                 Cluster time the input reflects. mongo-watch starts its\n"
+          "                 change stream there instead of bootstrapping.\n"
+          "    Does:    Memory-map the input, canonicalize and write document blobs with\n"
+          "             the worker pool, and commit the same snapshot tree a live\n"
+          "             bootstrap would. Prints the commit hash.\n"
+          "\n"
+          "  mongo-watch\n"
           "    Usage:   scribe [--store <path>] mongo-watch <uri>\n"
           "             scribe mongo-watch <uri> --store <path>\n"
           "    Options: <uri>\n"
@@ -247,6 +375,17 @@ int main(int argc, char **argv) {
         return cmd_info(store);
     }
     if (strcmp(cmd, "commit-batch") == 0) {
+        if (argi + 2 == argc && strcmp(argv[argi], "--socket") == 0) {
+            err = scribe_daemon_client(argv[argi + 1], stdin, stdout);
+            if (err == SCRIBE_EIO) {
+                return fail(err);
+            }
+            return err == SCRIBE_OK ? 0 : (int)err;
+        }
+        if (argi != argc) {
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
         err = open_ctx(store, 1, &ctx);
         if (err != SCRIBE_OK) {
             return fail(err);
@@ -255,6 +394,60 @@ int main(int argc, char **argv) {
         scribe_close(ctx);
         return err == SCRIBE_OK ? 0 : (int)err;
     }
+    if (strcmp(cmd, "daemon") == 0) {
+        const char *socket_path = NULL;
+        scribe_daemon_source *sources;
+        size_t source_count = 0;
+
+        sources = (scribe_daemon_source *)calloc((size_t)argc, sizeof(*sources));
+        if (sources == NULL) {
+            return fail(scribe_set_error(SCRIBE_ENOMEM, "failed to allocate daemon sessions"));
+        }
+        while (argi + 1 < argc) {
+            if (strcmp(argv[argi], "--socket") == 0 && socket_path == NULL) {
+                socket_path = argv[argi + 1];
+            } else if (strcmp(argv[argi], "--mongo") == 0 && strchr(argv[argi + 1], '=') != NULL) {
+#ifdef SCRIBE_HAVE_MONGO_ADAPTER
+                /* <name>=<uri>: the name is everything before the first '='. */
+                char *eq = strchr(argv[argi + 1], '=');
+
+                *eq = '\0';
+                sources[source_count].name = argv[argi + 1];
+                sources[source_count].uri = eq + 1;
+                sources[source_count].run = scribe_mongo_watch_session;
+                source_count++;
+#else
+                free(sources);
+                fprintf(stderr, "scribe: %s: daemon --mongo requires the MongoDB adapter\n",
+                        scribe_error_symbol(SCRIBE_ENOSYS));
+                return (int)SCRIBE_ENOSYS;
+#endif
+            } else {
+                break;
+            }
+            argi += 2;
+        }
+        if (argi != argc || (socket_path == NULL && source_count == 0)) {
+            free(sources);
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
+        err = open_ctx(store, 1, &ctx);
+        if (err != SCRIBE_OK) {
+            free(sources);
+            return fail(err);
+        }
+#ifdef SCRIBE_HAVE_MONGO_ADAPTER
+        scribe_mongo_global_init();
+#endif
+        err = scribe_daemon_run(ctx, socket_path, sources, source_count);
+#ifdef SCRIBE_HAVE_MONGO_ADAPTER
+        scribe_mongo_global_cleanup();
+#endif
+        scribe_close(ctx);
+        free(sources);
+        return err == SCRIBE_OK ? 0 : fail(err);
+    }
     if (strcmp(cmd, "list-objects") == 0) {
         int type_mask = 0;
         int reachable = 0;
@@ -307,6 +500,8 @@ int main(int argc, char **argv) {
     if (strcmp(cmd, "log") == 0) {
         int oneline = 0;
         int show_paths = 0;
+        int show_stat = 0;
+        int show_patch = 0;
         size_t limit = 0;
         const char *path_filter = NULL;
         int after_separator = 0;
@@ -325,6 +520,12 @@ int main(int argc, char **argv) {
             } else if (!after_separator && strcmp(argv[argi], "--paths") == 0) {
                 show_paths = 1;
                 argi++;
+            } else if (!after_separator && strcmp(argv[argi], "--stat") == 0) {
+                show_stat = 1;
+                argi++;
+            } else if (!after_separator && strcmp(argv[argi], "-p") == 0) {
+                show_patch = 1;
+                argi++;
             } else if (!after_separator && strcmp(argv[argi], "-n") == 0 && argi + 1 < argc) {
                 limit = (size_t)strtoul(argv[argi + 1], NULL, 10);
                 argi += 2;
@@ -346,11 +547,21 @@ int main(int argc, char **argv) {
         if (err != SCRIBE_OK) {
             return fail(err);
         }
-        err = scribe_cli_log(ctx, oneline, limit, show_paths, path_filter);
+        err = scribe_cli_log(ctx, oneline, limit, show_paths, show_stat, show_patch, path_filter);
         scribe_close(ctx);
         return err == SCRIBE_OK ? 0 : fail(err);
     }
     if (strcmp(cmd, "show") == 0) {
+        int render_json = 0;
+        if (argi < argc && strncmp(argv[argi], "--format=", 9) == 0) {
+            if (strcmp(argv[argi] + 9, "json") == 0) {
+                render_json = 1;
+            } else if (strcmp(argv[argi] + 9, "raw") != 0) {
+                usage(stderr);
+                return (int)SCRIBE_EINVAL;
+            }
+            argi++;
+        }
         if (argi != argc - 1) {
             usage(stderr);
             return (int)SCRIBE_EINVAL;
@@ -359,7 +570,7 @@ int main(int argc, char **argv) {
         if (err != SCRIBE_OK) {
             return fail(err);
         }
-        err = scribe_cli_show(ctx, argv[argi]);
+        err = scribe_cli_show(ctx, argv[argi], render_json);
         scribe_close(ctx);
         return err == SCRIBE_OK ? 0 : fail(err);
     }
@@ -379,6 +590,11 @@ int main(int argc, char **argv) {
         return err == SCRIBE_OK ? 0 : fail(err);
     }
     if (strcmp(cmd, "diff") == 0) {
+        int content = 0;
+        if (argi < argc && strcmp(argv[argi], "--content") == 0) {
+            content = 1;
+            argi++;
+        }
         if (argi >= argc || argi + 2 < argc) {
             usage(stderr);
             return (int)SCRIBE_EINVAL;
@@ -387,7 +603,106 @@ int main(int argc, char **argv) {
         if (err != SCRIBE_OK) {
             return fail(err);
         }
-        err = scribe_cli_diff(ctx, argv[argi], argi + 1 < argc ? argv[argi + 1] : NULL);
+        err = scribe_cli_diff(ctx, argv[argi], argi + 1 < argc ? argv[argi + 1] : NULL, content);
+        scribe_close(ctx);
+        return err == SCRIBE_OK ? 0 : fail(err);
+    }
+    if (strcmp(cmd, "grep") == 0) {
+        const char *pattern = NULL;
+        const char *rev = NULL;
+        const char *prefix = NULL;
+        int extended = 0;
+        while (argi < argc) {
+            if (strcmp(argv[argi], "-E") == 0) {
+                extended = 1;
+                argi++;
+            } else if (strcmp(argv[argi], "--rev") == 0 && argi + 1 < argc) {
+                rev = argv[argi + 1];
+                argi += 2;
+            } else if (strcmp(argv[argi], "--") == 0 && argi + 2 == argc) {
+                prefix = argv[argi + 1];
+                argi += 2;
+            } else if (pattern == NULL && strcmp(argv[argi], "--") != 0) {
+                pattern = argv[argi];
+                argi++;
+            } else {
+                break;
+            }
+        }
+        if (argi != argc || pattern == NULL) {
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
+        err = open_ctx(store, 0, &ctx);
+        if (err != SCRIBE_OK) {
+            return fail(err);
+        }
+        err = scribe_cli_grep(ctx, pattern, extended, rev, prefix);
+        scribe_close(ctx);
+        return err == SCRIBE_OK ? 0 : fail(err);
+    }
+    if (strcmp(cmd, "index") == 0) {
+        const char *rev = NULL;
+        if (argi < argc && strcmp(argv[argi], "update") == 0 && argi + 1 == argc) {
+            err = open_ctx(store, 1, &ctx);
+            if (err != SCRIBE_OK) {
+                return fail(err);
+            }
+            err = scribe_cli_index_update(ctx);
+            scribe_close(ctx);
+            return err == SCRIBE_OK ? 0 : fail(err);
+        }
+        if (argc - argi == 5 && strcmp(argv[argi + 3], "--rev") == 0) {
+            rev = argv[argi + 4];
+        } else if (argc - argi != 3) {
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
+        if (strcmp(argv[argi], "query") != 0) {
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
+        err = open_ctx(store, 0, &ctx);
+        if (err != SCRIBE_OK) {
+            return fail(err);
+        }
+        err = scribe_cli_index_query(ctx, argv[argi + 1], argv[argi + 2], rev);
+        scribe_close(ctx);
+        return err == SCRIBE_OK ? 0 : fail(err);
+    }
+    if (strcmp(cmd, "export") == 0) {
+        const char *rev = NULL;
+        const char *prefix = NULL;
+        int bson = 0;
+        while (argi < argc) {
+            if (strcmp(argv[argi], "--prefix") == 0 && argi + 1 < argc) {
+                prefix = argv[argi + 1];
+                argi += 2;
+            } else if (strcmp(argv[argi], "--format") == 0 && argi + 1 < argc) {
+                if (strcmp(argv[argi + 1], "bson") == 0) {
+                    bson = 1;
+                } else if (strcmp(argv[argi + 1], "ndjson") != 0) {
+                    usage(stderr);
+                    return (int)SCRIBE_EINVAL;
+                }
+                argi += 2;
+            } else if (rev == NULL && argv[argi][0] != '-') {
+                rev = argv[argi];
+                argi++;
+            } else {
+                usage(stderr);
+                return (int)SCRIBE_EINVAL;
+            }
+        }
+        if (rev == NULL) {
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
+        err = open_ctx(store, 0, &ctx);
+        if (err != SCRIBE_OK) {
+            return fail(err);
+        }
+        err = scribe_cli_export(ctx, rev, prefix, bson);
         scribe_close(ctx);
         return err == SCRIBE_OK ? 0 : fail(err);
     }
@@ -400,6 +715,104 @@ int main(int argc, char **argv) {
         scribe_close(ctx);
         return err == SCRIBE_OK ? 0 : fail(err);
     }
+    if (strcmp(cmd, "repack") == 0) {
+        int write_bitmap = 0;
+        int incremental = 0;
+        while (argi < argc) {
+            if (strcmp(argv[argi], "--write-bitmap") == 0) {
+                write_bitmap = 1;
+                argi++;
+            } else if (strcmp(argv[argi], "--incremental") == 0) {
+                incremental = 1;
+                argi++;
+            } else {
+                usage(stderr);
+                return (int)SCRIBE_EINVAL;
+            }
+        }
+        err = open_ctx(store, 1, &ctx);
+        if (err != SCRIBE_OK) {
+            return fail(err);
+        }
+        err = scribe_cli_repack(ctx, write_bitmap, incremental);
+        scribe_close(ctx);
+        return err == SCRIBE_OK ? 0 : fail(err);
+    }
+    if (strcmp(cmd, "compact-history") == 0) {
+        const char *older_than = NULL;
+        const char *granularity = NULL;
+        while (argi + 1 < argc) {
+            if (strcmp(argv[argi], "--older-than") == 0) {
+                older_than = argv[argi + 1];
+            } else if (strcmp(argv[argi], "--granularity") == 0) {
+                granularity = argv[argi + 1];
+            } else {
+                break;
+            }
+            argi += 2;
+        }
+        if (argi != argc || older_than == NULL || granularity == NULL) {
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
+        err = open_ctx(store, 1, &ctx);
+        if (err != SCRIBE_OK) {
+            return fail(err);
+        }
+        err = scribe_cli_compact_history(ctx, older_than, granularity);
+        scribe_close(ctx);
+        return err == SCRIBE_OK ? 0 : fail(err);
+    }
+    if (strcmp(cmd, "archive") == 0) {
+        if (argc - argi != 2 || strcmp(argv[argi], "--older-than") != 0) {
+            usage(stderr);
+            return (int)SCRIBE_EINVAL;
+        }
+        err = open_ctx(store, 1, &ctx);
+        if (err != SCRIBE_OK) {
+            return fail(err);
+        }
+        err = scribe_cli_archive(ctx, argv[argi + 1]);
+        scribe_close(ctx);
+        return err == SCRIBE_OK ? 0 : fail(err);
+    }
+    if (strcmp(cmd, "import") == 0) {
+#ifdef SCRIBE_HAVE_MONGO_ADAPTER
+        scribe_mongo_import_options opts;
+
+        memset(&opts, 0, sizeof(opts));
+        while (argi < argc) {
+            if (argi + 1 >= argc) {
+                usage(stderr);
+                return (int)SCRIBE_EINVAL;
+            }
+            if (strcmp(argv[argi], "--mongodump") == 0) {
+                opts.mongodump_dir = argv[argi + 1];
+            } else if (strcmp(argv[argi], "--ndjson") == 0) {
+                opts.ndjson_path = argv[argi + 1];
+            } else if (strcmp(argv[argi], "--path-template") == 0) {
+                opts.path_template = argv[argi + 1];
+            } else if (strcmp(argv[argi], "--oplog-ts") == 0) {
+                opts.oplog_ts = argv[argi + 1];
+            } else {
+                usage(stderr);
+                return (int)SCRIBE_EINVAL;
+            }
+            argi += 2;
+        }
+        err = open_ctx(store, 1, &ctx);
+        if (err != SCRIBE_OK) {
+            return fail(err);
+        }
+        err = scribe_mongo_import(ctx, &opts);
+        scribe_close(ctx);
+        return err == SCRIBE_OK ? 0 : fail(err);
+#else
+        (void)argi;
+        fprintf(stderr, "scribe: %s: import requires the MongoDB adapter\n", scribe_error_symbol(SCRIBE_ENOSYS));
+        return (int)SCRIBE_ENOSYS;
+#endif
+    }
     if (strcmp(cmd, "mongo-watch") == 0) {
 #ifdef SCRIBE_HAVE_MONGO_ADAPTER
         const char *uri;
@@ -0,0 +1,326 @@
+/*
+ * Cold-history archiving.
+ *
+ * `scribe archive --older-than <age>` shrinks the objects that only old
+ * history still uses. It walks main's old commits oldest first and pairs every
+ * tree with the parent commit's tree at the same path, so each changed blob or
+ * subtree meets the previous version of itself. Each object is then stored as
+ * a zstd delta against that previous version (see object.c); commits use their
+ * parent commit as the base. Objects are visited in order of first appearance,
+ * so a base always appeared earlier in history than the object built on it
+ * and chains cannot loop. Objects reachable from recent commits are left alone
+ * so the working set keeps single-frame reads. Hashes cover the uncompressed
+ * envelope, so no tree, commit, or ref changes.
+ *
+ * A delta keeps its base alive. When `compact-history` drops the commits
+ * that reached a base, scribe_archive_detach_unreachable() re-encodes the
+ * retained deltas on such bases as self-contained frames, so everything fsck
+ * then reports as dangling can be deleted.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    scribe_ctx *ctx;
+    scribe_archiver *archiver;
+    scribe_hash_map hot;
+    scribe_hash_map seen;
+    scribe_archive_stats stats;
+} archive_state;
+
+/*
+ * Reads and parses a tree into `arena`. The caller frees `obj` after it is
+ * done with the entries, which point into the payload.
+ */
+static scribe_error_t load_tree(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_object *obj,
+                                scribe_arena *arena, scribe_tree_entry **entries, size_t *count) {
+    size_t capacity = 0;
+    scribe_error_t err = scribe_object_read(ctx, hash, obj);
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj->type != SCRIBE_OBJECT_TREE) {
+        scribe_object_free(obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "tree entry points at a non-tree object");
+    }
+    err = scribe_tree_parse_arena_capacity(obj->payload_len, &capacity);
+    if (err == SCRIBE_OK) {
+        err = scribe_arena_init(arena, capacity);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_tree_parse(obj->payload, obj->payload_len, arena, entries, count);
+    }
+    if (err != SCRIBE_OK) {
+        scribe_object_free(obj);
+    }
+    return err;
+}
+
+/*
+ * Adds a tree and everything under it to the hot set. Subtrees already in
+ * the set are not walked again.
+ */
+static scribe_error_t mark_hot(archive_state *st, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    scribe_object obj;
+    scribe_arena arena = {0};
+    scribe_tree_entry *entries = NULL;
+    size_t count = 0;
+    size_t i;
+    int already = 0;
+    scribe_error_t err = scribe_hash_map_add(&st->hot, hash, 0, &already, NULL);
+
+    if (err != SCRIBE_OK || already) {
+        return err;
+    }
+    err = load_tree(st->ctx, hash, &obj, &arena, &entries, &count);
+    if (err != SCRIBE_OK) {
+        scribe_arena_destroy(&arena);
+        return err;
+    }
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        if (entries[i].type == SCRIBE_OBJECT_TREE) {
+            err = mark_hot(st, entries[i].hash);
+        } else {
+            err = scribe_hash_map_add(&st->hot, entries[i].hash, 0, &already, NULL);
+        }
+    }
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Archives one object against `base` (NULL for none) the first time it is
+ * seen. Returns *first = 0 for hot or already visited objects.
+ */
+static scribe_error_t archive_one(archive_state *st, const uint8_t hash[SCRIBE_HASH_SIZE], const uint8_t *base,
+                                  int *first) {
+    int already = 0;
+    scribe_error_t err;
+
+    *first = 0;
+    if (scribe_hash_map_get(&st->hot, hash) != NULL) {
+        return SCRIBE_OK;
+    }
+    err = scribe_hash_map_add(&st->seen, hash, 0, &already, NULL);
+    if (err != SCRIBE_OK || already) {
+        return err;
+    }
+    *first = 1;
+    return scribe_archiver_store(st->archiver, hash, base, &st->stats);
+}
+
+/*
+ * Archives tree `hash` and the new objects under it. `base` is the tree at the
+ * same path in the parent commit, or NULL; entries are matched to it by name
+ * so each changed child is stored against its previous version. Entries whose
+ * type changed, or that are new, are stored without a base.
+ */
+static scribe_error_t archive_tree(archive_state *st, const uint8_t *base, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    scribe_object obj;
+    scribe_object base_obj;
+    scribe_arena arena = {0};
+    scribe_arena base_arena = {0};
+    scribe_tree_entry *entries = NULL;
+    scribe_tree_entry *base_entries = NULL;
+    size_t count = 0;
+    size_t base_count = 0;
+    size_t i;
+    size_t j = 0;
+    int first = 0;
+    int have_base = 0;
+    scribe_error_t err = archive_one(st, hash, base, &first);
+
+    if (err != SCRIBE_OK || !first) {
+        return err;
+    }
+    err = load_tree(st->ctx, hash, &obj, &arena, &entries, &count);
+    if (err != SCRIBE_OK) {
+        scribe_arena_destroy(&arena);
+        return err;
+    }
+    if (base != NULL) {
+        err = load_tree(st->ctx, base, &base_obj, &base_arena, &base_entries, &base_count);
+        have_base = err == SCRIBE_OK;
+    }
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        const scribe_tree_entry *e = &entries[i];
+        const uint8_t *prev = NULL;
+        int cmp = 1;
+
+        while (j < base_count && (cmp = scribe_tree_entry_compare(&base_entries[j], e)) < 0) {
+            j++;
+        }
+        if (j < base_count && cmp == 0 && base_entries[j].type == e->type) {
+            if (scribe_hash_cmp(base_entries[j].hash, e->hash) == 0) {
+                continue;
+            }
+            prev = base_entries[j].hash;
+        }
+        if (e->type == SCRIBE_OBJECT_TREE) {
+            err = archive_tree(st, prev, e->hash);
+        } else {
+            err = archive_one(st, e->hash, prev, &first);
+        }
+    }
+    if (have_base) {
+        scribe_object_free(&base_obj);
+    }
+    scribe_arena_destroy(&base_arena);
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Implements `scribe archive`. Commits older than `older_than` form the cold
+ * part of main; objects reachable only from it are re-stored as deltas. Prints
+ * a one-line summary of the objects visited and the space recovered.
+ */
+scribe_error_t scribe_cli_archive(scribe_ctx *ctx, const char *older_than) {
+    archive_state st;
+    scribe_history_entry *entries = NULL;
+    uint8_t head[SCRIBE_HASH_SIZE];
+    size_t count = 0;
+    size_t cold = 0;
+    size_t i;
+    int64_t age;
+    int first;
+    scribe_error_t err;
+
+    memset(&st, 0, sizeof(st));
+    st.ctx = ctx;
+    err = scribe_parse_duration(older_than, "--older-than", &age);
+    if (err == SCRIBE_OK) {
+        err = scribe_partition_fold(ctx);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_refs_read(ctx, "refs/heads/main", head);
+        if (err == SCRIBE_OK) {
+            err = scribe_history_load(ctx, head, &entries, &count);
+        } else if (err == SCRIBE_ENOT_FOUND) {
+            err = SCRIBE_OK;
+        }
+    }
+    if (err == SCRIBE_OK) {
+        cold = scribe_history_cold_count(entries, count, age);
+        err = scribe_archiver_new(ctx, &st.archiver);
+    }
+    /*
+     * Everything the recent commits can reach stays in its current encoding,
+     * including objects that first appeared in cold history.
+     */
+    for (i = cold; err == SCRIBE_OK && i < count; i++) {
+        err = scribe_hash_map_add(&st.hot, entries[i].hash, 0, &first, NULL);
+        if (err == SCRIBE_OK) {
+            err = mark_hot(&st, entries[i].root);
+        }
+    }
+    for (i = 0; err == SCRIBE_OK && i < cold; i++) {
+        const uint8_t *parent = i == 0 ? NULL : entries[i - 1u].hash;
+
+        err = archive_one(&st, entries[i].hash, parent, &first);
+        if (err == SCRIBE_OK) {
+            err = archive_tree(&st, i == 0 ? NULL : entries[i - 1u].root, entries[i].root);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_object_flush(ctx);
+    }
+    scribe_archiver_free(st.archiver);
+    scribe_hash_map_destroy(&st.hot);
+    scribe_hash_map_destroy(&st.seen);
+    free(entries);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    scribe_log_msg(ctx, SCRIBE_LOG_INFO, "objects", "archive stored %zu of %zu cold object(s) as %zu delta(s)",
+                   st.stats.rewritten, st.stats.objects, st.stats.deltas);
+    printf("archive: %zu commits, %zu objects, %zu rewritten, %zu deltas, %llu -> %llu bytes\n", cold,
+           st.stats.objects, st.stats.rewritten, st.stats.deltas, (unsigned long long)st.stats.bytes_before,
+           (unsigned long long)st.stats.bytes_after);
+    return SCRIBE_OK;
+}
+
+/*
+ * Re-encodes every delta that main still reaches but whose base it no longer
+ * reaches as a self-contained frame, and drops those deltas from the list.
+ * Run after history is rewritten; rerunning it is harmless. A store with no
+ * recorded deltas is left untouched without a walk.
+ */
+scribe_error_t scribe_archive_detach_unreachable(scribe_ctx *ctx, size_t *out_rewritten) {
+    archive_state st;
+    scribe_history_entry *entries = NULL;
+    scribe_hash_map detached = {0};
+    uint8_t head[SCRIBE_HASH_SIZE];
+    uint8_t *pairs = NULL;
+    const uint8_t *listed = NULL;
+    size_t count = 0;
+    size_t listed_count;
+    size_t i;
+    int first;
+    scribe_error_t err;
+
+    *out_rewritten = 0;
+    err = scribe_archive_deltas_load(ctx, &pairs, &count);
+    free(pairs);
+    if (err != SCRIBE_OK || count == 0) {
+        return err;
+    }
+    memset(&st, 0, sizeof(st));
+    st.ctx = ctx;
+    err = scribe_refs_read(ctx, "refs/heads/main", head);
+    if (err == SCRIBE_OK) {
+        err = scribe_history_load(ctx, head, &entries, &count);
+    }
+    /* The graph set: every commit and everything its tree reaches. */
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        err = scribe_hash_map_add(&st.hot, entries[i].hash, 0, &first, NULL);
+        if (err == SCRIBE_OK) {
+            err = mark_hot(&st, entries[i].root);
+        }
+    }
+    free(entries);
+    if (err == SCRIBE_OK) {
+        err = scribe_archiver_new(ctx, &st.archiver);
+    }
+    listed_count = err == SCRIBE_OK ? scribe_archiver_deltas(st.archiver, &listed) : 0;
+    for (i = 0; err == SCRIBE_OK && i < listed_count; i++) {
+        const uint8_t *hash = listed + i * 2u * SCRIBE_HASH_SIZE;
+        uint8_t base[SCRIBE_HASH_SIZE];
+        int is_delta = 0;
+        int rewritten = 0;
+
+        if (scribe_hash_map_get(&st.hot, hash) == NULL || scribe_hash_map_get(&detached, hash) != NULL) {
+            continue;
+        }
+        err = scribe_object_delta_base(ctx, hash, base, &is_delta);
+        if (err == SCRIBE_OK && is_delta && scribe_hash_map_get(&st.hot, base) == NULL) {
+            err = scribe_archiver_detach(st.archiver, hash, &rewritten);
+        }
+        if (err == SCRIBE_OK && rewritten) {
+            err = scribe_hash_map_add(&detached, hash, 0, NULL, NULL);
+        }
+    }
+    if (err == SCRIBE_OK && detached.count != 0) {
+        err = scribe_object_flush(ctx);
+        if (err == SCRIBE_OK) {
+            err = scribe_archiver_prune(st.archiver, &detached);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        *out_rewritten = detached.count;
+    }
+    scribe_archiver_free(st.archiver);
+    scribe_hash_map_destroy(&st.hot);
+    scribe_hash_map_destroy(&detached);
+    return err;
+}
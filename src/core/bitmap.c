@@ -0,0 +1,1016 @@
+/*
+ * Reachability bitmaps.
+ *
+ * `objects/info/bitmaps` numbers every object reachable from the main ref in
+ * the order a history walk from the oldest commit first meets it, and stores,
+ * for selected commits, the set of objects reachable from that commit as an
+ * EWAH-compressed bitmap over those numbers. Because v1 history is linear and
+ * each commit reaches everything its parent does, these sets are mostly long
+ * runs of ones and compress to a few words.
+ *
+ * A reachability query walks the commit chain back from the ref only until it
+ * meets a bitmapped commit, ORs that commit's bitmap into the result, and then
+ * walks the trees of the newer commits, stopping at any subtree already in the
+ * set. Objects written after the bitmaps were built are kept in a hash table.
+ * Archived deltas reference their base (see object.c), so every reachable
+ * delta listed in `objects/info/archive-deltas` adds its real base chain last.
+ *
+ * Lookups by hash go through a 256-entry fanout on the first hash byte and a
+ * binary search of one slice of a sorted position table. `repack --incremental`
+ * extends the file from its last bitmapped tip: existing numbers and bitmaps
+ * are kept, so the cost of an update is the walk of the newer commits.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/leb128.h"
+#include "util/log.h"
+
+#include "blake3.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define BITMAP_MAGIC "SCRIBMP\002"
+#define BITMAP_MAGIC_LEN 8u
+#define BITMAP_FANOUT_BYTES (256u * 4u)
+
+/*
+ * A bitmap is stored for every this-many commits counted from the oldest, and
+ * for the ref tip. A query therefore walks at most this many commits' trees.
+ */
+#define BITMAP_INTERVAL 100u
+
+/* EWAH marker word: bit 0 run bit, bits 1-32 run length, bits 33-63 literal count. */
+#define EWAH_RUN_MAX UINT64_C(0xffffffff)
+#define EWAH_LIT_MAX UINT64_C(0x7fffffff)
+
+typedef struct {
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    const uint8_t *words;
+    size_t word_count;
+} bitmap_commit;
+
+typedef struct {
+    uint8_t *file;
+    const uint8_t *order;
+    const uint8_t *fanout;
+    const uint8_t *by_hash;
+    size_t count;
+    bitmap_commit *commits;
+    size_t commit_count;
+} bitmap_index;
+
+struct scribe_reachable {
+    bitmap_index *index;
+    uint64_t *bits;
+    scribe_hash_map extra;
+};
+
+/*
+ * Reads a little-endian 64-bit word from unaligned file bytes.
+ */
+static uint64_t read_le64(const uint8_t *p) {
+    uint64_t v = 0;
+    size_t i;
+
+    for (i = 0; i < 8u; i++) {
+        v |= (uint64_t)p[i] << (8u * i);
+    }
+    return v;
+}
+
+/*
+ * Reads a little-endian 32-bit value from unaligned file bytes.
+ */
+static uint32_t read_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * ORs one EWAH-compressed bitmap into a plain bitset of `word_count` words.
+ * Runs or literals that would extend past the bitset are corruption.
+ */
+static scribe_error_t ewah_or_into(const uint8_t *words, size_t n, uint64_t *bits, size_t word_count) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < n) {
+        uint64_t marker = read_le64(words + in * 8u);
+        uint64_t run = (marker >> 1) & EWAH_RUN_MAX;
+        uint64_t lits = marker >> 33;
+        size_t i;
+
+        in++;
+        if (run > word_count - out || lits > word_count - out - (size_t)run || lits > n - in) {
+            return scribe_set_error(SCRIBE_ECORRUPT, "invalid reachability bitmap");
+        }
+        if (marker & 1u) {
+            for (i = 0; i < (size_t)run; i++) {
+                bits[out + i] = UINT64_MAX;
+            }
+        }
+        out += (size_t)run;
+        for (i = 0; i < (size_t)lits; i++) {
+            bits[out++] |= read_le64(words + (in + i) * 8u);
+        }
+        in += (size_t)lits;
+    }
+    return SCRIBE_OK;
+}
+
+typedef struct {
+    uint8_t *bytes;
+    size_t len;
+    size_t cap;
+} byte_buf;
+
+/*
+ * Appends bytes to a growable output buffer.
+ */
+static scribe_error_t buf_append(byte_buf *b, const void *bytes, size_t len) {
+    if (len > b->cap - b->len) {
+        size_t cap = b->cap == 0 ? 4096u : b->cap;
+        uint8_t *grown;
+
+        while (len > cap - b->len) {
+            if (cap > SIZE_MAX / 2u) {
+                return scribe_set_error(SCRIBE_ENOMEM, "reachability bitmaps are too large");
+            }
+            cap *= 2u;
+        }
+        grown = (uint8_t *)realloc(b->bytes, cap);
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow bitmap buffer");
+        }
+        b->bytes = grown;
+        b->cap = cap;
+    }
+    memcpy(b->bytes + b->len, bytes, len);
+    b->len += len;
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends a LEB128 integer to a growable output buffer.
+ */
+static scribe_error_t buf_leb128(byte_buf *b, uint64_t v) {
+    uint8_t tmp[10];
+    size_t n = scribe_leb128_encode(v, tmp);
+
+    return buf_append(b, tmp, n);
+}
+
+/*
+ * Appends a little-endian 64-bit word to a growable output buffer.
+ */
+static scribe_error_t buf_le64(byte_buf *b, uint64_t v) {
+    uint8_t tmp[8];
+    size_t i;
+
+    for (i = 0; i < 8u; i++) {
+        tmp[i] = (uint8_t)(v >> (8u * i));
+    }
+    return buf_append(b, tmp, sizeof(tmp));
+}
+
+/*
+ * Returns whether a bitset word is all zeros or all ones, which EWAH encodes
+ * as part of a run instead of as a literal.
+ */
+static int ewah_clean(uint64_t w) { return w == 0 || w == UINT64_MAX; }
+
+/*
+ * Appends the EWAH encoding of a plain bitset to `b` as a LEB128 word count
+ * followed by little-endian words.
+ */
+static scribe_error_t ewah_encode(byte_buf *b, const uint64_t *bits, size_t word_count) {
+    byte_buf words;
+    size_t i = 0;
+    scribe_error_t err = SCRIBE_OK;
+
+    memset(&words, 0, sizeof(words));
+    while (err == SCRIBE_OK && i < word_count) {
+        uint64_t run_bit = 0;
+        uint64_t run = 0;
+        size_t lit_start;
+        uint64_t lits = 0;
+
+        if (ewah_clean(bits[i])) {
+            run_bit = bits[i] & 1u;
+            while (i < word_count && bits[i] == (run_bit ? UINT64_MAX : 0) && run < EWAH_RUN_MAX) {
+                run++;
+                i++;
+            }
+        }
+        lit_start = i;
+        while (i < word_count && !ewah_clean(bits[i]) && lits < EWAH_LIT_MAX) {
+            lits++;
+            i++;
+        }
+        err = buf_le64(&words, run_bit | (run << 1) | (lits << 33));
+        for (size_t k = 0; err == SCRIBE_OK && k < (size_t)lits; k++) {
+            err = buf_le64(&words, bits[lit_start + k]);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = buf_leb128(b, words.len / 8u);
+    }
+    if (err == SCRIBE_OK && words.len != 0) {
+        err = buf_append(b, words.bytes, words.len);
+    }
+    free(words.bytes);
+    return err;
+}
+
+/*
+ * Frees a loaded bitmap index.
+ */
+static void index_free(bitmap_index *idx) {
+    if (idx != NULL) {
+        free(idx->commits);
+        free(idx->file);
+        free(idx);
+    }
+}
+
+/*
+ * Reads one LEB128 value from a bitmap file cursor.
+ */
+static scribe_error_t index_leb128(const uint8_t *bytes, size_t len, size_t *pos, uint64_t *out) {
+    size_t used = 0;
+
+    if (scribe_leb128_decode(bytes + *pos, len - *pos, out, &used) != SCRIBE_OK) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid reachability bitmap file");
+    }
+    *pos += used;
+    return SCRIBE_OK;
+}
+
+/*
+ * Loads and checksums `objects/info/bitmaps`. Returns SCRIBE_ENOT_FOUND when
+ * no bitmaps have been written.
+ */
+static scribe_error_t index_load(scribe_ctx *ctx, bitmap_index **out) {
+    bitmap_index *idx;
+    char *path = scribe_path_join(ctx->repo_path, "objects/info/bitmaps");
+    uint8_t digest[SCRIBE_HASH_SIZE];
+    blake3_hasher hasher;
+    size_t len = 0;
+    size_t body;
+    size_t pos = BITMAP_MAGIC_LEN;
+    uint64_t v;
+    size_t i;
+    scribe_error_t err;
+
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    idx = (bitmap_index *)calloc(1, sizeof(*idx));
+    if (idx == NULL) {
+        free(path);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate bitmap index");
+    }
+    err = scribe_read_file(path, &idx->file, &len);
+    free(path);
+    if (err != SCRIBE_OK) {
+        index_free(idx);
+        return err;
+    }
+    if (len < BITMAP_MAGIC_LEN + SCRIBE_HASH_SIZE || memcmp(idx->file, BITMAP_MAGIC, BITMAP_MAGIC_LEN) != 0) {
+        index_free(idx);
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid reachability bitmap header");
+    }
+    body = len - SCRIBE_HASH_SIZE;
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, idx->file, body);
+    blake3_hasher_finalize(&hasher, digest, SCRIBE_HASH_SIZE);
+    if (memcmp(digest, idx->file + body, SCRIBE_HASH_SIZE) != 0) {
+        index_free(idx);
+        return scribe_set_error(SCRIBE_ECORRUPT, "reachability bitmap checksum mismatch");
+    }
+    err = index_leb128(idx->file, body, &pos, &v);
+    if (err == SCRIBE_OK && (v > UINT32_MAX || body - pos < BITMAP_FANOUT_BYTES ||
+                             v > (body - pos - BITMAP_FANOUT_BYTES) / (SCRIBE_HASH_SIZE + 4u))) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "invalid reachability bitmap object count");
+    }
+    if (err == SCRIBE_OK) {
+        idx->count = (size_t)v;
+        idx->order = idx->file + pos;
+        pos += idx->count * SCRIBE_HASH_SIZE;
+        idx->fanout = idx->file + pos;
+        pos += BITMAP_FANOUT_BYTES;
+        idx->by_hash = idx->file + pos;
+        pos += idx->count * 4u;
+        for (i = 0; err == SCRIBE_OK && i < 256u; i++) {
+            uint32_t upper = read_le32(idx->fanout + i * 4u);
+            if (upper > idx->count || (i > 0 && upper < read_le32(idx->fanout + (i - 1u) * 4u)) ||
+                (i == 255u && upper != idx->count)) {
+                err = scribe_set_error(SCRIBE_ECORRUPT, "invalid reachability bitmap fanout");
+            }
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = index_leb128(idx->file, body, &pos, &v);
+    }
+    if (err == SCRIBE_OK && v > (body - pos) / (SCRIBE_HASH_SIZE + 1u)) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "invalid reachability bitmap commit count");
+    }
+    if (err == SCRIBE_OK) {
+        idx->commit_count = (size_t)v;
+        idx->commits = (bitmap_commit *)calloc(idx->commit_count == 0 ? 1u : idx->commit_count, sizeof(*idx->commits));
+        if (idx->commits == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate bitmap commits");
+        }
+    }
+    for (i = 0; err == SCRIBE_OK && i < idx->commit_count; i++) {
+        if (body - pos < SCRIBE_HASH_SIZE) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "truncated reachability bitmap");
+            break;
+        }
+        memcpy(idx->commits[i].hash, idx->file + pos, SCRIBE_HASH_SIZE);
+        pos += SCRIBE_HASH_SIZE;
+        err = index_leb128(idx->file, body, &pos, &v);
+        if (err == SCRIBE_OK && v > (body - pos) / 8u) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "truncated reachability bitmap");
+        }
+        if (err == SCRIBE_OK) {
+            idx->commits[i].words = idx->file + pos;
+            idx->commits[i].word_count = (size_t)v;
+            pos += (size_t)v * 8u;
+        }
+    }
+    if (err == SCRIBE_OK && pos != body) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "trailing bytes in reachability bitmap");
+    }
+    if (err != SCRIBE_OK) {
+        index_free(idx);
+        return err;
+    }
+    *out = idx;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the bit position of a hash in the index, or -1 when the object was
+ * written after the bitmaps. The fanout narrows the by-hash table to entries
+ * sharing the first hash byte, which are then binary searched.
+ */
+static long index_position(const bitmap_index *idx, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    size_t lo = hash[0] == 0 ? 0 : read_le32(idx->fanout + (hash[0] - 1u) * 4u);
+    size_t hi = read_le32(idx->fanout + hash[0] * 4u);
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2u;
+        uint32_t p = read_le32(idx->by_hash + mid * 4u);
+        int c = p < idx->count ? memcmp(idx->order + (size_t)p * SCRIBE_HASH_SIZE, hash, SCRIBE_HASH_SIZE) : 1;
+
+        if (c == 0) {
+            return (long)p;
+        }
+        if (c < 0) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Adds one hash to a reachable set. *already reports whether it was present,
+ * which lets walks stop at subtrees they have covered.
+ */
+static scribe_error_t reachable_add(scribe_reachable *r, const uint8_t hash[SCRIBE_HASH_SIZE], int *already) {
+    if (r->index != NULL) {
+        long pos = index_position(r->index, hash);
+        if (pos >= 0) {
+            uint64_t bit = UINT64_C(1) << ((size_t)pos % 64u);
+            *already = (r->bits[(size_t)pos / 64u] & bit) != 0;
+            r->bits[(size_t)pos / 64u] |= bit;
+            return SCRIBE_OK;
+        }
+    }
+    return scribe_hash_map_add(&r->extra, hash, 0, already, NULL);
+}
+
+typedef scribe_error_t (*reach_add_fn)(void *set, const uint8_t hash[SCRIBE_HASH_SIZE], int *already);
+
+/*
+ * Walks one tree into a set: the tree itself, its blob entries, and each
+ * subtree not already present. Shard levels are ordinary subtrees here.
+ */
+static scribe_error_t walk_tree(scribe_ctx *ctx, reach_add_fn add, void *set, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_tree_entry *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t i;
+    int already = 0;
+    scribe_error_t err = add(set, hash, &already);
+
+    if (err != SCRIBE_OK || already) {
+        return err;
+    }
+    err = scribe_object_read(ctx, hash, &obj);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_TREE) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "reachable object has wrong type");
+    }
+    err = scribe_tree_parse_arena_capacity(obj.payload_len, &capacity);
+    if (err == SCRIBE_OK) {
+        err = scribe_arena_init(&arena, capacity);
+    }
+    if (err != SCRIBE_OK) {
+        scribe_object_free(&obj);
+        return err;
+    }
+    err = scribe_tree_parse(obj.payload, obj.payload_len, &arena, &entries, &count);
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        if (entries[i].type == SCRIBE_OBJECT_TREE) {
+            err = walk_tree(ctx, add, set, entries[i].hash);
+        } else {
+            err = add(set, entries[i].hash, &already);
+        }
+    }
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Reads a commit's root tree and parent. *has_parent is cleared for the
+ * initial commit.
+ */
+static scribe_error_t read_commit_links(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                        uint8_t root[SCRIBE_HASH_SIZE], uint8_t parent[SCRIBE_HASH_SIZE],
+                                        int *has_parent) {
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+    scribe_error_t err = scribe_object_read(ctx, hash, &obj);
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_COMMIT) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "reachable object has wrong type");
+    }
+    err = scribe_arena_init(&arena, obj.payload_len + 4096u);
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view);
+        if (err == SCRIBE_OK) {
+            scribe_hash_copy(root, view.root_tree);
+            scribe_hash_copy(parent, view.parent);
+            *has_parent = view.has_parent;
+        }
+        scribe_arena_destroy(&arena);
+    }
+    scribe_object_free(&obj);
+    return err;
+}
+
+typedef struct {
+    uint8_t *pairs;
+    size_t count;
+    size_t cap;
+} commit_chain;
+
+/*
+ * Appends one (commit, root tree) pair to a chain.
+ */
+static scribe_error_t chain_push(commit_chain *c, const uint8_t commit[SCRIBE_HASH_SIZE],
+                                 const uint8_t root[SCRIBE_HASH_SIZE]) {
+    if (c->count == c->cap) {
+        size_t cap = c->cap == 0 ? 64u : c->cap * 2u;
+        uint8_t *grown;
+
+        if (cap > SIZE_MAX / (2u * SCRIBE_HASH_SIZE)) {
+            return scribe_set_error(SCRIBE_ENOMEM, "commit chain is too long");
+        }
+        grown = (uint8_t *)realloc(c->pairs, cap * 2u * SCRIBE_HASH_SIZE);
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow commit chain");
+        }
+        c->pairs = grown;
+        c->cap = cap;
+    }
+    memcpy(c->pairs + c->count * 2u * SCRIBE_HASH_SIZE, commit, SCRIBE_HASH_SIZE);
+    memcpy(c->pairs + c->count * 2u * SCRIBE_HASH_SIZE + SCRIBE_HASH_SIZE, root, SCRIBE_HASH_SIZE);
+    c->count++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the bitmap stored for a commit, or NULL.
+ */
+static const bitmap_commit *index_commit(const bitmap_index *idx, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    size_t i;
+
+    for (i = 0; idx != NULL && i < idx->commit_count; i++) {
+        if (memcmp(idx->commits[i].hash, hash, SCRIBE_HASH_SIZE) == 0) {
+            return &idx->commits[i];
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Collects the commits from `head` back to the first one that has a bitmap
+ * (exclusive), newest first, and returns that bitmap in *stop. Without an
+ * index, or when no bitmapped commit is an ancestor, the whole history is
+ * collected and *stop is NULL.
+ */
+static scribe_error_t collect_chain(scribe_ctx *ctx, const bitmap_index *idx, const uint8_t head[SCRIBE_HASH_SIZE],
+                                    commit_chain *chain, const bitmap_commit **stop) {
+    uint8_t current[SCRIBE_HASH_SIZE];
+    uint8_t root[SCRIBE_HASH_SIZE];
+    uint8_t parent[SCRIBE_HASH_SIZE];
+    int has_parent = 1;
+    scribe_error_t err = SCRIBE_OK;
+
+    *stop = NULL;
+    scribe_hash_copy(current, head);
+    while (err == SCRIBE_OK && has_parent) {
+        *stop = index_commit(idx, current);
+        if (*stop != NULL) {
+            break;
+        }
+        err = read_commit_links(ctx, current, root, parent, &has_parent);
+        if (err == SCRIBE_OK) {
+            err = chain_push(chain, current, root);
+        }
+        scribe_hash_copy(current, parent);
+    }
+    return err;
+}
+
+/*
+ * Set adapter so walk_tree() can fill a scribe_reachable.
+ */
+static scribe_error_t reachable_add_fn(void *set, const uint8_t hash[SCRIBE_HASH_SIZE], int *already) {
+    return reachable_add((scribe_reachable *)set, hash, already);
+}
+
+/*
+ * Adds the delta bases of reachable archived objects to a reachable set. The
+ * delta list names candidates; each chain is followed through the stored
+ * headers, so a listed object that has since been detached adds nothing.
+ * A base adds only itself and its own base, not the objects it references.
+ */
+static scribe_error_t reachable_add_bases(scribe_ctx *ctx, scribe_reachable *r) {
+    uint8_t *pairs = NULL;
+    size_t count = 0;
+    size_t i;
+    scribe_error_t err = scribe_archive_deltas_load(ctx, &pairs, &count);
+
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        uint8_t at[SCRIBE_HASH_SIZE];
+        int is_delta = 1;
+        unsigned depth;
+
+        if (!scribe_reachable_has(r, pairs + i * 2u * SCRIBE_HASH_SIZE)) {
+            continue;
+        }
+        scribe_hash_copy(at, pairs + i * 2u * SCRIBE_HASH_SIZE);
+        for (depth = 0; err == SCRIBE_OK && depth <= SCRIBE_ARCHIVE_MAX_DEPTH; depth++) {
+            int already;
+
+            err = scribe_object_delta_base(ctx, at, at, &is_delta);
+            if (err == SCRIBE_ENOT_FOUND) {
+                scribe_clear_error();
+                err = SCRIBE_OK;
+                break;
+            }
+            if (err != SCRIBE_OK || !is_delta) {
+                break;
+            }
+            err = reachable_add(r, at, &already);
+        }
+    }
+    free(pairs);
+    return err;
+}
+
+/*
+ * Computes the set of objects reachable from refs/heads/main: parents, root
+ * trees, subtrees, blobs, and the delta bases of archived objects. Bitmaps are used when present and valid; a
+ * damaged bitmap file is logged and ignored, falling back to a full walk.
+ */
+scribe_error_t scribe_reachable_compute(scribe_ctx *ctx, scribe_reachable **out) {
+    scribe_reachable *r;
+    commit_chain chain;
+    const bitmap_commit *stop = NULL;
+    uint8_t head[SCRIBE_HASH_SIZE];
+    size_t word_count = 0;
+    size_t i;
+    scribe_error_t err;
+
+    if (ctx == NULL || out == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid reachability arguments");
+    }
+    r = (scribe_reachable *)calloc(1, sizeof(*r));
+    if (r == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate reachable set");
+    }
+    err = index_load(ctx, &r->index);
+    if (err != SCRIBE_OK && err != SCRIBE_ENOT_FOUND) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "objects", "ignoring reachability bitmaps: %s",
+                       scribe_last_error_detail());
+    }
+    if (r->index != NULL) {
+        word_count = (r->index->count + 63u) / 64u;
+        r->bits = (uint64_t *)calloc(word_count == 0 ? 1u : word_count, sizeof(*r->bits));
+        if (r->bits == NULL) {
+            scribe_reachable_free(r);
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate reachability bitmap");
+        }
+    }
+    err = scribe_refs_read(ctx, "refs/heads/main", head);
+    if (err == SCRIBE_ENOT_FOUND) {
+        *out = r;
+        return SCRIBE_OK;
+    }
+    if (err != SCRIBE_OK) {
+        scribe_reachable_free(r);
+        return err;
+    }
+    memset(&chain, 0, sizeof(chain));
+    err = collect_chain(ctx, r->index, head, &chain, &stop);
+    if (err == SCRIBE_OK && stop != NULL) {
+        err = ewah_or_into(stop->words, stop->word_count, r->bits, word_count);
+    }
+    for (i = 0; err == SCRIBE_OK && i < chain.count; i++) {
+        int already;
+        err = reachable_add(r, chain.pairs + i * 2u * SCRIBE_HASH_SIZE, &already);
+        if (err == SCRIBE_OK) {
+            err = walk_tree(ctx, reachable_add_fn, r, chain.pairs + i * 2u * SCRIBE_HASH_SIZE + SCRIBE_HASH_SIZE);
+        }
+    }
+    free(chain.pairs);
+    if (err == SCRIBE_OK) {
+        err = reachable_add_bases(ctx, r);
+    }
+    if (err != SCRIBE_OK) {
+        scribe_reachable_free(r);
+        return err;
+    }
+    *out = r;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns whether a hash is in a computed reachable set.
+ */
+int scribe_reachable_has(const scribe_reachable *r, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    if (r->index != NULL) {
+        long pos = index_position(r->index, hash);
+        if (pos >= 0) {
+            return (r->bits[(size_t)pos / 64u] >> ((size_t)pos % 64u)) & 1u;
+        }
+    }
+    return scribe_hash_map_get(&r->extra, hash) != NULL;
+}
+
+/*
+ * Releases a reachable set and the bitmap index it borrowed from.
+ */
+void scribe_reachable_free(scribe_reachable *r) {
+    if (r != NULL) {
+        index_free(r->index);
+        free(r->bits);
+        scribe_hash_map_destroy(&r->extra);
+        free(r);
+    }
+}
+
+typedef struct {
+    const bitmap_index *base;
+    size_t base_count;
+    scribe_hash_map seen;
+    uint8_t *order;
+    size_t count;
+    size_t cap;
+    uint64_t *bits;
+    size_t word_cap;
+} bitmap_writer;
+
+/*
+ * Prepares a writer. With a base index the existing numbering is kept, every
+ * base object counts as already seen, and the running bitmap starts with all
+ * base bits set, since the new tip descends from the base tip.
+ */
+static scribe_error_t writer_init(bitmap_writer *w, const bitmap_index *base) {
+    size_t i;
+
+    memset(w, 0, sizeof(*w));
+    w->base = base;
+    w->base_count = base == NULL ? 0 : base->count;
+    w->word_cap = w->base_count / 64u + 16u;
+    w->bits = (uint64_t *)calloc(w->word_cap, sizeof(*w->bits));
+    if (w->bits == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate reachability bitmap");
+    }
+    for (i = 0; i < w->base_count / 64u; i++) {
+        w->bits[i] = UINT64_MAX;
+    }
+    if (w->base_count % 64u != 0) {
+        w->bits[w->base_count / 64u] = (UINT64_C(1) << (w->base_count % 64u)) - 1u;
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees a writer's buffers. The base index belongs to the caller.
+ */
+static void writer_destroy(bitmap_writer *w) {
+    free(w->order);
+    free(w->bits);
+    scribe_hash_map_destroy(&w->seen);
+}
+
+/*
+ * Numbers one object for the bitmap file the first time the writer meets it
+ * and sets its bit in the running cumulative bitmap.
+ */
+static scribe_error_t writer_add(void *set, const uint8_t hash[SCRIBE_HASH_SIZE], int *already) {
+    bitmap_writer *w = (bitmap_writer *)set;
+    size_t total = w->base_count + w->count;
+    scribe_error_t err;
+
+    if (w->base != NULL && index_position(w->base, hash) >= 0) {
+        *already = 1;
+        return SCRIBE_OK;
+    }
+    if (total == UINT32_MAX) {
+        return scribe_set_error(SCRIBE_ENOMEM, "too many objects for reachability bitmaps");
+    }
+    err = scribe_hash_map_add(&w->seen, hash, total, already, NULL);
+    if (err != SCRIBE_OK || *already) {
+        return err;
+    }
+    if (w->count == w->cap) {
+        size_t cap = w->cap == 0 ? 1024u : w->cap * 2u;
+        uint8_t *grown = (uint8_t *)realloc(w->order, cap * SCRIBE_HASH_SIZE);
+
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow bitmap object order");
+        }
+        w->order = grown;
+        w->cap = cap;
+    }
+    if (total / 64u >= w->word_cap) {
+        size_t word_cap = w->word_cap * 2u;
+        uint64_t *bits = (uint64_t *)realloc(w->bits, word_cap * sizeof(*bits));
+
+        if (bits == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow reachability bitmap");
+        }
+        memset(bits + w->word_cap, 0, (word_cap - w->word_cap) * sizeof(*bits));
+        w->bits = bits;
+        w->word_cap = word_cap;
+    }
+    memcpy(w->order + w->count * SCRIBE_HASH_SIZE, hash, SCRIBE_HASH_SIZE);
+    w->bits[total / 64u] |= UINT64_C(1) << (total % 64u);
+    w->count++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the hash numbered `pos` by a writer, whether it came from the base
+ * index or was added in this run.
+ */
+static const uint8_t *writer_hash(const bitmap_writer *w, size_t pos) {
+    if (pos < w->base_count) {
+        return w->base->order + pos * SCRIBE_HASH_SIZE;
+    }
+    return w->order + (pos - w->base_count) * SCRIBE_HASH_SIZE;
+}
+
+/*
+ * Appends a little-endian 32-bit value to a growable output buffer.
+ */
+static scribe_error_t buf_le32(byte_buf *b, uint32_t v) {
+    uint8_t tmp[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+
+    return buf_append(b, tmp, sizeof(tmp));
+}
+
+typedef struct {
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    uint32_t pos;
+} sorted_entry;
+
+/*
+ * Orders by-hash table entries by object hash.
+ */
+static int sorted_entry_cmp(const void *a, const void *b) {
+    return memcmp(((const sorted_entry *)a)->hash, ((const sorted_entry *)b)->hash, SCRIBE_HASH_SIZE);
+}
+
+/*
+ * Serializes the object order, the fanout, the by-hash lookup table, and the
+ * base index's commit bitmaps followed by the new ones (already encoded in
+ * `commits`) into `out`.
+ */
+static scribe_error_t writer_serialize(const bitmap_writer *w, const byte_buf *commits, size_t commit_count,
+                                       byte_buf *out) {
+    size_t total = w->base_count + w->count;
+    size_t base_commits = w->base == NULL ? 0 : w->base->commit_count;
+    sorted_entry *sorted;
+    uint32_t fanout[256];
+    uint8_t digest[SCRIBE_HASH_SIZE];
+    blake3_hasher hasher;
+    size_t i;
+    scribe_error_t err;
+
+    sorted = (sorted_entry *)malloc((total == 0 ? 1u : total) * sizeof(*sorted));
+    if (sorted == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate bitmap lookup table");
+    }
+    memset(fanout, 0, sizeof(fanout));
+    for (i = 0; i < total; i++) {
+        memcpy(sorted[i].hash, writer_hash(w, i), SCRIBE_HASH_SIZE);
+        sorted[i].pos = (uint32_t)i;
+        fanout[sorted[i].hash[0]]++;
+    }
+    for (i = 1; i < 256u; i++) {
+        fanout[i] += fanout[i - 1u];
+    }
+    qsort(sorted, total, sizeof(*sorted), sorted_entry_cmp);
+    err = buf_append(out, BITMAP_MAGIC, BITMAP_MAGIC_LEN);
+    if (err == SCRIBE_OK) {
+        err = buf_leb128(out, total);
+    }
+    if (err == SCRIBE_OK && w->base_count != 0) {
+        err = buf_append(out, w->base->order, w->base_count * SCRIBE_HASH_SIZE);
+    }
+    if (err == SCRIBE_OK && w->count != 0) {
+        err = buf_append(out, w->order, w->count * SCRIBE_HASH_SIZE);
+    }
+    for (i = 0; err == SCRIBE_OK && i < 256u; i++) {
+        err = buf_le32(out, fanout[i]);
+    }
+    for (i = 0; err == SCRIBE_OK && i < total; i++) {
+        err = buf_le32(out, sorted[i].pos);
+    }
+    free(sorted);
+    if (err == SCRIBE_OK) {
+        err = buf_leb128(out, base_commits + commit_count);
+    }
+    for (i = 0; err == SCRIBE_OK && i < base_commits; i++) {
+        const bitmap_commit *c = &w->base->commits[i];
+        err = buf_append(out, c->hash, SCRIBE_HASH_SIZE);
+        if (err == SCRIBE_OK) {
+            err = buf_leb128(out, c->word_count);
+        }
+        if (err == SCRIBE_OK && c->word_count != 0) {
+            err = buf_append(out, c->words, c->word_count * 8u);
+        }
+    }
+    if (err == SCRIBE_OK && commits->len != 0) {
+        err = buf_append(out, commits->bytes, commits->len);
+    }
+    if (err == SCRIBE_OK) {
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, out->bytes, out->len);
+        blake3_hasher_finalize(&hasher, digest, SCRIBE_HASH_SIZE);
+        err = buf_append(out, digest, sizeof(digest));
+    }
+    return err;
+}
+
+/*
+ * Loads the existing index as the base of an incremental update. Returns NULL
+ * (and the caller rebuilds in full) when there is no usable index or the main
+ * ref no longer descends from the tip it was built for; *chain then holds
+ * only the commits newer than that tip.
+ */
+static bitmap_index *incremental_base(scribe_ctx *ctx, const uint8_t head[SCRIBE_HASH_SIZE], commit_chain *chain,
+                                      scribe_error_t *err) {
+    bitmap_index *base = NULL;
+    const bitmap_commit *stop = NULL;
+
+    *err = index_load(ctx, &base);
+    if (*err == SCRIBE_ENOT_FOUND) {
+        *err = SCRIBE_OK;
+        return NULL;
+    }
+    if (*err != SCRIBE_OK) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "objects", "rebuilding reachability bitmaps: %s",
+                       scribe_last_error_detail());
+        *err = SCRIBE_OK;
+        return NULL;
+    }
+    *err = collect_chain(ctx, base, head, chain, &stop);
+    if (*err != SCRIBE_OK || base->commit_count == 0 || stop != &base->commits[base->commit_count - 1u]) {
+        if (*err == SCRIBE_OK) {
+            scribe_log_msg(ctx, SCRIBE_LOG_WARN, "objects",
+                           "rebuilding reachability bitmaps: main no longer descends from the indexed tip");
+        }
+        chain->count = 0;
+        index_free(base);
+        return NULL;
+    }
+    return base;
+}
+
+/*
+ * Writes `objects/info/bitmaps` for the history reachable from
+ * refs/heads/main. Objects are numbered as a walk from the oldest commit
+ * meets them, and a bitmap is kept for every BITMAP_INTERVAL-th commit and for
+ * the tip. In incremental mode an existing index is extended: only commits
+ * newer than its tip are walked, new objects are numbered after the existing
+ * ones, and the existing bitmaps are kept as they are. The outputs count what
+ * this run added. The caller must hold the writer lock.
+ */
+scribe_error_t scribe_bitmap_write(scribe_ctx *ctx, int incremental, size_t *out_commits, size_t *out_objects) {
+    bitmap_writer w;
+    bitmap_index *base = NULL;
+    commit_chain chain;
+    const bitmap_commit *stop = NULL;
+    byte_buf commits;
+    byte_buf file;
+    uint8_t head[SCRIBE_HASH_SIZE];
+    size_t commit_count = 0;
+    size_t i;
+    char *path;
+    scribe_error_t err;
+
+    *out_commits = 0;
+    *out_objects = 0;
+    err = scribe_refs_read(ctx, "refs/heads/main", head);
+    if (err == SCRIBE_ENOT_FOUND) {
+        return SCRIBE_OK;
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    memset(&chain, 0, sizeof(chain));
+    memset(&commits, 0, sizeof(commits));
+    memset(&file, 0, sizeof(file));
+    if (incremental) {
+        base = incremental_base(ctx, head, &chain, &err);
+        if (err == SCRIBE_OK && base != NULL && chain.count == 0) {
+            index_free(base);
+            free(chain.pairs);
+            return SCRIBE_OK;
+        }
+    }
+    if (err == SCRIBE_OK && base == NULL) {
+        err = collect_chain(ctx, NULL, head, &chain, &stop);
+    }
+    if (err == SCRIBE_OK) {
+        err = writer_init(&w, base);
+    } else {
+        memset(&w, 0, sizeof(w));
+    }
+    for (i = chain.count; err == SCRIBE_OK && i > 0; i--) {
+        const uint8_t *commit = chain.pairs + (i - 1u) * 2u * SCRIBE_HASH_SIZE;
+        size_t from_oldest = chain.count - i;
+        int already;
+
+        err = writer_add(&w, commit, &already);
+        if (err == SCRIBE_OK) {
+            err = walk_tree(ctx, writer_add, &w, commit + SCRIBE_HASH_SIZE);
+        }
+        if (err == SCRIBE_OK && (from_oldest % BITMAP_INTERVAL == BITMAP_INTERVAL - 1u || i == 1u)) {
+            err = buf_append(&commits, commit, SCRIBE_HASH_SIZE);
+            if (err == SCRIBE_OK) {
+                err = ewah_encode(&commits, w.bits, (w.base_count + w.count + 63u) / 64u);
+            }
+            commit_count++;
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = writer_serialize(&w, &commits, commit_count, &file);
+    }
+    if (err == SCRIBE_OK) {
+        char *info = scribe_path_join(ctx->repo_path, "objects/info");
+        err = info == NULL ? SCRIBE_ENOMEM : scribe_mkdir_p(info);
+        free(info);
+    }
+    if (err == SCRIBE_OK) {
+        path = scribe_path_join(ctx->repo_path, "objects/info/bitmaps");
+        err = path == NULL ? SCRIBE_ENOMEM : scribe_write_file_atomic(path, file.bytes, file.len);
+        free(path);
+    }
+    if (err == SCRIBE_OK) {
+        *out_commits = commit_count;
+        *out_objects = w.count;
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "objects", "%s reachability bitmaps: %zu commit(s), %zu new object(s)",
+                       base == NULL ? "wrote" : "extended", commit_count, w.count);
+    }
+    free(chain.pairs);
+    free(commits.bytes);
+    free(file.bytes);
+    writer_destroy(&w);
+    index_free(base);
+    return err;
+}
@@ -4,7 +4,9 @@
  * Despite the filename, this module owns the mutable tree builder used by
  * scribe_commit_batch(). It loads the current root tree, applies blob writes and
  * tombstones, writes new tree objects bottom-up, writes the commit object, and
- * finally advances refs/heads/main with compare-and-swap publication.
+ * finally advances refs/heads/main, or a partition ref (see partition.c), with
+ * compare-and-swap publication. Group commit publishes a chain of such commits
+ * with one barrier and one ref update.
  */
 #include "core/internal.h"
 
@@ -19,18 +21,43 @@
 typedef struct tree_node tree_node;
 
 typedef struct {
-    char *name;
+    const char *name;
     uint8_t type;
     uint8_t hash[SCRIBE_HASH_SIZE];
     tree_node *child;
 } node_entry;
 
+/*
+ * Mutable view of one persistent tree object. A tree entry whose child is NULL
+ * has not been loaded and still carries its persistent hash; only the trees on
+ * the paths touched by a batch are ever loaded or rewritten. A sharded node is
+ * an interior shard level whose entries are shard buckets rather than names.
+ */
 struct tree_node {
     node_entry *entries;
     size_t count;
     size_t cap;
+    bool sharded;
+    bool shrunk;
 };
 
+/*
+ * Heap arena owned by one loaded tree. Loaded trees can be arbitrarily large,
+ * so each gets an arena sized to its own entry list instead of drawing from the
+ * fixed per-batch work arena.
+ */
+typedef struct loaded_arena {
+    scribe_arena arena;
+    struct loaded_arena *next;
+} loaded_arena;
+
+typedef struct {
+    scribe_ctx *ctx;
+    scribe_arena *work;
+    loaded_arena *loaded;
+    size_t event_count;
+} tree_builder;
+
 /*
  * Allocates an empty mutable tree node from the work arena. All nodes created
  * during one commit are freed together when that arena is destroyed.
@@ -44,125 +71,87 @@ static tree_node *node_new(scribe_arena *arena) {
 }
 
 /*
- * Finds an entry by exact C-string name in a mutable tree node. The return value
- * is the entry index or -1 when the name is absent.
+ * Compares two names in canonical tree order. Interned names are equal exactly
+ * when their pointers are, so shared components skip the byte comparison.
  */
-static ssize_t node_find(tree_node *node, const char *name) {
-    size_t i;
-
-    for (i = 0; i < node->count; i++) {
-        if (strcmp(node->entries[i].name, name) == 0) {
-            return (ssize_t)i;
-        }
-    }
-    return -1;
-}
+static int name_compare(const char *a, const char *b) { return a == b ? 0 : strcmp(a, b); }
 
 /*
- * Ensures a mutable tree node has room for one more entry. Because arena memory
- * cannot be reallocated in place, growth copies the old entry array into a new
- * arena allocation.
+ * Returns the index of the first entry at or after lo whose name sorts at or
+ * after name. Mutable nodes keep their entries in canonical order, so this is
+ * a binary search; equality with the returned entry means the name exists.
  */
-static scribe_error_t node_reserve(scribe_arena *arena, tree_node *node) {
-    node_entry *grown;
-    size_t new_cap;
+static size_t node_lower_bound(const tree_node *node, size_t lo, const char *name) {
+    size_t hi = node->count;
 
-    if (node->count < node->cap) {
-        return SCRIBE_OK;
-    }
-    new_cap = node->cap == 0 ? 8u : node->cap * 2u;
-    /*
-     * tree_node is an arena-backed editable view of a persistent tree. Growing
-     * an arena allocation cannot free the old entries, so this is a copy-grow:
-     * allocate a larger array, copy existing entries, and leave the old array
-     * to be reclaimed when the whole work arena is destroyed.
-     */
-    grown = (node_entry *)scribe_arena_alloc(arena, sizeof(*grown) * new_cap, _Alignof(node_entry));
-    if (grown == NULL) {
-        return SCRIBE_ENOMEM;
-    }
-    if (node->count != 0) {
-        memcpy(grown, node->entries, sizeof(*grown) * node->count);
-    }
-    node->entries = grown;
-    node->cap = new_cap;
-    return SCRIBE_OK;
-}
-
-/*
- * Sets or replaces a child tree entry in a mutable node. Replacing a previous
- * blob with a tree is allowed only after higher-level path validation has
- * decided that the batch semantics require a tree at that name.
- */
-static scribe_error_t node_set_tree(scribe_arena *arena, tree_node *node, const char *name, tree_node *child) {
-    ssize_t idx = node_find(node, name);
-
-    if (idx >= 0) {
-        node_entry *entry = &node->entries[(size_t)idx];
-        entry->type = SCRIBE_OBJECT_TREE;
-        entry->child = child;
-        memset(entry->hash, 0, SCRIBE_HASH_SIZE);
-        return SCRIBE_OK;
-    }
-    if (node_reserve(arena, node) != SCRIBE_OK) {
-        return SCRIBE_ENOMEM;
-    }
-    node->entries[node->count].name = scribe_arena_strdup(arena, name);
-    if (node->entries[node->count].name == NULL) {
-        return SCRIBE_ENOMEM;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2u;
+        if (name_compare(node->entries[mid].name, name) < 0) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
     }
-    node->entries[node->count].type = SCRIBE_OBJECT_TREE;
-    node->entries[node->count].child = child;
-    memset(node->entries[node->count].hash, 0, SCRIBE_HASH_SIZE);
-    node->count++;
-    return SCRIBE_OK;
+    return lo;
 }
 
 /*
- * Sets or replaces a blob entry in a mutable node with an already-written blob
- * hash. The entry keeps only the hash because blobs themselves are immutable
- * object-store contents.
+ * Applies one merge pass worth of structural edits to a mutable node: removes
+ * the entries at the ascending indexes in `deletes`, then merges the
+ * name-sorted `inserts`, none of which exist in the node. Deletion compacts
+ * forward and insertion merges backward from the end, so the node stays in
+ * canonical order in O(count + edits) without a sort. Growth copies the entry
+ * array once into the work arena, leaving the old array to the arena.
  */
-static scribe_error_t node_set_blob(scribe_arena *arena, tree_node *node, const char *name,
-                                    const uint8_t hash[SCRIBE_HASH_SIZE]) {
-    ssize_t idx = node_find(node, name);
+static scribe_error_t node_merge(scribe_arena *arena, tree_node *node, const size_t *deletes, size_t delete_count,
+                                 const node_entry *inserts, size_t insert_count) {
+    size_t i;
+    size_t kept;
+    size_t d = 0;
 
-    if (idx >= 0) {
-        node_entry *entry = &node->entries[(size_t)idx];
-        entry->type = SCRIBE_OBJECT_BLOB;
-        entry->child = NULL;
-        scribe_hash_copy(entry->hash, hash);
-        return SCRIBE_OK;
-    }
-    if (node_reserve(arena, node) != SCRIBE_OK) {
-        return SCRIBE_ENOMEM;
+    if (delete_count != 0) {
+        kept = deletes[0];
+        for (i = deletes[0]; i < node->count; i++) {
+            if (d < delete_count && deletes[d] == i) {
+                d++;
+                continue;
+            }
+            node->entries[kept++] = node->entries[i];
+        }
+        node->count = kept;
     }
-    node->entries[node->count].name = scribe_arena_strdup(arena, name);
-    if (node->entries[node->count].name == NULL) {
-        return SCRIBE_ENOMEM;
+    if (insert_count == 0) {
+        return SCRIBE_OK;
     }
-    node->entries[node->count].type = SCRIBE_OBJECT_BLOB;
-    scribe_hash_copy(node->entries[node->count].hash, hash);
-    node->entries[node->count].child = NULL;
-    node->count++;
-    return SCRIBE_OK;
-}
+    if (node->count + insert_count > node->cap) {
+        size_t new_cap = node->cap * 2u;
+        node_entry *grown;
 
-/*
- * Removes an entry by name from a mutable node. Missing entries are a no-op so
- * deleting an already-absent document path remains idempotent.
- */
-static void node_delete(tree_node *node, const char *name) {
-    ssize_t idx = node_find(node, name);
-
-    if (idx < 0) {
-        return;
+        if (new_cap < node->count + insert_count + 8u) {
+            new_cap = node->count + insert_count + 8u;
+        }
+        grown = (node_entry *)scribe_arena_alloc(arena, sizeof(*grown) * new_cap, _Alignof(node_entry));
+        if (grown == NULL) {
+            return SCRIBE_ENOMEM;
+        }
+        if (node->count != 0) {
+            memcpy(grown, node->entries, sizeof(*grown) * node->count);
+        }
+        node->entries = grown;
+        node->cap = new_cap;
     }
-    if ((size_t)idx + 1u < node->count) {
-        memmove(&node->entries[(size_t)idx], &node->entries[(size_t)idx + 1u],
-                sizeof(*node->entries) * (node->count - (size_t)idx - 1u));
+    i = node->count;
+    d = insert_count;
+    kept = node->count + insert_count;
+    while (d > 0) {
+        if (i > 0 && name_compare(node->entries[i - 1u].name, inserts[d - 1u].name) > 0) {
+            node->entries[--kept] = node->entries[--i];
+        } else {
+            node->entries[--kept] = inserts[--d];
+        }
     }
-    node->count--;
+    node->count += insert_count;
+    return SCRIBE_OK;
 }
 
 /*
@@ -178,59 +167,43 @@ static scribe_error_t checked_add_size(size_t *total, size_t add) {
 }
 
 /*
- * Estimates the temporary arena size needed to serialize one mutable tree node.
- * It accounts for the tree-entry array, sorted copy, encoded names, and a small
- * fixed overhead used by the tree serializer.
+ * Releases the per-tree arenas of every node loaded during one commit.
  */
-static scribe_error_t tree_write_arena_capacity(const tree_node *node, size_t *out) {
-    size_t i;
-    size_t entry_count;
-    size_t total = 4096u;
+static void builder_destroy(tree_builder *builder) {
+    loaded_arena *it = builder->loaded;
 
-    if (node == NULL || out == NULL) {
-        return scribe_set_error(SCRIBE_EINVAL, "invalid tree arena capacity input");
-    }
-    entry_count = node->count == 0 ? 1u : node->count;
-    if (entry_count > SIZE_MAX / sizeof(scribe_tree_entry)) {
-        return scribe_set_error(SCRIBE_ENOMEM, "tree has too many entries");
-    }
-    if (checked_add_size(&total, sizeof(scribe_tree_entry) * entry_count) != SCRIBE_OK ||
-        checked_add_size(&total, sizeof(scribe_tree_entry) * entry_count) != SCRIBE_OK) {
-        return SCRIBE_ENOMEM;
-    }
-    for (i = 0; i < node->count; i++) {
-        size_t name_len = strlen(node->entries[i].name);
-        if (checked_add_size(&total, 1u + SCRIBE_HASH_SIZE + 10u + name_len) != SCRIBE_OK) {
-            return SCRIBE_ENOMEM;
-        }
+    while (it != NULL) {
+        loaded_arena *next = it->next;
+        scribe_arena_destroy(&it->arena);
+        it = next;
     }
-    *out = total;
-    return SCRIBE_OK;
+    builder->loaded = NULL;
 }
 
 /*
- * Loads an immutable tree object into mutable arena-owned tree_node structures.
- * This gives the commit builder an editable view of the current root tree before
- * applying the new batch.
+ * Loads one immutable tree object into a mutable node without descending into
+ * its children. Subtree entries keep their persistent hash and a NULL child
+ * until a change actually needs to edit below them. The node and its blob names
+ * live in a dedicated arena with spare entry slots for this batch's insertions.
+ * `depth` is the path level of the node's entries. Subtree names above
+ * SCRIBE_INTERN_DEPTH and shard names are interned so they compare by pointer
+ * with event paths; deeper subtree names are copied into the arena like blobs.
  */
-static scribe_error_t load_tree(scribe_ctx *ctx, scribe_arena *work, const uint8_t hash[SCRIBE_HASH_SIZE],
+static scribe_error_t load_tree(tree_builder *builder, const uint8_t hash[SCRIBE_HASH_SIZE], size_t depth,
                                 tree_node **out) {
     scribe_object obj;
-    scribe_arena arena;
+    scribe_arena parse;
     scribe_tree_entry *entries = NULL;
     size_t count = 0;
     size_t i;
+    size_t slots;
+    size_t capacity = 256u;
+    loaded_arena *owner;
     tree_node *node;
     scribe_error_t err;
-    size_t arena_capacity = 0;
+    size_t parse_capacity = 0;
 
-    /*
-     * Existing persistent trees are immutable object payloads. To apply a new
-     * batch, Scribe first expands the current root tree into mutable tree_node
-     * objects allocated from the work arena. Blob entries keep only their hash;
-     * subtree entries recursively get editable child nodes.
-     */
-    err = scribe_object_read(ctx, hash, &obj);
+    err = scribe_object_read(builder->ctx, hash, &obj);
     if (err != SCRIBE_OK) {
         return err;
     }
@@ -238,183 +211,521 @@ static scribe_error_t load_tree(scribe_ctx *ctx, scribe_arena *work, const uint8
         scribe_object_free(&obj);
         return scribe_set_error(SCRIBE_ECORRUPT, "expected tree object");
     }
-    err = scribe_tree_parse_arena_capacity(obj.payload_len, &arena_capacity);
+    err = scribe_tree_parse_arena_capacity(obj.payload_len, &parse_capacity);
     if (err == SCRIBE_OK) {
-        err = scribe_arena_init(&arena, arena_capacity);
+        err = scribe_arena_init(&parse, parse_capacity);
     }
     if (err != SCRIBE_OK) {
         scribe_object_free(&obj);
         return err;
     }
-    err = scribe_tree_parse(obj.payload, obj.payload_len, &arena, &entries, &count);
+    err = scribe_tree_parse(obj.payload, obj.payload_len, &parse, &entries, &count);
+    scribe_object_free(&obj);
     if (err != SCRIBE_OK) {
-        scribe_arena_destroy(&arena);
-        scribe_object_free(&obj);
+        scribe_arena_destroy(&parse);
+        return err;
+    }
+    /*
+     * Each event adds at most one entry to a given tree, so reserving
+     * min(count, events) spare slots covers ordinary batches without sizing
+     * every loaded tree for the whole batch; rarer growth copy-grows in the
+     * work arena as before.
+     */
+    slots = count + (builder->event_count < count ? builder->event_count : count) + 8u;
+    if (slots > (SIZE_MAX - capacity) / sizeof(node_entry)) {
+        scribe_arena_destroy(&parse);
+        return scribe_set_error(SCRIBE_ENOMEM, "tree has too many entries");
+    }
+    capacity += sizeof(tree_node) + sizeof(node_entry) * slots;
+    for (i = 0; i < count; i++) {
+        if (checked_add_size(&capacity, entries[i].name_len + 1u) != SCRIBE_OK) {
+            scribe_arena_destroy(&parse);
+            return SCRIBE_ENOMEM;
+        }
+    }
+    owner = (loaded_arena *)scribe_arena_alloc(builder->work, sizeof(*owner), _Alignof(loaded_arena));
+    if (owner == NULL) {
+        scribe_arena_destroy(&parse);
+        return SCRIBE_ENOMEM;
+    }
+    err = scribe_arena_init(&owner->arena, capacity);
+    if (err != SCRIBE_OK) {
+        scribe_arena_destroy(&parse);
         return err;
     }
-    node = node_new(work);
+    owner->next = builder->loaded;
+    builder->loaded = owner;
+    node = node_new(&owner->arena);
     if (node == NULL) {
-        scribe_arena_destroy(&arena);
-        scribe_object_free(&obj);
+        scribe_arena_destroy(&parse);
+        return SCRIBE_ENOMEM;
+    }
+    node->entries = (node_entry *)scribe_arena_alloc(&owner->arena, sizeof(node_entry) * slots, _Alignof(node_entry));
+    if (node->entries == NULL) {
+        scribe_arena_destroy(&parse);
         return SCRIBE_ENOMEM;
     }
+    node->cap = slots;
+    node->sharded = scribe_tree_entries_sharded(entries, count);
     for (i = 0; i < count; i++) {
-        if (entries[i].type == SCRIBE_OBJECT_TREE) {
-            tree_node *child = NULL;
-            err = load_tree(ctx, work, entries[i].hash, &child);
-            if (err != SCRIBE_OK) {
-                scribe_arena_destroy(&arena);
-                scribe_object_free(&obj);
-                return err;
-            }
-            err = node_set_tree(work, node, entries[i].name, child);
+        node_entry *entry = &node->entries[i];
+        if (entries[i].type == SCRIBE_OBJECT_TREE && (node->sharded || depth < SCRIBE_INTERN_DEPTH)) {
+            err = scribe_intern(builder->ctx, entries[i].name, entries[i].name_len, &entry->name, NULL);
         } else {
-            err = node_set_blob(work, node, entries[i].name, entries[i].hash);
+            entry->name = scribe_arena_strdup_len(&owner->arena, entries[i].name, entries[i].name_len);
+            err = entry->name == NULL ? SCRIBE_ENOMEM : SCRIBE_OK;
         }
         if (err != SCRIBE_OK) {
-            scribe_arena_destroy(&arena);
-            scribe_object_free(&obj);
+            scribe_arena_destroy(&parse);
             return err;
         }
+        entry->type = entries[i].type;
+        scribe_hash_copy(entry->hash, entries[i].hash);
+        entry->child = NULL;
     }
-    scribe_arena_destroy(&arena);
-    scribe_object_free(&obj);
+    node->count = count;
+    scribe_arena_destroy(&parse);
     *out = node;
     return SCRIBE_OK;
 }
 
 /*
- * Recursively estimates additional work-arena capacity needed to load an
- * existing persistent tree. This prevents large repositories from exhausting the
- * fixed commit arena during updates.
+ * Makes a subtree entry editable by loading its persistent tree on first use.
+ * `depth` is the path level of the subtree's own entries.
  */
-static scribe_error_t estimate_tree_work_capacity(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
-                                                  size_t *capacity) {
-    scribe_object obj;
-    scribe_arena arena;
-    scribe_tree_entry *entries = NULL;
-    size_t count = 0;
+static scribe_error_t ensure_loaded(tree_builder *builder, node_entry *entry, size_t depth) {
+    if (entry->type != SCRIBE_OBJECT_TREE || entry->child != NULL) {
+        return SCRIBE_OK;
+    }
+    return load_tree(builder, entry->hash, depth, &entry->child);
+}
+
+static scribe_error_t apply_sorted(tree_builder *builder, tree_node *node, const scribe_change_event **evs, size_t n,
+                                   size_t depth, size_t shard_depth);
+
+/*
+ * Routes sorted events through one shard level. A stable counting sort by
+ * bucket keeps each bucket's events in name order, and buckets ascend in the
+ * same order as their shard names, so the level is merged like any other node.
+ * A missing bucket is created unless its events are only deletions that end at
+ * this component; deletions mark the level so the writer can check whether the
+ * tree has shrunk back under the threshold.
+ */
+static scribe_error_t apply_sharded(tree_builder *builder, tree_node *node, const scribe_change_event **evs, size_t n,
+                                    size_t depth, size_t shard_depth) {
+    size_t offsets[257];
+    size_t fill[256];
+    const scribe_change_event **grouped;
+    uint8_t *buckets;
+    node_entry *inserts;
+    size_t insert_count = 0;
+    size_t pos = 0;
     size_t i;
-    size_t parse_capacity = 0;
-    scribe_error_t err;
+    scribe_error_t err = SCRIBE_OK;
 
-    /*
-     * Loading large Mongo collections can require many tree entries and path
-     * strings. Before allocating the work arena, walk the existing tree and add
-     * a conservative parse capacity for every subtree so updates to large stores
-     * do not fail with arena exhaustion.
-     */
-    err = scribe_object_read(ctx, hash, &obj);
-    if (err != SCRIBE_OK) {
-        return err;
+    grouped = (const scribe_change_event **)scribe_arena_alloc(builder->work, sizeof(*grouped) * n,
+                                                               _Alignof(const scribe_change_event *));
+    buckets = (uint8_t *)scribe_arena_alloc(builder->work, n, _Alignof(uint8_t));
+    inserts = (node_entry *)scribe_arena_alloc(builder->work, sizeof(*inserts) * (n < 256u ? n : 256u),
+                                               _Alignof(node_entry));
+    if (grouped == NULL || buckets == NULL || inserts == NULL) {
+        return SCRIBE_ENOMEM;
     }
-    if (obj.type != SCRIBE_OBJECT_TREE) {
-        scribe_object_free(&obj);
-        return scribe_set_error(SCRIBE_ECORRUPT, "expected tree object");
+    memset(offsets, 0, sizeof(offsets));
+    for (i = 0; i < n; i++) {
+        const char *name = evs[i]->path[depth];
+        buckets[i] = scribe_tree_shard_bucket(name, strlen(name), shard_depth);
+        offsets[(size_t)buckets[i] + 1u]++;
+        if (evs[i]->path_len == depth + 1u && evs[i]->payload == NULL) {
+            node->shrunk = true;
+        }
     }
-    err = scribe_tree_parse_arena_capacity(obj.payload_len, &parse_capacity);
-    if (err == SCRIBE_OK) {
-        err = checked_add_size(capacity, parse_capacity);
+    for (i = 0; i < 256u; i++) {
+        offsets[i + 1u] += offsets[i];
+        fill[i] = offsets[i];
     }
-    if (err == SCRIBE_OK) {
-        err = scribe_arena_init(&arena, parse_capacity);
+    for (i = 0; i < n; i++) {
+        grouped[fill[buckets[i]]++] = evs[i];
     }
-    if (err != SCRIBE_OK) {
-        scribe_object_free(&obj);
-        return err;
+    for (i = 0; i < 256u && err == SCRIBE_OK; i++) {
+        const scribe_change_event **group = grouped + offsets[i];
+        size_t count = offsets[i + 1u] - offsets[i];
+        char shard[SCRIBE_SHARD_NAME_LEN + 1u];
+        tree_node *child;
+        size_t j;
+        bool create = false;
+
+        if (count == 0) {
+            continue;
+        }
+        scribe_tree_shard_name((uint8_t)i, shard);
+        pos = node_lower_bound(node, pos, shard);
+        if (pos < node->count && strcmp(node->entries[pos].name, shard) == 0) {
+            err = ensure_loaded(builder, &node->entries[pos], depth);
+            if (err == SCRIBE_OK) {
+                err = apply_sorted(builder, node->entries[pos].child, group, count, depth, shard_depth + 1u);
+            }
+            continue;
+        }
+        for (j = 0; j < count && !create; j++) {
+            create = group[j]->path_len > depth + 1u || group[j]->payload != NULL;
+        }
+        if (!create) {
+            continue;
+        }
+        child = node_new(builder->work);
+        if (child == NULL) {
+            return SCRIBE_ENOMEM;
+        }
+        err = scribe_intern(builder->ctx, shard, SCRIBE_SHARD_NAME_LEN, &inserts[insert_count].name, NULL);
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+        inserts[insert_count].type = SCRIBE_OBJECT_TREE;
+        memset(inserts[insert_count].hash, 0, SCRIBE_HASH_SIZE);
+        inserts[insert_count].child = child;
+        insert_count++;
+        err = apply_sorted(builder, child, group, count, depth, shard_depth + 1u);
     }
-    err = scribe_tree_parse(obj.payload, obj.payload_len, &arena, &entries, &count);
-    scribe_object_free(&obj);
     if (err != SCRIBE_OK) {
-        scribe_arena_destroy(&arena);
         return err;
     }
-    for (i = 0; i < count; i++) {
-        if (entries[i].type == SCRIBE_OBJECT_TREE) {
-            err = estimate_tree_work_capacity(ctx, entries[i].hash, capacity);
+    return node_merge(builder->work, node, NULL, 0, inserts, insert_count);
+}
+
+/*
+ * Applies a run of events to the node that holds path component `depth`;
+ * shard_depth is the node's shard level within its logical tree. The
+ * events are sorted by path, distinct, and share every earlier component, so
+ * each distinct component forms one contiguous group that is merge-joined
+ * against the node's sorted entries: existing entries are found by a binary
+ * search that resumes where the previous group stopped, replaced in place, and
+ * recursed into once per group; additions and deletions are collected and
+ * merged in a single pass at the end. Missing intermediate trees are created on
+ * demand and existing ones are loaded on demand, so untouched siblings are
+ * never read. A NULL payload is a tombstone and deletes the leaf.
+ */
+static scribe_error_t apply_sorted(tree_builder *builder, tree_node *node, const scribe_change_event **evs, size_t n,
+                                   size_t depth, size_t shard_depth) {
+    node_entry *inserts;
+    size_t *deletes;
+    size_t insert_count = 0;
+    size_t delete_count = 0;
+    size_t pos = 0;
+    size_t i = 0;
+    scribe_error_t err;
+
+    if (node->sharded) {
+        return apply_sharded(builder, node, evs, n, depth, shard_depth);
+    }
+    inserts = (node_entry *)scribe_arena_alloc(builder->work, sizeof(*inserts) * n, _Alignof(node_entry));
+    deletes = (size_t *)scribe_arena_alloc(builder->work, sizeof(*deletes) * n, _Alignof(size_t));
+    if (inserts == NULL || deletes == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    while (i < n) {
+        const char *name = evs[i]->path[depth];
+        size_t end = i + 1u;
+        bool found;
+
+        while (end < n && name_compare(evs[end]->path[depth], name) == 0) {
+            end++;
+        }
+        pos = node_lower_bound(node, pos, name);
+        found = pos < node->count && name_compare(node->entries[pos].name, name) == 0;
+        if (evs[i]->path_len == depth + 1u) {
+            /* A leaf is never a prefix of another event, so its group is itself. */
+            uint8_t blob_hash[SCRIBE_HASH_SIZE];
+
+            if (evs[i]->payload == NULL) {
+                if (found) {
+                    deletes[delete_count++] = pos;
+                }
+                i = end;
+                continue;
+            }
+            err = scribe_object_write(builder->ctx, SCRIBE_OBJECT_BLOB, evs[i]->payload, evs[i]->payload_len,
+                                      blob_hash);
+            if (err != SCRIBE_OK) {
+                return err;
+            }
+            if (found) {
+                node->entries[pos].type = SCRIBE_OBJECT_BLOB;
+                node->entries[pos].child = NULL;
+                scribe_hash_copy(node->entries[pos].hash, blob_hash);
+            } else {
+                node_entry *entry = &inserts[insert_count++];
+                entry->name = scribe_arena_strdup(builder->work, name);
+                if (entry->name == NULL) {
+                    return SCRIBE_ENOMEM;
+                }
+                entry->type = SCRIBE_OBJECT_BLOB;
+                scribe_hash_copy(entry->hash, blob_hash);
+                entry->child = NULL;
+            }
+        } else {
+            tree_node *child;
+
+            if (found && node->entries[pos].type != SCRIBE_OBJECT_TREE) {
+                return scribe_set_error(SCRIBE_ECORRUPT, "path component collides with blob");
+            }
+            if (found) {
+                err = ensure_loaded(builder, &node->entries[pos], depth + 1u);
+                if (err != SCRIBE_OK) {
+                    return err;
+                }
+                child = node->entries[pos].child;
+            } else {
+                node_entry *entry = &inserts[insert_count++];
+                child = node_new(builder->work);
+                if (child == NULL) {
+                    return SCRIBE_ENOMEM;
+                }
+                if (depth < SCRIBE_INTERN_DEPTH) {
+                    err = scribe_intern(builder->ctx, name, strlen(name), &entry->name, NULL);
+                } else {
+                    entry->name = scribe_arena_strdup(builder->work, name);
+                    err = entry->name == NULL ? SCRIBE_ENOMEM : SCRIBE_OK;
+                }
+                if (err != SCRIBE_OK) {
+                    return err;
+                }
+                entry->type = SCRIBE_OBJECT_TREE;
+                memset(entry->hash, 0, SCRIBE_HASH_SIZE);
+                entry->child = child;
+            }
+            err = apply_sorted(builder, child, evs + i, end - i, depth + 1u, 0);
             if (err != SCRIBE_OK) {
-                scribe_arena_destroy(&arena);
                 return err;
             }
         }
+        i = end;
     }
-    scribe_arena_destroy(&arena);
-    return SCRIBE_OK;
+    return node_merge(builder->work, node, deletes, delete_count, inserts, insert_count);
 }
 
 /*
- * Applies one change event to the mutable tree. Non-NULL payloads are written as
- * blob objects and installed at the leaf path; NULL payloads delete the leaf as
- * a tombstone.
+ * qsort comparator for event pointers: orders by path, comparing components in
+ * canonical tree order with a path before its extensions, and breaks ties by
+ * position in the batch so the last write to a path sorts last.
  */
-static scribe_error_t apply_change(scribe_ctx *ctx, scribe_arena *work, tree_node *root,
-                                   const scribe_change_event *ev) {
-    tree_node *node = root;
+static int event_path_compare(const void *a, const void *b) {
+    const scribe_change_event *ea = *(const scribe_change_event *const *)a;
+    const scribe_change_event *eb = *(const scribe_change_event *const *)b;
+    size_t min = ea->path_len < eb->path_len ? ea->path_len : eb->path_len;
     size_t i;
 
-    /*
-     * Each event path is a sequence of tree components followed by one leaf.
-     * Intermediate components must be trees. Missing intermediate trees are
-     * created on demand. A NULL payload is a tombstone and deletes the leaf;
-     * otherwise the payload is written as a blob and the leaf is set to that blob hash.
-     */
-    for (i = 0; i + 1u < ev->path_len; i++) {
-        ssize_t idx = node_find(node, ev->path[i]);
-        tree_node *child;
-        if (idx >= 0 && node->entries[(size_t)idx].type != SCRIBE_OBJECT_TREE) {
-            return scribe_set_error(SCRIBE_ECORRUPT, "path component collides with blob");
+    for (i = 0; i < min; i++) {
+        int cmp = name_compare(ea->path[i], eb->path[i]);
+        if (cmp != 0) {
+            return cmp;
         }
-        if (idx >= 0) {
-            child = node->entries[(size_t)idx].child;
-        } else {
-            child = node_new(work);
-            if (child == NULL) {
-                return SCRIBE_ENOMEM;
-            }
-            if (node_set_tree(work, node, ev->path[i], child) != SCRIBE_OK) {
-                return SCRIBE_ENOMEM;
-            }
+    }
+    if (ea->path_len != eb->path_len) {
+        return ea->path_len < eb->path_len ? -1 : 1;
+    }
+    return ea < eb ? -1 : ea > eb;
+}
+
+/*
+ * Returns whether a's path equals b's path or is a proper prefix of it.
+ */
+static bool event_path_is_prefix(const scribe_change_event *a, const scribe_change_event *b) {
+    size_t i;
+
+    if (a->path_len > b->path_len) {
+        return false;
+    }
+    for (i = 0; i < a->path_len; i++) {
+        if (name_compare(a->path[i], b->path[i]) != 0) {
+            return false;
         }
-        node = child;
     }
-    if (ev->payload == NULL) {
-        node_delete(node, ev->path[ev->path_len - 1u]);
+    return true;
+}
+
+/*
+ * Applies a whole batch to the root. Events are sorted by path and repeated
+ * paths collapse to their last write, so each superseded payload is never
+ * hashed or stored and each touched tree is merged once. Sorting only
+ * preserves batch semantics while no event path is a prefix of another: a
+ * batch that replaces a leaf with a subtree, or the reverse, is applied event
+ * by event in batch order instead.
+ */
+static scribe_error_t apply_batch(tree_builder *builder, tree_node *root, const scribe_change_batch *batch) {
+    const scribe_change_event **evs;
+    size_t kept = 0;
+    size_t i;
+
+    if (batch->event_count == 0) {
         return SCRIBE_OK;
     }
-    {
-        uint8_t blob_hash[SCRIBE_HASH_SIZE];
-        scribe_error_t err = scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, ev->payload, ev->payload_len, blob_hash);
+    evs = (const scribe_change_event **)scribe_arena_alloc(builder->work, sizeof(*evs) * batch->event_count,
+                                                           _Alignof(const scribe_change_event *));
+    if (evs == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    for (i = 0; i < batch->event_count; i++) {
+        evs[i] = &batch->events[i];
+    }
+    qsort(evs, batch->event_count, sizeof(*evs), event_path_compare);
+    for (i = 0; i < batch->event_count; i++) {
+        if (i + 1u < batch->event_count && evs[i]->path_len == evs[i + 1u]->path_len &&
+            event_path_is_prefix(evs[i], evs[i + 1u])) {
+            continue;
+        }
+        if (kept > 0 && event_path_is_prefix(evs[kept - 1u], evs[i])) {
+            break;
+        }
+        evs[kept++] = evs[i];
+    }
+    if (i == batch->event_count) {
+        return apply_sorted(builder, root, evs, kept, 0, 0);
+    }
+    for (i = 0; i < batch->event_count; i++) {
+        const scribe_change_event *ev = &batch->events[i];
+        scribe_error_t err = apply_sorted(builder, root, &ev, 1, 0, 0);
         if (err != SCRIBE_OK) {
             return err;
         }
-        return node_set_blob(work, node, ev->path[ev->path_len - 1u], blob_hash);
     }
+    return SCRIBE_OK;
 }
 
+static scribe_error_t write_tree_recursive(tree_builder *builder, tree_node *node, size_t depth,
+                                           uint8_t out_hash[SCRIBE_HASH_SIZE], bool *out_empty);
+
 /*
- * Serializes a mutable tree and all of its child trees into immutable tree
- * objects. Children are written first because parent entries need child hashes.
+ * Counts the logical entries under a shard level, stopping once the count
+ * exceeds limit. Unloaded shards are loaded so a collapse can reuse them.
  */
-static scribe_error_t write_tree_recursive(scribe_ctx *ctx, tree_node *node, uint8_t out_hash[SCRIBE_HASH_SIZE]) {
+static scribe_error_t count_logical(tree_builder *builder, tree_node *node, size_t limit, size_t *total) {
+    size_t i;
+
+    if (!node->sharded) {
+        *total += node->count;
+        return SCRIBE_OK;
+    }
+    for (i = 0; i < node->count && *total <= limit; i++) {
+        /* These names are only written back out, so they are copied, not interned. */
+        scribe_error_t err = ensure_loaded(builder, &node->entries[i], SCRIBE_INTERN_DEPTH);
+        if (err == SCRIBE_OK) {
+            err = count_logical(builder, node->entries[i].child, limit, total);
+        }
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Gathers the logical entries under a fully loaded shard level into one array,
+ * writing any edited subtrees first so every entry carries its final hash.
+ */
+static scribe_error_t collect_logical(tree_builder *builder, tree_node *node, scribe_tree_entry *out, size_t *off) {
+    size_t i;
+
+    for (i = 0; i < node->count; i++) {
+        node_entry *entry = &node->entries[i];
+        scribe_error_t err = SCRIBE_OK;
+        if (node->sharded) {
+            err = collect_logical(builder, entry->child, out, off);
+        } else {
+            scribe_tree_entry *dst = &out[(*off)++];
+            bool empty = false;
+            dst->type = entry->type;
+            dst->name = entry->name;
+            dst->name_len = strlen(entry->name);
+            if (entry->type == SCRIBE_OBJECT_TREE && entry->child != NULL) {
+                err = write_tree_recursive(builder, entry->child, 0, dst->hash, &empty);
+            } else {
+                scribe_hash_copy(dst->hash, entry->hash);
+            }
+        }
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Writes a shard level that no longer needs sharding, or that must be
+ * unsharded because sharding was disabled, as the flat tree for its entries.
+ */
+static scribe_error_t collapse_shards(tree_builder *builder, tree_node *node, size_t total, size_t depth,
+                                      uint8_t out_hash[SCRIBE_HASH_SIZE]) {
+    scribe_tree_entry *entries;
+    size_t off = 0;
+    scribe_error_t err;
+
+    if (total > SIZE_MAX / sizeof(*entries) - 1u) {
+        return scribe_set_error(SCRIBE_ENOMEM, "tree has too many entries");
+    }
+    entries = (scribe_tree_entry *)calloc(total + 1u, sizeof(*entries));
+    if (entries == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate tree entries");
+    }
+    err = collect_logical(builder, node, entries, &off);
+    if (err == SCRIBE_OK) {
+        /* Buckets partition by name hash, so their concatenation is unordered. */
+        qsort(entries, off, sizeof(*entries), scribe_tree_entry_compare);
+        err = scribe_tree_write_at_depth(builder->ctx, entries, off, depth, out_hash);
+    }
+    free(entries);
+    return err;
+}
+
+/*
+ * Serializes a mutable tree and its edited descendants into immutable tree
+ * objects. Children are written first because parent entries need child hashes;
+ * unloaded children keep their persistent hash without being read. depth is the
+ * shard depth of the node within its logical tree. out_empty reports a node
+ * with no logical entries so an emptied shard bucket can be dropped.
+ */
+static scribe_error_t write_tree_recursive(tree_builder *builder, tree_node *node, size_t depth,
+                                           uint8_t out_hash[SCRIBE_HASH_SIZE], bool *out_empty) {
     scribe_tree_entry *entries;
     scribe_arena arena;
-    uint8_t *payload;
-    size_t payload_len;
+    size_t kept = 0;
     size_t i;
     scribe_error_t err;
-    size_t arena_capacity = 0;
+    size_t arena_capacity = 4096u;
 
     /*
      * After all events are applied, the mutable tree is collapsed back into
-     * immutable tree objects bottom-up. Child trees are written first so their
-     * hashes can be placed in the parent tree entry array. Unchanged subtrees
-     * naturally reuse their existing hash because tree serialization is
-     * canonical and object writes are content-addressed.
+     * immutable tree objects bottom-up. Only loaded nodes are rewritten; every
+     * other subtree reuses its existing hash, so the work is bounded by the
+     * touched paths rather than the size of the tree. Shard levels whose tree
+     * lost entries are first checked against the threshold so a tree that
+     * shrinks back below it returns to the canonical flat layout.
      */
-    err = tree_write_arena_capacity(node, &arena_capacity);
-    if (err == SCRIBE_OK) {
-        err = scribe_arena_init(&arena, arena_capacity);
+    if (node->sharded) {
+        size_t threshold = builder->ctx->config.tree_shard_threshold;
+        if (threshold == 0 || node->shrunk) {
+            size_t total = 0;
+            err = count_logical(builder, node, threshold == 0 ? SIZE_MAX : threshold, &total);
+            if (err != SCRIBE_OK) {
+                return err;
+            }
+            if (threshold == 0 || total <= threshold) {
+                *out_empty = total == 0;
+                if (total == 0 && depth != 0) {
+                    return SCRIBE_OK;
+                }
+                return collapse_shards(builder, node, total, depth, out_hash);
+            }
+        }
+    }
+    *out_empty = node->count == 0;
+    if (node->count == 0 && depth != 0) {
+        return SCRIBE_OK;
     }
+    if (checked_add_size(&arena_capacity, sizeof(*entries) * node->count) != SCRIBE_OK) {
+        return SCRIBE_ENOMEM;
+    }
+    err = scribe_arena_init(&arena, arena_capacity);
     if (err != SCRIBE_OK) {
         return err;
     }
@@ -424,38 +735,42 @@ static scribe_error_t write_tree_recursive(scribe_ctx *ctx, tree_node *node, uin
         scribe_arena_destroy(&arena);
         return SCRIBE_ENOMEM;
     }
-    memset(entries, 0, sizeof(*entries) * (node->count == 0 ? 1u : node->count));
     for (i = 0; i < node->count; i++) {
-        entries[i].type = node->entries[i].type;
-        entries[i].name = node->entries[i].name;
-        entries[i].name_len = strlen(node->entries[i].name);
-        if (node->entries[i].type == SCRIBE_OBJECT_TREE) {
-            err = write_tree_recursive(ctx, node->entries[i].child, entries[i].hash);
+        bool empty = false;
+        entries[kept].type = node->entries[i].type;
+        entries[kept].name = node->entries[i].name;
+        entries[kept].name_len = strlen(node->entries[i].name);
+        if (node->entries[i].type == SCRIBE_OBJECT_TREE && node->entries[i].child != NULL) {
+            err = write_tree_recursive(builder, node->entries[i].child, node->sharded ? depth + 1u : 0,
+                                       entries[kept].hash, &empty);
             if (err != SCRIBE_OK) {
                 scribe_arena_destroy(&arena);
                 return err;
             }
         } else {
-            scribe_hash_copy(entries[i].hash, node->entries[i].hash);
+            scribe_hash_copy(entries[kept].hash, node->entries[i].hash);
+        }
+        if (!(node->sharded && empty)) {
+            kept++;
         }
     }
-    err = scribe_tree_serialize(entries, node->count, &arena, &payload, &payload_len);
-    if (err != SCRIBE_OK) {
-        scribe_arena_destroy(&arena);
-        return err;
+    if (node->sharded) {
+        *out_empty = kept == 0;
+        err = kept == 0 && depth != 0 ? SCRIBE_OK : scribe_tree_write_flat(builder->ctx, entries, kept, out_hash);
+    } else {
+        err = scribe_tree_write_at_depth(builder->ctx, entries, kept, depth, out_hash);
     }
-    err = scribe_object_write(ctx, SCRIBE_OBJECT_TREE, payload, payload_len, out_hash);
     scribe_arena_destroy(&arena);
     return err;
 }
 
 /*
- * Reads refs/heads/main and extracts the root tree hash from the current commit.
- * If the repository has no main ref yet, has_parent is false and the caller
- * should start from a new empty root tree.
+ * Reads a ref and extracts the root tree hash from the commit it names. If the
+ * ref does not exist yet, has_parent is false and the caller should start from
+ * a new empty root tree.
  */
-static scribe_error_t read_head_root_hash(scribe_ctx *ctx, uint8_t parent_hash[SCRIBE_HASH_SIZE], int *has_parent,
-                                          uint8_t root_hash[SCRIBE_HASH_SIZE]) {
+static scribe_error_t read_ref_root_hash(scribe_ctx *ctx, const char *ref, uint8_t parent_hash[SCRIBE_HASH_SIZE],
+                                         int *has_parent, uint8_t root_hash[SCRIBE_HASH_SIZE]) {
     scribe_error_t err;
 
     /*
@@ -463,7 +778,7 @@ static scribe_error_t read_head_root_hash(scribe_ctx *ctx, uint8_t parent_hash[S
      * normal change batch, read refs/heads/main, parse the commit it points to,
      * and take that commit's root tree as the editable base.
      */
-    err = scribe_refs_read(ctx, "refs/heads/main", parent_hash);
+    err = scribe_refs_read(ctx, ref, parent_hash);
     if (err == SCRIBE_ENOT_FOUND) {
         *has_parent = 0;
         memset(root_hash, 0, SCRIBE_HASH_SIZE);
@@ -483,7 +798,7 @@ static scribe_error_t read_head_root_hash(scribe_ctx *ctx, uint8_t parent_hash[S
         }
         if (commit_obj.type != SCRIBE_OBJECT_COMMIT) {
             scribe_object_free(&commit_obj);
-            return scribe_set_error(SCRIBE_ECORRUPT, "main ref does not point to a commit");
+            return scribe_set_error(SCRIBE_ECORRUPT, "ref '%s' does not point to a commit", ref);
         }
         err = scribe_arena_init(&arena, commit_obj.payload_len + 1024u);
         if (err != SCRIBE_OK) {
@@ -500,60 +815,94 @@ static scribe_error_t read_head_root_hash(scribe_ctx *ctx, uint8_t parent_hash[S
     }
 }
 
+/*
+ * Publishes a written commit object on `ref`: barrier, compare-and-swap, then
+ * the change summary for commits on refs/heads/main. Partition commits skip the
+ * summary; the main commits that publish them get one.
+ */
+static scribe_error_t publish_commit(scribe_ctx *ctx, const char *ref, const uint8_t *parent,
+                                     const uint8_t *parent_root, const uint8_t root[SCRIBE_HASH_SIZE],
+                                     const uint8_t commit[SCRIBE_HASH_SIZE]) {
+    scribe_error_t err;
+
+    scribe_crash_point("commit-before-barrier");
+    err = scribe_object_flush(ctx);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    scribe_crash_point("commit-before-ref");
+    err = scribe_refs_cas(ctx, ref, parent, commit);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    scribe_crash_point("commit-after-ref");
+    if (strcmp(ref, "refs/heads/main") == 0) {
+        scribe_commit_stats_record(ctx, commit, parent_root, root);
+        scribe_field_index_record(ctx, commit);
+    }
+    scribe_log_msg(ctx, SCRIBE_LOG_DEBUG, "commit", "wrote commit");
+    scribe_log_flush(ctx);
+    return SCRIBE_OK;
+}
+
 /*
  * Builds a normal commit from a change batch. The function applies changes to
  * the current tree, writes all required objects, and publishes the new commit as
- * refs/heads/main only after every object write succeeds.
+ * refs/heads/main only after every object write succeeds. Partitions that
+ * outlived a crashed partitioned writer are folded into main first.
  */
 scribe_error_t scribe_commit_batch_internal(scribe_ctx *ctx, const scribe_change_batch *batch,
                                             uint8_t out_commit_hash[SCRIBE_HASH_SIZE]) {
-    tree_node *root = NULL;
-    uint8_t parent_hash[SCRIBE_HASH_SIZE];
-    uint8_t parent_root_hash[SCRIBE_HASH_SIZE];
-    uint8_t root_hash[SCRIBE_HASH_SIZE];
-    uint8_t *commit_payload;
-    size_t commit_payload_len;
-    scribe_arena arena;
-    scribe_arena work;
-    int has_parent = 0;
-    size_t i;
-    size_t work_capacity;
     scribe_error_t err;
 
     if (ctx == NULL || !ctx->writable) {
         return scribe_set_error(SCRIBE_EINVAL, "writable context required");
     }
-    /*
-     * Commit publication order is important:
-     *   1. read the current main ref and root tree;
-     *   2. write all new blob/tree/commit objects;
-     *   3. atomically compare-and-swap refs/heads/main to the new commit.
-     *
-     * If the process dies before step 3, objects may be left on disk but are
-     * unreachable. That is allowed in v1 and is exactly what fsck reports as
-     * dangling. If step 3 fails because the ref changed, history is not overwritten.
-     */
-    err = read_head_root_hash(ctx, parent_hash, &has_parent, parent_root_hash);
+    err = scribe_partition_fold(ctx);
     if (err != SCRIBE_OK) {
         return err;
     }
+    return scribe_commit_batch_ref(ctx, "refs/heads/main", NULL, batch, out_commit_hash);
+}
+
+/*
+ * Applies a change batch to `base_root` (an empty tree when NULL), writes the
+ * new trees and a commit parented to `parent`, and returns both hashes. Nothing
+ * is published; callers move a ref with publish_commit().
+ */
+static scribe_error_t write_batch_commit(scribe_ctx *ctx, const uint8_t *parent, const uint8_t *base_root,
+                                         const scribe_change_batch *batch, uint8_t out_root[SCRIBE_HASH_SIZE],
+                                         uint8_t out_commit_hash[SCRIBE_HASH_SIZE]) {
+    tree_node *root = NULL;
+    uint8_t *commit_payload;
+    size_t commit_payload_len;
+    scribe_arena arena;
+    scribe_arena work;
+    tree_builder builder;
+    bool root_empty = false;
+    size_t work_capacity;
+    scribe_error_t err;
+
     if (batch != NULL && batch->event_count > (SIZE_MAX - (1024u * 1024u)) / 4096u) {
         return scribe_set_error(SCRIBE_ENOMEM, "commit batch is too large");
     }
+    /*
+     * Existing trees are loaded lazily into their own arenas, so the work
+     * arena only holds new nodes and entries created by this batch.
+     */
     work_capacity = 1024u * 1024u + (batch == NULL ? 0u : batch->event_count * 4096u);
-    if (has_parent) {
-        err = estimate_tree_work_capacity(ctx, parent_root_hash, &work_capacity);
-        if (err != SCRIBE_OK) {
-            return err;
-        }
-    }
     err = scribe_arena_init(&work, work_capacity);
     if (err != SCRIBE_OK) {
         return err;
     }
-    if (has_parent) {
-        err = load_tree(ctx, &work, parent_root_hash, &root);
+    builder.ctx = ctx;
+    builder.work = &work;
+    builder.loaded = NULL;
+    builder.event_count = batch == NULL ? 0u : batch->event_count;
+    if (base_root != NULL) {
+        err = load_tree(&builder, base_root, 0, &root);
         if (err != SCRIBE_OK) {
+            builder_destroy(&builder);
             scribe_arena_destroy(&work);
             return err;
         }
@@ -564,90 +913,250 @@ scribe_error_t scribe_commit_batch_internal(scribe_ctx *ctx, const scribe_change
             return SCRIBE_ENOMEM;
         }
     }
-    for (i = 0; i < batch->event_count; i++) {
-        err = apply_change(ctx, &work, root, &batch->events[i]);
-        if (err != SCRIBE_OK) {
-            scribe_arena_destroy(&work);
-            return err;
-        }
+    err = apply_batch(&builder, root, batch);
+    if (err != SCRIBE_OK) {
+        builder_destroy(&builder);
+        scribe_arena_destroy(&work);
+        return err;
     }
-    err = write_tree_recursive(ctx, root, root_hash);
+    err = write_tree_recursive(&builder, root, 0, out_root, &root_empty);
+    builder_destroy(&builder);
     if (err != SCRIBE_OK) {
         scribe_arena_destroy(&work);
         return err;
     }
     err = scribe_arena_init(&arena, 4096u + (batch->message_len * 2u));
     if (err != SCRIBE_OK) {
+        scribe_arena_destroy(&work);
         return err;
     }
-    err = scribe_commit_serialize(root_hash, has_parent ? parent_hash : NULL, batch, &arena, &commit_payload,
-                                  &commit_payload_len);
+    err = scribe_commit_serialize(out_root, parent, batch, &arena, &commit_payload, &commit_payload_len);
     if (err == SCRIBE_OK) {
         err = scribe_object_write(ctx, SCRIBE_OBJECT_COMMIT, commit_payload, commit_payload_len, out_commit_hash);
     }
     scribe_arena_destroy(&arena);
     scribe_arena_destroy(&work);
+    return err;
+}
+
+/*
+ * Commits a change batch on `ref`. When the ref does not exist yet and
+ * base_root is not NULL, the batch applies to that tree instead of an empty
+ * one; partitions use this to start from the database's subtree in main.
+ */
+scribe_error_t scribe_commit_batch_ref(scribe_ctx *ctx, const char *ref, const uint8_t *base_root,
+                                       const scribe_change_batch *batch, uint8_t out_commit_hash[SCRIBE_HASH_SIZE]) {
+    uint8_t parent_hash[SCRIBE_HASH_SIZE];
+    uint8_t parent_root_hash[SCRIBE_HASH_SIZE];
+    uint8_t root_hash[SCRIBE_HASH_SIZE];
+    int has_parent = 0;
+    int has_root;
+    scribe_error_t err;
+
+    if (ctx == NULL || !ctx->writable) {
+        return scribe_set_error(SCRIBE_EINVAL, "writable context required");
+    }
+    err = scribe_commit_validate_batch(batch);
     if (err != SCRIBE_OK) {
         return err;
     }
-    err = scribe_refs_cas(ctx, "refs/heads/main", has_parent ? parent_hash : NULL, out_commit_hash);
+    /*
+     * Commit publication order is important:
+     *   1. read the current main ref and root tree;
+     *   2. write all new blob/tree/commit objects;
+     *   3. atomically compare-and-swap refs/heads/main to the new commit.
+     *
+     * If the process dies before step 3, objects may be left on disk but are
+     * unreachable. That is allowed in v1 and is exactly what fsck reports as
+     * dangling. If step 3 fails because the ref changed, history is not overwritten.
+     */
+    err = read_ref_root_hash(ctx, ref, parent_hash, &has_parent, parent_root_hash);
     if (err != SCRIBE_OK) {
         return err;
     }
-    scribe_log_msg(ctx, SCRIBE_LOG_DEBUG, "commit", "wrote commit");
-    scribe_log_flush(ctx);
-    return SCRIBE_OK;
+    has_root = has_parent;
+    if (!has_parent && base_root != NULL) {
+        scribe_hash_copy(parent_root_hash, base_root);
+        has_root = 1;
+    }
+    err = write_batch_commit(ctx, has_parent ? parent_hash : NULL, has_root ? parent_root_hash : NULL, batch,
+                             root_hash, out_commit_hash);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    return publish_commit(ctx, ref, has_parent ? parent_hash : NULL, has_root ? parent_root_hash : NULL, root_hash,
+                          out_commit_hash);
+}
+
+/*
+ * Group commit: validates and applies each batch on its own and writes its
+ * commit parented to the previous batch that succeeded, then publishes that
+ * chain with a single barrier and ref update. History is the same as
+ * committing the batches one by one; only the per-commit flush and ref fsync
+ * are shared. A batch that fails gets its own error in `results` and is left
+ * out of the chain, so one bad batch does not fail the others; its objects
+ * stay behind as dangling. The return value is the publication's: when it
+ * fails, every batch that had succeeded reports that error instead.
+ */
+scribe_error_t scribe_commit_group(scribe_ctx *ctx, const scribe_change_batch *const *batches, size_t count,
+                                   scribe_group_result *results) {
+    uint8_t head[SCRIBE_HASH_SIZE];
+    uint8_t (*roots)[SCRIBE_HASH_SIZE];
+    const uint8_t *parent = NULL;
+    const uint8_t *prev_root = NULL;
+    const uint8_t *base = NULL;
+    int has_head = 0;
+    size_t last = count;
+    size_t i;
+    scribe_error_t err;
+
+    if (ctx == NULL || !ctx->writable) {
+        return scribe_set_error(SCRIBE_EINVAL, "writable context required");
+    }
+    if (count == 0) {
+        return SCRIBE_OK;
+    }
+    err = scribe_partition_fold(ctx);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    /* roots[0] is main's current root; roots[i + 1] is the root of batch i. */
+    roots = (uint8_t(*)[SCRIBE_HASH_SIZE])malloc((count + 1u) * sizeof(*roots));
+    if (roots == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate group commit");
+    }
+    err = read_ref_root_hash(ctx, "refs/heads/main", head, &has_head, roots[0]);
+    if (err != SCRIBE_OK) {
+        free(roots);
+        return err;
+    }
+    if (has_head) {
+        parent = head;
+        base = roots[0];
+    }
+    for (i = 0; i < count; i++) {
+        scribe_error_t batch_err = scribe_commit_validate_batch(batches[i]);
+
+        if (batch_err == SCRIBE_OK) {
+            batch_err = write_batch_commit(ctx, parent, base, batches[i], roots[i + 1u], results[i].commit);
+        }
+        results[i].err = batch_err;
+        if (batch_err != SCRIBE_OK) {
+            snprintf(results[i].detail, sizeof(results[i].detail), "%s", scribe_last_error_detail());
+            scribe_clear_error();
+            continue;
+        }
+        prev_root = base;
+        parent = results[i].commit;
+        base = roots[i + 1u];
+        last = i;
+    }
+    if (last != count) {
+        err = publish_commit(ctx, "refs/heads/main", has_head ? head : NULL, prev_root, base, results[last].commit);
+    }
+    /* publish_commit() summarized the tip; the rest of the chain gets its summaries here. */
+    prev_root = has_head ? roots[0] : NULL;
+    for (i = 0; i < count && last != count; i++) {
+        if (results[i].err != SCRIBE_OK) {
+            continue;
+        }
+        if (err != SCRIBE_OK) {
+            results[i].err = err;
+            snprintf(results[i].detail, sizeof(results[i].detail), "%s", scribe_last_error_detail());
+        } else if (i != last) {
+            scribe_commit_stats_record(ctx, results[i].commit, prev_root, roots[i + 1u]);
+        }
+        prev_root = roots[i + 1u];
+    }
+    free(roots);
+    return err;
 }
 
 /*
  * Wraps an already-written root tree in a commit and publishes it. Mongo
  * bootstrap uses this path because it builds a complete snapshot tree directly
- * instead of replaying individual change events through apply_change().
+ * instead of replaying individual change events through apply_batch().
  */
 scribe_error_t scribe_commit_root_internal(scribe_ctx *ctx, const uint8_t root_tree[SCRIBE_HASH_SIZE],
                                            const scribe_change_batch *metadata,
                                            uint8_t out_commit_hash[SCRIBE_HASH_SIZE]) {
-    uint8_t parent_hash[SCRIBE_HASH_SIZE];
-    uint8_t *commit_payload;
-    size_t commit_payload_len;
-    scribe_arena arena;
-    int has_parent = 0;
     scribe_error_t err;
 
     if (ctx == NULL || !ctx->writable) {
         return scribe_set_error(SCRIBE_EINVAL, "writable context required");
     }
+    err = scribe_partition_fold(ctx);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    return scribe_commit_root_ref(ctx, "refs/heads/main", root_tree, metadata, out_commit_hash);
+}
+
+/*
+ * Wraps a root tree in a commit on `ref`, parented to the ref's current
+ * commit. Partition folding uses this directly for aggregate commits.
+ */
+scribe_error_t scribe_commit_root_ref(scribe_ctx *ctx, const char *ref, const uint8_t root_tree[SCRIBE_HASH_SIZE],
+                                      const scribe_change_batch *metadata, uint8_t out_commit_hash[SCRIBE_HASH_SIZE]) {
     /*
      * Bootstrap already constructed and wrote the complete snapshot tree. This
      * helper wraps that root tree in a commit and advances the ref, using the
      * same parent/ref CAS rules as normal event batches.
      */
-    err = scribe_refs_read(ctx, "refs/heads/main", parent_hash);
-    if (err == SCRIBE_ENOT_FOUND) {
-        has_parent = 0;
-    } else if (err != SCRIBE_OK) {
-        return err;
-    } else {
-        has_parent = 1;
+    return scribe_commit_root_chain(ctx, ref, (const uint8_t(*)[SCRIBE_HASH_SIZE])root_tree, &metadata, 1,
+                                    (uint8_t(*)[SCRIBE_HASH_SIZE])out_commit_hash);
+}
+
+/*
+ * Wraps each of `count` already-written root trees in a commit on `ref`,
+ * chained in order from the ref's current commit, and publishes the chain
+ * with one barrier and ref update. Partition publication uses this so every
+ * batch keeps its own commit and metadata on main.
+ */
+scribe_error_t scribe_commit_root_chain(scribe_ctx *ctx, const char *ref, const uint8_t (*roots)[SCRIBE_HASH_SIZE],
+                                        const scribe_change_batch *const *metadata, size_t count,
+                                        uint8_t (*out_commit_hashes)[SCRIBE_HASH_SIZE]) {
+    uint8_t parent_hash[SCRIBE_HASH_SIZE];
+    uint8_t parent_root_hash[SCRIBE_HASH_SIZE];
+    uint8_t *commit_payload;
+    size_t commit_payload_len;
+    scribe_arena arena;
+    int has_parent = 0;
+    size_t i;
+    scribe_error_t err;
+
+    if (ctx == NULL || !ctx->writable) {
+        return scribe_set_error(SCRIBE_EINVAL, "writable context required");
     }
-    err = scribe_arena_init(&arena, 4096u + (metadata == NULL ? 0u : metadata->message_len * 2u));
-    if (err != SCRIBE_OK) {
-        return err;
+    if (count == 0) {
+        return SCRIBE_OK;
     }
-    err = scribe_commit_serialize_allow_empty(root_tree, has_parent ? parent_hash : NULL, metadata, &arena,
-                                              &commit_payload, &commit_payload_len);
-    if (err == SCRIBE_OK) {
-        err = scribe_object_write(ctx, SCRIBE_OBJECT_COMMIT, commit_payload, commit_payload_len, out_commit_hash);
+    err = read_ref_root_hash(ctx, ref, parent_hash, &has_parent, parent_root_hash);
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        const uint8_t *parent = i != 0 ? out_commit_hashes[i - 1u] : has_parent ? parent_hash : NULL;
+
+        err = scribe_arena_init(&arena, 4096u + (metadata[i] == NULL ? 0u : metadata[i]->message_len * 2u));
+        if (err != SCRIBE_OK) {
+            break;
+        }
+        err = scribe_commit_serialize_allow_empty(roots[i], parent, metadata[i], &arena, &commit_payload,
+                                                  &commit_payload_len);
+        if (err == SCRIBE_OK) {
+            err = scribe_object_write(ctx, SCRIBE_OBJECT_COMMIT, commit_payload, commit_payload_len,
+                                      out_commit_hashes[i]);
+        }
+        scribe_arena_destroy(&arena);
     }
-    scribe_arena_destroy(&arena);
-    if (err != SCRIBE_OK) {
-        return err;
+    if (err == SCRIBE_OK) {
+        err = publish_commit(ctx, ref, has_parent ? parent_hash : NULL,
+                             count > 1u ? roots[count - 2u] : has_parent ? parent_root_hash : NULL, roots[count - 1u],
+                             out_commit_hashes[count - 1u]);
     }
-    err = scribe_refs_cas(ctx, "refs/heads/main", has_parent ? parent_hash : NULL, out_commit_hash);
-    if (err != SCRIBE_OK) {
-        return err;
+    /* publish_commit() summarized the tip; the rest of the chain gets its summaries here. */
+    for (i = 0; err == SCRIBE_OK && strcmp(ref, "refs/heads/main") == 0 && i + 1u < count; i++) {
+        const uint8_t *before = i != 0 ? roots[i - 1u] : has_parent ? parent_root_hash : NULL;
+
+        scribe_commit_stats_record(ctx, out_commit_hashes[i], before, roots[i]);
     }
-    scribe_log_msg(ctx, SCRIBE_LOG_DEBUG, "commit", "wrote commit");
-    scribe_log_flush(ctx);
-    return SCRIBE_OK;
+    return err;
 }
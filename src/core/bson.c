@@ -0,0 +1,598 @@
+/*
+ * Read-side rendering of sorted-BSON document blobs.
+ *
+ * Stores configured with `adapter.mongodb.blob_format = bson-sorted` keep Mongo
+ * documents as BSON instead of canonical Extended JSON. Core never links
+ * libbson, so `show --format=json` uses this small self-contained decoder to
+ * print such blobs as compact canonical Extended JSON. Fields are emitted in
+ * stored order; the adapter already sorted them when the blob was written.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BSON_MAX_DEPTH 128
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} json_buf;
+
+/*
+ * Ensures room for `extra` more bytes plus a NUL terminator. The buffer doubles
+ * so rendering a large document stays linear.
+ */
+static scribe_error_t jb_reserve(json_buf *b, size_t extra) {
+    size_t need = b->len + extra + 1u;
+    size_t cap = b->cap == 0 ? 256u : b->cap;
+    char *next;
+
+    if (need <= b->cap) {
+        return SCRIBE_OK;
+    }
+    while (cap < need) {
+        cap *= 2u;
+    }
+    next = (char *)realloc(b->data, cap);
+    if (next == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to grow JSON buffer");
+    }
+    b->data = next;
+    b->cap = cap;
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends raw bytes to the output buffer and keeps it NUL-terminated.
+ */
+static scribe_error_t jb_append(json_buf *b, const char *s, size_t len) {
+    scribe_error_t err = jb_reserve(b, len);
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends a NUL-terminated literal to the output buffer.
+ */
+static scribe_error_t jb_puts(json_buf *b, const char *s) {
+    return jb_append(b, s, strlen(s));
+}
+
+/*
+ * Appends printf-formatted text. Every caller formats short scalar values, so
+ * a fixed stack buffer is sufficient.
+ */
+static scribe_error_t jb_printf(json_buf *b, const char *fmt, ...) {
+    char tmp[128];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    n = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= sizeof(tmp)) {
+        return scribe_set_error(SCRIBE_EINVAL, "formatted JSON scalar is too long");
+    }
+    return jb_append(b, tmp, (size_t)n);
+}
+
+/*
+ * Appends a JSON string literal, escaping quotes, backslashes, and control
+ * bytes the way libbson's Extended JSON writer does.
+ */
+static scribe_error_t jb_string(json_buf *b, const char *s, size_t len) {
+    scribe_error_t err = jb_append(b, "\"", 1);
+    size_t i;
+
+    for (i = 0; err == SCRIBE_OK && i < len; i++) {
+        unsigned char c = (unsigned char)s[i];
+        switch (c) {
+        case '"':
+            err = jb_append(b, "\\\"", 2);
+            break;
+        case '\\':
+            err = jb_append(b, "\\\\", 2);
+            break;
+        case '\b':
+            err = jb_append(b, "\\b", 2);
+            break;
+        case '\f':
+            err = jb_append(b, "\\f", 2);
+            break;
+        case '\n':
+            err = jb_append(b, "\\n", 2);
+            break;
+        case '\r':
+            err = jb_append(b, "\\r", 2);
+            break;
+        case '\t':
+            err = jb_append(b, "\\t", 2);
+            break;
+        default:
+            err = c < 0x20u ? jb_printf(b, "\\u%04x", c) : jb_append(b, (const char *)&s[i], 1);
+            break;
+        }
+    }
+    return err == SCRIBE_OK ? jb_append(b, "\"", 1) : err;
+}
+
+/*
+ * Appends `len` bytes as standard padded base64, as used by `$binary`.
+ */
+static scribe_error_t jb_base64(json_buf *b, const uint8_t *data, size_t len) {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    scribe_error_t err = jb_reserve(b, ((len + 2u) / 3u) * 4u);
+    size_t i;
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    for (i = 0; i < len; i += 3u) {
+        uint32_t v = (uint32_t)data[i] << 16;
+        size_t rest = len - i;
+        if (rest > 1u) {
+            v |= (uint32_t)data[i + 1u] << 8;
+        }
+        if (rest > 2u) {
+            v |= data[i + 2u];
+        }
+        b->data[b->len++] = alphabet[(v >> 18) & 0x3fu];
+        b->data[b->len++] = alphabet[(v >> 12) & 0x3fu];
+        b->data[b->len++] = rest > 1u ? alphabet[(v >> 6) & 0x3fu] : '=';
+        b->data[b->len++] = rest > 2u ? alphabet[v & 0x3fu] : '=';
+    }
+    b->data[b->len] = '\0';
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends 12 ObjectId bytes as `{"$oid":"<24-hex>"}`.
+ */
+static scribe_error_t jb_oid(json_buf *b, const uint8_t *oid) {
+    scribe_error_t err = jb_puts(b, "{\"$oid\":\"");
+    size_t i;
+
+    for (i = 0; err == SCRIBE_OK && i < 12u; i++) {
+        err = jb_printf(b, "%02x", oid[i]);
+    }
+    return err == SCRIBE_OK ? jb_puts(b, "\"}") : err;
+}
+
+/*
+ * Decodes little-endian integers from BSON element bodies.
+ */
+static uint32_t le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t le64(const uint8_t *p) {
+    return (uint64_t)le32(p) | ((uint64_t)le32(p + 4) << 32);
+}
+
+/*
+ * Divides a 128-bit big-endian limb array by one billion in place and returns
+ * the remainder. Used to print Decimal128 coefficients without 128-bit types.
+ */
+static uint32_t divide_1e9(uint32_t parts[4]) {
+    uint64_t rem = 0;
+    size_t i;
+
+    for (i = 0; i < 4u; i++) {
+        rem = (rem << 32) + parts[i];
+        parts[i] = (uint32_t)(rem / 1000000000u);
+        rem %= 1000000000u;
+    }
+    return (uint32_t)rem;
+}
+
+/*
+ * Appends a Decimal128 value as `{"$numberDecimal":"..."}` using the string
+ * rules of the BSON Decimal128 specification, matching libbson's output.
+ */
+static scribe_error_t jb_decimal128(json_buf *b, const uint8_t *p) {
+    uint64_t low = le64(p);
+    uint64_t high = le64(p + 8);
+    uint32_t combination = (uint32_t)((high >> 58) & 0x1fu);
+    uint32_t parts[4];
+    char digits[40];
+    char text[80];
+    size_t ndigits = 0;
+    size_t pos = 0;
+    int64_t exponent;
+    int64_t scientific;
+    scribe_error_t err;
+
+    if ((combination >> 3) == 3u && combination >= 0x1eu) {
+        const char *special = combination == 0x1eu ? ((high >> 63) ? "-Infinity" : "Infinity") : "NaN";
+        err = jb_puts(b, "{\"$numberDecimal\":\"");
+        err = err == SCRIBE_OK ? jb_puts(b, special) : err;
+        return err == SCRIBE_OK ? jb_puts(b, "\"}") : err;
+    }
+    if ((combination >> 3) == 3u) {
+        /* Coefficients in this form always exceed 10^34 - 1 and read as zero. */
+        exponent = (int64_t)((high >> 47) & 0x3fffu) - 6176;
+        high = 0;
+        low = 0;
+    } else {
+        exponent = (int64_t)((high >> 49) & 0x3fffu) - 6176;
+        high &= 0x1ffffffffffffULL;
+        if (high > 0x1ed09bead87c0ULL || (high == 0x1ed09bead87c0ULL && low >= 0x378d8e6400000000ULL)) {
+            high = 0;
+            low = 0;
+        }
+    }
+    parts[0] = (uint32_t)(high >> 32);
+    parts[1] = (uint32_t)high;
+    parts[2] = (uint32_t)(low >> 32);
+    parts[3] = (uint32_t)low;
+    while (parts[0] != 0 || parts[1] != 0 || parts[2] != 0 || parts[3] != 0) {
+        uint32_t rem = divide_1e9(parts);
+        size_t i;
+        for (i = 0; i < 9u; i++) {
+            digits[ndigits++] = (char)('0' + rem % 10u);
+            rem /= 10u;
+        }
+    }
+    while (ndigits > 1u && digits[ndigits - 1u] == '0') {
+        ndigits--;
+    }
+    if (ndigits == 0) {
+        digits[ndigits++] = '0';
+    }
+    /* digits[] holds the coefficient least-significant digit first. */
+    if ((p[15] & 0x80u) != 0) {
+        text[pos++] = '-';
+    }
+    scientific = (int64_t)ndigits - 1 + exponent;
+    if (exponent > 0 || scientific < -6) {
+        size_t i;
+        text[pos++] = digits[ndigits - 1u];
+        if (ndigits > 1u) {
+            text[pos++] = '.';
+            for (i = ndigits - 1u; i > 0; i--) {
+                text[pos++] = digits[i - 1u];
+            }
+        }
+        pos += (size_t)snprintf(text + pos, sizeof(text) - pos, "E%+" PRId64, scientific);
+    } else if (exponent == 0) {
+        size_t i;
+        for (i = ndigits; i > 0; i--) {
+            text[pos++] = digits[i - 1u];
+        }
+    } else {
+        int64_t radix = (int64_t)ndigits + exponent;
+        size_t i;
+        if (radix > 0) {
+            for (i = ndigits; i > 0; i--) {
+                if ((int64_t)(ndigits - i) == radix) {
+                    text[pos++] = '.';
+                }
+                text[pos++] = digits[i - 1u];
+            }
+        } else {
+            text[pos++] = '0';
+            text[pos++] = '.';
+            for (; radix < 0; radix++) {
+                text[pos++] = '0';
+            }
+            for (i = ndigits; i > 0; i--) {
+                text[pos++] = digits[i - 1u];
+            }
+        }
+    }
+    err = jb_puts(b, "{\"$numberDecimal\":\"");
+    err = err == SCRIBE_OK ? jb_append(b, text, pos) : err;
+    return err == SCRIBE_OK ? jb_puts(b, "\"}") : err;
+}
+
+/*
+ * Appends a double as `{"$numberDouble":"..."}` with libbson's spelling for
+ * non-finite values and a trailing `.0` on integral finite values.
+ */
+static scribe_error_t jb_double(json_buf *b, double d) {
+    char tmp[64];
+
+    if (isnan(d)) {
+        snprintf(tmp, sizeof(tmp), "NaN");
+    } else if (isinf(d)) {
+        snprintf(tmp, sizeof(tmp), "%s", d < 0 ? "-Infinity" : "Infinity");
+    } else {
+        snprintf(tmp, sizeof(tmp), "%.20g", d);
+        if (strpbrk(tmp, ".e") == NULL) {
+            strcat(tmp, ".0");
+        }
+    }
+    return jb_printf(b, "{\"$numberDouble\":\"%s\"}", tmp);
+}
+
+/*
+ * Reads a BSON length-prefixed string (int32 length including the NUL, then
+ * bytes) from `p` with `avail` readable bytes.
+ */
+static scribe_error_t read_bson_string(const uint8_t *p, size_t avail, const char **out, size_t *out_len,
+                                       size_t *consumed) {
+    uint32_t n;
+
+    if (avail < 4u) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "truncated BSON string");
+    }
+    n = le32(p);
+    if (n < 1u || n > avail - 4u || p[4u + n - 1u] != 0) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "invalid BSON string length");
+    }
+    *out = (const char *)p + 4;
+    *out_len = n - 1u;
+    *consumed = 4u + n;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads a NUL-terminated BSON cstring and returns its length without the NUL.
+ */
+static scribe_error_t read_bson_cstring(const uint8_t *p, size_t avail, size_t *out_len) {
+    const uint8_t *nul = (const uint8_t *)memchr(p, 0, avail);
+
+    if (nul == NULL) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "unterminated BSON cstring");
+    }
+    *out_len = (size_t)(nul - p);
+    return SCRIBE_OK;
+}
+
+static scribe_error_t render_document(const uint8_t *doc, size_t avail, int is_array, int depth, json_buf *b,
+                                      size_t *consumed);
+
+/*
+ * Renders one element body of BSON type `type` located at `p`. Returns the
+ * number of bytes consumed so the caller can advance to the next element.
+ */
+static scribe_error_t render_value(uint8_t type, const uint8_t *p, size_t avail, int depth, json_buf *b,
+                                   size_t *consumed) {
+    const char *s;
+    size_t slen;
+    size_t used;
+    scribe_error_t err;
+
+    switch (type) {
+    case 0x01:
+        if (avail < 8u) {
+            break;
+        }
+        {
+            uint64_t bits = le64(p);
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            *consumed = 8u;
+            return jb_double(b, d);
+        }
+    case 0x02:
+        if ((err = read_bson_string(p, avail, &s, &slen, consumed)) != SCRIBE_OK) {
+            return err;
+        }
+        return jb_string(b, s, slen);
+    case 0x03:
+    case 0x04:
+        return render_document(p, avail, type == 0x04, depth + 1, b, consumed);
+    case 0x05: {
+        uint32_t n;
+        uint8_t subtype;
+        const uint8_t *data;
+        if (avail < 5u || (n = le32(p)) > avail - 5u) {
+            break;
+        }
+        subtype = p[4];
+        data = p + 5;
+        *consumed = 5u + n;
+        if (subtype == 0x02u && n >= 4u) {
+            /* The deprecated binary subtype carries a redundant inner length. */
+            data += 4;
+            n -= 4u;
+        }
+        err = jb_puts(b, "{\"$binary\":{\"base64\":\"");
+        err = err == SCRIBE_OK ? jb_base64(b, data, n) : err;
+        return err == SCRIBE_OK ? jb_printf(b, "\",\"subType\":\"%02x\"}}", subtype) : err;
+    }
+    case 0x06:
+        *consumed = 0;
+        return jb_puts(b, "{\"$undefined\":true}");
+    case 0x07:
+        if (avail < 12u) {
+            break;
+        }
+        *consumed = 12u;
+        return jb_oid(b, p);
+    case 0x08:
+        if (avail < 1u || p[0] > 1u) {
+            break;
+        }
+        *consumed = 1u;
+        return jb_puts(b, p[0] ? "true" : "false");
+    case 0x09:
+        if (avail < 8u) {
+            break;
+        }
+        *consumed = 8u;
+        return jb_printf(b, "{\"$date\":{\"$numberLong\":\"%" PRId64 "\"}}", (int64_t)le64(p));
+    case 0x0a:
+        *consumed = 0;
+        return jb_puts(b, "null");
+    case 0x0b: {
+        size_t plen;
+        size_t olen;
+        if ((err = read_bson_cstring(p, avail, &plen)) != SCRIBE_OK ||
+            (err = read_bson_cstring(p + plen + 1u, avail - plen - 1u, &olen)) != SCRIBE_OK) {
+            return err;
+        }
+        *consumed = plen + olen + 2u;
+        err = jb_puts(b, "{\"$regularExpression\":{\"pattern\":");
+        err = err == SCRIBE_OK ? jb_string(b, (const char *)p, plen) : err;
+        err = err == SCRIBE_OK ? jb_puts(b, ",\"options\":") : err;
+        err = err == SCRIBE_OK ? jb_string(b, (const char *)p + plen + 1u, olen) : err;
+        return err == SCRIBE_OK ? jb_puts(b, "}}") : err;
+    }
+    case 0x0c:
+        if ((err = read_bson_string(p, avail, &s, &slen, &used)) != SCRIBE_OK) {
+            return err;
+        }
+        if (avail - used < 12u) {
+            break;
+        }
+        *consumed = used + 12u;
+        err = jb_puts(b, "{\"$dbPointer\":{\"$ref\":");
+        err = err == SCRIBE_OK ? jb_string(b, s, slen) : err;
+        err = err == SCRIBE_OK ? jb_puts(b, ",\"$id\":") : err;
+        err = err == SCRIBE_OK ? jb_oid(b, p + used) : err;
+        return err == SCRIBE_OK ? jb_puts(b, "}}") : err;
+    case 0x0d:
+    case 0x0e:
+        if ((err = read_bson_string(p, avail, &s, &slen, consumed)) != SCRIBE_OK) {
+            return err;
+        }
+        err = jb_puts(b, type == 0x0d ? "{\"$code\":" : "{\"$symbol\":");
+        err = err == SCRIBE_OK ? jb_string(b, s, slen) : err;
+        return err == SCRIBE_OK ? jb_puts(b, "}") : err;
+    case 0x0f: {
+        uint32_t total;
+        size_t scope_len;
+        if (avail < 4u || (total = le32(p)) > avail || total < 4u) {
+            break;
+        }
+        if ((err = read_bson_string(p + 4, total - 4u, &s, &slen, &used)) != SCRIBE_OK) {
+            return err;
+        }
+        *consumed = total;
+        err = jb_puts(b, "{\"$code\":");
+        err = err == SCRIBE_OK ? jb_string(b, s, slen) : err;
+        err = err == SCRIBE_OK ? jb_puts(b, ",\"$scope\":") : err;
+        err = err == SCRIBE_OK ? render_document(p + 4 + used, total - 4u - used, 0, depth + 1, b, &scope_len) : err;
+        if (err == SCRIBE_OK && 4u + used + scope_len != total) {
+            return scribe_set_error(SCRIBE_EMALFORMED, "invalid BSON code-with-scope length");
+        }
+        return err == SCRIBE_OK ? jb_puts(b, "}") : err;
+    }
+    case 0x10:
+        if (avail < 4u) {
+            break;
+        }
+        *consumed = 4u;
+        return jb_printf(b, "{\"$numberInt\":\"%" PRId32 "\"}", (int32_t)le32(p));
+    case 0x11:
+        if (avail < 8u) {
+            break;
+        }
+        *consumed = 8u;
+        return jb_printf(b, "{\"$timestamp\":{\"t\":%" PRIu32 ",\"i\":%" PRIu32 "}}", le32(p + 4), le32(p));
+    case 0x12:
+        if (avail < 8u) {
+            break;
+        }
+        *consumed = 8u;
+        return jb_printf(b, "{\"$numberLong\":\"%" PRId64 "\"}", (int64_t)le64(p));
+    case 0x13:
+        if (avail < 16u) {
+            break;
+        }
+        *consumed = 16u;
+        return jb_decimal128(b, p);
+    case 0x7f:
+        *consumed = 0;
+        return jb_puts(b, "{\"$maxKey\":1}");
+    case 0xff:
+        *consumed = 0;
+        return jb_puts(b, "{\"$minKey\":1}");
+    default:
+        return scribe_set_error(SCRIBE_EMALFORMED, "unsupported BSON element type 0x%02x", type);
+    }
+    return scribe_set_error(SCRIBE_EMALFORMED, "truncated BSON element of type 0x%02x", type);
+}
+
+/*
+ * Renders an embedded document or array starting at its int32 length prefix.
+ * Array element keys are validated for framing but not printed.
+ */
+static scribe_error_t render_document(const uint8_t *doc, size_t avail, int is_array, int depth, json_buf *b,
+                                      size_t *consumed) {
+    uint32_t doc_len;
+    size_t pos = 4u;
+    int first = 1;
+    scribe_error_t err;
+
+    if (depth > BSON_MAX_DEPTH) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "BSON document nests too deeply");
+    }
+    if (avail < 5u || (doc_len = le32(doc)) < 5u || doc_len > avail || doc[doc_len - 1u] != 0) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "invalid BSON document length");
+    }
+    if ((err = jb_append(b, is_array ? "[" : "{", 1)) != SCRIBE_OK) {
+        return err;
+    }
+    while (pos < doc_len - 1u) {
+        uint8_t type = doc[pos++];
+        size_t key_len;
+        size_t used = 0;
+        if ((err = read_bson_cstring(doc + pos, doc_len - 1u - pos, &key_len)) != SCRIBE_OK) {
+            return err;
+        }
+        if ((!first && (err = jb_append(b, ",", 1)) != SCRIBE_OK) ||
+            (!is_array && ((err = jb_string(b, (const char *)doc + pos, key_len)) != SCRIBE_OK ||
+                           (err = jb_append(b, ":", 1)) != SCRIBE_OK))) {
+            return err;
+        }
+        pos += key_len + 1u;
+        if ((err = render_value(type, doc + pos, doc_len - 1u - pos, depth, b, &used)) != SCRIBE_OK) {
+            return err;
+        }
+        pos += used;
+        first = 0;
+    }
+    if (pos != doc_len - 1u) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "BSON element overruns its document");
+    }
+    *consumed = doc_len;
+    return jb_append(b, is_array ? "]" : "}", 1);
+}
+
+/*
+ * Returns whether blob bytes are framed as a single BSON document: the int32
+ * length prefix equals the blob size and the final byte is the terminator.
+ * Canonical JSON blobs always end in `}` and can never match.
+ */
+bool scribe_bson_is_document(const uint8_t *bytes, size_t len) {
+    return bytes != NULL && len >= 5u && len <= UINT32_MAX && le32(bytes) == (uint32_t)len && bytes[len - 1u] == 0;
+}
+
+/*
+ * Renders a BSON document blob as compact canonical Extended JSON. The output
+ * buffer is heap-owned and NUL-terminated; `out_len` excludes the terminator.
+ */
+scribe_error_t scribe_bson_to_json(const uint8_t *bytes, size_t len, char **out, size_t *out_len) {
+    json_buf b;
+    size_t used = 0;
+    scribe_error_t err;
+
+    if (out == NULL || out_len == NULL || !scribe_bson_is_document(bytes, len)) {
+        return scribe_set_error(SCRIBE_EINVAL, "blob is not a BSON document");
+    }
+    memset(&b, 0, sizeof(b));
+    err = render_document(bytes, len, 0, 0, &b, &used);
+    if (err != SCRIBE_OK) {
+        free(b.data);
+        return err;
+    }
+    *out = b.data;
+    *out_len = b.len;
+    return SCRIBE_OK;
+}
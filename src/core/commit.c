@@ -2,8 +2,8 @@
  * Commit payload serialization and parsing.
  *
  * Scribe commit objects are human-readable text headers plus raw message bytes.
- * This file validates commit batch metadata, serializes commit payloads, and
- * parses commit objects into arena-backed views used by log, diff, fsck, and
+ * This file validates commit batch metadata, serializes and reparents commit
+ * payloads, and parses commit objects into arena-backed views used by log, diff, fsck, and
  * adapter code.
  */
 #include "core/internal.h"
@@ -74,6 +74,9 @@ static scribe_error_t validate_batch(const scribe_change_batch *batch, int allow
                 strchr(ev->path[j], '\t') != NULL) {
                 return scribe_set_error(SCRIBE_EMALFORMED, "invalid path component");
             }
+            if (ev->path[j][0] == SCRIBE_SHARD_MARKER) {
+                return scribe_set_error(SCRIBE_EMALFORMED, "path component uses the reserved shard marker");
+            }
         }
     }
     return SCRIBE_OK;
@@ -183,6 +186,47 @@ scribe_error_t scribe_commit_serialize_allow_empty(const uint8_t root_tree[SCRIB
     return commit_serialize_ex(root_tree, parent, batch, arena, out, out_len, 1);
 }
 
+/*
+ * Copies a commit payload with its parent line replaced by `parent`, or
+ * removed when parent is NULL. Every other byte is kept, so the copy differs
+ * from the original only in its parent. History compaction uses this to move
+ * retained commits onto rewritten ancestors.
+ */
+scribe_error_t scribe_commit_reparent(const uint8_t *payload, size_t len, const uint8_t *parent, scribe_arena *arena,
+                                      uint8_t **out, size_t *out_len) {
+    const size_t tree_len = 5u + SCRIBE_HEX_HASH_SIZE + 1u;
+    const size_t parent_len = 7u + SCRIBE_HEX_HASH_SIZE + 1u;
+    size_t rest = tree_len;
+    uint8_t *buf;
+    size_t n;
+
+    if (len < tree_len || memcmp(payload, "tree ", 5) != 0 || payload[tree_len - 1u] != '\n') {
+        return scribe_set_error(SCRIBE_ECORRUPT, "commit missing tree header");
+    }
+    if (len - tree_len >= parent_len && memcmp(payload + tree_len, "parent ", 7) == 0) {
+        rest += parent_len;
+    }
+    buf = (uint8_t *)scribe_arena_alloc(arena, len - rest + tree_len + parent_len, _Alignof(uint8_t));
+    if (buf == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    memcpy(buf, payload, tree_len);
+    n = tree_len;
+    if (parent != NULL) {
+        char hex[SCRIBE_HEX_HASH_SIZE + 1];
+
+        scribe_hash_to_hex(parent, hex);
+        memcpy(buf + n, "parent ", 7);
+        memcpy(buf + n + 7u, hex, SCRIBE_HEX_HASH_SIZE);
+        buf[n + parent_len - 1u] = '\n';
+        n += parent_len;
+    }
+    memcpy(buf + n, payload + rest, len - rest);
+    *out = buf;
+    *out_len = n + len - rest;
+    return SCRIBE_OK;
+}
+
 /*
  * Returns the next newline-terminated line from a mutable buffer and replaces
  * the newline with NUL. The cursor advances past the newline for the next call.
@@ -299,6 +343,12 @@ scribe_error_t scribe_commit_parse(const uint8_t *payload, size_t len, scribe_ar
     return SCRIBE_OK;
 }
 
+/*
+ * Validates a normal change batch before any tree editing starts, so malformed
+ * paths are rejected before blobs are written.
+ */
+scribe_error_t scribe_commit_validate_batch(const scribe_change_batch *batch) { return validate_batch(batch, 0); }
+
 /* Commit construction is implemented in blob.c to keep the tree editing helpers private. */
 /*
  * Public commit entry point for callers with a writable context and a validated
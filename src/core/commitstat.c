@@ -0,0 +1,636 @@
+/*
+ * Per-commit change summaries.
+ *
+ * For every published commit the writer records how many leaves were added,
+ * modified, and deleted under each database/collection prefix (the first two
+ * path components). `log --stat` and `show` read these records instead of
+ * diffing trees. Summaries are computed right after publication from the
+ * counting diff of the parent and new root trees, which only reads trees that
+ * diverged, so they always agree with `diff`.
+ *
+ * Records are appended to `objects/info/commit-stats`:
+ *
+ *   u32 body length | body | u32 body length | first 8 bytes of BLAKE3(body)
+ *
+ * with body = commit hash, LEB128 prefix count, and per prefix LEB128-framed
+ * database and collection names followed by the three LEB128 counts. The
+ * trailer lets a writer check the last record in O(1) and trim a torn append
+ * before adding more. The file is a cache: commits without a record are
+ * summarized on demand, and the file may be deleted at any time. The field
+ * indexes in fieldindex.c reuse the same framing through the scribe_info_*
+ * helpers below.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/leb128.h"
+#include "util/log.h"
+
+#include "blake3.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define STATS_CHECK_SIZE 8u
+#define STATS_TRAILER_SIZE (4u + STATS_CHECK_SIZE)
+
+struct scribe_commit_stats_index {
+    uint8_t *file;
+    size_t len;
+    scribe_hash_map bodies;
+};
+
+/*
+ * Reads a little-endian u32.
+ */
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Writes a little-endian u32.
+ */
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/*
+ * Computes the truncated BLAKE3 check value of one record body.
+ */
+static void body_check(const uint8_t *body, size_t len, uint8_t out[STATS_CHECK_SIZE]) {
+    blake3_hasher hasher;
+
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, body, len);
+    blake3_hasher_finalize(&hasher, out, STATS_CHECK_SIZE);
+}
+
+/*
+ * Validates the record starting at `off`. Returns the record's total size, or
+ * 0 when the bytes there are not a complete, intact record.
+ */
+size_t scribe_info_record_at(const uint8_t *file, size_t len, size_t off) {
+    uint8_t check[STATS_CHECK_SIZE];
+    size_t body_len;
+
+    if (len - off < 4u + SCRIBE_HASH_SIZE + STATS_TRAILER_SIZE) {
+        return 0;
+    }
+    body_len = get_u32(file + off);
+    if (body_len < SCRIBE_HASH_SIZE || body_len > len - off - 4u - STATS_TRAILER_SIZE ||
+        get_u32(file + off + 4u + body_len) != body_len) {
+        return 0;
+    }
+    body_check(file + off + 4u, body_len, check);
+    if (memcmp(check, file + off + 8u + body_len, STATS_CHECK_SIZE) != 0) {
+        return 0;
+    }
+    return body_len + 4u + STATS_TRAILER_SIZE;
+}
+
+/*
+ * Writes the framing and trailer around a body of `body_len` bytes that
+ * starts 4 bytes into `record`. The buffer must hold body_len +
+ * SCRIBE_INFO_RECORD_OVERHEAD bytes.
+ */
+void scribe_info_record_seal(uint8_t *record, size_t body_len) {
+    put_u32(record, (uint32_t)body_len);
+    put_u32(record + 4u + body_len, (uint32_t)body_len);
+    body_check(record + 4u, body_len, record + 8u + body_len);
+}
+
+/*
+ * Loads every intact record into a commit-keyed table. Parsing stops at the
+ * first damaged record; commits after it are summarized on demand instead.
+ */
+scribe_error_t scribe_commit_stats_open(scribe_ctx *ctx, scribe_commit_stats_index **out) {
+    scribe_commit_stats_index *idx = (scribe_commit_stats_index *)calloc(1, sizeof(*idx));
+    char *path = scribe_path_join(ctx->repo_path, "objects/info/commit-stats");
+    size_t records = 0;
+    size_t off = 0;
+    size_t n;
+    scribe_error_t err;
+
+    if (idx == NULL || path == NULL) {
+        free(idx);
+        free(path);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate commit summary index");
+    }
+    err = scribe_read_file(path, &idx->file, &idx->len);
+    free(path);
+    if (err == SCRIBE_ENOT_FOUND) {
+        idx->len = 0;
+    } else if (err != SCRIBE_OK) {
+        free(idx);
+        return err;
+    }
+    while ((n = scribe_info_record_at(idx->file, idx->len, off)) != 0) {
+        records++;
+        off += n;
+    }
+    if (off != idx->len) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "objects", "ignoring damaged commit summaries after byte %zu", off);
+    }
+    err = scribe_hash_map_reserve(&idx->bodies, records);
+    for (off = 0; err == SCRIBE_OK && (n = scribe_info_record_at(idx->file, idx->len, off)) != 0; off += n) {
+        uint64_t *body;
+
+        err = scribe_hash_map_add(&idx->bodies, idx->file + off + 4u, 0, NULL, &body);
+        if (err == SCRIBE_OK) {
+            *body = off + 4u;
+        }
+    }
+    if (err != SCRIBE_OK) {
+        scribe_commit_stats_index_free(idx);
+        return err;
+    }
+    *out = idx;
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees an index returned by scribe_commit_stats_open(). Accepts NULL.
+ */
+void scribe_commit_stats_index_free(scribe_commit_stats_index *idx) {
+    if (idx == NULL) {
+        return;
+    }
+    free(idx->file);
+    scribe_hash_map_destroy(&idx->bodies);
+    free(idx);
+}
+
+/*
+ * Frees the prefix array and names of a summary and empties it.
+ */
+void scribe_commit_stats_free(scribe_commit_stats *stats) {
+    size_t i;
+
+    if (stats == NULL) {
+        return;
+    }
+    for (i = 0; i < stats->count; i++) {
+        free(stats->prefixes[i].db);
+        free(stats->prefixes[i].collection);
+    }
+    free(stats->prefixes);
+    memset(stats, 0, sizeof(*stats));
+}
+
+/*
+ * Returns the summary entry for a prefix, appending a zeroed one when the
+ * prefix is new. Entries stay in the order the diff walk meets them, which is
+ * byte-sorted by database and then collection.
+ */
+static scribe_error_t stats_prefix(scribe_commit_stats *stats, const char *db, size_t db_len, const char *coll,
+                                   size_t coll_len, scribe_prefix_stat **out) {
+    scribe_prefix_stat *p;
+
+    if (stats->count != 0) {
+        p = &stats->prefixes[stats->count - 1u];
+        if (p->db_len == db_len && p->collection_len == coll_len && memcmp(p->db, db, db_len) == 0 &&
+            memcmp(p->collection, coll, coll_len) == 0) {
+            *out = p;
+            return SCRIBE_OK;
+        }
+    }
+    if (stats->count == stats->cap) {
+        size_t cap = stats->cap == 0 ? 8u : stats->cap * 2u;
+        scribe_prefix_stat *grown = (scribe_prefix_stat *)realloc(stats->prefixes, cap * sizeof(*grown));
+
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow commit summary");
+        }
+        stats->prefixes = grown;
+        stats->cap = cap;
+    }
+    p = &stats->prefixes[stats->count];
+    memset(p, 0, sizeof(*p));
+    p->db = (char *)malloc(db_len + 1u);
+    p->collection = (char *)malloc(coll_len + 1u);
+    if (p->db == NULL || p->collection == NULL) {
+        free(p->db);
+        free(p->collection);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate commit summary prefix");
+    }
+    memcpy(p->db, db, db_len);
+    p->db[db_len] = '\0';
+    memcpy(p->collection, coll, coll_len);
+    p->collection[coll_len] = '\0';
+    p->db_len = db_len;
+    p->collection_len = coll_len;
+    stats->count++;
+    *out = p;
+    return SCRIBE_OK;
+}
+
+/*
+ * Adds added/modified/deleted counts to one prefix, skipping zero totals so
+ * the summary lists only prefixes that changed.
+ */
+static scribe_error_t stats_add(scribe_commit_stats *stats, const char *db, size_t db_len, const char *coll,
+                                size_t coll_len, const uint64_t counts[3]) {
+    scribe_prefix_stat *p;
+    scribe_error_t err;
+
+    if (counts[0] == 0 && counts[1] == 0 && counts[2] == 0) {
+        return SCRIBE_OK;
+    }
+    err = stats_prefix(stats, db, db_len, coll, coll_len, &p);
+    if (err == SCRIBE_OK) {
+        p->added += counts[0];
+        p->modified += counts[1];
+        p->deleted += counts[2];
+    }
+    return err;
+}
+
+/*
+ * Diffs one level of the database/collection prefix. Depth 0 compares root
+ * entries (databases) and recurses; depth 1 compares a database's collections
+ * and hands each changed collection to the counting diff. Either side may be
+ * NULL for a tree that is absent on that side. A leaf whose type changed counts
+ * as one modification, as in `diff`.
+ */
+static scribe_error_t stats_level(scribe_ctx *ctx, const uint8_t *old_tree, const uint8_t *new_tree,
+                                  const scribe_tree_entry *db, scribe_commit_stats *stats) {
+    scribe_arena arena_a = {0};
+    scribe_arena arena_b = {0};
+    scribe_tree_entry *a = NULL;
+    scribe_tree_entry *b = NULL;
+    size_t ac = 0;
+    size_t bc = 0;
+    size_t ai = 0;
+    size_t bi = 0;
+    scribe_error_t err = SCRIBE_OK;
+
+    if (old_tree != NULL) {
+        err = scribe_tree_read_logical(ctx, old_tree, &arena_a, &a, &ac);
+    }
+    if (err == SCRIBE_OK && new_tree != NULL) {
+        err = scribe_tree_read_logical(ctx, new_tree, &arena_b, &b, &bc);
+    }
+    while (err == SCRIBE_OK && (ai < ac || bi < bc)) {
+        const scribe_tree_entry *e;
+        const uint8_t *old_child = NULL;
+        const uint8_t *new_child = NULL;
+        uint64_t counts[3] = {0, 0, 0};
+        int cmp = ai >= ac ? 1 : bi >= bc ? -1 : scribe_tree_entry_compare(&a[ai], &b[bi]);
+
+        if (cmp <= 0) {
+            old_child = a[ai].type == SCRIBE_OBJECT_TREE ? a[ai].hash : NULL;
+        }
+        if (cmp >= 0) {
+            new_child = b[bi].type == SCRIBE_OBJECT_TREE ? b[bi].hash : NULL;
+        }
+        e = cmp <= 0 ? &a[ai] : &b[bi];
+        if (cmp == 0 && scribe_hash_cmp(a[ai].hash, b[bi].hash) == 0) {
+            /* unchanged */
+        } else if (cmp == 0 && (old_child == NULL || new_child == NULL)) {
+            counts[1] = 1;
+        } else if (old_child == NULL && new_child == NULL) {
+            counts[cmp < 0 ? 2 : 0] = 1;
+        } else if (db == NULL) {
+            err = stats_level(ctx, old_child, new_child, e, stats);
+        } else {
+            err = scribe_diff_count(ctx, old_child, new_child, counts);
+        }
+        if (err == SCRIBE_OK && db == NULL) {
+            err = stats_add(stats, e->name, e->name_len, "", 0, counts);
+        } else if (err == SCRIBE_OK) {
+            err = stats_add(stats, db->name, db->name_len, e->name, e->name_len, counts);
+        }
+        ai += cmp <= 0 ? 1u : 0u;
+        bi += cmp >= 0 ? 1u : 0u;
+    }
+    scribe_arena_destroy(&arena_a);
+    scribe_arena_destroy(&arena_b);
+    return err;
+}
+
+/*
+ * Summarizes the change from old_root (NULL for an initial commit) to
+ * new_root by database/collection prefix.
+ */
+scribe_error_t scribe_commit_stats_compute(scribe_ctx *ctx, const uint8_t *old_root,
+                                           const uint8_t new_root[SCRIBE_HASH_SIZE], scribe_commit_stats *out) {
+    scribe_error_t err;
+
+    memset(out, 0, sizeof(*out));
+    err = stats_level(ctx, old_root, new_root, NULL, out);
+    if (err != SCRIBE_OK) {
+        scribe_commit_stats_free(out);
+    }
+    return err;
+}
+
+/*
+ * Reads one LEB128 value from a record body.
+ */
+static scribe_error_t body_uint(const uint8_t *body, size_t len, size_t *pos, uint64_t *out) {
+    size_t used = 0;
+
+    if (*pos >= len || scribe_leb128_decode(body + *pos, len - *pos, out, &used) != SCRIBE_OK) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid commit summary record");
+    }
+    *pos += used;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads one LEB128-framed name from a record body without copying it.
+ */
+static scribe_error_t body_name(const uint8_t *body, size_t len, size_t *pos, const char **out, size_t *out_len) {
+    uint64_t n = 0;
+    scribe_error_t err = body_uint(body, len, pos, &n);
+
+    if (err == SCRIBE_OK && n > len - *pos) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "invalid commit summary record");
+    }
+    if (err == SCRIBE_OK) {
+        *out = (const char *)(body + *pos);
+        *out_len = (size_t)n;
+        *pos += (size_t)n;
+    }
+    return err;
+}
+
+/*
+ * Decodes a record body. The record framing and checksum were already
+ * verified when the index was opened.
+ */
+static scribe_error_t decode_body(const uint8_t *body, size_t len, scribe_commit_stats *out) {
+    size_t pos = SCRIBE_HASH_SIZE;
+    uint64_t n = 0;
+    uint64_t i;
+    scribe_error_t err = body_uint(body, len, &pos, &n);
+
+    memset(out, 0, sizeof(*out));
+    for (i = 0; err == SCRIBE_OK && i < n; i++) {
+        const char *db = NULL;
+        const char *coll = NULL;
+        size_t db_len = 0;
+        size_t coll_len = 0;
+        uint64_t counts[3] = {0, 0, 0};
+
+        err = body_name(body, len, &pos, &db, &db_len);
+        if (err == SCRIBE_OK) {
+            err = body_name(body, len, &pos, &coll, &coll_len);
+        }
+        if (err == SCRIBE_OK) {
+            err = body_uint(body, len, &pos, &counts[0]);
+        }
+        if (err == SCRIBE_OK) {
+            err = body_uint(body, len, &pos, &counts[1]);
+        }
+        if (err == SCRIBE_OK) {
+            err = body_uint(body, len, &pos, &counts[2]);
+        }
+        if (err == SCRIBE_OK) {
+            err = stats_add(out, db, db_len, coll, coll_len, counts);
+        }
+    }
+    if (err != SCRIBE_OK) {
+        scribe_commit_stats_free(out);
+    }
+    return err;
+}
+
+/*
+ * Returns a commit's summary from the index, or computes it from the two root
+ * trees when the commit has no record. parent_root is NULL for an initial
+ * commit; idx may be NULL to skip the lookup.
+ */
+scribe_error_t scribe_commit_stats_get(scribe_ctx *ctx, scribe_commit_stats_index *idx,
+                                       const uint8_t commit[SCRIBE_HASH_SIZE], const uint8_t *parent_root,
+                                       const uint8_t root[SCRIBE_HASH_SIZE], scribe_commit_stats *out) {
+    if (idx != NULL) {
+        const uint64_t *at = scribe_hash_map_get(&idx->bodies, commit);
+
+        if (at != NULL) {
+            size_t body = (size_t)*at;
+
+            return decode_body(idx->file + body, get_u32(idx->file + body - 4u), out);
+        }
+    }
+    return scribe_commit_stats_compute(ctx, parent_root, root, out);
+}
+
+/*
+ * Serializes one complete record: framing, body, and trailer.
+ */
+static scribe_error_t encode_record(const uint8_t commit[SCRIBE_HASH_SIZE], const scribe_commit_stats *stats,
+                                    uint8_t **out, size_t *out_len) {
+    uint8_t leb[10];
+    size_t len = SCRIBE_HASH_SIZE + scribe_leb128_encode((uint64_t)stats->count, leb);
+    size_t pos;
+    size_t i;
+    uint8_t *buf;
+
+    for (i = 0; i < stats->count; i++) {
+        const scribe_prefix_stat *p = &stats->prefixes[i];
+
+        len += scribe_leb128_encode((uint64_t)p->db_len, leb) + p->db_len;
+        len += scribe_leb128_encode((uint64_t)p->collection_len, leb) + p->collection_len;
+        len += scribe_leb128_encode(p->added, leb) + scribe_leb128_encode(p->modified, leb) +
+               scribe_leb128_encode(p->deleted, leb);
+    }
+    if (len > UINT32_MAX) {
+        return scribe_set_error(SCRIBE_ENOMEM, "commit summary is too large");
+    }
+    buf = (uint8_t *)malloc(len + SCRIBE_INFO_RECORD_OVERHEAD);
+    if (buf == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate commit summary record");
+    }
+    put_u32(buf, (uint32_t)len);
+    memcpy(buf + 4u, commit, SCRIBE_HASH_SIZE);
+    pos = 4u + SCRIBE_HASH_SIZE;
+    pos += scribe_leb128_encode((uint64_t)stats->count, buf + pos);
+    for (i = 0; i < stats->count; i++) {
+        const scribe_prefix_stat *p = &stats->prefixes[i];
+
+        pos += scribe_leb128_encode((uint64_t)p->db_len, buf + pos);
+        memcpy(buf + pos, p->db, p->db_len);
+        pos += p->db_len;
+        pos += scribe_leb128_encode((uint64_t)p->collection_len, buf + pos);
+        memcpy(buf + pos, p->collection, p->collection_len);
+        pos += p->collection_len;
+        pos += scribe_leb128_encode(p->added, buf + pos);
+        pos += scribe_leb128_encode(p->modified, buf + pos);
+        pos += scribe_leb128_encode(p->deleted, buf + pos);
+    }
+    scribe_info_record_seal(buf, len);
+    *out = buf;
+    *out_len = pos + STATS_TRAILER_SIZE;
+    return SCRIBE_OK;
+}
+
+/*
+ * Makes sure an info file ends on a record boundary before an append. The
+ * last record is checked through its trailer; only if it is damaged is the
+ * file scanned from the start and cut after its last intact record. When
+ * `last` is not NULL it receives a heap copy of the last intact record, or
+ * NULL when the file holds none.
+ */
+static scribe_error_t trim_torn_tail(int fd, uint8_t **last, size_t *last_len) {
+    struct stat st;
+    uint8_t *file;
+    size_t len;
+    size_t off = 0;
+    size_t prev = 0;
+    size_t n;
+
+    if (fstat(fd, &st) != 0) {
+        return scribe_set_error(SCRIBE_EIO, "failed to stat info file");
+    }
+    len = (size_t)st.st_size;
+    if (len == 0) {
+        return SCRIBE_OK;
+    }
+    if (len >= STATS_TRAILER_SIZE) {
+        uint8_t trailer[4];
+
+        if (pread(fd, trailer, sizeof(trailer), (off_t)(len - STATS_TRAILER_SIZE)) == (ssize_t)sizeof(trailer)) {
+            size_t body_len = get_u32(trailer);
+
+            if (body_len <= len - STATS_TRAILER_SIZE - 4u) {
+                size_t start = len - STATS_TRAILER_SIZE - 4u - body_len;
+                size_t rec_len = len - start;
+
+                file = (uint8_t *)malloc(rec_len);
+                if (file != NULL && pread(fd, file, rec_len, (off_t)start) == (ssize_t)rec_len &&
+                    scribe_info_record_at(file, rec_len, 0) == rec_len) {
+                    if (last != NULL) {
+                        *last = file;
+                        *last_len = rec_len;
+                    } else {
+                        free(file);
+                    }
+                    return SCRIBE_OK;
+                }
+                free(file);
+            }
+        }
+    }
+    file = (uint8_t *)malloc(len);
+    if (file == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to read info file");
+    }
+    if (pread(fd, file, len, 0) != (ssize_t)len) {
+        free(file);
+        return scribe_set_error(SCRIBE_EIO, "failed to read info file");
+    }
+    while ((n = scribe_info_record_at(file, len, off)) != 0) {
+        prev = off;
+        off += n;
+    }
+    if (last != NULL && off != 0) {
+        *last = (uint8_t *)malloc(off - prev);
+        if (*last == NULL) {
+            free(file);
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to read info file");
+        }
+        memcpy(*last, file + prev, off - prev);
+        *last_len = off - prev;
+    }
+    free(file);
+    if (ftruncate(fd, (off_t)off) != 0) {
+        if (last != NULL) {
+            free(*last);
+            *last = NULL;
+        }
+        return scribe_set_error(SCRIBE_EIO, "failed to trim info file");
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Opens `objects/info/<name>` for appending records, creating it and its
+ * directory as needed, and trims any torn tail. See trim_torn_tail() for
+ * `last`, which may be NULL.
+ */
+scribe_error_t scribe_info_open(scribe_ctx *ctx, const char *name, int *out_fd, uint8_t **last, size_t *last_len) {
+    char *info = scribe_path_join(ctx->repo_path, "objects/info");
+    char *path = info == NULL ? NULL : scribe_path_join(info, name);
+    char *dir = path == NULL ? NULL : strdup(path);
+    int fd = -1;
+    scribe_error_t err = dir == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate info path") : SCRIBE_OK;
+
+    if (last != NULL) {
+        *last = NULL;
+        *last_len = 0;
+    }
+    if (err == SCRIBE_OK) {
+        fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0 && errno == ENOENT) {
+            *strrchr(dir, '/') = '\0';
+            if (scribe_mkdir_p(dir) == SCRIBE_OK) {
+                fd = open(path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+            }
+        }
+        err = fd < 0 ? scribe_set_error(SCRIBE_EIO, "failed to open %s", path) : trim_torn_tail(fd, last, last_len);
+    }
+    if (err != SCRIBE_OK && fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+    *out_fd = fd;
+    free(dir);
+    free(path);
+    free(info);
+    return err;
+}
+
+/*
+ * Appends a summary record for `commit`. Failures are logged rather than
+ * returned because the file is only a cache; `log --stat` recomputes any
+ * summary that is missing.
+ */
+void scribe_commit_stats_store(scribe_ctx *ctx, const uint8_t commit[SCRIBE_HASH_SIZE],
+                               const scribe_commit_stats *stats) {
+    uint8_t *record = NULL;
+    size_t record_len = 0;
+    int fd = -1;
+    scribe_error_t err = encode_record(commit, stats, &record, &record_len);
+
+    if (err == SCRIBE_OK) {
+        err = scribe_info_open(ctx, "commit-stats", &fd, NULL, NULL);
+    }
+    if (err == SCRIBE_OK && write(fd, record, record_len) != (ssize_t)record_len) {
+        err = scribe_set_error(SCRIBE_EIO, "failed to append commit summary");
+    }
+    if (err != SCRIBE_OK) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "commit", "failed to record commit summary: %s",
+                       scribe_last_error_detail());
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(record);
+}
+
+/*
+ * Summarizes a just-published commit and appends its record. The commit is
+ * already visible, so failures are logged rather than returned.
+ */
+void scribe_commit_stats_record(scribe_ctx *ctx, const uint8_t commit[SCRIBE_HASH_SIZE], const uint8_t *parent_root,
+                                const uint8_t root[SCRIBE_HASH_SIZE]) {
+    scribe_commit_stats stats;
+    scribe_error_t err = scribe_commit_stats_compute(ctx, parent_root, root, &stats);
+
+    if (err != SCRIBE_OK) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "commit", "failed to record commit summary: %s",
+                       scribe_last_error_detail());
+        return;
+    }
+    scribe_commit_stats_store(ctx, commit, &stats);
+    scribe_commit_stats_free(&stats);
+}
@@ -0,0 +1,290 @@
+/*
+ * History compaction.
+ *
+ * `scribe compact-history --older-than <age> --granularity <window>` thins the
+ * old end of main's history. Commits older than the cutoff are grouped into
+ * windows aligned to the Unix epoch, and every window holding more than one
+ * commit is replaced by a single commit whose root tree is the root of the
+ * window's last commit. Retained states therefore keep their exact trees and
+ * share every tree and blob object with the original history. Commits newer
+ * than the cutoff and windows of one commit are copied byte for byte except
+ * for their parent line. The new chain is written in full before main moves
+ * with one barrier and one compare-and-swap, so a crash leaves either the old
+ * history or the new one. Replaced commits become dangling objects that fsck
+ * reports until a future gc removes them. Archived objects that the new
+ * history keeps but whose delta base it drops are then re-encoded on their
+ * own (see archive.c), so nothing fsck reports is still needed.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    COMPACT_KEEP = 0,
+    COMPACT_REPARENT = 1,
+    COMPACT_WINDOW = 2,
+    COMPACT_DROP = 3,
+} compact_kind;
+
+typedef struct {
+    scribe_history_entry old;
+    uint8_t new_hash[SCRIBE_HASH_SIZE];
+    compact_kind kind;
+} compact_commit;
+
+typedef struct {
+    compact_commit *items;
+    size_t count;
+} compact_history;
+
+/*
+ * Returns the epoch-aligned window that contains `t`, rounding toward
+ * negative infinity so windows before 1970 are as wide as the rest.
+ */
+static int64_t window_of(int64_t t, int64_t width) { return t >= 0 ? t / width : -((-(t + 1)) / width) - 1; }
+
+/*
+ * Copies commit `c` onto `parent` (NULL for a root commit) and stores the
+ * copy's hash in c->new_hash.
+ */
+static scribe_error_t reparent_commit(scribe_ctx *ctx, compact_commit *c, const uint8_t *parent) {
+    scribe_object obj;
+    scribe_arena arena = {0};
+    uint8_t *payload;
+    size_t payload_len;
+    scribe_error_t err = scribe_object_read(ctx, c->old.hash, &obj);
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_arena_init(&arena, obj.payload_len + 4096u);
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_reparent(obj.payload, obj.payload_len, parent, &arena, &payload, &payload_len);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_object_write(ctx, SCRIBE_OBJECT_COMMIT, payload, payload_len, c->new_hash);
+    }
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Writes the commit that replaces window items[0..n), parented to `parent`.
+ * It carries the root tree and time of the window's last commit, and its
+ * message lists the commits it replaces.
+ */
+static scribe_error_t write_window(scribe_ctx *ctx, compact_commit *items, size_t n, const uint8_t *parent,
+                                   const char *params) {
+    compact_commit *last = &items[n - 1u];
+    scribe_change_batch meta;
+    scribe_arena arena = {0};
+    uint8_t *payload;
+    size_t payload_len;
+    size_t cap = 64u + n * (SCRIBE_HEX_HASH_SIZE + 8u);
+    size_t len;
+    size_t i;
+    char *message = (char *)malloc(cap);
+    scribe_error_t err;
+
+    if (message == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate compaction message");
+    }
+    len = (size_t)snprintf(message, cap, "compact %zu commits\n", n);
+    for (i = 0; i < n; i++) {
+        char hex[SCRIBE_HEX_HASH_SIZE + 1];
+
+        scribe_hash_to_hex(items[i].old.hash, hex);
+        len += (size_t)snprintf(message + len, cap - len, "commit %s\n", hex);
+    }
+    memset(&meta, 0, sizeof(meta));
+    meta.author = (scribe_identity){"scribe", "", "scribe"};
+    meta.committer = (scribe_identity){"scribe", "", "scribe"};
+    meta.process = (scribe_process_info){"compact-history", SCRIBE_VERSION, params, ""};
+    meta.timestamp_unix_nanos = last->old.time;
+    meta.message = message;
+    meta.message_len = len;
+    err = scribe_arena_init(&arena, 4096u + len * 2u);
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_serialize_allow_empty(last->old.root, parent, &meta, &arena, &payload, &payload_len);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_object_write(ctx, SCRIBE_OBJECT_COMMIT, payload, payload_len, last->new_hash);
+    }
+    scribe_arena_destroy(&arena);
+    free(message);
+    for (i = 0; err == SCRIBE_OK && i + 1u < n; i++) {
+        items[i].kind = COMPACT_DROP;
+        scribe_hash_copy(items[i].new_hash, last->new_hash);
+    }
+    last->kind = COMPACT_WINDOW;
+    return err;
+}
+
+/*
+ * Builds the compacted chain: windows for the first `cold` commits, then
+ * copies of everything after them. Returns the new tip in `tip`. Nothing is
+ * published.
+ */
+static scribe_error_t rewrite_history(scribe_ctx *ctx, compact_history *h, size_t cold, int64_t width,
+                                      const char *params, uint8_t tip[SCRIBE_HASH_SIZE]) {
+    const uint8_t *parent = NULL;
+    int moved = 0;
+    size_t i = 0;
+    scribe_error_t err = SCRIBE_OK;
+
+    while (err == SCRIBE_OK && i < h->count) {
+        compact_commit *c = &h->items[i];
+        size_t n = 1;
+
+        while (i + n < cold && window_of(h->items[i + n].old.time, width) == window_of(c->old.time, width)) {
+            n++;
+        }
+        if (n > 1u) {
+            err = write_window(ctx, c, n, parent, params);
+            moved = 1;
+        } else if (moved) {
+            c->kind = COMPACT_REPARENT;
+            err = reparent_commit(ctx, c, parent);
+        } else {
+            c->kind = COMPACT_KEEP;
+            scribe_hash_copy(c->new_hash, c->old.hash);
+        }
+        i += n;
+        parent = h->items[i - 1u].new_hash;
+    }
+    if (err == SCRIBE_OK && h->count != 0) {
+        scribe_hash_copy(tip, h->items[h->count - 1u].new_hash);
+    }
+    return err;
+}
+
+/*
+ * Records change summaries for the published chain. Copies inherit their
+ * original's summary because their parent root is unchanged; window commits
+ * are summarized against the previous retained root.
+ */
+static void record_summaries(scribe_ctx *ctx, const compact_history *h) {
+    scribe_commit_stats_index *idx = NULL;
+    const uint8_t *parent_root = NULL;
+    size_t i;
+
+    if (scribe_commit_stats_open(ctx, &idx) != SCRIBE_OK) {
+        idx = NULL;
+    }
+    for (i = 0; i < h->count; i++) {
+        const compact_commit *c = &h->items[i];
+
+        if (c->kind == COMPACT_DROP) {
+            continue;
+        }
+        if (c->kind == COMPACT_WINDOW) {
+            scribe_commit_stats_record(ctx, c->new_hash, parent_root, c->old.root);
+        } else if (c->kind == COMPACT_REPARENT) {
+            scribe_commit_stats stats;
+
+            if (scribe_commit_stats_get(ctx, idx, c->old.hash, parent_root, c->old.root, &stats) == SCRIBE_OK) {
+                scribe_commit_stats_store(ctx, c->new_hash, &stats);
+                scribe_commit_stats_free(&stats);
+            }
+        }
+        parent_root = c->old.root;
+    }
+    scribe_commit_stats_index_free(idx);
+}
+
+/*
+ * Implements `scribe compact-history`. On success prints `<old> <new>` for
+ * every commit whose id changed, oldest first; replaced commits map to the
+ * window commit that now holds their window's final state.
+ */
+scribe_error_t scribe_cli_compact_history(scribe_ctx *ctx, const char *older_than, const char *granularity) {
+    compact_history h = {0};
+    scribe_history_entry *entries = NULL;
+    uint8_t head[SCRIBE_HASH_SIZE];
+    uint8_t tip[SCRIBE_HASH_SIZE];
+    char params[128];
+    int64_t age;
+    int64_t width;
+    size_t windows = 0;
+    size_t dropped = 0;
+    size_t copied = 0;
+    size_t detached = 0;
+    size_t i;
+    scribe_error_t err;
+
+    err = scribe_parse_duration(older_than, "--older-than", &age);
+    if (err == SCRIBE_OK) {
+        err = scribe_parse_duration(granularity, "--granularity", &width);
+    }
+    if (err == SCRIBE_OK && width == 0) {
+        err = scribe_set_error(SCRIBE_EINVAL, "--granularity must be greater than zero");
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_partition_fold(ctx);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_refs_read(ctx, "refs/heads/main", head);
+    }
+    if (err == SCRIBE_ENOT_FOUND) {
+        return SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_history_load(ctx, head, &entries, &h.count);
+    }
+    if (err == SCRIBE_OK) {
+        h.items = (compact_commit *)calloc(h.count, sizeof(*h.items));
+        err = h.items == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate history") : SCRIBE_OK;
+    }
+    if (err != SCRIBE_OK) {
+        free(entries);
+        return err;
+    }
+    for (i = 0; i < h.count; i++) {
+        h.items[i].old = entries[i];
+    }
+    (void)snprintf(params, sizeof(params), "older-than=%s granularity=%s", older_than, granularity);
+    err = rewrite_history(ctx, &h, scribe_history_cold_count(entries, h.count, age), width, params, tip);
+    free(entries);
+    if (err == SCRIBE_OK && scribe_hash_cmp(tip, head) != 0) {
+        err = scribe_object_flush(ctx);
+        if (err == SCRIBE_OK) {
+            err = scribe_refs_cas(ctx, "refs/heads/main", head, tip);
+        }
+        if (err == SCRIBE_OK) {
+            record_summaries(ctx, &h);
+            scribe_field_index_record(ctx, tip);
+        }
+    }
+    /* Also runs when nothing moved, so a rerun finishes an interrupted one. */
+    if (err == SCRIBE_OK) {
+        err = scribe_archive_detach_unreachable(ctx, &detached);
+    }
+    for (i = 0; err == SCRIBE_OK && i < h.count; i++) {
+        char old_hex[SCRIBE_HEX_HASH_SIZE + 1];
+        char new_hex[SCRIBE_HEX_HASH_SIZE + 1];
+
+        windows += h.items[i].kind == COMPACT_WINDOW;
+        dropped += h.items[i].kind == COMPACT_DROP;
+        copied += h.items[i].kind == COMPACT_REPARENT;
+        if (h.items[i].kind != COMPACT_KEEP) {
+            scribe_hash_to_hex(h.items[i].old.hash, old_hex);
+            scribe_hash_to_hex(h.items[i].new_hash, new_hex);
+            printf("%s %s\n", old_hex, new_hex);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "compact",
+                       "compacted %zu commits into %zu window commits, rewrote %zu newer commits, detached %zu "
+                       "archived object(s)",
+                       windows + dropped, windows, copied, detached);
+    }
+    free(h.items);
+    return err;
+}
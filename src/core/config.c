@@ -30,8 +30,84 @@ scribe_error_t scribe_default_config(scribe_config *cfg) {
     cfg->event_queue_capacity = 64;
     cfg->queue_stall_warn_seconds = 30;
     cfg->adapter_require_pre_post_images = false;
+    cfg->adapter_enable_post_images = false;
     cfg->adapter_coalesce_window_ms = 0;
     strcpy(cfg->adapter_excluded_databases, "admin,local,config");
+    cfg->adapter_blob_format = SCRIBE_BLOB_FORMAT_JSON;
+    cfg->tree_shard_threshold = 0;
+    cfg->snapshot_memory_bytes = SCRIBE_DEFAULT_SNAPSHOT_MEMORY;
+    cfg->memory_limit_bytes = 0;
+    cfg->adaptive_compression_level = 0;
+    cfg->repack_compression_level = SCRIBE_DEFAULT_REPACK_COMPRESSION_LEVEL;
+    cfg->archive_compression_level = SCRIBE_DEFAULT_ARCHIVE_COMPRESSION_LEVEL;
+    cfg->durability = SCRIBE_DURABILITY_STRICT;
+    cfg->durability_sync_seconds = SCRIBE_DEFAULT_DURABILITY_SYNC_SECONDS;
+    cfg->ref_partitioning = SCRIBE_REF_PARTITIONING_NONE;
+    cfg->partition_publish_ms = SCRIBE_DEFAULT_PARTITION_PUBLISH_MS;
+    cfg->worker_cpu_affinity = false;
+    cfg->field_index_count = 0;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the config spelling of a durability mode.
+ */
+const char *scribe_durability_name(scribe_durability mode) {
+    switch (mode) {
+    case SCRIBE_DURABILITY_BATCH:
+        return "batch";
+    case SCRIBE_DURABILITY_RELAXED:
+        return "relaxed";
+    case SCRIBE_DURABILITY_STRICT:
+    default:
+        return "strict";
+    }
+}
+
+/*
+ * Returns the config spelling of a ref partitioning mode.
+ */
+const char *scribe_ref_partitioning_name(scribe_ref_partitioning mode) {
+    return mode == SCRIBE_REF_PARTITIONING_DATABASE ? "database" : "none";
+}
+
+/*
+ * Returns the change stream fullDocument option for a mode.
+ */
+const char *scribe_full_document_name(scribe_full_document mode) {
+    switch (mode) {
+    case SCRIBE_FULL_DOCUMENT_WHEN_AVAILABLE:
+        return "whenAvailable";
+    case SCRIBE_FULL_DOCUMENT_REQUIRED:
+        return "required";
+    case SCRIBE_FULL_DOCUMENT_LOOKUP:
+    default:
+        return "updateLookup";
+    }
+}
+
+/*
+ * Chooses the fullDocument mode of a change stream from how many watched
+ * collections do and do not store post-images. Post-images are used only when
+ * every collection has them: a single collection without them would otherwise
+ * cost a synchronous client read per update, where updateLookup lets the server
+ * do that read inside the stream. require_pre_post_images turns any collection
+ * without them into SCRIBE_ECONFIG.
+ */
+scribe_error_t scribe_choose_full_document(const scribe_config *cfg, size_t with, size_t without,
+                                           scribe_full_document *out) {
+    if (cfg->adapter_require_pre_post_images) {
+        if (without != 0) {
+            return scribe_set_error(SCRIBE_ECONFIG,
+                                    "%zu watched collection(s) lack changeStreamPreAndPostImages, which "
+                                    "adapter.mongodb.require_pre_post_images requires; enable it or set "
+                                    "adapter.mongodb.enable_post_images = true",
+                                    without);
+        }
+        *out = SCRIBE_FULL_DOCUMENT_REQUIRED;
+    } else {
+        *out = with != 0 && without == 0 ? SCRIBE_FULL_DOCUMENT_WHEN_AVAILABLE : SCRIBE_FULL_DOCUMENT_LOOKUP;
+    }
     return SCRIBE_OK;
 }
 
@@ -42,7 +118,7 @@ scribe_error_t scribe_default_config(scribe_config *cfg) {
  */
 scribe_error_t scribe_write_config(const char *repo_path, const scribe_config *cfg) {
     char *path;
-    char buf[512];
+    char buf[1024];
     int n;
     scribe_error_t err;
 
@@ -58,14 +134,35 @@ scribe_error_t scribe_write_config(const char *repo_path, const scribe_config *c
                  "worker_threads = %d\n"
                  "event_queue_capacity = %zu\n"
                  "queue_stall_warn_seconds = %d\n"
+                 "tree_shard_threshold = %zu\n"
+                 "snapshot_memory_bytes = %zu\n"
+                 "memory_limit_bytes = %zu\n"
+                 "adaptive_compression_level = %d\n"
+                 "repack_compression_level = %d\n"
+                 "archive_compression_level = %d\n"
+                 "durability = %s\n"
+                 "durability_sync_seconds = %d\n"
+                 "ref_partitioning = %s\n"
+                 "partition_publish_ms = %d\n"
+                 "worker_cpu_affinity = %s\n"
                  "\n"
                  "adapter.name = mongodb\n"
                  "adapter.mongodb.excluded_databases = %s\n"
                  "adapter.mongodb.require_pre_post_images = %s\n"
-                 "adapter.mongodb.coalesce_window_ms = %d\n",
+                 "adapter.mongodb.enable_post_images = %s\n"
+                 "adapter.mongodb.coalesce_window_ms = %d\n"
+                 "adapter.mongodb.blob_format = %s\n",
                  cfg->scribe_format_version, cfg->compression_level, cfg->worker_threads, cfg->event_queue_capacity,
-                 cfg->queue_stall_warn_seconds, cfg->adapter_excluded_databases,
-                 cfg->adapter_require_pre_post_images ? "true" : "false", cfg->adapter_coalesce_window_ms);
+                 cfg->queue_stall_warn_seconds, cfg->tree_shard_threshold, cfg->snapshot_memory_bytes,
+                 cfg->memory_limit_bytes, cfg->adaptive_compression_level, cfg->repack_compression_level,
+                 cfg->archive_compression_level,
+                 scribe_durability_name(cfg->durability), cfg->durability_sync_seconds,
+                 scribe_ref_partitioning_name(cfg->ref_partitioning), cfg->partition_publish_ms,
+                 cfg->worker_cpu_affinity ? "true" : "false",
+                 cfg->adapter_excluded_databases,
+                 cfg->adapter_require_pre_post_images ? "true" : "false",
+                 cfg->adapter_enable_post_images ? "true" : "false", cfg->adapter_coalesce_window_ms,
+                 cfg->adapter_blob_format == SCRIBE_BLOB_FORMAT_BSON_SORTED ? "bson-sorted" : "json");
     if (n < 0 || (size_t)n >= sizeof(buf)) {
         free(path);
         return scribe_set_error(SCRIBE_ECONFIG, "config is too large");
@@ -243,6 +340,160 @@ scribe_error_t scribe_read_config(const char *repo_path, scribe_config *cfg) {
                 return err;
             }
             seen |= 1u << 10;
+        } else if (strcmp(key, "adapter.mongodb.enable_post_images") == 0) {
+            /*
+             * Optional: when true, mongo-watch turns on
+             * changeStreamPreAndPostImages for watched collections that lack it.
+             */
+            if (strcmp(value, "true") == 0) {
+                cfg->adapter_enable_post_images = true;
+            } else if (strcmp(value, "false") == 0) {
+                cfg->adapter_enable_post_images = false;
+            } else {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "invalid boolean '%s'", value);
+            }
+        } else if (strcmp(key, "adapter.mongodb.blob_format") == 0) {
+            /*
+             * Optional: repositories without the line keep canonical JSON
+             * blobs. Changing it only affects documents written afterwards.
+             */
+            if (strcmp(value, "json") == 0) {
+                cfg->adapter_blob_format = SCRIBE_BLOB_FORMAT_JSON;
+            } else if (strcmp(value, "bson-sorted") == 0) {
+                cfg->adapter_blob_format = SCRIBE_BLOB_FORMAT_BSON_SORTED;
+            } else {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "invalid blob format '%s'", value);
+            }
+        } else if (strcmp(key, "tree_shard_threshold") == 0) {
+            /*
+             * Optional: repositories initialized before tree sharding existed
+             * have no such line and keep the flat layout.
+             */
+            if ((err = parse_size(value, &cfg->tree_shard_threshold)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
+        } else if (strcmp(key, "memory_limit_bytes") == 0) {
+            /*
+             * Optional: 0 keeps memory unbounded, as before the governor.
+             */
+            if ((err = parse_size(value, &cfg->memory_limit_bytes)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
+        } else if (strcmp(key, "adaptive_compression_level") == 0) {
+            /*
+             * Optional: 0 keeps every write at compression_level. A nonzero
+             * level is used while writers are backlogged.
+             */
+            if ((err = parse_int(value, &cfg->adaptive_compression_level)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
+        } else if (strcmp(key, "repack_compression_level") == 0) {
+            if ((err = parse_int(value, &cfg->repack_compression_level)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
+        } else if (strcmp(key, "archive_compression_level") == 0) {
+            if ((err = parse_int(value, &cfg->archive_compression_level)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
+        } else if (strcmp(key, "durability") == 0) {
+            /*
+             * Optional: repositories without the line keep strict per-object
+             * fsync.
+             */
+            if (strcmp(value, "strict") == 0) {
+                cfg->durability = SCRIBE_DURABILITY_STRICT;
+            } else if (strcmp(value, "batch") == 0) {
+                cfg->durability = SCRIBE_DURABILITY_BATCH;
+            } else if (strcmp(value, "relaxed") == 0) {
+                cfg->durability = SCRIBE_DURABILITY_RELAXED;
+            } else {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "invalid durability mode '%s'", value);
+            }
+        } else if (strcmp(key, "durability_sync_seconds") == 0) {
+            if ((err = parse_int(value, &cfg->durability_sync_seconds)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
+            if (cfg->durability_sync_seconds == 0) {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "durability_sync_seconds must be positive");
+            }
+        } else if (strcmp(key, "ref_partitioning") == 0) {
+            /*
+             * Optional: repositories without the line commit every pipe batch
+             * directly on refs/heads/main.
+             */
+            if (strcmp(value, "none") == 0) {
+                cfg->ref_partitioning = SCRIBE_REF_PARTITIONING_NONE;
+            } else if (strcmp(value, "database") == 0) {
+                cfg->ref_partitioning = SCRIBE_REF_PARTITIONING_DATABASE;
+            } else {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "invalid ref_partitioning mode '%s'", value);
+            }
+        } else if (strcmp(key, "partition_publish_ms") == 0) {
+            if ((err = parse_int(value, &cfg->partition_publish_ms)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
+            if (cfg->partition_publish_ms == 0) {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "partition_publish_ms must be positive");
+            }
+        } else if (strcmp(key, "worker_cpu_affinity") == 0) {
+            /*
+             * Optional: pins worker pool threads to CPUs, for dedicated hosts.
+             */
+            if (strcmp(value, "true") == 0) {
+                cfg->worker_cpu_affinity = true;
+            } else if (strcmp(value, "false") == 0) {
+                cfg->worker_cpu_affinity = false;
+            } else {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "invalid boolean '%s'", value);
+            }
+        } else if (strncmp(key, "index.", 6) == 0) {
+            /*
+             * Optional and repeatable: each line names one field index. The
+             * first dot after the prefix ends the collection name, so the
+             * field may itself be a dotted path into nested objects.
+             */
+            const char *name = key + 6;
+            const char *dot = strchr(name, '.');
+
+            if (dot == NULL || dot == name || dot[1] == '\0' || strchr(name, '/') != NULL ||
+                strlen(name) >= SCRIBE_FIELD_INDEX_NAME_MAX) {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "invalid field index '%s'", key);
+            }
+            if (strcmp(value, "true") == 0) {
+                if (cfg->field_index_count == SCRIBE_MAX_FIELD_INDEXES) {
+                    free(bytes);
+                    return scribe_set_error(SCRIBE_ECONFIG, "at most %u field indexes are supported",
+                                            SCRIBE_MAX_FIELD_INDEXES);
+                }
+                strcpy(cfg->field_indexes[cfg->field_index_count++], name);
+            } else if (strcmp(value, "false") != 0) {
+                free(bytes);
+                return scribe_set_error(SCRIBE_ECONFIG, "invalid boolean '%s'", value);
+            }
+        } else if (strcmp(key, "snapshot_memory_bytes") == 0) {
+            /*
+             * Optional: bounds the in-memory part of bootstrap and import tree
+             * assembly; larger snapshots spill sorted runs to `.scribe/tmp/`.
+             */
+            if ((err = parse_size(value, &cfg->snapshot_memory_bytes)) != SCRIBE_OK) {
+                free(bytes);
+                return err;
+            }
         } else {
             /*
              * Unknown keys are configuration errors rather than warnings. This
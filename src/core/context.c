@@ -13,6 +13,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 /*
  * Creates a new repository skeleton at path. The function writes HEAD, config,
@@ -105,15 +106,39 @@ scribe_error_t scribe_open(const char *path, int writable, scribe_ctx **out) {
     ctx->repo_path = strdup(path);
     ctx->writable = writable;
     ctx->lock_fd = -1;
+    atomic_init(&ctx->fast_objects_fd, -1);
     if (ctx->repo_path == NULL) {
         free(ctx);
         return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate repository path");
     }
+    err = scribe_mem_budget_init(&ctx->mem, 0, 0);
+    if (err != SCRIBE_OK) {
+        free(ctx->repo_path);
+        free(ctx);
+        return err;
+    }
     err = scribe_read_config(path, &ctx->config);
     if (err != SCRIBE_OK) {
         scribe_close(ctx);
         return err;
     }
+    atomic_init(&ctx->compression_pressure, 0u);
+    err = scribe_object_backend_loose_new(path, &ctx->objects);
+    if (err == SCRIBE_OK) {
+        err = scribe_leaf_cache_new(&ctx->leaf_counts);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_intern_table_new(&ctx->names);
+    }
+    if (err != SCRIBE_OK) {
+        scribe_close(ctx);
+        return err;
+    }
+    scribe_resources_probe("", &ctx->resources);
+    /* Without an explicit limit, keep in-flight data to half the cgroup's memory. */
+    ctx->mem.limit = ctx->config.memory_limit_bytes != 0 ? ctx->config.memory_limit_bytes
+                                                         : (size_t)(ctx->resources.memory_max / 2u);
+    ctx->mem.stall_warn_seconds = ctx->config.queue_stall_warn_seconds;
     if (writable) {
         err = scribe_lock_repo(ctx);
         if (err != SCRIBE_OK) {
@@ -122,26 +147,65 @@ scribe_error_t scribe_open(const char *path, int writable, scribe_ctx **out) {
         }
     }
     err = scribe_log_open(ctx);
+    if (err == SCRIBE_OK && writable) {
+        err = scribe_durability_open(ctx);
+    }
     if (err != SCRIBE_OK) {
         scribe_close(ctx);
         return err;
     }
+    scribe_resources_log(ctx);
     scribe_log_msg(ctx, SCRIBE_LOG_DEBUG, "repo", "opened store");
     *out = ctx;
     return SCRIBE_OK;
 }
 
 /*
- * Releases every resource owned by a context: log file, lock, repository path,
- * and the context allocation itself. It accepts NULL so cleanup paths can call
- * it after partial-open failures.
+ * Releases every resource owned by a context: the durability syncer (after its
+ * final sync), object engine, fast-objects list, leaf-count cache, interned
+ * names, log file, lock, memory budget, repository path, and the context
+ * allocation itself. It accepts NULL so cleanup paths can call it after
+ * partial-open failures.
  */
 void scribe_close(scribe_ctx *ctx) {
     if (ctx == NULL) {
         return;
     }
+    scribe_field_index_flush(ctx);
+    scribe_durability_close(ctx);
+    scribe_object_set_backend(ctx, NULL);
+    scribe_object_fast_list_close(ctx);
+    scribe_leaf_cache_free(ctx->leaf_counts);
+    scribe_intern_table_free(ctx->names);
     scribe_log_close(ctx);
     scribe_unlock_repo(ctx);
+    scribe_mem_budget_destroy(&ctx->mem);
     free(ctx->repo_path);
     free(ctx);
 }
+
+/*
+ * Chooses the worker count for parallel work. An explicit worker_threads value
+ * wins; otherwise use the CPUs the process may actually run on, after affinity,
+ * cpuset, and CPU quota limits (see resources.c), with a minimum of one worker.
+ */
+unsigned scribe_worker_count(const scribe_ctx *ctx) {
+    if (ctx->config.worker_threads > 0) {
+        return (unsigned)ctx->config.worker_threads;
+    }
+    return ctx->resources.cpus < 1 ? 1u : ctx->resources.cpus;
+}
+
+/*
+ * Writes the context memory budget's counters to the operational log. Bounded
+ * budgets log at INFO so operators can size `memory_limit_bytes`; unbounded
+ * ones only at DEBUG.
+ */
+void scribe_log_memory(scribe_ctx *ctx, const char *phase) {
+    scribe_mem_stats stats;
+
+    scribe_mem_budget_stats(&ctx->mem, &stats);
+    scribe_log_msg(ctx, stats.limit != 0 ? SCRIBE_LOG_INFO : SCRIBE_LOG_DEBUG, "memory",
+                   "%s: reserved %zu peak %zu limit %zu waits %llu", phase, stats.reserved, stats.peak, stats.limit,
+                   (unsigned long long)stats.waits);
+}
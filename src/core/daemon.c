@@ -0,0 +1,816 @@
+/*
+ * Commit daemon: many pipe clients, one writer, group commit.
+ *
+ * `scribe daemon --socket <path>` holds the store's writer lock and accepts
+ * pipe protocol v1 clients on a Unix socket. Each connection is a session with
+ * its own reader thread, which parses frames exactly as `commit-batch` does and
+ * queues them for one commit scheduler. The scheduler takes every batch queued
+ * while the previous group was being written and commits them together with
+ * scribe_commit_group(): one commit per batch, one barrier, one ref update.
+ * Batches are applied one at a time, so a batch that fails is answered with
+ * ERR on its own session and the rest of its group still commits.
+ * Sessions share the context, so the object cache, intern table, leaf-count
+ * cache, and compression state are shared too.
+ *
+ * Each session gets the same responses as a `commit-batch` process: OK with
+ * its batch's own commit, or ERR and the end of the session. Batches from one
+ * session commit in order; batches from different sessions interleave in queue
+ * order. A session's position in its stream is the count of its OK lines, as
+ * with the pipe; the daemon keeps no per-client state across connections.
+ *
+ * The daemon can also host adapter sessions: each `--mongo <name>=<uri>` runs
+ * a MongoDB watcher on its own thread that commits through the same scheduler
+ * instead of to main directly, so its batches share groups with every other
+ * session. A hosted session keeps its resume state under its name, and its
+ * bootstrap snapshot replaces only the databases it holds. The daemon owns
+ * SIGTERM/SIGINT; hosted sessions poll its shutdown flag, drain their open
+ * batch, and return. A hosted session that fails stops the whole daemon, as
+ * a failing `mongo-watch` process would, so no watcher falls behind silently.
+ *
+ * `commit-batch --socket <path>` is the matching client: it streams stdin to
+ * the daemon and relays the responses.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/log.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Characters a hosted session name may use; the name is part of a file name. */
+#define SESSION_NAME_CHARS "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-"
+
+/*
+ * One queued commit. A request with `root` set is a hosted session's bootstrap
+ * snapshot, merged into main's root; `batch` is then only its metadata.
+ */
+typedef struct daemon_request {
+    const scribe_change_batch *batch;
+    const uint8_t *root;
+    const char *scope;
+    uint8_t commit[SCRIBE_HASH_SIZE];
+    scribe_error_t err;
+    char detail[512];
+    int done;
+    struct daemon_request *next;
+} daemon_request;
+
+typedef struct daemon_state daemon_state;
+
+typedef struct daemon_session {
+    daemon_state *d;
+    int fd;
+    pthread_t thread;
+    int finished;
+    struct daemon_session *next;
+} daemon_session;
+
+typedef struct {
+    daemon_state *d;
+    const scribe_daemon_source *source;
+    scribe_session_sink sink;
+    pthread_t thread;
+    int started;
+    int finished;
+    scribe_error_t err;
+    char detail[512];
+} daemon_hosted;
+
+struct daemon_state {
+    scribe_ctx *ctx;
+    pthread_mutex_t mu;
+    pthread_cond_t queued;
+    pthread_cond_t done;
+    daemon_request *head;
+    daemon_request *tail;
+    size_t queue_len;
+    int stop;
+    size_t batches;
+    size_t groups;
+    size_t largest_group;
+    size_t session_count;
+    daemon_session *sessions;
+    daemon_hosted *hosted;
+    size_t hosted_count;
+    atomic_int stopping;
+};
+
+static volatile sig_atomic_t g_daemon_shutdown = 0;
+
+/*
+ * Async-signal-safe handler that only flips the shutdown flag. The accept
+ * loop polls with a timeout and notices it within one interval.
+ */
+static void daemon_signal_handler(int signo) {
+    (void)signo;
+    g_daemon_shutdown = 1;
+}
+
+/*
+ * Installs SIGTERM/SIGINT handlers and ignores SIGPIPE, so a client that
+ * disconnects mid-response ends its session instead of the daemon.
+ */
+static scribe_error_t install_signal_handlers(void) {
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = daemon_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGTERM, &sa, NULL) != 0 || sigaction(SIGINT, &sa, NULL) != 0) {
+        return scribe_set_error(SCRIBE_ERR, "failed to install daemon signal handlers");
+    }
+    sa.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &sa, NULL) != 0) {
+        return scribe_set_error(SCRIBE_ERR, "failed to ignore SIGPIPE");
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Publishes a hosted session's bootstrap snapshot: main's root with the
+ * snapshot's databases merged in, wrapped in one commit.
+ */
+static scribe_error_t commit_snapshot(scribe_ctx *ctx, const daemon_request *req,
+                                      uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    uint8_t root[SCRIBE_HASH_SIZE];
+    scribe_error_t err = scribe_partition_merge_root(ctx, req->root, req->scope, root);
+
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_root_internal(ctx, root, req->batch, out_commit);
+    }
+    return err;
+}
+
+/*
+ * Commit scheduler: drains the request queue in groups until stopped with an
+ * empty queue. A group is whatever queued while the previous group committed,
+ * capped at event_queue_capacity, so a lone client pays no added latency and a
+ * busy daemon shares one barrier across many batches. A bootstrap snapshot
+ * ends the group before it and commits on its own.
+ */
+static void *scheduler_main(void *arg) {
+    daemon_state *d = (daemon_state *)arg;
+    size_t cap = d->ctx->config.event_queue_capacity == 0 ? 1u : d->ctx->config.event_queue_capacity;
+    const scribe_change_batch **batches;
+    scribe_group_result *results;
+    daemon_request **group;
+
+    batches = (const scribe_change_batch **)malloc(cap * sizeof(*batches));
+    results = (scribe_group_result *)malloc(cap * sizeof(*results));
+    group = (daemon_request **)malloc(cap * sizeof(*group));
+    pthread_mutex_lock(&d->mu);
+    for (;;) {
+        size_t n = 0;
+        size_t i;
+        scribe_error_t err;
+
+        while (d->head == NULL && !d->stop) {
+            pthread_cond_wait(&d->queued, &d->mu);
+        }
+        if (d->head == NULL) {
+            break;
+        }
+        while (d->head != NULL && n < cap && (n == 0 || d->head->root == NULL)) {
+            group[n] = d->head;
+            d->head = d->head->next;
+            d->queue_len--;
+            if (group[n++]->root != NULL) {
+                break;
+            }
+        }
+        if (d->head == NULL) {
+            d->tail = NULL;
+        }
+        pthread_mutex_unlock(&d->mu);
+        if (batches == NULL || results == NULL || group == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate commit group");
+        } else {
+            for (i = 0; i < n; i++) {
+                batches[i] = group[i]->batch;
+                results[i].err = SCRIBE_OK;
+            }
+            if (group[0]->root != NULL) {
+                err = commit_snapshot(d->ctx, group[0], results[0].commit);
+            } else {
+                err = scribe_commit_group(d->ctx, batches, n, results);
+            }
+        }
+        pthread_mutex_lock(&d->mu);
+        for (i = 0; i < n; i++) {
+            /* Only a group that never started fails every batch alike. */
+            if (results == NULL || (err != SCRIBE_OK && results[i].err == SCRIBE_OK)) {
+                group[i]->err = err;
+                snprintf(group[i]->detail, sizeof(group[i]->detail), "%s", scribe_last_error_detail());
+            } else if (results[i].err != SCRIBE_OK) {
+                group[i]->err = results[i].err;
+                memcpy(group[i]->detail, results[i].detail, sizeof(group[i]->detail));
+            } else {
+                group[i]->err = SCRIBE_OK;
+                scribe_hash_copy(group[i]->commit, results[i].commit);
+            }
+            group[i]->done = 1;
+        }
+        d->batches += n;
+        d->groups++;
+        if (n > d->largest_group) {
+            d->largest_group = n;
+        }
+        pthread_cond_broadcast(&d->done);
+    }
+    pthread_mutex_unlock(&d->mu);
+    free(batches);
+    free(results);
+    free(group);
+    return NULL;
+}
+
+/*
+ * Queues one request and waits for its group to commit. Sessions wait for
+ * queue space when event_queue_capacity requests are already queued.
+ */
+static scribe_error_t submit_request(daemon_state *d, daemon_request *req, uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    size_t cap = d->ctx->config.event_queue_capacity == 0 ? 1u : d->ctx->config.event_queue_capacity;
+
+    pthread_mutex_lock(&d->mu);
+    while (d->queue_len >= cap) {
+        pthread_cond_wait(&d->done, &d->mu);
+    }
+    if (d->tail == NULL) {
+        d->head = req;
+    } else {
+        d->tail->next = req;
+    }
+    d->tail = req;
+    d->queue_len++;
+    pthread_cond_signal(&d->queued);
+    while (!req->done) {
+        pthread_cond_wait(&d->done, &d->mu);
+    }
+    pthread_mutex_unlock(&d->mu);
+    if (req->err != SCRIBE_OK) {
+        return scribe_set_error(req->err, "%s", req->detail);
+    }
+    scribe_hash_copy(out_commit, req->commit);
+    return SCRIBE_OK;
+}
+
+/*
+ * Queues one validated batch and waits for its own commit.
+ */
+static scribe_error_t submit_and_wait(daemon_state *d, const scribe_change_batch *batch,
+                                      uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    daemon_request req;
+
+    memset(&req, 0, sizeof(req));
+    req.batch = batch;
+    return submit_request(d, &req, out_commit);
+}
+
+/*
+ * Session thread: the `commit-batch` loop over one client connection. The
+ * batch's payload bytes stay reserved against the memory budget until its
+ * commit finishes, as in the pipe. The streams use duplicates of the socket;
+ * the reaper keeps the original open so it can always shut the session down.
+ */
+static void *session_main(void *arg) {
+    daemon_session *s = (daemon_session *)arg;
+    scribe_ctx *ctx = s->d->ctx;
+    int in_fd = dup(s->fd);
+    int out_fd = dup(s->fd);
+    FILE *in = in_fd < 0 ? NULL : fdopen(in_fd, "r");
+    FILE *out = out_fd < 0 ? NULL : fdopen(out_fd, "w");
+    char *line = NULL;
+    size_t cap = 0;
+
+    if (in == NULL || out == NULL) {
+        scribe_log_msg(ctx, SCRIBE_LOG_ERROR, "daemon", "failed to open session streams");
+    }
+    while (in != NULL && out != NULL) {
+        scribe_change_batch batch;
+        uint8_t commit[SCRIBE_HASH_SIZE];
+        char hex[SCRIBE_HEX_HASH_SIZE + 1];
+        size_t reserved = 0;
+        scribe_error_t err = scribe_pipe_next_batch(ctx, in, &line, &cap, &batch);
+
+        if (err == SCRIBE_ENOT_FOUND) {
+            break;
+        }
+        if (err == SCRIBE_OK) {
+            err = scribe_commit_validate_batch(&batch);
+            if (err == SCRIBE_OK) {
+                reserved = scribe_pipe_batch_bytes(&batch);
+                err = scribe_mem_reserve(&ctx->mem, reserved);
+            }
+            if (err == SCRIBE_OK) {
+                err = submit_and_wait(s->d, &batch, commit);
+                scribe_mem_release(&ctx->mem, reserved);
+            }
+            scribe_pipe_free_batch(&batch);
+        }
+        if (err != SCRIBE_OK) {
+            scribe_pipe_write_error(out, err);
+            break;
+        }
+        scribe_hash_to_hex(commit, hex);
+        fprintf(out, "OK\t%s\n", hex);
+        if (fflush(out) != 0) {
+            break;
+        }
+    }
+    free(line);
+    if (out != NULL) {
+        fclose(out);
+    } else if (out_fd >= 0) {
+        close(out_fd);
+    }
+    if (in != NULL) {
+        fclose(in);
+    } else if (in_fd >= 0) {
+        close(in_fd);
+    }
+    shutdown(s->fd, SHUT_RDWR);
+    pthread_mutex_lock(&s->d->mu);
+    s->finished = 1;
+    pthread_mutex_unlock(&s->d->mu);
+    return NULL;
+}
+
+/*
+ * Joins and frees sessions whose clients have disconnected. With `all`, first
+ * ends every session's input so a blocked read returns, then joins them all;
+ * batches already queued still commit and get their responses.
+ */
+static void reap_sessions(daemon_state *d, int all) {
+    daemon_session **link = &d->sessions;
+
+    if (all) {
+        daemon_session *s;
+
+        pthread_mutex_lock(&d->mu);
+        for (s = d->sessions; s != NULL; s = s->next) {
+            if (!s->finished) {
+                shutdown(s->fd, SHUT_RD);
+            }
+        }
+        pthread_mutex_unlock(&d->mu);
+    }
+    while (*link != NULL) {
+        daemon_session *s = *link;
+        int finished;
+
+        pthread_mutex_lock(&d->mu);
+        finished = s->finished;
+        pthread_mutex_unlock(&d->mu);
+        if (all || finished) {
+            pthread_join(s->thread, NULL);
+            close(s->fd);
+            *link = s->next;
+            free(s);
+        } else {
+            link = &s->next;
+        }
+    }
+}
+
+/*
+ * Reports whether hosted sessions should stop: on the daemon's shutdown
+ * signal, once any hosted session has failed, or when the daemon is exiting.
+ */
+static int hosted_stopping(const scribe_session_sink *sink) {
+    const daemon_hosted *h = (const daemon_hosted *)sink->user;
+
+    return g_daemon_shutdown || atomic_load(&h->d->stopping);
+}
+
+/*
+ * Commits a hosted session's batch through the scheduler, in a group with
+ * whatever else is queued.
+ */
+static scribe_error_t hosted_commit(scribe_session_sink *sink, const scribe_change_batch *batch,
+                                    uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    daemon_hosted *h = (daemon_hosted *)sink->user;
+
+    return submit_and_wait(h->d, batch, out_commit);
+}
+
+/*
+ * Queues a hosted session's bootstrap snapshot, which the scheduler merges
+ * into main's root on its own.
+ */
+static scribe_error_t hosted_commit_root(scribe_session_sink *sink, const uint8_t root[SCRIBE_HASH_SIZE],
+                                         const char *scope, const scribe_change_batch *metadata,
+                                         uint8_t out_commit[SCRIBE_HASH_SIZE]) {
+    daemon_hosted *h = (daemon_hosted *)sink->user;
+    daemon_request req;
+
+    memset(&req, 0, sizeof(req));
+    req.batch = metadata;
+    req.root = root;
+    req.scope = scope;
+    return submit_request(h->d, &req, out_commit);
+}
+
+/*
+ * Hosted session thread: runs the adapter until it stops or fails. A failure
+ * is kept for the daemon's exit status and stops every other session.
+ */
+static void *hosted_main(void *arg) {
+    daemon_hosted *h = (daemon_hosted *)arg;
+    scribe_error_t err = h->source->run(h->d->ctx, h->source->uri, &h->sink);
+
+    if (err != SCRIBE_OK) {
+        snprintf(h->detail, sizeof(h->detail), "%s", scribe_last_error_detail());
+        scribe_log_msg(h->d->ctx, SCRIBE_LOG_ERROR, "daemon", "session '%s' failed: %s: %s", h->source->name,
+                       scribe_error_symbol(err), h->detail);
+        atomic_store(&h->d->stopping, 1);
+    }
+    pthread_mutex_lock(&h->d->mu);
+    h->err = err;
+    h->finished = 1;
+    pthread_mutex_unlock(&h->d->mu);
+    return NULL;
+}
+
+/*
+ * Checks hosted session names before anything starts. A name keys the
+ * session's adapter-state file, so it must be a plain, unique file name part.
+ */
+static scribe_error_t check_sources(const scribe_daemon_source *sources, size_t count) {
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < count; i++) {
+        const char *name = sources[i].name;
+
+        if (name == NULL || name[0] == '\0' || name[0] == '.' || strspn(name, SESSION_NAME_CHARS) != strlen(name)) {
+            return scribe_set_error(SCRIBE_EINVAL, "invalid session name '%s'", name == NULL ? "" : name);
+        }
+        if (sources[i].uri == NULL || sources[i].uri[0] == '\0' || sources[i].run == NULL) {
+            return scribe_set_error(SCRIBE_EINVAL, "session '%s' has no source", name);
+        }
+        for (j = 0; j < i; j++) {
+            if (strcmp(sources[j].name, name) == 0) {
+                return scribe_set_error(SCRIBE_EINVAL, "duplicate session name '%s'", name);
+            }
+        }
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Counts hosted sessions that are still running.
+ */
+static size_t hosted_running(daemon_state *d) {
+    size_t running = 0;
+    size_t i;
+
+    pthread_mutex_lock(&d->mu);
+    for (i = 0; i < d->hosted_count; i++) {
+        running += d->hosted[i].started && !d->hosted[i].finished;
+    }
+    pthread_mutex_unlock(&d->mu);
+    return running;
+}
+
+/*
+ * Joins every hosted session, which drains on the shutdown flag, and returns
+ * the first session failure.
+ */
+static scribe_error_t join_hosted(daemon_state *d) {
+    scribe_error_t err = SCRIBE_OK;
+    size_t i;
+
+    for (i = 0; i < d->hosted_count; i++) {
+        daemon_hosted *h = &d->hosted[i];
+
+        if (!h->started) {
+            continue;
+        }
+        pthread_join(h->thread, NULL);
+        if (err == SCRIBE_OK && h->err != SCRIBE_OK) {
+            err = scribe_set_error(h->err, "session '%s': %s", h->source->name, h->detail);
+        }
+    }
+    return err;
+}
+
+/*
+ * Binds the listening socket. A stale socket left by a crashed daemon is
+ * replaced; the writer lock already proves no daemon serves this store, but a
+ * path that is not a socket is never removed.
+ */
+static scribe_error_t listen_socket(const char *path, int *out_fd) {
+    struct sockaddr_un addr;
+    struct stat st;
+    int fd;
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        return scribe_set_error(SCRIBE_EINVAL, "socket path '%s' is too long", path);
+    }
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            return scribe_set_error(SCRIBE_EEXISTS, "'%s' exists and is not a socket", path);
+        }
+        if (unlink(path) != 0) {
+            return scribe_set_error(SCRIBE_EIO, "failed to remove stale socket '%s'", path);
+        }
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, strlen(path) + 1u);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return scribe_set_error(SCRIBE_EIO, "failed to create socket: %s", strerror(errno));
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+        int saved = errno;
+
+        close(fd);
+        return scribe_set_error(SCRIBE_EIO, "failed to listen on '%s': %s", path, strerror(saved));
+    }
+    *out_fd = fd;
+    return SCRIBE_OK;
+}
+
+/*
+ * Implements `scribe daemon`: serves pipe clients on `socket_path` and runs
+ * each hosted session until SIGTERM or SIGINT, then stops accepting, lets
+ * every session finish the batch it is committing, and exits after the last
+ * group commit. Without a socket the daemon also exits once every hosted
+ * session has returned. A failed hosted session stops the daemon the same way
+ * and is its error.
+ */
+scribe_error_t scribe_daemon_run(scribe_ctx *ctx, const char *socket_path, const scribe_daemon_source *sources,
+                                 size_t source_count) {
+    daemon_state d;
+    pthread_t scheduler;
+    int listen_fd = -1;
+    size_t i;
+    scribe_error_t err;
+
+    if (ctx == NULL || !ctx->writable) {
+        return scribe_set_error(SCRIBE_EINVAL, "writable context required");
+    }
+    if (socket_path == NULL && source_count == 0) {
+        return scribe_set_error(SCRIBE_EINVAL, "daemon needs a socket or a hosted session");
+    }
+    err = check_sources(sources, source_count);
+    if (err == SCRIBE_OK) {
+        err = scribe_partition_fold(ctx);
+    }
+    if (err == SCRIBE_OK) {
+        g_daemon_shutdown = 0;
+        err = install_signal_handlers();
+    }
+    if (err == SCRIBE_OK && socket_path != NULL) {
+        err = listen_socket(socket_path, &listen_fd);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    memset(&d, 0, sizeof(d));
+    d.ctx = ctx;
+    atomic_init(&d.stopping, 0);
+    d.hosted = (daemon_hosted *)calloc(source_count == 0 ? 1u : source_count, sizeof(*d.hosted));
+    if (d.hosted == NULL || pthread_mutex_init(&d.mu, NULL) != 0 || pthread_cond_init(&d.queued, NULL) != 0 ||
+        pthread_cond_init(&d.done, NULL) != 0 || pthread_create(&scheduler, NULL, scheduler_main, &d) != 0) {
+        free(d.hosted);
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(socket_path);
+        }
+        return scribe_set_error(SCRIBE_ERR, "failed to start commit scheduler");
+    }
+    d.hosted_count = source_count;
+    for (i = 0; i < source_count; i++) {
+        daemon_hosted *h = &d.hosted[i];
+
+        h->d = &d;
+        h->source = &sources[i];
+        h->sink.key = sources[i].name;
+        h->sink.stopping = hosted_stopping;
+        h->sink.commit = hosted_commit;
+        h->sink.commit_root = hosted_commit_root;
+        h->sink.user = h;
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "daemon", "hosting session '%s'", sources[i].name);
+        if (pthread_create(&h->thread, NULL, hosted_main, h) != 0) {
+            err = scribe_set_error(SCRIBE_ERR, "failed to start session '%s'", sources[i].name);
+            atomic_store(&d.stopping, 1);
+            break;
+        }
+        h->started = 1;
+        d.session_count++;
+    }
+    if (listen_fd >= 0) {
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "daemon", "listening on %s", socket_path);
+        printf("daemon: listening on %s\n", socket_path);
+        fflush(stdout);
+    }
+    while (!g_daemon_shutdown && !atomic_load(&d.stopping) && (listen_fd >= 0 || hosted_running(&d) != 0)) {
+        struct pollfd pfd = {listen_fd, POLLIN, 0};
+        daemon_session *s;
+        int fd;
+
+        /* Without a socket, poll only sleeps between checks. */
+        if (poll(&pfd, 1, 200) <= 0) {
+            reap_sessions(&d, 0);
+            continue;
+        }
+        fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        s = (daemon_session *)calloc(1, sizeof(*s));
+        if (s == NULL) {
+            close(fd);
+            continue;
+        }
+        s->d = &d;
+        s->fd = fd;
+        if (pthread_create(&s->thread, NULL, session_main, s) != 0) {
+            scribe_log_msg(ctx, SCRIBE_LOG_WARN, "daemon", "failed to start session thread");
+            close(fd);
+            free(s);
+            continue;
+        }
+        s->next = d.sessions;
+        d.sessions = s;
+        d.session_count++;
+    }
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(socket_path);
+    }
+    atomic_store(&d.stopping, 1);
+    reap_sessions(&d, 1);
+    {
+        scribe_error_t hosted_err = join_hosted(&d);
+
+        if (err == SCRIBE_OK) {
+            err = hosted_err;
+        }
+    }
+    pthread_mutex_lock(&d.mu);
+    d.stop = 1;
+    pthread_cond_signal(&d.queued);
+    pthread_mutex_unlock(&d.mu);
+    pthread_join(scheduler, NULL);
+    scribe_log_msg(ctx, SCRIBE_LOG_INFO, "daemon",
+                   "stopped: %zu sessions, %zu batches in %zu group commits, largest group %zu", d.session_count,
+                   d.batches, d.groups, d.largest_group);
+    printf("daemon: %zu sessions, %zu batches, %zu group commits\n", d.session_count, d.batches, d.groups);
+    pthread_cond_destroy(&d.done);
+    pthread_cond_destroy(&d.queued);
+    pthread_mutex_destroy(&d.mu);
+    free(d.hosted);
+    return err;
+}
+
+typedef struct {
+    FILE *in;
+    int fd;
+    atomic_int finished;
+} client_sender;
+
+/*
+ * Client sender thread: copies the input stream to the socket, then closes
+ * the write side so the daemon sees the end of the stream.
+ */
+static void *client_send_main(void *arg) {
+    client_sender *cs = (client_sender *)arg;
+    char buf[65536];
+    size_t n;
+
+    while ((n = fread(buf, 1, sizeof(buf), cs->in)) != 0) {
+        size_t off = 0;
+
+        while (off < n) {
+            ssize_t w = send(cs->fd, buf + off, n - off, MSG_NOSIGNAL);
+
+            if (w < 0 && errno == EINTR) {
+                continue;
+            }
+            if (w <= 0) {
+                shutdown(cs->fd, SHUT_WR);
+                atomic_store(&cs->finished, 1);
+                return NULL;
+            }
+            off += (size_t)w;
+        }
+    }
+    shutdown(cs->fd, SHUT_WR);
+    atomic_store(&cs->finished, 1);
+    return NULL;
+}
+
+/*
+ * Maps an ERR symbol from the daemon back to its error code.
+ */
+static scribe_error_t error_from_symbol(const char *symbol) {
+    int e;
+
+    for (e = SCRIBE_ERR; e <= SCRIBE_ESHUTDOWN; e++) {
+        if (strcmp(scribe_error_symbol((scribe_error_t)e), symbol) == 0) {
+            return (scribe_error_t)e;
+        }
+    }
+    return SCRIBE_ERR;
+}
+
+/*
+ * Implements `commit-batch --socket`: streams `in` to a daemon and copies its
+ * responses to `out` byte for byte. Returns the error of an ERR response, so
+ * the exit status matches a local `commit-batch`.
+ */
+scribe_error_t scribe_daemon_client(const char *socket_path, FILE *in, FILE *out) {
+    struct sockaddr_un addr;
+    client_sender *cs;
+    pthread_t sender;
+    FILE *replies;
+    char *line = NULL;
+    size_t cap = 0;
+    int fd;
+    scribe_error_t err = SCRIBE_OK;
+
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return scribe_set_error(SCRIBE_EINVAL, "socket path '%s' is too long", socket_path);
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, socket_path, strlen(socket_path) + 1u);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        int saved = errno;
+
+        if (fd >= 0) {
+            close(fd);
+        }
+        return scribe_set_error(SCRIBE_EIO, "failed to connect to daemon at '%s': %s", socket_path,
+                                strerror(saved));
+    }
+    cs = (client_sender *)calloc(1, sizeof(*cs));
+    if (cs == NULL) {
+        close(fd);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate client sender");
+    }
+    cs->in = in;
+    cs->fd = fd;
+    atomic_init(&cs->finished, 0);
+    if (pthread_create(&sender, NULL, client_send_main, cs) != 0) {
+        close(fd);
+        free(cs);
+        return scribe_set_error(SCRIBE_ERR, "failed to start client sender");
+    }
+    replies = fdopen(dup(fd), "r");
+    while (replies != NULL && getline(&line, &cap, replies) >= 0) {
+        fputs(line, out);
+        if (strncmp(line, "ERR\t", 4) == 0) {
+            char *sym = line + 4;
+            char *tab = strchr(sym, '\t');
+            size_t len = tab == NULL ? 0 : (size_t)strtoull(tab + 1, NULL, 10);
+            char *detail = (char *)malloc(len + 2u);
+            size_t got = detail == NULL ? 0 : fread(detail, 1, len + 1u, replies);
+
+            fwrite(detail == NULL ? "" : detail, 1, got, out);
+            if (tab != NULL) {
+                *tab = '\0';
+            }
+            if (detail != NULL && got >= len) {
+                detail[len] = '\0';
+            }
+            err = scribe_set_error(error_from_symbol(sym), "%s", detail != NULL && got >= len ? detail : "");
+            free(detail);
+        }
+        fflush(out);
+    }
+    free(line);
+    if (replies != NULL) {
+        fclose(replies);
+    }
+    /*
+     * The daemon ends a session after an ERR or at shutdown, possibly while
+     * the sender is still blocked reading input. Such a sender is left to the
+     * process exit instead of being joined.
+     */
+    shutdown(fd, SHUT_RDWR);
+    if (atomic_load(&cs->finished)) {
+        pthread_join(sender, NULL);
+        close(fd);
+        free(cs);
+    } else {
+        pthread_detach(sender);
+    }
+    return err;
+}
@@ -4,7 +4,8 @@
  * This file implements the user-facing history commands that compare commit
  * root trees: log path filtering, show metadata, cat-object pretty output, and
  * diff. The diff algorithm treats blobs as opaque bytes and reports changes at
- * Scribe path level.
+ * Scribe path level; `diff --content` and `log -p` then hand each modified
+ * document pair to the JSON diff in jsondiff.c.
  */
 #include "core/internal.h"
 
@@ -84,26 +85,42 @@ scribe_error_t scribe_resolve_commit(scribe_ctx *ctx, const char *rev, uint8_t o
     return scribe_hash_from_hex(rev, out);
 }
 
-typedef scribe_error_t (*diff_visit_fn)(char status, const char *path, void *user);
-
 static scribe_error_t diff_roots(scribe_ctx *ctx, const uint8_t *old_root, const uint8_t new_root[SCRIBE_HASH_SIZE],
-                                 diff_visit_fn visit, void *user);
-static scribe_error_t print_diff_visit(char status, const char *path, void *user);
+                                 scribe_diff_visit_fn visit, void *user);
+static scribe_error_t print_diff_visit(char status, const char *path, const uint8_t *old_blob,
+                                       const uint8_t *new_blob, void *user);
+static scribe_error_t print_content_visit(char status, const char *path, const uint8_t *old_blob,
+                                          const uint8_t *new_blob, void *user);
+
+typedef struct {
+    scribe_ctx *ctx;
+    const char *indent;
+} content_diff_state;
 
 typedef struct {
-    size_t count;
+    uint64_t added;
+    uint64_t modified;
+    uint64_t deleted;
 } diff_count_state;
 
 /*
- * Diff visitor that only increments a counter. log --oneline --paths uses it to
- * append `[N changed]` without printing every changed path.
+ * Diff visitor that only counts changes by status. log --oneline --paths and
+ * the per-commit change summaries use it instead of printing every path.
  */
-static scribe_error_t count_diff_visit(char status, const char *path, void *user) {
+static scribe_error_t count_diff_visit(char status, const char *path, const uint8_t *old_blob,
+                                       const uint8_t *new_blob, void *user) {
     diff_count_state *state = (diff_count_state *)user;
 
-    (void)status;
     (void)path;
-    state->count++;
+    (void)old_blob;
+    (void)new_blob;
+    if (status == 'A') {
+        state->added++;
+    } else if (status == 'D') {
+        state->deleted++;
+    } else {
+        state->modified++;
+    }
     return SCRIBE_OK;
 }
 
@@ -142,29 +159,47 @@ static const char *path_change_annotation(const scribe_path_resolution *parent,
 }
 
 /*
- * Counts leaf-level changed paths between two root trees. old_root may be NULL
- * for an initial commit, in which case every leaf in new_root is counted as added.
+ * Sums a commit summary into added/modified/deleted totals.
  */
-static scribe_error_t count_changed_paths(scribe_ctx *ctx, const uint8_t *old_root,
-                                          const uint8_t new_root[SCRIBE_HASH_SIZE], size_t *out) {
-    diff_count_state state;
-    scribe_error_t err;
+static void stats_totals(const scribe_commit_stats *stats, uint64_t out[3]) {
+    size_t i;
 
-    state.count = 0;
-    err = diff_roots(ctx, old_root, new_root, count_diff_visit, &state);
-    if (err != SCRIBE_OK) {
-        return err;
+    out[0] = out[1] = out[2] = 0;
+    for (i = 0; i < stats->count; i++) {
+        out[0] += stats->prefixes[i].added;
+        out[1] += stats->prefixes[i].modified;
+        out[2] += stats->prefixes[i].deleted;
     }
-    *out = state.count;
-    return SCRIBE_OK;
 }
 
 /*
- * Implements `scribe log`. It walks the parent chain from HEAD, optionally
- * filters commits by one path, optionally prints changed paths, and applies -n
- * to the number of commits emitted rather than the number scanned.
+ * Prints one `+added ~modified -deleted  db/collection` line per changed
+ * prefix, then the totals. Counts come first so prefix names need no quoting.
+ */
+static void print_commit_stats(const scribe_commit_stats *stats, const char *indent) {
+    uint64_t totals[3];
+    size_t i;
+
+    for (i = 0; i < stats->count; i++) {
+        const scribe_prefix_stat *p = &stats->prefixes[i];
+
+        printf("%s+%llu ~%llu -%llu  %.*s%s%.*s\n", indent, (unsigned long long)p->added,
+               (unsigned long long)p->modified, (unsigned long long)p->deleted, (int)p->db_len, p->db,
+               p->collection_len != 0 ? "/" : "", (int)p->collection_len, p->collection);
+    }
+    stats_totals(stats, totals);
+    printf("%s%zu prefix(es) changed, +%llu ~%llu -%llu\n", indent, stats->count, (unsigned long long)totals[0],
+           (unsigned long long)totals[1], (unsigned long long)totals[2]);
+}
+
+/*
+ * Walks the parent chain for `scribe log`. Change counts come from the
+ * per-commit summaries in stats_index, which is non-NULL whenever counts are
+ * printed.
  */
-scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int show_paths, const char *path_filter) {
+static scribe_error_t log_walk(scribe_ctx *ctx, int oneline, size_t limit, int show_paths, int show_stat,
+                               int show_patch, const char *path_filter, scribe_commit_stats_index *stats_index) {
+    content_diff_state content = {ctx, "  "};
     uint8_t hash[SCRIBE_HASH_SIZE];
     size_t emitted = 0;
     scribe_error_t err = scribe_refs_read(ctx, "refs/heads/main", hash);
@@ -183,9 +218,12 @@ scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int sh
         uint8_t next_hash[SCRIBE_HASH_SIZE];
         const uint8_t *parent_root = NULL;
         const char *annotation = NULL;
+        scribe_path_resolution current_path;
+        scribe_path_resolution parent_path;
         int emit = 1;
         int have_parent_view = 0;
-        size_t changed_count = 0;
+        scribe_commit_stats stats = {0};
+        uint64_t totals[3] = {0, 0, 0};
         char hex[SCRIBE_HEX_HASH_SIZE + 1];
 
         err = scribe_arena_init(&arena, 4096);
@@ -216,10 +254,8 @@ scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int sh
          * limit is reached, so "-n 3 -- path" means "three commits that changed
          * path", not "scan three commits total".
          */
+        memset(&parent_path, 0, sizeof(parent_path));
         if (path_filter != NULL) {
-            scribe_path_resolution current_path;
-            scribe_path_resolution parent_path;
-
             err = scribe_tree_resolve_path(ctx, view.root_tree, path_filter, &current_path);
             if (err == SCRIBE_OK && have_parent_view) {
                 err = scribe_tree_resolve_path(ctx, parent_view.root_tree, path_filter, &parent_path);
@@ -234,13 +270,14 @@ scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int sh
             emit = path_resolution_changed(&parent_path, &current_path);
             annotation = path_change_annotation(&parent_path, &current_path);
         }
-        if (emit && show_paths && oneline) {
-            err = count_changed_paths(ctx, parent_root, view.root_tree, &changed_count);
+        if (emit && (show_stat || (show_paths && oneline))) {
+            err = scribe_commit_stats_get(ctx, stats_index, hash, parent_root, view.root_tree, &stats);
             if (err != SCRIBE_OK) {
                 scribe_arena_destroy(&parent_arena);
                 scribe_arena_destroy(&arena);
                 return err;
             }
+            stats_totals(&stats, totals);
         }
         scribe_hash_to_hex(hash, hex);
         if (emit) {
@@ -250,7 +287,11 @@ scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int sh
                     printf(" %.*s", (int)view.message_len, (const char *)view.message);
                 }
                 if (show_paths) {
-                    printf(" [%zu changed]", changed_count);
+                    printf(" [%llu changed]", (unsigned long long)(totals[0] + totals[1] + totals[2]));
+                }
+                if (show_stat) {
+                    printf(" [+%llu ~%llu -%llu]", (unsigned long long)totals[0], (unsigned long long)totals[1],
+                           (unsigned long long)totals[2]);
                 }
                 if (annotation != NULL) {
                     printf(" (%s)", annotation);
@@ -273,20 +314,41 @@ scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int sh
                 if (annotation != NULL) {
                     printf("  (%s)\n", annotation);
                 }
-                if (show_paths) {
+                if (show_paths && !show_patch) {
                     err = diff_roots(ctx, parent_root, view.root_tree, print_diff_visit, "  ");
                     if (err != SCRIBE_OK) {
+                        scribe_commit_stats_free(&stats);
                         scribe_arena_destroy(&parent_arena);
                         scribe_arena_destroy(&arena);
                         return err;
                     }
                 }
-                if (annotation != NULL || show_paths) {
-                    printf("\n");
+                if (show_stat) {
+                    print_commit_stats(&stats, "  ");
                 }
             }
+            /*
+             * -p prints each changed document with its JSON Patch. With a
+             * path filter only the filtered path's changes are shown.
+             */
+            if (show_patch && path_filter != NULL) {
+                err = scribe_diff_walk_path(ctx, &parent_path, &current_path, path_filter, print_content_visit,
+                                            &content);
+            } else if (show_patch) {
+                err = diff_roots(ctx, parent_root, view.root_tree, print_content_visit, &content);
+            }
+            if (err != SCRIBE_OK) {
+                scribe_commit_stats_free(&stats);
+                scribe_arena_destroy(&parent_arena);
+                scribe_arena_destroy(&arena);
+                return err;
+            }
+            if (!oneline && (annotation != NULL || show_paths || show_stat || show_patch)) {
+                printf("\n");
+            }
             emitted++;
         }
+        scribe_commit_stats_free(&stats);
         if (view.has_parent) {
             scribe_hash_copy(next_hash, view.parent);
         }
@@ -303,12 +365,67 @@ scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int sh
     return SCRIBE_OK;
 }
 
+/*
+ * Implements `scribe log`. It walks the parent chain from HEAD, optionally
+ * filters commits by one path, optionally prints changed paths or per-prefix
+ * change counts, and applies -n to the number of commits emitted rather than
+ * the number scanned.
+ */
+scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int show_paths, int show_stat,
+                              int show_patch, const char *path_filter) {
+    scribe_commit_stats_index *stats_index = NULL;
+    scribe_error_t err;
+
+    if (show_stat || (show_paths && oneline)) {
+        err = scribe_commit_stats_open(ctx, &stats_index);
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+    }
+    err = log_walk(ctx, oneline, limit, show_paths, show_stat, show_patch, path_filter, stats_index);
+    scribe_commit_stats_index_free(stats_index);
+    return err;
+}
+
+/*
+ * Prints the per-prefix summary section of `show`. The parent's root tree is
+ * only read when the commit has no stored summary.
+ */
+static scribe_error_t print_show_stats(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                       const scribe_commit_view *view) {
+    scribe_commit_stats_index *stats_index = NULL;
+    scribe_commit_stats stats;
+    scribe_arena parent_arena = {0};
+    scribe_commit_view parent_view;
+    const uint8_t *parent_root = NULL;
+    scribe_error_t err = scribe_commit_stats_open(ctx, &stats_index);
+
+    if (err == SCRIBE_OK && view->has_parent) {
+        err = scribe_arena_init(&parent_arena, 4096);
+        if (err == SCRIBE_OK) {
+            err = read_commit_view(ctx, view->parent, &parent_arena, &parent_view);
+        }
+        parent_root = parent_view.root_tree;
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_stats_get(ctx, stats_index, hash, parent_root, view->root_tree, &stats);
+    }
+    if (err == SCRIBE_OK) {
+        printf("\nstat:\n");
+        print_commit_stats(&stats, "  ");
+        scribe_commit_stats_free(&stats);
+    }
+    scribe_arena_destroy(&parent_arena);
+    scribe_commit_stats_index_free(stats_index);
+    return err;
+}
+
 /*
  * Implements `scribe show <commit>` and delegates `scribe show <commit>:<path>`
- * to the path-inspection implementation. The commit form prints metadata and
- * diffs the commit against its parent for the changes section.
+ * to the path-inspection implementation. The commit form prints metadata, the
+ * per-prefix change summary, and the commit's diff against its parent.
  */
-scribe_error_t scribe_cli_show(scribe_ctx *ctx, const char *rev) {
+scribe_error_t scribe_cli_show(scribe_ctx *ctx, const char *rev, int render_json) {
     uint8_t hash[SCRIBE_HASH_SIZE];
     scribe_arena arena;
     scribe_commit_view view;
@@ -316,7 +433,7 @@ scribe_error_t scribe_cli_show(scribe_ctx *ctx, const char *rev) {
     scribe_error_t err;
 
     if (strchr(rev, ':') != NULL) {
-        return scribe_cli_show_path(ctx, rev);
+        return scribe_cli_show_path(ctx, rev, render_json);
     }
     err = scribe_resolve_commit(ctx, rev, hash);
     if (err != SCRIBE_OK) {
@@ -345,11 +462,16 @@ scribe_error_t scribe_cli_show(scribe_ctx *ctx, const char *rev) {
     if (view.message_len != 0) {
         printf("%.*s\n", (int)view.message_len, (const char *)view.message);
     }
+    err = print_show_stats(ctx, hash, &view);
+    if (err != SCRIBE_OK) {
+        scribe_arena_destroy(&arena);
+        return err;
+    }
     printf("\nchanges:\n");
     if (view.has_parent) {
         char parent_hex[SCRIBE_HEX_HASH_SIZE + 1];
         scribe_hash_to_hex(view.parent, parent_hex);
-        err = scribe_cli_diff(ctx, parent_hex, hex);
+        err = scribe_cli_diff(ctx, parent_hex, hex, 0);
     }
     scribe_arena_destroy(&arena);
     return err;
@@ -443,13 +565,97 @@ scribe_error_t scribe_cli_cat_object(scribe_ctx *ctx, char mode, const char *hex
  * Diff visitor that prints one changed path, optionally with an indentation
  * prefix supplied through the user pointer.
  */
-static scribe_error_t print_diff_visit(char status, const char *path, void *user) {
+static scribe_error_t print_diff_visit(char status, const char *path, const uint8_t *old_blob,
+                                       const uint8_t *new_blob, void *user) {
     const char *indent = user == NULL ? "" : (const char *)user;
 
+    (void)old_blob;
+    (void)new_blob;
     printf("%s%c %s\n", indent, status, path);
     return SCRIBE_OK;
 }
 
+/*
+ * Reads a blob as JSON text, rendering sorted-BSON documents first. *json is
+ * a heap copy when rendering happened and NULL otherwise; the text is valid
+ * until both `obj` and *json are freed.
+ */
+static scribe_error_t read_blob_json(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_object *obj,
+                                     char **json, const char **text, size_t *len) {
+    scribe_error_t err = scribe_object_read(ctx, hash, obj);
+
+    *json = NULL;
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    *text = (const char *)obj->payload;
+    *len = obj->payload_len;
+    if (scribe_bson_is_document(obj->payload, obj->payload_len)) {
+        err = scribe_bson_to_json(obj->payload, obj->payload_len, json, len);
+        if (err != SCRIBE_OK) {
+            scribe_object_free(obj);
+            return err;
+        }
+        *text = *json;
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Prints one JSON Patch operation as a single-line JSON object.
+ */
+static scribe_error_t print_patch_op(const scribe_json_patch_op *op, void *user) {
+    const content_diff_state *state = (const content_diff_state *)user;
+
+    printf("%s  {\"op\":\"%s\",\"path\":\"%.*s\"", state->indent, op->op, (int)op->path_len, op->path);
+    if (op->value != NULL) {
+        printf(",\"value\":%.*s", (int)op->value_len, op->value);
+    }
+    printf("}\n");
+    return SCRIBE_OK;
+}
+
+/*
+ * Diff visitor for --content and log -p: prints the path line, then for a
+ * modified document the JSON Patch that turns the old version into the new
+ * one. Documents that are not JSON get a note instead of a patch.
+ */
+static scribe_error_t print_content_visit(char status, const char *path, const uint8_t *old_blob,
+                                          const uint8_t *new_blob, void *user) {
+    const content_diff_state *state = (const content_diff_state *)user;
+    scribe_object old_obj;
+    scribe_object new_obj;
+    char *old_json = NULL;
+    char *new_json = NULL;
+    const char *old_text = NULL;
+    const char *new_text = NULL;
+    size_t old_len = 0;
+    size_t new_len = 0;
+    scribe_error_t err;
+
+    printf("%s%c %s\n", state->indent, status, path);
+    if (status != 'M' || old_blob == NULL || new_blob == NULL) {
+        return SCRIBE_OK;
+    }
+    err = read_blob_json(state->ctx, old_blob, &old_obj, &old_json, &old_text, &old_len);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = read_blob_json(state->ctx, new_blob, &new_obj, &new_json, &new_text, &new_len);
+    if (err == SCRIBE_OK) {
+        err = scribe_json_diff(old_text, old_len, new_text, new_len, print_patch_op, user);
+        if (err == SCRIBE_EMALFORMED) {
+            printf("%s  (not JSON; contents differ)\n", state->indent);
+            err = SCRIBE_OK;
+        }
+        free(new_json);
+        scribe_object_free(&new_obj);
+    }
+    free(old_json);
+    scribe_object_free(&old_obj);
+    return err;
+}
+
 /*
  * Builds a slash-separated child path from an existing prefix and one entry
  * name. The caller owns the returned heap string.
@@ -485,6 +691,18 @@ static scribe_error_t join_path(const char *prefix, const char *name, char **out
     return SCRIBE_OK;
 }
 
+/*
+ * Builds the path for a child entry. Shard entries are interior levels of one
+ * logical tree, so their children keep the parent's path unchanged.
+ */
+static scribe_error_t child_path(const char *prefix, const char *name, bool shard, char **out) {
+    if (shard) {
+        *out = strdup(prefix);
+        return *out == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate diff path") : SCRIBE_OK;
+    }
+    return join_path(prefix, name, out);
+}
+
 /*
  * Reads and parses a tree object for diffing. The arena is reinitialized to a
  * capacity based on the object payload so large trees can be parsed safely.
@@ -518,25 +736,41 @@ static scribe_error_t parse_tree_object(scribe_ctx *ctx, const uint8_t hash[SCRI
 /*
  * Reports every leaf under a blob or tree as added/deleted. This turns subtree
  * additions/deletions into the leaf-level output users expect from diff/log --paths.
+ * Counting diffs need no paths, so they add a whole subtree from the leaf-count
+ * cache instead of walking it.
  */
 static scribe_error_t report_all(scribe_ctx *ctx, char status, const uint8_t hash[SCRIBE_HASH_SIZE], uint8_t type,
-                                 const char *path, diff_visit_fn visit, void *user) {
+                                 const char *path, scribe_diff_visit_fn visit, void *user) {
     /*
      * When an entire subtree is added or deleted, user-facing diff output is
      * still leaf-oriented. Descend until blobs are reached and report every leaf
-     * path with the same status.
+     * path with the same status. Shard levels are descended without adding a
+     * path component.
      */
     if (type == SCRIBE_OBJECT_BLOB) {
-        return visit(status, path, user);
+        return visit(status, path, status == 'D' ? hash : NULL, status == 'D' ? NULL : hash, user);
     }
     if (type != SCRIBE_OBJECT_TREE) {
         return scribe_set_error(SCRIBE_ECORRUPT, "invalid tree entry type while diffing");
     }
+    if (visit == count_diff_visit) {
+        diff_count_state *state = (diff_count_state *)user;
+        uint64_t leaves = 0;
+        scribe_error_t err = scribe_tree_leaf_count(ctx, hash, &leaves);
+
+        if (status == 'A') {
+            state->added += leaves;
+        } else {
+            state->deleted += leaves;
+        }
+        return err;
+    }
     {
         scribe_arena arena = {0};
         scribe_tree_entry *entries = NULL;
         size_t count = 0;
         size_t i;
+        bool sharded;
         scribe_error_t err = scribe_arena_init(&arena, 4096);
         if (err != SCRIBE_OK) {
             return err;
@@ -546,9 +780,10 @@ static scribe_error_t report_all(scribe_ctx *ctx, char status, const uint8_t has
             scribe_arena_destroy(&arena);
             return err;
         }
+        sharded = scribe_tree_entries_sharded(entries, count);
         for (i = 0; i < count; i++) {
             char *child = NULL;
-            err = join_path(path, entries[i].name, &child);
+            err = child_path(path, entries[i].name, sharded, &child);
             if (err != SCRIBE_OK) {
                 scribe_arena_destroy(&arena);
                 return err;
@@ -571,7 +806,7 @@ static scribe_error_t report_all(scribe_ctx *ctx, char status, const uint8_t has
  * hashes report a modification.
  */
 static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HASH_SIZE],
-                                 const uint8_t b_hash[SCRIBE_HASH_SIZE], const char *prefix, diff_visit_fn visit,
+                                 const uint8_t b_hash[SCRIBE_HASH_SIZE], const char *prefix, scribe_diff_visit_fn visit,
                                  void *user) {
     scribe_arena arena_a = {0};
     scribe_arena arena_b = {0};
@@ -581,6 +816,7 @@ static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HA
     size_t bc = 0;
     size_t ai = 0;
     size_t bi = 0;
+    bool sharded = false;
     scribe_error_t err;
 
     if (scribe_hash_cmp(a_hash, b_hash) == 0) {
@@ -596,6 +832,23 @@ static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HA
     if (err == SCRIBE_OK) {
         err = parse_tree_object(ctx, b_hash, &arena_b, &b, &bc);
     }
+    if (err == SCRIBE_OK) {
+        /*
+         * Two shard levels are walked shard-by-shard so unchanged buckets are
+         * skipped by hash. When only one side is sharded (the tree crossed the
+         * threshold) both sides are expanded to their logical entries.
+         */
+        sharded = scribe_tree_entries_sharded(a, ac);
+        if (sharded != scribe_tree_entries_sharded(b, bc)) {
+            sharded = false;
+            scribe_arena_destroy(&arena_a);
+            scribe_arena_destroy(&arena_b);
+            err = scribe_tree_read_logical(ctx, a_hash, &arena_a, &a, &ac);
+            if (err == SCRIBE_OK) {
+                err = scribe_tree_read_logical(ctx, b_hash, &arena_b, &b, &bc);
+            }
+        }
+    }
     if (err != SCRIBE_OK) {
         scribe_arena_destroy(&arena_a);
         scribe_arena_destroy(&arena_b);
@@ -621,7 +874,7 @@ static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HA
             }
         }
         if (cmp < 0) {
-            err = join_path(prefix, a[ai].name, &path);
+            err = child_path(prefix, a[ai].name, sharded, &path);
             if (err != SCRIBE_OK) {
                 break;
             }
@@ -629,7 +882,7 @@ static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HA
             free(path);
             ai++;
         } else if (cmp > 0) {
-            err = join_path(prefix, b[bi].name, &path);
+            err = child_path(prefix, b[bi].name, sharded, &path);
             if (err != SCRIBE_OK) {
                 break;
             }
@@ -637,7 +890,7 @@ static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HA
             free(path);
             bi++;
         } else {
-            err = join_path(prefix, a[ai].name, &path);
+            err = child_path(prefix, a[ai].name, sharded, &path);
             if (err != SCRIBE_OK) {
                 break;
             }
@@ -645,7 +898,8 @@ static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HA
                 if (a[ai].type == SCRIBE_OBJECT_TREE && b[bi].type == SCRIBE_OBJECT_TREE) {
                     err = diff_trees(ctx, a[ai].hash, b[bi].hash, path, visit, user);
                 } else {
-                    err = visit('M', path, user);
+                    err = visit('M', path, a[ai].type == SCRIBE_OBJECT_BLOB ? a[ai].hash : NULL,
+                                b[bi].type == SCRIBE_OBJECT_BLOB ? b[bi].hash : NULL, user);
                 }
             }
             free(path);
@@ -666,7 +920,7 @@ static scribe_error_t diff_trees(scribe_ctx *ctx, const uint8_t a_hash[SCRIBE_HA
  * every leaf in the new root is an added path.
  */
 static scribe_error_t diff_roots(scribe_ctx *ctx, const uint8_t *old_root, const uint8_t new_root[SCRIBE_HASH_SIZE],
-                                 diff_visit_fn visit, void *user) {
+                                 scribe_diff_visit_fn visit, void *user) {
     if (visit == NULL) {
         return scribe_set_error(SCRIBE_EINVAL, "diff visitor is NULL");
     }
@@ -676,11 +930,87 @@ static scribe_error_t diff_roots(scribe_ctx *ctx, const uint8_t *old_root, const
     return diff_trees(ctx, old_root, new_root, "", visit, user);
 }
 
+/*
+ * Counts the leaf changes between two trees as added, modified, and deleted,
+ * in that order. Either side may be NULL for an absent tree. Whole added or
+ * deleted subtrees are counted from the leaf-count cache, so the cost follows
+ * the diverged trees rather than the number of changed leaves.
+ */
+scribe_error_t scribe_diff_count(scribe_ctx *ctx, const uint8_t *old_tree, const uint8_t *new_tree,
+                                 uint64_t out[3]) {
+    diff_count_state state;
+    scribe_error_t err = SCRIBE_OK;
+
+    memset(&state, 0, sizeof(state));
+    if (old_tree != NULL && new_tree != NULL) {
+        err = diff_trees(ctx, old_tree, new_tree, "", count_diff_visit, &state);
+    } else if (new_tree != NULL) {
+        err = report_all(ctx, 'A', new_tree, SCRIBE_OBJECT_TREE, "", count_diff_visit, &state);
+    } else if (old_tree != NULL) {
+        err = report_all(ctx, 'D', old_tree, SCRIBE_OBJECT_TREE, "", count_diff_visit, &state);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    out[0] = state.added;
+    out[1] = state.modified;
+    out[2] = state.deleted;
+    return SCRIBE_OK;
+}
+
+/*
+ * Walks the leaf changes between two trees, reporting paths under `prefix`.
+ * Either side may be NULL for an absent tree. The visitor receives the old
+ * and new blob hashes of each leaf; a side is NULL where the leaf is absent or
+ * is not a blob.
+ */
+scribe_error_t scribe_diff_walk(scribe_ctx *ctx, const uint8_t *old_tree, const uint8_t *new_tree, const char *prefix,
+                                scribe_diff_visit_fn visit, void *user) {
+    if (visit == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "diff visitor is NULL");
+    }
+    if (old_tree != NULL && new_tree != NULL) {
+        return diff_trees(ctx, old_tree, new_tree, prefix, visit, user);
+    }
+    if (new_tree != NULL) {
+        return report_all(ctx, 'A', new_tree, SCRIBE_OBJECT_TREE, prefix, visit, user);
+    }
+    if (old_tree != NULL) {
+        return report_all(ctx, 'D', old_tree, SCRIBE_OBJECT_TREE, prefix, visit, user);
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Walks the leaf changes at `path` between two resolutions of it, such as
+ * the same path in a parent and a child commit. A path that names a single
+ * document is reported as that one leaf; trees are diffed below it.
+ */
+scribe_error_t scribe_diff_walk_path(scribe_ctx *ctx, const scribe_path_resolution *old_res,
+                                     const scribe_path_resolution *new_res, const char *path,
+                                     scribe_diff_visit_fn visit, void *user) {
+    const uint8_t *old_blob = old_res->state == SCRIBE_PATH_BLOB ? old_res->hash : NULL;
+    const uint8_t *new_blob = new_res->state == SCRIBE_PATH_BLOB ? new_res->hash : NULL;
+    scribe_error_t err = SCRIBE_OK;
+
+    if (old_blob != NULL && (new_blob == NULL || scribe_hash_cmp(old_blob, new_blob) != 0)) {
+        err = visit(new_blob == NULL ? 'D' : 'M', path, old_blob, new_blob, user);
+    } else if (new_blob != NULL && old_blob == NULL) {
+        err = visit('A', path, NULL, new_blob, user);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    return scribe_diff_walk(ctx, old_res->state == SCRIBE_PATH_TREE ? old_res->hash : NULL,
+                            new_res->state == SCRIBE_PATH_TREE ? new_res->hash : NULL, path, visit, user);
+}
+
 /*
  * Implements `scribe diff`. With one revision it compares that commit's parent
  * to the commit; with two revisions it compares the two resolved root trees.
  */
-scribe_error_t scribe_cli_diff(scribe_ctx *ctx, const char *a_rev, const char *b_rev) {
+scribe_error_t scribe_cli_diff(scribe_ctx *ctx, const char *a_rev, const char *b_rev, int content) {
+    content_diff_state state = {ctx, ""};
     uint8_t a_hash[SCRIBE_HASH_SIZE];
     uint8_t b_hash[SCRIBE_HASH_SIZE];
     scribe_arena arena_a = {0};
@@ -726,7 +1056,8 @@ scribe_error_t scribe_cli_diff(scribe_ctx *ctx, const char *a_rev, const char *b
         err = read_commit_view(ctx, b_hash, &arena_b, &b_commit);
     }
     if (err == SCRIBE_OK) {
-        err = diff_trees(ctx, a_commit.root_tree, b_commit.root_tree, "", print_diff_visit, "");
+        err = diff_trees(ctx, a_commit.root_tree, b_commit.root_tree, "", content ? print_content_visit : print_diff_visit,
+                         content ? (void *)&state : (void *)"");
     }
     scribe_arena_destroy(&arena_a);
     scribe_arena_destroy(&arena_b);
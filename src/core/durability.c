@@ -0,0 +1,468 @@
+/*
+ * Durability modes and the relaxed-mode syncer.
+ *
+ * `durability = strict` fsyncs every object file and its directory as it is
+ * written. `batch` writes objects without fsync and issues one syncfs() barrier
+ * when a commit or bootstrap publishes its ref. `relaxed` skips that barrier
+ * too: a background thread runs syncfs() every `durability_sync_seconds` and
+ * only then writes the newest commit of refs/heads/main (and of any partition
+ * ref), followed by any adapter state that names it. Until then the in-process ref is the pending
+ * value, so this context sees its own commits immediately while other
+ * processes and a restart see the last synced one.
+ *
+ * Unsynced object files can survive a power loss as named but torn files, and
+ * a later content-addressed write would skip them because they already exist.
+ * Non-strict writable contexts therefore durably create
+ * `objects/info/unsynced` before their first unsynced write and remove it
+ * after the final barrier. A writable open that finds the marker verifies
+ * every object file written since it and deletes the ones that fail.
+ *
+ * SCRIBE_CRASH_AT names a crash point at which the process exits immediately;
+ * the integration tests use it to check recovery in every mode.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/log.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define UNSYNCED_MARKER "objects/info/unsynced"
+#define CRASH_EXIT_CODE 86
+
+/*
+ * Adapter-state or other file whose publication waits for the next sync.
+ */
+typedef struct deferred_file {
+    char *path;
+    uint8_t *bytes;
+    size_t len;
+    struct deferred_file *next;
+} deferred_file;
+
+/*
+ * Ref value waiting for the next sync: refs/heads/main, or a partition ref
+ * while a partitioned writer runs.
+ */
+typedef struct pending_ref {
+    char *name;
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    struct pending_ref *next;
+} pending_ref;
+
+struct scribe_syncer {
+    pthread_mutex_t mu;
+    pthread_cond_t wake;
+    pthread_mutex_t publish_mu;
+    pthread_t thread;
+    int started;
+    int stop;
+    int marked;
+    pending_ref *refs;
+    deferred_file *files;
+};
+
+/*
+ * Exits the process without cleanup when SCRIBE_CRASH_AT names this point.
+ * Nothing is flushed or unlinked, so the store is left exactly as a crash at
+ * that instant would leave it.
+ */
+void scribe_crash_point(const char *point) {
+    const char *want = getenv("SCRIBE_CRASH_AT");
+
+    if (want != NULL && strcmp(want, point) == 0) {
+        _exit(CRASH_EXIT_CODE);
+    }
+}
+
+/*
+ * Frees a list of deferred files.
+ */
+static void free_files(deferred_file *f) {
+    while (f != NULL) {
+        deferred_file *next = f->next;
+        free(f->path);
+        free(f->bytes);
+        free(f);
+        f = next;
+    }
+}
+
+/*
+ * Frees a list of pending refs.
+ */
+static void free_refs(pending_ref *r) {
+    while (r != NULL) {
+        pending_ref *next = r->next;
+        free(r->name);
+        free(r);
+        r = next;
+    }
+}
+
+/*
+ * Copies the pending refs so they can be written without holding the mutex.
+ * Returns -1 when out of memory. The caller holds the mutex.
+ */
+static int copy_refs(const pending_ref *r, pending_ref **out) {
+    *out = NULL;
+    for (; r != NULL; r = r->next) {
+        pending_ref *copy = (pending_ref *)calloc(1, sizeof(*copy));
+
+        if (copy == NULL || (copy->name = strdup(r->name)) == NULL) {
+            free(copy);
+            free_refs(*out);
+            *out = NULL;
+            return -1;
+        }
+        memcpy(copy->hash, r->hash, SCRIBE_HASH_SIZE);
+        copy->next = *out;
+        *out = copy;
+    }
+    return 0;
+}
+
+/*
+ * Runs one barrier and publishes everything that was pending when it started:
+ * the ref first, then deferred files in the order they were queued. Values
+ * queued during the barrier wait for the next round. On failure the snapshot
+ * is put back unless a newer value replaced it meanwhile.
+ */
+static scribe_error_t sync_once(scribe_ctx *ctx) {
+    scribe_syncer *s = ctx->syncer;
+    pending_ref *refs;
+    pending_ref *r;
+    deferred_file *files;
+    deferred_file *f;
+    deferred_file **tail;
+    scribe_error_t err = SCRIBE_OK;
+
+    pthread_mutex_lock(&s->publish_mu);
+    pthread_mutex_lock(&s->mu);
+    if (copy_refs(s->refs, &refs) != 0) {
+        pthread_mutex_unlock(&s->mu);
+        pthread_mutex_unlock(&s->publish_mu);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to snapshot pending refs");
+    }
+    files = s->files;
+    s->files = NULL;
+    pthread_mutex_unlock(&s->mu);
+
+    err = ctx->objects->ops->flush(ctx->objects);
+    scribe_crash_point("sync-before-publish");
+    for (r = refs; err == SCRIBE_OK && r != NULL; r = r->next) {
+        err = scribe_refs_write(ctx, r->name, r->hash);
+    }
+    for (f = files; err == SCRIBE_OK && f != NULL; f = f->next) {
+        err = scribe_write_file_atomic(f->path, f->bytes, f->len);
+    }
+
+    pthread_mutex_lock(&s->mu);
+    for (r = refs; err == SCRIBE_OK && r != NULL; r = r->next) {
+        pending_ref **link;
+
+        for (link = &s->refs; *link != NULL; link = &(*link)->next) {
+            if (strcmp((*link)->name, r->name) == 0) {
+                if (memcmp((*link)->hash, r->hash, SCRIBE_HASH_SIZE) == 0) {
+                    pending_ref *done = *link;
+
+                    *link = done->next;
+                    done->next = NULL;
+                    free_refs(done);
+                }
+                break;
+            }
+        }
+    }
+    if (err == SCRIBE_OK) {
+        free_files(files);
+    } else {
+        /*
+         * Requeue older values in front of anything queued since, dropping a
+         * file that was already superseded.
+         */
+        tail = &files;
+        while (*tail != NULL) {
+            deferred_file *newer;
+
+            for (newer = s->files; newer != NULL && strcmp(newer->path, (*tail)->path) != 0; newer = newer->next) {
+            }
+            if (newer != NULL) {
+                f = *tail;
+                *tail = f->next;
+                f->next = NULL;
+                free_files(f);
+            } else {
+                tail = &(*tail)->next;
+            }
+        }
+        *tail = s->files;
+        s->files = files;
+    }
+    pthread_mutex_unlock(&s->mu);
+    pthread_mutex_unlock(&s->publish_mu);
+    free_refs(refs);
+    return err;
+}
+
+/*
+ * Background loop for relaxed mode: sleep for the configured interval or
+ * until woken for shutdown, then sync. Failures are logged and retried on the
+ * next tick; the pending values stay in memory.
+ */
+static void *syncer_main(void *arg) {
+    scribe_ctx *ctx = (scribe_ctx *)arg;
+    scribe_syncer *s = ctx->syncer;
+
+    pthread_mutex_lock(&s->mu);
+    while (!s->stop) {
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += ctx->config.durability_sync_seconds;
+        while (!s->stop && pthread_cond_timedwait(&s->wake, &s->mu, &deadline) != ETIMEDOUT) {
+        }
+        if (s->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&s->mu);
+        if (sync_once(ctx) != SCRIBE_OK) {
+            scribe_log_msg(ctx, SCRIBE_LOG_WARN, "durability", "background sync failed: %s", scribe_last_error_detail());
+        }
+        pthread_mutex_lock(&s->mu);
+    }
+    pthread_mutex_unlock(&s->mu);
+    return NULL;
+}
+
+/*
+ * Verifies the objects written since an unclean writer created the marker and
+ * removes torn ones, so later writes store them again instead of skipping
+ * them as already present. The check ends with an object-store barrier, so
+ * the files it kept are durable before the caller replaces or removes the
+ * marker; a crash before then just repeats the check.
+ */
+static scribe_error_t recover_unsynced(scribe_ctx *ctx, const char *marker) {
+    struct stat st;
+    size_t removed = 0;
+    scribe_error_t err;
+
+    if (stat(marker, &st) != 0) {
+        return errno == ENOENT ? SCRIBE_OK : scribe_set_error(SCRIBE_EIO, "failed to stat '%s'", marker);
+    }
+    scribe_log_msg(ctx, SCRIBE_LOG_WARN, "durability",
+                   "previous writer stopped before its final sync; verifying recent objects");
+    /* One second of slack covers filesystems with coarse timestamps. */
+    err = scribe_object_loose_discard_torn(ctx, st.st_mtime - 1, &removed);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (removed != 0) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "durability", "removed %zu torn object file(s)", removed);
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Sets up durability for a writable context after the repository lock is
+ * held: recovers after an unclean non-strict writer, marks the store before
+ * this context writes unsynced objects, and starts the relaxed-mode syncer.
+ */
+scribe_error_t scribe_durability_open(scribe_ctx *ctx) {
+    scribe_syncer *s;
+    char *marker;
+    scribe_error_t err;
+
+    s = (scribe_syncer *)calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate syncer");
+    }
+    if (pthread_mutex_init(&s->mu, NULL) != 0) {
+        free(s);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize syncer");
+    }
+    if (pthread_mutex_init(&s->publish_mu, NULL) != 0) {
+        pthread_mutex_destroy(&s->mu);
+        free(s);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize syncer");
+    }
+    if (pthread_cond_init(&s->wake, NULL) != 0) {
+        pthread_mutex_destroy(&s->publish_mu);
+        pthread_mutex_destroy(&s->mu);
+        free(s);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize syncer");
+    }
+    ctx->syncer = s;
+
+    marker = scribe_path_join(ctx->repo_path, UNSYNCED_MARKER);
+    if (marker == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    /* Recovery ends with a barrier, so the marker can be renewed or removed. */
+    err = recover_unsynced(ctx, marker);
+    if (err == SCRIBE_OK && ctx->config.durability != SCRIBE_DURABILITY_STRICT) {
+        char *info = scribe_path_join(ctx->repo_path, "objects/info");
+
+        err = info == NULL ? SCRIBE_ENOMEM : scribe_mkdir_p(info);
+        free(info);
+        if (err == SCRIBE_OK) {
+            err = scribe_write_file_atomic(marker, (const uint8_t *)"", 0);
+        }
+        s->marked = err == SCRIBE_OK;
+    } else if (err == SCRIBE_OK && unlink(marker) != 0 && errno != ENOENT) {
+        err = scribe_set_error(SCRIBE_EIO, "failed to remove '%s'", marker);
+    }
+    free(marker);
+    if (err == SCRIBE_OK && ctx->config.durability == SCRIBE_DURABILITY_RELAXED) {
+        if (pthread_create(&s->thread, NULL, syncer_main, ctx) != 0) {
+            return scribe_set_error(SCRIBE_ERR, "failed to start syncer thread");
+        }
+        s->started = 1;
+    }
+    return err;
+}
+
+/*
+ * Stops the syncer, runs the final barrier and publication, and removes the
+ * unsynced marker once nothing unsynced remains. Called by scribe_close()
+ * before the object engine goes away. Failures are logged: the marker then
+ * stays behind and the next writable open verifies recent objects.
+ */
+void scribe_durability_close(scribe_ctx *ctx) {
+    scribe_syncer *s = ctx->syncer;
+
+    if (s == NULL) {
+        return;
+    }
+    if (s->started) {
+        pthread_mutex_lock(&s->mu);
+        s->stop = 1;
+        pthread_cond_signal(&s->wake);
+        pthread_mutex_unlock(&s->mu);
+        pthread_join(s->thread, NULL);
+    }
+    if (s->marked) {
+        if (sync_once(ctx) != SCRIBE_OK) {
+            scribe_log_msg(ctx, SCRIBE_LOG_ERROR, "durability", "final sync failed: %s", scribe_last_error_detail());
+        } else {
+            char *marker = scribe_path_join(ctx->repo_path, UNSYNCED_MARKER);
+
+            if (marker == NULL || unlink(marker) != 0) {
+                scribe_log_msg(ctx, SCRIBE_LOG_WARN, "durability", "failed to remove unsynced marker");
+            }
+            free(marker);
+        }
+    }
+    free_refs(s->refs);
+    free_files(s->files);
+    pthread_cond_destroy(&s->wake);
+    pthread_mutex_destroy(&s->publish_mu);
+    pthread_mutex_destroy(&s->mu);
+    free(s);
+    ctx->syncer = NULL;
+}
+
+/*
+ * Returns 1 and the value when a ref update is waiting for the next sync.
+ */
+int scribe_durability_pending_ref(scribe_ctx *ctx, const char *name, uint8_t out[SCRIBE_HASH_SIZE]) {
+    scribe_syncer *s = ctx->syncer;
+    pending_ref *r;
+
+    if (s == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&s->mu);
+    for (r = s->refs; r != NULL && strcmp(r->name, name) != 0; r = r->next) {
+    }
+    if (r != NULL) {
+        memcpy(out, r->hash, SCRIBE_HASH_SIZE);
+    }
+    pthread_mutex_unlock(&s->mu);
+    return r != NULL;
+}
+
+/*
+ * Reports whether ref and state publication waits for the background syncer.
+ */
+int scribe_durability_deferred(const scribe_ctx *ctx) { return ctx->syncer != NULL && ctx->syncer->started; }
+
+/*
+ * Queues a ref value for publication after the next barrier, replacing any
+ * value already queued for the same ref.
+ */
+scribe_error_t scribe_durability_defer_ref(scribe_ctx *ctx, const char *name, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    scribe_syncer *s = ctx->syncer;
+    pending_ref *r;
+
+    pthread_mutex_lock(&s->mu);
+    for (r = s->refs; r != NULL && strcmp(r->name, name) != 0; r = r->next) {
+    }
+    if (r == NULL) {
+        r = (pending_ref *)calloc(1, sizeof(*r));
+        if (r == NULL || (r->name = strdup(name)) == NULL) {
+            free(r);
+            pthread_mutex_unlock(&s->mu);
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to queue ref update");
+        }
+        r->next = s->refs;
+        s->refs = r;
+    }
+    memcpy(r->hash, hash, SCRIBE_HASH_SIZE);
+    pthread_mutex_unlock(&s->mu);
+    return SCRIBE_OK;
+}
+
+/*
+ * Runs a barrier and publishes every queued value now instead of at the next
+ * tick. Callers that are about to remove a ref file use this so a queued value
+ * cannot recreate it afterwards.
+ */
+scribe_error_t scribe_durability_sync(scribe_ctx *ctx) {
+    if (!scribe_durability_deferred(ctx)) {
+        return SCRIBE_OK;
+    }
+    return sync_once(ctx);
+}
+
+/*
+ * Replaces a file that describes committed history, such as adapter state.
+ * In relaxed mode the write is queued behind the pending ref so the file never
+ * reaches disk ahead of the commit it names; otherwise it is written now.
+ */
+scribe_error_t scribe_publish_file(scribe_ctx *ctx, const char *path, const uint8_t *bytes, size_t len) {
+    scribe_syncer *s = ctx->syncer;
+    deferred_file *f;
+    deferred_file **link;
+
+    if (!scribe_durability_deferred(ctx)) {
+        return scribe_write_file_atomic(path, bytes, len);
+    }
+    f = (deferred_file *)calloc(1, sizeof(*f));
+    if (f == NULL || (f->path = strdup(path)) == NULL || (f->bytes = (uint8_t *)malloc(len == 0 ? 1u : len)) == NULL) {
+        free_files(f);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to queue file update");
+    }
+    if (len != 0) {
+        memcpy(f->bytes, bytes, len);
+    }
+    f->len = len;
+    pthread_mutex_lock(&s->mu);
+    for (link = &s->files; *link != NULL; link = &(*link)->next) {
+        if (strcmp((*link)->path, path) == 0) {
+            f->next = (*link)->next;
+            (*link)->next = NULL;
+            free_files(*link);
+            break;
+        }
+    }
+    *link = f;
+    pthread_mutex_unlock(&s->mu);
+    return SCRIBE_OK;
+}
@@ -0,0 +1,629 @@
+/*
+ * Bulk export of recorded state.
+ *
+ * `scribe export <rev> [--prefix <path>] [--format ndjson|bson]` writes every
+ * document under a path at one commit as newline-delimited JSON or as
+ * concatenated BSON, the layout mongoimport and mongorestore read. A range
+ * `<a>..<b>` writes only the documents that differ between the two commits,
+ * each wrapped with its A/M/D operation and path.
+ *
+ * The calling thread walks the tree (or the range's tree diff) in storage
+ * order and queues each leaf into a fixed window of slots. Worker threads
+ * read, decompress, and render the slots in any order; the caller writes
+ * finished slots strictly in queue order, so output keeps path order while
+ * decompression runs on `worker_threads` threads. The window bounds how many
+ * rendered documents wait in memory, and output leaves in large sequential
+ * writes.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXPORT_SLOTS_PER_THREAD 16u
+#define EXPORT_OUTPUT_BUFFER (1u << 20)
+
+typedef struct {
+    char *path;
+    uint8_t blob[SCRIBE_HASH_SIZE];
+    char op;
+    int done;
+    char *out;
+    size_t out_len;
+} export_slot;
+
+typedef struct {
+    scribe_ctx *ctx;
+    int bson;
+    int tagged;
+    export_slot *slots;
+    size_t window;
+    size_t queued;
+    size_t claimed;
+    size_t written;
+    int closing;
+    pthread_mutex_t mu;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    scribe_error_t err;
+    char err_detail[256];
+    char *buf;
+    size_t buf_len;
+    uint64_t documents;
+} export_state;
+
+/*
+ * Growable byte buffer for one rendered document.
+ */
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} export_buf;
+
+/*
+ * Appends bytes to a document buffer, doubling its capacity as needed.
+ */
+static scribe_error_t buf_append(export_buf *b, const void *bytes, size_t len) {
+    if (b->len + len > b->cap) {
+        size_t cap = b->cap == 0 ? 256u : b->cap;
+        char *next;
+
+        while (cap < b->len + len) {
+            cap *= 2u;
+        }
+        next = (char *)realloc(b->data, cap);
+        if (next == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow export buffer");
+        }
+        b->data = next;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, bytes, len);
+    b->len += len;
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends a path as a JSON string. Scribe paths hold no control characters
+ * other than those a Mongo _id may carry, which are escaped as \u00XX.
+ */
+static scribe_error_t buf_json_string(export_buf *b, const char *s) {
+    scribe_error_t err = buf_append(b, "\"", 1u);
+
+    for (; err == SCRIBE_OK && *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        char esc[8];
+
+        if (c == '"' || c == '\\') {
+            esc[0] = '\\';
+            esc[1] = (char)c;
+            err = buf_append(b, esc, 2u);
+        } else if (c < 0x20u) {
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            err = buf_append(b, esc, 6u);
+        } else {
+            err = buf_append(b, s, 1u);
+        }
+    }
+    return err == SCRIBE_OK ? buf_append(b, "\"", 1u) : err;
+}
+
+/*
+ * Appends a little-endian int32 as BSON stores lengths.
+ */
+static scribe_error_t buf_le32(export_buf *b, uint32_t v) {
+    uint8_t le[4] = {(uint8_t)v, (uint8_t)(v >> 8), (uint8_t)(v >> 16), (uint8_t)(v >> 24)};
+
+    return buf_append(b, le, sizeof(le));
+}
+
+/*
+ * Appends a BSON string element named `key`.
+ */
+static scribe_error_t buf_bson_string(export_buf *b, const char *key, const char *value) {
+    size_t len = strlen(value) + 1u;
+    scribe_error_t err = buf_append(b, "\x02", 1u);
+
+    if (err == SCRIBE_OK) {
+        err = buf_append(b, key, strlen(key) + 1u);
+    }
+    if (err == SCRIBE_OK) {
+        err = buf_le32(b, (uint32_t)len);
+    }
+    return err == SCRIBE_OK ? buf_append(b, value, len) : err;
+}
+
+/*
+ * Renders one ndjson line. Sorted-BSON documents become canonical Extended
+ * JSON; JSON blobs are copied with raw line breaks turned into spaces, which
+ * is lossless because valid JSON only allows them between tokens.
+ */
+static scribe_error_t render_ndjson(const export_slot *slot, const scribe_object *obj, int tagged, export_buf *b) {
+    char *json = NULL;
+    const char *doc = obj == NULL ? NULL : (const char *)obj->payload;
+    size_t doc_len = obj == NULL ? 0 : obj->payload_len;
+    char op[2] = {slot->op, '\0'};
+    scribe_error_t err = SCRIBE_OK;
+    size_t start;
+    size_t i;
+
+    if (obj != NULL && scribe_bson_is_document(obj->payload, obj->payload_len)) {
+        err = scribe_bson_to_json(obj->payload, obj->payload_len, &json, &doc_len);
+        doc = json;
+    }
+    if (err == SCRIBE_OK && tagged) {
+        err = buf_append(b, "{\"op\":\"", 7u);
+        if (err == SCRIBE_OK) {
+            err = buf_append(b, op, 1u);
+        }
+        if (err == SCRIBE_OK) {
+            err = buf_append(b, "\",\"path\":", 9u);
+        }
+        if (err == SCRIBE_OK) {
+            err = buf_json_string(b, slot->path);
+        }
+        if (err == SCRIBE_OK && doc != NULL) {
+            err = buf_append(b, ",\"doc\":", 7u);
+        }
+    }
+    start = b->len;
+    if (err == SCRIBE_OK && doc != NULL) {
+        err = buf_append(b, doc, doc_len);
+    }
+    for (i = start; err == SCRIBE_OK && i < b->len; i++) {
+        if (b->data[i] == '\n' || b->data[i] == '\r') {
+            b->data[i] = ' ';
+        }
+    }
+    if (err == SCRIBE_OK && tagged) {
+        err = buf_append(b, "}", 1u);
+    }
+    if (err == SCRIBE_OK) {
+        err = buf_append(b, "\n", 1u);
+    }
+    free(json);
+    return err;
+}
+
+/*
+ * Renders one BSON document. A tagged entry is a document with the stored
+ * document under `doc` and the operation and path beside it, keys sorted.
+ */
+static scribe_error_t render_bson(const export_slot *slot, const scribe_object *obj, int tagged, export_buf *b) {
+    char op[2] = {slot->op, '\0'};
+    scribe_error_t err = SCRIBE_OK;
+
+    if (obj != NULL && !scribe_bson_is_document(obj->payload, obj->payload_len)) {
+        return scribe_set_error(SCRIBE_EINVAL, "export --format=bson: '%s' is not a BSON document", slot->path);
+    }
+    if (!tagged) {
+        return buf_append(b, obj->payload, obj->payload_len);
+    }
+    err = buf_le32(b, 0);
+    if (err == SCRIBE_OK && obj != NULL) {
+        err = buf_append(b, "\x03" "doc", 5u);
+        if (err == SCRIBE_OK) {
+            err = buf_append(b, obj->payload, obj->payload_len);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = buf_bson_string(b, "op", op);
+    }
+    if (err == SCRIBE_OK) {
+        err = buf_bson_string(b, "path", slot->path);
+    }
+    if (err == SCRIBE_OK) {
+        err = buf_append(b, "", 1u);
+    }
+    if (err == SCRIBE_OK) {
+        uint32_t total = (uint32_t)b->len;
+
+        b->data[0] = (char)total;
+        b->data[1] = (char)(total >> 8);
+        b->data[2] = (char)(total >> 16);
+        b->data[3] = (char)(total >> 24);
+    }
+    return err;
+}
+
+/*
+ * Reads and renders one slot. Deleted entries in a range have no blob and
+ * render from the path alone.
+ */
+static scribe_error_t render_slot(const export_state *st, export_slot *slot) {
+    scribe_object obj;
+    export_buf b = {0};
+    int have_obj = slot->op != 'D';
+    scribe_error_t err = SCRIBE_OK;
+
+    if (have_obj) {
+        err = scribe_object_read(st->ctx, slot->blob, &obj);
+    }
+    if (err == SCRIBE_OK) {
+        err = st->bson ? render_bson(slot, have_obj ? &obj : NULL, st->tagged, &b)
+                       : render_ndjson(slot, have_obj ? &obj : NULL, st->tagged, &b);
+        if (have_obj) {
+            scribe_object_free(&obj);
+        }
+    }
+    if (err != SCRIBE_OK) {
+        free(b.data);
+        return err;
+    }
+    slot->out = b.data;
+    slot->out_len = b.len;
+    return SCRIBE_OK;
+}
+
+/*
+ * Records the first failure and wakes every waiter. Called with the lock
+ * held; the detail is copied because error details are per thread.
+ */
+static void record_error(export_state *st, scribe_error_t err) {
+    if (st->err == SCRIBE_OK) {
+        st->err = err;
+        snprintf(st->err_detail, sizeof(st->err_detail), "%s", scribe_last_error_detail());
+    }
+    pthread_cond_broadcast(&st->work);
+    pthread_cond_broadcast(&st->done);
+}
+
+/*
+ * Claims the next queued slot and renders it outside the lock. Called and
+ * returns with the lock held.
+ */
+static void render_next(export_state *st) {
+    export_slot *slot = &st->slots[st->claimed++ % st->window];
+    scribe_error_t err;
+
+    pthread_mutex_unlock(&st->mu);
+    err = render_slot(st, slot);
+    pthread_mutex_lock(&st->mu);
+    if (err != SCRIBE_OK) {
+        record_error(st, err);
+        return;
+    }
+    slot->done = 1;
+    pthread_cond_broadcast(&st->done);
+}
+
+/*
+ * Worker thread body: renders queued slots until the walk has ended and the
+ * queue is drained, or until any thread fails.
+ */
+static void *export_worker(void *arg) {
+    export_state *st = (export_state *)arg;
+
+    pthread_mutex_lock(&st->mu);
+    while (st->err == SCRIBE_OK) {
+        if (st->claimed < st->queued) {
+            render_next(st);
+        } else if (st->closing) {
+            break;
+        } else {
+            pthread_cond_wait(&st->work, &st->mu);
+        }
+    }
+    pthread_mutex_unlock(&st->mu);
+    return NULL;
+}
+
+/*
+ * Writes the output buffer to stdout.
+ */
+static scribe_error_t flush_output(export_state *st) {
+    if (st->buf_len != 0 && fwrite(st->buf, 1, st->buf_len, stdout) != st->buf_len) {
+        return scribe_set_error(SCRIBE_EIO, "failed to write export output");
+    }
+    st->buf_len = 0;
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends one rendered document to the output buffer, writing the buffer out
+ * when it fills. Documents larger than the buffer are written directly.
+ */
+static scribe_error_t emit_slot(export_state *st, const export_slot *slot) {
+    scribe_error_t err = SCRIBE_OK;
+
+    if (st->buf_len + slot->out_len > EXPORT_OUTPUT_BUFFER) {
+        err = flush_output(st);
+    }
+    if (err == SCRIBE_OK && slot->out_len > EXPORT_OUTPUT_BUFFER) {
+        if (fwrite(slot->out, 1, slot->out_len, stdout) != slot->out_len) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to write export output");
+        }
+    } else if (err == SCRIBE_OK) {
+        memcpy(st->buf + st->buf_len, slot->out, slot->out_len);
+        st->buf_len += slot->out_len;
+    }
+    return err;
+}
+
+/*
+ * Writes finished slots in queue order until at most `keep` remain queued.
+ * The caller renders unclaimed slots itself rather than waiting, so export
+ * makes progress even with no worker threads. Called and returns with the
+ * lock held.
+ */
+static void drain(export_state *st, size_t keep) {
+    while (st->err == SCRIBE_OK && st->queued - st->written > keep) {
+        export_slot *slot = &st->slots[st->written % st->window];
+
+        if (slot->done) {
+            scribe_error_t err;
+
+            pthread_mutex_unlock(&st->mu);
+            err = emit_slot(st, slot);
+            free(slot->path);
+            free(slot->out);
+            memset(slot, 0, sizeof(*slot));
+            pthread_mutex_lock(&st->mu);
+            if (err != SCRIBE_OK) {
+                record_error(st, err);
+            }
+            st->written++;
+            st->documents++;
+        } else if (st->claimed < st->queued) {
+            render_next(st);
+        } else {
+            pthread_cond_wait(&st->done, &st->mu);
+        }
+    }
+}
+
+/*
+ * Queues one leaf for rendering, first making room in the window.
+ */
+static scribe_error_t queue_leaf(export_state *st, char op, const char *path, const uint8_t *blob) {
+    char *copy = strdup(path);
+    scribe_error_t err;
+
+    if (copy == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate export path");
+    }
+    pthread_mutex_lock(&st->mu);
+    drain(st, st->window - 1u);
+    err = st->err;
+    if (err == SCRIBE_OK) {
+        export_slot *slot = &st->slots[st->queued % st->window];
+
+        slot->path = copy;
+        slot->op = op;
+        if (blob != NULL) {
+            scribe_hash_copy(slot->blob, blob);
+        }
+        st->queued++;
+        copy = NULL;
+        pthread_cond_signal(&st->work);
+    }
+    pthread_mutex_unlock(&st->mu);
+    free(copy);
+    return err == SCRIBE_OK ? SCRIBE_OK : SCRIBE_ERR;
+}
+
+/*
+ * Diff visitor for range exports. A leaf whose new side is not a document
+ * (a blob replaced by a tree) is exported as deleted; the tree's leaves
+ * arrive as additions.
+ */
+static scribe_error_t export_visit(char status, const char *path, const uint8_t *old_blob, const uint8_t *new_blob,
+                                   void *user) {
+    (void)old_blob;
+    if (new_blob == NULL) {
+        status = 'D';
+    }
+    return queue_leaf((export_state *)user, status, path, new_blob);
+}
+
+/*
+ * Queues every document under a tree in storage order.
+ */
+static scribe_error_t walk_tree(export_state *st, const uint8_t tree[SCRIBE_HASH_SIZE], const char *prefix) {
+    scribe_arena arena = {0};
+    scribe_tree_entry *entries = NULL;
+    size_t count = 0;
+    size_t i;
+    scribe_error_t err = scribe_tree_read_logical(st->ctx, tree, &arena, &entries, &count);
+
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        char *path = (char *)malloc(strlen(prefix) + entries[i].name_len + 2u);
+
+        if (path == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate export path");
+            break;
+        }
+        if (prefix[0] != '\0') {
+            sprintf(path, "%s/%.*s", prefix, (int)entries[i].name_len, entries[i].name);
+        } else {
+            sprintf(path, "%.*s", (int)entries[i].name_len, entries[i].name);
+        }
+        if (entries[i].type == SCRIBE_OBJECT_TREE) {
+            err = walk_tree(st, entries[i].hash, path);
+        } else if (entries[i].type == SCRIBE_OBJECT_BLOB) {
+            err = queue_leaf(st, 'A', path, entries[i].hash);
+        } else {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "invalid tree entry type");
+        }
+        free(path);
+    }
+    scribe_arena_destroy(&arena);
+    return err;
+}
+
+/*
+ * Resolves `prefix` (the whole tree when empty) in a commit. A NULL commit
+ * stands for the empty history before the first commit.
+ */
+static scribe_error_t resolve_at(scribe_ctx *ctx, const uint8_t *commit, const char *prefix,
+                                 scribe_path_resolution *out) {
+    scribe_object obj;
+    scribe_arena arena = {0};
+    scribe_commit_view view;
+    scribe_error_t err;
+
+    memset(out, 0, sizeof(*out));
+    if (commit == NULL) {
+        return SCRIBE_OK;
+    }
+    err = scribe_object_read(ctx, commit, &obj);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_COMMIT) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_EINVAL, "export revision is not a commit");
+    }
+    err = scribe_arena_init(&arena, obj.payload_len + 4096u);
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view);
+    }
+    if (err == SCRIBE_OK && prefix[0] == '\0') {
+        out->state = SCRIBE_PATH_TREE;
+        scribe_hash_copy(out->hash, view.root_tree);
+    } else if (err == SCRIBE_OK) {
+        err = scribe_tree_resolve_path(ctx, view.root_tree, prefix, out);
+    }
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Runs the walk for a single revision or a range on the calling thread while
+ * workers render, then drains the window.
+ */
+static scribe_error_t export_walk(export_state *st, const char *rev, const char *prefix) {
+    const char *dots = strstr(rev, "..");
+    uint8_t tip[SCRIBE_HASH_SIZE];
+    uint8_t base[SCRIBE_HASH_SIZE];
+    scribe_path_resolution old_res;
+    scribe_path_resolution new_res;
+    scribe_error_t err = SCRIBE_OK;
+
+    if (dots != NULL && dots != rev) {
+        char *a = strndup(rev, (size_t)(dots - rev));
+
+        err = a == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate revision")
+                        : scribe_resolve_commit(st->ctx, a, base);
+        free(a);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_resolve_commit(st->ctx, dots == NULL ? rev : dots[2] == '\0' ? NULL : dots + 2, tip);
+    }
+    if (err == SCRIBE_OK) {
+        err = resolve_at(st->ctx, dots != NULL && dots != rev ? base : NULL, prefix, &old_res);
+    }
+    if (err == SCRIBE_OK) {
+        err = resolve_at(st->ctx, tip, prefix, &new_res);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (dots != NULL) {
+        return scribe_diff_walk_path(st->ctx, &old_res, &new_res, prefix, export_visit, st);
+    }
+    if (new_res.state == SCRIBE_PATH_BLOB) {
+        return queue_leaf(st, 'A', prefix, new_res.hash);
+    }
+    if (new_res.state == SCRIBE_PATH_TREE) {
+        return walk_tree(st, new_res.hash, prefix);
+    }
+    return scribe_set_error(SCRIBE_ENOT_FOUND, "path '%s' does not exist at %s", prefix, rev);
+}
+
+/*
+ * Implements `scribe export`. Documents under `path_prefix` at `rev` are
+ * written to stdout in path order; a `<a>..<b>` range writes only the changed
+ * ones, tagged with their operation. The document count goes to stderr.
+ * BSON output is refused up front unless the store writes sorted-BSON blobs.
+ */
+scribe_error_t scribe_cli_export(scribe_ctx *ctx, const char *rev, const char *path_prefix, int bson) {
+    pthread_t workers[63];
+    export_state st;
+    char *prefix;
+    unsigned threads = scribe_worker_count(ctx);
+    unsigned started = 0;
+    unsigned i;
+    size_t len;
+    scribe_error_t err;
+
+    if (bson && ctx->config.adapter_blob_format != SCRIBE_BLOB_FORMAT_BSON_SORTED) {
+        return scribe_set_error(SCRIBE_EINVAL,
+                                "export --format bson needs adapter.mongodb.blob_format = bson-sorted; this store "
+                                "writes JSON blobs, use --format ndjson");
+    }
+    memset(&st, 0, sizeof(st));
+    st.ctx = ctx;
+    st.bson = bson;
+    st.tagged = strstr(rev, "..") != NULL;
+    if (threads > 64u) {
+        threads = 64u;
+    }
+    st.window = (size_t)threads * EXPORT_SLOTS_PER_THREAD;
+    prefix = strdup(path_prefix == NULL ? "" : path_prefix);
+    st.slots = (export_slot *)calloc(st.window, sizeof(*st.slots));
+    st.buf = (char *)malloc(EXPORT_OUTPUT_BUFFER);
+    if (prefix == NULL || st.slots == NULL || st.buf == NULL) {
+        free(prefix);
+        free(st.slots);
+        free(st.buf);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate export state");
+    }
+    len = strlen(prefix);
+    while (len > 0 && prefix[len - 1u] == '/') {
+        prefix[--len] = '\0';
+    }
+    if (pthread_mutex_init(&st.mu, NULL) != 0 || pthread_cond_init(&st.work, NULL) != 0 ||
+        pthread_cond_init(&st.done, NULL) != 0) {
+        free(prefix);
+        free(st.slots);
+        free(st.buf);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize export workers");
+    }
+    while (started + 1u < threads && pthread_create(&workers[started], NULL, export_worker, &st) == 0) {
+        scribe_worker_pin(ctx, workers[started], started);
+        started++;
+    }
+    err = export_walk(&st, rev, prefix);
+    pthread_mutex_lock(&st.mu);
+    if (err != SCRIBE_OK && st.err == SCRIBE_OK) {
+        record_error(&st, err);
+    }
+    drain(&st, 0);
+    st.closing = 1;
+    pthread_cond_broadcast(&st.work);
+    pthread_mutex_unlock(&st.mu);
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    err = st.err;
+    if (err == SCRIBE_OK) {
+        err = flush_output(&st);
+    }
+    if (err == SCRIBE_OK && fflush(stdout) != 0) {
+        err = scribe_set_error(SCRIBE_EIO, "failed to write export output");
+    }
+    if (err == SCRIBE_OK) {
+        fprintf(stderr, "exported %llu document(s)\n", (unsigned long long)st.documents);
+    } else if (st.err != SCRIBE_OK) {
+        err = scribe_set_error(st.err, "%s", st.err_detail);
+    }
+    for (i = 0; i < st.window; i++) {
+        free(st.slots[i].path);
+        free(st.slots[i].out);
+    }
+    pthread_cond_destroy(&st.done);
+    pthread_cond_destroy(&st.work);
+    pthread_mutex_destroy(&st.mu);
+    free(st.slots);
+    free(st.buf);
+    free(prefix);
+    return err;
+}
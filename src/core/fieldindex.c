@@ -0,0 +1,1822 @@
+/*
+ * Secondary field indexes over history.
+ *
+ * A config line `index.<collection>.<field> = true` keeps an index of one
+ * field's values across every commit on main, so questions such as "which
+ * orders had status refunded at any time in this range" are answered from the
+ * index instead of reading blobs. The field is a dot-separated path of object
+ * keys, and it is indexed in every database that has the collection.
+ *
+ * Each index is a file `objects/info/field-index/<collection>.<field>` of
+ * records in the framing used for commit summaries (see commitstat.c), one
+ * per commit on main, oldest first:
+ *
+ *   body = commit hash | LEB128 ordinal | LEB128 posting count
+ *          | u32 LE offset per posting | postings
+ *   posting = LEB128-framed value | LEB128-framed path | u8 present
+ *
+ * The ordinal is the commit's position in main's chain, starting at 0. A
+ * present posting says the document at `path` holds `value` from this commit
+ * on; an absent posting says it stopped holding it here. Values are the raw
+ * JSON text of the field, rendered from canonical Extended JSON for
+ * sorted-BSON blobs. Postings in a record are sorted by value, then path, and
+ * the offsets (from the first posting) let a query binary-search a record for
+ * its value and skip records that do not mention it.
+ *
+ * Beside each index, `objects/info/field-index/values/<name>/` holds value
+ * files that map every value to the records that mention it, so a query reads
+ * only those records instead of every record up to the end of its range.
+ * Each file covers a run of records and is named `<first>-<count>` in hex:
+ *
+ *   u64 first ordinal | u64 record count | u64 value count
+ *   | per record: u64 offset in the index | commit hash
+ *   | u32 record number per record, sorted by commit hash
+ *   | u64 file offset per value, sorted by value
+ *   | per value: u32 length | value | u32 n | n u32 record numbers
+ *   | u64 file size
+ *
+ * with record numbers counted from the file's first ordinal. Files are never
+ * modified: catching up writes one for the new records, merged with the newest
+ * files while those cover fewer than twice as many, and unlinks what it
+ * replaced. A query follows the files that chain from ordinal 0 and reads the
+ * records after them in full.
+ *
+ * Publishing a commit on main only notes the new tip. Every
+ * SCRIBE_FIELD_INDEX_BATCH commits, after SCRIBE_FIELD_INDEX_LAG_MS, and when
+ * the writer closes, every index catches up from its last record to the tip,
+ * diffing each new commit against its parent and extracting the field only
+ * from the documents that changed. If main no
+ * longer contains the last indexed commit, as after compact-history, the index
+ * is rebuilt from the initial commit. Like the commit summaries, index files
+ * are caches and may be deleted at any time.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/leb128.h"
+#include "util/log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define VALUES_HEADER_SIZE 24u
+#define VALUES_ENTRY_SIZE (8u + SCRIBE_HASH_SIZE)
+#define VALUES_NAME_SIZE 34u
+
+typedef struct {
+    char *value;
+    size_t value_len;
+    char *path;
+    uint8_t present;
+} index_posting;
+
+typedef struct {
+    scribe_ctx *ctx;
+    const char *collection;
+    size_t collection_len;
+    const char *field;
+    index_posting *items;
+    size_t count;
+    size_t cap;
+} index_build;
+
+typedef struct {
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    uint8_t root[SCRIBE_HASH_SIZE];
+} index_commit;
+
+/*
+ * Reads a little-endian u32.
+ */
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Writes a little-endian u32.
+ */
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/*
+ * Returns the index file name for a configured "<collection>.<field>".
+ */
+static char *index_file_name(const char *name) {
+    char *file = (char *)malloc(strlen("field-index/") + strlen(name) + 1u);
+
+    if (file != NULL) {
+        sprintf(file, "field-index/%s", name);
+    }
+    return file;
+}
+
+/*
+ * Reads a commit's root tree and parent.
+ */
+static scribe_error_t read_commit(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                  uint8_t root[SCRIBE_HASH_SIZE], uint8_t parent[SCRIBE_HASH_SIZE], int *has_parent) {
+    scribe_object obj;
+    scribe_arena arena = {0};
+    scribe_commit_view view;
+    scribe_error_t err = scribe_object_read(ctx, hash, &obj);
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_COMMIT) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "object is not a commit");
+    }
+    err = scribe_arena_init(&arena, 4096);
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view);
+    }
+    if (err == SCRIBE_OK) {
+        scribe_hash_copy(root, view.root_tree);
+        scribe_hash_copy(parent, view.parent);
+        *has_parent = view.has_parent;
+    }
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Extracts the indexed field from a blob into a heap copy of its JSON text.
+ * *value is NULL when the document lacks the field or is not JSON; such
+ * documents are simply not indexed.
+ */
+static scribe_error_t blob_field(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], const char *field,
+                                 char **value, size_t *value_len) {
+    scribe_object obj;
+    char *json = NULL;
+    const char *doc;
+    const char *found = NULL;
+    size_t doc_len;
+    size_t found_len = 0;
+    scribe_error_t err = scribe_object_read(ctx, hash, &obj);
+
+    *value = NULL;
+    *value_len = 0;
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    doc = (const char *)obj.payload;
+    doc_len = obj.payload_len;
+    if (scribe_bson_is_document(obj.payload, obj.payload_len)) {
+        err = scribe_bson_to_json(obj.payload, obj.payload_len, &json, &doc_len);
+        doc = json;
+    }
+    if (err == SCRIBE_OK && scribe_json_get_field(doc, doc_len, field, &found, &found_len) != SCRIBE_OK) {
+        found = NULL;
+    }
+    if (err == SCRIBE_OK && found != NULL) {
+        *value = (char *)malloc(found_len == 0 ? 1u : found_len);
+        if (*value == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index value");
+        } else {
+            memcpy(*value, found, found_len);
+            *value_len = found_len;
+        }
+    }
+    free(json);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Adds one posting, taking ownership of `value`.
+ */
+static scribe_error_t add_posting(index_build *b, char *value, size_t value_len, const char *path, uint8_t present) {
+    index_posting *p;
+
+    if (b->count == b->cap) {
+        size_t cap = b->cap == 0 ? 16u : b->cap * 2u;
+        index_posting *grown = (index_posting *)realloc(b->items, cap * sizeof(*grown));
+
+        if (grown == NULL) {
+            free(value);
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow index postings");
+        }
+        b->items = grown;
+        b->cap = cap;
+    }
+    p = &b->items[b->count];
+    p->path = strdup(path);
+    if (p->path == NULL) {
+        free(value);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index path");
+    }
+    p->value = value;
+    p->value_len = value_len;
+    p->present = present;
+    b->count++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees every posting and empties the list.
+ */
+static void postings_clear(index_build *b) {
+    size_t i;
+
+    for (i = 0; i < b->count; i++) {
+        free(b->items[i].value);
+        free(b->items[i].path);
+    }
+    b->count = 0;
+}
+
+/*
+ * Diff visitor: for each changed document of the indexed collection, the old
+ * value (if any) becomes absent and the new value (if any) present. A change
+ * that keeps the field's value produces no postings.
+ */
+static scribe_error_t index_visit(char status, const char *path, const uint8_t *old_blob, const uint8_t *new_blob,
+                                  void *user) {
+    index_build *b = (index_build *)user;
+    const char *collection = strchr(path, '/');
+    const char *rest = collection == NULL ? NULL : strchr(collection + 1, '/');
+    char *old_value = NULL;
+    char *new_value = NULL;
+    size_t old_len = 0;
+    size_t new_len = 0;
+    scribe_error_t err = SCRIBE_OK;
+
+    (void)status;
+    if (rest == NULL || (size_t)(rest - collection - 1) != b->collection_len ||
+        memcmp(collection + 1, b->collection, b->collection_len) != 0) {
+        return SCRIBE_OK;
+    }
+    if (old_blob != NULL) {
+        err = blob_field(b->ctx, old_blob, b->field, &old_value, &old_len);
+    }
+    if (err == SCRIBE_OK && new_blob != NULL) {
+        err = blob_field(b->ctx, new_blob, b->field, &new_value, &new_len);
+    }
+    if (err == SCRIBE_OK && old_value != NULL && new_value != NULL && old_len == new_len &&
+        memcmp(old_value, new_value, old_len) == 0) {
+        free(old_value);
+        free(new_value);
+        return SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK && old_value != NULL) {
+        err = add_posting(b, old_value, old_len, path, 0);
+        old_value = NULL;
+    }
+    if (err == SCRIBE_OK && new_value != NULL) {
+        err = add_posting(b, new_value, new_len, path, 1);
+        new_value = NULL;
+    }
+    free(old_value);
+    free(new_value);
+    return err;
+}
+
+/*
+ * Orders two values bytewise, shorter first on a common prefix.
+ */
+static int value_compare(const char *a, size_t a_len, const char *b, size_t b_len) {
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+    if (cmp != 0) {
+        return cmp;
+    }
+    return a_len < b_len ? -1 : a_len > b_len;
+}
+
+/*
+ * Orders postings by value, then path, then absent before present.
+ */
+static int posting_compare(const void *a, const void *b) {
+    const index_posting *x = (const index_posting *)a;
+    const index_posting *y = (const index_posting *)b;
+    int cmp = value_compare(x->value, x->value_len, y->value, y->value_len);
+
+    if (cmp == 0) {
+        cmp = strcmp(x->path, y->path);
+    }
+    return cmp != 0 ? cmp : (int)x->present - (int)y->present;
+}
+
+/*
+ * Serializes one commit's postings as a complete record.
+ */
+static scribe_error_t encode_record(const uint8_t commit[SCRIBE_HASH_SIZE], uint64_t ordinal, const index_build *b,
+                                    uint8_t **out, size_t *out_len) {
+    uint8_t leb[10];
+    size_t len = SCRIBE_HASH_SIZE + scribe_leb128_encode(ordinal, leb) + scribe_leb128_encode(b->count, leb);
+    size_t offsets;
+    size_t pos;
+    size_t i;
+    uint8_t *buf;
+
+    if (b->count > UINT32_MAX / 4u) {
+        return scribe_set_error(SCRIBE_ENOMEM, "field index record is too large");
+    }
+    len += b->count * 4u;
+
+    for (i = 0; i < b->count; i++) {
+        size_t path_len = strlen(b->items[i].path);
+
+        len += scribe_leb128_encode(b->items[i].value_len, leb) + b->items[i].value_len;
+        len += scribe_leb128_encode(path_len, leb) + path_len + 1u;
+    }
+    if (len > UINT32_MAX) {
+        return scribe_set_error(SCRIBE_ENOMEM, "field index record is too large");
+    }
+    buf = (uint8_t *)malloc(len + SCRIBE_INFO_RECORD_OVERHEAD);
+    if (buf == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate field index record");
+    }
+    memcpy(buf + 4u, commit, SCRIBE_HASH_SIZE);
+    pos = 4u + SCRIBE_HASH_SIZE;
+    pos += scribe_leb128_encode(ordinal, buf + pos);
+    pos += scribe_leb128_encode(b->count, buf + pos);
+    offsets = pos;
+    pos += b->count * 4u;
+    for (i = 0; i < b->count; i++) {
+        const index_posting *p = &b->items[i];
+        size_t path_len = strlen(p->path);
+
+        put_u32(buf + offsets + i * 4u, (uint32_t)(pos - offsets - b->count * 4u));
+        pos += scribe_leb128_encode(p->value_len, buf + pos);
+        memcpy(buf + pos, p->value, p->value_len);
+        pos += p->value_len;
+        pos += scribe_leb128_encode(path_len, buf + pos);
+        memcpy(buf + pos, p->path, path_len);
+        pos += path_len;
+        buf[pos++] = p->present;
+    }
+    scribe_info_record_seal(buf, len);
+    *out = buf;
+    *out_len = len + SCRIBE_INFO_RECORD_OVERHEAD;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads one LEB128 value from a record body.
+ */
+static scribe_error_t body_uint(const uint8_t *body, size_t len, size_t *pos, uint64_t *out) {
+    size_t used = 0;
+
+    if (*pos >= len || scribe_leb128_decode(body + *pos, len - *pos, out, &used) != SCRIBE_OK) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid field index record");
+    }
+    *pos += used;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads one LEB128-framed byte string from a record body without copying it.
+ */
+static scribe_error_t body_bytes(const uint8_t *body, size_t len, size_t *pos, const char **out, size_t *out_len) {
+    uint64_t n = 0;
+    scribe_error_t err = body_uint(body, len, pos, &n);
+
+    if (err == SCRIBE_OK && n > len - *pos) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index record");
+    }
+    if (err == SCRIBE_OK) {
+        *out = (const char *)(body + *pos);
+        *out_len = (size_t)n;
+        *pos += (size_t)n;
+    }
+    return err;
+}
+
+/*
+ * One commit record of an index, as a body pointer into a buffer.
+ */
+typedef struct {
+    const uint8_t *body;
+    size_t len;
+} index_record;
+
+/*
+ * One value file: a run of `count` records starting at ordinal `first`.
+ */
+typedef struct {
+    int fd;
+    uint64_t first;
+    uint64_t count;
+    uint64_t values;
+    uint64_t size;
+    char file[VALUES_NAME_SIZE];
+} values_run;
+
+/*
+ * The value files that chain from ordinal 0, and the index offset just past
+ * the last record they cover. Records from there on are the uncovered tail.
+ */
+typedef struct {
+    values_run *runs;
+    size_t count;
+    uint64_t covered;
+    uint64_t next_off;
+} values_chain;
+
+/*
+ * The names found in a value directory.
+ */
+typedef struct {
+    char (*files)[VALUES_NAME_SIZE];
+    size_t count;
+    size_t cap;
+} values_listing;
+
+/*
+ * One (value, record) pair collected while building a value file.
+ */
+typedef struct {
+    const char *value;
+    size_t value_len;
+    uint32_t record;
+} values_pair;
+
+/*
+ * One record's commit hash and its position in a value file being built.
+ */
+typedef struct {
+    const uint8_t *hash;
+    uint32_t record;
+} values_key;
+
+/*
+ * Reads a little-endian u64.
+ */
+static uint64_t get_u64(const uint8_t *p) {
+    return (uint64_t)get_u32(p) | ((uint64_t)get_u32(p + 4u) << 32);
+}
+
+/*
+ * Writes a little-endian u64.
+ */
+static void put_u64(uint8_t *p, uint64_t v) {
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4u, (uint32_t)(v >> 32));
+}
+
+/*
+ * Reads exactly `len` bytes at `off`.
+ */
+static scribe_error_t read_at(int fd, uint64_t off, void *buf, size_t len) {
+    if (pread(fd, buf, len, (off_t)off) != (ssize_t)len) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "truncated field index file");
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the value directory of index `name`.
+ */
+static char *values_dir(scribe_ctx *ctx, const char *name) {
+    char *root = scribe_path_join(ctx->repo_path, "objects/info/field-index/values");
+    char *dir = root == NULL ? NULL : scribe_path_join(root, name);
+
+    free(root);
+    return dir;
+}
+
+/*
+ * Reads the record at `off` of an index into a heap buffer and checks that it
+ * is intact and holds `ordinal`.
+ */
+static scribe_error_t read_record(int fd, uint64_t off, uint64_t ordinal, uint8_t **buf, index_record *rec) {
+    uint8_t prefix[4];
+    uint64_t got = 0;
+    size_t pos = SCRIBE_HASH_SIZE;
+    size_t total;
+    scribe_error_t err = read_at(fd, off, prefix, sizeof(prefix));
+
+    *buf = NULL;
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    total = (size_t)get_u32(prefix) + SCRIBE_INFO_RECORD_OVERHEAD;
+    *buf = (uint8_t *)malloc(total);
+    if (*buf == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate field index record");
+    }
+    err = read_at(fd, off, *buf, total);
+    if (err == SCRIBE_OK && scribe_info_record_at(*buf, total, 0) != total) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "damaged field index record");
+    }
+    if (err == SCRIBE_OK) {
+        rec->body = *buf + 4u;
+        rec->len = total - SCRIBE_INFO_RECORD_OVERHEAD;
+        err = body_uint(rec->body, rec->len, &pos, &got);
+    }
+    if (err == SCRIBE_OK && got != ordinal) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "field index record is out of place");
+    }
+    return err;
+}
+
+/*
+ * Reads entry `i` of a value file: the index offset and commit hash of record
+ * first + i.
+ */
+static scribe_error_t run_entry(const values_run *run, uint64_t i, uint64_t *off, uint8_t hash[SCRIBE_HASH_SIZE]) {
+    uint8_t entry[VALUES_ENTRY_SIZE];
+    scribe_error_t err = read_at(run->fd, VALUES_HEADER_SIZE + i * VALUES_ENTRY_SIZE, entry, sizeof(entry));
+
+    if (err == SCRIBE_OK) {
+        *off = get_u64(entry);
+        memcpy(hash, entry + 8u, SCRIBE_HASH_SIZE);
+    }
+    return err;
+}
+
+/*
+ * Opens value file `file` and checks its name, header, and trailer against its
+ * size. Returns 1 when it is usable.
+ */
+static int run_open(const char *dir, const char *file, values_run *run) {
+    char *path = scribe_path_join(dir, file);
+    uint8_t header[VALUES_HEADER_SIZE];
+    uint8_t trailer[8];
+    char name[VALUES_NAME_SIZE];
+    struct stat st;
+    uint64_t fixed;
+
+    run->fd = path == NULL ? -1 : open(path, O_RDONLY | O_CLOEXEC);
+    free(path);
+    if (run->fd < 0) {
+        return 0;
+    }
+    if (fstat(run->fd, &st) != 0 || st.st_size < (off_t)(VALUES_HEADER_SIZE + 8u) ||
+        read_at(run->fd, 0, header, sizeof(header)) != SCRIBE_OK ||
+        read_at(run->fd, (uint64_t)st.st_size - 8u, trailer, sizeof(trailer)) != SCRIBE_OK) {
+        close(run->fd);
+        run->fd = -1;
+        return 0;
+    }
+    run->first = get_u64(header);
+    run->count = get_u64(header + 8u);
+    run->values = get_u64(header + 16u);
+    run->size = (uint64_t)st.st_size;
+    fixed = VALUES_HEADER_SIZE + 8u;
+    snprintf(name, sizeof(name), "%016" PRIx64 "-%016" PRIx64, run->first, run->count);
+    if (strcmp(name, file) != 0 || get_u64(trailer) != run->size || run->count == 0 ||
+        run->count > (run->size - fixed) / (VALUES_ENTRY_SIZE + 4u) ||
+        run->values > (run->size - fixed - run->count * (VALUES_ENTRY_SIZE + 4u)) / 8u) {
+        close(run->fd);
+        run->fd = -1;
+        return 0;
+    }
+    snprintf(run->file, sizeof(run->file), "%s", file);
+    return 1;
+}
+
+/*
+ * Closes every value file of a chain.
+ */
+static void chain_free(values_chain *chain) {
+    size_t i;
+
+    for (i = 0; i < chain->count; i++) {
+        close(chain->runs[i].fd);
+    }
+    free(chain->runs);
+    memset(chain, 0, sizeof(*chain));
+}
+
+/*
+ * Directory visitor: collects the names of value files.
+ */
+static scribe_error_t listing_add(const char *name, void *user) {
+    values_listing *l = (values_listing *)user;
+
+    if (strlen(name) != VALUES_NAME_SIZE - 1u) {
+        return SCRIBE_OK;
+    }
+    if (l->count == l->cap) {
+        size_t cap = l->cap == 0 ? 16u : l->cap * 2u;
+        char(*grown)[VALUES_NAME_SIZE] = realloc(l->files, cap * sizeof(*grown));
+
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to list field index values");
+        }
+        l->files = grown;
+        l->cap = cap;
+    }
+    memcpy(l->files[l->count++], name, VALUES_NAME_SIZE);
+    return SCRIBE_OK;
+}
+
+/*
+ * Lists a value directory and links the longest usable file at each ordinal
+ * into a chain from 0. The chain is kept only if its last record is still the
+ * index's record at that ordinal, so value files left from before the index
+ * was rebuilt are never used. used[i] is set for listing entries in the chain.
+ */
+static scribe_error_t chain_load(const char *dir, int index_fd, values_chain *chain, values_listing *listing,
+                                 uint8_t **used) {
+    scribe_error_t err;
+
+    memset(chain, 0, sizeof(*chain));
+    memset(listing, 0, sizeof(*listing));
+    *used = NULL;
+    err = scribe_list_dir(dir, listing_add, listing);
+    if (err == SCRIBE_ENOT_FOUND) {
+        return SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK && listing->count != 0) {
+        *used = (uint8_t *)calloc(listing->count, 1u);
+        chain->runs = (values_run *)malloc(listing->count * sizeof(*chain->runs));
+        err = *used == NULL || chain->runs == NULL
+                  ? scribe_set_error(SCRIBE_ENOMEM, "failed to load field index values")
+                  : SCRIBE_OK;
+    }
+    while (err == SCRIBE_OK) {
+        values_run best;
+        size_t pick = listing->count;
+        size_t i;
+
+        best.fd = -1;
+        best.count = 0;
+        for (i = 0; i < listing->count; i++) {
+            values_run run;
+
+            if (!(*used)[i] && strtoull(listing->files[i], NULL, 16) == chain->covered &&
+                run_open(dir, listing->files[i], &run)) {
+                if (run.count > best.count) {
+                    if (best.fd >= 0) {
+                        close(best.fd);
+                    }
+                    best = run;
+                    pick = i;
+                } else {
+                    close(run.fd);
+                }
+            }
+        }
+        if (pick == listing->count) {
+            break;
+        }
+        (*used)[pick] = 1;
+        chain->runs[chain->count++] = best;
+        chain->covered += best.count;
+    }
+    if (err == SCRIBE_OK && chain->count != 0) {
+        const values_run *last = &chain->runs[chain->count - 1u];
+        uint8_t hash[SCRIBE_HASH_SIZE];
+        uint8_t *buf = NULL;
+        index_record rec;
+        uint64_t off = 0;
+
+        if (run_entry(last, last->count - 1u, &off, hash) == SCRIBE_OK &&
+            read_record(index_fd, off, chain->covered - 1u, &buf, &rec) == SCRIBE_OK &&
+            scribe_hash_cmp(rec.body, hash) == 0) {
+            chain->next_off = off + rec.len + SCRIBE_INFO_RECORD_OVERHEAD;
+        } else {
+            chain_free(chain);
+            memset(*used, 0, listing->count);
+        }
+        free(buf);
+    }
+    return err;
+}
+
+/*
+ * Counts the intact records at the start of `bytes`, which must hold
+ * consecutive ordinals from `first`.
+ */
+static uint64_t records_intact(const uint8_t *bytes, size_t len, uint64_t first) {
+    uint64_t count = 0;
+    size_t off = 0;
+    size_t n;
+
+    while ((n = scribe_info_record_at(bytes, len, off)) != 0 && count < UINT32_MAX) {
+        size_t pos = SCRIBE_HASH_SIZE;
+        uint64_t ordinal = 0;
+
+        if (body_uint(bytes + off + 4u, n - SCRIBE_INFO_RECORD_OVERHEAD, &pos, &ordinal) != SCRIBE_OK ||
+            ordinal != first + count) {
+            break;
+        }
+        count++;
+        off += n;
+    }
+    return count;
+}
+
+/*
+ * Orders build pairs by value, then record.
+ */
+static int pair_compare(const void *a, const void *b) {
+    const values_pair *x = (const values_pair *)a;
+    const values_pair *y = (const values_pair *)b;
+    int cmp = value_compare(x->value, x->value_len, y->value, y->value_len);
+
+    if (cmp != 0) {
+        return cmp;
+    }
+    return x->record < y->record ? -1 : x->record > y->record;
+}
+
+/*
+ * Orders build keys by commit hash.
+ */
+static int values_key_compare(const void *a, const void *b) {
+    return scribe_hash_cmp(((const values_key *)a)->hash, ((const values_key *)b)->hash);
+}
+
+/*
+ * Collects one (value, record) pair per distinct value in each of the first
+ * `count` records of `bytes`, and each record's key.
+ */
+static scribe_error_t run_collect(const uint8_t *bytes, size_t len, uint64_t count, values_key *keys,
+                                  values_pair **pairs, size_t *pair_count) {
+    size_t cap = 0;
+    size_t off = 0;
+    uint64_t r;
+    scribe_error_t err = SCRIBE_OK;
+
+    *pairs = NULL;
+    *pair_count = 0;
+    for (r = 0; err == SCRIBE_OK && r < count; r++) {
+        const uint8_t *body = bytes + off + 4u;
+        size_t n = scribe_info_record_at(bytes, len, off);
+        size_t body_len = n - SCRIBE_INFO_RECORD_OVERHEAD;
+        size_t pos = SCRIBE_HASH_SIZE;
+        const char *prev = NULL;
+        size_t prev_len = 0;
+        uint64_t postings = 0;
+        uint64_t ordinal = 0;
+        uint64_t i;
+
+        keys[r].hash = body;
+        keys[r].record = (uint32_t)r;
+        err = body_uint(body, body_len, &pos, &ordinal);
+        if (err == SCRIBE_OK) {
+            err = body_uint(body, body_len, &pos, &postings);
+        }
+        if (err == SCRIBE_OK && postings > (body_len - pos) / 4u) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index record");
+        }
+        pos += (size_t)postings * 4u;
+        for (i = 0; err == SCRIBE_OK && i < postings; i++) {
+            const char *v = NULL;
+            const char *path = NULL;
+            size_t v_len = 0;
+            size_t path_len = 0;
+
+            err = body_bytes(body, body_len, &pos, &v, &v_len);
+            if (err == SCRIBE_OK) {
+                err = body_bytes(body, body_len, &pos, &path, &path_len);
+            }
+            if (err == SCRIBE_OK && pos++ >= body_len) {
+                err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index record");
+            }
+            if (err != SCRIBE_OK || (prev != NULL && value_compare(prev, prev_len, v, v_len) == 0)) {
+                continue;
+            }
+            if (*pair_count == cap) {
+                size_t grown_cap = cap == 0 ? 256u : cap * 2u;
+                values_pair *grown = (values_pair *)realloc(*pairs, grown_cap * sizeof(*grown));
+
+                if (grown == NULL) {
+                    err = scribe_set_error(SCRIBE_ENOMEM, "failed to grow field index values");
+                    break;
+                }
+                *pairs = grown;
+                cap = grown_cap;
+            }
+            (*pairs)[*pair_count].value = v;
+            (*pairs)[*pair_count].value_len = v_len;
+            (*pairs)[*pair_count].record = (uint32_t)r;
+            (*pair_count)++;
+            prev = v;
+            prev_len = v_len;
+        }
+        off += n;
+    }
+    return err;
+}
+
+/*
+ * Encodes a value file for the first `count` records of `bytes`, which start
+ * at index offset `base` with ordinal `first`.
+ */
+static scribe_error_t run_encode(const uint8_t *bytes, size_t len, uint64_t base, uint64_t first, uint64_t count,
+                                 uint8_t **out, size_t *out_len) {
+    values_key *keys = (values_key *)malloc((size_t)count * sizeof(*keys));
+    values_pair *pairs = NULL;
+    size_t pair_count = 0;
+    size_t values = 0;
+    size_t size;
+    size_t table;
+    size_t pos;
+    size_t off = 0;
+    size_t i;
+    uint8_t *buf = NULL;
+    scribe_error_t err = keys == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate field index values")
+                                      : run_collect(bytes, len, count, keys, &pairs, &pair_count);
+
+    if (err == SCRIBE_OK) {
+        qsort(pairs, pair_count, sizeof(*pairs), pair_compare);
+        size = VALUES_HEADER_SIZE + (size_t)count * (VALUES_ENTRY_SIZE + 4u) + 8u;
+        for (i = 0; i < pair_count; i++) {
+            if (i == 0 || value_compare(pairs[i - 1u].value, pairs[i - 1u].value_len, pairs[i].value,
+                                        pairs[i].value_len) != 0) {
+                values++;
+                size += 8u + 4u + pairs[i].value_len + 4u;
+            }
+            size += 4u;
+        }
+        buf = (uint8_t *)malloc(size);
+        err = buf == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate field index values") : SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK) {
+        put_u64(buf, first);
+        put_u64(buf + 8u, count);
+        put_u64(buf + 16u, values);
+        pos = VALUES_HEADER_SIZE;
+        for (i = 0; i < (size_t)count; i++) {
+            put_u64(buf + pos, base + off);
+            memcpy(buf + pos + 8u, keys[i].hash, SCRIBE_HASH_SIZE);
+            pos += VALUES_ENTRY_SIZE;
+            off += scribe_info_record_at(bytes, len, off);
+        }
+        qsort(keys, (size_t)count, sizeof(*keys), values_key_compare);
+        for (i = 0; i < (size_t)count; i++) {
+            put_u32(buf + pos, keys[i].record);
+            pos += 4u;
+        }
+        table = pos;
+        pos += values * 8u;
+        for (i = 0; i < pair_count;) {
+            size_t j = i;
+
+            put_u64(buf + table, pos);
+            table += 8u;
+            put_u32(buf + pos, (uint32_t)pairs[i].value_len);
+            memcpy(buf + pos + 4u, pairs[i].value, pairs[i].value_len);
+            pos += 4u + pairs[i].value_len + 4u;
+            while (j < pair_count && value_compare(pairs[i].value, pairs[i].value_len, pairs[j].value,
+                                                   pairs[j].value_len) == 0) {
+                put_u32(buf + pos, pairs[j].record);
+                pos += 4u;
+                j++;
+            }
+            put_u32(buf + pos - 4u * (j - i) - 4u, (uint32_t)(j - i));
+            i = j;
+        }
+        put_u64(buf + pos, size);
+        *out = buf;
+        *out_len = size;
+    }
+    free(pairs);
+    free(keys);
+    return err;
+}
+
+/*
+ * Brings the value files of index `name` up to its last intact record. New
+ * records get a file of their own, merged with the newest files while those
+ * cover fewer than twice as many records, so a run is rewritten O(log n)
+ * times and a query opens O(log n) files. Unlinked files stay readable by
+ * queries that already opened them. The files are a cache, so failures are
+ * logged.
+ */
+static void values_update(scribe_ctx *ctx, const char *name, int index_fd) {
+    char *dir = values_dir(ctx, name);
+    values_chain chain;
+    values_listing listing;
+    uint8_t *used = NULL;
+    uint8_t *bytes = NULL;
+    uint8_t *run = NULL;
+    size_t run_len = 0;
+    struct stat st;
+    uint64_t start;
+    uint64_t first;
+    uint64_t merged;
+    uint64_t count;
+    size_t keep;
+    size_t i;
+    scribe_error_t err = dir == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index values path")
+                                     : chain_load(dir, index_fd, &chain, &listing, &used);
+
+    for (i = 0; err == SCRIBE_OK && i < listing.count; i++) {
+        if (!used[i]) {
+            char *stale = scribe_path_join(dir, listing.files[i]);
+
+            if (stale != NULL) {
+                unlink(stale);
+            }
+            free(stale);
+        }
+    }
+    if (err == SCRIBE_OK && fstat(index_fd, &st) != 0) {
+        err = scribe_set_error(SCRIBE_EIO, "failed to stat field index %s", name);
+    }
+    if (err != SCRIBE_OK || (uint64_t)st.st_size <= chain.next_off) {
+        goto done;
+    }
+    bytes = (uint8_t *)malloc((size_t)((uint64_t)st.st_size - chain.next_off));
+    err = bytes == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to read field index %s", name)
+                        : read_at(index_fd, chain.next_off, bytes, (size_t)((uint64_t)st.st_size - chain.next_off));
+    count = err == SCRIBE_OK ? records_intact(bytes, (size_t)((uint64_t)st.st_size - chain.next_off),
+                                              chain.covered)
+                             : 0;
+    if (count == 0) {
+        goto done;
+    }
+    keep = chain.count;
+    merged = count;
+    while (keep > 0 && chain.runs[keep - 1u].count < 2u * merged && merged + chain.runs[keep - 1u].count < UINT32_MAX) {
+        merged += chain.runs[--keep].count;
+    }
+    start = chain.next_off;
+    first = chain.covered;
+    if (keep < chain.count) {
+        uint8_t hash[SCRIBE_HASH_SIZE];
+
+        first = chain.runs[keep].first;
+        err = run_entry(&chain.runs[keep], 0, &start, hash);
+        free(bytes);
+        bytes = err == SCRIBE_OK ? (uint8_t *)malloc((size_t)((uint64_t)st.st_size - start)) : NULL;
+        if (err == SCRIBE_OK) {
+            err = bytes == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to read field index %s", name)
+                                : read_at(index_fd, start, bytes, (size_t)((uint64_t)st.st_size - start));
+        }
+        if (err == SCRIBE_OK && records_intact(bytes, (size_t)((uint64_t)st.st_size - start), first) < merged) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "field index %s changed while indexing values", name);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = run_encode(bytes, (size_t)((uint64_t)st.st_size - start), start, first, merged, &run, &run_len);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_mkdir_p(dir);
+    }
+    if (err == SCRIBE_OK) {
+        char file[VALUES_NAME_SIZE];
+        char *path;
+
+        snprintf(file, sizeof(file), "%016" PRIx64 "-%016" PRIx64, first, merged);
+        path = scribe_path_join(dir, file);
+        err = path == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index values path")
+                           : scribe_write_file_atomic_flags(path, run, run_len, SCRIBE_WRITE_NOSYNC);
+        free(path);
+    }
+    for (i = keep; err == SCRIBE_OK && i < chain.count; i++) {
+        char *merged_path = scribe_path_join(dir, chain.runs[i].file);
+
+        if (merged_path != NULL) {
+            unlink(merged_path);
+        }
+        free(merged_path);
+    }
+done:
+    if (err != SCRIBE_OK) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "index", "failed to update values of field index %s: %s", name,
+                       scribe_last_error_detail());
+    }
+    if (dir != NULL) {
+        chain_free(&chain);
+        free(listing.files);
+    }
+    free(used);
+    free(run);
+    free(bytes);
+    free(dir);
+}
+
+/*
+ * Brings one index up to date with `tip`, appending a record for every
+ * commit after the last indexed one. *added receives the number of records
+ * written.
+ */
+static scribe_error_t index_update(scribe_ctx *ctx, const char *name, const uint8_t tip[SCRIBE_HASH_SIZE],
+                                   size_t *added) {
+    index_build b;
+    index_commit *chain = NULL;
+    size_t count = 0;
+    size_t cap = 0;
+    uint8_t *last = NULL;
+    size_t last_len = 0;
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    uint8_t prev_root[SCRIBE_HASH_SIZE];
+    uint64_t ordinal = 0;
+    char *file = index_file_name(name);
+    int found = 0;
+    int has_prev = 0;
+    int fd = -1;
+    scribe_error_t err = file == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index name") : SCRIBE_OK;
+
+    *added = 0;
+    memset(&b, 0, sizeof(b));
+    b.ctx = ctx;
+    b.collection = name;
+    b.field = strchr(name, '.') + 1;
+    b.collection_len = (size_t)(b.field - name - 1);
+    if (err == SCRIBE_OK) {
+        err = scribe_info_open(ctx, file, &fd, &last, &last_len);
+    }
+    /* Walk back from the tip to the last indexed commit. */
+    scribe_hash_copy(hash, tip);
+    while (err == SCRIBE_OK) {
+        int has_parent = 0;
+        uint8_t parent[SCRIBE_HASH_SIZE];
+
+        if (last != NULL && scribe_hash_cmp(hash, last + 4u) == 0) {
+            found = 1;
+            break;
+        }
+        if (count == cap) {
+            index_commit *grown;
+
+            cap = cap == 0 ? 16u : cap * 2u;
+            grown = (index_commit *)realloc(chain, cap * sizeof(*grown));
+            if (grown == NULL) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "failed to grow index chain");
+                break;
+            }
+            chain = grown;
+        }
+        scribe_hash_copy(chain[count].hash, hash);
+        err = read_commit(ctx, hash, chain[count].root, parent, &has_parent);
+        count++;
+        if (!has_parent) {
+            break;
+        }
+        scribe_hash_copy(hash, parent);
+    }
+    if (err == SCRIBE_OK && found) {
+        size_t pos = SCRIBE_HASH_SIZE;
+        int unused = 0;
+
+        err = body_uint(last + 4u, last_len - SCRIBE_INFO_RECORD_OVERHEAD, &pos, &ordinal);
+        if (err == SCRIBE_OK) {
+            err = read_commit(ctx, last + 4u, prev_root, hash, &unused);
+            ordinal++;
+            has_prev = 1;
+        }
+    } else if (err == SCRIBE_OK && last != NULL) {
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "index", "rebuilding field index %s: main was rewritten", name);
+        if (ftruncate(fd, 0) != 0) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to reset field index %s", name);
+        }
+    }
+    while (err == SCRIBE_OK && count > 0) {
+        index_commit *c = &chain[--count];
+        uint8_t *record = NULL;
+        size_t record_len = 0;
+
+        err = scribe_diff_walk(ctx, has_prev ? prev_root : NULL, c->root, "", index_visit, &b);
+        if (err == SCRIBE_OK) {
+            qsort(b.items, b.count, sizeof(*b.items), posting_compare);
+            err = encode_record(c->hash, ordinal, &b, &record, &record_len);
+        }
+        if (err == SCRIBE_OK && write(fd, record, record_len) != (ssize_t)record_len) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to append to field index %s", name);
+        }
+        free(record);
+        postings_clear(&b);
+        scribe_hash_copy(prev_root, c->root);
+        has_prev = 1;
+        ordinal++;
+        (*added)++;
+    }
+    postings_clear(&b);
+    free(b.items);
+    if (err == SCRIBE_OK) {
+        values_update(ctx, name, fd);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(chain);
+    free(last);
+    free(file);
+    return err;
+}
+
+/*
+ * Returns a monotonic clock reading in milliseconds.
+ */
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+/*
+ * Brings every configured index up to main's last published tip. The commits
+ * are already visible and the indexes are caches, so failures are logged; the
+ * next catch-up or `scribe index update` retries. Called by scribe_close().
+ */
+void scribe_field_index_flush(scribe_ctx *ctx) {
+    scribe_index_lag *lag = &ctx->index_lag;
+    size_t i;
+
+    if (lag->pending == 0) {
+        return;
+    }
+    for (i = 0; i < ctx->config.field_index_count; i++) {
+        size_t added = 0;
+
+        if (index_update(ctx, ctx->config.field_indexes[i], lag->tip, &added) != SCRIBE_OK) {
+            scribe_log_msg(ctx, SCRIBE_LOG_WARN, "index", "failed to update field index %s: %s",
+                           ctx->config.field_indexes[i], scribe_last_error_detail());
+        }
+    }
+    lag->pending = 0;
+    lag->caught_up_ms = monotonic_ms();
+}
+
+/*
+ * Notes a commit published on main. Catching up diffs and reads every changed
+ * document, so it runs once per SCRIBE_FIELD_INDEX_BATCH commits or
+ * SCRIBE_FIELD_INDEX_LAG_MS rather than on every publish.
+ */
+void scribe_field_index_record(scribe_ctx *ctx, const uint8_t commit[SCRIBE_HASH_SIZE]) {
+    scribe_index_lag *lag = &ctx->index_lag;
+
+    if (ctx->config.field_index_count == 0) {
+        return;
+    }
+    scribe_hash_copy(lag->tip, commit);
+    lag->pending++;
+    if (lag->pending >= SCRIBE_FIELD_INDEX_BATCH || monotonic_ms() - lag->caught_up_ms >= SCRIBE_FIELD_INDEX_LAG_MS) {
+        scribe_field_index_flush(ctx);
+    }
+}
+
+/*
+ * Implements `scribe index update`: brings every configured index up to date
+ * with main and reports how many commits each one gained.
+ */
+scribe_error_t scribe_cli_index_update(scribe_ctx *ctx) {
+    uint8_t head[SCRIBE_HASH_SIZE];
+    size_t i;
+    scribe_error_t err = scribe_refs_read(ctx, "refs/heads/main", head);
+
+    if (err == SCRIBE_ENOT_FOUND) {
+        return SCRIBE_OK;
+    }
+    for (i = 0; err == SCRIBE_OK && i < ctx->config.field_index_count; i++) {
+        size_t added = 0;
+
+        err = index_update(ctx, ctx->config.field_indexes[i], head, &added);
+        if (err == SCRIBE_OK) {
+            printf("%s: indexed %zu new commit(s)\n", ctx->config.field_indexes[i], added);
+        }
+    }
+    return err;
+}
+
+/*
+ * A path whose document holds the queried value from ordinal `start` on.
+ */
+typedef struct {
+    const char *path;
+    size_t path_len;
+    size_t start;
+    int open;
+} index_open;
+
+/*
+ * One stretch of commits in which a path held the queried value.
+ */
+typedef struct {
+    const char *path;
+    size_t path_len;
+    size_t first;
+    size_t last;
+} index_hit;
+
+/*
+ * Query state: paths seen with the value, indexed by the BLAKE3 of the path,
+ * and the finished stretches.
+ */
+typedef struct {
+    scribe_hash_map ids;
+    index_open *paths;
+    size_t count;
+    size_t cap;
+    index_hit *hits;
+    size_t hit_count;
+    size_t hit_cap;
+} index_query;
+
+/*
+ * Returns the entry of a path seen earlier in the query, or NULL.
+ */
+static index_open *open_find(const index_query *q, const char *path, size_t path_len) {
+    uint8_t key[SCRIBE_HASH_SIZE];
+    const uint64_t *id;
+
+    scribe_hash_map_key(path, path_len, key);
+    id = scribe_hash_map_get(&q->ids, key);
+    return id == NULL ? NULL : &q->paths[*id];
+}
+
+/*
+ * Marks a path as holding the value from `ordinal` on.
+ */
+static scribe_error_t open_path(index_query *q, const char *path, size_t path_len, size_t ordinal) {
+    uint8_t key[SCRIBE_HASH_SIZE];
+    uint64_t *id = NULL;
+    int already = 0;
+    index_open *slot;
+    scribe_error_t err;
+
+    if (q->count == q->cap) {
+        size_t cap = q->cap == 0 ? 64u : q->cap * 2u;
+        index_open *grown = (index_open *)realloc(q->paths, cap * sizeof(*grown));
+
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow index query table");
+        }
+        q->paths = grown;
+        q->cap = cap;
+    }
+    scribe_hash_map_key(path, path_len, key);
+    err = scribe_hash_map_add(&q->ids, key, q->count, &already, &id);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    slot = &q->paths[*id];
+    if (!already) {
+        slot->path = path;
+        slot->path_len = path_len;
+        q->count++;
+    }
+    slot->start = ordinal;
+    slot->open = 1;
+    return SCRIBE_OK;
+}
+
+/*
+ * Records a finished stretch [first, last] if it overlaps the queried range
+ * starting at `lo`.
+ */
+static scribe_error_t add_hit(index_query *q, const index_open *slot, size_t lo, size_t last) {
+    index_hit *hit;
+
+    if (last < lo || last < slot->start) {
+        return SCRIBE_OK;
+    }
+    if (q->hit_count == q->hit_cap) {
+        size_t cap = q->hit_cap == 0 ? 64u : q->hit_cap * 2u;
+        index_hit *grown = (index_hit *)realloc(q->hits, cap * sizeof(*grown));
+
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow index query results");
+        }
+        q->hits = grown;
+        q->hit_cap = cap;
+    }
+    hit = &q->hits[q->hit_count++];
+    hit->path = slot->path;
+    hit->path_len = slot->path_len;
+    hit->first = slot->start < lo ? lo : slot->start;
+    hit->last = last;
+    return SCRIBE_OK;
+}
+
+/*
+ * Orders hits by first commit, then path.
+ */
+static int hit_compare(const void *a, const void *b) {
+    const index_hit *x = (const index_hit *)a;
+    const index_hit *y = (const index_hit *)b;
+
+    if (x->first != y->first) {
+        return x->first < y->first ? -1 : 1;
+    }
+    return value_compare(x->path, x->path_len, y->path, y->path_len);
+}
+
+/*
+ * Reads the value of posting `i` of a record whose offset table starts at
+ * `offsets` and whose postings start at `base`, leaving *pos after it.
+ */
+static scribe_error_t posting_value(const index_record *rec, size_t offsets, size_t base, size_t i, size_t *pos,
+                                    const char **v, size_t *v_len) {
+    size_t off = get_u32(rec->body + offsets + i * 4u);
+
+    if (off >= rec->len - base) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid field index record");
+    }
+    *pos = base + off;
+    return body_bytes(rec->body, rec->len, pos, v, v_len);
+}
+
+/*
+ * Applies the postings of one record that carry `value`. The first one is
+ * found by binary search over the offset table, so a record that does not
+ * mention the value costs a few comparisons.
+ */
+static scribe_error_t scan_record(index_query *q, const index_record *rec, size_t ordinal, const char *value,
+                                  size_t value_len, size_t lo) {
+    size_t pos = SCRIBE_HASH_SIZE;
+    uint64_t skip = 0;
+    uint64_t n = 0;
+    size_t offsets;
+    size_t base;
+    size_t first = 0;
+    size_t end;
+    size_t i;
+    scribe_error_t err = body_uint(rec->body, rec->len, &pos, &skip);
+
+    if (err == SCRIBE_OK) {
+        err = body_uint(rec->body, rec->len, &pos, &n);
+    }
+    if (err == SCRIBE_OK && n > (rec->len - pos) / 4u) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index record");
+    }
+    if (err != SCRIBE_OK || n == 0) {
+        return err;
+    }
+    offsets = pos;
+    base = pos + (size_t)n * 4u;
+    for (end = (size_t)n; first < end;) {
+        size_t mid = first + (end - first) / 2u;
+        const char *v = NULL;
+        size_t v_len = 0;
+
+        err = posting_value(rec, offsets, base, mid, &pos, &v, &v_len);
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+        if (value_compare(v, v_len, value, value_len) < 0) {
+            first = mid + 1u;
+        } else {
+            end = mid;
+        }
+    }
+    for (i = first; err == SCRIBE_OK && i < (size_t)n; i++) {
+        const char *v = NULL;
+        const char *path = NULL;
+        size_t v_len = 0;
+        size_t path_len = 0;
+
+        err = posting_value(rec, offsets, base, i, &pos, &v, &v_len);
+        if (err == SCRIBE_OK) {
+            err = body_bytes(rec->body, rec->len, &pos, &path, &path_len);
+        }
+        if (err == SCRIBE_OK && pos >= rec->len) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index record");
+        }
+        if (err != SCRIBE_OK || value_compare(v, v_len, value, value_len) != 0) {
+            break;
+        }
+        if (rec->body[pos] != 0) {
+            err = open_path(q, path, path_len, ordinal);
+        } else {
+            index_open *slot = open_find(q, path, path_len);
+
+            if (slot != NULL && slot->open) {
+                slot->open = 0;
+                err = ordinal == 0 ? SCRIBE_OK : add_hit(q, slot, lo, ordinal - 1u);
+            }
+        }
+    }
+    return err;
+}
+
+/*
+ * Converts a query value to the JSON text stored in the index. Arguments that
+ * already look like JSON (strings, numbers, objects, arrays, true, false,
+ * null) are used as given; anything else is taken as a string.
+ */
+static char *query_value(const char *arg) {
+    char *out;
+    size_t len = 2;
+    const char *s;
+    char *p;
+
+    if (arg[0] == '"' || arg[0] == '{' || arg[0] == '[' || arg[0] == '-' || (arg[0] >= '0' && arg[0] <= '9') ||
+        strcmp(arg, "true") == 0 || strcmp(arg, "false") == 0 || strcmp(arg, "null") == 0) {
+        return strdup(arg);
+    }
+    for (s = arg; *s != '\0'; s++) {
+        len += *s == '"' || *s == '\\' ? 2u : 1u;
+    }
+    out = (char *)malloc(len + 1u);
+    if (out == NULL) {
+        return NULL;
+    }
+    p = out;
+    *p++ = '"';
+    for (s = arg; *s != '\0'; s++) {
+        if (*s == '"' || *s == '\\') {
+            *p++ = '\\';
+        }
+        *p++ = *s;
+    }
+    *p++ = '"';
+    *p = '\0';
+    return out;
+}
+
+/*
+ * An index opened for a query: the value files that cover its head, and the
+ * tail of records after them, which is read whole.
+ */
+typedef struct {
+    int fd;
+    values_chain chain;
+    uint8_t *tail;
+    index_record *recs;
+    size_t tail_count;
+    uint8_t **loaded;
+    size_t loaded_count;
+    size_t loaded_cap;
+} index_reader;
+
+/*
+ * Opens index `name` for a query. A missing index reads as empty; a missing
+ * or stale set of value files leaves every record in the tail, which only
+ * costs speed.
+ */
+static scribe_error_t reader_open(scribe_ctx *ctx, const char *name, index_reader *r) {
+    char *file = index_file_name(name);
+    char *info = scribe_path_join(ctx->repo_path, "objects/info");
+    char *path = info == NULL || file == NULL ? NULL : scribe_path_join(info, file);
+    char *dir = values_dir(ctx, name);
+    values_listing listing;
+    uint8_t *used = NULL;
+    struct stat st;
+    size_t len = 0;
+    size_t off = 0;
+    size_t n;
+    scribe_error_t err = path == NULL || dir == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index query")
+                                                     : SCRIBE_OK;
+
+    memset(r, 0, sizeof(*r));
+    memset(&listing, 0, sizeof(listing));
+    r->fd = -1;
+    if (err == SCRIBE_OK) {
+        r->fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (r->fd < 0 && errno != ENOENT) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to open field index %s", name);
+        }
+    }
+    if (err == SCRIBE_OK && r->fd >= 0) {
+        err = fstat(r->fd, &st) != 0 ? scribe_set_error(SCRIBE_EIO, "failed to stat field index %s", name)
+                                     : chain_load(dir, r->fd, &r->chain, &listing, &used);
+    }
+    if (err == SCRIBE_OK && r->fd >= 0 && (uint64_t)st.st_size > r->chain.next_off) {
+        len = (size_t)((uint64_t)st.st_size - r->chain.next_off);
+        r->tail = (uint8_t *)malloc(len);
+        err = r->tail == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to read field index %s", name)
+                              : read_at(r->fd, r->chain.next_off, r->tail, len);
+    }
+    if (err == SCRIBE_OK) {
+        r->recs = (index_record *)malloc((len / SCRIBE_INFO_RECORD_OVERHEAD + 1u) * sizeof(*r->recs));
+        err = r->recs == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index records") : SCRIBE_OK;
+    }
+    while (err == SCRIBE_OK && (n = scribe_info_record_at(r->tail, len, off)) != 0) {
+        size_t pos = SCRIBE_HASH_SIZE;
+        uint64_t ordinal = 0;
+
+        r->recs[r->tail_count].body = r->tail + off + 4u;
+        r->recs[r->tail_count].len = n - SCRIBE_INFO_RECORD_OVERHEAD;
+        if (body_uint(r->recs[r->tail_count].body, r->recs[r->tail_count].len, &pos, &ordinal) != SCRIBE_OK ||
+            ordinal != r->chain.covered + r->tail_count) {
+            break;
+        }
+        r->tail_count++;
+        off += n;
+    }
+    if (err == SCRIBE_OK && off != len) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "index", "ignoring damaged field index %s after byte %" PRIu64, name,
+                       r->chain.next_off + off);
+    }
+    free(listing.files);
+    free(used);
+    free(dir);
+    free(path);
+    free(info);
+    free(file);
+    return err;
+}
+
+/*
+ * Releases an index opened by reader_open() and the records read from it.
+ */
+static void reader_close(index_reader *r) {
+    size_t i;
+
+    for (i = 0; i < r->loaded_count; i++) {
+        free(r->loaded[i]);
+    }
+    free(r->loaded);
+    chain_free(&r->chain);
+    free(r->recs);
+    free(r->tail);
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+}
+
+/*
+ * Returns the commit hash of record `ordinal`.
+ */
+static scribe_error_t reader_hash(const index_reader *r, size_t ordinal, uint8_t hash[SCRIBE_HASH_SIZE]) {
+    uint64_t off = 0;
+    size_t i;
+
+    if (ordinal >= r->chain.covered) {
+        scribe_hash_copy(hash, r->recs[ordinal - r->chain.covered].body);
+        return SCRIBE_OK;
+    }
+    for (i = 0; ordinal >= r->chain.runs[i].first + r->chain.runs[i].count; i++) {
+    }
+    return run_entry(&r->chain.runs[i], ordinal - r->chain.runs[i].first, &off, hash);
+}
+
+/*
+ * Looks a commit up in a value file by binary search over its hash-ordered
+ * entry numbers. Sets *found and *ordinal when the file covers it.
+ */
+static scribe_error_t run_lookup(const values_run *run, const uint8_t hash[SCRIBE_HASH_SIZE], int *found,
+                                 size_t *ordinal) {
+    uint64_t perm = VALUES_HEADER_SIZE + run->count * VALUES_ENTRY_SIZE;
+    uint64_t lo = 0;
+    uint64_t hi = run->count;
+    scribe_error_t err = SCRIBE_OK;
+
+    *found = 0;
+    while (err == SCRIBE_OK && lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2u;
+        uint8_t entry_hash[SCRIBE_HASH_SIZE];
+        uint8_t index[4];
+        uint64_t off = 0;
+        int cmp;
+
+        err = read_at(run->fd, perm + mid * 4u, index, sizeof(index));
+        if (err == SCRIBE_OK && get_u32(index) >= run->count) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index values");
+        }
+        if (err == SCRIBE_OK) {
+            err = run_entry(run, get_u32(index), &off, entry_hash);
+        }
+        if (err != SCRIBE_OK) {
+            break;
+        }
+        cmp = scribe_hash_cmp(entry_hash, hash);
+        if (cmp == 0) {
+            *found = 1;
+            *ordinal = (size_t)(run->first + get_u32(index));
+            break;
+        }
+        if (cmp < 0) {
+            lo = mid + 1u;
+        } else {
+            hi = mid;
+        }
+    }
+    return err;
+}
+
+/*
+ * Finds `value` in a value file by binary search and returns the numbers,
+ * from the file's first ordinal, of the records that mention it. *count is 0
+ * when none does.
+ */
+static scribe_error_t run_find(const values_run *run, const char *value, size_t value_len, uint32_t **records,
+                               uint32_t *count) {
+    uint64_t table = VALUES_HEADER_SIZE + run->count * (VALUES_ENTRY_SIZE + 4u);
+    uint64_t end = run->size - 8u;
+    uint64_t lo = 0;
+    uint64_t hi = run->values;
+    char *probe = NULL;
+    scribe_error_t err = SCRIBE_OK;
+
+    *records = NULL;
+    *count = 0;
+    while (err == SCRIBE_OK && lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2u;
+        uint8_t word[8];
+        uint64_t off = 0;
+        uint32_t len = 0;
+        int cmp;
+
+        err = read_at(run->fd, table + mid * 8u, word, 8u);
+        if (err == SCRIBE_OK) {
+            off = get_u64(word);
+            err = off < table || off > end - 8u ? scribe_set_error(SCRIBE_ECORRUPT, "invalid field index values")
+                                                : read_at(run->fd, off, word, 4u);
+        }
+        if (err == SCRIBE_OK) {
+            len = get_u32(word);
+            if (len > end - off - 8u) {
+                err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index values");
+            }
+        }
+        if (err == SCRIBE_OK) {
+            free(probe);
+            probe = (char *)malloc(len == 0 ? 1u : len);
+            err = probe == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index value")
+                                : read_at(run->fd, off + 4u, probe, len);
+        }
+        if (err != SCRIBE_OK) {
+            break;
+        }
+        cmp = value_compare(probe, len, value, value_len);
+        if (cmp < 0) {
+            lo = mid + 1u;
+        } else if (cmp > 0) {
+            hi = mid;
+        } else {
+            err = read_at(run->fd, off + 4u + len, word, 4u);
+            if (err == SCRIBE_OK && get_u32(word) > (end - off - 8u - len) / 4u) {
+                err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index values");
+            }
+            if (err == SCRIBE_OK) {
+                *count = get_u32(word);
+                *records = (uint32_t *)malloc(*count == 0 ? 1u : (size_t)*count * 4u);
+                err = *records == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index ordinals")
+                                       : read_at(run->fd, off + 8u + len, *records, (size_t)*count * 4u);
+            }
+            break;
+        }
+    }
+    free(probe);
+    return err;
+}
+
+/*
+ * Applies the records of one value file that mention `value`, up to ordinal
+ * `hi`, reading only those records from the index.
+ */
+static scribe_error_t scan_run(index_query *q, index_reader *r, const values_run *run, const char *value,
+                               size_t value_len, size_t lo, size_t hi) {
+    uint32_t *records = NULL;
+    uint32_t count = 0;
+    uint32_t i;
+    scribe_error_t err = run_find(run, value, value_len, &records, &count);
+
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        uint32_t k = get_u32((const uint8_t *)&records[i]);
+        uint8_t hash[SCRIBE_HASH_SIZE];
+        uint8_t *buf = NULL;
+        index_record rec;
+        uint64_t off = 0;
+
+        if (k >= run->count) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "invalid field index values");
+            break;
+        }
+        if (run->first + k > hi) {
+            break;
+        }
+        if (r->loaded_count == r->loaded_cap) {
+            size_t cap = r->loaded_cap == 0 ? 64u : r->loaded_cap * 2u;
+            uint8_t **grown = (uint8_t **)realloc(r->loaded, cap * sizeof(*grown));
+
+            if (grown == NULL) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "failed to grow index query records");
+                break;
+            }
+            r->loaded = grown;
+            r->loaded_cap = cap;
+        }
+        err = run_entry(run, k, &off, hash);
+        if (err == SCRIBE_OK) {
+            err = read_record(r->fd, off, run->first + k, &buf, &rec);
+            r->loaded[r->loaded_count++] = buf;
+        }
+        if (err == SCRIBE_OK && scribe_hash_cmp(rec.body, hash) != 0) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "field index values do not match the index");
+        }
+        if (err == SCRIBE_OK) {
+            err = scan_record(q, &rec, (size_t)(run->first + k), value, value_len, lo);
+        }
+    }
+    free(records);
+    return err;
+}
+
+/*
+ * Returns the ordinal of `rev` in an opened index, or an error naming the
+ * index when the commit is not covered.
+ */
+static scribe_error_t rev_ordinal(scribe_ctx *ctx, const index_reader *r, const char *name, const char *rev,
+                                  size_t *out) {
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    size_t i;
+    int found = 0;
+    scribe_error_t err = scribe_resolve_commit(ctx, rev, hash);
+
+    for (i = 0; err == SCRIBE_OK && !found && i < r->chain.count; i++) {
+        err = run_lookup(&r->chain.runs[i], hash, &found, out);
+    }
+    for (i = 0; err == SCRIBE_OK && !found && i < r->tail_count; i++) {
+        if (scribe_hash_cmp(r->recs[i].body, hash) == 0) {
+            *out = (size_t)r->chain.covered + i;
+            found = 1;
+        }
+    }
+    if (err == SCRIBE_OK && !found) {
+        err = scribe_set_error(SCRIBE_ENOT_FOUND, "field index %s does not cover %s; run `scribe index update`", name,
+                               rev == NULL ? "HEAD" : rev);
+    }
+    return err;
+}
+
+/*
+ * Implements `scribe index query`. For one revision it prints the paths whose
+ * document held `value` in the indexed field at that commit; for a range it
+ * prints `<first> <last> <path>` for every stretch of commits in the range in
+ * which a path held it. No blobs are read, and of the records the value files
+ * cover, only those that mention the value are.
+ */
+scribe_error_t scribe_cli_index_query(scribe_ctx *ctx, const char *name, const char *value, const char *rev) {
+    const char *dots = rev == NULL ? NULL : strstr(rev, "..");
+    index_reader r;
+    index_query q;
+    char *want = NULL;
+    size_t lo = 0;
+    size_t hi = 0;
+    size_t i;
+    scribe_error_t err = SCRIBE_OK;
+
+    memset(&q, 0, sizeof(q));
+    for (i = 0; i < ctx->config.field_index_count && strcmp(ctx->config.field_indexes[i], name) != 0; i++) {
+    }
+    if (i == ctx->config.field_index_count) {
+        return scribe_set_error(SCRIBE_ECONFIG, "no field index '%s' is configured", name);
+    }
+    want = query_value(value);
+    if (want == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate index query");
+    }
+    err = reader_open(ctx, name, &r);
+    if (err == SCRIBE_OK) {
+        err = rev_ordinal(ctx, &r, name, dots == NULL ? rev : dots[2] == '\0' ? NULL : dots + 2, &hi);
+    }
+    if (err == SCRIBE_OK && dots != NULL && dots != rev) {
+        char *a = strndup(rev, (size_t)(dots - rev));
+
+        err = a == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate revision")
+                        : rev_ordinal(ctx, &r, name, a, &lo);
+        if (err == SCRIBE_OK && lo > hi) {
+            err = scribe_set_error(SCRIBE_EINVAL, "'%s' is not an ancestor of the range end", a);
+        }
+        lo++;
+        free(a);
+    } else if (err == SCRIBE_OK && dots == NULL) {
+        lo = hi;
+    }
+    for (i = 0; err == SCRIBE_OK && lo <= hi && i < r.chain.count && r.chain.runs[i].first <= hi; i++) {
+        err = scan_run(&q, &r, &r.chain.runs[i], want, strlen(want), lo, hi);
+    }
+    for (i = 0; err == SCRIBE_OK && lo <= hi && i < r.tail_count && r.chain.covered + i <= hi; i++) {
+        err = scan_record(&q, &r.recs[i], (size_t)r.chain.covered + i, want, strlen(want), lo);
+    }
+    for (i = 0; err == SCRIBE_OK && i < q.count; i++) {
+        if (q.paths[i].open) {
+            err = add_hit(&q, &q.paths[i], lo, hi);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        qsort(q.hits, q.hit_count, sizeof(*q.hits), hit_compare);
+    }
+    for (i = 0; err == SCRIBE_OK && i < q.hit_count; i++) {
+        if (dots == NULL) {
+            printf("%.*s\n", (int)q.hits[i].path_len, q.hits[i].path);
+        } else {
+            uint8_t first_hash[SCRIBE_HASH_SIZE];
+            uint8_t last_hash[SCRIBE_HASH_SIZE];
+            char first[SCRIBE_HEX_HASH_SIZE + 1];
+            char last[SCRIBE_HEX_HASH_SIZE + 1];
+
+            err = reader_hash(&r, q.hits[i].first, first_hash);
+            if (err == SCRIBE_OK) {
+                err = reader_hash(&r, q.hits[i].last, last_hash);
+            }
+            if (err == SCRIBE_OK) {
+                scribe_hash_to_hex(first_hash, first);
+                scribe_hash_to_hex(last_hash, last);
+                printf("%.12s %.12s %.*s\n", first, last, (int)q.hits[i].path_len, q.hits[i].path);
+            }
+        }
+    }
+    scribe_hash_map_destroy(&q.ids);
+    free(q.paths);
+    free(q.hits);
+    reader_close(&r);
+    free(want);
+    return err;
+}
@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -123,13 +124,26 @@ scribe_error_t scribe_mkdir_p(const char *path) {
     return SCRIBE_OK;
 }
 
+static atomic_ulong g_tmp_sequence;
+
 /*
- * Writes bytes to a pid-suffixed temporary file, fsyncs it, renames it over the
- * destination, then fsyncs the parent directory. This is used for refs, config,
- * logs, adapter state, and loose objects whenever Scribe needs all-or-nothing
- * file replacement.
+ * Writes bytes to a uniquely suffixed temporary file, fsyncs it, renames it
+ * over the destination, then fsyncs the parent directory. This is used for refs,
+ * config, logs, adapter state, and loose objects whenever Scribe needs
+ * all-or-nothing file replacement. The suffix combines the pid with a
+ * process-wide counter so threads writing the same object never share a
+ * temporary file.
  */
 scribe_error_t scribe_write_file_atomic(const char *path, const uint8_t *bytes, size_t len) {
+    return scribe_write_file_atomic_flags(path, bytes, len, 0);
+}
+
+/*
+ * scribe_write_file_atomic() with options. SCRIBE_WRITE_NOSYNC skips both
+ * fsyncs: the rename is still atomic for concurrent readers, but the file is
+ * durable only after a later barrier such as syncfs().
+ */
+scribe_error_t scribe_write_file_atomic_flags(const char *path, const uint8_t *bytes, size_t len, unsigned flags) {
     char tmp[PATH_MAX];
     int fd;
     size_t off = 0;
@@ -137,7 +151,8 @@ scribe_error_t scribe_write_file_atomic(const char *path, const uint8_t *bytes,
     if (path == NULL || bytes == NULL) {
         return scribe_set_error(SCRIBE_EINVAL, "invalid file write");
     }
-    if (snprintf(tmp, sizeof(tmp), "%s.tmp.%ld", path, (long)getpid()) >= (int)sizeof(tmp)) {
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp.%ld.%lu", path, (long)getpid(), atomic_fetch_add(&g_tmp_sequence, 1ul)) >=
+        (int)sizeof(tmp)) {
         return scribe_set_error(SCRIBE_EPATH, "temporary path too long");
     }
     fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
@@ -153,7 +168,7 @@ scribe_error_t scribe_write_file_atomic(const char *path, const uint8_t *bytes,
         }
         off += (size_t)n;
     }
-    if (fsync(fd) != 0) {
+    if ((flags & SCRIBE_WRITE_NOSYNC) == 0 && fsync(fd) != 0) {
         close(fd);
         unlink(tmp);
         return scribe_set_error(SCRIBE_EIO, "failed to fsync temporary file");
@@ -166,7 +181,7 @@ scribe_error_t scribe_write_file_atomic(const char *path, const uint8_t *bytes,
         unlink(tmp);
         return scribe_set_error(SCRIBE_EIO, "failed to rename temporary file");
     }
-    return fsync_parent_dir(path);
+    return (flags & SCRIBE_WRITE_NOSYNC) != 0 ? SCRIBE_OK : fsync_parent_dir(path);
 }
 
 /*
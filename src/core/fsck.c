@@ -2,15 +2,18 @@
  * Repository integrity checker.
  *
  * The fsck command verifies the reachable object graph starting from
- * refs/heads/main, then scans loose objects to report valid but unreachable
- * objects as dangling. Dangling objects are warnings in v1 because interrupted
- * writes can leave them behind before a ref update publishes a commit.
+ * refs/heads/main and any partition refs, then scans the object store to report
+ * valid but unreachable objects as dangling. Dangling objects are warnings in v1 because interrupted
+ * writes can leave them behind before a ref update publishes a commit. An
+ * archived object's delta base is an edge too: the base and its own chain
+ * are kept (not dangling) without walking what they reference.
  */
 #include "core/internal.h"
 
 #include "util/error.h"
 #include "util/hex.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,7 +23,10 @@ typedef struct {
     uint8_t *hashes;
     size_t count;
     size_t cap;
+    scribe_hash_map bases;
     size_t dangling;
+    size_t retained;
+    pthread_mutex_t dangling_mu;
 } fsck_state;
 
 /*
@@ -30,7 +36,7 @@ typedef struct {
  *
  *   1. avoid walking the same object more than once when multiple commits share
  *      subtrees or blobs;
- *   2. identify dangling loose objects during the later full object scan.
+ *   2. identify dangling objects during the later full object scan.
  */
 /*
  * Returns whether the visited set already contains a hash. The set is linear
@@ -149,6 +155,30 @@ static scribe_error_t fsck_walk_commit(fsck_state *st, scribe_object *obj) {
     return err;
 }
 
+/*
+ * Keeps the delta chain under a reachable archived object: `base` and every
+ * base below it. Reading the object already verified the chain, so this only
+ * records it.
+ */
+static scribe_error_t fsck_keep_bases(fsck_state *st, const uint8_t base[SCRIBE_HASH_SIZE]) {
+    uint8_t at[SCRIBE_HASH_SIZE];
+    int is_delta = 1;
+    unsigned depth;
+    scribe_error_t err = SCRIBE_OK;
+
+    scribe_hash_copy(at, base);
+    for (depth = 0; err == SCRIBE_OK && is_delta && depth < SCRIBE_ARCHIVE_MAX_DEPTH; depth++) {
+        int already = 0;
+
+        err = scribe_hash_map_add(&st->bases, at, 0, &already, NULL);
+        if (err != SCRIBE_OK || already) {
+            break;
+        }
+        err = scribe_object_delta_base(st->ctx, at, at, &is_delta);
+    }
+    return err;
+}
+
 /*
  * Verifies and walks one object by hash. The expected_type comes from the parent
  * ref or tree entry, so a readable object with the wrong type is still corrupt.
@@ -174,6 +204,13 @@ static scribe_error_t fsck_walk_object(fsck_state *st, const uint8_t hash[SCRIBE
         scribe_object_free(&obj);
         return scribe_set_error(SCRIBE_ECORRUPT, "reachable object has wrong type");
     }
+    if (obj.has_delta_base) {
+        err = fsck_keep_bases(st, obj.delta_base);
+    }
+    if (err != SCRIBE_OK) {
+        scribe_object_free(&obj);
+        return err;
+    }
     if (obj.type == SCRIBE_OBJECT_TREE) {
         err = fsck_walk_tree(st, &obj);
     } else if (obj.type == SCRIBE_OBJECT_COMMIT) {
@@ -183,85 +220,71 @@ static scribe_error_t fsck_walk_object(fsck_state *st, const uint8_t hash[SCRIBE
     return err;
 }
 
-typedef struct {
-    fsck_state *st;
-    char dir_hex[3];
-} dangling_dir_ctx;
-
 /*
- * Visits one loose object file during the dangling-object scan. Files whose
- * names are not valid loose-object suffixes are ignored; valid object-shaped
- * names not reached earlier are reported as dangling.
+ * Object-iterator callback for the dangling-object scan. Objects not reached
+ * by the graph walk are reported as dangling. The reachable set is read-only
+ * by now, so only the warning and counter need the lock.
  */
-static scribe_error_t visit_object_file(const char *name, void *vctx) {
-    dangling_dir_ctx *dctx = (dangling_dir_ctx *)vctx;
+static scribe_error_t visit_dangling(const uint8_t hash[SCRIBE_HASH_SIZE], void *vctx) {
+    fsck_state *st = (fsck_state *)vctx;
     char hex[SCRIBE_HEX_HASH_SIZE + 1];
-    uint8_t hash[SCRIBE_HASH_SIZE];
-    scribe_error_t err;
 
-    if (strlen(name) != 62u) {
-        return SCRIBE_OK;
-    }
-    snprintf(hex, sizeof(hex), "%s%s", dctx->dir_hex, name);
-    err = scribe_hash_from_hex(hex, hash);
-    if (err != SCRIBE_OK) {
-        return SCRIBE_OK;
-    }
     /*
-     * Dangling means "present in objects/ but absent from the reachability set
-     * built from refs/heads/main". It is only a warning in v1. Interrupted
-     * writes may leave valid objects on disk before the ref update publishes a
-     * commit, and Scribe has no garbage collector yet.
+     * Dangling means "present in the object store but absent from the
+     * reachability set built from refs/heads/main". It is only a warning in v1.
+     * Interrupted writes may leave valid objects behind before the ref update
+     * publishes a commit, and Scribe has no garbage collector yet. Delta
+     * bases of reachable objects are counted as reachable, not dangling.
      */
-    if (!visited_has(dctx->st, hash)) {
+    if (visited_has(st, hash)) {
+        return SCRIBE_OK;
+    }
+    if (scribe_hash_map_get(&st->bases, hash) != NULL) {
+        pthread_mutex_lock(&st->dangling_mu);
+        st->retained++;
+        pthread_mutex_unlock(&st->dangling_mu);
+    } else {
+        scribe_hash_to_hex(hash, hex);
+        pthread_mutex_lock(&st->dangling_mu);
         printf("warning: dangling object %s\n", hex);
-        dctx->st->dangling++;
+        st->dangling++;
+        pthread_mutex_unlock(&st->dangling_mu);
     }
     return SCRIBE_OK;
 }
 
 /*
- * Visits one two-character fanout directory under objects/ and delegates each
- * file to visit_object_file(). Missing directories are tolerated so sparse
- * object stores do not fail fsck.
+ * Walks the commit a partition ref points to. Partition refs only exist while
+ * a partitioned writer runs or after it crashed; their commits are not on
+ * main yet but must be intact for the next fold. Temporary files are skipped.
  */
-static scribe_error_t visit_object_dir(const char *name, void *vctx) {
-    fsck_state *st = (fsck_state *)vctx;
-    char *objects;
-    char *dir;
-    dangling_dir_ctx dctx;
-    scribe_error_t err;
+static scribe_error_t walk_partition_ref(const char *name, void *user) {
+    fsck_state *st = (fsck_state *)user;
+    uint8_t tip[SCRIBE_HASH_SIZE];
+    char ref[256];
+    int n;
 
-    if (strlen(name) != 2u) {
+    if (strchr(name, '.') != NULL) {
         return SCRIBE_OK;
     }
-    objects = scribe_path_join(st->ctx->repo_path, "objects");
-    if (objects == NULL) {
-        return SCRIBE_ENOMEM;
+    n = snprintf(ref, sizeof(ref), "refs/partitions/%s", name);
+    if (n < 0 || (size_t)n >= sizeof(ref)) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid partition ref name '%s'", name);
     }
-    dir = scribe_path_join(objects, name);
-    free(objects);
-    if (dir == NULL) {
-        return SCRIBE_ENOMEM;
+    if (scribe_refs_read(st->ctx, ref, tip) != SCRIBE_OK) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid partition ref '%s'", ref);
     }
-    dctx.st = st;
-    dctx.dir_hex[0] = name[0];
-    dctx.dir_hex[1] = name[1];
-    dctx.dir_hex[2] = '\0';
-    err = scribe_list_dir(dir, visit_object_file, &dctx);
-    free(dir);
-    return err == SCRIBE_ENOT_FOUND ? SCRIBE_OK : err;
+    return fsck_walk_object(st, tip, SCRIBE_OBJECT_COMMIT);
 }
 
 /*
  * Implements `scribe fsck`: build the reachable set from main history, scan the
- * loose object store for unvisited hashes, print dangling warnings, and finish
+ * object store for unvisited hashes, print dangling warnings, and finish
  * with a summary count.
  */
 scribe_error_t scribe_cli_fsck(scribe_ctx *ctx) {
     fsck_state st;
     uint8_t head[SCRIBE_HASH_SIZE];
-    char *objects;
     scribe_error_t err;
 
     memset(&st, 0, sizeof(st));
@@ -275,22 +298,26 @@ scribe_error_t scribe_cli_fsck(scribe_ctx *ctx) {
         return scribe_set_error(SCRIBE_ECORRUPT, "invalid main ref");
     }
     err = fsck_walk_object(&st, head, SCRIBE_OBJECT_COMMIT);
-    if (err != SCRIBE_OK) {
-        free(st.hashes);
-        return err;
+    if (err == SCRIBE_OK) {
+        char *dir = scribe_path_join(ctx->repo_path, "refs/partitions");
+
+        err = dir == NULL ? SCRIBE_ENOMEM : scribe_list_dir(dir, walk_partition_ref, &st);
+        free(dir);
+        if (err == SCRIBE_ENOT_FOUND) {
+            scribe_clear_error();
+            err = SCRIBE_OK;
+        }
     }
-    objects = scribe_path_join(ctx->repo_path, "objects");
-    if (objects == NULL) {
-        free(st.hashes);
-        return SCRIBE_ENOMEM;
+    if (err == SCRIBE_OK && pthread_mutex_init(&st.dangling_mu, NULL) != 0) {
+        err = scribe_set_error(SCRIBE_ERR, "failed to initialize fsck lock");
+    } else if (err == SCRIBE_OK) {
+        err = scribe_object_iter_concurrent(ctx, visit_dangling, &st);
+        pthread_mutex_destroy(&st.dangling_mu);
     }
-    err = scribe_list_dir(objects, visit_object_dir, &st);
-    free(objects);
-    if (err != SCRIBE_OK && err != SCRIBE_ENOT_FOUND) {
-        free(st.hashes);
-        return err;
+    if (err == SCRIBE_OK) {
+        printf("fsck: %zu reachable objects, %zu dangling objects\n", st.count + st.retained, st.dangling);
     }
-    printf("fsck: %zu reachable objects, %zu dangling objects\n", st.count, st.dangling);
     free(st.hashes);
-    return SCRIBE_OK;
+    scribe_hash_map_destroy(&st.bases);
+    return err;
 }
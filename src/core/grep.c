@@ -0,0 +1,405 @@
+/*
+ * Content search over recorded state.
+ *
+ * `scribe grep <pattern> [--rev <range>] [-- <prefix>]` finds the documents
+ * whose bytes contain a pattern, either in one commit or across a range of
+ * history. The history walk uses tree diffs, so each commit costs only the
+ * paths it changed. Every (path, blob) pair becomes an interval from the
+ * commit that introduced the blob at that path to the last commit that still
+ * had it. Each distinct blob is then searched exactly once, in parallel on
+ * `worker_threads` threads, and matches are mapped back to the intervals.
+ * Fixed strings use memmem(), which glibc vectorizes; -E patterns use POSIX
+ * extended regexes over the raw blob bytes.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+
+#include <pthread.h>
+#include <regex.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *path;
+    uint8_t blob[SCRIBE_HASH_SIZE];
+    size_t first;
+    size_t last;
+} grep_interval;
+
+typedef struct {
+    scribe_ctx *ctx;
+    grep_interval *items;
+    size_t count;
+    size_t cap;
+    scribe_hash_map open;
+    size_t commit;
+} grep_state;
+
+typedef struct {
+    scribe_ctx *ctx;
+    const char *pattern;
+    size_t pattern_len;
+    const regex_t *regex;
+    const uint8_t *blobs;
+    uint8_t *matched;
+    size_t count;
+    atomic_size_t next;
+    atomic_int stop;
+    pthread_mutex_t mu;
+    scribe_error_t err;
+    char err_detail[256];
+} grep_search;
+
+/*
+ * Ends the interval open at `path`, if any, at the previous commit.
+ */
+static void interval_close(grep_state *st, const char *path) {
+    uint8_t key[SCRIBE_HASH_SIZE];
+    const uint64_t *open;
+
+    if (st->open.count == 0) {
+        return;
+    }
+    scribe_hash_map_key(path, strlen(path), key);
+    open = scribe_hash_map_get(&st->open, key);
+    if (open != NULL) {
+        st->items[*open].last = st->commit - 1u;
+        (void)scribe_hash_map_remove(&st->open, key);
+    }
+}
+
+/*
+ * Starts an interval for `blob` at `path` in the current commit.
+ */
+static scribe_error_t interval_open(grep_state *st, const char *path, const uint8_t blob[SCRIBE_HASH_SIZE]) {
+    grep_interval *item;
+    uint8_t key[SCRIBE_HASH_SIZE];
+    scribe_error_t err;
+
+    if (st->count == st->cap) {
+        size_t cap = st->cap == 0 ? 1024u : st->cap * 2u;
+        grep_interval *grown;
+
+        if (cap > SIZE_MAX / sizeof(*grown)) {
+            return scribe_set_error(SCRIBE_ENOMEM, "too many grep paths");
+        }
+        grown = (grep_interval *)realloc(st->items, cap * sizeof(*grown));
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow grep paths");
+        }
+        st->items = grown;
+        st->cap = cap;
+    }
+    scribe_hash_map_key(path, strlen(path), key);
+    err = scribe_hash_map_add(&st->open, key, st->count, NULL, NULL);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    item = &st->items[st->count];
+    item->path = strdup(path);
+    if (item->path == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate grep path");
+    }
+    scribe_hash_copy(item->blob, blob);
+    item->first = st->commit;
+    item->last = st->commit;
+    st->count++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Diff visitor: a changed or removed leaf ends its interval, and a new blob at
+ * a path starts one.
+ */
+static scribe_error_t grep_visit(char status, const char *path, const uint8_t *old_blob, const uint8_t *new_blob,
+                                 void *user) {
+    grep_state *st = (grep_state *)user;
+
+    (void)old_blob;
+    if (status != 'A') {
+        interval_close(st, path);
+    }
+    return new_blob == NULL ? SCRIBE_OK : interval_open(st, path, new_blob);
+}
+
+/*
+ * Resolves `prefix` (the whole tree when empty) in a commit.
+ */
+static scribe_error_t resolve_prefix(scribe_ctx *ctx, const scribe_history_entry *commit, const char *prefix,
+                                     scribe_path_resolution *out) {
+    if (prefix[0] == '\0') {
+        out->state = SCRIBE_PATH_TREE;
+        scribe_hash_copy(out->hash, commit->root);
+        return SCRIBE_OK;
+    }
+    return scribe_tree_resolve_path(ctx, commit->root, prefix, out);
+}
+
+/*
+ * Orders blob hashes for deduplication and lookup.
+ */
+static int blob_compare(const void *a, const void *b) { return memcmp(a, b, SCRIBE_HASH_SIZE); }
+
+/*
+ * Searches one blob's bytes for the pattern.
+ */
+static scribe_error_t search_blob(grep_search *s, const uint8_t hash[SCRIBE_HASH_SIZE], uint8_t *matched) {
+    scribe_object obj;
+    scribe_error_t err = scribe_object_read(s->ctx, hash, &obj);
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (s->regex != NULL) {
+        regmatch_t m;
+
+        /*
+         * REG_STARTEND bounds the match by length, so blobs need no NUL
+         * terminator and embedded NULs (BSON) do not end the search early.
+         */
+        m.rm_so = 0;
+        m.rm_eo = (regoff_t)obj.payload_len;
+        *matched = regexec(s->regex, (const char *)obj.payload, 1, &m, REG_STARTEND) == 0;
+    } else {
+        *matched = memmem(obj.payload, obj.payload_len, s->pattern, s->pattern_len) != NULL;
+    }
+    scribe_object_free(&obj);
+    return SCRIBE_OK;
+}
+
+/*
+ * Search thread body: claims blobs from a shared counter until all are taken
+ * or another thread has failed. The first error and its detail are kept for
+ * the calling thread.
+ */
+static void *search_worker(void *arg) {
+    grep_search *s = (grep_search *)arg;
+    scribe_error_t err = SCRIBE_OK;
+
+    while (err == SCRIBE_OK && !atomic_load(&s->stop)) {
+        size_t i = atomic_fetch_add(&s->next, 1u);
+
+        if (i >= s->count) {
+            break;
+        }
+        err = search_blob(s, s->blobs + i * SCRIBE_HASH_SIZE, &s->matched[i]);
+    }
+    if (err != SCRIBE_OK) {
+        pthread_mutex_lock(&s->mu);
+        if (s->err == SCRIBE_OK) {
+            s->err = err;
+            snprintf(s->err_detail, sizeof(s->err_detail), "%s", scribe_last_error_detail());
+        }
+        pthread_mutex_unlock(&s->mu);
+        atomic_store(&s->stop, 1);
+    }
+    return NULL;
+}
+
+/*
+ * Searches every distinct blob once, on the caller's thread plus up to
+ * worker_threads - 1 more. matched[i] is set for blobs[i].
+ */
+static scribe_error_t search_blobs(grep_search *s) {
+    pthread_t workers[63];
+    unsigned threads = scribe_worker_count(s->ctx);
+    unsigned started = 0;
+    unsigned i;
+
+    atomic_init(&s->next, 0u);
+    atomic_init(&s->stop, 0);
+    if (pthread_mutex_init(&s->mu, NULL) != 0) {
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize grep workers");
+    }
+    if (threads > 64u) {
+        threads = 64u;
+    }
+    while (started + 1u < threads && started + 1u < s->count &&
+           pthread_create(&workers[started], NULL, search_worker, s) == 0) {
+        scribe_worker_pin(s->ctx, workers[started], started);
+        started++;
+    }
+    search_worker(s);
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&s->mu);
+    if (s->err != SCRIBE_OK) {
+        return scribe_set_error(s->err, "%s", s->err_detail);
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Selects the commits to scan from a --rev value. `<rev>` is that one commit;
+ * `<a>..<b>` is every commit after a up to b, and an empty a means the whole
+ * history up to b. Only those commits are loaded, oldest first: a single
+ * revision reads just its own commit and a range stops walking at a.
+ */
+static scribe_error_t select_commits(scribe_ctx *ctx, const char *rev, scribe_history_entry **entries,
+                                     size_t *count, int *range) {
+    const char *dots = rev == NULL ? NULL : strstr(rev, "..");
+    uint8_t tip[SCRIBE_HASH_SIZE];
+    uint8_t base[SCRIBE_HASH_SIZE];
+    int has_base = 0;
+    char *a = NULL;
+    scribe_error_t err;
+
+    *range = dots != NULL;
+    if (dots == NULL) {
+        err = scribe_resolve_commit(ctx, rev, tip);
+    } else {
+        err = scribe_resolve_commit(ctx, dots[2] == '\0' ? NULL : dots + 2, tip);
+    }
+    if (err == SCRIBE_OK && dots != NULL && dots != rev) {
+        a = strndup(rev, (size_t)(dots - rev));
+        err = a == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate revision") : SCRIBE_OK;
+        if (err == SCRIBE_OK) {
+            err = scribe_resolve_commit(ctx, a, base);
+            has_base = err == SCRIBE_OK;
+        }
+        free(a);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_history_load_range(ctx, tip, has_base ? base : NULL, dots == NULL ? 1u : 0u, entries, count);
+    if (err == SCRIBE_EINVAL && has_base) {
+        return scribe_set_error(SCRIBE_EINVAL, "'%.*s' is not an ancestor of the range end", (int)(dots - rev), rev);
+    }
+    return err;
+}
+
+/*
+ * Implements `scribe grep`. For a single revision it prints each matching
+ * path; for a range it prints `<first> <last> <path>` for every stretch of
+ * commits in which the path held a matching blob, in order of first
+ * appearance.
+ */
+scribe_error_t scribe_cli_grep(scribe_ctx *ctx, const char *pattern, int extended, const char *rev,
+                               const char *path_prefix) {
+    grep_state st;
+    grep_search search;
+    regex_t regex;
+    scribe_history_entry *entries = NULL;
+    scribe_path_resolution prev;
+    scribe_path_resolution cur;
+    uint8_t *blobs = NULL;
+    char *prefix = NULL;
+    size_t count = 0;
+    size_t unique = 0;
+    size_t i;
+    int range = 0;
+    int have_regex = 0;
+    scribe_error_t err = SCRIBE_OK;
+
+    memset(&st, 0, sizeof(st));
+    memset(&search, 0, sizeof(search));
+    st.ctx = ctx;
+    if (pattern[0] == '\0') {
+        return scribe_set_error(SCRIBE_EINVAL, "grep pattern is empty");
+    }
+    if (extended) {
+        int rc = regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB);
+
+        if (rc != 0) {
+            char detail[128];
+
+            regerror(rc, &regex, detail, sizeof(detail));
+            return scribe_set_error(SCRIBE_EINVAL, "invalid pattern '%s': %s", pattern, detail);
+        }
+        have_regex = 1;
+    }
+    prefix = strdup(path_prefix == NULL ? "" : path_prefix);
+    if (prefix == NULL) {
+        err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate path prefix");
+    } else {
+        size_t len = strlen(prefix);
+
+        while (len > 0 && prefix[len - 1u] == '/') {
+            prefix[--len] = '\0';
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = select_commits(ctx, rev, &entries, &count, &range);
+        if (err == SCRIBE_ENOT_FOUND && rev == NULL) {
+            err = SCRIBE_OK;
+            count = 0;
+        }
+    }
+    memset(&prev, 0, sizeof(prev));
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        st.commit = i;
+        err = resolve_prefix(ctx, &entries[i], prefix, &cur);
+        if (err == SCRIBE_OK) {
+            err = scribe_diff_walk_path(ctx, &prev, &cur, prefix, grep_visit, &st);
+            prev = cur;
+        }
+    }
+    for (i = 0; err == SCRIBE_OK && i < st.open.cap; i++) {
+        if (st.open.used[i]) {
+            st.items[st.open.values[i]].last = count - 1u;
+        }
+    }
+    if (err == SCRIBE_OK && st.count != 0) {
+        blobs = (uint8_t *)malloc(st.count * SCRIBE_HASH_SIZE);
+        search.matched = (uint8_t *)calloc(st.count, 1u);
+        err = blobs == NULL || search.matched == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate blob set")
+                                                      : SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK && st.count != 0) {
+        for (i = 0; i < st.count; i++) {
+            memcpy(blobs + i * SCRIBE_HASH_SIZE, st.items[i].blob, SCRIBE_HASH_SIZE);
+        }
+        qsort(blobs, st.count, SCRIBE_HASH_SIZE, blob_compare);
+        for (i = 0; i < st.count; i++) {
+            if (unique == 0 || memcmp(blobs + (unique - 1u) * SCRIBE_HASH_SIZE, blobs + i * SCRIBE_HASH_SIZE,
+                                      SCRIBE_HASH_SIZE) != 0) {
+                memmove(blobs + unique * SCRIBE_HASH_SIZE, blobs + i * SCRIBE_HASH_SIZE, SCRIBE_HASH_SIZE);
+                unique++;
+            }
+        }
+        search.ctx = ctx;
+        search.pattern = pattern;
+        search.pattern_len = strlen(pattern);
+        search.regex = have_regex ? &regex : NULL;
+        search.blobs = blobs;
+        search.count = unique;
+        err = search_blobs(&search);
+    }
+    for (i = 0; err == SCRIBE_OK && i < st.count; i++) {
+        const grep_interval *item = &st.items[i];
+        const uint8_t *hit = (const uint8_t *)bsearch(item->blob, blobs, unique, SCRIBE_HASH_SIZE, blob_compare);
+
+        if (!search.matched[(size_t)(hit - blobs) / SCRIBE_HASH_SIZE]) {
+            continue;
+        }
+        if (range) {
+            char first[SCRIBE_HEX_HASH_SIZE + 1];
+            char last[SCRIBE_HEX_HASH_SIZE + 1];
+
+            scribe_hash_to_hex(entries[item->first].hash, first);
+            scribe_hash_to_hex(entries[item->last].hash, last);
+            printf("%.12s %.12s %s\n", first, last, item->path);
+        } else {
+            printf("%s\n", item->path);
+        }
+    }
+    for (i = 0; i < st.count; i++) {
+        free(st.items[i].path);
+    }
+    free(st.items);
+    scribe_hash_map_destroy(&st.open);
+    free(search.matched);
+    free(blobs);
+    free(entries);
+    free(prefix);
+    if (have_regex) {
+        regfree(&regex);
+    }
+    return err;
+}
@@ -0,0 +1,210 @@
+/*
+ * Object-hash map.
+ *
+ * An open-addressing table from a SCRIBE_HASH_SIZE key to a u64 value, shared
+ * by every in-memory index keyed by object hash: bitmap and archive walk sets,
+ * the leaf-count and commit-summary caches, the in-memory object engine, and
+ * the intern table and grep and field-index path maps, which key by the
+ * BLAKE3 of the name or path.
+ * Keys are BLAKE3 output, so their first bytes are uniform and index the table
+ * directly. Probing is linear and removal shifts the probe run back, so there
+ * are no tombstones. A zeroed map is empty and valid; callers lock around it
+ * themselves where it is shared.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+
+#include "blake3.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Returns the slot a key starts probing from.
+ */
+static size_t map_home(const uint8_t key[SCRIBE_HASH_SIZE], size_t cap) {
+    uint64_t h = 0;
+    size_t i;
+
+    for (i = 0; i < 8u; i++) {
+        h = (h << 8) | key[i];
+    }
+    return (size_t)(h & (uint64_t)(cap - 1u));
+}
+
+/*
+ * Finds a key. Returns its slot, or the empty slot where it would be
+ * inserted, and sets *found accordingly. The map must have slots.
+ */
+static size_t map_find(const scribe_hash_map *m, const uint8_t key[SCRIBE_HASH_SIZE], int *found) {
+    size_t slot = map_home(key, m->cap);
+
+    while (m->used[slot]) {
+        if (memcmp(m->keys + slot * SCRIBE_HASH_SIZE, key, SCRIBE_HASH_SIZE) == 0) {
+            *found = 1;
+            return slot;
+        }
+        slot = (slot + 1u) & (m->cap - 1u);
+    }
+    *found = 0;
+    return slot;
+}
+
+/*
+ * Resizes the table to `cap` slots (a power of two above the entry count)
+ * and reinserts every entry.
+ */
+static scribe_error_t map_resize(scribe_hash_map *m, size_t cap) {
+    scribe_hash_map grown;
+    size_t i;
+
+    if (cap > SIZE_MAX / SCRIBE_HASH_SIZE || cap > SIZE_MAX / sizeof(*grown.values)) {
+        return scribe_set_error(SCRIBE_ENOMEM, "hash map is too large");
+    }
+    memset(&grown, 0, sizeof(grown));
+    grown.cap = cap;
+    grown.keys = (uint8_t *)malloc(cap * SCRIBE_HASH_SIZE);
+    grown.values = (uint64_t *)malloc(cap * sizeof(*grown.values));
+    grown.used = (uint8_t *)calloc(cap, 1u);
+    if (grown.keys == NULL || grown.values == NULL || grown.used == NULL) {
+        scribe_hash_map_destroy(&grown);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to grow hash map");
+    }
+    for (i = 0; i < m->cap; i++) {
+        if (m->used[i]) {
+            int found;
+            size_t slot = map_find(&grown, m->keys + i * SCRIBE_HASH_SIZE, &found);
+
+            memcpy(grown.keys + slot * SCRIBE_HASH_SIZE, m->keys + i * SCRIBE_HASH_SIZE, SCRIBE_HASH_SIZE);
+            grown.values[slot] = m->values[i];
+            grown.used[slot] = 1u;
+        }
+    }
+    grown.count = m->count;
+    scribe_hash_map_destroy(m);
+    *m = grown;
+    return SCRIBE_OK;
+}
+
+/*
+ * Makes room for `count` entries in total without further growth. Loaders
+ * that know their record count call this once up front.
+ */
+scribe_error_t scribe_hash_map_reserve(scribe_hash_map *m, size_t count) {
+    size_t cap = m->cap == 0 ? 1024u : m->cap;
+
+    while (count * 4u > cap * 3u) {
+        if (cap > SIZE_MAX / 2u) {
+            return scribe_set_error(SCRIBE_ENOMEM, "hash map is too large");
+        }
+        cap *= 2u;
+    }
+    return cap == m->cap ? SCRIBE_OK : map_resize(m, cap);
+}
+
+/*
+ * Returns a pointer to the value stored under `key`, or NULL when the key is
+ * absent. The pointer is valid until the next insert or remove.
+ */
+uint64_t *scribe_hash_map_get(const scribe_hash_map *m, const uint8_t key[SCRIBE_HASH_SIZE]) {
+    size_t slot;
+    int found;
+
+    if (m->cap == 0) {
+        return NULL;
+    }
+    slot = map_find(m, key, &found);
+    return found ? &m->values[slot] : NULL;
+}
+
+/*
+ * Inserts `key` with `value` unless it is already present, in which case the
+ * stored value is kept. *already reports which happened, and *out_value (when
+ * not NULL) points at the stored value so callers can overwrite it.
+ */
+scribe_error_t scribe_hash_map_add(scribe_hash_map *m, const uint8_t key[SCRIBE_HASH_SIZE], uint64_t value,
+                                   int *already, uint64_t **out_value) {
+    size_t slot;
+    int found;
+    scribe_error_t err;
+
+    if (m->cap == 0 || (m->count + 1u) * 4u > m->cap * 3u) {
+        if (m->cap > SIZE_MAX / 2u) {
+            return scribe_set_error(SCRIBE_ENOMEM, "hash map is too large");
+        }
+        err = map_resize(m, m->cap == 0 ? 1024u : m->cap * 2u);
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+    }
+    slot = map_find(m, key, &found);
+    if (!found) {
+        memcpy(m->keys + slot * SCRIBE_HASH_SIZE, key, SCRIBE_HASH_SIZE);
+        m->values[slot] = value;
+        m->used[slot] = 1u;
+        m->count++;
+    }
+    if (already != NULL) {
+        *already = found;
+    }
+    if (out_value != NULL) {
+        *out_value = &m->values[slot];
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Removes `key` if present and re-places the rest of its probe run so later
+ * lookups never stop at the hole. Returns whether the key was present.
+ */
+int scribe_hash_map_remove(scribe_hash_map *m, const uint8_t key[SCRIBE_HASH_SIZE]) {
+    size_t slot;
+    size_t next;
+    int found;
+
+    if (m->cap == 0) {
+        return 0;
+    }
+    slot = map_find(m, key, &found);
+    if (!found) {
+        return 0;
+    }
+    m->used[slot] = 0;
+    m->count--;
+    for (next = (slot + 1u) & (m->cap - 1u); m->used[next]; next = (next + 1u) & (m->cap - 1u)) {
+        size_t home = map_home(m->keys + next * SCRIBE_HASH_SIZE, m->cap);
+
+        /* Move the entry back when the hole lies between its home slot and it. */
+        if (((next - home) & (m->cap - 1u)) >= ((next - slot) & (m->cap - 1u))) {
+            memcpy(m->keys + slot * SCRIBE_HASH_SIZE, m->keys + next * SCRIBE_HASH_SIZE, SCRIBE_HASH_SIZE);
+            m->values[slot] = m->values[next];
+            m->used[slot] = 1u;
+            m->used[next] = 0;
+            slot = next;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Derives a map key from arbitrary bytes such as a path. BLAKE3 makes
+ * distinct inputs distinct keys for the same reason it names objects.
+ */
+void scribe_hash_map_key(const void *bytes, size_t len, uint8_t out[SCRIBE_HASH_SIZE]) {
+    blake3_hasher hasher;
+
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, bytes, len);
+    blake3_hasher_finalize(&hasher, out, SCRIBE_HASH_SIZE);
+}
+
+/*
+ * Frees a map's arrays and leaves it empty. Safe on a zeroed map.
+ */
+void scribe_hash_map_destroy(scribe_hash_map *m) {
+    free(m->keys);
+    free(m->values);
+    free(m->used);
+    memset(m, 0, sizeof(*m));
+}
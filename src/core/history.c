@@ -0,0 +1,176 @@
+/*
+ * History selection shared by maintenance commands.
+ *
+ * `compact-history` and `archive` both act on "old history": the longest
+ * prefix of main's chain, oldest first, whose committer times are older than
+ * an age given on the command line. This file parses those ages and loads the
+ * chain with each commit's root tree and time.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Parses a duration such as 90d or 1h into nanoseconds. The suffix is one of
+ * s, m, h, d, or w; `option` names the flag in error messages.
+ */
+scribe_error_t scribe_parse_duration(const char *s, const char *option, int64_t *out) {
+    int64_t unit;
+    char *end = NULL;
+    unsigned long long n;
+
+    if (s == NULL || s[0] < '0' || s[0] > '9') {
+        return scribe_set_error(SCRIBE_EINVAL, "%s: invalid duration '%s'", option, s == NULL ? "" : s);
+    }
+    n = strtoull(s, &end, 10);
+    switch (end[0]) {
+    case 's':
+        unit = 1000000000;
+        break;
+    case 'm':
+        unit = (int64_t)60 * 1000000000;
+        break;
+    case 'h':
+        unit = (int64_t)3600 * 1000000000;
+        break;
+    case 'd':
+        unit = (int64_t)86400 * 1000000000;
+        break;
+    case 'w':
+        unit = (int64_t)7 * 86400 * 1000000000;
+        break;
+    default:
+        return scribe_set_error(SCRIBE_EINVAL, "%s: duration '%s' needs a unit of s, m, h, d, or w", option, s);
+    }
+    if (end[1] != '\0' || n > (unsigned long long)(INT64_MAX / unit)) {
+        return scribe_set_error(SCRIBE_EINVAL, "%s: invalid duration '%s'", option, s);
+    }
+    *out = (int64_t)n * unit;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads a commit's root tree, committer time, and parent.
+ */
+static scribe_error_t read_entry(scribe_ctx *ctx, scribe_history_entry *e, uint8_t parent[SCRIBE_HASH_SIZE],
+                                 int *has_parent) {
+    scribe_object obj;
+    scribe_arena arena = {0};
+    scribe_commit_view view;
+    scribe_error_t err = scribe_object_read(ctx, e->hash, &obj);
+
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_COMMIT) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "history contains a non-commit object");
+    }
+    err = scribe_arena_init(&arena, obj.payload_len + 4096u);
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view);
+    }
+    if (err == SCRIBE_OK) {
+        scribe_hash_copy(e->root, view.root_tree);
+        e->time = view.committer_time;
+        scribe_hash_copy(parent, view.parent);
+        *has_parent = view.has_parent;
+    }
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Walks the chain from `head` to the initial commit and returns it oldest
+ * first in a heap array the caller frees.
+ */
+scribe_error_t scribe_history_load(scribe_ctx *ctx, const uint8_t head[SCRIBE_HASH_SIZE],
+                                   scribe_history_entry **out, size_t *out_count) {
+    return scribe_history_load_range(ctx, head, NULL, 0, out, out_count);
+}
+
+/*
+ * Like scribe_history_load(), but stops before `base` when it is not NULL and
+ * after `limit` commits when it is not 0, so callers that need only the tip
+ * or the part of history after a known commit do not read back to the root.
+ * Reaching the initial commit without meeting `base` is SCRIBE_EINVAL.
+ */
+scribe_error_t scribe_history_load_range(scribe_ctx *ctx, const uint8_t head[SCRIBE_HASH_SIZE], const uint8_t *base,
+                                         size_t limit, scribe_history_entry **out, size_t *out_count) {
+    scribe_history_entry *items = NULL;
+    uint8_t current[SCRIBE_HASH_SIZE];
+    size_t count = 0;
+    size_t cap = 0;
+    size_t i;
+    int has_current = 1;
+    scribe_error_t err = SCRIBE_OK;
+
+    scribe_hash_copy(current, head);
+    while (err == SCRIBE_OK && has_current) {
+        if (base != NULL && scribe_hash_cmp(current, base) == 0) {
+            break;
+        }
+        if (limit != 0 && count == limit) {
+            break;
+        }
+        if (count == cap) {
+            size_t grown_cap = cap == 0 ? 256u : cap * 2u;
+            scribe_history_entry *grown;
+
+            if (grown_cap > SIZE_MAX / sizeof(*grown)) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "history is too long");
+                break;
+            }
+            grown = (scribe_history_entry *)realloc(items, grown_cap * sizeof(*grown));
+            if (grown == NULL) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "failed to grow history");
+                break;
+            }
+            items = grown;
+            cap = grown_cap;
+        }
+        scribe_hash_copy(items[count].hash, current);
+        err = read_entry(ctx, &items[count], current, &has_current);
+        count++;
+    }
+    if (err == SCRIBE_OK && base != NULL && !has_current) {
+        err = scribe_set_error(SCRIBE_EINVAL, "range base is not an ancestor of the range end");
+    }
+    if (err != SCRIBE_OK) {
+        free(items);
+        return err;
+    }
+    for (i = 0; i < count / 2u; i++) {
+        scribe_history_entry tmp = items[i];
+
+        items[i] = items[count - 1u - i];
+        items[count - 1u - i] = tmp;
+    }
+    *out = items;
+    *out_count = count;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns how many of the oldest entries are older than `age` before now. A
+ * commit at or past the cutoff ends the old part even if older timestamps
+ * follow it, so the old part is always a prefix of history.
+ */
+size_t scribe_history_cold_count(const scribe_history_entry *entries, size_t count, int64_t age) {
+    struct timespec now;
+    int64_t cutoff;
+    size_t n = 0;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    cutoff = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec - age;
+    while (n < count && entries[n].time < cutoff) {
+        n++;
+    }
+    return n;
+}
@@ -12,16 +12,11 @@
 #include "util/hex.h"
 
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct {
-    uint8_t *hashes;
-    size_t count;
-    size_t cap;
-} hash_set;
-
 /*
  * Maps an object type byte to the public type string used in list/tree output.
  * NULL means the type is not valid in the current context.
@@ -56,60 +51,6 @@ static int type_mask(uint8_t type) {
     return 0;
 }
 
-/*
- * Returns whether an in-memory hash set already contains a hash. The set is a
- * simple linear array because reachable-listing is an inspection command.
- */
-static int hash_set_has(const hash_set *set, const uint8_t hash[SCRIBE_HASH_SIZE]) {
-    size_t i;
-
-    for (i = 0; i < set->count; i++) {
-        if (memcmp(set->hashes + i * SCRIBE_HASH_SIZE, hash, SCRIBE_HASH_SIZE) == 0) {
-            return 1;
-        }
-    }
-    return 0;
-}
-
-/*
- * Adds a hash to the reachable set, growing the backing array as needed. The
- * already flag lets callers avoid re-walking shared history or shared subtrees.
- */
-static scribe_error_t hash_set_add(hash_set *set, const uint8_t hash[SCRIBE_HASH_SIZE], int *already) {
-    uint8_t *grown;
-
-    *already = hash_set_has(set, hash);
-    if (*already) {
-        return SCRIBE_OK;
-    }
-    if (set->count == set->cap) {
-        size_t new_cap = set->cap == 0 ? 128u : set->cap * 2u;
-        if (new_cap < set->cap || new_cap > SIZE_MAX / SCRIBE_HASH_SIZE) {
-            return scribe_set_error(SCRIBE_ENOMEM, "reachable object set is too large");
-        }
-        grown = (uint8_t *)realloc(set->hashes, new_cap * SCRIBE_HASH_SIZE);
-        if (grown == NULL) {
-            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow reachable object set");
-        }
-        set->hashes = grown;
-        set->cap = new_cap;
-    }
-    memcpy(set->hashes + set->count * SCRIBE_HASH_SIZE, hash, SCRIBE_HASH_SIZE);
-    set->count++;
-    return SCRIBE_OK;
-}
-
-/*
- * Frees the memory owned by a hash set and clears it. This is safe to call on an
- * empty or partially initialized set.
- */
-static void hash_set_destroy(hash_set *set) {
-    if (set != NULL) {
-        free(set->hashes);
-        memset(set, 0, sizeof(*set));
-    }
-}
-
 /*
  * Reads a commit object and parses it into an arena-backed view. This local
  * helper keeps inspect.c independent from diff.c's private read helper.
@@ -130,41 +71,6 @@ static scribe_error_t read_commit_view(scribe_ctx *ctx, const uint8_t hash[SCRIB
     return err;
 }
 
-/*
- * Reads a tree object and parses its entries into the supplied arena. The arena
- * is initialized here because callers frequently use this as a one-shot parse.
- */
-static scribe_error_t read_tree_entries(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_arena *arena,
-                                        scribe_tree_entry **entries, size_t *count) {
-    scribe_object obj;
-    scribe_error_t err;
-    size_t arena_capacity = 0;
-
-    err = scribe_arena_init(arena, 0);
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    err = scribe_object_read(ctx, hash, &obj);
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    if (obj.type != SCRIBE_OBJECT_TREE) {
-        scribe_object_free(&obj);
-        return scribe_set_error(SCRIBE_ECORRUPT, "object is not a tree");
-    }
-    err = scribe_tree_parse_arena_capacity(obj.payload_len, &arena_capacity);
-    if (err == SCRIBE_OK) {
-        err = scribe_arena_init(arena, arena_capacity);
-    }
-    if (err != SCRIBE_OK) {
-        scribe_object_free(&obj);
-        return err;
-    }
-    err = scribe_tree_parse(obj.payload, obj.payload_len, arena, entries, count);
-    scribe_object_free(&obj);
-    return err;
-}
-
 /*
  * Joins a tree-listing prefix and entry name into a slash-separated display
  * path. Lengths are explicit because tree entry names are byte strings with
@@ -217,9 +123,10 @@ static scribe_error_t print_tree_entries_recursive(scribe_ctx *ctx, const uint8_
      * ls-tree is recursive by design. Print the current entry first, then
      * descend into subtrees using the full path assembled so far. The path is
      * not shell-quoted because Scribe path components cannot contain tabs or
-     * newlines, and Mongo-shaped paths are meant to be copied exactly.
+     * newlines, and Mongo-shaped paths are meant to be copied exactly. Shard
+     * levels of large trees are expanded here and never printed.
      */
-    err = read_tree_entries(ctx, tree_hash, &arena, &entries, &count);
+    err = scribe_tree_read_logical(ctx, tree_hash, &arena, &entries, &count);
     if (err != SCRIBE_OK) {
         scribe_arena_destroy(&arena);
         return err;
@@ -309,120 +216,6 @@ scribe_error_t scribe_cli_ls_tree(scribe_ctx *ctx, const char *hex) {
     return print_tree_entries(ctx, tree_hash);
 }
 
-static scribe_error_t walk_reachable_object(hash_set *set, scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
-                                            uint8_t expected_type);
-
-/*
- * Adds all child objects referenced by a reachable tree to the reachable set.
- * Each child is walked according to the type recorded in the tree entry.
- */
-static scribe_error_t walk_reachable_tree(hash_set *set, scribe_ctx *ctx, scribe_object *obj) {
-    scribe_arena arena;
-    scribe_tree_entry *entries = NULL;
-    size_t count = 0;
-    size_t i;
-    size_t arena_capacity = 0;
-    scribe_error_t err = scribe_tree_parse_arena_capacity(obj->payload_len, &arena_capacity);
-
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    err = scribe_arena_init(&arena, arena_capacity);
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    err = scribe_tree_parse(obj->payload, obj->payload_len, &arena, &entries, &count);
-    if (err != SCRIBE_OK) {
-        scribe_arena_destroy(&arena);
-        return err;
-    }
-    for (i = 0; i < count; i++) {
-        err = walk_reachable_object(set, ctx, entries[i].hash, entries[i].type);
-        if (err != SCRIBE_OK) {
-            scribe_arena_destroy(&arena);
-            return err;
-        }
-    }
-    scribe_arena_destroy(&arena);
-    return SCRIBE_OK;
-}
-
-/*
- * Adds the root tree and parent commit referenced by a reachable commit. This
- * makes --reachable include transitive history, not only the HEAD snapshot.
- */
-static scribe_error_t walk_reachable_commit(hash_set *set, scribe_ctx *ctx, scribe_object *obj) {
-    scribe_arena arena;
-    scribe_commit_view view;
-    scribe_error_t err = scribe_arena_init(&arena, obj->payload_len + 4096u);
-
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    err = scribe_commit_parse(obj->payload, obj->payload_len, &arena, &view);
-    if (err == SCRIBE_OK) {
-        err = walk_reachable_object(set, ctx, view.root_tree, SCRIBE_OBJECT_TREE);
-    }
-    if (err == SCRIBE_OK && view.has_parent) {
-        err = walk_reachable_object(set, ctx, view.parent, SCRIBE_OBJECT_COMMIT);
-    }
-    scribe_arena_destroy(&arena);
-    return err;
-}
-
-/*
- * Adds and verifies one object in the reachable walk. Expected type mismatches
- * are corruption because parent objects define the child type contract.
- */
-static scribe_error_t walk_reachable_object(hash_set *set, scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
-                                            uint8_t expected_type) {
-    scribe_object obj;
-    int already = 0;
-    scribe_error_t err = hash_set_add(set, hash, &already);
-
-    if (err != SCRIBE_OK || already) {
-        return err;
-    }
-    err = scribe_object_read(ctx, hash, &obj);
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    if (obj.type != expected_type) {
-        scribe_object_free(&obj);
-        return scribe_set_error(SCRIBE_ECORRUPT, "reachable object has wrong type");
-    }
-    if (obj.type == SCRIBE_OBJECT_TREE) {
-        err = walk_reachable_tree(set, ctx, &obj);
-    } else if (obj.type == SCRIBE_OBJECT_COMMIT) {
-        err = walk_reachable_commit(set, ctx, &obj);
-    }
-    scribe_object_free(&obj);
-    return err;
-}
-
-/*
- * Builds the full in-memory reachable set for list-objects --reachable. It
- * starts from refs/heads/main and walks parents, root trees, subtrees, and blobs.
- */
-static scribe_error_t build_reachable_set(scribe_ctx *ctx, hash_set *set) {
-    /*
-     * list-objects --reachable uses the same graph idea as fsck: start at
-     * refs/heads/main, follow every parent commit, and follow every root tree
-     * down to blobs. The result is held in memory and then used as a filter over
-     * the object-store iterator.
-     */
-    uint8_t head[SCRIBE_HASH_SIZE];
-    scribe_error_t err = scribe_refs_read(ctx, "refs/heads/main", head);
-
-    if (err == SCRIBE_ENOT_FOUND) {
-        return SCRIBE_OK;
-    }
-    if (err != SCRIBE_OK) {
-        return err;
-    }
-    return walk_reachable_object(set, ctx, head, SCRIBE_OBJECT_COMMIT);
-}
-
 /*
  * Validates a list-objects output template before any objects are printed. This
  * prevents a bad placeholder from producing partial output.
@@ -454,10 +247,11 @@ static scribe_error_t validate_format(const char *format) {
 
 typedef struct {
     scribe_ctx *ctx;
-    hash_set *reachable_set;
+    scribe_reachable *reachable_set;
     int reachable_only;
     int type_mask;
     const char *format;
+    pthread_mutex_t print_mu;
 } list_objects_state;
 
 /*
@@ -506,6 +300,8 @@ static scribe_error_t print_formatted_object(list_objects_state *state, const ui
 /*
  * Object-store iterator callback for list-objects. It applies reachable and
  * type filters, reads the object for verification/metadata, then prints it.
+ * Visits run concurrently; only the print is serialized so lines never
+ * interleave.
  */
 static scribe_error_t list_object_visit(const uint8_t hash[SCRIBE_HASH_SIZE], void *user) {
     list_objects_state *state = (list_objects_state *)user;
@@ -513,7 +309,7 @@ static scribe_error_t list_object_visit(const uint8_t hash[SCRIBE_HASH_SIZE], vo
     scribe_error_t err;
     int mask;
 
-    if (state->reachable_only && !hash_set_has(state->reachable_set, hash)) {
+    if (state->reachable_only && !scribe_reachable_has(state->reachable_set, hash)) {
         return SCRIBE_OK;
     }
     err = scribe_object_read(state->ctx, hash, &obj);
@@ -529,17 +325,21 @@ static scribe_error_t list_object_visit(const uint8_t hash[SCRIBE_HASH_SIZE], vo
         scribe_object_free(&obj);
         return SCRIBE_OK;
     }
+    pthread_mutex_lock(&state->print_mu);
     err = print_formatted_object(state, hash, &obj);
+    pthread_mutex_unlock(&state->print_mu);
     scribe_object_free(&obj);
     return err;
 }
 
 /*
- * Implements `scribe list-objects`. Reachable mode first builds an in-memory
- * graph set, then all modes iterate the object store through its iterator API.
+ * Implements `scribe list-objects`. Reachable mode first computes the set
+ * reachable from refs/heads/main (using reachability bitmaps when present),
+ * then all modes iterate the object store through its concurrent iterator, so
+ * output order is unspecified.
  */
 scribe_error_t scribe_cli_list_objects(scribe_ctx *ctx, int type_mask_value, int reachable, const char *format) {
-    hash_set reachable_set;
+    scribe_reachable *reachable_set = NULL;
     list_objects_state state;
     scribe_error_t err;
 
@@ -547,21 +347,24 @@ scribe_error_t scribe_cli_list_objects(scribe_ctx *ctx, int type_mask_value, int
     if (err != SCRIBE_OK) {
         return err;
     }
-    memset(&reachable_set, 0, sizeof(reachable_set));
     if (reachable) {
-        err = build_reachable_set(ctx, &reachable_set);
+        err = scribe_reachable_compute(ctx, &reachable_set);
         if (err != SCRIBE_OK) {
-            hash_set_destroy(&reachable_set);
             return err;
         }
     }
     state.ctx = ctx;
-    state.reachable_set = &reachable_set;
+    state.reachable_set = reachable_set;
     state.reachable_only = reachable;
     state.type_mask = type_mask_value;
     state.format = format;
-    err = scribe_object_iter(ctx, list_object_visit, &state);
-    hash_set_destroy(&reachable_set);
+    if (pthread_mutex_init(&state.print_mu, NULL) != 0) {
+        scribe_reachable_free(reachable_set);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize list-objects lock");
+    }
+    err = scribe_object_iter_concurrent(ctx, list_object_visit, &state);
+    pthread_mutex_destroy(&state.print_mu);
+    scribe_reachable_free(reachable_set);
     return err;
 }
 
@@ -594,7 +397,8 @@ static scribe_error_t resolve_tree_path(scribe_ctx *ctx, const uint8_t root_tree
      * Path resolution is shared by "show commit:path" and log path filtering.
      * strict=1 gives user-facing ENOT_FOUND diagnostics; strict=0 turns missing
      * paths and attempts to descend through blobs into an ABSENT result so log
-     * can compare "present vs absent" across commits.
+     * can compare "present vs absent" across commits. Each component is looked
+     * up in the bucket that holds it, so shard levels cost one small read each.
      */
     if (path == NULL || path[0] == '\0') {
         scribe_hash_copy(out_hash, root_tree);
@@ -610,7 +414,7 @@ static scribe_error_t resolve_tree_path(scribe_ctx *ctx, const uint8_t root_tree
         scribe_tree_entry *entries = NULL;
         scribe_tree_entry *entry = NULL;
         size_t count = 0;
-        scribe_error_t err = read_tree_entries(ctx, current, &arena, &entries, &count);
+        scribe_error_t err = scribe_tree_read_bucket(ctx, current, part, part_len, &arena, &entries, &count);
         if (err == SCRIBE_OK) {
             entry = find_tree_entry(entries, count, part, part_len);
             if (entry == NULL) {
@@ -683,9 +487,14 @@ scribe_error_t scribe_tree_resolve_path(scribe_ctx *ctx, const uint8_t root_tree
 /*
  * Writes a blob object's raw payload bytes to stdout. No newline or envelope is
  * added, which makes `scribe show commit:path` suitable for piping to jq/diff.
+ * With `render_json`, sorted-BSON blobs are rendered as canonical Extended JSON
+ * instead; any other payload is still written unchanged.
  */
-static scribe_error_t write_blob_payload(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+static scribe_error_t write_blob_payload(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], int render_json) {
     scribe_object obj;
+    const uint8_t *bytes;
+    size_t len;
+    char *json = NULL;
     scribe_error_t err = scribe_object_read(ctx, hash, &obj);
 
     if (err != SCRIBE_OK) {
@@ -695,10 +504,22 @@ static scribe_error_t write_blob_payload(scribe_ctx *ctx, const uint8_t hash[SCR
         scribe_object_free(&obj);
         return scribe_set_error(SCRIBE_ECORRUPT, "object is not a blob");
     }
-    if (obj.payload_len != 0 && fwrite(obj.payload, 1, obj.payload_len, stdout) != obj.payload_len) {
+    bytes = obj.payload;
+    len = obj.payload_len;
+    if (render_json && scribe_bson_is_document(obj.payload, obj.payload_len)) {
+        err = scribe_bson_to_json(obj.payload, obj.payload_len, &json, &len);
+        if (err != SCRIBE_OK) {
+            scribe_object_free(&obj);
+            return err;
+        }
+        bytes = (const uint8_t *)json;
+    }
+    if (len != 0 && fwrite(bytes, 1, len, stdout) != len) {
+        free(json);
         scribe_object_free(&obj);
         return scribe_set_error(SCRIBE_EIO, "failed to write blob payload");
     }
+    free(json);
     scribe_object_free(&obj);
     return SCRIBE_OK;
 }
@@ -708,7 +529,7 @@ static scribe_error_t write_blob_payload(scribe_ctx *ctx, const uint8_t hash[SCR
  * the path side is walked from the commit root and then printed as raw blob
  * bytes or recursive tree entries.
  */
-scribe_error_t scribe_cli_show_path(scribe_ctx *ctx, const char *spec) {
+scribe_error_t scribe_cli_show_path(scribe_ctx *ctx, const char *spec, int render_json) {
     const char *colon = strchr(spec, ':');
     scribe_arena arena;
     char *rev;
@@ -759,7 +580,7 @@ scribe_error_t scribe_cli_show_path(scribe_ctx *ctx, const char *spec) {
         return print_tree_entries(ctx, target_hash);
     }
     if (target_type == SCRIBE_OBJECT_BLOB) {
-        return write_blob_payload(ctx, target_hash);
+        return write_blob_payload(ctx, target_hash, render_json);
     }
     return scribe_set_error(SCRIBE_ECORRUPT, "path resolved to invalid object type");
 }
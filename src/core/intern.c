@@ -0,0 +1,153 @@
+/*
+ * Interned path components.
+ *
+ * Every event under one MongoDB namespace carries the same database and
+ * collection names. The intern table stores each distinct name once per
+ * context and hands out a stable pointer and a dense id, so adapters, the pipe
+ * reader, and the commit builder share one copy instead of duplicating it per
+ * event and per tree edit. Two interned names are equal exactly when their
+ * pointers are, which lets sorting and merging skip the byte comparison for
+ * the common case.
+ *
+ * Only the first SCRIBE_INTERN_DEPTH path levels (database and collection)
+ * and shard bucket names belong here. Those sets stay small for the life of a
+ * context; deeper components and leaf names can be unbounded and would grow
+ * the table forever in a long-running daemon, so callers copy them per batch.
+ * Interned names live until scribe_close(). Lookups go through the shared
+ * hash map, keyed by the BLAKE3 of the name.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_CHUNK_SIZE (64u * 1024u)
+
+/*
+ * Heap arena holding interned name bytes. Chunks are never freed before the
+ * table, which is what keeps returned pointers stable.
+ */
+typedef struct intern_chunk {
+    scribe_arena arena;
+    struct intern_chunk *next;
+} intern_chunk;
+
+struct scribe_intern_table {
+    pthread_mutex_t mu;
+    scribe_hash_map ids;
+    const char **names;
+    size_t count;
+    size_t cap;
+    intern_chunk *chunks;
+};
+
+/*
+ * Copies a new name into the current chunk, starting a fresh chunk when it
+ * does not fit. The caller holds the mutex.
+ */
+static const char *intern_store(scribe_intern_table *t, const char *s, size_t len) {
+    char *copy = t->chunks == NULL ? NULL : scribe_arena_strdup_len(&t->chunks->arena, s, len);
+
+    if (copy == NULL) {
+        intern_chunk *chunk = (intern_chunk *)calloc(1, sizeof(*chunk));
+        size_t size = len + 1u > INTERN_CHUNK_SIZE ? len + 1u : INTERN_CHUNK_SIZE;
+
+        if (chunk == NULL || scribe_arena_init(&chunk->arena, size) != SCRIBE_OK) {
+            free(chunk);
+            return NULL;
+        }
+        chunk->next = t->chunks;
+        t->chunks = chunk;
+        copy = scribe_arena_strdup_len(&chunk->arena, s, len);
+    }
+    return copy;
+}
+
+/*
+ * Allocates an empty table. scribe_open() creates one per context.
+ */
+scribe_error_t scribe_intern_table_new(scribe_intern_table **out) {
+    scribe_intern_table *t = (scribe_intern_table *)calloc(1, sizeof(*t));
+
+    if (t == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate intern table");
+    }
+    if (pthread_mutex_init(&t->mu, NULL) != 0) {
+        free(t);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize intern table");
+    }
+    *out = t;
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees the table and every interned name. Accepts NULL.
+ */
+void scribe_intern_table_free(scribe_intern_table *t) {
+    if (t == NULL) {
+        return;
+    }
+    while (t->chunks != NULL) {
+        intern_chunk *next = t->chunks->next;
+        scribe_arena_destroy(&t->chunks->arena);
+        free(t->chunks);
+        t->chunks = next;
+    }
+    pthread_mutex_destroy(&t->mu);
+    scribe_hash_map_destroy(&t->ids);
+    free(t->names);
+    free(t);
+}
+
+/*
+ * Returns the context's shared copy of a name, NUL-terminated and valid until
+ * scribe_close(), adding it on first use. out_id, when not NULL, receives the
+ * name's id: ids are assigned densely in first-use order and never change.
+ * Safe to call from several threads.
+ */
+scribe_error_t scribe_intern(scribe_ctx *ctx, const char *s, size_t len, const char **out, uint32_t *out_id) {
+    scribe_intern_table *t = ctx->names;
+    uint8_t key[SCRIBE_HASH_SIZE];
+    uint64_t *id = NULL;
+    int already = 0;
+    scribe_error_t err = SCRIBE_OK;
+
+    scribe_hash_map_key(s, len, key);
+    pthread_mutex_lock(&t->mu);
+    if (t->count >= UINT32_MAX) {
+        err = scribe_set_error(SCRIBE_ENOMEM, "intern table is full");
+    } else if (t->count == t->cap) {
+        size_t cap = t->cap == 0 ? 256u : t->cap * 2u;
+        const char **grown = (const char **)realloc((void *)t->names, cap * sizeof(*grown));
+
+        if (grown == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to grow intern table");
+        } else {
+            t->names = grown;
+            t->cap = cap;
+        }
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_hash_map_add(&t->ids, key, t->count, &already, &id);
+    }
+    if (err == SCRIBE_OK && !already) {
+        t->names[t->count] = intern_store(t, s, len);
+        if (t->names[t->count] == NULL) {
+            (void)scribe_hash_map_remove(&t->ids, key);
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to intern name");
+        } else {
+            t->count++;
+        }
+    }
+    if (err == SCRIBE_OK) {
+        *out = t->names[*id];
+        if (out_id != NULL) {
+            *out_id = (uint32_t)*id;
+        }
+    }
+    pthread_mutex_unlock(&t->mu);
+    return err;
+}
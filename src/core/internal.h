@@ -3,7 +3,9 @@
 
 #include "scribe/scribe.h"
 #include "util/arena.h"
+#include "util/membudget.h"
 
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -18,6 +20,112 @@
 #define SCRIBE_LIST_TYPE_TREE 0x02
 #define SCRIBE_LIST_TYPE_COMMIT 0x04
 
+/*
+ * Interior shard levels of a large tree use reserved three-byte entry names:
+ * this marker byte followed by two lowercase hex digits naming the bucket.
+ * Adapter path components may not start with the marker.
+ */
+#define SCRIBE_SHARD_MARKER '\x01'
+#define SCRIBE_SHARD_NAME_LEN 3u
+
+/*
+ * Default memory budget for full-snapshot tree assembly, in bytes. Snapshots
+ * whose records exceed it are sorted in runs on disk.
+ */
+#define SCRIBE_DEFAULT_SNAPSHOT_MEMORY ((size_t)256u * 1024u * 1024u)
+
+/*
+ * Default zstd level `scribe repack` uses to recompress objects that were
+ * written at the adaptive fast level.
+ */
+#define SCRIBE_DEFAULT_REPACK_COMPRESSION_LEVEL 19
+
+/*
+ * Default zstd level `scribe archive` uses for cold objects, and the longest
+ * chain of deltas a reader follows to rebuild one archived object.
+ */
+#define SCRIBE_DEFAULT_ARCHIVE_COMPRESSION_LEVEL 19
+#define SCRIBE_ARCHIVE_MAX_DEPTH 32u
+
+/*
+ * Path levels whose components are interned per context (database and
+ * collection). Deeper components may be unbounded and are copied per batch.
+ */
+#define SCRIBE_INTERN_DEPTH 2u
+
+/*
+ * Change-stream lag, in milliseconds, above which writes count as backlogged
+ * for adaptive compression.
+ */
+#define SCRIBE_COMPRESSION_LAG_MS 2000u
+
+/*
+ * Field indexes catch up with main after this many published commits or this
+ * many milliseconds, whichever comes first, and when the writer closes.
+ */
+#define SCRIBE_FIELD_INDEX_BATCH 64u
+#define SCRIBE_FIELD_INDEX_LAG_MS 1000u
+
+/*
+ * Encoding of Mongo document blobs. JSON is canonical Extended JSON; sorted
+ * BSON is libbson's binary form with object keys recursively byte-sorted.
+ */
+typedef enum {
+    SCRIBE_BLOB_FORMAT_JSON = 0,
+    SCRIBE_BLOB_FORMAT_BSON_SORTED = 1,
+} scribe_blob_format;
+
+/*
+ * Where update events of a Mongo change stream get their post-change
+ * document (§13.3). LOOKUP is fullDocument=updateLookup, a server read per
+ * update. WHEN_AVAILABLE and REQUIRED use stored post-images and need no read;
+ * REQUIRED fails the stream when one is missing.
+ */
+typedef enum {
+    SCRIBE_FULL_DOCUMENT_LOOKUP = 0,
+    SCRIBE_FULL_DOCUMENT_WHEN_AVAILABLE = 1,
+    SCRIBE_FULL_DOCUMENT_REQUIRED = 2,
+} scribe_full_document;
+
+/*
+ * When object writes reach stable storage (§15). Strict fsyncs every object
+ * file; batch issues one barrier per commit or bootstrap; relaxed leaves the
+ * barrier to a background syncer and publishes refs only behind it.
+ */
+typedef enum {
+    SCRIBE_DURABILITY_STRICT = 0,
+    SCRIBE_DURABILITY_BATCH = 1,
+    SCRIBE_DURABILITY_RELAXED = 2,
+} scribe_durability;
+
+/*
+ * Default interval, in seconds, between background syncs in relaxed mode.
+ */
+#define SCRIBE_DEFAULT_DURABILITY_SYNC_SECONDS 5
+
+/*
+ * How the pipe writer assigns refs. none commits every batch on
+ * refs/heads/main; database commits each database on its own partition ref
+ * and publishes each batch's commit on main (see partition.c).
+ */
+typedef enum {
+    SCRIBE_REF_PARTITIONING_NONE = 0,
+    SCRIBE_REF_PARTITIONING_DATABASE = 1,
+} scribe_ref_partitioning;
+
+/*
+ * Default interval, in milliseconds, between publications to main when refs
+ * are partitioned.
+ */
+#define SCRIBE_DEFAULT_PARTITION_PUBLISH_MS 1000
+
+/*
+ * Field indexes are configured as `index.<collection>.<field> = true` and
+ * stored as "<collection>.<field>"; see fieldindex.c.
+ */
+#define SCRIBE_MAX_FIELD_INDEXES 16u
+#define SCRIBE_FIELD_INDEX_NAME_MAX 128u
+
 typedef struct {
     int scribe_format_version;
     int compression_level;
@@ -25,16 +133,67 @@ typedef struct {
     size_t event_queue_capacity;
     int queue_stall_warn_seconds;
     bool adapter_require_pre_post_images;
+    bool adapter_enable_post_images;
     int adapter_coalesce_window_ms;
     char adapter_excluded_databases[128];
+    scribe_blob_format adapter_blob_format;
+    size_t tree_shard_threshold;
+    size_t snapshot_memory_bytes;
+    size_t memory_limit_bytes;
+    int adaptive_compression_level;
+    int repack_compression_level;
+    int archive_compression_level;
+    scribe_durability durability;
+    int durability_sync_seconds;
+    scribe_ref_partitioning ref_partitioning;
+    int partition_publish_ms;
+    bool worker_cpu_affinity;
+    size_t field_index_count;
+    char field_indexes[SCRIBE_MAX_FIELD_INDEXES][SCRIBE_FIELD_INDEX_NAME_MAX];
 } scribe_config;
 
+/*
+ * CPU and memory limits found at open (see resources.c). Every field except
+ * cpus and online_cpus is 0 when its source is unlimited or unavailable.
+ */
+typedef struct {
+    unsigned online_cpus;
+    unsigned affinity_cpus;
+    unsigned cpuset_cpus;
+    unsigned quota_cpus;
+    unsigned cpus;
+    uint64_t memory_max;
+} scribe_resources;
+
+typedef struct scribe_object_backend scribe_object_backend;
+typedef struct scribe_leaf_cache scribe_leaf_cache;
+typedef struct scribe_intern_table scribe_intern_table;
+typedef struct scribe_syncer scribe_syncer;
+
+/*
+ * Main's tip as last published and how far the field indexes trail it.
+ */
+typedef struct {
+    uint8_t tip[SCRIBE_HASH_SIZE];
+    size_t pending;
+    uint64_t caught_up_ms;
+} scribe_index_lag;
+
 struct scribe_ctx {
     char *repo_path;
     int writable;
     int lock_fd;
     FILE *log_file;
     scribe_config config;
+    scribe_resources resources;
+    scribe_mem_budget mem;
+    atomic_uint compression_pressure;
+    atomic_int fast_objects_fd;
+    scribe_object_backend *objects;
+    scribe_leaf_cache *leaf_counts;
+    scribe_intern_table *names;
+    scribe_syncer *syncer;
+    scribe_index_lag index_lag;
 };
 
 typedef struct {
@@ -44,16 +203,118 @@ typedef struct {
     size_t name_len;
 } scribe_tree_entry;
 
+/*
+ * One read object. has_delta_base is set when the stored encoding is an
+ * archive delta (see object.c); delta_base then names the object it was
+ * rebuilt from, which must stay stored for as long as this one does.
+ */
 typedef struct {
     uint8_t type;
     uint8_t *payload;
     size_t payload_len;
     uint8_t *envelope;
     size_t envelope_len;
+    uint8_t delta_base[SCRIBE_HASH_SIZE];
+    int has_delta_base;
 } scribe_object;
 
+/*
+ * Accumulates the documents of a full snapshot as (path, blob hash, sequence)
+ * records under a memory budget, spilling sorted runs to `.scribe/tmp/`, and
+ * writes the resulting tree bottom-up. See snapshot.c.
+ */
+typedef struct scribe_snapshot_builder scribe_snapshot_builder;
+
 typedef scribe_error_t (*scribe_object_visit_fn)(const uint8_t hash[SCRIBE_HASH_SIZE], void *user);
 
+/* put() flag: overwrite an existing object (a re-encoding of the same envelope). */
+#define SCRIBE_OBJECT_PUT_REPLACE 1u
+/* put() flag: skip the per-object fsync; the object is durable after flush(). */
+#define SCRIBE_OBJECT_PUT_NOSYNC 2u
+
+/* scribe_write_file_atomic_flags() flag: rename without fsyncing. */
+#define SCRIBE_WRITE_NOSYNC 1u
+
+/*
+ * Object-store engine. Engines keep the stored (zstd-compressed) encoding of
+ * each object under its hash and nothing else; object.c owns enveloping,
+ * hashing, compression, and read verification, so every engine gets the same
+ * integrity checks. put() is idempotent unless SCRIBE_OBJECT_PUT_REPLACE is
+ * set, get() returns a heap buffer the caller frees, has()/get()/stat()
+ * report SCRIBE_ENOT_FOUND for absent objects, and flush() makes every
+ * completed put() durable before a ref update publishes it. iter() may call
+ * the visitor from up to `threads` threads at once; threads <= 1 means serial.
+ */
+typedef struct {
+    const char *name;
+    scribe_error_t (*put)(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], const uint8_t *bytes,
+                          size_t len, unsigned flags);
+    scribe_error_t (*get)(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], uint8_t **out,
+                          size_t *out_len);
+    scribe_error_t (*has)(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE]);
+    scribe_error_t (*iter)(scribe_object_backend *b, scribe_object_visit_fn visit, void *user, unsigned threads);
+    scribe_error_t (*stat)(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], size_t *out_len);
+    scribe_error_t (*flush)(scribe_object_backend *b);
+    void (*destroy)(scribe_object_backend *b);
+} scribe_object_backend_ops;
+
+struct scribe_object_backend {
+    const scribe_object_backend_ops *ops;
+};
+
+typedef struct {
+    size_t listed;
+    size_t recompressed;
+    uint64_t bytes_before;
+    uint64_t bytes_after;
+} scribe_repack_stats;
+
+typedef struct {
+    size_t objects;
+    size_t rewritten;
+    size_t deltas;
+    uint64_t bytes_before;
+    uint64_t bytes_after;
+} scribe_archive_stats;
+
+/*
+ * Open-addressing map from an object hash (or another BLAKE3 digest) to a u64;
+ * see hashmap.c. A zeroed map is empty.
+ */
+typedef struct {
+    uint8_t *keys;
+    uint64_t *values;
+    uint8_t *used;
+    size_t count;
+    size_t cap;
+} scribe_hash_map;
+
+typedef struct scribe_archiver scribe_archiver;
+
+typedef struct scribe_reachable scribe_reachable;
+
+/*
+ * Leaf changes of one commit under one database/collection prefix. collection
+ * is empty for a leaf stored directly under the root tree.
+ */
+typedef struct {
+    char *db;
+    size_t db_len;
+    char *collection;
+    size_t collection_len;
+    uint64_t added;
+    uint64_t modified;
+    uint64_t deleted;
+} scribe_prefix_stat;
+
+typedef struct {
+    scribe_prefix_stat *prefixes;
+    size_t count;
+    size_t cap;
+} scribe_commit_stats;
+
+typedef struct scribe_commit_stats_index scribe_commit_stats_index;
+
 typedef struct {
     uint8_t root_tree[SCRIBE_HASH_SIZE];
     bool has_parent;
@@ -88,34 +349,118 @@ typedef struct {
 char *scribe_path_join(const char *a, const char *b);
 scribe_error_t scribe_mkdir_p(const char *path);
 scribe_error_t scribe_write_file_atomic(const char *path, const uint8_t *bytes, size_t len);
+scribe_error_t scribe_write_file_atomic_flags(const char *path, const uint8_t *bytes, size_t len, unsigned flags);
 scribe_error_t scribe_read_file(const char *path, uint8_t **out, size_t *out_len);
 bool scribe_file_exists(const char *path);
 scribe_error_t scribe_list_dir(const char *path, scribe_error_t (*visit)(const char *name, void *ctx), void *ctx);
 
+scribe_error_t scribe_hash_map_reserve(scribe_hash_map *m, size_t count);
+uint64_t *scribe_hash_map_get(const scribe_hash_map *m, const uint8_t key[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_hash_map_add(scribe_hash_map *m, const uint8_t key[SCRIBE_HASH_SIZE], uint64_t value,
+                                   int *already, uint64_t **out_value);
+int scribe_hash_map_remove(scribe_hash_map *m, const uint8_t key[SCRIBE_HASH_SIZE]);
+void scribe_hash_map_key(const void *bytes, size_t len, uint8_t out[SCRIBE_HASH_SIZE]);
+void scribe_hash_map_destroy(scribe_hash_map *m);
+
 scribe_error_t scribe_default_config(scribe_config *cfg);
 scribe_error_t scribe_write_config(const char *repo_path, const scribe_config *cfg);
+const char *scribe_durability_name(scribe_durability mode);
+const char *scribe_ref_partitioning_name(scribe_ref_partitioning mode);
+const char *scribe_full_document_name(scribe_full_document mode);
+scribe_error_t scribe_choose_full_document(const scribe_config *cfg, size_t with, size_t without,
+                                           scribe_full_document *out);
 scribe_error_t scribe_read_config(const char *repo_path, scribe_config *cfg);
 
 scribe_error_t scribe_lock_repo(scribe_ctx *ctx);
 void scribe_unlock_repo(scribe_ctx *ctx);
+void scribe_log_memory(scribe_ctx *ctx, const char *phase);
+unsigned scribe_worker_count(const scribe_ctx *ctx);
+void scribe_resources_probe(const char *root, scribe_resources *out);
+void scribe_resources_log(scribe_ctx *ctx);
+void scribe_worker_pin(scribe_ctx *ctx, pthread_t thread, unsigned index);
 scribe_error_t scribe_refs_read(scribe_ctx *ctx, const char *name, uint8_t out[SCRIBE_HASH_SIZE]);
 scribe_error_t scribe_refs_cas(scribe_ctx *ctx, const char *name, const uint8_t *expected,
                                const uint8_t new_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_refs_write(scribe_ctx *ctx, const char *name, const uint8_t hash[SCRIBE_HASH_SIZE]);
+
+scribe_error_t scribe_durability_open(scribe_ctx *ctx);
+void scribe_durability_close(scribe_ctx *ctx);
+scribe_error_t scribe_durability_sync(scribe_ctx *ctx);
+int scribe_durability_deferred(const scribe_ctx *ctx);
+int scribe_durability_pending_ref(scribe_ctx *ctx, const char *name, uint8_t out[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_durability_defer_ref(scribe_ctx *ctx, const char *name, const uint8_t hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_publish_file(scribe_ctx *ctx, const char *path, const uint8_t *bytes, size_t len);
+void scribe_crash_point(const char *point);
 
 scribe_error_t scribe_object_write(scribe_ctx *ctx, uint8_t type, const uint8_t *payload, size_t payload_len,
                                    uint8_t out_hash[SCRIBE_HASH_SIZE]);
 scribe_error_t scribe_object_read(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_object *out);
 void scribe_object_free(scribe_object *obj);
 scribe_error_t scribe_object_has(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE]);
-char *scribe_object_path(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE]);
 scribe_error_t scribe_object_iter(scribe_ctx *ctx, scribe_object_visit_fn visit, void *user);
+scribe_error_t scribe_object_iter_concurrent(scribe_ctx *ctx, scribe_object_visit_fn visit, void *user);
 scribe_error_t scribe_object_compressed_size(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], size_t *out);
+scribe_error_t scribe_object_flush(scribe_ctx *ctx);
+void scribe_object_set_backend(scribe_ctx *ctx, scribe_object_backend *backend);
+scribe_error_t scribe_object_backend_loose_new(const char *repo_path, scribe_object_backend **out);
+scribe_error_t scribe_object_loose_discard_torn(scribe_ctx *ctx, time_t since, size_t *out_removed);
+scribe_error_t scribe_object_backend_mem_new(scribe_object_backend **out);
+void scribe_object_note_queue_depth(scribe_ctx *ctx, size_t depth, size_t capacity);
+void scribe_object_note_lag(scribe_ctx *ctx, uint64_t lag_ms);
+void scribe_object_fast_list_close(scribe_ctx *ctx);
+scribe_error_t scribe_object_repack(scribe_ctx *ctx, scribe_repack_stats *out);
+scribe_error_t scribe_archiver_new(scribe_ctx *ctx, scribe_archiver **out);
+void scribe_archiver_free(scribe_archiver *a);
+scribe_error_t scribe_archiver_store(scribe_archiver *a, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                     const uint8_t *base_hash, scribe_archive_stats *stats);
+size_t scribe_archiver_deltas(const scribe_archiver *a, const uint8_t **out_pairs);
+scribe_error_t scribe_archiver_detach(scribe_archiver *a, const uint8_t hash[SCRIBE_HASH_SIZE], int *out_rewritten);
+scribe_error_t scribe_archiver_prune(scribe_archiver *a, const scribe_hash_map *detached);
+scribe_error_t scribe_archive_deltas_load(scribe_ctx *ctx, uint8_t **out_pairs, size_t *out_count);
+scribe_error_t scribe_object_delta_base(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                        uint8_t out_base[SCRIBE_HASH_SIZE], int *out_is_delta);
+scribe_error_t scribe_archive_detach_unreachable(scribe_ctx *ctx, size_t *out_rewritten);
+scribe_error_t scribe_bitmap_write(scribe_ctx *ctx, int incremental, size_t *out_commits, size_t *out_objects);
+scribe_error_t scribe_reachable_compute(scribe_ctx *ctx, scribe_reachable **out);
+int scribe_reachable_has(const scribe_reachable *r, const uint8_t hash[SCRIBE_HASH_SIZE]);
+void scribe_reachable_free(scribe_reachable *r);
 
 scribe_error_t scribe_tree_serialize(const scribe_tree_entry *entries, size_t count, scribe_arena *arena, uint8_t **out,
                                      size_t *out_len);
 scribe_error_t scribe_tree_parse_arena_capacity(size_t payload_len, size_t *out);
 scribe_error_t scribe_tree_parse(const uint8_t *payload, size_t len, scribe_arena *arena,
                                  scribe_tree_entry **out_entries, size_t *out_count);
+int scribe_tree_entry_compare(const void *a, const void *b);
+
+bool scribe_tree_name_is_shard(const char *name, size_t name_len);
+bool scribe_tree_entries_sharded(const scribe_tree_entry *entries, size_t count);
+uint8_t scribe_tree_shard_bucket(const char *name, size_t name_len, size_t depth);
+void scribe_tree_shard_name(uint8_t bucket, char out[SCRIBE_SHARD_NAME_LEN + 1u]);
+scribe_error_t scribe_tree_write_flat(scribe_ctx *ctx, const scribe_tree_entry *entries, size_t count,
+                                      uint8_t out_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_tree_write_at_depth(scribe_ctx *ctx, const scribe_tree_entry *entries, size_t count,
+                                          size_t depth, uint8_t out_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_tree_write(scribe_ctx *ctx, const scribe_tree_entry *entries, size_t count,
+                                 uint8_t out_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_intern_table_new(scribe_intern_table **out);
+void scribe_intern_table_free(scribe_intern_table *t);
+scribe_error_t scribe_intern(scribe_ctx *ctx, const char *s, size_t len, const char **out, uint32_t *out_id);
+scribe_error_t scribe_leaf_cache_new(scribe_leaf_cache **out);
+void scribe_leaf_cache_free(scribe_leaf_cache *c);
+scribe_error_t scribe_tree_leaf_count(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], uint64_t *out);
+scribe_error_t scribe_tree_leaf_count_note(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                           const scribe_tree_entry *entries, size_t count);
+scribe_error_t scribe_snapshot_builder_new(scribe_ctx *ctx, size_t memory_bytes, scribe_snapshot_builder **out);
+scribe_error_t scribe_snapshot_builder_add(scribe_snapshot_builder *b, const char *const *path, size_t path_len,
+                                           const uint8_t hash[SCRIBE_HASH_SIZE], uint64_t seq);
+size_t scribe_snapshot_builder_count(const scribe_snapshot_builder *b);
+scribe_error_t scribe_snapshot_builder_finish(scribe_snapshot_builder *b, uint8_t out_root[SCRIBE_HASH_SIZE]);
+void scribe_snapshot_builder_free(scribe_snapshot_builder *b);
+scribe_error_t scribe_tree_read_logical(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_arena *arena,
+                                        scribe_tree_entry **entries, size_t *count);
+scribe_error_t scribe_tree_read_bucket(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], const char *name,
+                                       size_t name_len, scribe_arena *arena, scribe_tree_entry **entries,
+                                       size_t *count);
 
 scribe_error_t scribe_commit_serialize(const uint8_t root_tree[SCRIBE_HASH_SIZE], const uint8_t *parent,
                                        const scribe_change_batch *batch, scribe_arena *arena, uint8_t **out,
@@ -123,6 +468,9 @@ scribe_error_t scribe_commit_serialize(const uint8_t root_tree[SCRIBE_HASH_SIZE]
 scribe_error_t scribe_commit_serialize_allow_empty(const uint8_t root_tree[SCRIBE_HASH_SIZE], const uint8_t *parent,
                                                    const scribe_change_batch *batch, scribe_arena *arena, uint8_t **out,
                                                    size_t *out_len);
+scribe_error_t scribe_commit_validate_batch(const scribe_change_batch *batch);
+scribe_error_t scribe_commit_reparent(const uint8_t *payload, size_t len, const uint8_t *parent, scribe_arena *arena,
+                                      uint8_t **out, size_t *out_len);
 scribe_error_t scribe_commit_parse(const uint8_t *payload, size_t len, scribe_arena *arena, scribe_commit_view *out);
 
 scribe_error_t scribe_commit_batch_internal(scribe_ctx *ctx, const scribe_change_batch *batch,
@@ -130,19 +478,164 @@ scribe_error_t scribe_commit_batch_internal(scribe_ctx *ctx, const scribe_change
 scribe_error_t scribe_commit_root_internal(scribe_ctx *ctx, const uint8_t root_tree[SCRIBE_HASH_SIZE],
                                            const scribe_change_batch *metadata,
                                            uint8_t out_commit_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_commit_batch_ref(scribe_ctx *ctx, const char *ref, const uint8_t *base_root,
+                                       const scribe_change_batch *batch, uint8_t out_commit_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_commit_root_ref(scribe_ctx *ctx, const char *ref, const uint8_t root_tree[SCRIBE_HASH_SIZE],
+                                      const scribe_change_batch *metadata, uint8_t out_commit_hash[SCRIBE_HASH_SIZE]);
+scribe_error_t scribe_commit_root_chain(scribe_ctx *ctx, const char *ref, const uint8_t (*roots)[SCRIBE_HASH_SIZE],
+                                        const scribe_change_batch *const *metadata, size_t count,
+                                        uint8_t (*out_commit_hashes)[SCRIBE_HASH_SIZE]);
+/*
+ * Outcome of one batch of scribe_commit_group(): its commit, or its own error
+ * and detail.
+ */
+typedef struct {
+    scribe_error_t err;
+    uint8_t commit[SCRIBE_HASH_SIZE];
+    char detail[512];
+} scribe_group_result;
+
+scribe_error_t scribe_commit_group(scribe_ctx *ctx, const scribe_change_batch *const *batches, size_t count,
+                                   scribe_group_result *results);
+
+/*
+ * Partitioned pipe writer; see partition.c. The ack callback receives the
+ * batch_user given to submit and the batch's own commit on main, or NULL when
+ * the batch was dropped.
+ */
+typedef struct scribe_partition_writer scribe_partition_writer;
+typedef void (*scribe_partition_ack_fn)(void *user, void *batch_user, const uint8_t *commit_hash);
+
+scribe_error_t scribe_partition_writer_open(scribe_ctx *ctx, scribe_partition_ack_fn ack, void *ack_user,
+                                            scribe_partition_writer **out);
+scribe_error_t scribe_partition_submit(scribe_partition_writer *w, const scribe_change_batch *batch,
+                                       void *batch_user);
+scribe_error_t scribe_partition_writer_close(scribe_partition_writer *w);
+scribe_error_t scribe_partition_fold(scribe_ctx *ctx);
+scribe_error_t scribe_partition_merge_root(scribe_ctx *ctx, const uint8_t snapshot[SCRIBE_HASH_SIZE],
+                                           const char *scope, uint8_t out_root[SCRIBE_HASH_SIZE]);
 
-scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int show_paths, const char *path_filter);
-scribe_error_t scribe_cli_show(scribe_ctx *ctx, const char *rev);
-scribe_error_t scribe_cli_show_path(scribe_ctx *ctx, const char *spec);
+typedef scribe_error_t (*scribe_diff_visit_fn)(char status, const char *path, const uint8_t *old_blob,
+                                               const uint8_t *new_blob, void *user);
+
+scribe_error_t scribe_diff_count(scribe_ctx *ctx, const uint8_t *old_tree, const uint8_t *new_tree,
+                                 uint64_t out[3]);
+scribe_error_t scribe_diff_walk(scribe_ctx *ctx, const uint8_t *old_tree, const uint8_t *new_tree, const char *prefix,
+                                scribe_diff_visit_fn visit, void *user);
+scribe_error_t scribe_diff_walk_path(scribe_ctx *ctx, const scribe_path_resolution *old_res,
+                                     const scribe_path_resolution *new_res, const char *path,
+                                     scribe_diff_visit_fn visit, void *user);
+scribe_error_t scribe_commit_stats_compute(scribe_ctx *ctx, const uint8_t *old_root,
+                                           const uint8_t new_root[SCRIBE_HASH_SIZE], scribe_commit_stats *out);
+void scribe_commit_stats_free(scribe_commit_stats *stats);
+void scribe_commit_stats_record(scribe_ctx *ctx, const uint8_t commit[SCRIBE_HASH_SIZE], const uint8_t *parent_root,
+                                const uint8_t root[SCRIBE_HASH_SIZE]);
+void scribe_commit_stats_store(scribe_ctx *ctx, const uint8_t commit[SCRIBE_HASH_SIZE],
+                               const scribe_commit_stats *stats);
+scribe_error_t scribe_commit_stats_open(scribe_ctx *ctx, scribe_commit_stats_index **out);
+void scribe_commit_stats_index_free(scribe_commit_stats_index *idx);
+scribe_error_t scribe_commit_stats_get(scribe_ctx *ctx, scribe_commit_stats_index *idx,
+                                       const uint8_t commit[SCRIBE_HASH_SIZE], const uint8_t *parent_root,
+                                       const uint8_t root[SCRIBE_HASH_SIZE], scribe_commit_stats *out);
+
+/*
+ * Checksummed append-only record files under objects/info/, shared by commit
+ * summaries and field indexes. A record is a u32 body length, the body (which
+ * starts with a commit hash), and a trailer of the length again plus a
+ * truncated BLAKE3 check; see commitstat.c.
+ */
+#define SCRIBE_INFO_RECORD_OVERHEAD 16u
+
+size_t scribe_info_record_at(const uint8_t *file, size_t len, size_t off);
+void scribe_info_record_seal(uint8_t *record, size_t body_len);
+scribe_error_t scribe_info_open(scribe_ctx *ctx, const char *name, int *out_fd, uint8_t **last, size_t *last_len);
+
+void scribe_field_index_record(scribe_ctx *ctx, const uint8_t commit[SCRIBE_HASH_SIZE]);
+void scribe_field_index_flush(scribe_ctx *ctx);
+scribe_error_t scribe_json_get_field(const char *doc, size_t len, const char *field, const char **value,
+                                     size_t *value_len);
+
+/*
+ * One commit of main's chain as loaded by scribe_history_load(); see history.c.
+ */
+typedef struct {
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    uint8_t root[SCRIBE_HASH_SIZE];
+    int64_t time;
+} scribe_history_entry;
+
+scribe_error_t scribe_parse_duration(const char *s, const char *option, int64_t *out);
+scribe_error_t scribe_history_load(scribe_ctx *ctx, const uint8_t head[SCRIBE_HASH_SIZE],
+                                   scribe_history_entry **out, size_t *out_count);
+scribe_error_t scribe_history_load_range(scribe_ctx *ctx, const uint8_t head[SCRIBE_HASH_SIZE], const uint8_t *base,
+                                         size_t limit, scribe_history_entry **out, size_t *out_count);
+size_t scribe_history_cold_count(const scribe_history_entry *entries, size_t count, int64_t age);
+
+scribe_error_t scribe_cli_log(scribe_ctx *ctx, int oneline, size_t limit, int show_paths, int show_stat,
+                              int show_patch, const char *path_filter);
+scribe_error_t scribe_cli_show(scribe_ctx *ctx, const char *rev, int render_json);
+scribe_error_t scribe_cli_show_path(scribe_ctx *ctx, const char *spec, int render_json);
 scribe_error_t scribe_cli_cat_object(scribe_ctx *ctx, char mode, const char *hex);
-scribe_error_t scribe_cli_diff(scribe_ctx *ctx, const char *a, const char *b);
+scribe_error_t scribe_cli_diff(scribe_ctx *ctx, const char *a, const char *b, int content);
+scribe_error_t scribe_cli_export(scribe_ctx *ctx, const char *rev, const char *path_prefix, int bson);
+scribe_error_t scribe_cli_index_update(scribe_ctx *ctx);
+scribe_error_t scribe_cli_index_query(scribe_ctx *ctx, const char *name, const char *value, const char *rev);
+scribe_error_t scribe_cli_grep(scribe_ctx *ctx, const char *pattern, int extended, const char *rev,
+                               const char *path_prefix);
 scribe_error_t scribe_cli_fsck(scribe_ctx *ctx);
+scribe_error_t scribe_cli_repack(scribe_ctx *ctx, int write_bitmap, int incremental);
+scribe_error_t scribe_cli_compact_history(scribe_ctx *ctx, const char *older_than, const char *granularity);
+scribe_error_t scribe_cli_archive(scribe_ctx *ctx, const char *older_than);
 scribe_error_t scribe_cli_list_objects(scribe_ctx *ctx, int type_mask, int reachable, const char *format);
 scribe_error_t scribe_cli_ls_tree(scribe_ctx *ctx, const char *hex);
 scribe_error_t scribe_resolve_commit(scribe_ctx *ctx, const char *rev, uint8_t out[SCRIBE_HASH_SIZE]);
 scribe_error_t scribe_tree_resolve_path(scribe_ctx *ctx, const uint8_t root_tree[SCRIBE_HASH_SIZE], const char *path,
                                         scribe_path_resolution *out);
 
+bool scribe_bson_is_document(const uint8_t *bytes, size_t len);
+scribe_error_t scribe_bson_to_json(const uint8_t *bytes, size_t len, char **out, size_t *out_len);
+
 scribe_error_t scribe_pipe_commit_batch(scribe_ctx *ctx, FILE *in, FILE *out);
+scribe_error_t scribe_pipe_next_batch(scribe_ctx *ctx, FILE *in, char **line, size_t *cap,
+                                      scribe_change_batch *batch);
+void scribe_pipe_free_batch(scribe_change_batch *batch);
+size_t scribe_pipe_batch_bytes(const scribe_change_batch *batch);
+void scribe_pipe_write_error(FILE *out, scribe_error_t err);
+
+/*
+ * Where an adapter session sends its commits. A standalone watcher commits
+ * straight to main; a session hosted by `scribe daemon` hands each commit to
+ * the daemon's scheduler. `key` names the session's adapter-state file, or is
+ * NULL for a store's only watcher. `stopping` reports a shutdown request, after
+ * which the session drains its open batch and returns. `commit_root` publishes
+ * a bootstrap snapshot; a hosted session's snapshot replaces only the
+ * top-level entries it holds, plus `scope` when that is set.
+ */
+typedef struct scribe_session_sink scribe_session_sink;
+struct scribe_session_sink {
+    const char *key;
+    int (*stopping)(const scribe_session_sink *sink);
+    scribe_error_t (*commit)(scribe_session_sink *sink, const scribe_change_batch *batch,
+                             uint8_t out_commit[SCRIBE_HASH_SIZE]);
+    scribe_error_t (*commit_root)(scribe_session_sink *sink, const uint8_t root[SCRIBE_HASH_SIZE], const char *scope,
+                                  const scribe_change_batch *metadata, uint8_t out_commit[SCRIBE_HASH_SIZE]);
+    void *user;
+};
+
+/*
+ * An adapter session hosted by the daemon: `run` watches `uri` on its own
+ * thread and commits through `sink` until the sink reports stopping. `name`
+ * keys the session's resume state.
+ */
+typedef scribe_error_t (*scribe_daemon_source_fn)(scribe_ctx *ctx, const char *uri, scribe_session_sink *sink);
+typedef struct {
+    const char *name;
+    const char *uri;
+    scribe_daemon_source_fn run;
+} scribe_daemon_source;
+
+scribe_error_t scribe_daemon_run(scribe_ctx *ctx, const char *socket_path, const scribe_daemon_source *sources,
+                                 size_t source_count);
+scribe_error_t scribe_daemon_client(const char *socket_path, FILE *in, FILE *out);
 
 #endif
@@ -0,0 +1,553 @@
+/*
+ * Structural diff of canonical JSON documents.
+ *
+ * Document blobs are canonical JSON whose object keys are sorted, so two
+ * versions of a document can be compared in one streaming pass without
+ * building a DOM. Objects are merge-walked by key and arrays by index; a
+ * member whose value bytes are identical on both sides is skipped with one
+ * memcmp, so unchanged runs cost a scan for their extent and nothing more.
+ * Changes are reported as RFC 6902 JSON Patch operations whose values are
+ * slices of the new document. The tokenizer validates structure but is
+ * lenient about number syntax, because pipe producers may store any bytes.
+ * The same tokenizer extracts single field values for the field indexes.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JSON_DIFF_MAX_DEPTH 128
+
+typedef struct {
+    scribe_json_patch_fn emit;
+    void *user;
+    char *path;
+    size_t path_len;
+    size_t path_cap;
+} json_diff;
+
+/*
+ * Skips JSON whitespace.
+ */
+static const char *skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+/*
+ * Returns the end of [p, end) without trailing JSON whitespace.
+ */
+static const char *trim_ws(const char *p, const char *end) {
+    while (end > p && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) {
+        end--;
+    }
+    return end;
+}
+
+/*
+ * Returns the end of the string literal starting at `p`, or NULL.
+ */
+static const char *scan_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+        if (*p == '"') {
+            return p + 1;
+        }
+        if (*p == '\\') {
+            p++;
+        } else if ((unsigned char)*p < 0x20u) {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Skips an object key and its colon, returning the start of the member value,
+ * or NULL.
+ */
+static const char *scan_key(const char *p, const char *end) {
+    p = skip_ws(p, end);
+    if (p >= end || *p != '"' || (p = scan_string(p, end)) == NULL) {
+        return NULL;
+    }
+    p = skip_ws(p, end);
+    return p < end && *p == ':' ? p + 1 : NULL;
+}
+
+/*
+ * Returns the end of the JSON value starting at `p`, or NULL when it is not
+ * one. Nesting is tracked with an explicit stack of open brackets, so deep
+ * documents cannot exhaust the C stack.
+ */
+static const char *scan_value(const char *p, const char *end) {
+    char stack[JSON_DIFF_MAX_DEPTH];
+    size_t depth = 0;
+
+    for (;;) {
+        p = skip_ws(p, end);
+        if (p >= end) {
+            return NULL;
+        }
+        if (*p == '{' || *p == '[') {
+            if (depth == JSON_DIFF_MAX_DEPTH) {
+                return NULL;
+            }
+            stack[depth++] = *p == '{' ? '}' : ']';
+            p = skip_ws(p + 1, end);
+            if (p < end && *p == stack[depth - 1u]) {
+                depth--;
+                p++;
+            } else {
+                if (stack[depth - 1u] == '}' && (p = scan_key(p, end)) == NULL) {
+                    return NULL;
+                }
+                continue;
+            }
+        } else if (*p == '"') {
+            if ((p = scan_string(p, end)) == NULL) {
+                return NULL;
+            }
+        } else if (*p == '-' || (*p >= '0' && *p <= '9')) {
+            while (p < end && (*p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E' ||
+                               (*p >= '0' && *p <= '9'))) {
+                p++;
+            }
+        } else if (end - p >= 4 && (memcmp(p, "true", 4) == 0 || memcmp(p, "null", 4) == 0)) {
+            p += 4;
+        } else if (end - p >= 5 && memcmp(p, "false", 5) == 0) {
+            p += 5;
+        } else {
+            return NULL;
+        }
+        /*
+         * A value is complete: close finished containers, then step over the
+         * comma (and, in an object, the next key) to the next value.
+         */
+        for (;;) {
+            if (depth == 0) {
+                return p;
+            }
+            p = skip_ws(p, end);
+            if (p >= end) {
+                return NULL;
+            }
+            if (*p == stack[depth - 1u]) {
+                depth--;
+                p++;
+                continue;
+            }
+            if (*p != ',') {
+                return NULL;
+            }
+            p++;
+            if (stack[depth - 1u] == '}' && (p = scan_key(p, end)) == NULL) {
+                return NULL;
+            }
+            break;
+        }
+    }
+}
+
+/*
+ * One parsed object member or array element: raw key text (without quotes,
+ * still escaped) and the value's byte range.
+ */
+typedef struct {
+    const char *key;
+    size_t key_len;
+    const char *value;
+    const char *value_end;
+} json_item;
+
+/*
+ * Reads the next member of an object (`object` true) or element of an array
+ * at *p. Returns 0 at the closing bracket, 1 for an item, and -1 for
+ * malformed input.
+ */
+static int next_item(const char **p, const char *end, int object, int first, json_item *out) {
+    const char *q = skip_ws(*p, end);
+
+    if (q < end && *q == (object ? '}' : ']')) {
+        *p = q + 1;
+        return 0;
+    }
+    if (!first) {
+        if (q >= end || *q != ',') {
+            return -1;
+        }
+        q = skip_ws(q + 1, end);
+    }
+    out->key = NULL;
+    out->key_len = 0;
+    if (object) {
+        const char *key_end;
+
+        if (q >= end || *q != '"' || (key_end = scan_string(q, end)) == NULL) {
+            return -1;
+        }
+        out->key = q + 1;
+        out->key_len = (size_t)(key_end - q - 2);
+        q = skip_ws(key_end, end);
+        if (q >= end || *q != ':') {
+            return -1;
+        }
+        q++;
+    }
+    out->value = skip_ws(q, end);
+    out->value_end = scan_value(out->value, end);
+    if (out->value_end == NULL) {
+        return -1;
+    }
+    *p = out->value_end;
+    return 1;
+}
+
+/*
+ * Orders raw key texts bytewise, the order canonical documents are stored in.
+ */
+static int key_compare(const json_item *a, const json_item *b) {
+    size_t n = a->key_len < b->key_len ? a->key_len : b->key_len;
+    int cmp = memcmp(a->key, b->key, n);
+
+    if (cmp != 0) {
+        return cmp;
+    }
+    return a->key_len < b->key_len ? -1 : a->key_len > b->key_len;
+}
+
+/*
+ * Reads the member after `item` of an object into `item`, setting *unsorted
+ * when its key does not sort strictly after the one before it.
+ */
+static int next_member(const char **p, const char *end, json_item *item, int *unsorted) {
+    json_item prev = *item;
+    int rc = next_item(p, end, 1, 0, item);
+
+    if (rc == 1 && key_compare(&prev, item) >= 0) {
+        *unsorted = 1;
+    }
+    return rc;
+}
+
+/*
+ * Appends bytes to the current JSON Pointer.
+ */
+static scribe_error_t path_append(json_diff *d, const char *bytes, size_t len) {
+    if (d->path_len + len + 1u > d->path_cap) {
+        size_t cap = d->path_cap == 0 ? 256u : d->path_cap;
+        char *grown;
+
+        while (cap < d->path_len + len + 1u) {
+            cap *= 2u;
+        }
+        grown = (char *)realloc(d->path, cap);
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow JSON pointer");
+        }
+        d->path = grown;
+        d->path_cap = cap;
+    }
+    memcpy(d->path + d->path_len, bytes, len);
+    d->path_len += len;
+    d->path[d->path_len] = '\0';
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends one reference token for an object key. The key stays in its JSON
+ * string escaping, so the pointer can be embedded in JSON output as is; `~`
+ * and `/`, including their escaped spellings, become `~0` and `~1`.
+ */
+static scribe_error_t path_push_key(json_diff *d, const char *key, size_t len) {
+    scribe_error_t err = path_append(d, "/", 1);
+    size_t i = 0;
+
+    while (err == SCRIBE_OK && i < len) {
+        if (key[i] == '~' || (len - i >= 6 && (strncmp(key + i, "\\u007e", 6) == 0 ||
+                                               strncmp(key + i, "\\u007E", 6) == 0))) {
+            err = path_append(d, "~0", 2);
+            i += key[i] == '~' ? 1u : 6u;
+        } else if (key[i] == '/' || (len - i >= 6 && (strncmp(key + i, "\\u002f", 6) == 0 ||
+                                                      strncmp(key + i, "\\u002F", 6) == 0))) {
+            err = path_append(d, "~1", 2);
+            i += key[i] == '/' ? 1u : 6u;
+        } else if (len - i >= 2 && key[i] == '\\' && key[i + 1u] == '/') {
+            err = path_append(d, "~1", 2);
+            i += 2u;
+        } else if (key[i] == '\\' && len - i >= 2) {
+            err = path_append(d, key + i, 2);
+            i += 2u;
+        } else {
+            err = path_append(d, key + i, 1);
+            i++;
+        }
+    }
+    return err;
+}
+
+/*
+ * Appends one reference token for an array index.
+ */
+static scribe_error_t path_push_index(json_diff *d, size_t index) {
+    char token[32];
+    int n = snprintf(token, sizeof(token), "/%zu", index);
+
+    return path_append(d, token, (size_t)n);
+}
+
+/*
+ * Emits one operation at the current pointer.
+ */
+static scribe_error_t emit_op(json_diff *d, const char *op, const char *value, const char *value_end) {
+    scribe_json_patch_op patch;
+
+    patch.op = op;
+    patch.path = d->path == NULL ? "" : d->path;
+    patch.path_len = d->path_len;
+    patch.value = value;
+    patch.value_len = value == NULL ? 0 : (size_t)(value_end - value);
+    return d->emit(&patch, d->user);
+}
+
+static scribe_error_t diff_value(json_diff *d, const char *a, const char *a_end, const char *b, const char *b_end,
+                                 size_t depth);
+
+/*
+ * Merge-walks two objects with sorted keys. Members only in `a` are removed,
+ * members only in `b` are added, and shared keys recurse. Key order is checked
+ * as the walk goes: at the first key on either side that does not sort after
+ * the one before it, the rest of both objects is only validated and the whole
+ * object is replaced. The operations already emitted stay valid, so the patch
+ * still applies in order. Each object must end exactly at its `_end`.
+ */
+static scribe_error_t diff_object(json_diff *d, const char *a, const char *a_end, const char *b, const char *b_end,
+                                  size_t depth) {
+    const char *b_value = b;
+    json_item ai;
+    json_item bi;
+    size_t base = d->path_len;
+    int unsorted = 0;
+    int ra;
+    int rb;
+    scribe_error_t err = SCRIBE_OK;
+
+    a++;
+    b++;
+    ra = next_item(&a, a_end, 1, 1, &ai);
+    rb = next_item(&b, b_end, 1, 1, &bi);
+    while (err == SCRIBE_OK && !unsorted && ra == 1 && rb == 1) {
+        int cmp = key_compare(&ai, &bi);
+
+        err = path_push_key(d, cmp <= 0 ? ai.key : bi.key, cmp <= 0 ? ai.key_len : bi.key_len);
+        if (err == SCRIBE_OK) {
+            if (cmp < 0) {
+                err = emit_op(d, "remove", NULL, NULL);
+            } else if (cmp > 0) {
+                err = emit_op(d, "add", bi.value, bi.value_end);
+            } else {
+                err = diff_value(d, ai.value, ai.value_end, bi.value, bi.value_end, depth + 1u);
+            }
+        }
+        d->path_len = base;
+        if (cmp <= 0) {
+            ra = next_member(&a, a_end, &ai, &unsorted);
+        }
+        if (cmp >= 0) {
+            rb = next_member(&b, b_end, &bi, &unsorted);
+        }
+    }
+    while (err == SCRIBE_OK && !unsorted && ra == 1 && rb >= 0) {
+        err = path_push_key(d, ai.key, ai.key_len);
+        if (err == SCRIBE_OK) {
+            err = emit_op(d, "remove", NULL, NULL);
+        }
+        d->path_len = base;
+        ra = next_member(&a, a_end, &ai, &unsorted);
+    }
+    while (err == SCRIBE_OK && !unsorted && rb == 1 && ra >= 0) {
+        err = path_push_key(d, bi.key, bi.key_len);
+        if (err == SCRIBE_OK) {
+            err = emit_op(d, "add", bi.value, bi.value_end);
+        }
+        d->path_len = base;
+        rb = next_member(&b, b_end, &bi, &unsorted);
+    }
+    while (err == SCRIBE_OK && unsorted && ra == 1) {
+        ra = next_item(&a, a_end, 1, 0, &ai);
+    }
+    while (err == SCRIBE_OK && unsorted && rb == 1) {
+        rb = next_item(&b, b_end, 1, 0, &bi);
+    }
+    if (err == SCRIBE_OK && (ra != 0 || rb != 0 || a != a_end || b != b_end)) {
+        err = scribe_set_error(SCRIBE_EMALFORMED, "malformed JSON object");
+    }
+    if (err == SCRIBE_OK && unsorted) {
+        err = emit_op(d, "replace", b_value, b_end);
+    }
+    return err;
+}
+
+/*
+ * Walks two arrays by index. Trailing elements only in `b` are appended;
+ * trailing elements only in `a` are removed one at a time at the first
+ * surplus index, which keeps every operation valid when applied in order.
+ * Each array must end exactly at its `_end`.
+ */
+static scribe_error_t diff_array(json_diff *d, const char *a, const char *a_end, const char *b, const char *b_end,
+                                 size_t depth) {
+    json_item ai;
+    json_item bi;
+    size_t base = d->path_len;
+    size_t index = 0;
+    int ra;
+    int rb;
+    scribe_error_t err = SCRIBE_OK;
+
+    a++;
+    b++;
+    ra = next_item(&a, a_end, 0, 1, &ai);
+    rb = next_item(&b, b_end, 0, 1, &bi);
+    while (err == SCRIBE_OK && (ra == 1 || rb == 1)) {
+        err = path_push_index(d, index);
+        if (err == SCRIBE_OK) {
+            if (ra == 1 && rb == 1) {
+                err = diff_value(d, ai.value, ai.value_end, bi.value, bi.value_end, depth + 1u);
+            } else if (rb == 1) {
+                err = emit_op(d, "add", bi.value, bi.value_end);
+            } else {
+                err = emit_op(d, "remove", NULL, NULL);
+            }
+        }
+        d->path_len = base;
+        if (ra == 1) {
+            ra = next_item(&a, a_end, 0, 0, &ai);
+        }
+        if (rb == 1) {
+            rb = next_item(&b, b_end, 0, 0, &bi);
+            index++;
+        }
+        if (ra < 0 || rb < 0) {
+            break;
+        }
+    }
+    if (err == SCRIBE_OK && (ra < 0 || rb < 0 || a != a_end || b != b_end)) {
+        err = scribe_set_error(SCRIBE_EMALFORMED, "malformed JSON array");
+    }
+    return err;
+}
+
+/*
+ * Diffs two values at the current pointer. Identical bytes end the walk for
+ * this subtree; matching containers recurse; anything else is replaced.
+ */
+static scribe_error_t diff_value(json_diff *d, const char *a, const char *a_end, const char *b, const char *b_end,
+                                 size_t depth) {
+    if (a_end - a == b_end - b && memcmp(a, b, (size_t)(a_end - a)) == 0) {
+        return SCRIBE_OK;
+    }
+    if (depth > JSON_DIFF_MAX_DEPTH) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "JSON document nests too deeply");
+    }
+    if (*a == '{' && *b == '{') {
+        return diff_object(d, a, a_end, b, b_end, depth);
+    }
+    if (*a == '[' && *b == '[') {
+        return diff_array(d, a, a_end, b, b_end, depth);
+    }
+    return emit_op(d, "replace", b, b_end);
+}
+
+/*
+ * Computes an RFC 6902 JSON Patch that turns document `a` into document `b`
+ * and passes each operation to `emit` in application order. Both inputs must
+ * be single JSON values; objects whose keys are not sorted are replaced
+ * whole rather than merged. Returns SCRIBE_EMALFORMED for input that is not
+ * JSON. Two documents of the same container type are validated by the walk
+ * itself rather than by a separate pass, so operations emitted before
+ * malformed input is reached are not retracted.
+ */
+scribe_error_t scribe_json_diff(const char *a, size_t a_len, const char *b, size_t b_len, scribe_json_patch_fn emit,
+                                void *user) {
+    const char *a_end = a + a_len;
+    const char *b_end = b + b_len;
+    const char *a_value;
+    const char *b_value;
+    const char *a_stop;
+    const char *b_stop;
+    json_diff d;
+    scribe_error_t err;
+
+    if ((a == NULL && a_len != 0) || (b == NULL && b_len != 0) || emit == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid JSON diff arguments");
+    }
+    a_value = skip_ws(a, a_end);
+    b_value = skip_ws(b, b_end);
+    a_stop = trim_ws(a_value, a_end);
+    b_stop = trim_ws(b_value, b_end);
+    memset(&d, 0, sizeof(d));
+    d.emit = emit;
+    d.user = user;
+    if (a_value < a_stop && b_value < b_stop && *a_value == '{' && *b_value == '{') {
+        err = diff_object(&d, a_value, a_stop, b_value, b_stop, 0);
+    } else if (a_value < a_stop && b_value < b_stop && *a_value == '[' && *b_value == '[') {
+        err = diff_array(&d, a_value, a_stop, b_value, b_stop, 0);
+    } else if (a_value == a_stop || b_value == b_stop || scan_value(a_value, a_end) != a_stop ||
+               scan_value(b_value, b_end) != b_stop) {
+        err = scribe_set_error(SCRIBE_EMALFORMED, "document is not a single JSON value");
+    } else {
+        err = diff_value(&d, a_value, a_stop, b_value, b_stop, 0);
+    }
+    free(d.path);
+    return err;
+}
+
+/*
+ * Finds the value of a field in a JSON document without parsing the rest of
+ * it. `field` is a dot-separated path of object keys, compared with the raw
+ * key text. *value is NULL when the field is absent or a step of the path is
+ * not an object. Returns SCRIBE_EMALFORMED when the members scanned on the
+ * way are not JSON.
+ */
+scribe_error_t scribe_json_get_field(const char *doc, size_t len, const char *field, const char **value,
+                                     size_t *value_len) {
+    const char *end = doc + len;
+    const char *p = skip_ws(doc, end);
+
+    *value = NULL;
+    *value_len = 0;
+    while (*field != '\0') {
+        const char *dot = strchr(field, '.');
+        size_t step = dot == NULL ? strlen(field) : (size_t)(dot - field);
+        json_item item;
+        int first = 1;
+        int rc;
+
+        if (p >= end || *p != '{') {
+            return SCRIBE_OK;
+        }
+        p++;
+        while ((rc = next_item(&p, end, 1, first, &item)) == 1) {
+            if (item.key_len == step && memcmp(item.key, field, step) == 0) {
+                break;
+            }
+            first = 0;
+        }
+        if (rc < 0) {
+            return scribe_set_error(SCRIBE_EMALFORMED, "document is not JSON");
+        }
+        if (rc == 0) {
+            return SCRIBE_OK;
+        }
+        p = item.value;
+        end = item.value_end;
+        field += step + (dot == NULL ? 0u : 1u);
+    }
+    *value = p;
+    *value_len = (size_t)(end - p);
+    return SCRIBE_OK;
+}
@@ -0,0 +1,246 @@
+/*
+ * Tree leaf-count cache.
+ *
+ * Maps a tree hash to the number of blob leaves beneath it, shard levels
+ * included. Counting diffs (`log --oneline --paths`) use it to count an added or
+ * deleted subtree in O(1) instead of walking every descendant tree. Counts are
+ * recorded as tree objects are written and computed lazily for older trees.
+ *
+ * Writable contexts persist the cache append-only at
+ * `objects/info/leaf-counts` as fixed 40-byte records: the tree hash followed
+ * by the count as a little-endian u64. Tree hashes are immutable, so a record
+ * never goes stale; the file is a pure cache and may be deleted at any time.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define LEAF_RECORD_SIZE (SCRIBE_HASH_SIZE + 8u)
+
+struct scribe_leaf_cache {
+    pthread_mutex_t mu;
+    int loaded;
+    int fd;
+    scribe_hash_map counts;
+};
+
+/*
+ * Loads the persisted records on first use. The caller holds the mutex. A
+ * torn last record (crash mid-append) is ignored; a writable context also cuts
+ * it off so later appends stay aligned. Load failures leave an empty cache,
+ * which only costs recomputation.
+ */
+static void cache_load(scribe_ctx *ctx, scribe_leaf_cache *c) {
+    char *path = scribe_path_join(ctx->repo_path, "objects/info/leaf-counts");
+    uint8_t *bytes = NULL;
+    size_t len = 0;
+    size_t off;
+    uint64_t *at;
+
+    c->loaded = 1;
+    if (path == NULL || scribe_read_file(path, &bytes, &len) != SCRIBE_OK) {
+        free(path);
+        return;
+    }
+    (void)scribe_hash_map_reserve(&c->counts, len / LEAF_RECORD_SIZE);
+    for (off = 0; off + LEAF_RECORD_SIZE <= len; off += LEAF_RECORD_SIZE) {
+        uint64_t leaves = 0;
+        size_t i;
+
+        for (i = 0; i < 8u; i++) {
+            leaves |= (uint64_t)bytes[off + SCRIBE_HASH_SIZE + i] << (8u * i);
+        }
+        if (scribe_hash_map_add(&c->counts, bytes + off, leaves, NULL, &at) != SCRIBE_OK) {
+            break;
+        }
+        *at = leaves;
+    }
+    if (ctx->writable && len % LEAF_RECORD_SIZE != 0 && truncate(path, (off_t)(len - len % LEAF_RECORD_SIZE)) != 0) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "objects", "failed to trim torn leaf-count record");
+    }
+    free(bytes);
+    free(path);
+}
+
+/*
+ * Looks up a cached count, loading the persisted records on first use.
+ * Returns 1 when the tree is cached.
+ */
+static int cache_lookup(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], uint64_t *out) {
+    scribe_leaf_cache *c = ctx->leaf_counts;
+    const uint64_t *leaves;
+    int found;
+
+    pthread_mutex_lock(&c->mu);
+    if (!c->loaded) {
+        cache_load(ctx, c);
+    }
+    leaves = scribe_hash_map_get(&c->counts, hash);
+    found = leaves != NULL;
+    if (found) {
+        *out = *leaves;
+    }
+    pthread_mutex_unlock(&c->mu);
+    return found;
+}
+
+/*
+ * Records one count in memory and, for writable contexts, appends it to the
+ * persisted cache. Trees already cached are skipped, so rewriting an existing
+ * tree adds no record. Append failures are logged, not returned: the count is
+ * only an accelerator.
+ */
+static scribe_error_t cache_record(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], uint64_t leaves) {
+    scribe_leaf_cache *c = ctx->leaf_counts;
+    uint8_t record[LEAF_RECORD_SIZE];
+    scribe_error_t err;
+    size_t i;
+    int already = 0;
+
+    memcpy(record, hash, SCRIBE_HASH_SIZE);
+    for (i = 0; i < 8u; i++) {
+        record[SCRIBE_HASH_SIZE + i] = (uint8_t)(leaves >> (8u * i));
+    }
+    pthread_mutex_lock(&c->mu);
+    if (!c->loaded) {
+        cache_load(ctx, c);
+    }
+    err = scribe_hash_map_add(&c->counts, hash, leaves, &already, NULL);
+    if (err == SCRIBE_OK && !already && ctx->writable) {
+        if (c->fd < 0) {
+            char *info = scribe_path_join(ctx->repo_path, "objects/info");
+            char *path = info == NULL ? NULL : scribe_path_join(info, "leaf-counts");
+
+            if (path != NULL) {
+                c->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+                if (c->fd < 0 && errno == ENOENT && scribe_mkdir_p(info) == SCRIBE_OK) {
+                    c->fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+                }
+            }
+            free(path);
+            free(info);
+        }
+        if (c->fd < 0 || write(c->fd, record, sizeof(record)) != (ssize_t)sizeof(record)) {
+            scribe_log_msg(ctx, SCRIBE_LOG_WARN, "objects", "failed to record tree leaf count");
+        }
+    }
+    pthread_mutex_unlock(&c->mu);
+    return err;
+}
+
+/*
+ * Allocates an empty, not-yet-loaded cache. scribe_open() creates one per
+ * context.
+ */
+scribe_error_t scribe_leaf_cache_new(scribe_leaf_cache **out) {
+    scribe_leaf_cache *c = (scribe_leaf_cache *)calloc(1, sizeof(*c));
+
+    if (c == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate leaf-count cache");
+    }
+    if (pthread_mutex_init(&c->mu, NULL) != 0) {
+        free(c);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize leaf-count cache");
+    }
+    c->fd = -1;
+    *out = c;
+    return SCRIBE_OK;
+}
+
+/*
+ * Closes the append descriptor and frees the cache. Accepts NULL.
+ */
+void scribe_leaf_cache_free(scribe_leaf_cache *c) {
+    if (c == NULL) {
+        return;
+    }
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    pthread_mutex_destroy(&c->mu);
+    scribe_hash_map_destroy(&c->counts);
+    free(c);
+}
+
+/*
+ * Returns the number of blob leaves under a tree. A cache miss parses the tree
+ * and recurses into child trees, recording every count it computes, so each
+ * tree is walked at most once per cache lifetime.
+ */
+scribe_error_t scribe_tree_leaf_count(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], uint64_t *out) {
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_tree_entry *entries = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    size_t i;
+    uint64_t leaves = 0;
+    scribe_error_t err;
+
+    if (cache_lookup(ctx, hash, out)) {
+        return SCRIBE_OK;
+    }
+    err = scribe_object_read(ctx, hash, &obj);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_TREE) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "expected tree while counting leaves");
+    }
+    err = scribe_tree_parse_arena_capacity(obj.payload_len, &capacity);
+    if (err == SCRIBE_OK) {
+        err = scribe_arena_init(&arena, capacity);
+    }
+    if (err != SCRIBE_OK) {
+        scribe_object_free(&obj);
+        return err;
+    }
+    err = scribe_tree_parse(obj.payload, obj.payload_len, &arena, &entries, &count);
+    scribe_object_free(&obj);
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        uint64_t child = 1;
+
+        if (entries[i].type == SCRIBE_OBJECT_TREE) {
+            err = scribe_tree_leaf_count(ctx, entries[i].hash, &child);
+        }
+        leaves += child;
+    }
+    scribe_arena_destroy(&arena);
+    if (err == SCRIBE_OK) {
+        err = cache_record(ctx, hash, leaves);
+    }
+    if (err == SCRIBE_OK) {
+        *out = leaves;
+    }
+    return err;
+}
+
+/*
+ * Records the leaf count of a tree that was just written from `entries`. Child
+ * trees are looked up but never computed here, so writing stays O(entries);
+ * if any child is uncached the tree is left for lazy computation.
+ */
+scribe_error_t scribe_tree_leaf_count_note(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                           const scribe_tree_entry *entries, size_t count) {
+    uint64_t leaves = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        uint64_t child = 1;
+
+        if (entries[i].type == SCRIBE_OBJECT_TREE && !cache_lookup(ctx, entries[i].hash, &child)) {
+            return SCRIBE_OK;
+        }
+        leaves += child;
+    }
+    return cache_record(ctx, hash, leaves);
+}
@@ -1,26 +1,34 @@
 /*
  * Content-addressed object storage.
  *
- * Scribe stores blobs, trees, and commits as zstd-compressed loose objects under
- * `.scribe/objects`. The object hash is BLAKE3 over the uncompressed typed
- * envelope, so reads can verify both identity and payload framing before higher
- * layers parse object contents.
+ * Scribe stores blobs, trees, and commits as zstd-compressed typed envelopes.
+ * The object hash is BLAKE3 over the uncompressed envelope, so reads can verify
+ * both identity and payload framing before higher layers parse object contents.
+ * Where the compressed bytes live is up to the context's object engine
+ * (`ctx->objects`): loose files under `.scribe/objects` by default
+ * (object_loose.c), or an in-memory table (object_mem.c).
+ *
+ * Because the hash ignores compression, the level is a per-write choice. While
+ * producers report a backlog, writes use `adaptive_compression_level` and are
+ * listed in `objects/info/fast-objects`; `scribe repack` later recompresses
+ * them in place at `repack_compression_level`. `scribe archive` goes further
+ * for cold history and stores objects as zstd deltas against an older
+ * version of the same path.
  */
 #include "core/internal.h"
 
 #include "util/error.h"
 #include "util/hex.h"
 #include "util/leb128.h"
+#include "util/log.h"
 
 #include "blake3.h"
 #include "zstd.h"
 
 #include <errno.h>
 #include <fcntl.h>
-#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 /*
@@ -73,58 +81,132 @@ static scribe_error_t build_envelope(uint8_t type, const uint8_t *payload, size_
 }
 
 /*
- * Computes the loose-object path for a hash using the v1 two-character fanout
- * directory layout. The returned string is heap-owned by the caller.
+ * Checks whether the object engine holds a hash without reading or verifying
+ * the object. Writers use this to make content-addressed writes idempotent.
  */
-char *scribe_object_path(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE]) {
-    char hex[SCRIBE_HEX_HASH_SIZE + 1];
-    char dirpart[16];
-    char *objects;
-    char *dir;
-    char *path;
+scribe_error_t scribe_object_has(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    return ctx->objects->ops->has(ctx->objects, hash);
+}
 
-    /*
-     * Loose objects are sharded by the first two hex characters:
-     * objects/ab/cdef... instead of objects/abcdef... This keeps directory
-     * sizes reasonable for large v1 stores and matches the
-     * iterator layout used by list-objects and fsck.
-     */
-    scribe_hash_to_hex(hash, hex);
-    objects = scribe_path_join(ctx->repo_path, "objects");
-    if (objects == NULL) {
-        return NULL;
+#define PRESSURE_QUEUE 1u
+#define PRESSURE_LAG 2u
+
+/*
+ * Sets or clears one backlog source and logs when the combined state flips
+ * between the configured and the fast compression level.
+ */
+static void set_pressure(scribe_ctx *ctx, unsigned bit, int on) {
+    unsigned old;
+    unsigned now;
+
+    if (ctx->config.adaptive_compression_level == 0) {
+        return;
+    }
+    if (on) {
+        old = atomic_fetch_or(&ctx->compression_pressure, bit);
+        now = old | bit;
+    } else {
+        old = atomic_fetch_and(&ctx->compression_pressure, ~bit);
+        now = old & ~bit;
     }
-    snprintf(dirpart, sizeof(dirpart), "%.2s", hex);
-    dir = scribe_path_join(objects, dirpart);
-    free(objects);
-    if (dir == NULL) {
-        return NULL;
+    if ((old == 0) != (now == 0)) {
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "objects", "compression level %d (%s)",
+                       now != 0 ? ctx->config.adaptive_compression_level : ctx->config.compression_level,
+                       now != 0 ? "backlog" : "backlog cleared");
     }
-    path = scribe_path_join(dir, hex + 2);
-    free(dir);
-    return path;
 }
 
 /*
- * Checks whether an object file currently exists without reading or verifying
- * it. Writers use this to make content-addressed writes idempotent.
+ * Reports the depth of a bounded work queue feeding object writes. Writes turn
+ * fast once the queue is three-quarters full and return to the configured
+ * level when it drains below one quarter.
  */
-scribe_error_t scribe_object_has(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE]) {
-    char *path = scribe_object_path(ctx, hash);
-    int exists;
+void scribe_object_note_queue_depth(scribe_ctx *ctx, size_t depth, size_t capacity) {
+    if (depth >= capacity - capacity / 4u) {
+        set_pressure(ctx, PRESSURE_QUEUE, 1);
+    } else if (depth <= capacity / 4u) {
+        set_pressure(ctx, PRESSURE_QUEUE, 0);
+    }
+}
 
-    if (path == NULL) {
-        return SCRIBE_ENOMEM;
+/*
+ * Reports how far committed history trails the source, in milliseconds. Writes
+ * turn fast above SCRIBE_COMPRESSION_LAG_MS and return to the configured level
+ * below half of it.
+ */
+void scribe_object_note_lag(scribe_ctx *ctx, uint64_t lag_ms) {
+    if (lag_ms > SCRIBE_COMPRESSION_LAG_MS) {
+        set_pressure(ctx, PRESSURE_LAG, 1);
+    } else if (lag_ms < SCRIBE_COMPRESSION_LAG_MS / 2u) {
+        set_pressure(ctx, PRESSURE_LAG, 0);
+    }
+}
+
+/*
+ * Returns the context's descriptor for `objects/info/fast-objects`, opening it
+ * O_APPEND on first use as the leaf-count cache does, or -1. Of two threads
+ * opening it at once, the one that publishes second closes its own.
+ */
+static int fast_list_fd(scribe_ctx *ctx) {
+    int fd = atomic_load(&ctx->fast_objects_fd);
+    int expected = -1;
+    char *info;
+    char *path;
+
+    if (fd >= 0) {
+        return fd;
+    }
+    info = scribe_path_join(ctx->repo_path, "objects/info");
+    path = info == NULL ? NULL : scribe_path_join(info, "fast-objects");
+    if (path != NULL) {
+        fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0 && errno == ENOENT && scribe_mkdir_p(info) == SCRIBE_OK) {
+            fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        }
     }
-    exists = scribe_file_exists(path);
     free(path);
-    return exists ? SCRIBE_OK : scribe_set_error(SCRIBE_ENOT_FOUND, "object not found");
+    free(info);
+    if (fd >= 0 && !atomic_compare_exchange_strong(&ctx->fast_objects_fd, &expected, fd)) {
+        close(fd);
+        fd = expected;
+    }
+    return fd;
+}
+
+/*
+ * Closes the fast-objects descriptor, if open. scribe_close() calls this, and
+ * so does repack before it removes the list, so that later appends create a
+ * new list instead of writing to the unlinked one.
+ */
+void scribe_object_fast_list_close(scribe_ctx *ctx) {
+    int fd = atomic_exchange(&ctx->fast_objects_fd, -1);
+
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+/*
+ * Appends one hash to `objects/info/fast-objects`. Lines are 65 bytes and the
+ * file is opened O_APPEND, so concurrent writers do not interleave. Failure
+ * only costs the later recompression, so it is logged, not returned.
+ */
+static void record_fast_object(scribe_ctx *ctx, const char hex[SCRIBE_HEX_HASH_SIZE + 1]) {
+    char line[SCRIBE_HEX_HASH_SIZE + 1];
+    int fd = fast_list_fd(ctx);
+
+    memcpy(line, hex, SCRIBE_HEX_HASH_SIZE);
+    line[SCRIBE_HEX_HASH_SIZE] = '\n';
+    if (fd < 0 || write(fd, line, sizeof(line)) != (ssize_t)sizeof(line)) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "objects", "failed to record fast-compressed object %s", hex);
+    }
 }
 
 /*
- * Writes an object if its content-addressed file does not already exist. The
- * object is enveloped, hashed, compressed, and atomically published under the
- * loose-object path derived from the hash.
+ * Writes an object unless the object engine already holds its hash. The
+ * object is enveloped, hashed, compressed, and handed to the engine under that
+ * hash. Under backlog the envelope is compressed at the adaptive fast level
+ * and recorded for `scribe repack`.
  */
 scribe_error_t scribe_object_write(scribe_ctx *ctx, uint8_t type, const uint8_t *payload, size_t payload_len,
                                    uint8_t out_hash[SCRIBE_HASH_SIZE]) {
@@ -133,11 +215,9 @@ scribe_error_t scribe_object_write(scribe_ctx *ctx, uint8_t type, const uint8_t
     size_t bound;
     size_t compressed_len;
     uint8_t *compressed;
-    char *path;
-    char *objects;
     char hex[SCRIBE_HEX_HASH_SIZE + 1];
-    char dirpart[16];
-    char *dir;
+    int level;
+    int fast;
     scribe_error_t err;
 
     if (payload == NULL && payload_len != 0) {
@@ -148,7 +228,7 @@ scribe_error_t scribe_object_write(scribe_ctx *ctx, uint8_t type, const uint8_t
      *   1. build the uncompressed typed envelope;
      *   2. hash the envelope to get the content address;
      *   3. skip the write if that object already exists;
-     *   4. compress the envelope and atomically publish the loose object file.
+     *   4. compress the envelope and hand it to the object engine.
      *
      * The idempotent "already exists" case matters because the same MongoDB
      * document bytes can be observed repeatedly and should reuse one blob.
@@ -158,36 +238,8 @@ scribe_error_t scribe_object_write(scribe_ctx *ctx, uint8_t type, const uint8_t
         return err;
     }
     hash_bytes(envelope, envelope_len, out_hash);
-    path = scribe_object_path(ctx, out_hash);
-    if (path == NULL) {
-        free(envelope);
-        return SCRIBE_ENOMEM;
-    }
-    if (scribe_file_exists(path)) {
-        free(path);
-        free(envelope);
-        return SCRIBE_OK;
-    }
-
-    scribe_hash_to_hex(out_hash, hex);
-    objects = scribe_path_join(ctx->repo_path, "objects");
-    if (objects == NULL) {
-        free(path);
-        free(envelope);
-        return SCRIBE_ENOMEM;
-    }
-    snprintf(dirpart, sizeof(dirpart), "%.2s", hex);
-    dir = scribe_path_join(objects, dirpart);
-    free(objects);
-    if (dir == NULL) {
-        free(path);
-        free(envelope);
-        return SCRIBE_ENOMEM;
-    }
-    err = scribe_mkdir_p(dir);
-    free(dir);
-    if (err != SCRIBE_OK) {
-        free(path);
+    err = ctx->objects->ops->has(ctx->objects, out_hash);
+    if (err != SCRIBE_ENOT_FOUND) {
         free(envelope);
         return err;
     }
@@ -195,34 +247,134 @@ scribe_error_t scribe_object_write(scribe_ctx *ctx, uint8_t type, const uint8_t
     bound = ZSTD_compressBound(envelope_len);
     compressed = (uint8_t *)malloc(bound);
     if (compressed == NULL) {
-        free(path);
         free(envelope);
         return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate compressed object");
     }
-    compressed_len = ZSTD_compress(compressed, bound, envelope, envelope_len, ctx->config.compression_level);
+    fast = ctx->config.adaptive_compression_level != 0 && atomic_load(&ctx->compression_pressure) != 0;
+    level = fast ? ctx->config.adaptive_compression_level : ctx->config.compression_level;
+    compressed_len = ZSTD_compress(compressed, bound, envelope, envelope_len, level);
     free(envelope);
     if (ZSTD_isError(compressed_len)) {
-        free(path);
         free(compressed);
         return scribe_set_error(SCRIBE_EIO, "zstd compression failed: %s", ZSTD_getErrorName(compressed_len));
     }
-    err = scribe_write_file_atomic(path, compressed, compressed_len);
-    free(path);
+    err = ctx->objects->ops->put(ctx->objects, out_hash, compressed, compressed_len,
+                                 ctx->config.durability == SCRIBE_DURABILITY_STRICT ? 0u : SCRIBE_OBJECT_PUT_NOSYNC);
     free(compressed);
+    if (err == SCRIBE_OK && fast) {
+        scribe_hash_to_hex(out_hash, hex);
+        record_fast_object(ctx, hex);
+    }
     return err;
 }
 
 /*
- * Reads and verifies one loose object. Verification includes zstd frame
- * validity, BLAKE3 hash equality, envelope type/length framing, and exact
- * payload-length accounting.
+ * Archived objects (see archive.c) are stored as a zstd skippable frame that
+ * names a base object, followed by a zstd frame compressed with the base's
+ * envelope as its prefix:
+ *
+ *   u32le ARCHIVE_MAGIC | u32le 33 | u8 chain depth | base hash | zstd frame
+ *
+ * The depth counts the delta objects from this one down to a plain object,
+ * so a reader decompresses at most SCRIBE_ARCHIVE_MAX_DEPTH bases. It stays
+ * true because an object that is already some delta's base is never turned
+ * into a delta itself: that would lengthen every chain through it. Every
+ * delta is listed in `objects/info/archive-deltas` as a raw 64-byte record,
+ * its own hash then its base's, written before the delta replaces the plain
+ * object. A base is referenced by its delta like a tree references its
+ * entries, so reachability walks consult this list (see bitmap.c).
  */
-scribe_error_t scribe_object_read(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_object *out) {
-    char *path;
+#define ARCHIVE_DELTA_RECORD (2u * SCRIBE_HASH_SIZE)
+#define ARCHIVE_MAGIC 0x184D2A5Au
+#define ARCHIVE_HEADER_SIZE (8u + 1u + SCRIBE_HASH_SIZE)
+
+/*
+ * Delta frames may use zstd's long-distance window. Reads accept up to the
+ * 64-bit maximum rather than the default 128 MiB limit.
+ */
+#define ARCHIVE_WINDOW_LOG_MAX 31
+
+/*
+ * Reads a little-endian u32.
+ */
+static uint32_t get_le32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/*
+ * Writes a little-endian u32.
+ */
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/*
+ * Returns the chain depth of a stored encoding: 0 for a plain zstd frame,
+ * otherwise the depth recorded in its archive header.
+ */
+static unsigned stored_depth(const uint8_t *stored, size_t len) {
+    if (len < ARCHIVE_HEADER_SIZE || get_le32(stored) != ARCHIVE_MAGIC ||
+        get_le32(stored + 4u) != 1u + SCRIBE_HASH_SIZE) {
+        return 0;
+    }
+    return stored[8];
+}
+
+/*
+ * Decompresses one zstd frame into a new heap buffer. A non-NULL prefix is the
+ * base envelope a delta frame was compressed against.
+ */
+static scribe_error_t decompress_frame(const uint8_t *frame, size_t frame_len, const uint8_t *prefix,
+                                       size_t prefix_len, uint8_t **out, size_t *out_len) {
+    unsigned long long content_len = ZSTD_getFrameContentSize(frame, frame_len);
+    uint8_t *envelope;
+    size_t n;
+
+    if (content_len == ZSTD_CONTENTSIZE_ERROR || content_len == ZSTD_CONTENTSIZE_UNKNOWN) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "invalid zstd object frame");
+    }
+    if (content_len > (unsigned long long)SIZE_MAX) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "object too large");
+    }
+    envelope = (uint8_t *)malloc(content_len == 0 ? 1u : (size_t)content_len);
+    if (envelope == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate object envelope");
+    }
+    if (prefix == NULL) {
+        n = ZSTD_decompress(envelope, (size_t)content_len, frame, frame_len);
+    } else {
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+
+        n = dctx == NULL ? (size_t)-1 : ZSTD_DCtx_setParameter(dctx, ZSTD_d_windowLogMax, ARCHIVE_WINDOW_LOG_MAX);
+        if (!ZSTD_isError(n)) {
+            n = ZSTD_DCtx_refPrefix(dctx, prefix, prefix_len);
+        }
+        if (!ZSTD_isError(n)) {
+            n = ZSTD_decompressDCtx(dctx, envelope, (size_t)content_len, frame, frame_len);
+        }
+        ZSTD_freeDCtx(dctx);
+    }
+    if (ZSTD_isError(n) || n != (size_t)content_len) {
+        free(envelope);
+        return scribe_set_error(SCRIBE_ECORRUPT, "zstd decompression failed");
+    }
+    *out = envelope;
+    *out_len = n;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads and verifies one object whose delta chain is already `depth` objects
+ * deep; see scribe_object_read().
+ */
+static scribe_error_t read_object(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_object *out,
+                                  unsigned depth) {
     uint8_t *compressed = NULL;
     uint8_t *envelope = NULL;
     size_t compressed_len = 0;
-    unsigned long long frame_len;
     size_t decompressed_len;
     uint8_t actual[SCRIBE_HASH_SIZE];
     uint64_t payload_len64;
@@ -230,41 +382,40 @@ scribe_error_t scribe_object_read(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HAS
     scribe_error_t err;
 
     memset(out, 0, sizeof(*out));
-    path = scribe_object_path(ctx, hash);
-    if (path == NULL) {
-        return SCRIBE_ENOMEM;
-    }
-    err = scribe_read_file(path, &compressed, &compressed_len);
-    free(path);
+    err = ctx->objects->ops->get(ctx->objects, hash, &compressed, &compressed_len);
     if (err != SCRIBE_OK) {
         return err;
     }
     /*
      * Read path is deliberately strict. A caller asking for hash H receives an
-     * object only if the file decompresses cleanly, the decompressed envelope
+     * object only if the bytes decompress cleanly, the decompressed envelope
      * rehashes to H, and the embedded payload length exactly matches the
      * remaining bytes. This is the verification that fsck relies on, and every
      * command that reads objects gets the same corruption checks for free.
+     * A delta's base goes through the same checks before it is used.
      */
-    frame_len = ZSTD_getFrameContentSize(compressed, compressed_len);
-    if (frame_len == ZSTD_CONTENTSIZE_ERROR || frame_len == ZSTD_CONTENTSIZE_UNKNOWN) {
-        free(compressed);
-        return scribe_set_error(SCRIBE_ECORRUPT, "invalid zstd object frame");
-    }
-    if (frame_len > (unsigned long long)SIZE_MAX) {
-        free(compressed);
-        return scribe_set_error(SCRIBE_ECORRUPT, "object too large");
-    }
-    envelope = (uint8_t *)malloc((size_t)frame_len);
-    if (envelope == NULL) {
-        free(compressed);
-        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate object envelope");
+    if (stored_depth(compressed, compressed_len) != 0) {
+        scribe_object base;
+
+        if (depth >= SCRIBE_ARCHIVE_MAX_DEPTH) {
+            free(compressed);
+            return scribe_set_error(SCRIBE_ECORRUPT, "archived object delta chain is too deep");
+        }
+        memcpy(out->delta_base, compressed + 9u, SCRIBE_HASH_SIZE);
+        out->has_delta_base = 1;
+        err = read_object(ctx, compressed + 9u, &base, depth + 1u);
+        if (err == SCRIBE_OK) {
+            err = decompress_frame(compressed + ARCHIVE_HEADER_SIZE, compressed_len - ARCHIVE_HEADER_SIZE,
+                                   base.envelope, base.envelope_len, &envelope, &decompressed_len);
+            scribe_object_free(&base);
+        }
+    } else {
+        err = decompress_frame(compressed, compressed_len, NULL, 0, &envelope, &decompressed_len);
     }
-    decompressed_len = ZSTD_decompress(envelope, (size_t)frame_len, compressed, compressed_len);
     free(compressed);
-    if (ZSTD_isError(decompressed_len) || decompressed_len != (size_t)frame_len) {
-        free(envelope);
-        return scribe_set_error(SCRIBE_ECORRUPT, "zstd decompression failed");
+    if (err != SCRIBE_OK) {
+        out->has_delta_base = 0;
+        return err;
     }
     hash_bytes(envelope, decompressed_len, actual);
     if (scribe_hash_cmp(actual, hash) != 0) {
@@ -293,161 +444,571 @@ scribe_error_t scribe_object_read(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HAS
 }
 
 /*
- * Releases the envelope buffer owned by a read object and clears all object
- * fields so accidental reuse is easier to notice during debugging.
+ * Reads and verifies one object. Verification includes zstd frame
+ * validity, BLAKE3 hash equality, envelope type/length framing, and exact
+ * payload-length accounting. Archived objects are rebuilt from their base.
  */
-void scribe_object_free(scribe_object *obj) {
-    if (obj != NULL) {
-        free(obj->envelope);
-        memset(obj, 0, sizeof(*obj));
+scribe_error_t scribe_object_read(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_object *out) {
+    return read_object(ctx, hash, out, 0);
+}
+
+struct scribe_archiver {
+    scribe_ctx *ctx;
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    scribe_hash_map bases;
+    uint8_t *deltas;
+    size_t delta_count;
+    size_t delta_cap;
+    int deltas_fd;
+};
+
+/*
+ * Returns whether a stored encoding is an archive delta and, if so, copies
+ * the base hash from its header.
+ */
+static int stored_base(const uint8_t *stored, size_t len, uint8_t base[SCRIBE_HASH_SIZE]) {
+    if (stored_depth(stored, len) == 0) {
+        return 0;
     }
+    memcpy(base, stored + 9u, SCRIBE_HASH_SIZE);
+    return 1;
 }
 
 /*
- * Returns whether a character is valid lowercase hex for object path names.
+ * Reports whether the stored encoding of `hash` is an archive delta and, if
+ * so, the base named in its header. Nothing is decompressed.
  */
-static int is_hex_char(char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); }
+scribe_error_t scribe_object_delta_base(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                        uint8_t out_base[SCRIBE_HASH_SIZE], int *out_is_delta) {
+    uint8_t *stored = NULL;
+    size_t stored_len = 0;
+    scribe_error_t err = ctx->objects->ops->get(ctx->objects, hash, &stored, &stored_len);
+
+    if (err == SCRIBE_OK) {
+        *out_is_delta = stored_base(stored, stored_len, out_base);
+    }
+    free(stored);
+    return err;
+}
 
 /*
- * Validates a string slice as lowercase hex without requiring it to be
- * NUL-terminated. Object iteration uses this for fanout directories and file names.
+ * Returns the path of the delta list. The caller frees it.
  */
-static int is_hex_string(const char *s, size_t len) {
-    size_t i;
+static char *deltas_path(scribe_ctx *ctx) { return scribe_path_join(ctx->repo_path, "objects/info/archive-deltas"); }
 
-    if (s == NULL) {
-        return 0;
+/*
+ * Loads `objects/info/archive-deltas` as (delta, base) hash pairs, dropping a
+ * torn last record. A store that was never archived has no list and no
+ * deltas, so a missing file loads as zero pairs. The caller frees *out_pairs.
+ */
+scribe_error_t scribe_archive_deltas_load(scribe_ctx *ctx, uint8_t **out_pairs, size_t *out_count) {
+    char *path = deltas_path(ctx);
+    uint8_t *bytes = NULL;
+    size_t len = 0;
+    scribe_error_t err;
+
+    *out_pairs = NULL;
+    *out_count = 0;
+    if (path == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate archive-deltas path");
+    }
+    err = scribe_read_file(path, &bytes, &len);
+    free(path);
+    if (err == SCRIBE_ENOT_FOUND) {
+        scribe_clear_error();
+        return SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK) {
+        *out_pairs = bytes;
+        *out_count = len / ARCHIVE_DELTA_RECORD;
+    }
+    return err;
+}
+
+/*
+ * Appends one (delta, base) pair to the archiver's in-memory list and adds
+ * the base to its base set.
+ */
+static scribe_error_t remember_delta(scribe_archiver *a, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                     const uint8_t base[SCRIBE_HASH_SIZE]) {
+    if (a->delta_count == a->delta_cap) {
+        size_t cap = a->delta_cap == 0 ? 256u : a->delta_cap * 2u;
+        uint8_t *grown;
+
+        if (cap > SIZE_MAX / ARCHIVE_DELTA_RECORD) {
+            return scribe_set_error(SCRIBE_ENOMEM, "too many archive deltas");
+        }
+        grown = (uint8_t *)realloc(a->deltas, cap * ARCHIVE_DELTA_RECORD);
+        if (grown == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow archive delta list");
+        }
+        a->deltas = grown;
+        a->delta_cap = cap;
+    }
+    memcpy(a->deltas + a->delta_count * ARCHIVE_DELTA_RECORD, hash, SCRIBE_HASH_SIZE);
+    memcpy(a->deltas + a->delta_count * ARCHIVE_DELTA_RECORD + SCRIBE_HASH_SIZE, base, SCRIBE_HASH_SIZE);
+    a->delta_count++;
+    return scribe_hash_map_add(&a->bases, base, 0, NULL, NULL);
+}
+
+/*
+ * Object visitor that records every stored delta with its base.
+ */
+static scribe_error_t collect_delta(const uint8_t hash[SCRIBE_HASH_SIZE], void *user) {
+    scribe_archiver *a = (scribe_archiver *)user;
+    uint8_t base[SCRIBE_HASH_SIZE];
+    int is_delta = 0;
+    scribe_error_t err = scribe_object_delta_base(a->ctx, hash, base, &is_delta);
+
+    if (err == SCRIBE_OK && is_delta) {
+        err = remember_delta(a, hash, base);
+    }
+    return err;
+}
+
+/*
+ * Opens the delta list at `path` for appending, replacing it first with the
+ * archiver's in-memory list when `rewrite` is set.
+ */
+static scribe_error_t open_deltas(scribe_archiver *a, const char *path, int rewrite) {
+    scribe_error_t err = SCRIBE_OK;
+
+    if (rewrite) {
+        char *info = scribe_path_join(a->ctx->repo_path, "objects/info");
+
+        err = info == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate objects/info path")
+                           : scribe_mkdir_p(info);
+        free(info);
+        if (err == SCRIBE_OK) {
+            err = scribe_write_file_atomic(path, a->deltas == NULL ? (const uint8_t *)"" : a->deltas,
+                                           a->delta_count * ARCHIVE_DELTA_RECORD);
+        }
     }
-    for (i = 0; i < len; i++) {
-        if (!is_hex_char(s[i])) {
-            return 0;
+    if (err == SCRIBE_OK) {
+        if (a->deltas_fd >= 0) {
+            close(a->deltas_fd);
+        }
+        a->deltas_fd = open(path, O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (a->deltas_fd < 0) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to open archive-deltas list");
         }
     }
-    return 1;
+    return err;
 }
 
-typedef struct {
-    scribe_object_visit_fn visit;
-    void *user;
-    char dir_hex[3];
-} object_file_iter;
+/*
+ * Loads the delta list. A store without the list (first archive, or the file
+ * was deleted) is scanned once for deltas and the list rewritten from the
+ * result. A torn last record is dropped.
+ */
+static scribe_error_t load_deltas(scribe_archiver *a) {
+    char *path = deltas_path(a->ctx);
+    uint8_t *bytes = NULL;
+    size_t len = 0;
+    size_t off;
+    scribe_error_t err;
+
+    if (path == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate archive-deltas path");
+    }
+    err = scribe_read_file(path, &bytes, &len);
+    if (err == SCRIBE_OK) {
+        len -= len % ARCHIVE_DELTA_RECORD;
+        err = scribe_hash_map_reserve(&a->bases, len / ARCHIVE_DELTA_RECORD);
+        for (off = 0; err == SCRIBE_OK && off < len; off += ARCHIVE_DELTA_RECORD) {
+            err = remember_delta(a, bytes + off, bytes + off + SCRIBE_HASH_SIZE);
+        }
+        if (err == SCRIBE_OK && truncate(path, (off_t)len) != 0) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to trim torn archive-deltas record");
+        }
+        if (err == SCRIBE_OK) {
+            err = open_deltas(a, path, 0);
+        }
+    } else if (err == SCRIBE_ENOT_FOUND) {
+        scribe_clear_error();
+        err = scribe_object_iter(a->ctx, collect_delta, a);
+        if (err == SCRIBE_OK) {
+            err = open_deltas(a, path, 1);
+        }
+    }
+    free(bytes);
+    free(path);
+    return err;
+}
 
 /*
- * Visits one file name inside an object fanout directory. Only names that look
- * like the remaining 62 hex characters of a loose object are converted to a
- * hash and passed to the caller's visitor.
+ * Records that `hash` is about to become a delta against `base` before the
+ * delta is stored, so a crash can only over-report deltas.
  */
-static scribe_error_t visit_object_file(const char *name, void *vctx) {
-    object_file_iter *it = (object_file_iter *)vctx;
-    char hex[SCRIBE_HEX_HASH_SIZE + 1];
-    uint8_t hash[SCRIBE_HASH_SIZE];
+static scribe_error_t note_delta(scribe_archiver *a, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                 const uint8_t base[SCRIBE_HASH_SIZE]) {
+    uint8_t record[ARCHIVE_DELTA_RECORD];
+
+    memcpy(record, hash, SCRIBE_HASH_SIZE);
+    memcpy(record + SCRIBE_HASH_SIZE, base, SCRIBE_HASH_SIZE);
+    if (write(a->deltas_fd, record, sizeof(record)) != (ssize_t)sizeof(record) || fdatasync(a->deltas_fd) != 0) {
+        return scribe_set_error(SCRIBE_EIO, "failed to record archive delta");
+    }
+    return remember_delta(a, hash, base);
+}
+
+/*
+ * Counts the deltas from `hash` down to a plain object by following the
+ * stored headers. Stops counting past SCRIBE_ARCHIVE_MAX_DEPTH.
+ */
+static scribe_error_t chain_depth(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], unsigned *out) {
+    uint8_t at[SCRIBE_HASH_SIZE];
+    unsigned depth = 0;
+
+    memcpy(at, hash, SCRIBE_HASH_SIZE);
+    for (;;) {
+        uint8_t *stored = NULL;
+        size_t stored_len = 0;
+        scribe_error_t err = ctx->objects->ops->get(ctx->objects, at, &stored, &stored_len);
+
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+        if (stored_depth(stored, stored_len) == 0 || depth > SCRIBE_ARCHIVE_MAX_DEPTH) {
+            free(stored);
+            *out = depth;
+            return SCRIBE_OK;
+        }
+        memcpy(at, stored + 9u, SCRIBE_HASH_SIZE);
+        free(stored);
+        depth++;
+    }
+}
+
+/*
+ * Creates the compression state for archiving objects at
+ * `archive_compression_level` with long-distance matching.
+ */
+scribe_error_t scribe_archiver_new(scribe_ctx *ctx, scribe_archiver **out) {
+    scribe_archiver *a = (scribe_archiver *)calloc(1, sizeof(*a));
     scribe_error_t err;
 
-    /*
-     * Ignore files that do not look like loose object names. Operators may
-     * leave editor temp files or filesystem metadata in objects/; those should
-     * not break iteration. A file that has a valid object-shaped name but bad
-     * contents will still fail later when the visitor reads it.
-     */
-    if (strlen(name) != 62u || !is_hex_string(name, 62u)) {
+    if (a == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate archiver");
+    }
+    a->ctx = ctx;
+    a->deltas_fd = -1;
+    a->cctx = ZSTD_createCCtx();
+    a->dctx = ZSTD_createDCtx();
+    if (a->cctx == NULL || a->dctx == NULL) {
+        scribe_archiver_free(a);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate zstd contexts");
+    }
+    err = load_deltas(a);
+    if (err != SCRIBE_OK) {
+        scribe_archiver_free(a);
+        return err;
+    }
+    *out = a;
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees an archiver. Accepts NULL.
+ */
+void scribe_archiver_free(scribe_archiver *a) {
+    if (a == NULL) {
+        return;
+    }
+    ZSTD_freeCCtx(a->cctx);
+    ZSTD_freeDCtx(a->dctx);
+    if (a->deltas_fd >= 0) {
+        close(a->deltas_fd);
+    }
+    scribe_hash_map_destroy(&a->bases);
+    free(a->deltas);
+    free(a);
+}
+
+/*
+ * Compresses `obj` as one frame, against `base` as a prefix when it is not
+ * NULL, and checks that the frame decompresses back to the envelope before it
+ * can replace anything.
+ */
+static scribe_error_t archive_frame(scribe_archiver *a, const scribe_object *obj, const scribe_object *base,
+                                    uint8_t *out, size_t cap, size_t *out_len) {
+    uint8_t *check = NULL;
+    size_t n;
+
+    n = ZSTD_CCtx_reset(a->cctx, ZSTD_reset_session_and_parameters);
+    if (!ZSTD_isError(n)) {
+        n = ZSTD_CCtx_setParameter(a->cctx, ZSTD_c_compressionLevel, a->ctx->config.archive_compression_level);
+    }
+    if (!ZSTD_isError(n)) {
+        n = ZSTD_CCtx_setParameter(a->cctx, ZSTD_c_enableLongDistanceMatching, 1);
+    }
+    if (!ZSTD_isError(n) && base != NULL) {
+        n = ZSTD_CCtx_refPrefix(a->cctx, base->envelope, base->envelope_len);
+    }
+    if (!ZSTD_isError(n)) {
+        n = ZSTD_compress2(a->cctx, out, cap, obj->envelope, obj->envelope_len);
+    }
+    if (ZSTD_isError(n)) {
+        return scribe_set_error(SCRIBE_EIO, "zstd archive compression failed: %s", ZSTD_getErrorName(n));
+    }
+    *out_len = n;
+    check = (uint8_t *)malloc(obj->envelope_len);
+    if (check == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate archive check buffer");
+    }
+    n = ZSTD_DCtx_reset(a->dctx, ZSTD_reset_session_and_parameters);
+    if (!ZSTD_isError(n)) {
+        n = ZSTD_DCtx_setParameter(a->dctx, ZSTD_d_windowLogMax, ARCHIVE_WINDOW_LOG_MAX);
+    }
+    if (!ZSTD_isError(n) && base != NULL) {
+        n = ZSTD_DCtx_refPrefix(a->dctx, base->envelope, base->envelope_len);
+    }
+    if (!ZSTD_isError(n)) {
+        n = ZSTD_decompressDCtx(a->dctx, check, obj->envelope_len, out, *out_len);
+    }
+    if (ZSTD_isError(n) || n != obj->envelope_len || memcmp(check, obj->envelope, n) != 0) {
+        free(check);
+        return scribe_set_error(SCRIBE_EIO, "archived object failed its round-trip check");
+    }
+    free(check);
+    return SCRIBE_OK;
+}
+
+/*
+ * Re-encodes one object for the cold tier. With a base, the object is stored
+ * as a delta against the base's envelope unless that would make the chain
+ * deeper than SCRIBE_ARCHIVE_MAX_DEPTH or the object is itself a delta base;
+ * otherwise it is recompressed alone. The base's depth comes from walking its
+ * real chain, not from its header.
+ * The new encoding replaces the stored one only when it is smaller. Objects
+ * that are already deltas are left alone, so archiving is idempotent and
+ * never changes an existing chain. The hash never changes.
+ */
+scribe_error_t scribe_archiver_store(scribe_archiver *a, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                     const uint8_t *base_hash, scribe_archive_stats *stats) {
+    scribe_ctx *ctx = a->ctx;
+    scribe_object obj;
+    scribe_object base;
+    uint8_t *stored = NULL;
+    size_t stored_len = 0;
+    uint8_t *encoded = NULL;
+    size_t cap;
+    size_t frame_len = 0;
+    unsigned depth = 0;
+    int have_base = 0;
+    scribe_error_t err;
+
+    err = ctx->objects->ops->get(ctx->objects, hash, &stored, &stored_len);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    depth = stored_depth(stored, stored_len);
+    free(stored);
+    stats->objects++;
+    stats->bytes_before += stored_len;
+    if (depth != 0) {
+        stats->bytes_after += stored_len;
         return SCRIBE_OK;
     }
-    snprintf(hex, sizeof(hex), "%s%s", it->dir_hex, name);
-    err = scribe_hash_from_hex(hex, hash);
+    if (base_hash != NULL && scribe_hash_cmp(base_hash, hash) != 0 && scribe_hash_map_get(&a->bases, hash) == NULL) {
+        err = chain_depth(ctx, base_hash, &depth);
+        if (err == SCRIBE_OK) {
+            depth++;
+            have_base = depth <= SCRIBE_ARCHIVE_MAX_DEPTH;
+        } else if (err == SCRIBE_ENOT_FOUND) {
+            err = SCRIBE_OK;
+        }
+    }
+    if (err == SCRIBE_OK && have_base) {
+        err = scribe_object_read(ctx, base_hash, &base);
+        have_base = err == SCRIBE_OK;
+    }
     if (err != SCRIBE_OK) {
         return err;
     }
-    return it->visit(hash, it->user);
+    err = scribe_object_read(ctx, hash, &obj);
+    if (err == SCRIBE_OK) {
+        cap = ARCHIVE_HEADER_SIZE + ZSTD_compressBound(obj.envelope_len);
+        encoded = (uint8_t *)malloc(cap);
+        err = encoded == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate archived object") : SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK) {
+        err = archive_frame(a, &obj, have_base ? &base : NULL, encoded + (have_base ? ARCHIVE_HEADER_SIZE : 0u),
+                            cap - ARCHIVE_HEADER_SIZE, &frame_len);
+    }
+    if (err == SCRIBE_OK && have_base) {
+        put_le32(encoded, ARCHIVE_MAGIC);
+        put_le32(encoded + 4u, 1u + SCRIBE_HASH_SIZE);
+        encoded[8] = (uint8_t)depth;
+        memcpy(encoded + 9u, base_hash, SCRIBE_HASH_SIZE);
+        frame_len += ARCHIVE_HEADER_SIZE;
+    }
+    if (err == SCRIBE_OK && frame_len < stored_len && have_base) {
+        err = note_delta(a, hash, base_hash);
+    }
+    if (err == SCRIBE_OK && frame_len < stored_len) {
+        err = ctx->objects->ops->put(ctx->objects, hash, encoded, frame_len, SCRIBE_OBJECT_PUT_REPLACE);
+        if (err == SCRIBE_OK) {
+            stats->rewritten++;
+            stats->deltas += (size_t)have_base;
+        }
+    }
+    if (err == SCRIBE_OK) {
+        stats->bytes_after += frame_len < stored_len ? frame_len : stored_len;
+    }
+    free(encoded);
+    if (obj.envelope != NULL) {
+        scribe_object_free(&obj);
+    }
+    if (have_base) {
+        scribe_object_free(&base);
+    }
+    return err;
 }
 
-typedef struct {
-    scribe_ctx *ctx;
-    scribe_object_visit_fn visit;
-    void *user;
-} object_dir_iter;
+/*
+ * Returns the archiver's (delta, base) pairs, each 2 * SCRIBE_HASH_SIZE bytes,
+ * in the order they were recorded. Entries may be stale: an object listed
+ * here can since have been detached or removed.
+ */
+size_t scribe_archiver_deltas(const scribe_archiver *a, const uint8_t **out_pairs) {
+    *out_pairs = a->deltas;
+    return a->delta_count;
+}
 
 /*
- * Visits one fanout directory under objects/. Valid two-character hex
- * directories are opened and their files are delegated to visit_object_file().
+ * Re-encodes a stored delta as a self-contained frame so it no longer needs
+ * its base. Plain objects are left alone and *out_rewritten stays 0. The hash
+ * never changes.
  */
-static scribe_error_t visit_object_dir(const char *name, void *vctx) {
-    object_dir_iter *it = (object_dir_iter *)vctx;
-    object_file_iter file_it;
-    char *objects;
-    char *dir;
+scribe_error_t scribe_archiver_detach(scribe_archiver *a, const uint8_t hash[SCRIBE_HASH_SIZE], int *out_rewritten) {
+    scribe_ctx *ctx = a->ctx;
+    scribe_object obj;
+    uint8_t *encoded = NULL;
+    size_t cap;
+    size_t frame_len = 0;
     scribe_error_t err;
 
-    if (strlen(name) != 2u || !is_hex_string(name, 2u)) {
-        return SCRIBE_OK;
+    *out_rewritten = 0;
+    err = scribe_object_read(ctx, hash, &obj);
+    if (err != SCRIBE_OK || !obj.has_delta_base) {
+        if (err == SCRIBE_OK) {
+            scribe_object_free(&obj);
+        }
+        return err;
     }
-    objects = scribe_path_join(it->ctx->repo_path, "objects");
-    if (objects == NULL) {
-        return SCRIBE_ENOMEM;
+    cap = ZSTD_compressBound(obj.envelope_len);
+    encoded = (uint8_t *)malloc(cap);
+    err = encoded == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate detached object") : SCRIBE_OK;
+    if (err == SCRIBE_OK) {
+        err = archive_frame(a, &obj, NULL, encoded, cap, &frame_len);
     }
-    dir = scribe_path_join(objects, name);
-    free(objects);
-    if (dir == NULL) {
-        return SCRIBE_ENOMEM;
+    if (err == SCRIBE_OK) {
+        err = ctx->objects->ops->put(ctx->objects, hash, encoded, frame_len, SCRIBE_OBJECT_PUT_REPLACE);
+        *out_rewritten = err == SCRIBE_OK;
     }
-    file_it.visit = it->visit;
-    file_it.user = it->user;
-    file_it.dir_hex[0] = name[0];
-    file_it.dir_hex[1] = name[1];
-    file_it.dir_hex[2] = '\0';
-    err = scribe_list_dir(dir, visit_object_file, &file_it);
-    free(dir);
-    return err == SCRIBE_ENOT_FOUND ? SCRIBE_OK : err;
+    free(encoded);
+    scribe_object_free(&obj);
+    return err;
 }
 
 /*
- * Iterates every loose object hash known to the object store. The iterator uses
- * the storage abstraction rather than exposing filesystem walking to callers so
- * future pack storage can replace this implementation behind the same API.
+ * Drops the pairs of detached objects from the delta list and replaces the
+ * file. Their bases stay in the base set, which may only over-report.
  */
-scribe_error_t scribe_object_iter(scribe_ctx *ctx, scribe_object_visit_fn visit, void *user) {
-    object_dir_iter it;
-    char *objects;
+scribe_error_t scribe_archiver_prune(scribe_archiver *a, const scribe_hash_map *detached) {
+    char *path;
+    size_t kept = 0;
+    size_t i;
     scribe_error_t err;
 
+    for (i = 0; i < a->delta_count; i++) {
+        const uint8_t *pair = a->deltas + i * ARCHIVE_DELTA_RECORD;
+
+        if (scribe_hash_map_get(detached, pair) == NULL) {
+            memmove(a->deltas + kept * ARCHIVE_DELTA_RECORD, pair, ARCHIVE_DELTA_RECORD);
+            kept++;
+        }
+    }
+    if (kept == a->delta_count) {
+        return SCRIBE_OK;
+    }
+    a->delta_count = kept;
+    path = deltas_path(a->ctx);
+    err = path == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate archive-deltas path")
+                       : open_deltas(a, path, 1);
+    free(path);
+    return err;
+}
+
+/*
+ * Releases the envelope buffer owned by a read object and clears all object
+ * fields so accidental reuse is easier to notice during debugging.
+ */
+void scribe_object_free(scribe_object *obj) {
+    if (obj != NULL) {
+        free(obj->envelope);
+        memset(obj, 0, sizeof(*obj));
+    }
+}
+
+/*
+ * Iterates every object hash held by the object engine, calling the visitor
+ * on this thread only. Callers never walk storage directly, so engines can
+ * change without touching list-objects, fsck, or the bitmap writer.
+ */
+scribe_error_t scribe_object_iter(scribe_ctx *ctx, scribe_object_visit_fn visit, void *user) {
     if (ctx == NULL || visit == NULL) {
         return scribe_set_error(SCRIBE_EINVAL, "invalid object iterator arguments");
     }
-    objects = scribe_path_join(ctx->repo_path, "objects");
-    if (objects == NULL) {
-        return SCRIBE_ENOMEM;
+    return ctx->objects->ops->iter(ctx->objects, visit, user, 1u);
+}
+
+/*
+ * Like scribe_object_iter(), but the engine may scan with up to
+ * scribe_worker_count() threads and call the visitor from any of them at once.
+ * Visitors must synchronize their own shared state. The first visitor or scan
+ * error stops the remaining work and is returned.
+ */
+scribe_error_t scribe_object_iter_concurrent(scribe_ctx *ctx, scribe_object_visit_fn visit, void *user) {
+    if (ctx == NULL || visit == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid object iterator arguments");
     }
-    it.ctx = ctx;
-    it.visit = visit;
-    it.user = user;
-    err = scribe_list_dir(objects, visit_object_dir, &it);
-    free(objects);
-    return err == SCRIBE_ENOT_FOUND ? SCRIBE_OK : err;
+    return ctx->objects->ops->iter(ctx->objects, visit, user, scribe_worker_count(ctx));
 }
 
 /*
- * Returns the compressed on-disk byte size of a loose object. list-objects uses
+ * Returns the stored (compressed) byte size of an object. list-objects uses
  * this only when the user requests the `%C` format placeholder.
  */
 scribe_error_t scribe_object_compressed_size(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], size_t *out) {
-    struct stat st;
-    char *path;
-
     if (ctx == NULL || hash == NULL || out == NULL) {
         return scribe_set_error(SCRIBE_EINVAL, "invalid compressed-size arguments");
     }
-    path = scribe_object_path(ctx, hash);
-    if (path == NULL) {
-        return SCRIBE_ENOMEM;
-    }
-    if (stat(path, &st) != 0) {
-        free(path);
-        return errno == ENOENT ? scribe_set_error(SCRIBE_ENOT_FOUND, "object not found")
-                               : scribe_set_error(SCRIBE_EIO, "failed to stat object");
+    return ctx->objects->ops->stat(ctx->objects, hash, out);
+}
+
+/*
+ * Makes every completed object write durable. Commit publication calls this
+ * before moving refs/heads/main so a ref never names an object an engine could
+ * still lose. In relaxed durability mode the ref itself waits for the
+ * background syncer's barrier, so there is nothing to do here.
+ */
+scribe_error_t scribe_object_flush(scribe_ctx *ctx) {
+    if (scribe_durability_deferred(ctx)) {
+        return SCRIBE_OK;
     }
-    free(path);
-    if (st.st_size < 0 || (uintmax_t)st.st_size > (uintmax_t)SIZE_MAX) {
-        return scribe_set_error(SCRIBE_EIO, "invalid compressed object size");
+    return ctx->objects->ops->flush(ctx->objects);
+}
+
+/*
+ * Replaces the context's object engine, destroying the previous one. Tests and
+ * benchmarks call this right after scribe_open() to run on the in-memory engine.
+ */
+void scribe_object_set_backend(scribe_ctx *ctx, scribe_object_backend *backend) {
+    if (ctx->objects != NULL) {
+        ctx->objects->ops->destroy(ctx->objects);
     }
-    *out = (size_t)st.st_size;
-    return SCRIBE_OK;
+    ctx->objects = backend;
 }
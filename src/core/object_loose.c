@@ -0,0 +1,490 @@
+/*
+ * Loose-file object engine.
+ *
+ * The default object-store engine keeps one file per object at
+ * `.scribe/objects/<xx>/<rest-of-hash>`, holding the zstd-compressed envelope.
+ * Files are published with the atomic write helper, which fsyncs the file and
+ * its directory, so a strict put() is already durable. Puts flagged
+ * SCRIBE_OBJECT_PUT_NOSYNC skip both fsyncs and leave the engine dirty;
+ * flush() then covers them all with one syncfs(). Iteration reads fanout
+ * directories with large getdents64 batches and can spread them over several
+ * threads.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+typedef struct {
+    scribe_object_backend base;
+    char *objects_dir;
+    atomic_int dirty;
+} loose_backend;
+
+/*
+ * Computes the loose-object path for a hash using the v1 two-character fanout
+ * directory layout. The returned string is heap-owned by the caller.
+ */
+static char *loose_path(const loose_backend *lb, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    char hex[SCRIBE_HEX_HASH_SIZE + 1];
+    size_t len = strlen(lb->objects_dir) + SCRIBE_HEX_HASH_SIZE + 3u;
+    char *path = (char *)malloc(len);
+
+    /*
+     * Loose objects are sharded by the first two hex characters:
+     * objects/ab/cdef... instead of objects/abcdef... This keeps directory
+     * sizes reasonable for large v1 stores and matches the
+     * iterator layout used by list-objects and fsck.
+     */
+    if (path == NULL) {
+        (void)scribe_set_error(SCRIBE_ENOMEM, "failed to allocate object path");
+        return NULL;
+    }
+    scribe_hash_to_hex(hash, hex);
+    snprintf(path, len, "%s/%.2s/%s", lb->objects_dir, hex, hex + 2);
+    return path;
+}
+
+/*
+ * Checks whether an object file currently exists without reading or verifying
+ * it. Writers use this to make content-addressed writes idempotent.
+ */
+static scribe_error_t loose_has(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    char *path = loose_path((loose_backend *)b, hash);
+    int exists;
+
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    exists = scribe_file_exists(path);
+    free(path);
+    return exists ? SCRIBE_OK : scribe_set_error(SCRIBE_ENOT_FOUND, "object not found");
+}
+
+/*
+ * Publishes one stored encoding under its fanout directory, creating the
+ * directory on first use. An existing file is kept unless the caller asks to
+ * replace it. Replacements are always fsynced: the file they overwrite may
+ * already be named by a durable ref.
+ */
+static scribe_error_t loose_put(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], const uint8_t *bytes,
+                                size_t len, unsigned flags) {
+    loose_backend *lb = (loose_backend *)b;
+    char *path = loose_path(lb, hash);
+    char *slash;
+    scribe_error_t err;
+
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    if ((flags & SCRIBE_OBJECT_PUT_REPLACE) == 0 && scribe_file_exists(path)) {
+        free(path);
+        return SCRIBE_OK;
+    }
+    slash = strrchr(path, '/');
+    *slash = '\0';
+    err = scribe_mkdir_p(path);
+    *slash = '/';
+    if (err == SCRIBE_OK && (flags & (SCRIBE_OBJECT_PUT_NOSYNC | SCRIBE_OBJECT_PUT_REPLACE)) == SCRIBE_OBJECT_PUT_NOSYNC) {
+        atomic_store(&lb->dirty, 1);
+        err = scribe_write_file_atomic_flags(path, bytes, len, SCRIBE_WRITE_NOSYNC);
+    } else if (err == SCRIBE_OK) {
+        err = scribe_write_file_atomic(path, bytes, len);
+    }
+    free(path);
+    return err;
+}
+
+/*
+ * Reads one object file into a heap buffer. A missing file reports
+ * SCRIBE_ENOT_FOUND, which fsck turns into a missing-object error.
+ */
+static scribe_error_t loose_get(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], uint8_t **out,
+                                size_t *out_len) {
+    char *path = loose_path((loose_backend *)b, hash);
+    scribe_error_t err;
+
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    err = scribe_read_file(path, out, out_len);
+    free(path);
+    return err;
+}
+
+/*
+ * Returns the on-disk byte size of one object file.
+ */
+static scribe_error_t loose_stat(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], size_t *out_len) {
+    struct stat st;
+    char *path = loose_path((loose_backend *)b, hash);
+
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    if (stat(path, &st) != 0) {
+        free(path);
+        return errno == ENOENT ? scribe_set_error(SCRIBE_ENOT_FOUND, "object not found")
+                               : scribe_set_error(SCRIBE_EIO, "failed to stat object");
+    }
+    free(path);
+    if (st.st_size < 0 || (uintmax_t)st.st_size > (uintmax_t)SIZE_MAX) {
+        return scribe_set_error(SCRIBE_EIO, "invalid compressed object size");
+    }
+    *out_len = (size_t)st.st_size;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the value of one lowercase hex digit, or -1. Object file names are
+ * always lowercase, so anything else is not an object.
+ */
+static int hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+/*
+ * Decodes a fanout byte plus a 62-character file name into a hash. Returns 0
+ * for names that are not loose objects (temp files, editor droppings), which
+ * iteration skips; an object-shaped file with bad contents still fails later
+ * when the visitor reads it.
+ */
+static int decode_object_name(unsigned fanout, const char *name, uint8_t hash[SCRIBE_HASH_SIZE]) {
+    size_t i;
+
+    hash[0] = (uint8_t)fanout;
+    for (i = 1; i < SCRIBE_HASH_SIZE; i++) {
+        int hi = hex_digit(name[2u * i - 2u]);
+        int lo = hi < 0 ? -1 : hex_digit(name[2u * i - 1u]);
+        if (lo < 0) {
+            return 0;
+        }
+        hash[i] = (uint8_t)((hi << 4) | lo);
+    }
+    return name[2u * SCRIBE_HASH_SIZE - 2u] == '\0';
+}
+
+/* Directory-entry buffer per scanning thread; one getdents call fills it. */
+#define LOOSE_DENTS_BUFFER (256u * 1024u)
+
+typedef struct {
+    int objects_fd;
+    scribe_object_visit_fn visit;
+    void *user;
+    atomic_uint next_fanout;
+    atomic_int stop;
+    pthread_mutex_t mu;
+    scribe_error_t err;
+    char err_detail[512];
+} loose_scan;
+
+#ifdef SYS_getdents64
+struct loose_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/*
+ * Visits every object in one open fanout directory, reading entries in large
+ * getdents64 batches instead of one readdir call per name.
+ */
+static scribe_error_t scan_entries(loose_scan *scan, int fd, unsigned fanout, uint8_t *buf) {
+    uint8_t hash[SCRIBE_HASH_SIZE];
+
+    for (;;) {
+        long n = syscall(SYS_getdents64, fd, buf, LOOSE_DENTS_BUFFER);
+        long off;
+
+        if (n < 0) {
+            return scribe_set_error(SCRIBE_EIO, "failed to read object directory %02x", fanout);
+        }
+        if (n == 0 || atomic_load(&scan->stop)) {
+            return SCRIBE_OK;
+        }
+        for (off = 0; off < n;) {
+            const struct loose_dirent64 *d = (const struct loose_dirent64 *)(const void *)(buf + off);
+            off += d->d_reclen;
+            if (decode_object_name(fanout, d->d_name, hash)) {
+                scribe_error_t err = scan->visit(hash, scan->user);
+                if (err != SCRIBE_OK) {
+                    return err;
+                }
+            }
+        }
+    }
+}
+#else
+/*
+ * Visits every object in one open fanout directory with readdir. Used where
+ * getdents64 is not available.
+ */
+static scribe_error_t scan_entries(loose_scan *scan, int fd, unsigned fanout, uint8_t *buf) {
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    DIR *dir = fdopendir(fd);
+    struct dirent *ent;
+    scribe_error_t err = SCRIBE_OK;
+
+    (void)buf;
+    if (dir == NULL) {
+        close(fd);
+        return scribe_set_error(SCRIBE_EIO, "failed to read object directory %02x", fanout);
+    }
+    while (err == SCRIBE_OK && (ent = readdir(dir)) != NULL) {
+        if (decode_object_name(fanout, ent->d_name, hash)) {
+            err = scan->visit(hash, scan->user);
+        }
+    }
+    closedir(dir);
+    return err;
+}
+#endif
+
+/*
+ * Opens and scans one fanout directory. A missing directory just means no
+ * object with that first byte has been written yet.
+ */
+static scribe_error_t scan_fanout(loose_scan *scan, unsigned fanout, uint8_t *buf) {
+    char name[3];
+    int fd;
+    scribe_error_t err;
+
+    name[0] = "0123456789abcdef"[fanout >> 4];
+    name[1] = "0123456789abcdef"[fanout & 15u];
+    name[2] = '\0';
+    fd = openat(scan->objects_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT ? SCRIBE_OK : scribe_set_error(SCRIBE_EIO, "failed to open object directory %s", name);
+    }
+    err = scan_entries(scan, fd, fanout, buf);
+#ifdef SYS_getdents64
+    close(fd);
+#endif
+    return err;
+}
+
+/*
+ * Scanning thread body: claims fanout directories from a shared counter until
+ * all 256 are taken or another thread has failed. The first error and its
+ * detail message are kept for the calling thread.
+ */
+static void *scan_worker(void *arg) {
+    loose_scan *scan = (loose_scan *)arg;
+    uint8_t *buf = (uint8_t *)malloc(LOOSE_DENTS_BUFFER);
+    scribe_error_t err = buf == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate directory buffer")
+                                     : SCRIBE_OK;
+
+    while (err == SCRIBE_OK && !atomic_load(&scan->stop)) {
+        unsigned fanout = atomic_fetch_add(&scan->next_fanout, 1u);
+        if (fanout >= 256u) {
+            break;
+        }
+        err = scan_fanout(scan, fanout, buf);
+    }
+    if (err != SCRIBE_OK) {
+        pthread_mutex_lock(&scan->mu);
+        if (scan->err == SCRIBE_OK) {
+            scan->err = err;
+            snprintf(scan->err_detail, sizeof(scan->err_detail), "%s", scribe_last_error_detail());
+        }
+        pthread_mutex_unlock(&scan->mu);
+        atomic_store(&scan->stop, 1);
+    }
+    free(buf);
+    return NULL;
+}
+
+/*
+ * Iterates every loose object file. The 256 fanout directories are opened
+ * directly instead of listing objects/, and with threads > 1 they are shared
+ * out among that many scanning threads (the caller's included), so visitors
+ * must then tolerate concurrent calls. With one thread, fanouts are visited
+ * in order on the calling thread.
+ */
+static scribe_error_t loose_iter(scribe_object_backend *b, scribe_object_visit_fn visit, void *user,
+                                 unsigned threads) {
+    const loose_backend *lb = (const loose_backend *)b;
+    pthread_t workers[255];
+    unsigned started = 0;
+    unsigned i;
+    loose_scan scan;
+
+    memset(&scan, 0, sizeof(scan));
+    scan.objects_fd = open(lb->objects_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (scan.objects_fd < 0) {
+        return errno == ENOENT ? SCRIBE_OK : scribe_set_error(SCRIBE_EIO, "failed to open objects directory");
+    }
+    scan.visit = visit;
+    scan.user = user;
+    atomic_init(&scan.next_fanout, 0u);
+    atomic_init(&scan.stop, 0);
+    if (pthread_mutex_init(&scan.mu, NULL) != 0) {
+        close(scan.objects_fd);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize object iterator");
+    }
+    if (threads > 256u) {
+        threads = 256u;
+    }
+    while (started + 1u < threads && pthread_create(&workers[started], NULL, scan_worker, &scan) == 0) {
+        started++;
+    }
+    scan_worker(&scan);
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&scan.mu);
+    close(scan.objects_fd);
+    if (scan.err != SCRIBE_OK) {
+        return scribe_set_error(scan.err, "%s", scan.err_detail);
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Makes unsynced puts durable with one syncfs() on the objects directory's
+ * filesystem. Strict puts are durable on return, so a clean engine has
+ * nothing to do. The dirty flag is cleared before the barrier: a put racing
+ * with it sets the flag again and is covered by the next flush.
+ */
+static scribe_error_t loose_flush(scribe_object_backend *b) {
+    loose_backend *lb = (loose_backend *)b;
+    int fd;
+
+    if (atomic_exchange(&lb->dirty, 0) == 0) {
+        return SCRIBE_OK;
+    }
+    fd = open(lb->objects_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || syncfs(fd) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        atomic_store(&lb->dirty, 1);
+        return scribe_set_error(SCRIBE_EIO, "failed to sync object store");
+    }
+    close(fd);
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees the engine. Files on disk are untouched.
+ */
+static void loose_destroy(scribe_object_backend *b) {
+    loose_backend *lb = (loose_backend *)b;
+
+    free(lb->objects_dir);
+    free(lb);
+}
+
+static const scribe_object_backend_ops loose_ops = {
+    "loose", loose_put, loose_get, loose_has, loose_iter, loose_stat, loose_flush, loose_destroy,
+};
+
+/*
+ * Creates the loose-file engine for the repository at repo_path. The objects/
+ * directory is not created here; init already made it and puts create fanout
+ * directories on demand.
+ */
+scribe_error_t scribe_object_backend_loose_new(const char *repo_path, scribe_object_backend **out) {
+    loose_backend *lb = (loose_backend *)calloc(1, sizeof(*lb));
+
+    if (lb == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate loose object engine");
+    }
+    lb->objects_dir = scribe_path_join(repo_path, "objects");
+    if (lb->objects_dir == NULL) {
+        free(lb);
+        return SCRIBE_ENOMEM;
+    }
+    atomic_init(&lb->dirty, 0);
+    lb->base.ops = &loose_ops;
+    *out = &lb->base;
+    return SCRIBE_OK;
+}
+
+/*
+ * Verifies every loose object file modified at or after `since` and deletes
+ * the ones that fail, counting them in out_removed. Used after an unclean
+ * non-strict writer: a torn file would otherwise satisfy has() forever.
+ * Files that pass may still be only in the page cache after a process crash,
+ * so the pass ends with a syncfs() barrier; only then may the caller drop or
+ * renew the marker that dates them. Contexts running another engine have no
+ * unsynced files and return at once.
+ */
+scribe_error_t scribe_object_loose_discard_torn(scribe_ctx *ctx, time_t since, size_t *out_removed) {
+    loose_backend *lb = (loose_backend *)ctx->objects;
+    char dir[PATH_MAX];
+    unsigned fanout;
+    scribe_error_t err = SCRIBE_OK;
+
+    *out_removed = 0;
+    if (ctx->objects->ops != &loose_ops) {
+        return SCRIBE_OK;
+    }
+    for (fanout = 0; err == SCRIBE_OK && fanout < 256u; fanout++) {
+        DIR *d;
+        struct dirent *ent;
+
+        snprintf(dir, sizeof(dir), "%s/%02x", lb->objects_dir, fanout);
+        d = opendir(dir);
+        if (d == NULL) {
+            continue;
+        }
+        while (err == SCRIBE_OK && (ent = readdir(d)) != NULL) {
+            char hex[SCRIBE_HEX_HASH_SIZE + 1];
+            char path[PATH_MAX];
+            uint8_t hash[SCRIBE_HASH_SIZE];
+            scribe_object obj;
+            struct stat st;
+            scribe_error_t read_err;
+
+            if (strlen(ent->d_name) != SCRIBE_HEX_HASH_SIZE - 2u) {
+                continue;
+            }
+            snprintf(hex, 3, "%02x", fanout);
+            memcpy(hex + 2, ent->d_name, SCRIBE_HEX_HASH_SIZE - 2u);
+            hex[SCRIBE_HEX_HASH_SIZE] = '\0';
+            if (snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name) >= (int)sizeof(path) ||
+                scribe_hash_from_hex(hex, hash) != SCRIBE_OK || stat(path, &st) != 0 || st.st_mtime < since) {
+                continue;
+            }
+            read_err = scribe_object_read(ctx, hash, &obj);
+            if (read_err == SCRIBE_OK) {
+                scribe_object_free(&obj);
+            } else if (read_err == SCRIBE_ENOMEM) {
+                err = read_err;
+            } else if (unlink(path) != 0) {
+                err = scribe_set_error(SCRIBE_EIO, "failed to remove torn object '%s'", path);
+            } else {
+                scribe_clear_error();
+                (*out_removed)++;
+            }
+        }
+        closedir(d);
+    }
+    if (err == SCRIBE_OK) {
+        atomic_store(&lb->dirty, 1);
+        err = loose_flush(&lb->base);
+    }
+    return err;
+}
@@ -0,0 +1,237 @@
+/*
+ * In-memory object engine.
+ *
+ * Keeps every stored object encoding in an array indexed by a hash map keyed by
+ * object hash, guarded by one mutex so bootstrap and pipe workers can write
+ * concurrently. Nothing reaches the disk, which makes the engine useful for
+ * tests and for benchmarks that want to measure hashing, compression, and tree
+ * building without filesystem cost. Contents are lost when the context closes.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint8_t *bytes;
+    size_t len;
+} mem_object;
+
+typedef struct {
+    scribe_object_backend base;
+    pthread_mutex_t mu;
+    scribe_hash_map index;
+    mem_object *objects;
+    size_t count;
+    size_t cap;
+} mem_backend;
+
+/*
+ * Returns the stored object for a hash, or NULL. The caller holds the mutex.
+ */
+static mem_object *mem_find(mem_backend *mb, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    uint64_t *at = scribe_hash_map_get(&mb->index, hash);
+
+    return at == NULL ? NULL : &mb->objects[*at];
+}
+
+/*
+ * Stores a copy of one object encoding. Existing objects are kept unless the
+ * caller asks to replace them.
+ */
+static scribe_error_t mem_put(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], const uint8_t *bytes,
+                              size_t len, unsigned flags) {
+    mem_backend *mb = (mem_backend *)b;
+    uint8_t *copy;
+    mem_object *obj;
+    scribe_error_t err = SCRIBE_OK;
+
+    copy = (uint8_t *)malloc(len == 0 ? 1u : len);
+    if (copy == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate in-memory object");
+    }
+    if (len != 0) {
+        memcpy(copy, bytes, len);
+    }
+    pthread_mutex_lock(&mb->mu);
+    obj = mem_find(mb, hash);
+    if (obj != NULL && (flags & SCRIBE_OBJECT_PUT_REPLACE) == 0) {
+        free(copy);
+    } else if (obj != NULL) {
+        free(obj->bytes);
+        obj->bytes = copy;
+        obj->len = len;
+    } else {
+        if (mb->count == mb->cap) {
+            size_t cap = mb->cap == 0 ? 1024u : mb->cap * 2u;
+            mem_object *grown = NULL;
+
+            if (cap <= SIZE_MAX / sizeof(*grown)) {
+                grown = (mem_object *)realloc(mb->objects, cap * sizeof(*grown));
+            }
+
+            if (grown == NULL) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "failed to grow in-memory object table");
+            } else {
+                mb->objects = grown;
+                mb->cap = cap;
+            }
+        }
+        if (err == SCRIBE_OK) {
+            err = scribe_hash_map_add(&mb->index, hash, mb->count, NULL, NULL);
+        }
+        if (err == SCRIBE_OK) {
+            mb->objects[mb->count].bytes = copy;
+            mb->objects[mb->count].len = len;
+            mb->count++;
+        } else {
+            free(copy);
+        }
+    }
+    pthread_mutex_unlock(&mb->mu);
+    return err;
+}
+
+/*
+ * Returns a heap copy of one stored encoding.
+ */
+static scribe_error_t mem_get(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], uint8_t **out,
+                              size_t *out_len) {
+    mem_backend *mb = (mem_backend *)b;
+    mem_object *obj;
+    uint8_t *copy = NULL;
+    size_t len = 0;
+    int used;
+
+    pthread_mutex_lock(&mb->mu);
+    obj = mem_find(mb, hash);
+    used = obj != NULL;
+    if (used) {
+        len = obj->len;
+        copy = (uint8_t *)malloc(len == 0 ? 1u : len);
+        if (copy != NULL && len != 0) {
+            memcpy(copy, obj->bytes, len);
+        }
+    }
+    pthread_mutex_unlock(&mb->mu);
+    if (!used) {
+        return scribe_set_error(SCRIBE_ENOT_FOUND, "object not found");
+    }
+    if (copy == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate object buffer");
+    }
+    *out = copy;
+    *out_len = len;
+    return SCRIBE_OK;
+}
+
+/*
+ * Reports whether an object is stored.
+ */
+static scribe_error_t mem_has(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    mem_backend *mb = (mem_backend *)b;
+    int used;
+
+    pthread_mutex_lock(&mb->mu);
+    used = mem_find(mb, hash) != NULL;
+    pthread_mutex_unlock(&mb->mu);
+    return used ? SCRIBE_OK : scribe_set_error(SCRIBE_ENOT_FOUND, "object not found");
+}
+
+/*
+ * Returns the stored byte size of one object.
+ */
+static scribe_error_t mem_stat(scribe_object_backend *b, const uint8_t hash[SCRIBE_HASH_SIZE], size_t *out_len) {
+    mem_backend *mb = (mem_backend *)b;
+    mem_object *obj;
+
+    pthread_mutex_lock(&mb->mu);
+    obj = mem_find(mb, hash);
+    if (obj != NULL) {
+        *out_len = obj->len;
+    }
+    pthread_mutex_unlock(&mb->mu);
+    return obj != NULL ? SCRIBE_OK : scribe_set_error(SCRIBE_ENOT_FOUND, "object not found");
+}
+
+/*
+ * Visits every stored hash on the calling thread. The hashes are copied out
+ * first so visitors can read or write objects without deadlocking on the table
+ * mutex. There is no I/O to overlap, so `threads` is ignored.
+ */
+static scribe_error_t mem_iter(scribe_object_backend *b, scribe_object_visit_fn visit, void *user, unsigned threads) {
+    mem_backend *mb = (mem_backend *)b;
+    uint8_t *hashes;
+    size_t count = 0;
+    size_t i;
+    scribe_error_t err = SCRIBE_OK;
+
+    (void)threads;
+    pthread_mutex_lock(&mb->mu);
+    hashes = (uint8_t *)malloc((mb->count == 0 ? 1u : mb->count) * SCRIBE_HASH_SIZE);
+    for (i = 0; hashes != NULL && i < mb->index.cap; i++) {
+        if (mb->index.used[i]) {
+            memcpy(hashes + count * SCRIBE_HASH_SIZE, mb->index.keys + i * SCRIBE_HASH_SIZE, SCRIBE_HASH_SIZE);
+            count++;
+        }
+    }
+    pthread_mutex_unlock(&mb->mu);
+    if (hashes == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate object iterator");
+    }
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        err = visit(hashes + i * SCRIBE_HASH_SIZE, user);
+    }
+    free(hashes);
+    return err;
+}
+
+/*
+ * Nothing is persisted, so there is nothing to flush.
+ */
+static scribe_error_t mem_flush(scribe_object_backend *b) {
+    (void)b;
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees every stored object and the engine itself.
+ */
+static void mem_destroy(scribe_object_backend *b) {
+    mem_backend *mb = (mem_backend *)b;
+    size_t i;
+
+    for (i = 0; i < mb->count; i++) {
+        free(mb->objects[i].bytes);
+    }
+    free(mb->objects);
+    scribe_hash_map_destroy(&mb->index);
+    pthread_mutex_destroy(&mb->mu);
+    free(mb);
+}
+
+static const scribe_object_backend_ops mem_ops = {
+    "memory", mem_put, mem_get, mem_has, mem_iter, mem_stat, mem_flush, mem_destroy,
+};
+
+/*
+ * Creates an empty in-memory engine. Install it with
+ * scribe_object_set_backend() right after scribe_open().
+ */
+scribe_error_t scribe_object_backend_mem_new(scribe_object_backend **out) {
+    mem_backend *mb = (mem_backend *)calloc(1, sizeof(*mb));
+
+    if (mb == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate in-memory object engine");
+    }
+    if (pthread_mutex_init(&mb->mu, NULL) != 0) {
+        free(mb);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize in-memory object engine");
+    }
+    mb->base.ops = &mem_ops;
+    *out = &mb->base;
+    return SCRIBE_OK;
+}
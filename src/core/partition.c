@@ -0,0 +1,1101 @@
+/*
+ * Partitioned refs for parallel commit pipelines.
+ *
+ * With `ref_partitioning = database`, the pipe writer commits each database's
+ * share of a batch on its own ref, `refs/partitions/<hex of database name>`,
+ * whose root tree holds only that database. Each partition belongs to one of
+ * `worker_threads` commit workers, so different databases build trees, write
+ * objects, and advance refs in parallel while one database's commits stay in
+ * order. A publisher thread periodically takes the prefix of fully committed
+ * batches and writes one commit per batch on refs/heads/main, in submission
+ * order, each carrying the batch's own metadata and a root that is the
+ * previous one with the batch's databases replaced by their partition
+ * subtrees. The chain is published with one barrier and ref update, so main
+ * always shows whole batches in submission order, every batch is acked with
+ * its own commit on main, and readers never need to know partitions exist.
+ *
+ * Partition refs live only while a writer runs. Closing the writer publishes
+ * what is complete and removes them; the next writer starts each partition
+ * from main, so partition commits are scaffolding that main does not keep.
+ * Refs left behind by a crash are folded into main as one aggregate commit
+ * (published as they are, then removed) by the next writer or direct commit.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/log.h"
+#include "util/queue.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PARTITION_REF_DIR "refs/partitions"
+#define MAIN_REF "refs/heads/main"
+
+typedef struct {
+    char *key;
+    size_t key_len;
+    char *ref;
+    uint8_t seed[SCRIBE_HASH_SIZE];
+    int has_seed;
+    unsigned worker;
+} partition;
+
+typedef struct partition_ticket partition_ticket;
+
+/*
+ * One partition's share of a submitted batch. The events are shallow copies
+ * that point into the caller's batch, which stays alive until it is acked.
+ */
+typedef struct {
+    partition_ticket *ticket;
+    partition *part;
+    scribe_change_batch sub;
+    scribe_change_event *events;
+    uint8_t commit[SCRIBE_HASH_SIZE];
+    int failed;
+} partition_job;
+
+struct partition_ticket {
+    void *batch_user;
+    scribe_change_batch meta;
+    size_t remaining;
+    int failed;
+    partition_job *jobs;
+    size_t job_count;
+    partition_ticket *next;
+};
+
+typedef struct {
+    scribe_partition_writer *w;
+    scribe_spsc_queue queue;
+    pthread_t thread;
+    int started;
+} partition_worker;
+
+struct scribe_partition_writer {
+    scribe_ctx *ctx;
+    scribe_partition_ack_fn ack;
+    void *ack_user;
+    pthread_mutex_t mu;
+    pthread_cond_t wake;
+    partition **parts;
+    size_t part_count;
+    size_t part_cap;
+    partition_worker *workers;
+    unsigned worker_count;
+    partition_ticket *head;
+    partition_ticket *tail;
+    pthread_t publisher;
+    int publisher_started;
+    int stop;
+    scribe_error_t failed;
+    char failed_detail[512];
+};
+
+/*
+ * Builds the ref name of a partition. Keys are hex-encoded so any database
+ * name maps to a safe file name.
+ */
+static char *partition_ref_name(const char *key, size_t key_len) {
+    static const char digits[] = "0123456789abcdef";
+    size_t prefix = strlen(PARTITION_REF_DIR) + 1u;
+    char *ref = (char *)malloc(prefix + key_len * 2u + 1u);
+    size_t i;
+
+    if (ref == NULL) {
+        return NULL;
+    }
+    memcpy(ref, PARTITION_REF_DIR "/", prefix);
+    for (i = 0; i < key_len; i++) {
+        ref[prefix + i * 2u] = digits[(uint8_t)key[i] >> 4];
+        ref[prefix + i * 2u + 1u] = digits[(uint8_t)key[i] & 0x0fu];
+    }
+    ref[prefix + key_len * 2u] = '\0';
+    return ref;
+}
+
+/*
+ * Decodes a partition ref file name back into its key. Returns NULL for names
+ * that are not partition refs, such as leftover temporary files.
+ */
+static char *partition_key_from_name(const char *name, size_t *out_len) {
+    size_t len = strlen(name);
+    char *key;
+    size_t i;
+
+    if (len == 0 || len % 2u != 0 || strspn(name, "0123456789abcdef") != len) {
+        return NULL;
+    }
+    key = (char *)malloc(len / 2u + 1u);
+    if (key == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < len / 2u; i++) {
+        unsigned byte;
+
+        (void)sscanf(name + i * 2u, "%2x", &byte);
+        key[i] = (char)byte;
+    }
+    key[len / 2u] = '\0';
+    *out_len = len / 2u;
+    return key;
+}
+
+/*
+ * Reads a commit and returns its root tree hash.
+ */
+static scribe_error_t commit_root(scribe_ctx *ctx, const uint8_t commit[SCRIBE_HASH_SIZE],
+                                  uint8_t out[SCRIBE_HASH_SIZE]) {
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+    scribe_error_t err;
+
+    err = scribe_object_read(ctx, commit, &obj);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_COMMIT) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "partition ref does not point to a commit");
+    }
+    err = scribe_arena_init(&arena, obj.payload_len + 1024u);
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view);
+        if (err == SCRIBE_OK) {
+            scribe_hash_copy(out, view.root_tree);
+        }
+        scribe_arena_destroy(&arena);
+    }
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Reads the logical entries of main's root tree. A store without commits has
+ * an empty root. The caller destroys the arena, which must start zeroed.
+ */
+static scribe_error_t main_root_entries(scribe_ctx *ctx, scribe_arena *arena, scribe_tree_entry **entries,
+                                        size_t *count) {
+    uint8_t head[SCRIBE_HASH_SIZE];
+    uint8_t root[SCRIBE_HASH_SIZE];
+    scribe_error_t err;
+
+    *entries = NULL;
+    *count = 0;
+    err = scribe_refs_read(ctx, MAIN_REF, head);
+    if (err == SCRIBE_ENOT_FOUND) {
+        scribe_clear_error();
+        return scribe_arena_init(arena, 64u);
+    }
+    if (err == SCRIBE_OK) {
+        err = commit_root(ctx, head, root);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    return scribe_tree_read_logical(ctx, root, arena, entries, count);
+}
+
+/*
+ * Reports whether a tree entry is the top-level entry of a partition key.
+ */
+static int entry_is_key(const scribe_tree_entry *entry, const char *key, size_t key_len) {
+    return entry->name_len == key_len && memcmp(entry->name, key, key_len) == 0;
+}
+
+typedef struct {
+    const char *key;
+    size_t key_len;
+    const uint8_t *tip;
+} aggregate_part;
+
+/*
+ * Replaces the top-level entry of a partition key in `entries` with that
+ * entry of the partition commit `tip`, or removes it when the partition is
+ * empty. The new entry lives in `arena`. `entries` must have room for one
+ * more entry and is left unsorted.
+ */
+static scribe_error_t merge_partition(scribe_ctx *ctx, const char *key, size_t key_len, const uint8_t *tip,
+                                      scribe_arena *arena, scribe_tree_entry *entries, size_t *count) {
+    scribe_tree_entry *part = NULL;
+    size_t part_count = 0;
+    uint8_t root[SCRIBE_HASH_SIZE];
+    size_t i;
+    scribe_error_t err = commit_root(ctx, tip, root);
+
+    if (err == SCRIBE_OK) {
+        err = scribe_tree_read_logical(ctx, root, arena, &part, &part_count);
+    }
+    if (err == SCRIBE_OK && (part_count > 1u || (part_count == 1u && !entry_is_key(&part[0], key, key_len)))) {
+        err = scribe_set_error(SCRIBE_ECORRUPT, "partition '%s' holds entries outside its key", key);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    for (i = 0; i < *count && !entry_is_key(&entries[i], key, key_len); i++) {
+    }
+    if (part_count == 1u) {
+        entries[i] = part[0];
+        *count += i == *count;
+    } else if (i < *count) {
+        entries[i] = entries[--*count];
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Writes an aggregate commit on refs/heads/main: main's root with the
+ * top-level entry of every listed partition replaced by that partition tip's
+ * entry, or removed when the partition is empty. Only folding uses this: the
+ * batches on refs a crashed writer left are no longer known.
+ */
+static scribe_error_t publish_aggregate(scribe_ctx *ctx, const aggregate_part *parts, size_t part_count,
+                                        const scribe_change_batch *meta, uint8_t out[SCRIBE_HASH_SIZE]) {
+    scribe_arena main_arena = {0};
+    scribe_arena *part_arenas;
+    scribe_tree_entry *main_entries = NULL;
+    size_t main_count = 0;
+    scribe_tree_entry *merged = NULL;
+    size_t merged_count = 0;
+    uint8_t root[SCRIBE_HASH_SIZE];
+    size_t i;
+    scribe_error_t err;
+
+    part_arenas = (scribe_arena *)calloc(part_count == 0 ? 1u : part_count, sizeof(*part_arenas));
+    if (part_arenas == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partition aggregate");
+    }
+    err = main_root_entries(ctx, &main_arena, &main_entries, &main_count);
+    if (err == SCRIBE_OK && main_count > SIZE_MAX / sizeof(*merged) - part_count - 1u) {
+        err = scribe_set_error(SCRIBE_ENOMEM, "aggregate root is too large");
+    } else if (err == SCRIBE_OK) {
+        merged = (scribe_tree_entry *)malloc((main_count + part_count + 1u) * sizeof(*merged));
+        if (merged == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate aggregate root");
+        }
+    }
+    for (i = 0; err == SCRIBE_OK && i < main_count; i++) {
+        merged[merged_count++] = main_entries[i];
+    }
+    for (i = 0; err == SCRIBE_OK && i < part_count; i++) {
+        err = merge_partition(ctx, parts[i].key, parts[i].key_len, parts[i].tip, &part_arenas[i], merged,
+                              &merged_count);
+    }
+    if (err == SCRIBE_OK) {
+        qsort(merged, merged_count, sizeof(*merged), scribe_tree_entry_compare);
+        err = scribe_tree_write(ctx, merged, merged_count, root);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_root_ref(ctx, MAIN_REF, root, meta, out);
+    }
+    free(merged);
+    for (i = 0; i < part_count; i++) {
+        scribe_arena_destroy(&part_arenas[i]);
+    }
+    free(part_arenas);
+    scribe_arena_destroy(&main_arena);
+    return err;
+}
+
+/*
+ * Writes main's root with every top-level entry of the tree `snapshot` in
+ * place of main's entry of the same name. When `scope` is set and the
+ * snapshot has no entry of that name, main's entry is removed; every other
+ * entry of main is kept. Daemon-hosted adapter sessions bootstrap through
+ * this, so one session's snapshot replaces only the databases it watches.
+ */
+scribe_error_t scribe_partition_merge_root(scribe_ctx *ctx, const uint8_t snapshot[SCRIBE_HASH_SIZE],
+                                           const char *scope, uint8_t out_root[SCRIBE_HASH_SIZE]) {
+    scribe_arena main_arena = {0};
+    scribe_arena snap_arena = {0};
+    scribe_tree_entry *main_entries = NULL;
+    scribe_tree_entry *snap = NULL;
+    scribe_tree_entry *merged = NULL;
+    size_t main_count = 0;
+    size_t snap_count = 0;
+    size_t merged_count = 0;
+    size_t i = 0;
+    size_t j = 0;
+    scribe_error_t err;
+
+    err = main_root_entries(ctx, &main_arena, &main_entries, &main_count);
+    if (err == SCRIBE_OK) {
+        err = scribe_tree_read_logical(ctx, snapshot, &snap_arena, &snap, &snap_count);
+    }
+    if (err == SCRIBE_OK) {
+        merged = (scribe_tree_entry *)malloc((main_count + snap_count + 1u) * sizeof(*merged));
+        if (merged == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate merged root");
+        }
+    }
+    if (err == SCRIBE_OK) {
+        qsort(main_entries, main_count, sizeof(*main_entries), scribe_tree_entry_compare);
+        qsort(snap, snap_count, sizeof(*snap), scribe_tree_entry_compare);
+        while (i < main_count || j < snap_count) {
+            int cmp = -1;
+
+            if (i == main_count) {
+                cmp = 1;
+            } else if (j < snap_count) {
+                cmp = scribe_tree_entry_compare(&main_entries[i], &snap[j]);
+            }
+
+            if (cmp < 0) {
+                if (scope == NULL || !entry_is_key(&main_entries[i], scope, strlen(scope))) {
+                    merged[merged_count++] = main_entries[i];
+                }
+                i++;
+            } else {
+                merged[merged_count++] = snap[j++];
+                i += cmp == 0;
+            }
+        }
+        err = scribe_tree_write(ctx, merged, merged_count, out_root);
+    }
+    free(merged);
+    scribe_arena_destroy(&snap_arena);
+    scribe_arena_destroy(&main_arena);
+    return err;
+}
+
+/*
+ * Fills the metadata of an aggregate commit. The message lists the partition
+ * tips it publishes so history records where each subtree came from.
+ */
+static scribe_error_t aggregate_metadata(const char *process, int64_t timestamp, const aggregate_part *parts,
+                                         size_t part_count, scribe_change_batch *meta, char **message) {
+    size_t cap = 64u;
+    size_t len;
+    size_t i;
+    char *buf;
+
+    for (i = 0; i < part_count; i++) {
+        cap += parts[i].key_len + SCRIBE_HEX_HASH_SIZE + 16u;
+    }
+    buf = (char *)malloc(cap);
+    if (buf == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate aggregate message");
+    }
+    len = (size_t)snprintf(buf, cap, "publish %zu partition(s)\n", part_count);
+    for (i = 0; i < part_count; i++) {
+        char hex[SCRIBE_HEX_HASH_SIZE + 1];
+
+        scribe_hash_to_hex(parts[i].tip, hex);
+        len += (size_t)snprintf(buf + len, cap - len, "partition %s %s\n", parts[i].key, hex);
+    }
+    memset(meta, 0, sizeof(*meta));
+    meta->author = (scribe_identity){"scribe", "", "scribe"};
+    meta->committer = (scribe_identity){"scribe", "", "scribe"};
+    meta->process = (scribe_process_info){process, SCRIBE_VERSION, "", ""};
+    meta->timestamp_unix_nanos = timestamp;
+    meta->message = buf;
+    meta->message_len = len;
+    *message = buf;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the current time in Unix nanoseconds for fold commits, which have no
+ * batch timestamp to inherit.
+ */
+static int64_t now_nanos(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+typedef struct {
+    scribe_ctx *ctx;
+    aggregate_part *parts;
+    char **keys;
+    char **refs;
+    uint8_t (*tips)[SCRIBE_HASH_SIZE];
+    size_t count;
+    size_t cap;
+    scribe_error_t err;
+} fold_state;
+
+/*
+ * Collects one leftover partition ref for scribe_partition_fold().
+ */
+static scribe_error_t fold_visit(const char *name, void *user) {
+    fold_state *st = (fold_state *)user;
+    size_t key_len = 0;
+    char *key = partition_key_from_name(name, &key_len);
+    char *ref;
+    scribe_error_t err;
+
+    if (key == NULL) {
+        return SCRIBE_OK;
+    }
+    if (st->count == st->cap) {
+        size_t cap = st->cap == 0 ? 8u : st->cap * 2u;
+        aggregate_part *parts = (aggregate_part *)realloc(st->parts, cap * sizeof(*parts));
+        char **keys = parts == NULL ? NULL : (char **)realloc(st->keys, cap * sizeof(*keys));
+        char **refs = keys == NULL ? NULL : (char **)realloc(st->refs, cap * sizeof(*refs));
+        uint8_t(*tips)[SCRIBE_HASH_SIZE] =
+            refs == NULL ? NULL : (uint8_t(*)[SCRIBE_HASH_SIZE])realloc(st->tips, cap * sizeof(*tips));
+
+        if (parts != NULL) {
+            st->parts = parts;
+        }
+        if (keys != NULL) {
+            st->keys = keys;
+        }
+        if (refs != NULL) {
+            st->refs = refs;
+        }
+        if (tips == NULL) {
+            free(key);
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to list partition refs");
+        }
+        st->tips = tips;
+        st->cap = cap;
+    }
+    ref = partition_ref_name(key, key_len);
+    if (ref == NULL) {
+        free(key);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to list partition refs");
+    }
+    err = scribe_refs_read(st->ctx, ref, st->tips[st->count]);
+    if (err != SCRIBE_OK) {
+        free(key);
+        free(ref);
+        return err;
+    }
+    st->keys[st->count] = key;
+    st->refs[st->count] = ref;
+    st->parts[st->count].key = key;
+    st->parts[st->count].key_len = key_len;
+    st->count++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Removes partition ref files. In relaxed durability mode queued values are
+ * published first so none of them can recreate a removed file.
+ */
+static scribe_error_t remove_partition_refs(scribe_ctx *ctx, char **refs, size_t count) {
+    scribe_error_t err = scribe_durability_sync(ctx);
+    size_t i;
+
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        char *path = scribe_path_join(ctx->repo_path, refs[i]);
+
+        if (path == NULL) {
+            return SCRIBE_ENOMEM;
+        }
+        if (unlink(path) != 0 && errno != ENOENT) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to remove partition ref '%s'", refs[i]);
+        }
+        free(path);
+    }
+    return err;
+}
+
+/*
+ * Publishes partition refs left by a writer that did not close cleanly, then
+ * removes them. Every commit on them is published, including the share of a
+ * batch whose other partitions never committed; such batches were never
+ * acknowledged, so their producer resends them. A crash between the aggregate
+ * commit and the removal only repeats the fold. Stores without partition refs
+ * pay one failed opendir().
+ */
+scribe_error_t scribe_partition_fold(scribe_ctx *ctx) {
+    fold_state st;
+    char *dir;
+    scribe_error_t err;
+    size_t i;
+
+    dir = scribe_path_join(ctx->repo_path, PARTITION_REF_DIR);
+    if (dir == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    memset(&st, 0, sizeof(st));
+    st.ctx = ctx;
+    err = scribe_list_dir(dir, fold_visit, &st);
+    free(dir);
+    if (err == SCRIBE_ENOT_FOUND) {
+        scribe_clear_error();
+        err = SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK && st.count != 0) {
+        scribe_change_batch meta;
+        uint8_t commit[SCRIBE_HASH_SIZE];
+        char *message = NULL;
+
+        for (i = 0; i < st.count; i++) {
+            st.parts[i].tip = st.tips[i];
+        }
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "partition", "folding %zu partition ref(s) left by an unclean writer",
+                       st.count);
+        err = aggregate_metadata("partition-fold", now_nanos(), st.parts, st.count, &meta, &message);
+        if (err == SCRIBE_OK) {
+            err = publish_aggregate(ctx, st.parts, st.count, &meta, commit);
+        }
+        free(message);
+        if (err == SCRIBE_OK) {
+            err = remove_partition_refs(ctx, st.refs, st.count);
+        }
+    }
+    for (i = 0; i < st.count; i++) {
+        free(st.keys[i]);
+        free(st.refs[i]);
+    }
+    free(st.parts);
+    free(st.keys);
+    free(st.refs);
+    free(st.tips);
+    return err;
+}
+
+/*
+ * Records the first failure. Error details are thread-local, so the message
+ * is copied for the thread that reports it.
+ */
+static void writer_fail(scribe_partition_writer *w, scribe_error_t err) {
+    pthread_mutex_lock(&w->mu);
+    if (w->failed == SCRIBE_OK) {
+        w->failed = err;
+        snprintf(w->failed_detail, sizeof(w->failed_detail), "%s", scribe_last_error_detail());
+    }
+    pthread_mutex_unlock(&w->mu);
+}
+
+/*
+ * Commit worker: commits its partitions' jobs in queue order until it pops the
+ * NULL stop item. After a failure the remaining jobs are only counted down.
+ */
+static void *worker_main(void *arg) {
+    partition_worker *worker = (partition_worker *)arg;
+    scribe_partition_writer *w = worker->w;
+
+    for (;;) {
+        void *item = NULL;
+        partition_job *job;
+        scribe_error_t err = SCRIBE_OK;
+        int skip;
+
+        if (scribe_spsc_queue_pop(&worker->queue, &item) != SCRIBE_OK || item == NULL) {
+            break;
+        }
+        job = (partition_job *)item;
+        pthread_mutex_lock(&w->mu);
+        skip = w->failed != SCRIBE_OK;
+        pthread_mutex_unlock(&w->mu);
+        if (!skip) {
+            err = scribe_commit_batch_ref(w->ctx, job->part->ref, job->part->has_seed ? job->part->seed : NULL,
+                                          &job->sub, job->commit);
+            if (err != SCRIBE_OK) {
+                writer_fail(w, err);
+            }
+        }
+        pthread_mutex_lock(&w->mu);
+        job->failed = skip || err != SCRIBE_OK;
+        if (job->failed) {
+            job->ticket->failed = 1;
+        }
+        job->ticket->remaining--;
+        pthread_mutex_unlock(&w->mu);
+    }
+    return NULL;
+}
+
+/*
+ * Frees a ticket and its jobs. The caller's batch is released through the ack
+ * callback, not here.
+ */
+static void ticket_free(partition_ticket *t) {
+    size_t i;
+
+    for (i = 0; i < t->job_count; i++) {
+        free(t->jobs[i].events);
+    }
+    free(t->jobs);
+    free(t);
+}
+
+/*
+ * Writes one commit on refs/heads/main for each of `count` ready batches, in
+ * order. Batch i's root is batch i-1's root (main's for the first) with the
+ * databases of its jobs replaced by the partition commits those jobs made, so
+ * each commit shows exactly the batch's changes under its own metadata. The
+ * chain is published with one barrier and ref update.
+ */
+static scribe_error_t publish_batches(scribe_ctx *ctx, partition_ticket *ready, size_t count,
+                                      uint8_t (*commits)[SCRIBE_HASH_SIZE]) {
+    scribe_arena main_arena = {0};
+    scribe_arena *job_arenas = NULL;
+    scribe_tree_entry *merged = NULL;
+    size_t merged_count = 0;
+    scribe_tree_entry *main_entries = NULL;
+    size_t main_count = 0;
+    uint8_t (*roots)[SCRIBE_HASH_SIZE];
+    const scribe_change_batch **metas;
+    partition_ticket *t;
+    size_t jobs = 0;
+    size_t arena = 0;
+    size_t b;
+    size_t i;
+    scribe_error_t err;
+
+    for (t = ready; t != NULL; t = t->next) {
+        jobs += t->job_count;
+    }
+    roots = (uint8_t(*)[SCRIBE_HASH_SIZE])malloc(count * sizeof(*roots));
+    metas = (const scribe_change_batch **)malloc(count * sizeof(*metas));
+    job_arenas = (scribe_arena *)calloc(jobs == 0 ? 1u : jobs, sizeof(*job_arenas));
+    err = roots == NULL || metas == NULL || job_arenas == NULL
+              ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partition publication")
+              : main_root_entries(ctx, &main_arena, &main_entries, &main_count);
+    if (err == SCRIBE_OK && main_count > SIZE_MAX / sizeof(*merged) - jobs - 1u) {
+        err = scribe_set_error(SCRIBE_ENOMEM, "published root is too large");
+    } else if (err == SCRIBE_OK) {
+        merged = (scribe_tree_entry *)malloc((main_count + jobs + 1u) * sizeof(*merged));
+        if (merged == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate published root");
+        }
+    }
+    for (i = 0; err == SCRIBE_OK && i < main_count; i++) {
+        merged[merged_count++] = main_entries[i];
+    }
+    for (t = ready, b = 0; err == SCRIBE_OK && t != NULL; t = t->next, b++) {
+        for (i = 0; err == SCRIBE_OK && i < t->job_count; i++) {
+            const partition *part = t->jobs[i].part;
+
+            err = merge_partition(ctx, part->key, part->key_len, t->jobs[i].commit, &job_arenas[arena++], merged,
+                                  &merged_count);
+        }
+        if (err == SCRIBE_OK) {
+            qsort(merged, merged_count, sizeof(*merged), scribe_tree_entry_compare);
+            err = scribe_tree_write(ctx, merged, merged_count, roots[b]);
+        }
+        metas[b] = &t->meta;
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_commit_root_chain(ctx, MAIN_REF, (const uint8_t(*)[SCRIBE_HASH_SIZE])roots, metas, count,
+                                       commits);
+    }
+    for (i = 0; job_arenas != NULL && i < jobs; i++) {
+        scribe_arena_destroy(&job_arenas[i]);
+    }
+    free(job_arenas);
+    free(merged);
+    free(metas);
+    free(roots);
+    scribe_arena_destroy(&main_arena);
+    return err;
+}
+
+/*
+ * Publishes the longest prefix of submitted batches whose jobs have all
+ * committed, one commit per batch, and acks each batch with its own commit.
+ * Called by the publisher thread and once more by close.
+ */
+static scribe_error_t publish_ready(scribe_partition_writer *w) {
+    partition_ticket *ready = NULL;
+    partition_ticket *last = NULL;
+    partition_ticket *t;
+    uint8_t (*commits)[SCRIBE_HASH_SIZE] = NULL;
+    size_t batches = 0;
+    size_t i;
+    scribe_error_t err = SCRIBE_OK;
+
+    pthread_mutex_lock(&w->mu);
+    while (w->head != NULL && w->head->remaining == 0 && !w->head->failed) {
+        t = w->head;
+        w->head = t->next;
+        if (w->head == NULL) {
+            w->tail = NULL;
+        }
+        t->next = NULL;
+        if (last == NULL) {
+            ready = t;
+        } else {
+            last->next = t;
+        }
+        last = t;
+        batches++;
+    }
+    pthread_mutex_unlock(&w->mu);
+    if (ready == NULL) {
+        return SCRIBE_OK;
+    }
+    commits = (uint8_t(*)[SCRIBE_HASH_SIZE])malloc(batches * sizeof(*commits));
+    err = commits == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partition publication")
+                          : publish_batches(w->ctx, ready, batches, commits);
+    if (err == SCRIBE_OK) {
+        scribe_log_msg(w->ctx, SCRIBE_LOG_DEBUG, "partition", "published %zu batch(es)", batches);
+    } else {
+        writer_fail(w, err);
+    }
+    for (i = 0; ready != NULL; i++) {
+        t = ready;
+        ready = t->next;
+        w->ack(w->ack_user, t->batch_user, err == SCRIBE_OK ? commits[i] : NULL);
+        ticket_free(t);
+    }
+    free(commits);
+    return err;
+}
+
+/*
+ * Publisher thread: publishes every `partition_publish_ms` until close.
+ */
+static void *publisher_main(void *arg) {
+    scribe_partition_writer *w = (scribe_partition_writer *)arg;
+    int interval = w->ctx->config.partition_publish_ms;
+
+    pthread_mutex_lock(&w->mu);
+    while (!w->stop) {
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += interval / 1000;
+        deadline.tv_nsec += (long)(interval % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!w->stop && pthread_cond_timedwait(&w->wake, &w->mu, &deadline) != ETIMEDOUT) {
+        }
+        if (w->stop) {
+            break;
+        }
+        pthread_mutex_unlock(&w->mu);
+        (void)publish_ready(w);
+        pthread_mutex_lock(&w->mu);
+    }
+    pthread_mutex_unlock(&w->mu);
+    return NULL;
+}
+
+/*
+ * Finds or creates the partition for a key. New partitions start from main's
+ * current entry for the key: the writer is the only one advancing main, and
+ * main already reflects everything published before the partition existed.
+ * Only the submitting thread creates partitions.
+ */
+static scribe_error_t find_partition(scribe_partition_writer *w, const char *key, size_t key_len, partition **out) {
+    scribe_arena arena = {0};
+    scribe_tree_entry *entries = NULL;
+    size_t count = 0;
+    partition *p;
+    size_t i;
+    scribe_error_t err;
+
+    for (i = 0; i < w->part_count; i++) {
+        if (w->parts[i]->key_len == key_len && memcmp(w->parts[i]->key, key, key_len) == 0) {
+            *out = w->parts[i];
+            return SCRIBE_OK;
+        }
+    }
+    p = (partition *)calloc(1, sizeof(*p));
+    if (p == NULL || (p->key = strndup(key, key_len)) == NULL || (p->ref = partition_ref_name(key, key_len)) == NULL) {
+        if (p != NULL) {
+            free(p->key);
+        }
+        free(p);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partition");
+    }
+    p->key_len = key_len;
+    p->worker = (unsigned)(w->part_count % w->worker_count);
+    err = main_root_entries(w->ctx, &arena, &entries, &count);
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        if (entry_is_key(&entries[i], key, key_len)) {
+            err = scribe_tree_write(w->ctx, &entries[i], 1, p->seed);
+            p->has_seed = err == SCRIBE_OK;
+            break;
+        }
+    }
+    scribe_arena_destroy(&arena);
+    if (err == SCRIBE_OK && w->part_count == w->part_cap) {
+        size_t cap = w->part_cap == 0 ? 8u : w->part_cap * 2u;
+        partition **parts = (partition **)realloc(w->parts, cap * sizeof(*parts));
+
+        if (parts == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to grow partition table");
+        } else {
+            pthread_mutex_lock(&w->mu);
+            w->parts = parts;
+            w->part_cap = cap;
+            pthread_mutex_unlock(&w->mu);
+        }
+    }
+    if (err != SCRIBE_OK) {
+        free(p->ref);
+        free(p->key);
+        free(p);
+        return err;
+    }
+    pthread_mutex_lock(&w->mu);
+    w->parts[w->part_count++] = p;
+    pthread_mutex_unlock(&w->mu);
+    *out = p;
+    return SCRIBE_OK;
+}
+
+/*
+ * Opens a partitioned writer on a writable context: folds leftover partition
+ * refs, then starts the commit workers and the publisher. `ack` is called from
+ * the publisher (or from close) once per submitted batch, in submission order,
+ * with the batch's own commit on main, or with NULL when the batch was
+ * dropped after a failure.
+ */
+scribe_error_t scribe_partition_writer_open(scribe_ctx *ctx, scribe_partition_ack_fn ack, void *ack_user,
+                                            scribe_partition_writer **out) {
+    scribe_partition_writer *w;
+    char *dir;
+    unsigned i;
+    scribe_error_t err;
+
+    if (ctx == NULL || !ctx->writable || ack == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "writable context required");
+    }
+    err = scribe_partition_fold(ctx);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    dir = scribe_path_join(ctx->repo_path, PARTITION_REF_DIR);
+    err = dir == NULL ? SCRIBE_ENOMEM : scribe_mkdir_p(dir);
+    free(dir);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    w = (scribe_partition_writer *)calloc(1, sizeof(*w));
+    if (w == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partitioned writer");
+    }
+    w->ctx = ctx;
+    w->ack = ack;
+    w->ack_user = ack_user;
+    w->worker_count = scribe_worker_count(ctx);
+    w->workers = (partition_worker *)calloc(w->worker_count, sizeof(*w->workers));
+    if (w->workers == NULL || pthread_mutex_init(&w->mu, NULL) != 0) {
+        free(w->workers);
+        free(w);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partitioned writer");
+    }
+    if (pthread_cond_init(&w->wake, NULL) != 0) {
+        pthread_mutex_destroy(&w->mu);
+        free(w->workers);
+        free(w);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize partitioned writer");
+    }
+    *out = w;
+    for (i = 0; i < w->worker_count; i++) {
+        partition_worker *worker = &w->workers[i];
+
+        worker->w = w;
+        err = scribe_spsc_queue_init(&worker->queue, ctx->config.event_queue_capacity,
+                                     ctx->config.queue_stall_warn_seconds);
+        if (err != SCRIBE_OK) {
+            break;
+        }
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            scribe_spsc_queue_destroy(&worker->queue);
+            err = scribe_set_error(SCRIBE_ERR, "failed to start partition worker");
+            break;
+        }
+        scribe_worker_pin(ctx, worker->thread, (unsigned)i);
+        worker->started = 1;
+    }
+    if (err == SCRIBE_OK) {
+        if (pthread_create(&w->publisher, NULL, publisher_main, w) != 0) {
+            err = scribe_set_error(SCRIBE_ERR, "failed to start partition publisher");
+        } else {
+            w->publisher_started = 1;
+        }
+    }
+    if (err != SCRIBE_OK) {
+        w->worker_count = i;
+        (void)scribe_partition_writer_close(w);
+        *out = NULL;
+    }
+    return err;
+}
+
+/*
+ * Splits a batch by its first path component and queues one job per
+ * partition. An accepted batch must stay valid until its ack. On error the
+ * batch was not accepted and is never acked; this includes the writer's first
+ * failure, so the caller stops submitting.
+ */
+scribe_error_t scribe_partition_submit(scribe_partition_writer *w, const scribe_change_batch *batch,
+                                       void *batch_user) {
+    partition_ticket *t;
+    partition **owner = NULL;
+    size_t i;
+    size_t j;
+    scribe_error_t err;
+
+    err = scribe_commit_validate_batch(batch);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    pthread_mutex_lock(&w->mu);
+    err = w->failed;
+    if (err != SCRIBE_OK) {
+        (void)scribe_set_error(err, "%s", w->failed_detail);
+    }
+    pthread_mutex_unlock(&w->mu);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    t = (partition_ticket *)calloc(1, sizeof(*t));
+    if (t == NULL || (batch->event_count != 0 &&
+                      (owner = (partition **)malloc(batch->event_count * sizeof(*owner))) == NULL)) {
+        free(t);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partition ticket");
+    }
+    t->batch_user = batch_user;
+    t->meta = *batch;
+    t->meta.events = NULL;
+    t->meta.event_count = 0;
+    for (i = 0; err == SCRIBE_OK && i < batch->event_count; i++) {
+        const char *key = batch->events[i].path[0];
+
+        err = find_partition(w, key, strlen(key), &owner[i]);
+        for (j = 0; err == SCRIBE_OK && j < t->job_count && t->jobs[j].part != owner[i]; j++) {
+        }
+        if (err == SCRIBE_OK && j == t->job_count) {
+            partition_job *jobs = (partition_job *)realloc(t->jobs, (t->job_count + 1u) * sizeof(*jobs));
+
+            if (jobs == NULL) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partition job");
+                break;
+            }
+            t->jobs = jobs;
+            memset(&t->jobs[t->job_count], 0, sizeof(t->jobs[0]));
+            t->jobs[t->job_count].ticket = t;
+            t->jobs[t->job_count].part = owner[i];
+            t->jobs[t->job_count].sub = *batch;
+            t->jobs[t->job_count].sub.events = NULL;
+            t->jobs[t->job_count].sub.event_count = 0;
+            t->job_count++;
+        }
+    }
+    for (j = 0; err == SCRIBE_OK && j < t->job_count; j++) {
+        partition_job *job = &t->jobs[j];
+        size_t n = 0;
+
+        for (i = 0; i < batch->event_count; i++) {
+            n += owner[i] == job->part;
+        }
+        job->events = (scribe_change_event *)malloc(n * sizeof(*job->events));
+        if (job->events == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate partition job");
+            break;
+        }
+        for (i = 0; i < batch->event_count; i++) {
+            if (owner[i] == job->part) {
+                job->events[job->sub.event_count++] = batch->events[i];
+            }
+        }
+        job->sub.events = job->events;
+    }
+    free(owner);
+    if (err != SCRIBE_OK) {
+        ticket_free(t);
+        return err;
+    }
+    t->remaining = t->job_count;
+    pthread_mutex_lock(&w->mu);
+    if (w->tail == NULL) {
+        w->head = t;
+    } else {
+        w->tail->next = t;
+    }
+    w->tail = t;
+    pthread_mutex_unlock(&w->mu);
+    for (j = 0; j < t->job_count; j++) {
+        err = scribe_spsc_queue_push(&w->workers[t->jobs[j].part->worker].queue, &t->jobs[j]);
+        if (err != SCRIBE_OK) {
+            /*
+             * The ticket is already queued for acking, so the failure is
+             * reported by the next submit or by close, and close drops it.
+             */
+            writer_fail(w, err);
+            pthread_mutex_lock(&w->mu);
+            t->failed = 1;
+            t->remaining -= t->job_count - j;
+            pthread_mutex_unlock(&w->mu);
+            break;
+        }
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Stops the workers after they drain their queues, stops the publisher,
+ * publishes what is complete, drops the rest, and removes the partition refs.
+ * Returns the first failure of the writer's lifetime.
+ */
+scribe_error_t scribe_partition_writer_close(scribe_partition_writer *w) {
+    scribe_ctx *ctx;
+    char **refs = NULL;
+    partition_ticket *t;
+    unsigned i;
+    size_t k;
+    scribe_error_t err;
+
+    if (w == NULL) {
+        return SCRIBE_OK;
+    }
+    ctx = w->ctx;
+    for (i = 0; i < w->worker_count; i++) {
+        if (w->workers[i].started) {
+            (void)scribe_spsc_queue_push(&w->workers[i].queue, NULL);
+            pthread_join(w->workers[i].thread, NULL);
+            scribe_spsc_queue_destroy(&w->workers[i].queue);
+        }
+    }
+    if (w->publisher_started) {
+        pthread_mutex_lock(&w->mu);
+        w->stop = 1;
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->mu);
+        pthread_join(w->publisher, NULL);
+    }
+    (void)publish_ready(w);
+    while (w->head != NULL) {
+        t = w->head;
+        w->head = t->next;
+        w->ack(w->ack_user, t->batch_user, NULL);
+        ticket_free(t);
+    }
+    refs = (char **)malloc((w->part_count == 0 ? 1u : w->part_count) * sizeof(*refs));
+    for (k = 0; refs != NULL && k < w->part_count; k++) {
+        refs[k] = w->parts[k]->ref;
+    }
+    err = refs == NULL ? scribe_set_error(SCRIBE_ENOMEM, "failed to list partition refs")
+                       : remove_partition_refs(ctx, refs, w->part_count);
+    free(refs);
+    if (err != SCRIBE_OK) {
+        writer_fail(w, err);
+    }
+    err = w->failed;
+    if (err != SCRIBE_OK) {
+        (void)scribe_set_error(err, "%s", w->failed_detail);
+    }
+    for (k = 0; k < w->part_count; k++) {
+        free(w->parts[k]->key);
+        free(w->parts[k]->ref);
+        free(w->parts[k]);
+    }
+    free(w->parts);
+    free(w->workers);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->mu);
+    free(w);
+    return err;
+}
@@ -4,7 +4,9 @@
  * `scribe commit-batch` reads a hybrid text/binary stream from stdin, turns each
  * BATCH frame into a scribe_change_batch, sends it through the configured SPSC
  * queue path, and writes an OK/ERR protocol response. The parser owns all heap
- * memory for a parsed batch and frees it after the commit attempt.
+ * memory for a parsed batch and frees it after the commit attempt. With
+ * `ref_partitioning = database` batches go to the partitioned writer instead,
+ * and each OK line is written once the batch's own commit is published on main.
  */
 #include "core/internal.h"
 
@@ -106,18 +108,23 @@ static scribe_error_t read_exact(FILE *in, uint8_t *buf, size_t len) {
 /*
  * Frees every allocation owned by a parsed batch. It also frees partially parsed
  * batches, so parse_one_batch() can use one cleanup path after any error.
+ * Database and collection components are interned in the context and are not
+ * freed.
  */
-static void free_batch(scribe_change_batch *batch) {
+void scribe_pipe_free_batch(scribe_change_batch *batch) {
     size_t i;
 
     if (batch == NULL) {
         return;
     }
     for (i = 0; i < batch->event_count; i++) {
-        size_t j;
         scribe_change_event *ev = (scribe_change_event *)&batch->events[i];
-        for (j = 0; j < ev->path_len; j++) {
-            free((void *)ev->path[j]);
+        size_t j;
+
+        for (j = 0; ev->path != NULL && j < ev->path_len; j++) {
+            if (j >= SCRIBE_INTERN_DEPTH || j + 1u == ev->path_len) {
+                free((void *)ev->path[j]);
+            }
         }
         free((void *)ev->path);
         free((void *)ev->payload);
@@ -169,9 +176,10 @@ static scribe_error_t parse_process(char **parts, scribe_process_info *process)
 /*
  * Parses one complete BATCH frame after the caller has already read the BATCH
  * line. The resulting batch owns heap memory for identities, process metadata,
- * message bytes, paths, and payload bytes.
+ * message bytes, path components, and payload bytes; database and collection
+ * components repeat across events and are interned in ctx instead.
  */
-static scribe_error_t parse_one_batch(FILE *in, char *first_line, scribe_change_batch *batch) {
+static scribe_error_t parse_one_batch(scribe_ctx *ctx, FILE *in, char *first_line, scribe_change_batch *batch) {
     char *line = NULL;
     size_t cap = 0;
     char *parts[5] = {0};
@@ -302,6 +310,13 @@ static scribe_error_t parse_one_batch(FILE *in, char *first_line, scribe_change_
             if ((err = read_line(in, &line, &cap)) != SCRIBE_OK) {
                 goto done;
             }
+            if (j < SCRIBE_INTERN_DEPTH && j + 1u < depth) {
+                if ((err = scribe_intern(ctx, line, strlen(line), &((const char **)batch->events[i].path)[j],
+                                         NULL)) != SCRIBE_OK) {
+                    goto done;
+                }
+                continue;
+            }
             ((const char **)batch->events[i].path)[j] = strdup(line);
             if (batch->events[i].path[j] == NULL) {
                 err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate path component");
@@ -339,17 +354,33 @@ static scribe_error_t parse_one_batch(FILE *in, char *first_line, scribe_change_
 done:
     free(line);
     if (err != SCRIBE_OK) {
-        free_batch(batch);
+        scribe_pipe_free_batch(batch);
         memset(batch, 0, sizeof(*batch));
     }
     return err;
 }
 
+/*
+ * Reads the next BATCH frame from a pipe stream, skipping blank lines between
+ * frames. `line` and `cap` are the caller's getline() buffer, reused across
+ * calls. Returns SCRIBE_ENOT_FOUND without setting an error at end of stream.
+ */
+scribe_error_t scribe_pipe_next_batch(scribe_ctx *ctx, FILE *in, char **line, size_t *cap,
+                                      scribe_change_batch *batch) {
+    while (getline(line, cap, in) >= 0) {
+        strip_lf(*line);
+        if ((*line)[0] != '\0') {
+            return parse_one_batch(ctx, in, *line, batch);
+        }
+    }
+    return SCRIBE_ENOT_FOUND;
+}
+
 /*
  * Writes the pipe ERR response for a failed frame. The detail length is printed
  * before the detail bytes so a caller can parse diagnostics without guessing.
  */
-static void write_error(FILE *out, scribe_error_t err) {
+void scribe_pipe_write_error(FILE *out, scribe_error_t err) {
     const char *detail = scribe_last_error_detail();
     size_t len = strlen(detail);
     fprintf(out, "ERR\t%s\t%zu\n", scribe_error_symbol(err), len);
@@ -360,10 +391,26 @@ static void write_error(FILE *out, scribe_error_t err) {
     fflush(out);
 }
 
+/*
+ * Returns the payload bytes a parsed batch holds in memory. The pipe reserves
+ * this amount against the context memory budget while the batch is queued.
+ */
+size_t scribe_pipe_batch_bytes(const scribe_change_batch *batch) {
+    size_t total = 0;
+
+    for (size_t i = 0; i < batch->event_count; i++) {
+        size_t len = batch->events[i].payload_len;
+        total = len > SIZE_MAX - total ? SIZE_MAX : total + len;
+    }
+    return total;
+}
+
 /*
  * Sends a parsed batch through the SPSC queue before committing it. This keeps
  * the CLI path exercising the same queue abstraction used by library/adapter
- * integrations instead of bypassing it with a direct commit call.
+ * integrations instead of bypassing it with a direct commit call. The batch's
+ * payload bytes stay reserved against the memory budget until the commit
+ * attempt finishes.
  */
 static scribe_error_t commit_via_queue(scribe_ctx *ctx, scribe_change_batch *batch,
                                        uint8_t commit_hash[SCRIBE_HASH_SIZE]) {
@@ -375,11 +422,17 @@ static scribe_error_t commit_via_queue(scribe_ctx *ctx, scribe_change_batch *bat
      */
     scribe_spsc_queue q;
     void *dequeued = NULL;
+    size_t reserved = scribe_pipe_batch_bytes(batch);
     scribe_error_t err =
         scribe_spsc_queue_init(&q, ctx->config.event_queue_capacity, ctx->config.queue_stall_warn_seconds);
     if (err != SCRIBE_OK) {
         return err;
     }
+    err = scribe_mem_reserve(&ctx->mem, reserved);
+    if (err != SCRIBE_OK) {
+        scribe_spsc_queue_destroy(&q);
+        return err;
+    }
     err = scribe_spsc_queue_push(&q, batch);
     if (err == SCRIBE_OK) {
         err = scribe_spsc_queue_pop(&q, &dequeued);
@@ -387,10 +440,111 @@ static scribe_error_t commit_via_queue(scribe_ctx *ctx, scribe_change_batch *bat
     if (err == SCRIBE_OK) {
         err = scribe_commit_batch(ctx, (scribe_change_batch *)dequeued, commit_hash);
     }
+    scribe_mem_release(&ctx->mem, reserved);
     scribe_spsc_queue_destroy(&q);
     return err;
 }
 
+/*
+ * A batch handed to the partitioned writer, with its memory reservation. It is
+ * freed by the writer's ack callback.
+ */
+typedef struct {
+    scribe_change_batch batch;
+    size_t reserved;
+} pipe_pending_batch;
+
+typedef struct {
+    scribe_ctx *ctx;
+    FILE *out;
+} pipe_ack_state;
+
+/*
+ * Partitioned writer ack: writes the OK line of a published batch and frees
+ * it. Acks arrive in submission order from a single thread at a time, so the
+ * output needs no locking.
+ */
+static void pipe_ack(void *user, void *batch_user, const uint8_t *commit_hash) {
+    pipe_ack_state *st = (pipe_ack_state *)user;
+    pipe_pending_batch *pending = (pipe_pending_batch *)batch_user;
+
+    if (commit_hash != NULL) {
+        char hex[SCRIBE_HEX_HASH_SIZE + 1];
+
+        scribe_hash_to_hex(commit_hash, hex);
+        fprintf(st->out, "OK\t%s\n", hex);
+        fflush(st->out);
+    }
+    scribe_mem_release(&st->ctx->mem, pending->reserved);
+    scribe_pipe_free_batch(&pending->batch);
+    free(pending);
+}
+
+/*
+ * Pipe loop for partitioned refs. Batches are submitted without waiting for
+ * their commits; the writer acks them in order as it publishes their commits
+ * on main. An ERR line is written only after the writer has closed, so it always
+ * follows every OK line it can still produce.
+ */
+static scribe_error_t pipe_commit_partitioned(scribe_ctx *ctx, FILE *in, FILE *out) {
+    pipe_ack_state st = {ctx, out};
+    scribe_partition_writer *w = NULL;
+    char *line = NULL;
+    size_t cap = 0;
+    char detail[512];
+    scribe_error_t err;
+    scribe_error_t close_err;
+
+    err = scribe_partition_writer_open(ctx, pipe_ack, &st, &w);
+    if (err != SCRIBE_OK) {
+        scribe_pipe_write_error(out, err);
+        return err;
+    }
+    while (err == SCRIBE_OK) {
+        pipe_pending_batch *pending = (pipe_pending_batch *)calloc(1, sizeof(*pending));
+
+        if (pending == NULL) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate batch");
+            break;
+        }
+        err = scribe_pipe_next_batch(ctx, in, &line, &cap, &pending->batch);
+        if (err != SCRIBE_OK) {
+            free(pending);
+            if (err == SCRIBE_ENOT_FOUND) {
+                err = SCRIBE_OK;
+            }
+            break;
+        }
+        pending->reserved = scribe_pipe_batch_bytes(&pending->batch);
+        err = scribe_mem_reserve(&ctx->mem, pending->reserved);
+        if (err != SCRIBE_OK) {
+            scribe_pipe_free_batch(&pending->batch);
+            free(pending);
+            break;
+        }
+        err = scribe_partition_submit(w, &pending->batch, pending);
+        if (err != SCRIBE_OK) {
+            /* A rejected batch was never queued, so it is not acked either. */
+            pipe_ack(&st, pending, NULL);
+        }
+    }
+    free(line);
+    if (err != SCRIBE_OK) {
+        /* Closing publishes and may replace this thread's error detail. */
+        snprintf(detail, sizeof(detail), "%s", scribe_last_error_detail());
+    }
+    close_err = scribe_partition_writer_close(w);
+    if (err != SCRIBE_OK) {
+        (void)scribe_set_error(err, "%s", detail);
+    } else {
+        err = close_err;
+    }
+    if (err != SCRIBE_OK) {
+        scribe_pipe_write_error(out, err);
+    }
+    return err;
+}
+
 /*
  * Reads zero or more BATCH frames from stdin and commits each valid frame. A
  * malformed frame stops the stream immediately because the remaining bytes may
@@ -400,35 +554,36 @@ scribe_error_t scribe_pipe_commit_batch(scribe_ctx *ctx, FILE *in, FILE *out) {
     char *line = NULL;
     size_t cap = 0;
 
+    if (ctx->config.ref_partitioning == SCRIBE_REF_PARTITIONING_DATABASE) {
+        return pipe_commit_partitioned(ctx, in, out);
+    }
     /*
      * Accept multiple BATCH frames on one stdin stream. Each successful frame
      * commits independently and emits its own OK line. The first malformed frame
      * emits ERR and stops; continuing after malformed framing would risk reading
      * binary payload bytes as protocol lines.
      */
-    while (getline(&line, &cap, in) >= 0) {
+    for (;;) {
         scribe_change_batch batch;
         uint8_t commit_hash[SCRIBE_HASH_SIZE];
         char hex[SCRIBE_HEX_HASH_SIZE + 1];
-        scribe_error_t err;
+        scribe_error_t err = scribe_pipe_next_batch(ctx, in, &line, &cap, &batch);
 
-        strip_lf(line);
-        if (line[0] == '\0') {
-            continue;
+        if (err == SCRIBE_ENOT_FOUND) {
+            break;
         }
-        err = parse_one_batch(in, line, &batch);
         if (err == SCRIBE_OK) {
             err = commit_via_queue(ctx, &batch, commit_hash);
         }
         if (err != SCRIBE_OK) {
-            write_error(out, err);
+            scribe_pipe_write_error(out, err);
             free(line);
             return err;
         }
         scribe_hash_to_hex(commit_hash, hex);
         fprintf(out, "OK\t%s\n", hex);
         fflush(out);
-        free_batch(&batch);
+        scribe_pipe_free_batch(&batch);
     }
     free(line);
     return SCRIBE_OK;
@@ -83,8 +83,10 @@ void scribe_unlock_repo(scribe_ctx *ctx) {
 static char *ref_path(scribe_ctx *ctx, const char *name) { return scribe_path_join(ctx->repo_path, name); }
 
 /*
- * Reads a direct hash ref from disk and parses its canonical 64-hex-plus-newline
- * format. Malformed refs are reported as corruption because they break history.
+ * Reads a direct hash ref and parses its canonical 64-hex-plus-newline format.
+ * A value still waiting for the relaxed-mode syncer wins over the file, so a
+ * writer always sees its own commits. Malformed refs are reported as
+ * corruption because they break history.
  */
 scribe_error_t scribe_refs_read(scribe_ctx *ctx, const char *name, uint8_t out[SCRIBE_HASH_SIZE]) {
     char *path;
@@ -93,6 +95,9 @@ scribe_error_t scribe_refs_read(scribe_ctx *ctx, const char *name, uint8_t out[S
     char hex[SCRIBE_HEX_HASH_SIZE + 1];
     scribe_error_t err;
 
+    if (scribe_durability_pending_ref(ctx, name, out)) {
+        return SCRIBE_OK;
+    }
     path = ref_path(ctx, name);
     if (path == NULL) {
         return SCRIBE_ENOMEM;
@@ -120,13 +125,12 @@ scribe_error_t scribe_refs_read(scribe_ctx *ctx, const char *name, uint8_t out[S
 /*
  * Atomically publishes a new ref value if the current value still matches the
  * expected parent hash. Passing expected == NULL means the ref must not exist,
- * which is how the first commit creates refs/heads/main.
+ * which is how the first commit creates refs/heads/main. In relaxed durability
+ * mode the new value is queued for the syncer instead of written here.
  */
 scribe_error_t scribe_refs_cas(scribe_ctx *ctx, const char *name, const uint8_t *expected,
                                const uint8_t new_hash[SCRIBE_HASH_SIZE]) {
     uint8_t current[SCRIBE_HASH_SIZE];
-    char hex[SCRIBE_HEX_HASH_SIZE + 2];
-    char *path;
     scribe_error_t err;
 
     /*
@@ -148,12 +152,26 @@ scribe_error_t scribe_refs_cas(scribe_ctx *ctx, const char *name, const uint8_t
             return scribe_set_error(SCRIBE_EREF_STALE, "ref '%s' changed", name);
         }
     }
+    if (scribe_durability_deferred(ctx)) {
+        return scribe_durability_defer_ref(ctx, name, new_hash);
+    }
+    return scribe_refs_write(ctx, name, new_hash);
+}
+
+/*
+ * Writes a ref file durably without comparing its old value. Used behind the
+ * CAS check and by the relaxed-mode syncer, which owns the pending value.
+ */
+scribe_error_t scribe_refs_write(scribe_ctx *ctx, const char *name, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    char hex[SCRIBE_HEX_HASH_SIZE + 2];
+    char *path;
+    scribe_error_t err;
 
     path = ref_path(ctx, name);
     if (path == NULL) {
         return SCRIBE_ENOMEM;
     }
-    scribe_hash_to_hex(new_hash, hex);
+    scribe_hash_to_hex(hash, hex);
     hex[SCRIBE_HEX_HASH_SIZE] = '\n';
     hex[SCRIBE_HEX_HASH_SIZE + 1u] = '\0';
     err = scribe_write_file_atomic(path, (const uint8_t *)hex, SCRIBE_HEX_HASH_SIZE + 1u);
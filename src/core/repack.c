@@ -0,0 +1,218 @@
+/*
+ * Object store maintenance.
+ *
+ * `scribe repack` recompresses the objects that were written at the adaptive
+ * fast level while producers were backlogged (see object.c). Hashes cover the
+ * uncompressed envelope, so recompression replaces the stored encoding through
+ * the object engine without changing any object identity.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/log.h"
+
+#include "zstd.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Recompresses one listed object with the configured repack context and
+ * replaces the stored encoding only when the result is smaller. A listed object that no
+ * longer exists is skipped.
+ */
+static scribe_error_t repack_one(scribe_ctx *ctx, ZSTD_CCtx *cctx, const uint8_t hash[SCRIBE_HASH_SIZE],
+                                 scribe_repack_stats *stats) {
+    scribe_object obj;
+    size_t before;
+    size_t bound;
+    size_t after;
+    uint8_t *compressed;
+    scribe_error_t err;
+
+    err = scribe_object_compressed_size(ctx, hash, &before);
+    if (err == SCRIBE_ENOT_FOUND) {
+        return SCRIBE_OK;
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_object_read(ctx, hash, &obj);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    bound = ZSTD_compressBound(obj.envelope_len);
+    compressed = (uint8_t *)malloc(bound);
+    if (compressed == NULL) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate compressed object");
+    }
+    after = ZSTD_compress2(cctx, compressed, bound, obj.envelope, obj.envelope_len);
+    scribe_object_free(&obj);
+    if (ZSTD_isError(after)) {
+        free(compressed);
+        return scribe_set_error(SCRIBE_EIO, "zstd compression failed: %s", ZSTD_getErrorName(after));
+    }
+    stats->bytes_before += before;
+    if (after >= before) {
+        stats->bytes_after += before;
+        free(compressed);
+        return SCRIBE_OK;
+    }
+    err = ctx->objects->ops->put(ctx->objects, hash, compressed, after, SCRIBE_OBJECT_PUT_REPLACE);
+    free(compressed);
+    if (err == SCRIBE_OK) {
+        stats->recompressed++;
+        stats->bytes_after += after;
+    }
+    return err;
+}
+
+/*
+ * Recompresses every object listed in `objects/info/fast-objects` at
+ * `repack_compression_level` with long-distance matching, then removes the
+ * list. Hashes cover the uncompressed envelope, so object identity and every
+ * reference to it are unchanged. The caller must hold the writer lock; an
+ * interrupted repack leaves the list in place and can simply be rerun.
+ */
+scribe_error_t scribe_object_repack(scribe_ctx *ctx, scribe_repack_stats *out) {
+    char *path;
+    uint8_t *list = NULL;
+    size_t list_len = 0;
+    size_t pos;
+    ZSTD_CCtx *cctx;
+    scribe_error_t err;
+
+    if (ctx == NULL || out == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid repack arguments");
+    }
+    memset(out, 0, sizeof(*out));
+    path = scribe_path_join(ctx->repo_path, "objects/info/fast-objects");
+    if (path == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    err = scribe_read_file(path, &list, &list_len);
+    if (err == SCRIBE_ENOT_FOUND) {
+        free(path);
+        return SCRIBE_OK;
+    }
+    if (err != SCRIBE_OK) {
+        free(path);
+        return err;
+    }
+    cctx = ZSTD_createCCtx();
+    if (cctx == NULL || ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel,
+                                                             ctx->config.repack_compression_level)) ||
+        ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_enableLongDistanceMatching, 1))) {
+        ZSTD_freeCCtx(cctx);
+        free(list);
+        free(path);
+        return scribe_set_error(SCRIBE_ERR, "failed to configure zstd for repack");
+    }
+    /*
+     * A torn last line (crash mid-append) is ignored; anything else that is
+     * not a hash means the list is damaged.
+     */
+    for (pos = 0; err == SCRIBE_OK && pos + SCRIBE_HEX_HASH_SIZE < list_len; pos += SCRIBE_HEX_HASH_SIZE + 1u) {
+        char hex[SCRIBE_HEX_HASH_SIZE + 1];
+        uint8_t hash[SCRIBE_HASH_SIZE];
+
+        if (list[pos + SCRIBE_HEX_HASH_SIZE] != '\n') {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "invalid fast-objects list");
+            break;
+        }
+        memcpy(hex, list + pos, SCRIBE_HEX_HASH_SIZE);
+        hex[SCRIBE_HEX_HASH_SIZE] = '\0';
+        err = scribe_hash_from_hex(hex, hash);
+        if (err == SCRIBE_OK) {
+            out->listed++;
+            err = repack_one(ctx, cctx, hash, out);
+        }
+    }
+    ZSTD_freeCCtx(cctx);
+    free(list);
+    if (err == SCRIBE_OK) {
+        err = scribe_object_flush(ctx);
+    }
+    if (err == SCRIBE_OK) {
+        scribe_object_fast_list_close(ctx);
+    }
+    if (err == SCRIBE_OK && unlink(path) != 0 && errno != ENOENT) {
+        err = scribe_set_error(SCRIBE_EIO, "failed to remove fast-objects list");
+    }
+    free(path);
+    if (err == SCRIBE_OK) {
+        scribe_log_msg(ctx, SCRIBE_LOG_INFO, "objects", "repack recompressed %zu of %zu object(s)", out->recompressed,
+                       out->listed);
+    }
+    return err;
+}
+
+/*
+ * Fills the leaf-count cache for every tree under HEAD's root. Trees written
+ * before the cache existed are otherwise only counted by read-only commands,
+ * which cannot persist what they compute.
+ */
+static scribe_error_t warm_leaf_counts(scribe_ctx *ctx) {
+    uint8_t head[SCRIBE_HASH_SIZE];
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+    uint64_t leaves = 0;
+    scribe_error_t err = scribe_refs_read(ctx, "refs/heads/main", head);
+
+    if (err == SCRIBE_ENOT_FOUND) {
+        return SCRIBE_OK;
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_object_read(ctx, head, &obj);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_arena_init(&arena, 4096);
+    if (err == SCRIBE_OK) {
+        err = obj.type == SCRIBE_OBJECT_COMMIT ? scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view)
+                                               : scribe_set_error(SCRIBE_ECORRUPT, "main does not point at a commit");
+        if (err == SCRIBE_OK) {
+            err = scribe_tree_leaf_count(ctx, view.root_tree, &leaves);
+        }
+        scribe_arena_destroy(&arena);
+    }
+    scribe_object_free(&obj);
+    return err;
+}
+
+/*
+ * Implements `scribe repack`: recompresses fast-written objects, fills the
+ * leaf-count cache for HEAD, and prints a one-line summary of the space recovered. With `write_bitmap` it then
+ * rebuilds the reachability bitmaps, and with `incremental` it extends them
+ * from the last indexed tip; either prints a second summary line.
+ */
+scribe_error_t scribe_cli_repack(scribe_ctx *ctx, int write_bitmap, int incremental) {
+    scribe_repack_stats stats;
+    size_t bitmap_commits = 0;
+    size_t bitmap_objects = 0;
+    scribe_error_t err = scribe_object_repack(ctx, &stats);
+
+    if (err == SCRIBE_OK) {
+        err = warm_leaf_counts(ctx);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    printf("repack: %zu listed, %zu recompressed, %llu -> %llu bytes\n", stats.listed, stats.recompressed,
+           (unsigned long long)stats.bytes_before, (unsigned long long)stats.bytes_after);
+    if (write_bitmap || incremental) {
+        err = scribe_bitmap_write(ctx, incremental, &bitmap_commits, &bitmap_objects);
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+        printf("bitmaps: %zu written, %zu objects indexed\n", bitmap_commits, bitmap_objects);
+    }
+    return SCRIBE_OK;
+}
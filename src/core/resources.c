@@ -0,0 +1,252 @@
+/*
+ * CPU and memory limits of the running process.
+ *
+ * sysconf(_SC_NPROCESSORS_ONLN) counts the host's CPUs, which is wrong inside
+ * a container: a pod with a 2-CPU quota on a 64-core node would start 64
+ * workers that the kernel then throttles. At open, Scribe also reads the
+ * affinity mask and the cgroup v2 files of its own cgroup and every ancestor:
+ *
+ *   cpu.max                 "<quota> <period>" or "max <period>"
+ *   cpuset.cpus.effective   CPU list such as "0-3,8"
+ *   memory.max              bytes or "max"
+ *
+ * The usable CPU count is the smallest of these, with a CPU quota rounded up
+ * to whole CPUs. It sizes every worker pool when worker_threads is 0, and
+ * memory.max bounds the memory budget when memory_limit_bytes is 0. Hosts
+ * without cgroup v2 keep the affinity and online counts.
+ *
+ * With worker_cpu_affinity, pool threads are pinned one per allowed CPU in
+ * turn, which avoids migrations on dedicated hosts.
+ */
+#include "core/internal.h"
+
+#include "util/log.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * Reads the first line of a small pseudo-file such as a cgroup control file,
+ * without its newline. Returns 0 when the file is missing or unreadable.
+ */
+static int read_line(const char *path, char *buf, size_t size) {
+    FILE *f = fopen(path, "r");
+    int ok;
+
+    if (f == NULL) {
+        return 0;
+    }
+    ok = fgets(buf, (int)size, f) != NULL;
+    fclose(f);
+    if (ok) {
+        buf[strcspn(buf, "\n")] = '\0';
+    }
+    return ok;
+}
+
+/*
+ * Parses cpu.max into whole CPUs, rounding a fractional quota up. Returns 0
+ * for "max" or malformed text.
+ */
+static unsigned parse_cpu_max(const char *text) {
+    char *end = NULL;
+    unsigned long long quota;
+    unsigned long long period;
+
+    if (strncmp(text, "max", 3) == 0) {
+        return 0;
+    }
+    errno = 0;
+    quota = strtoull(text, &end, 10);
+    if (errno != 0 || end == text || *end != ' ') {
+        return 0;
+    }
+    period = strtoull(end + 1, &end, 10);
+    if (errno != 0 || period == 0 || quota == 0) {
+        return 0;
+    }
+    quota = (quota + period - 1u) / period;
+    return quota > UINT_MAX ? UINT_MAX : (unsigned)quota;
+}
+
+/*
+ * Counts the CPUs in a cpuset list such as "0-3,8". Returns 0 for an empty or
+ * malformed list.
+ */
+static unsigned parse_cpu_list(const char *text) {
+    const char *p = text;
+    unsigned count = 0;
+
+    while (*p != '\0') {
+        char *end = NULL;
+        unsigned long lo = strtoul(p, &end, 10);
+        unsigned long hi = lo;
+
+        if (end == p) {
+            return 0;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtoul(p, &end, 10);
+            if (end == p || hi < lo) {
+                return 0;
+            }
+        }
+        count += (unsigned)(hi - lo + 1u);
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return 0;
+        }
+        p = end;
+    }
+    return count;
+}
+
+/*
+ * Returns the smaller of two limits where 0 means unlimited.
+ */
+static uint64_t min_limit(uint64_t a, uint64_t b) {
+    if (a == 0) {
+        return b;
+    }
+    return b == 0 || a < b ? a : b;
+}
+
+/*
+ * Reads the cgroup v2 limits that apply to this process. `root` prefixes
+ * /proc and /sys so tests can supply a fake hierarchy; it is "" in normal use.
+ * Limits are taken from the process's cgroup and every ancestor, because a
+ * parent's cpu.max or memory.max constrains its children too; the effective
+ * cpuset already accounts for the ancestors, so only the nearest one counts.
+ */
+static void probe_cgroup(const char *root, scribe_resources *out) {
+    char self[PATH_MAX];
+    char line[PATH_MAX];
+    char dir[PATH_MAX];
+    char file[PATH_MAX + 32];
+    char value[4096];
+    FILE *f;
+    size_t base_len;
+    int found = 0;
+
+    (void)snprintf(self, sizeof(self), "%s/proc/self/cgroup", root);
+    f = fopen(self, "r");
+    if (f == NULL) {
+        return;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            line[strcspn(line, "\n")] = '\0';
+            found = 1;
+            break;
+        }
+    }
+    fclose(f);
+    if (!found) {
+        return;
+    }
+    base_len = (size_t)snprintf(dir, sizeof(dir), "%s/sys/fs/cgroup", root);
+    if (base_len >= sizeof(dir) || base_len + strlen(line + 3) >= sizeof(dir)) {
+        return;
+    }
+    strcat(dir, strcmp(line + 3, "/") == 0 ? "" : line + 3);
+    for (;;) {
+        char *slash;
+
+        (void)snprintf(file, sizeof(file), "%s/cpu.max", dir);
+        if (read_line(file, value, sizeof(value))) {
+            out->quota_cpus = (unsigned)min_limit(out->quota_cpus, parse_cpu_max(value));
+        }
+        (void)snprintf(file, sizeof(file), "%s/memory.max", dir);
+        if (read_line(file, value, sizeof(value)) && strcmp(value, "max") != 0) {
+            out->memory_max = min_limit(out->memory_max, strtoull(value, NULL, 10));
+        }
+        (void)snprintf(file, sizeof(file), "%s/cpuset.cpus.effective", dir);
+        if (out->cpuset_cpus == 0 && read_line(file, value, sizeof(value))) {
+            out->cpuset_cpus = parse_cpu_list(value);
+        }
+        if (strlen(dir) <= base_len) {
+            break;
+        }
+        slash = strrchr(dir + base_len, '/');
+        *slash = '\0';
+    }
+}
+
+/*
+ * Fills `out` with the CPU and memory limits of the process and the CPU count
+ * worker pools should use. See the file comment for the sources.
+ */
+void scribe_resources_probe(const char *root, scribe_resources *out) {
+    cpu_set_t set;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+    memset(out, 0, sizeof(*out));
+    out->online_cpus = online < 1 ? 1u : (unsigned)online;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        out->affinity_cpus = (unsigned)CPU_COUNT(&set);
+    }
+    probe_cgroup(root, out);
+    out->cpus = out->online_cpus;
+    out->cpus = (unsigned)min_limit(out->cpus, out->affinity_cpus);
+    out->cpus = (unsigned)min_limit(out->cpus, out->cpuset_cpus);
+    out->cpus = (unsigned)min_limit(out->cpus, out->quota_cpus);
+}
+
+/*
+ * Logs the limits found at open and the sizes derived from them. Writable
+ * opens inside a CPU- or memory-limited cgroup log at INFO, so long-running
+ * commands such as mongo-watch show what they chose; everything else logs at
+ * DEBUG.
+ */
+void scribe_resources_log(scribe_ctx *ctx) {
+    const scribe_resources *r = &ctx->resources;
+    int limited = r->cpus < r->online_cpus || r->memory_max != 0;
+
+    scribe_log_msg(ctx, ctx->writable && limited ? SCRIBE_LOG_INFO : SCRIBE_LOG_DEBUG, "resources",
+                   "cpus %u (online %u, affinity %u, cpuset %u, quota %u), memory.max %llu; workers %u, memory "
+                   "budget %zu, cpu pinning %s",
+                   r->cpus, r->online_cpus, r->affinity_cpus, r->cpuset_cpus, r->quota_cpus,
+                   (unsigned long long)r->memory_max, scribe_worker_count(ctx), ctx->mem.limit,
+                   ctx->config.worker_cpu_affinity ? "on" : "off");
+}
+
+/*
+ * Pins pool thread `index` to one CPU of the process's affinity mask, taking
+ * the CPUs in turn, when worker_cpu_affinity is set. The calling thread stays
+ * unpinned. A failure only costs the pinning and is logged.
+ */
+void scribe_worker_pin(scribe_ctx *ctx, pthread_t thread, unsigned index) {
+    cpu_set_t allowed;
+    cpu_set_t one;
+    unsigned count;
+    unsigned want;
+    size_t cpu;
+
+    if (!ctx->config.worker_cpu_affinity || sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+    count = (unsigned)CPU_COUNT(&allowed);
+    if (count == 0) {
+        return;
+    }
+    want = index % count;
+    for (cpu = 0; cpu < (size_t)CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && want-- == 0) {
+            break;
+        }
+    }
+    CPU_ZERO(&one);
+    CPU_SET(cpu, &one);
+    if (pthread_setaffinity_np(thread, sizeof(one), &one) != 0) {
+        scribe_log_msg(ctx, SCRIBE_LOG_WARN, "resources", "failed to pin worker %u to CPU %zu", index, cpu);
+    }
+}
@@ -0,0 +1,417 @@
+/*
+ * Bounded-fanout layout for large trees.
+ *
+ * A logical tree with more than `tree_shard_threshold` entries is stored as an
+ * interior level of up to 256 shard trees, partitioned by one byte of the
+ * BLAKE3 hash of each entry name. A shard that is still too large is split
+ * again on the next hash byte. The layout is a pure function of the entry set,
+ * so the same logical tree hashes identically no matter how it was built, and a
+ * single-entry change rewrites one small shard per level instead of the whole
+ * tree. Readers treat shard levels as transparent: they never appear in paths.
+ */
+#include "core/internal.h"
+
+#include "util/error.h"
+#include "util/hex.h"
+
+#include "blake3.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Returns whether a tree entry name is a reserved shard name. Shard names are
+ * exactly the marker byte followed by two lowercase hex digits.
+ */
+bool scribe_tree_name_is_shard(const char *name, size_t name_len) {
+    static const char digits[] = "0123456789abcdef";
+
+    return name != NULL && name_len == SCRIBE_SHARD_NAME_LEN && name[0] == SCRIBE_SHARD_MARKER &&
+           name[1] != '\0' && strchr(digits, name[1]) != NULL && name[2] != '\0' && strchr(digits, name[2]) != NULL;
+}
+
+/*
+ * Returns whether a parsed tree is an interior shard level: nonempty, and every
+ * entry is a subtree with a reserved shard name.
+ */
+bool scribe_tree_entries_sharded(const scribe_tree_entry *entries, size_t count) {
+    size_t i;
+
+    if (entries == NULL || count == 0) {
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        if (entries[i].type != SCRIBE_OBJECT_TREE || !scribe_tree_name_is_shard(entries[i].name, entries[i].name_len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Returns the shard bucket for an entry name at one interior depth. Depth N
+ * uses byte N of BLAKE3(name), so names that shared a bucket at every earlier
+ * depth are spread again by an independent byte.
+ */
+uint8_t scribe_tree_shard_bucket(const char *name, size_t name_len, size_t depth) {
+    blake3_hasher hasher;
+    uint8_t digest[SCRIBE_HASH_SIZE];
+
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, name, name_len);
+    blake3_hasher_finalize(&hasher, digest, SCRIBE_HASH_SIZE);
+    return digest[depth < SCRIBE_HASH_SIZE ? depth : SCRIBE_HASH_SIZE - 1u];
+}
+
+/*
+ * Formats the reserved entry name for one shard bucket into a caller-owned
+ * NUL-terminated buffer.
+ */
+void scribe_tree_shard_name(uint8_t bucket, char out[SCRIBE_SHARD_NAME_LEN + 1u]) {
+    static const char digits[] = "0123456789abcdef";
+
+    out[0] = SCRIBE_SHARD_MARKER;
+    out[1] = digits[bucket >> 4];
+    out[2] = digits[bucket & 0x0fu];
+    out[3] = '\0';
+}
+
+/*
+ * Serializes an entry array as one tree object without any sharding decision.
+ * Interior shard levels and trees under the threshold both end up here, so
+ * this is also where every written tree's leaf count is recorded.
+ */
+scribe_error_t scribe_tree_write_flat(scribe_ctx *ctx, const scribe_tree_entry *entries, size_t count,
+                                      uint8_t out_hash[SCRIBE_HASH_SIZE]) {
+    scribe_arena arena;
+    uint8_t *payload;
+    size_t payload_len;
+    size_t capacity = 4096u;
+    size_t i;
+    scribe_error_t err;
+
+    if (count > (SIZE_MAX - capacity) / (sizeof(scribe_tree_entry) + 1u + SCRIBE_HASH_SIZE + 10u)) {
+        return scribe_set_error(SCRIBE_ENOMEM, "tree has too many entries");
+    }
+    capacity += count * (sizeof(scribe_tree_entry) + 1u + SCRIBE_HASH_SIZE + 10u);
+    for (i = 0; i < count; i++) {
+        if (entries[i].name_len > SIZE_MAX - capacity) {
+            return scribe_set_error(SCRIBE_ENOMEM, "tree arena size is too large");
+        }
+        capacity += entries[i].name_len;
+    }
+    err = scribe_arena_init(&arena, capacity);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_tree_serialize(entries, count, &arena, &payload, &payload_len);
+    if (err == SCRIBE_OK) {
+        err = scribe_object_write(ctx, SCRIBE_OBJECT_TREE, payload, payload_len, out_hash);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_tree_leaf_count_note(ctx, out_hash, entries, count);
+    }
+    scribe_arena_destroy(&arena);
+    return err;
+}
+
+/*
+ * Writes the entries of one logical tree, or of one shard at the given depth.
+ * Entry sets at or below the configured threshold are written flat; larger sets
+ * are partitioned into shard buckets that are written recursively, and the
+ * resulting shard entries form the interior tree whose hash is returned.
+ */
+scribe_error_t scribe_tree_write_at_depth(scribe_ctx *ctx, const scribe_tree_entry *entries, size_t count,
+                                          size_t depth, uint8_t out_hash[SCRIBE_HASH_SIZE]) {
+    size_t threshold;
+    size_t offsets[257];
+    size_t fill[256];
+    scribe_tree_entry *grouped;
+    scribe_tree_entry shards[256];
+    char names[256][SCRIBE_SHARD_NAME_LEN + 1u];
+    uint8_t *buckets;
+    size_t shard_count = 0;
+    size_t i;
+    scribe_error_t err = SCRIBE_OK;
+
+    if (ctx == NULL || out_hash == NULL || (count != 0 && entries == NULL)) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid tree write");
+    }
+    threshold = ctx->config.tree_shard_threshold;
+    if (threshold == 0 || count <= threshold || depth >= SCRIBE_HASH_SIZE) {
+        return scribe_tree_write_flat(ctx, entries, count, out_hash);
+    }
+    /*
+     * Counting sort by bucket: one pass computes every name's bucket, a prefix
+     * sum turns counts into offsets, and a second pass groups entries so each
+     * bucket can be written from a contiguous slice.
+     */
+    if (count > SIZE_MAX / sizeof(*grouped)) {
+        return scribe_set_error(SCRIBE_ENOMEM, "tree has too many entries");
+    }
+    grouped = (scribe_tree_entry *)malloc(sizeof(*grouped) * count);
+    buckets = (uint8_t *)malloc(count);
+    if (grouped == NULL || buckets == NULL) {
+        free(grouped);
+        free(buckets);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate shard partition");
+    }
+    memset(offsets, 0, sizeof(offsets));
+    for (i = 0; i < count; i++) {
+        buckets[i] = scribe_tree_shard_bucket(entries[i].name, entries[i].name_len, depth);
+        offsets[(size_t)buckets[i] + 1u]++;
+    }
+    for (i = 0; i < 256u; i++) {
+        offsets[i + 1u] += offsets[i];
+        fill[i] = offsets[i];
+    }
+    for (i = 0; i < count; i++) {
+        grouped[fill[buckets[i]]++] = entries[i];
+    }
+    for (i = 0; i < 256u && err == SCRIBE_OK; i++) {
+        size_t n = offsets[i + 1u] - offsets[i];
+        if (n == 0) {
+            continue;
+        }
+        scribe_tree_shard_name((uint8_t)i, names[shard_count]);
+        shards[shard_count].type = SCRIBE_OBJECT_TREE;
+        shards[shard_count].name = names[shard_count];
+        shards[shard_count].name_len = SCRIBE_SHARD_NAME_LEN;
+        err = scribe_tree_write_at_depth(ctx, grouped + offsets[i], n, depth + 1u, shards[shard_count].hash);
+        shard_count++;
+    }
+    free(grouped);
+    free(buckets);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    return scribe_tree_write_flat(ctx, shards, shard_count, out_hash);
+}
+
+/*
+ * Writes one logical tree, applying the repository's sharding threshold. This
+ * is the entry point for every writer that builds trees from a full entry list.
+ */
+scribe_error_t scribe_tree_write(scribe_ctx *ctx, const scribe_tree_entry *entries, size_t count,
+                                 uint8_t out_hash[SCRIBE_HASH_SIZE]) {
+    return scribe_tree_write_at_depth(ctx, entries, count, 0, out_hash);
+}
+
+/*
+ * Reads one tree object and parses its physical entries into a caller-supplied,
+ * already-destroyed arena. The arena is initialized here to the parse capacity
+ * of the object payload.
+ */
+static scribe_error_t read_physical(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_arena *arena,
+                                    scribe_tree_entry **entries, size_t *count) {
+    scribe_object obj;
+    size_t capacity = 0;
+    scribe_error_t err;
+
+    err = scribe_arena_init(arena, 0);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    err = scribe_object_read(ctx, hash, &obj);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    if (obj.type != SCRIBE_OBJECT_TREE) {
+        scribe_object_free(&obj);
+        return scribe_set_error(SCRIBE_ECORRUPT, "object is not a tree");
+    }
+    err = scribe_tree_parse_arena_capacity(obj.payload_len, &capacity);
+    if (err == SCRIBE_OK) {
+        err = scribe_arena_init(arena, capacity);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_tree_parse(obj.payload, obj.payload_len, arena, entries, count);
+    }
+    scribe_object_free(&obj);
+    return err;
+}
+
+typedef struct {
+    scribe_object *objects;
+    scribe_tree_entry **parts;
+    size_t *part_counts;
+    size_t count;
+    size_t cap;
+    size_t capacity;
+} shard_leaves;
+
+/*
+ * Collects the flat leaf shards under one interior level. Each leaf object is
+ * kept decompressed so the caller can size a single arena for all of them.
+ */
+static scribe_error_t collect_leaf_shards(scribe_ctx *ctx, const scribe_tree_entry *shards, size_t shard_count,
+                                          shard_leaves *leaves) {
+    size_t i;
+
+    for (i = 0; i < shard_count; i++) {
+        scribe_object obj;
+        scribe_arena arena;
+        scribe_tree_entry *entries = NULL;
+        size_t count = 0;
+        size_t capacity = 0;
+        scribe_error_t err = scribe_object_read(ctx, shards[i].hash, &obj);
+        if (err != SCRIBE_OK) {
+            return err;
+        }
+        if (obj.type != SCRIBE_OBJECT_TREE) {
+            scribe_object_free(&obj);
+            return scribe_set_error(SCRIBE_ECORRUPT, "shard entry is not a tree");
+        }
+        err = scribe_tree_parse_arena_capacity(obj.payload_len, &capacity);
+        if (err == SCRIBE_OK) {
+            err = scribe_arena_init(&arena, capacity);
+        }
+        if (err != SCRIBE_OK) {
+            scribe_object_free(&obj);
+            return err;
+        }
+        err = scribe_tree_parse(obj.payload, obj.payload_len, &arena, &entries, &count);
+        if (err == SCRIBE_OK && scribe_tree_entries_sharded(entries, count)) {
+            scribe_object_free(&obj);
+            err = collect_leaf_shards(ctx, entries, count, leaves);
+            scribe_arena_destroy(&arena);
+            if (err != SCRIBE_OK) {
+                return err;
+            }
+            continue;
+        }
+        scribe_arena_destroy(&arena);
+        if (err == SCRIBE_OK && leaves->count == leaves->cap) {
+            size_t new_cap = leaves->cap == 0 ? 16u : leaves->cap * 2u;
+            scribe_object *grown = (scribe_object *)realloc(leaves->objects, sizeof(*grown) * new_cap);
+            scribe_tree_entry **parts = NULL;
+            size_t *part_counts = NULL;
+            if (grown != NULL) {
+                leaves->objects = grown;
+                parts = (scribe_tree_entry **)realloc(leaves->parts, sizeof(*parts) * new_cap);
+            }
+            if (parts != NULL) {
+                leaves->parts = parts;
+                part_counts = (size_t *)realloc(leaves->part_counts, sizeof(*part_counts) * new_cap);
+            }
+            if (part_counts == NULL) {
+                err = scribe_set_error(SCRIBE_ENOMEM, "failed to allocate shard list");
+            } else {
+                leaves->part_counts = part_counts;
+                leaves->cap = new_cap;
+            }
+        }
+        if (err == SCRIBE_OK && capacity > SIZE_MAX - leaves->capacity) {
+            err = scribe_set_error(SCRIBE_ENOMEM, "sharded tree is too large");
+        }
+        if (err != SCRIBE_OK) {
+            scribe_object_free(&obj);
+            return err;
+        }
+        leaves->capacity += capacity;
+        leaves->objects[leaves->count++] = obj;
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads a tree as its logical entry list. Flat trees are parsed directly;
+ * sharded trees are expanded through every interior level and the leaf entries
+ * are merged back into canonical byte-sorted order. The arena is initialized
+ * here, as with a one-shot parse; the caller destroys it.
+ */
+scribe_error_t scribe_tree_read_logical(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], scribe_arena *arena,
+                                        scribe_tree_entry **entries, size_t *count) {
+    shard_leaves leaves = {0};
+    scribe_tree_entry *merged = NULL;
+    size_t total = 0;
+    size_t i;
+    scribe_error_t err;
+
+    err = read_physical(ctx, hash, arena, entries, count);
+    if (err != SCRIBE_OK || !scribe_tree_entries_sharded(*entries, *count)) {
+        return err;
+    }
+    err = collect_leaf_shards(ctx, *entries, *count, &leaves);
+    scribe_arena_destroy(arena);
+    if (err == SCRIBE_OK && leaves.capacity > (SIZE_MAX - 4096u) / 2u) {
+        err = scribe_set_error(SCRIBE_ENOMEM, "sharded tree is too large");
+    }
+    if (err == SCRIBE_OK) {
+        /* Room for every leaf parse plus one merged copy of the entry views. */
+        err = scribe_arena_init(arena, leaves.capacity * 2u + 4096u);
+    }
+    for (i = 0; err == SCRIBE_OK && i < leaves.count; i++) {
+        size_t n = 0;
+        err = scribe_tree_parse(leaves.objects[i].payload, leaves.objects[i].payload_len, arena, &leaves.parts[i],
+                                &n);
+        leaves.part_counts[i] = n;
+        total += n;
+    }
+    if (err == SCRIBE_OK) {
+        merged = (scribe_tree_entry *)scribe_arena_alloc(arena, sizeof(*merged) * (total == 0 ? 1u : total),
+                                                         _Alignof(scribe_tree_entry));
+        if (merged == NULL) {
+            err = SCRIBE_ENOMEM;
+        }
+    }
+    if (err == SCRIBE_OK) {
+        /*
+         * Buckets partition names by hash, not by order, so the concatenated
+         * leaves are re-sorted to restore the canonical listing order.
+         */
+        size_t off = 0;
+        for (i = 0; i < leaves.count; i++) {
+            if (leaves.part_counts[i] != 0) {
+                memcpy(merged + off, leaves.parts[i], sizeof(*merged) * leaves.part_counts[i]);
+                off += leaves.part_counts[i];
+            }
+        }
+        qsort(merged, total, sizeof(*merged), scribe_tree_entry_compare);
+        *entries = merged;
+        *count = total;
+    }
+    for (i = 0; i < leaves.count; i++) {
+        scribe_object_free(&leaves.objects[i]);
+    }
+    free(leaves.objects);
+    free(leaves.parts);
+    free(leaves.part_counts);
+    return err;
+}
+
+/*
+ * Reads the flat tree that would hold one entry name. For a flat tree that is
+ * the tree itself; for a sharded tree the interior levels are followed by the
+ * name's bucket at each depth. A missing bucket yields zero entries. The arena
+ * is initialized here and holds only the final level's entries.
+ */
+scribe_error_t scribe_tree_read_bucket(scribe_ctx *ctx, const uint8_t hash[SCRIBE_HASH_SIZE], const char *name,
+                                       size_t name_len, scribe_arena *arena, scribe_tree_entry **entries,
+                                       size_t *count) {
+    uint8_t current[SCRIBE_HASH_SIZE];
+    size_t depth;
+    scribe_error_t err;
+
+    scribe_hash_copy(current, hash);
+    for (depth = 0;; depth++) {
+        char shard[SCRIBE_SHARD_NAME_LEN + 1u];
+        size_t i;
+        err = read_physical(ctx, current, arena, entries, count);
+        if (err != SCRIBE_OK || !scribe_tree_entries_sharded(*entries, *count)) {
+            return err;
+        }
+        scribe_tree_shard_name(scribe_tree_shard_bucket(name, name_len, depth), shard);
+        for (i = 0; i < *count; i++) {
+            if (memcmp((*entries)[i].name, shard, SCRIBE_SHARD_NAME_LEN) == 0) {
+                break;
+            }
+        }
+        if (i == *count) {
+            *count = 0;
+            return SCRIBE_OK;
+        }
+        scribe_hash_copy(current, (*entries)[i].hash);
+        scribe_arena_destroy(arena);
+    }
+}
@@ -0,0 +1,1136 @@
+/*
+ * Full-snapshot tree assembly from a flat stream of leaves.
+ *
+ * Bulk loaders produce one (path, blob hash) record per document, usually in
+ * whatever order their input arrived. Rather than inserting each record into a
+ * mutable tree, the builder collects records under a fixed memory budget,
+ * spills sorted runs to unlinked temporary files under `.scribe/tmp/` when the
+ * budget fills, and k-way merges the runs into one sorted stream. A bottom-up
+ * tree writer consumes the stream and keeps only the open directories in
+ * memory.
+ *
+ * When tree sharding is enabled, the children of a directory are ordered by
+ * the BLAKE3 hash of their names, which is the bucket order used by
+ * scribe_tree_write_at_depth(). The writer can then emit each shard as soon as
+ * the stream moves past it and holds at most about `tree_shard_threshold`
+ * entries per shard depth, however large the directory. Trees come out
+ * byte-for-byte identical to those written by incremental commits.
+ */
+#include "core/internal.h"
+
+#include "util/arena.h"
+#include "util/error.h"
+#include "util/hex.h"
+#include "util/leb128.h"
+#include "util/log.h"
+
+#include "blake3.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Runs merged at once; more runs are first merged into intermediate runs. */
+#define SNAPSHOT_MERGE_FANIN 64u
+/* Smallest accepted memory budget. */
+#define SNAPSHOT_MIN_MEMORY 4096u
+/* stdio buffer for each run file. */
+#define SNAPSHOT_RUN_BUFFER (64u * 1024u)
+
+typedef struct {
+    const char **path;
+    size_t *lens;
+    uint64_t *keys;
+    size_t path_len;
+    uint64_t seq;
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    uint8_t sharded;
+} snapshot_rec;
+
+typedef scribe_error_t (*snapshot_sink_fn)(void *arg, const snapshot_rec *rec);
+
+struct scribe_snapshot_builder {
+    scribe_ctx *ctx;
+    uint8_t sharded;
+    scribe_arena arena;
+    snapshot_rec **recs;
+    size_t rec_count;
+    size_t rec_cap;
+    size_t rec_budget;
+    FILE **runs;
+    size_t run_count;
+    size_t run_cap;
+    size_t total;
+};
+
+/*
+ * Returns the sort key of one path component: the first eight bytes of the
+ * BLAKE3 hash of the name, big-endian, or zero when trees are not sharded.
+ */
+static uint64_t component_key(const char *name, size_t len, uint8_t sharded) {
+    blake3_hasher hasher;
+    uint8_t digest[8];
+    uint64_t key = 0;
+    size_t i;
+
+    if (!sharded) {
+        return 0;
+    }
+    blake3_hasher_init(&hasher);
+    blake3_hasher_update(&hasher, name, len);
+    blake3_hasher_finalize(&hasher, digest, sizeof(digest));
+    for (i = 0; i < sizeof(digest); i++) {
+        key = (key << 8) | digest[i];
+    }
+    return key;
+}
+
+/*
+ * Compares component `i` of two records in directory stream order: by shard
+ * key, by the full name hash when two keys collide, then by name bytes.
+ */
+static int component_cmp(const snapshot_rec *a, const snapshot_rec *b, size_t i) {
+    size_t n;
+    int c;
+
+    if (a->keys[i] != b->keys[i]) {
+        return a->keys[i] < b->keys[i] ? -1 : 1;
+    }
+    if (a->sharded && (a->lens[i] != b->lens[i] || memcmp(a->path[i], b->path[i], a->lens[i]) != 0)) {
+        uint8_t da[SCRIBE_HASH_SIZE];
+        uint8_t db[SCRIBE_HASH_SIZE];
+        blake3_hasher hasher;
+
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, a->path[i], a->lens[i]);
+        blake3_hasher_finalize(&hasher, da, SCRIBE_HASH_SIZE);
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, b->path[i], b->lens[i]);
+        blake3_hasher_finalize(&hasher, db, SCRIBE_HASH_SIZE);
+        if ((c = memcmp(da, db, SCRIBE_HASH_SIZE)) != 0) {
+            return c;
+        }
+    }
+    n = a->lens[i] < b->lens[i] ? a->lens[i] : b->lens[i];
+    if ((c = memcmp(a->path[i], b->path[i], n)) != 0) {
+        return c;
+    }
+    return a->lens[i] < b->lens[i] ? -1 : (a->lens[i] > b->lens[i] ? 1 : 0);
+}
+
+/*
+ * Orders records component-wise, a path before anything beneath it, and equal
+ * paths by ingest sequence so the last occurrence of a repeated path sorts last.
+ */
+static int rec_cmp(const snapshot_rec *a, const snapshot_rec *b) {
+    size_t n = a->path_len < b->path_len ? a->path_len : b->path_len;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        int c = component_cmp(a, b, i);
+        if (c != 0) {
+            return c;
+        }
+    }
+    if (a->path_len != b->path_len) {
+        return a->path_len < b->path_len ? -1 : 1;
+    }
+    return a->seq < b->seq ? -1 : (a->seq > b->seq ? 1 : 0);
+}
+
+/*
+ * qsort adapter for arrays of record pointers.
+ */
+static int rec_ptr_cmp(const void *a, const void *b) {
+    return rec_cmp(*(const snapshot_rec *const *)a, *(const snapshot_rec *const *)b);
+}
+
+/*
+ * Applies the same component rules as commit batches so a snapshot can never
+ * contain a path that an incremental commit would reject.
+ */
+static scribe_error_t validate_path(const char *const *path, size_t path_len) {
+    size_t i;
+
+    if (path == NULL || path_len == 0) {
+        return scribe_set_error(SCRIBE_EMALFORMED, "snapshot path is empty");
+    }
+    for (i = 0; i < path_len; i++) {
+        const char *c = path[i];
+        if (c == NULL || c[0] == '\0' || strchr(c, '\n') != NULL || strchr(c, '\t') != NULL) {
+            return scribe_set_error(SCRIBE_EMALFORMED, "invalid path component");
+        }
+        if (c[0] == SCRIBE_SHARD_MARKER) {
+            return scribe_set_error(SCRIBE_EMALFORMED, "path component uses the reserved shard marker");
+        }
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Appends one LEB128 integer to a run file.
+ */
+static scribe_error_t run_put_uint(FILE *f, uint64_t value) {
+    uint8_t buf[10];
+    size_t n = scribe_leb128_encode(value, buf);
+
+    if (fwrite(buf, 1, n, f) != n) {
+        return scribe_set_error(SCRIBE_EIO, "failed to write snapshot run");
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Reads one LEB128 integer from a run file. A clean end of file before the
+ * first byte sets *eof instead of failing, when the caller allows it.
+ */
+static scribe_error_t run_get_uint(FILE *f, uint64_t *out, int *eof) {
+    uint8_t buf[10];
+    size_t n = 0;
+    size_t used = 0;
+
+    for (;;) {
+        int c = getc(f);
+        if (c == EOF) {
+            if (n == 0 && eof != NULL && !ferror(f)) {
+                *eof = 1;
+                return SCRIBE_OK;
+            }
+            return scribe_set_error(SCRIBE_EIO, "truncated snapshot run");
+        }
+        if (n == sizeof(buf)) {
+            return scribe_set_error(SCRIBE_ECORRUPT, "malformed snapshot run");
+        }
+        buf[n++] = (uint8_t)c;
+        if ((c & 0x80) == 0) {
+            break;
+        }
+    }
+    return scribe_leb128_decode(buf, n, out, &used);
+}
+
+/*
+ * Serializes one record: component count, each component as length and bytes,
+ * the blob hash, then the ingest sequence. Sort keys are recomputed on read.
+ */
+static scribe_error_t run_put_rec(FILE *f, const snapshot_rec *rec) {
+    scribe_error_t err = run_put_uint(f, rec->path_len);
+    size_t i;
+
+    for (i = 0; err == SCRIBE_OK && i < rec->path_len; i++) {
+        err = run_put_uint(f, rec->lens[i]);
+        if (err == SCRIBE_OK && fwrite(rec->path[i], 1, rec->lens[i], f) != rec->lens[i]) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to write snapshot run");
+        }
+    }
+    if (err == SCRIBE_OK && fwrite(rec->hash, 1, SCRIBE_HASH_SIZE, f) != SCRIBE_HASH_SIZE) {
+        err = scribe_set_error(SCRIBE_EIO, "failed to write snapshot run");
+    }
+    return err == SCRIBE_OK ? run_put_uint(f, rec->seq) : err;
+}
+
+/*
+ * Creates an anonymous run file in `.scribe/tmp/`. The name is unlinked at
+ * once, so an interrupted build leaves nothing behind.
+ */
+static scribe_error_t run_create(scribe_ctx *ctx, FILE **out) {
+    char *dir = scribe_path_join(ctx->repo_path, "tmp");
+    char *tmpl = NULL;
+    int fd;
+    FILE *f;
+    scribe_error_t err;
+
+    if (dir == NULL) {
+        return SCRIBE_ENOMEM;
+    }
+    err = scribe_mkdir_p(dir);
+    if (err == SCRIBE_OK && (tmpl = scribe_path_join(dir, "snapshot-run.XXXXXX")) == NULL) {
+        err = SCRIBE_ENOMEM;
+    }
+    free(dir);
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    fd = mkstemp(tmpl);
+    if (fd < 0) {
+        err = scribe_set_error(SCRIBE_EIO, "failed to create snapshot run '%s'", tmpl);
+        free(tmpl);
+        return err;
+    }
+    (void)unlink(tmpl);
+    free(tmpl);
+    f = fdopen(fd, "w+b");
+    if (f == NULL) {
+        close(fd);
+        return scribe_set_error(SCRIBE_EIO, "failed to open snapshot run");
+    }
+    (void)setvbuf(f, NULL, _IOFBF, SNAPSHOT_RUN_BUFFER);
+    *out = f;
+    return SCRIBE_OK;
+}
+
+typedef struct {
+    FILE *file;
+    snapshot_rec rec;
+    size_t *offsets;
+    char *names;
+    size_t names_cap;
+    size_t path_cap;
+    int done;
+} run_reader;
+
+/*
+ * Ensures a reader's per-component arrays can hold `path_len` entries.
+ */
+static scribe_error_t reader_reserve_path(run_reader *r, size_t path_len) {
+    const char **path;
+    size_t *lens;
+    uint64_t *keys;
+    size_t *offsets;
+
+    if (path_len <= r->path_cap) {
+        return SCRIBE_OK;
+    }
+    if ((path = (const char **)realloc((void *)r->rec.path, path_len * sizeof(*path))) != NULL) {
+        r->rec.path = path;
+    }
+    if (path != NULL && (lens = (size_t *)realloc(r->rec.lens, path_len * sizeof(*lens))) != NULL) {
+        r->rec.lens = lens;
+        if ((keys = (uint64_t *)realloc(r->rec.keys, path_len * sizeof(*keys))) != NULL) {
+            r->rec.keys = keys;
+            if ((offsets = (size_t *)realloc(r->offsets, path_len * sizeof(*offsets))) != NULL) {
+                r->offsets = offsets;
+                r->path_cap = path_len;
+                return SCRIBE_OK;
+            }
+        }
+    }
+    return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot run record");
+}
+
+/*
+ * Ensures the reader's name buffer can hold `need` bytes.
+ */
+static scribe_error_t reader_reserve_names(run_reader *r, size_t need) {
+    size_t cap = r->names_cap == 0 ? 256u : r->names_cap;
+    char *grown;
+
+    if (need <= r->names_cap) {
+        return SCRIBE_OK;
+    }
+    while (cap < need) {
+        if (cap > SIZE_MAX / 2u) {
+            return scribe_set_error(SCRIBE_ECORRUPT, "malformed snapshot run");
+        }
+        cap *= 2u;
+    }
+    grown = (char *)realloc(r->names, cap);
+    if (grown == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot run record");
+    }
+    r->names = grown;
+    r->names_cap = cap;
+    return SCRIBE_OK;
+}
+
+/*
+ * Decodes the next record of a run into the reader's own buffers, or marks the
+ * reader done at end of file. Component names are NUL-terminated.
+ */
+static scribe_error_t reader_next(run_reader *r, uint8_t sharded) {
+    uint64_t path_len = 0;
+    size_t used = 0;
+    size_t i;
+    int eof = 0;
+    scribe_error_t err;
+
+    err = run_get_uint(r->file, &path_len, &eof);
+    if (err != SCRIBE_OK || eof) {
+        r->done = eof;
+        return err;
+    }
+    if (path_len == 0 || path_len > SIZE_MAX / sizeof(uint64_t)) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "malformed snapshot run");
+    }
+    if ((err = reader_reserve_path(r, (size_t)path_len)) != SCRIBE_OK) {
+        return err;
+    }
+    for (i = 0; err == SCRIBE_OK && i < (size_t)path_len; i++) {
+        uint64_t len = 0;
+        if ((err = run_get_uint(r->file, &len, NULL)) != SCRIBE_OK) {
+            break;
+        }
+        if (len > SIZE_MAX - used - 1u) {
+            err = scribe_set_error(SCRIBE_ECORRUPT, "malformed snapshot run");
+        } else if ((err = reader_reserve_names(r, used + (size_t)len + 1u)) == SCRIBE_OK &&
+                   fread(r->names + used, 1, (size_t)len, r->file) != (size_t)len) {
+            err = scribe_set_error(SCRIBE_EIO, "truncated snapshot run");
+        }
+        if (err == SCRIBE_OK) {
+            r->names[used + (size_t)len] = '\0';
+            r->offsets[i] = used;
+            r->rec.lens[i] = (size_t)len;
+            used += (size_t)len + 1u;
+        }
+    }
+    if (err == SCRIBE_OK && fread(r->rec.hash, 1, SCRIBE_HASH_SIZE, r->file) != SCRIBE_HASH_SIZE) {
+        err = scribe_set_error(SCRIBE_EIO, "truncated snapshot run");
+    }
+    if (err == SCRIBE_OK) {
+        err = run_get_uint(r->file, &r->rec.seq, NULL);
+    }
+    if (err != SCRIBE_OK) {
+        return err;
+    }
+    /* Names are pointed at only once the buffer has stopped moving. */
+    r->rec.path_len = (size_t)path_len;
+    r->rec.sharded = sharded;
+    for (i = 0; i < (size_t)path_len; i++) {
+        r->rec.path[i] = r->names + r->offsets[i];
+        r->rec.keys[i] = component_key(r->rec.path[i], r->rec.lens[i], sharded);
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Frees a reader's decode buffers. The run file itself belongs to the builder.
+ */
+static void reader_destroy(run_reader *r) {
+    free((void *)r->rec.path);
+    free(r->rec.lens);
+    free(r->rec.keys);
+    free(r->offsets);
+    free(r->names);
+}
+
+/*
+ * Restores the min-heap property below position `i` of a heap of readers
+ * ordered by their current record.
+ */
+static void heap_sift_down(run_reader **heap, size_t count, size_t i) {
+    for (;;) {
+        size_t l = 2u * i + 1u;
+        size_t r = l + 1u;
+        size_t m = i;
+        run_reader *tmp;
+
+        if (l < count && rec_cmp(&heap[l]->rec, &heap[m]->rec) < 0) {
+            m = l;
+        }
+        if (r < count && rec_cmp(&heap[r]->rec, &heap[m]->rec) < 0) {
+            m = r;
+        }
+        if (m == i) {
+            return;
+        }
+        tmp = heap[i];
+        heap[i] = heap[m];
+        heap[m] = tmp;
+        i = m;
+    }
+}
+
+/*
+ * Merges `count` sorted runs into one sorted stream delivered to `sink`. Runs
+ * are rewound first. The sequence number is part of the order, so repeated
+ * paths still reach the sink oldest first.
+ */
+static scribe_error_t merge_runs(FILE **runs, size_t count, uint8_t sharded, snapshot_sink_fn sink, void *arg) {
+    run_reader *readers;
+    run_reader **heap;
+    size_t live = 0;
+    size_t i;
+    scribe_error_t err = SCRIBE_OK;
+
+    readers = (run_reader *)calloc(count == 0 ? 1u : count, sizeof(*readers));
+    heap = (run_reader **)calloc(count == 0 ? 1u : count, sizeof(*heap));
+    if (readers == NULL || heap == NULL) {
+        free(readers);
+        free(heap);
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot merge");
+    }
+    for (i = 0; err == SCRIBE_OK && i < count; i++) {
+        readers[i].file = runs[i];
+        if (fflush(runs[i]) != 0 || fseek(runs[i], 0, SEEK_SET) != 0) {
+            err = scribe_set_error(SCRIBE_EIO, "failed to rewind snapshot run");
+            break;
+        }
+        err = reader_next(&readers[i], sharded);
+        if (err == SCRIBE_OK && !readers[i].done) {
+            heap[live++] = &readers[i];
+        }
+    }
+    for (i = live / 2u; err == SCRIBE_OK && i-- > 0;) {
+        heap_sift_down(heap, live, i);
+    }
+    while (err == SCRIBE_OK && live > 0) {
+        err = sink(arg, &heap[0]->rec);
+        if (err == SCRIBE_OK) {
+            err = reader_next(heap[0], sharded);
+        }
+        if (err == SCRIBE_OK) {
+            if (heap[0]->done) {
+                heap[0] = heap[--live];
+            }
+            heap_sift_down(heap, live, 0);
+        }
+    }
+    for (i = 0; i < count; i++) {
+        reader_destroy(&readers[i]);
+    }
+    free(readers);
+    free(heap);
+    return err;
+}
+
+/*
+ * Sink that appends merged records to an intermediate run file.
+ */
+static scribe_error_t run_sink(void *arg, const snapshot_rec *rec) { return run_put_rec((FILE *)arg, rec); }
+
+/*
+ * One open bucket of a directory at one shard depth. A buffering level holds
+ * the bucket's entries until it exceeds the shard threshold; an interior level
+ * holds the shard entries already written plus one open child bucket.
+ */
+typedef struct {
+    scribe_tree_entry *entries;
+    uint64_t *keys;
+    size_t count;
+    size_t cap;
+    int interior;
+    int child_open;
+    uint8_t bucket;
+    char names[256][SCRIBE_SHARD_NAME_LEN + 1u];
+} shard_level;
+
+typedef struct {
+    char *name;
+    size_t name_len;
+    uint64_t key;
+    shard_level **levels;
+    size_t level_count;
+    size_t level_cap;
+    char *pending_name;
+    size_t pending_len;
+    uint64_t pending_key;
+    uint8_t pending_hash[SCRIBE_HASH_SIZE];
+} stream_dir;
+
+typedef struct {
+    scribe_ctx *ctx;
+    size_t threshold;
+    stream_dir *dirs;
+    size_t dir_count;
+    size_t dir_cap;
+} tree_stream;
+
+/*
+ * Returns the shard bucket of an entry at `depth`, taken from its sort key
+ * while the key has bytes left and from the full name hash afterwards.
+ */
+static uint8_t entry_bucket(const char *name, size_t name_len, uint64_t key, size_t depth) {
+    if (depth < 8u) {
+        return (uint8_t)((key >> (56u - 8u * depth)) & 0xffu);
+    }
+    return scribe_tree_shard_bucket(name, name_len, depth);
+}
+
+/*
+ * Frees a level and the entry names it owns. Interior levels name their
+ * entries from their own shard-name table.
+ */
+static void level_free(shard_level *level) {
+    size_t i;
+
+    if (level == NULL) {
+        return;
+    }
+    if (!level->interior) {
+        for (i = 0; i < level->count; i++) {
+            free((void *)(uintptr_t)level->entries[i].name);
+        }
+    }
+    free(level->entries);
+    free(level->keys);
+    free(level);
+}
+
+/*
+ * Appends one entry to a level's array.
+ */
+static scribe_error_t level_append(shard_level *level, uint8_t type, const char *name, size_t name_len, uint64_t key,
+                                   const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    if (level->count == level->cap) {
+        size_t cap = level->cap == 0 ? 16u : level->cap * 2u;
+        scribe_tree_entry *entries = (scribe_tree_entry *)realloc(level->entries, cap * sizeof(*entries));
+        uint64_t *keys;
+        if (entries == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow snapshot tree level");
+        }
+        level->entries = entries;
+        keys = (uint64_t *)realloc(level->keys, cap * sizeof(*keys));
+        if (keys == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow snapshot tree level");
+        }
+        level->keys = keys;
+        level->cap = cap;
+    }
+    level->entries[level->count].type = type;
+    level->entries[level->count].name = name;
+    level->entries[level->count].name_len = name_len;
+    scribe_hash_copy(level->entries[level->count].hash, hash);
+    level->keys[level->count] = key;
+    level->count++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Pushes a new, empty buffering level onto a directory.
+ */
+static scribe_error_t dir_push_level(stream_dir *dir) {
+    if (dir->level_count == dir->level_cap) {
+        size_t cap = dir->level_cap == 0 ? 4u : dir->level_cap * 2u;
+        shard_level **levels = (shard_level **)realloc(dir->levels, cap * sizeof(*levels));
+        if (levels == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow snapshot shard levels");
+        }
+        dir->levels = levels;
+        dir->level_cap = cap;
+    }
+    dir->levels[dir->level_count] = (shard_level *)calloc(1, sizeof(shard_level));
+    if (dir->levels[dir->level_count] == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot shard level");
+    }
+    dir->level_count++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Writes the level at `depth` and every open level below it, then pops them.
+ * A buffering level becomes one flat tree; an interior level first closes its
+ * open child into a shard entry, then becomes the tree of its shard entries.
+ * The levels are freed even when writing fails.
+ */
+static scribe_error_t level_close(tree_stream *s, stream_dir *dir, size_t depth, uint8_t out_hash[SCRIBE_HASH_SIZE]) {
+    shard_level *level = dir->levels[depth];
+    scribe_error_t err = SCRIBE_OK;
+
+    if (level->interior && level->child_open) {
+        uint8_t child[SCRIBE_HASH_SIZE];
+        level->child_open = 0;
+        err = level_close(s, dir, depth + 1u, child);
+        if (err == SCRIBE_OK) {
+            scribe_tree_shard_name(level->bucket, level->names[level->count]);
+            err = level_append(level, SCRIBE_OBJECT_TREE, level->names[level->count], SCRIBE_SHARD_NAME_LEN, 0,
+                               child);
+        }
+    }
+    if (err == SCRIBE_OK) {
+        if (!level->interior && level->count > 1u) {
+            /* Stream order is hash order; tree objects list names bytewise. */
+            qsort(level->entries, level->count, sizeof(level->entries[0]), scribe_tree_entry_compare);
+        }
+        err = scribe_tree_write_flat(s->ctx, level->entries, level->count, out_hash);
+    }
+    level_free(level);
+    dir->level_count = depth;
+    return err;
+}
+
+static scribe_error_t level_add(tree_stream *s, stream_dir *dir, size_t depth, uint8_t type, char *name,
+                                size_t name_len, uint64_t key, const uint8_t hash[SCRIBE_HASH_SIZE]);
+
+/*
+ * Turns a buffering level that outgrew the threshold into an interior level
+ * by re-adding its buffered entries, which are already in bucket order.
+ */
+static scribe_error_t level_split(tree_stream *s, stream_dir *dir, size_t depth) {
+    shard_level *level = dir->levels[depth];
+    scribe_tree_entry *entries = level->entries;
+    uint64_t *keys = level->keys;
+    size_t count = level->count;
+    size_t i;
+    scribe_error_t err = SCRIBE_OK;
+
+    level->entries = NULL;
+    level->keys = NULL;
+    level->count = 0;
+    level->cap = 0;
+    level->interior = 1;
+    for (i = 0; i < count; i++) {
+        if (err == SCRIBE_OK) {
+            err = level_add(s, dir, depth, entries[i].type, (char *)(uintptr_t)entries[i].name, entries[i].name_len,
+                            keys[i], entries[i].hash);
+        } else {
+            free((void *)(uintptr_t)entries[i].name);
+        }
+    }
+    free(entries);
+    free(keys);
+    return err;
+}
+
+/*
+ * Adds one entry to the bucket open at `depth` of a directory, descending
+ * through interior levels and closing the child bucket the entry has moved
+ * past. Ownership of the heap-allocated `name` moves into the writer.
+ */
+static scribe_error_t level_add(tree_stream *s, stream_dir *dir, size_t depth, uint8_t type, char *name,
+                                size_t name_len, uint64_t key, const uint8_t hash[SCRIBE_HASH_SIZE]) {
+    shard_level *level = dir->levels[depth];
+    scribe_error_t err;
+
+    if (level->interior) {
+        uint8_t bucket = entry_bucket(name, name_len, key, depth);
+        if (level->child_open && level->bucket != bucket) {
+            uint8_t child[SCRIBE_HASH_SIZE];
+            level->child_open = 0;
+            err = level_close(s, dir, depth + 1u, child);
+            if (err == SCRIBE_OK) {
+                scribe_tree_shard_name(level->bucket, level->names[level->count]);
+                err = level_append(level, SCRIBE_OBJECT_TREE, level->names[level->count], SCRIBE_SHARD_NAME_LEN, 0,
+                                   child);
+            }
+            if (err != SCRIBE_OK) {
+                free(name);
+                return err;
+            }
+        }
+        if (!level->child_open) {
+            if ((err = dir_push_level(dir)) != SCRIBE_OK) {
+                free(name);
+                return err;
+            }
+            level->child_open = 1;
+            level->bucket = bucket;
+        }
+        return level_add(s, dir, depth + 1u, type, name, name_len, key, hash);
+    }
+    if ((err = level_append(level, type, name, name_len, key, hash)) != SCRIBE_OK) {
+        free(name);
+        return err;
+    }
+    if (s->threshold != 0 && level->count > s->threshold && depth < SCRIBE_HASH_SIZE) {
+        return level_split(s, dir, depth);
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Moves a directory's held-back blob into its levels. The newest blob is held
+ * back so that a repeated path can still replace its hash.
+ */
+static scribe_error_t dir_flush_pending(tree_stream *s, stream_dir *dir) {
+    char *name = dir->pending_name;
+
+    if (name == NULL) {
+        return SCRIBE_OK;
+    }
+    dir->pending_name = NULL;
+    return level_add(s, dir, 0, SCRIBE_OBJECT_BLOB, name, dir->pending_len, dir->pending_key, dir->pending_hash);
+}
+
+/*
+ * Frees everything an open directory still owns without writing it.
+ */
+static void dir_release(stream_dir *dir) {
+    while (dir->level_count > 0) {
+        level_free(dir->levels[--dir->level_count]);
+    }
+    free(dir->levels);
+    free(dir->pending_name);
+    free(dir->name);
+}
+
+/*
+ * Opens a subdirectory under the innermost open directory. A held-back blob
+ * with the same name means one path is both a document and a tree.
+ */
+static scribe_error_t stream_open_dir(tree_stream *s, const char *name, size_t name_len, uint64_t key) {
+    stream_dir *parent = &s->dirs[s->dir_count - 1u];
+    stream_dir *dir;
+    scribe_error_t err;
+
+    if (parent->pending_name != NULL && parent->pending_len == name_len &&
+        memcmp(parent->pending_name, name, name_len) == 0) {
+        return scribe_set_error(SCRIBE_ECORRUPT, "snapshot path '%s' is both a document and a tree", name);
+    }
+    if ((err = dir_flush_pending(s, parent)) != SCRIBE_OK) {
+        return err;
+    }
+    if (s->dir_count == s->dir_cap) {
+        size_t cap = s->dir_cap * 2u;
+        stream_dir *dirs = (stream_dir *)realloc(s->dirs, cap * sizeof(*dirs));
+        if (dirs == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow snapshot directory stack");
+        }
+        s->dirs = dirs;
+        s->dir_cap = cap;
+    }
+    dir = &s->dirs[s->dir_count++];
+    memset(dir, 0, sizeof(*dir));
+    dir->name = (char *)malloc(name_len + 1u);
+    if (dir->name == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot directory name");
+    }
+    memcpy(dir->name, name, name_len);
+    dir->name[name_len] = '\0';
+    dir->name_len = name_len;
+    dir->key = key;
+    return dir_push_level(dir);
+}
+
+/*
+ * Writes the innermost open directory and pops it. Unless it is the root, its
+ * tree is added to the parent; the root's hash is returned in `out_hash`.
+ */
+static scribe_error_t stream_close_dir(tree_stream *s, uint8_t out_hash[SCRIBE_HASH_SIZE]) {
+    stream_dir *dir = &s->dirs[s->dir_count - 1u];
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    char *name = dir->name;
+    size_t name_len = dir->name_len;
+    uint64_t key = dir->key;
+    scribe_error_t err = dir_flush_pending(s, dir);
+
+    if (err == SCRIBE_OK) {
+        err = level_close(s, dir, 0, hash);
+    }
+    dir->name = NULL;
+    dir_release(dir);
+    s->dir_count--;
+    if (err != SCRIBE_OK || s->dir_count == 0) {
+        free(name);
+        if (err == SCRIBE_OK) {
+            scribe_hash_copy(out_hash, hash);
+        }
+        return err;
+    }
+    return level_add(s, &s->dirs[s->dir_count - 1u], 0, SCRIBE_OBJECT_TREE, name, name_len, key, hash);
+}
+
+/*
+ * Sink that feeds one sorted record into the tree writer: closes directories
+ * the record has left, opens the ones it enters, and holds back its blob.
+ */
+static scribe_error_t stream_sink(void *arg, const snapshot_rec *rec) {
+    tree_stream *s = (tree_stream *)arg;
+    size_t leaf = rec->path_len - 1u;
+    size_t shared = 0;
+    stream_dir *dir;
+    uint8_t unused[SCRIBE_HASH_SIZE];
+    scribe_error_t err;
+
+    while (shared < leaf && shared + 1u < s->dir_count && s->dirs[shared + 1u].name_len == rec->lens[shared] &&
+           memcmp(s->dirs[shared + 1u].name, rec->path[shared], rec->lens[shared]) == 0) {
+        shared++;
+    }
+    while (s->dir_count > shared + 1u) {
+        if ((err = stream_close_dir(s, unused)) != SCRIBE_OK) {
+            return err;
+        }
+    }
+    while (s->dir_count - 1u < leaf) {
+        size_t i = s->dir_count - 1u;
+        if ((err = stream_open_dir(s, rec->path[i], rec->lens[i], rec->keys[i])) != SCRIBE_OK) {
+            return err;
+        }
+    }
+    dir = &s->dirs[s->dir_count - 1u];
+    if (dir->pending_name != NULL && dir->pending_len == rec->lens[leaf] &&
+        memcmp(dir->pending_name, rec->path[leaf], rec->lens[leaf]) == 0) {
+        /* A repeated path: the later record wins. */
+        scribe_hash_copy(dir->pending_hash, rec->hash);
+        return SCRIBE_OK;
+    }
+    if ((err = dir_flush_pending(s, dir)) != SCRIBE_OK) {
+        return err;
+    }
+    dir->pending_name = (char *)malloc(rec->lens[leaf] + 1u);
+    if (dir->pending_name == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot entry name");
+    }
+    memcpy(dir->pending_name, rec->path[leaf], rec->lens[leaf]);
+    dir->pending_name[rec->lens[leaf]] = '\0';
+    dir->pending_len = rec->lens[leaf];
+    dir->pending_key = rec->keys[leaf];
+    scribe_hash_copy(dir->pending_hash, rec->hash);
+    return SCRIBE_OK;
+}
+
+/*
+ * Prepares a tree writer with the root directory open.
+ */
+static scribe_error_t stream_init(tree_stream *s, scribe_ctx *ctx) {
+    memset(s, 0, sizeof(*s));
+    s->ctx = ctx;
+    s->threshold = ctx->config.tree_shard_threshold;
+    s->dirs = (stream_dir *)calloc(8u, sizeof(*s->dirs));
+    if (s->dirs == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot directory stack");
+    }
+    s->dir_cap = 8u;
+    s->dir_count = 1u;
+    return dir_push_level(&s->dirs[0]);
+}
+
+/*
+ * Closes every open directory, returning the root hash, and releases the
+ * writer. After an earlier error it only releases.
+ */
+static scribe_error_t stream_finish(tree_stream *s, scribe_error_t err, uint8_t out_root[SCRIBE_HASH_SIZE]) {
+    while (s->dir_count > 0) {
+        if (err == SCRIBE_OK) {
+            err = stream_close_dir(s, out_root);
+        } else {
+            dir_release(&s->dirs[--s->dir_count]);
+        }
+    }
+    free(s->dirs);
+    return err;
+}
+
+/*
+ * Creates a snapshot builder that keeps at most about `memory_bytes` of
+ * records in memory before spilling a sorted run. Under a context memory limit
+ * the budget is capped at half the limit. The builder does not reserve it:
+ * a long-lived reservation would keep blocked producers, whose documents the
+ * builder is waiting for, from ever being admitted alone.
+ */
+scribe_error_t scribe_snapshot_builder_new(scribe_ctx *ctx, size_t memory_bytes, scribe_snapshot_builder **out) {
+    scribe_snapshot_builder *b;
+    scribe_error_t err;
+
+    if (ctx == NULL || out == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid snapshot builder argument");
+    }
+    if (ctx->mem.limit != 0 && memory_bytes > ctx->mem.limit / 2u) {
+        memory_bytes = ctx->mem.limit / 2u;
+    }
+    if (memory_bytes < SNAPSHOT_MIN_MEMORY) {
+        memory_bytes = SNAPSHOT_MIN_MEMORY;
+    }
+    b = (scribe_snapshot_builder *)calloc(1, sizeof(*b));
+    if (b == NULL) {
+        return scribe_set_error(SCRIBE_ENOMEM, "failed to allocate snapshot builder");
+    }
+    b->ctx = ctx;
+    b->sharded = ctx->config.tree_shard_threshold != 0;
+    /* A quarter of the budget for the record pointer array, the rest for records. */
+    b->rec_budget = memory_bytes / 4u / sizeof(*b->recs);
+    err = scribe_arena_init(&b->arena, memory_bytes - memory_bytes / 4u);
+    if (err != SCRIBE_OK) {
+        free(b);
+        return err;
+    }
+    *out = b;
+    return SCRIBE_OK;
+}
+
+/*
+ * Sorts the in-memory records, writes them to a new run file, and empties the
+ * arena for the next batch.
+ */
+static scribe_error_t builder_spill(scribe_snapshot_builder *b) {
+    FILE *run = NULL;
+    size_t i;
+    scribe_error_t err;
+
+    if (b->run_count == b->run_cap) {
+        size_t cap = b->run_cap == 0 ? 8u : b->run_cap * 2u;
+        FILE **runs = (FILE **)realloc(b->runs, cap * sizeof(*runs));
+        if (runs == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow snapshot run list");
+        }
+        b->runs = runs;
+        b->run_cap = cap;
+    }
+    if ((err = run_create(b->ctx, &run)) != SCRIBE_OK) {
+        return err;
+    }
+    qsort(b->recs, b->rec_count, sizeof(b->recs[0]), rec_ptr_cmp);
+    for (i = 0; err == SCRIBE_OK && i < b->rec_count; i++) {
+        err = run_put_rec(run, b->recs[i]);
+    }
+    if (err != SCRIBE_OK) {
+        fclose(run);
+        return err;
+    }
+    b->runs[b->run_count++] = run;
+    b->rec_count = 0;
+    scribe_arena_reset(&b->arena);
+    return SCRIBE_OK;
+}
+
+/*
+ * Copies one record into the arena, or returns NULL when the arena is full.
+ */
+static snapshot_rec *builder_copy(scribe_snapshot_builder *b, const char *const *path, size_t path_len,
+                                  const uint8_t hash[SCRIBE_HASH_SIZE], uint64_t seq) {
+    snapshot_rec *rec = (snapshot_rec *)scribe_arena_alloc(&b->arena, sizeof(*rec), _Alignof(snapshot_rec));
+    size_t i;
+
+    if (rec == NULL) {
+        return NULL;
+    }
+    rec->path = (const char **)scribe_arena_alloc(&b->arena, path_len * sizeof(*rec->path), _Alignof(const char *));
+    rec->lens = (size_t *)scribe_arena_alloc(&b->arena, path_len * sizeof(*rec->lens), _Alignof(size_t));
+    rec->keys = (uint64_t *)scribe_arena_alloc(&b->arena, path_len * sizeof(*rec->keys), _Alignof(uint64_t));
+    if (rec->path == NULL || rec->lens == NULL || rec->keys == NULL) {
+        return NULL;
+    }
+    for (i = 0; i < path_len; i++) {
+        rec->lens[i] = strlen(path[i]);
+        rec->path[i] = scribe_arena_strdup_len(&b->arena, path[i], rec->lens[i]);
+        if (rec->path[i] == NULL) {
+            return NULL;
+        }
+        rec->keys[i] = component_key(path[i], rec->lens[i], b->sharded);
+    }
+    rec->path_len = path_len;
+    rec->seq = seq;
+    rec->sharded = b->sharded;
+    scribe_hash_copy(rec->hash, hash);
+    return rec;
+}
+
+/*
+ * Adds one document to the snapshot. The blob must already be written. When
+ * the same path is added more than once, the highest `seq` wins.
+ */
+scribe_error_t scribe_snapshot_builder_add(scribe_snapshot_builder *b, const char *const *path, size_t path_len,
+                                           const uint8_t hash[SCRIBE_HASH_SIZE], uint64_t seq) {
+    size_t mark;
+    snapshot_rec *rec;
+    scribe_error_t err;
+
+    if (b == NULL || hash == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid snapshot builder argument");
+    }
+    if ((err = validate_path(path, path_len)) != SCRIBE_OK) {
+        return err;
+    }
+    if (b->rec_count == b->rec_budget && (err = builder_spill(b)) != SCRIBE_OK) {
+        return err;
+    }
+    mark = b->arena.used;
+    rec = builder_copy(b, path, path_len, hash, seq);
+    if (rec == NULL && b->rec_count > 0) {
+        b->arena.used = mark;
+        if ((err = builder_spill(b)) != SCRIBE_OK) {
+            return err;
+        }
+        rec = builder_copy(b, path, path_len, hash, seq);
+    }
+    if (rec == NULL) {
+        scribe_arena_reset(&b->arena);
+        return scribe_set_error(SCRIBE_ENOMEM, "snapshot path does not fit the memory budget");
+    }
+    if (b->rec_count == b->rec_cap) {
+        size_t cap = b->rec_cap == 0 ? 1024u : b->rec_cap * 2u;
+        snapshot_rec **recs;
+        if (cap > b->rec_budget) {
+            cap = b->rec_budget;
+        }
+        recs = (snapshot_rec **)realloc(b->recs, cap * sizeof(*recs));
+        if (recs == NULL) {
+            return scribe_set_error(SCRIBE_ENOMEM, "failed to grow snapshot record list");
+        }
+        b->recs = recs;
+        b->rec_cap = cap;
+    }
+    b->recs[b->rec_count++] = rec;
+    b->total++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Returns the number of records added so far, counting repeated paths.
+ */
+size_t scribe_snapshot_builder_count(const scribe_snapshot_builder *b) { return b == NULL ? 0 : b->total; }
+
+/*
+ * Merges the oldest runs into one until at most SNAPSHOT_MERGE_FANIN remain,
+ * so the final merge keeps a bounded number of files and buffers open.
+ */
+static scribe_error_t builder_reduce_runs(scribe_snapshot_builder *b) {
+    while (b->run_count > SNAPSHOT_MERGE_FANIN) {
+        FILE *merged = NULL;
+        size_t i;
+        scribe_error_t err = run_create(b->ctx, &merged);
+
+        if (err == SCRIBE_OK) {
+            err = merge_runs(b->runs, SNAPSHOT_MERGE_FANIN, b->sharded, run_sink, merged);
+        }
+        if (err != SCRIBE_OK) {
+            if (merged != NULL) {
+                fclose(merged);
+            }
+            return err;
+        }
+        for (i = 0; i < SNAPSHOT_MERGE_FANIN; i++) {
+            fclose(b->runs[i]);
+        }
+        memmove(b->runs, b->runs + SNAPSHOT_MERGE_FANIN, (b->run_count - SNAPSHOT_MERGE_FANIN) * sizeof(*b->runs));
+        b->run_count -= SNAPSHOT_MERGE_FANIN;
+        b->runs[b->run_count++] = merged;
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Writes the complete tree described by every added record and returns its
+ * root hash. When nothing was spilled the records are sorted in memory;
+ * otherwise they become the last run and all runs are merged. An empty builder
+ * produces the empty root tree.
+ */
+scribe_error_t scribe_snapshot_builder_finish(scribe_snapshot_builder *b, uint8_t out_root[SCRIBE_HASH_SIZE]) {
+    tree_stream stream;
+    size_t i;
+    scribe_error_t err;
+
+    if (b == NULL || out_root == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "invalid snapshot builder argument");
+    }
+    if (b->run_count > 0 && b->rec_count > 0 && (err = builder_spill(b)) != SCRIBE_OK) {
+        return err;
+    }
+    if ((err = builder_reduce_runs(b)) != SCRIBE_OK) {
+        return err;
+    }
+    if ((err = stream_init(&stream, b->ctx)) != SCRIBE_OK) {
+        return stream_finish(&stream, err, out_root);
+    }
+    if (b->run_count > 0) {
+        scribe_log_msg(b->ctx, SCRIBE_LOG_DEBUG, "snapshot", "merging %zu sorted run(s) of %zu record(s)",
+                       b->run_count, b->total);
+        err = merge_runs(b->runs, b->run_count, b->sharded, stream_sink, &stream);
+    } else {
+        if (b->rec_count > 1u) {
+            qsort(b->recs, b->rec_count, sizeof(b->recs[0]), rec_ptr_cmp);
+        }
+        for (i = 0; err == SCRIBE_OK && i < b->rec_count; i++) {
+            err = stream_sink(&stream, b->recs[i]);
+        }
+    }
+    return stream_finish(&stream, err, out_root);
+}
+
+/*
+ * Releases a builder, closing (and thereby deleting) any spilled runs.
+ */
+void scribe_snapshot_builder_free(scribe_snapshot_builder *b) {
+    size_t i;
+
+    if (b == NULL) {
+        return;
+    }
+    for (i = 0; i < b->run_count; i++) {
+        fclose(b->runs[i]);
+    }
+    free(b->runs);
+    free(b->recs);
+    scribe_arena_destroy(&b->arena);
+    free(b);
+}
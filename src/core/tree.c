@@ -18,7 +18,7 @@
  * Compares two tree entries by raw name bytes, then by length when one name is
  * a prefix of the other. This defines the canonical storage order for trees.
  */
-static int entry_cmp(const void *a, const void *b) {
+int scribe_tree_entry_compare(const void *a, const void *b) {
     const scribe_tree_entry *ea = (const scribe_tree_entry *)a;
     const scribe_tree_entry *eb = (const scribe_tree_entry *)b;
     size_t min = ea->name_len < eb->name_len ? ea->name_len : eb->name_len;
@@ -36,13 +36,13 @@ static int entry_cmp(const void *a, const void *b) {
 }
 
 /*
- * Serializes an entry array into the canonical tree payload. The caller may
- * provide entries in any order; this function sorts a copy, validates names and
- * types, rejects duplicates, and writes the compact binary entry sequence.
+ * Serializes an entry array into the canonical tree payload. Callers provide
+ * entries already in canonical order; this function validates names, types,
+ * and strict ordering (which also rejects duplicates) and writes the compact
+ * binary entry sequence without copying or sorting the entries.
  */
 scribe_error_t scribe_tree_serialize(const scribe_tree_entry *entries, size_t count, scribe_arena *arena, uint8_t **out,
                                      size_t *out_len) {
-    scribe_tree_entry *sorted;
     size_t i;
     size_t len = 0;
     uint8_t *buf;
@@ -52,29 +52,22 @@ scribe_error_t scribe_tree_serialize(const scribe_tree_entry *entries, size_t co
         return scribe_set_error(SCRIBE_EINVAL, "invalid tree serialization");
     }
     /*
-     * Tree objects are canonical: callers may provide entries in any order, but
-     * the serialized payload is sorted byte-for-byte by name and rejects
-     * duplicates. This makes identical logical trees hash identically and keeps
-     * diff/log walks deterministic.
+     * Tree objects are canonical: the serialized payload is sorted byte-for-byte
+     * by name with no duplicates. This makes identical logical trees hash
+     * identically and keeps diff/log walks deterministic. Every writer already
+     * produces sorted entries (the commit builder merges edits into sorted
+     * nodes, the snapshot writer streams sorted records), so order is checked
+     * here rather than imposed with a sort.
      */
-    sorted = (scribe_tree_entry *)scribe_arena_alloc(arena, sizeof(*sorted) * (count == 0 ? 1u : count),
-                                                     _Alignof(scribe_tree_entry));
-    if (sorted == NULL) {
-        return SCRIBE_ENOMEM;
-    }
-    if (count != 0) {
-        memcpy(sorted, entries, sizeof(*sorted) * count);
-        qsort(sorted, count, sizeof(*sorted), entry_cmp);
-    }
     for (i = 0; i < count; i++) {
         uint8_t leb[10];
         size_t leb_len;
-        if ((sorted[i].type != SCRIBE_OBJECT_BLOB && sorted[i].type != SCRIBE_OBJECT_TREE) || sorted[i].name == NULL ||
-            sorted[i].name_len == 0) {
+        if ((entries[i].type != SCRIBE_OBJECT_BLOB && entries[i].type != SCRIBE_OBJECT_TREE) || entries[i].name == NULL ||
+            entries[i].name_len == 0) {
             return scribe_set_error(SCRIBE_EINVAL, "invalid tree entry");
         }
-        if (i > 0 && entry_cmp(&sorted[i - 1u], &sorted[i]) == 0) {
-            return scribe_set_error(SCRIBE_EINVAL, "duplicate tree entry name");
+        if (i > 0 && scribe_tree_entry_compare(&entries[i - 1u], &entries[i]) >= 0) {
+            return scribe_set_error(SCRIBE_EINVAL, "tree entries are not strictly sorted");
         }
         /*
          * Entry payload format:
@@ -82,8 +75,8 @@ scribe_error_t scribe_tree_serialize(const scribe_tree_entry *entries, size_t co
          * Names are not NUL-terminated on disk; parse creates arena-owned
          * NUL-terminated copies for C convenience.
          */
-        leb_len = scribe_leb128_encode((uint64_t)sorted[i].name_len, leb);
-        len += 1u + SCRIBE_HASH_SIZE + leb_len + sorted[i].name_len;
+        leb_len = scribe_leb128_encode((uint64_t)entries[i].name_len, leb);
+        len += 1u + SCRIBE_HASH_SIZE + leb_len + entries[i].name_len;
     }
     buf = (uint8_t *)scribe_arena_alloc(arena, len == 0 ? 1u : len, _Alignof(uint8_t));
     if (buf == NULL) {
@@ -91,14 +84,14 @@ scribe_error_t scribe_tree_serialize(const scribe_tree_entry *entries, size_t co
     }
     for (i = 0; i < count; i++) {
         uint8_t leb[10];
-        size_t leb_len = scribe_leb128_encode((uint64_t)sorted[i].name_len, leb);
-        buf[off++] = sorted[i].type;
-        memcpy(buf + off, sorted[i].hash, SCRIBE_HASH_SIZE);
+        size_t leb_len = scribe_leb128_encode((uint64_t)entries[i].name_len, leb);
+        buf[off++] = entries[i].type;
+        memcpy(buf + off, entries[i].hash, SCRIBE_HASH_SIZE);
         off += SCRIBE_HASH_SIZE;
         memcpy(buf + off, leb, leb_len);
         off += leb_len;
-        memcpy(buf + off, sorted[i].name, sorted[i].name_len);
-        off += sorted[i].name_len;
+        memcpy(buf + off, entries[i].name, entries[i].name_len);
+        off += entries[i].name_len;
     }
     *out = buf;
     *out_len = len;
@@ -188,7 +181,7 @@ scribe_error_t scribe_tree_parse(const uint8_t *payload, size_t len, scribe_aren
          * out-of-order entry is corrupt. Enforcing this during parse lets later
          * code use simple merge walks without defensive duplicate resolution.
          */
-        if (count > 0 && entry_cmp(&entries[count - 1u], &entries[count]) >= 0) {
+        if (count > 0 && scribe_tree_entry_compare(&entries[count - 1u], &entries[count]) >= 0) {
             return scribe_set_error(SCRIBE_ECORRUPT, "tree entries are not strictly sorted");
         }
         count++;
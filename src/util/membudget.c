@@ -0,0 +1,174 @@
+/*
+ * Process-wide memory budget shared by queues, batches, and bulk loaders.
+ *
+ * Components that hold data proportional to their input reserve its size here
+ * before keeping it and release it when done. With a zero limit the budget only
+ * keeps statistics. With a positive limit, a blocking reservation waits until
+ * enough bytes are released, so producers stall instead of the process growing
+ * without bound. A reservation larger than the whole limit is admitted once
+ * nothing else is reserved, so one oversized item slows the pipeline down but
+ * cannot deadlock it. By the same rule, a holder growing an item it cannot
+ * split, such as an open transaction, goes on once every reserved byte
+ * belongs to holders that are blocked growing theirs.
+ */
+#include "util/membudget.h"
+
+#include "util/error.h"
+
+#include <errno.h>
+#include <time.h>
+
+/*
+ * Initializes an empty budget. `stall_warn_seconds` is how long a blocked
+ * reservation waits before the budget records a stall for callers to report.
+ */
+scribe_error_t scribe_mem_budget_init(scribe_mem_budget *m, size_t limit, int stall_warn_seconds) {
+    if (m == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "memory budget is NULL");
+    }
+    m->limit = limit;
+    m->reserved = 0;
+    m->peak = 0;
+    m->waits = 0;
+    m->growing = 0;
+    m->stall_warn_seconds = stall_warn_seconds;
+    m->warned_stall = 0;
+    if (pthread_mutex_init(&m->mu, NULL) != 0) {
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize memory budget");
+    }
+    if (pthread_cond_init(&m->released, NULL) != 0) {
+        pthread_mutex_destroy(&m->mu);
+        return scribe_set_error(SCRIBE_ERR, "failed to initialize memory budget");
+    }
+    return SCRIBE_OK;
+}
+
+/*
+ * Destroys the budget's synchronization primitives. Every reservation must
+ * have been released.
+ */
+void scribe_mem_budget_destroy(scribe_mem_budget *m) {
+    if (m != NULL) {
+        pthread_cond_destroy(&m->released);
+        pthread_mutex_destroy(&m->mu);
+    }
+}
+
+/*
+ * Returns whether `bytes` fit next to the current reservations. Called with
+ * the mutex held.
+ */
+static int fits(const scribe_mem_budget *m, size_t bytes) {
+    return m->limit == 0 || m->reserved == 0 || (bytes <= m->limit && m->reserved <= m->limit - bytes);
+}
+
+/*
+ * Records a granted reservation. Called with the mutex held.
+ */
+static void grant(scribe_mem_budget *m, size_t bytes) {
+    m->reserved = bytes > SIZE_MAX - m->reserved ? SIZE_MAX : m->reserved + bytes;
+    if (m->reserved > m->peak) {
+        m->peak = m->reserved;
+    }
+}
+
+/*
+ * Returns whether a holder of `held` bytes may add `bytes`: when they fit, or
+ * when every reserved byte is held by growers blocked in
+ * scribe_mem_reserve_more(), whom no release will wake. Called with the mutex
+ * held.
+ */
+static int fits_growth(const scribe_mem_budget *m, size_t held, size_t bytes) {
+    return fits(m, bytes) || (held != 0 && m->reserved <= m->growing);
+}
+
+/*
+ * Reserves `bytes`, blocking while the budget is full. A wait longer than the
+ * stall threshold sets warned_stall, like the SPSC queue does for full pushes.
+ */
+scribe_error_t scribe_mem_reserve(scribe_mem_budget *m, size_t bytes) {
+    return scribe_mem_reserve_more(m, 0, bytes);
+}
+
+/*
+ * Reserves `bytes` on top of the `held` bytes the caller already has reserved
+ * for an item it cannot give back in part, blocking while the budget is full.
+ * It waits only for other holders: once the reserved bytes are the caller's
+ * own, or those of callers also blocked here, the reservation is admitted over
+ * the limit instead of waiting on itself.
+ */
+scribe_error_t scribe_mem_reserve_more(scribe_mem_budget *m, size_t held, size_t bytes) {
+    size_t growing = 0;
+
+    if (m == NULL) {
+        return scribe_set_error(SCRIBE_EINVAL, "memory budget is NULL");
+    }
+    pthread_mutex_lock(&m->mu);
+    if (!fits_growth(m, held, bytes)) {
+        m->waits++;
+        growing = held;
+        m->growing += growing;
+        /* Other growers may now hold everything that is reserved. */
+        pthread_cond_broadcast(&m->released);
+    }
+    while (!fits_growth(m, held, bytes)) {
+        if (m->stall_warn_seconds > 0) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += m->stall_warn_seconds;
+            if (pthread_cond_timedwait(&m->released, &m->mu, &deadline) == ETIMEDOUT) {
+                m->warned_stall = 1;
+            }
+        } else {
+            pthread_cond_wait(&m->released, &m->mu);
+        }
+    }
+    m->growing -= growing;
+    grant(m, bytes);
+    pthread_mutex_unlock(&m->mu);
+    return SCRIBE_OK;
+}
+
+/*
+ * Reserves `bytes` only if they fit right now. Returns 1 on success and 0 when
+ * the caller should release something, or flush, before trying again.
+ */
+int scribe_mem_try_reserve(scribe_mem_budget *m, size_t bytes) {
+    int ok;
+
+    if (m == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&m->mu);
+    ok = fits(m, bytes);
+    if (ok) {
+        grant(m, bytes);
+    }
+    pthread_mutex_unlock(&m->mu);
+    return ok;
+}
+
+/*
+ * Returns `bytes` to the budget and wakes blocked reservations.
+ */
+void scribe_mem_release(scribe_mem_budget *m, size_t bytes) {
+    if (m == NULL || bytes == 0) {
+        return;
+    }
+    pthread_mutex_lock(&m->mu);
+    m->reserved = bytes > m->reserved ? 0 : m->reserved - bytes;
+    pthread_cond_broadcast(&m->released);
+    pthread_mutex_unlock(&m->mu);
+}
+
+/*
+ * Copies a consistent snapshot of the budget's counters.
+ */
+void scribe_mem_budget_stats(scribe_mem_budget *m, scribe_mem_stats *out) {
+    pthread_mutex_lock(&m->mu);
+    out->limit = m->limit;
+    out->reserved = m->reserved;
+    out->peak = m->peak;
+    out->waits = m->waits;
+    pthread_mutex_unlock(&m->mu);
+}
@@ -0,0 +1,37 @@
+#ifndef SCRIBE_UTIL_MEMBUDGET_H
+#define SCRIBE_UTIL_MEMBUDGET_H
+
+#include "scribe/scribe.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    size_t limit;
+    size_t reserved;
+    size_t peak;
+    uint64_t waits;
+    size_t growing;
+    int stall_warn_seconds;
+    int warned_stall;
+    pthread_mutex_t mu;
+    pthread_cond_t released;
+} scribe_mem_budget;
+
+typedef struct {
+    size_t limit;
+    size_t reserved;
+    size_t peak;
+    uint64_t waits;
+} scribe_mem_stats;
+
+scribe_error_t scribe_mem_budget_init(scribe_mem_budget *m, size_t limit, int stall_warn_seconds);
+void scribe_mem_budget_destroy(scribe_mem_budget *m);
+scribe_error_t scribe_mem_reserve(scribe_mem_budget *m, size_t bytes);
+scribe_error_t scribe_mem_reserve_more(scribe_mem_budget *m, size_t held, size_t bytes);
+int scribe_mem_try_reserve(scribe_mem_budget *m, size_t bytes);
+void scribe_mem_release(scribe_mem_budget *m, size_t bytes);
+void scribe_mem_budget_stats(scribe_mem_budget *m, scribe_mem_stats *out);
+
+#endif
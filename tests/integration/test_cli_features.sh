@@ -251,6 +251,18 @@ grep -F '  M db/users/bob' "$LOG_ROOT/alice-full-paths" >/dev/null ||
 grep -F '  A db/users/alice' "$LOG_ROOT/alice-full-paths" >/dev/null ||
     fail "initial commit with --paths did not list alice as added"
 
+[ -s "$LOG_STORE/objects/info/commit-stats" ] || fail "commits did not record change summaries"
+"$BIN" --store "$LOG_STORE" log --stat >"$LOG_ROOT/stat-stored"
+grep -F '  +1 ~0 -0  db/audit' "$LOG_ROOT/stat-stored" >/dev/null ||
+    fail "log --stat did not summarize the unrelated collection"
+"$BIN" --store "$LOG_STORE" log --oneline --stat -n 1 -- db/users/alice | grep -F '[+0 ~2 -0]' >/dev/null ||
+    fail "--oneline --stat did not append change totals"
+"$BIN" --store "$LOG_STORE" show HEAD | grep -F '1 prefix(es) changed, +1 ~0 -0' >/dev/null ||
+    fail "show did not print the change summary"
+rm "$LOG_STORE/objects/info/commit-stats"
+"$BIN" --store "$LOG_STORE" log --stat >"$LOG_ROOT/stat-computed"
+cmp -s "$LOG_ROOT/stat-stored" "$LOG_ROOT/stat-computed" || fail "log --stat differs without stored summaries"
+
 LARGE_ROOT=$(mktemp -d)
 LARGE_STORE="$LARGE_ROOT/.scribe"
 LARGE_COUNT=5000
@@ -298,4 +310,433 @@ printf '{"v":1}' >"$LARGE_ROOT/expected-large-v1"
 cmp -s "$LARGE_ROOT/expected-large-v1" "$LARGE_ROOT/show-large-v1" ||
     fail "large tree update did not preserve updated blob"
 
+repack_out=$("$BIN" --store "$LARGE_STORE" repack)
+[ "$repack_out" = "repack: 0 listed, 0 recompressed, 0 -> 0 bytes" ] ||
+    fail "repack without fast-written objects should be a no-op"
+"$BIN" --store "$LARGE_STORE" list-objects --reachable | sort >"$LARGE_ROOT/reachable-walk"
+"$BIN" --store "$LARGE_STORE" repack --write-bitmap | grep -E '^bitmaps: 1 written, [0-9]+ objects indexed$' >/dev/null ||
+    fail "repack --write-bitmap did not report the bitmapped commits"
+"$BIN" --store "$LARGE_STORE" list-objects --reachable | sort >"$LARGE_ROOT/reachable-bitmap"
+cmp -s "$LARGE_ROOT/reachable-walk" "$LARGE_ROOT/reachable-bitmap" ||
+    fail "bitmap-assisted list-objects --reachable differs from the full walk"
+"$BIN" --store "$LARGE_STORE" repack --incremental | grep -Fx 'bitmaps: 0 written, 0 objects indexed' >/dev/null ||
+    fail "repack --incremental with no new commits should add nothing"
+
+durability_batch() {
+    printf 'BATCH\t1\t1\n'
+    printf 'AUTHOR\ttester\t\ttest\n'
+    printf 'COMMITTER\tscribe-test\t\tscribe\n'
+    printf 'PROCESS\tcli-test\t1\t\tdurability\n'
+    printf 'TIMESTAMP\t%s\n' "$1"
+    printf 'MESSAGE\t0\n'
+    printf 'EVENT\t3\t7\n'
+    printf 'db\nusers\na\n'
+    printf '{"v":%s}' "$1"
+    printf 'END\n'
+}
+
+crash_commit() {
+    crash_status=0
+    durability_batch "$3" | SCRIBE_CRASH_AT=$2 "$BIN" --store "$1" commit-batch >/dev/null 2>&1 || crash_status=$?
+    [ "$crash_status" = "86" ] || fail "$1: crash point $2 was not reached"
+}
+
+DUR_ROOT=$(mktemp -d)
+for mode in strict batch relaxed; do
+    DSTORE="$DUR_ROOT/$mode"
+    "$BIN" init "$DSTORE" >/dev/null
+    printf 'durability = %s\ndurability_sync_seconds = 60\n' "$mode" >>"$DSTORE/config"
+    durability_batch 1 | "$BIN" --store "$DSTORE" commit-batch >/dev/null
+    d1=$(cat "$DSTORE/refs/heads/main")
+    [ ! -e "$DSTORE/objects/info/unsynced" ] || fail "$mode: clean exit left the unsynced marker"
+
+    for point in commit-before-barrier commit-before-ref; do
+        crash_commit "$DSTORE" "$point" 2
+        [ "$(cat "$DSTORE/refs/heads/main")" = "$d1" ] || fail "$mode: ref moved before $point"
+        "$BIN" --store "$DSTORE" fsck >/dev/null || fail "$mode: fsck failed after crash at $point"
+    done
+
+    crash_commit "$DSTORE" commit-after-ref 2
+    if [ "$mode" = "relaxed" ]; then
+        [ "$(cat "$DSTORE/refs/heads/main")" = "$d1" ] || fail "relaxed: ref was published before a sync"
+    else
+        [ "$(cat "$DSTORE/refs/heads/main")" != "$d1" ] || fail "$mode: committed ref was lost"
+    fi
+    "$BIN" --store "$DSTORE" fsck >/dev/null || fail "$mode: fsck failed after crash past the ref update"
+
+    : >"$DUR_ROOT/torn"
+    if [ "$mode" != "strict" ]; then
+        # Emulate a power loss: a writer dies before its barrier, and every
+        # object file it created comes back torn. Listing before and after
+        # avoids relying on timestamps finer than the filesystem keeps.
+        find "$DSTORE/objects" -type f ! -path '*/info/*' | sort >"$DUR_ROOT/before"
+        crash_commit "$DSTORE" commit-before-barrier 7
+        [ -e "$DSTORE/objects/info/unsynced" ] || fail "$mode: crash did not leave the unsynced marker"
+        find "$DSTORE/objects" -type f ! -path '*/info/*' | sort | comm -13 "$DUR_ROOT/before" - >"$DUR_ROOT/torn"
+        [ -s "$DUR_ROOT/torn" ] || fail "$mode: the power-loss step truncated no object files"
+        while IFS= read -r torn; do : >"$torn"; done <"$DUR_ROOT/torn"
+    fi
+    durability_batch 3 | "$BIN" --store "$DSTORE" commit-batch >/dev/null 2>&1 ||
+        fail "$mode: commit after crash failed"
+    while IFS= read -r torn; do
+        [ ! -e "$torn" ] || fail "$mode: recovery kept torn object $torn"
+    done <"$DUR_ROOT/torn"
+    [ "$(cat "$DSTORE/refs/heads/main")" != "$d1" ] || fail "$mode: ref was not published at exit"
+    [ ! -e "$DSTORE/objects/info/unsynced" ] || fail "$mode: recovery left the unsynced marker"
+    "$BIN" --store "$DSTORE" fsck >/dev/null || fail "$mode: fsck failed after recovery"
+    [ "$("$BIN" --store "$DSTORE" show HEAD:db/users/a)" = '{"v":3}' ] || fail "$mode: recovered HEAD is wrong"
+done
+
+crash_commit "$DUR_ROOT/relaxed" sync-before-publish 4
+relaxed_head=$(cat "$DUR_ROOT/relaxed/refs/heads/main")
+[ "$("$BIN" --store "$DUR_ROOT/relaxed" show "$relaxed_head:db/users/a")" = '{"v":3}' ] ||
+    fail "relaxed: ref was published before its final sync completed"
+
+partition_batch() {
+    ts=$1
+    shift
+    printf 'BATCH\t1\t%s\n' "$#"
+    printf 'AUTHOR\ttester\t\ttest\n'
+    printf 'COMMITTER\tscribe-test\t\tscribe\n'
+    printf 'PROCESS\tcli-test\t1\t\tpartition\n'
+    printf 'TIMESTAMP\t%s\n' "$ts"
+    printf 'MESSAGE\t0\n'
+    for db in "$@"; do
+        printf 'EVENT\t3\t9\n'
+        printf '%s\nusers\nd%s\n' "$db" "$ts"
+        printf '{"v":%03d}' "$ts"
+    done
+    printf 'END\n'
+}
+
+partition_stream() {
+    for i in 1 2 3 4 5 6 7 8; do
+        partition_batch "$i" a b
+        partition_batch "$((i + 100))" c
+        partition_batch "$((i + 200))" a c d
+    done
+}
+
+PART_ROOT=$(mktemp -d)
+"$BIN" init "$PART_ROOT/plain" >/dev/null
+"$BIN" init "$PART_ROOT/part" >/dev/null
+printf 'ref_partitioning = database\npartition_publish_ms = 10\n' >>"$PART_ROOT/part/config"
+partition_stream | "$BIN" --store "$PART_ROOT/plain" commit-batch >"$PART_ROOT/plain.out"
+partition_stream | "$BIN" --store "$PART_ROOT/part" commit-batch >"$PART_ROOT/part.out"
+[ "$(grep -c '^OK' "$PART_ROOT/part.out")" = "24" ] || fail "partitioned writer did not ack every batch"
+# Each batch gets its own commit on main, identical to the one a main-only writer makes.
+cmp -s "$PART_ROOT/plain.out" "$PART_ROOT/part.out" || fail "partitioned acks differ from per-batch main commits"
+[ "$(tail -n 1 "$PART_ROOT/part.out")" = "OK	$(cat "$PART_ROOT/part/refs/heads/main")" ] ||
+    fail "last partitioned ack is not the published main commit"
+[ -z "$(ls "$PART_ROOT/part/refs/partitions")" ] || fail "partition refs survived a clean exit"
+for s in plain part; do
+    "$BIN" --store "$PART_ROOT/$s" ls-tree "$(cat "$PART_ROOT/$s/refs/heads/main")" >"$PART_ROOT/$s.tree"
+done
+cmp -s "$PART_ROOT/plain.tree" "$PART_ROOT/part.tree" || fail "partitioned store content differs from main-only store"
+"$BIN" --store "$PART_ROOT/part" fsck >/dev/null || fail "fsck failed on partitioned store"
+
+# A crash after the first partition commit leaves its ref for the next writer to fold.
+crash_status=0
+partition_batch 9 e | SCRIBE_CRASH_AT=commit-after-ref "$BIN" --store "$PART_ROOT/part" commit-batch >/dev/null 2>&1 ||
+    crash_status=$?
+[ "$crash_status" = "86" ] || fail "partitioned crash point was not reached"
+[ -n "$(ls "$PART_ROOT/part/refs/partitions")" ] || fail "crash did not leave a partition ref"
+"$BIN" --store "$PART_ROOT/part" fsck >/dev/null || fail "fsck failed with a leftover partition ref"
+partition_batch 10 a | "$BIN" --store "$PART_ROOT/part" commit-batch >/dev/null 2>&1 ||
+    fail "commit after partitioned crash failed"
+[ -z "$(ls "$PART_ROOT/part/refs/partitions")" ] || fail "leftover partition ref was not folded"
+[ "$("$BIN" --store "$PART_ROOT/part" show HEAD:e/users/d9)" = '{"v":009}' ] || fail "folded partition is missing"
+[ "$("$BIN" --store "$PART_ROOT/part" show HEAD:a/users/d10)" = '{"v":010}' ] || fail "commit after fold is missing"
+
+DAEMON_ROOT=$(mktemp -d)
+"$BIN" init "$DAEMON_ROOT/store" >/dev/null
+"$BIN" --store "$DAEMON_ROOT/store" daemon --socket "$DAEMON_ROOT/sock" >"$DAEMON_ROOT/daemon.out" 2>/dev/null &
+daemon_pid=$!
+for _ in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+    [ -S "$DAEMON_ROOT/sock" ] && break
+    sleep 0.1
+done
+[ -S "$DAEMON_ROOT/sock" ] || fail "daemon did not create its socket"
+client_pids=""
+for db in a b c; do
+    (for i in 1 2 3 4 5 6 7 8 9 10; do partition_batch "$i" "$db"; done) |
+        "$BIN" commit-batch --socket "$DAEMON_ROOT/sock" >"$DAEMON_ROOT/$db.out" &
+    client_pids="$client_pids $!"
+done
+for pid in $client_pids; do
+    wait "$pid" || fail "daemon client failed"
+done
+for db in a b c; do
+    [ "$(grep -c '^OK' "$DAEMON_ROOT/$db.out")" = "10" ] || fail "daemon did not ack every batch of client $db"
+done
+daemon_status=0
+printf 'NOPE\n' | "$BIN" commit-batch --socket "$DAEMON_ROOT/sock" >"$DAEMON_ROOT/bad.out" || daemon_status=$?
+[ "$daemon_status" != "0" ] || fail "daemon client accepted a malformed frame"
+grep -q '^ERR	SCRIBE_EPROTOCOL	' "$DAEMON_ROOT/bad.out" || fail "daemon did not relay the protocol error"
+kill -TERM "$daemon_pid"
+wait "$daemon_pid" || fail "daemon did not stop cleanly"
+[ ! -e "$DAEMON_ROOT/sock" ] || fail "daemon left its socket behind"
+grep -E '^daemon: 4 sessions, 30 batches, [0-9]+ group commits$' "$DAEMON_ROOT/daemon.out" >/dev/null ||
+    fail "daemon summary is wrong"
+[ "$("$BIN" --store "$DAEMON_ROOT/store" log --oneline | wc -l)" -eq 30 ] || fail "daemon did not write one commit per batch"
+[ "$("$BIN" --store "$DAEMON_ROOT/store" show HEAD:c/users/d10)" = '{"v":010}' ] || fail "daemon lost a batch"
+"$BIN" --store "$DAEMON_ROOT/store" fsck >/dev/null || fail "fsck failed after daemon run"
+
+compact_batch() {
+    printf 'BATCH\t1\t1\n'
+    printf 'AUTHOR\ttester\t\ttest\n'
+    printf 'COMMITTER\tscribe-test\t\tscribe\n'
+    printf 'PROCESS\tcli-test\t1\t\tcompact\n'
+    printf 'TIMESTAMP\t%s000000000\n' "$1"
+    printf 'MESSAGE\t0\n'
+    printf 'EVENT\t3\t9\n'
+    printf 'db\nusers\na\n'
+    printf '{"v":%03d}' "$2"
+    printf 'END\n'
+}
+
+COMPACT_ROOT=$(mktemp -d)
+"$BIN" init "$COMPACT_ROOT/store" >/dev/null
+now=$(date +%s)
+# Twelve commits ten minutes apart fill hour windows 0 and 1 and start window 2;
+# the last three are recent and survive as copies.
+{
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12; do compact_batch "$((i * 600))" "$i"; done
+    for i in 13 14 15; do compact_batch "$now" "$i"; done
+} | "$BIN" --store "$COMPACT_ROOT/store" commit-batch >/dev/null
+compact_head=$(cat "$COMPACT_ROOT/store/refs/heads/main")
+"$BIN" --store "$COMPACT_ROOT/store" ls-tree "$compact_head" >"$COMPACT_ROOT/before.tree"
+"$BIN" --store "$COMPACT_ROOT/store" compact-history --older-than 1d --granularity 1h >"$COMPACT_ROOT/map" 2>/dev/null ||
+    fail "compact-history failed"
+[ "$(wc -l <"$COMPACT_ROOT/map")" -eq 15 ] || fail "compact-history did not map every rewritten commit"
+[ "$(cut -d ' ' -f 2 "$COMPACT_ROOT/map" | sort -u | wc -l)" -eq 6 ] || fail "compact-history wrote the wrong chain"
+[ "$(grep "^$compact_head " "$COMPACT_ROOT/map" | cut -d ' ' -f 2)" = "$(cat "$COMPACT_ROOT/store/refs/heads/main")" ] ||
+    fail "map does not lead to the new head"
+"$BIN" --store "$COMPACT_ROOT/store" ls-tree "$(cat "$COMPACT_ROOT/store/refs/heads/main")" |
+    cmp -s - "$COMPACT_ROOT/before.tree" || fail "compaction changed the head tree"
+[ "$("$BIN" --store "$COMPACT_ROOT/store" show HEAD~4:db/users/a)" = '{"v":011}' ] ||
+    fail "window commit does not hold the window's last state"
+[ "$("$BIN" --store "$COMPACT_ROOT/store" show HEAD~3:db/users/a)" = '{"v":012}' ] ||
+    fail "single-commit window was not kept"
+"$BIN" --store "$COMPACT_ROOT/store" show HEAD~5 | grep -F 'compact-history' | grep -F 'granularity=1h' >/dev/null ||
+    fail "window commit metadata is wrong"
+# The header line plus the five commits of window 0.
+[ "$("$BIN" --store "$COMPACT_ROOT/store" show HEAD~5 | grep -c '^commit ')" -eq 6 ] ||
+    fail "window commit does not list the commits it replaced"
+"$BIN" --store "$COMPACT_ROOT/store" fsck | grep -E '^fsck: [0-9]+ reachable objects, [1-9][0-9]* dangling objects$' \
+    >/dev/null || fail "replaced commits are not dangling"
+"$BIN" --store "$COMPACT_ROOT/store" compact-history --older-than 1d --granularity 1h >"$COMPACT_ROOT/map2" 2>/dev/null
+[ ! -s "$COMPACT_ROOT/map2" ] || fail "compacting compacted history rewrote it"
+compact_status=0
+"$BIN" --store "$COMPACT_ROOT/store" compact-history --older-than 1d --granularity 1y 2>/dev/null || compact_status=$?
+[ "$compact_status" != "0" ] || fail "compact-history accepted an invalid duration"
+
+archive_batch() {
+    printf 'BATCH\t1\t2\n'
+    printf 'AUTHOR\ttester\t\ttest\n'
+    printf 'COMMITTER\tscribe-test\t\tscribe\n'
+    printf 'PROCESS\tcli-test\t1\t\tarchive\n'
+    printf 'TIMESTAMP\t%s000000000\n' "$1"
+    printf 'MESSAGE\t0\n'
+    printf 'EVENT\t3\t%s\n' "$((${#archive_pad} + 16))"
+    printf 'db\nusers\na\n'
+    printf '{"v":%03d,"p":"%s"}' "$2" "$archive_pad"
+    printf 'EVENT\t3\t9\n'
+    printf 'db\nusers\nb\n'
+    printf '{"v":%03d}' "$2"
+    printf 'END\n'
+}
+
+ARCHIVE_ROOT=$(mktemp -d)
+"$BIN" init "$ARCHIVE_ROOT/store" >/dev/null
+# Incompressible padding makes each version of a cost a full frame unless it
+# is stored as a delta against the previous one.
+archive_pad=$(head -c 3000 /dev/urandom | base64 | tr -d '\n')
+{
+    for i in $(seq 1 40); do archive_batch "$((i * 600))" "$i"; done
+    for i in 41 42; do archive_batch "$now" "$i"; done
+} | "$BIN" --store "$ARCHIVE_ROOT/store" commit-batch >/dev/null
+"$BIN" --store "$ARCHIVE_ROOT/store" show HEAD~20:db/users/a >"$ARCHIVE_ROOT/before.a"
+"$BIN" --store "$ARCHIVE_ROOT/store" archive --older-than 1d >"$ARCHIVE_ROOT/out" 2>/dev/null || fail "archive failed"
+read -r _ archive_commits _ _ _ _ _ archive_deltas _ archive_before _ archive_after _ <"$ARCHIVE_ROOT/out"
+[ "$archive_commits" -eq 40 ] || fail "archive picked the wrong cold commits"
+[ "$archive_deltas" -gt 40 ] || fail "archive did not store cold versions as deltas"
+[ "$archive_after" -lt "$((archive_before / 3))" ] || fail "archive did not shrink cold history"
+"$BIN" --store "$ARCHIVE_ROOT/store" show HEAD~20:db/users/a | cmp -s - "$ARCHIVE_ROOT/before.a" ||
+    fail "archived blob does not read back"
+[ "$("$BIN" --store "$ARCHIVE_ROOT/store" show HEAD~41:db/users/b)" = '{"v":001}' ] ||
+    fail "oldest archived state does not read back"
+"$BIN" --store "$ARCHIVE_ROOT/store" fsck | grep -E '^fsck: [0-9]+ reachable objects, 0 dangling objects$' \
+    >/dev/null || fail "fsck failed after archive"
+"$BIN" --store "$ARCHIVE_ROOT/store" archive --older-than 1d 2>/dev/null | grep -F ' 0 rewritten, 0 deltas,' \
+    >/dev/null || fail "archiving archived history rewrote it"
+
+# Every commit is cold, so HEAD's own blob is a delta on an older version.
+# Objects outside list-objects --reachable, and after compact-history the
+# objects fsck calls dangling, must be safe to delete.
+ARCHIVE_GC=$(mktemp -d)
+"$BIN" init "$ARCHIVE_GC/store" >/dev/null
+for i in $(seq 1 20); do archive_batch "$((i * 600))" "$i"; done |
+    "$BIN" --store "$ARCHIVE_GC/store" commit-batch >/dev/null
+"$BIN" --store "$ARCHIVE_GC/store" show HEAD:db/users/a >"$ARCHIVE_GC/head.a"
+"$BIN" --store "$ARCHIVE_GC/store" archive --older-than 1d >/dev/null 2>&1 || fail "archive of full history failed"
+delete_objects() {
+    while read -r hex; do rm "$1/objects/$(printf '%s' "$hex" | cut -c 1-2)/$(printf '%s' "$hex" | cut -c 3-)"; done
+}
+cp -R "$ARCHIVE_GC/store" "$ARCHIVE_GC/copy"
+"$BIN" --store "$ARCHIVE_GC/copy" list-objects | cut -d ' ' -f 1 | sort >"$ARCHIVE_GC/all"
+"$BIN" --store "$ARCHIVE_GC/copy" list-objects --reachable | cut -d ' ' -f 1 | sort >"$ARCHIVE_GC/reachable"
+comm -23 "$ARCHIVE_GC/all" "$ARCHIVE_GC/reachable" | delete_objects "$ARCHIVE_GC/copy"
+"$BIN" --store "$ARCHIVE_GC/copy" show HEAD~19:db/users/b >/dev/null 2>&1 ||
+    fail "list-objects --reachable left out a delta base"
+"$BIN" --store "$ARCHIVE_GC/store" compact-history --older-than 1d --granularity 1d >/dev/null 2>&1 ||
+    fail "compact-history of archived history failed"
+"$BIN" --store "$ARCHIVE_GC/store" fsck | sed -n 's/^warning: dangling object //p' >"$ARCHIVE_GC/dangling"
+[ -s "$ARCHIVE_GC/dangling" ] || fail "compact-history left no dangling objects"
+delete_objects "$ARCHIVE_GC/store" <"$ARCHIVE_GC/dangling"
+"$BIN" --store "$ARCHIVE_GC/store" show HEAD:db/users/a | cmp -s - "$ARCHIVE_GC/head.a" ||
+    fail "deleting dangling objects broke an archived blob"
+"$BIN" --store "$ARCHIVE_GC/store" fsck | grep -E '^fsck: [0-9]+ reachable objects, 0 dangling objects$' \
+    >/dev/null || fail "fsck failed after deleting dangling objects"
+
+grep_batch() {
+    printf 'BATCH\t1\t1\n'
+    printf 'AUTHOR\ttester\t\ttest\n'
+    printf 'COMMITTER\tscribe-test\t\tscribe\n'
+    printf 'PROCESS\tcli-test\t1\t\tgrep\n'
+    printf 'TIMESTAMP\t%s000000000\n' "$1"
+    printf 'MESSAGE\t0\n'
+    printf 'EVENT\t3\t%s\n' "${#4}"
+    printf 'db\n%s\n%s\n%s' "$2" "$3" "$4"
+    printf 'END\n'
+}
+
+GREP_ROOT=$(mktemp -d)
+"$BIN" init "$GREP_ROOT/store" >/dev/null
+{
+    grep_batch 1 users a '{"e":"x@y.com"}'
+    grep_batch 2 users b '{"e":"q@y.com"}'
+    grep_batch 3 users a '{"e":"z@y.com"}'
+    grep_batch 4 orders o '{"e":"x@y.com"}'
+    grep_batch 5 users a '{"e":"x@y.com"}'
+} | "$BIN" --store "$GREP_ROOT/store" commit-batch >/dev/null
+"$BIN" --store "$GREP_ROOT/store" log --oneline | awk '{ print $1 }' >"$GREP_ROOT/commits"
+grep_commit() { sed -n "$1p" "$GREP_ROOT/commits"; }
+[ "$("$BIN" --store "$GREP_ROOT/store" grep x@y.com | tr '\n' ' ')" = 'db/orders/o db/users/a ' ] ||
+    fail "grep did not search HEAD"
+printf '%s %s db/users/a\n%s %s db/orders/o\n%s %s db/users/a\n' \
+    "$(grep_commit 5)" "$(grep_commit 4)" "$(grep_commit 2)" "$(grep_commit 1)" "$(grep_commit 1)" \
+    "$(grep_commit 1)" >"$GREP_ROOT/expected"
+"$BIN" --store "$GREP_ROOT/store" grep x@y.com --rev ..HEAD | cmp -s - "$GREP_ROOT/expected" ||
+    fail "grep did not map history hits to first and last commits"
+[ "$("$BIN" --store "$GREP_ROOT/store" grep -E '[qx]@y' --rev HEAD~3..HEAD -- db/users/ | wc -l)" -eq 2 ] ||
+    fail "grep did not honor the range and path prefix"
+[ -z "$("$BIN" --store "$GREP_ROOT/store" grep nobody@y.com --rev ..HEAD)" ] || fail "grep matched a missing pattern"
+[ "$("$BIN" --store "$GREP_ROOT/store" grep x@y.com --rev HEAD~1 | tr '\n' ' ')" = 'db/orders/o ' ] ||
+    fail "grep did not search a single older revision"
+grep_tip=$(grep_commit 1)
+[ "$("$BIN" --store "$GREP_ROOT/store" grep q@y.com --rev HEAD~1..HEAD)" = "$grep_tip $grep_tip db/users/b" ] ||
+    fail "grep range did not stop at its base"
+grep_status=0
+"$BIN" --store "$GREP_ROOT/store" grep x@y.com --rev HEAD..HEAD~1 2>"$GREP_ROOT/range.err" || grep_status=$?
+[ "$grep_status" != "0" ] && grep -F 'is not an ancestor of the range end' "$GREP_ROOT/range.err" >/dev/null ||
+    fail "grep accepted a range whose base is not an ancestor"
+grep_status=0
+"$BIN" --store "$GREP_ROOT/store" grep -E '(' 2>/dev/null || grep_status=$?
+[ "$grep_status" != "0" ] || fail "grep accepted an invalid regex"
+
+PATCH_ROOT=$(mktemp -d)
+"$BIN" init "$PATCH_ROOT/store" >/dev/null
+{
+    grep_batch 1 users a '{"n":1,"t":["x"]}'
+    grep_batch 2 users a '{"n":2,"t":["x","y"]}'
+    grep_batch 3 users b 'not json'
+    grep_batch 4 users b 'still not json'
+} | "$BIN" --store "$PATCH_ROOT/store" commit-batch >/dev/null
+printf '%s\n' 'M db/users/a' '  {"op":"replace","path":"/n","value":2}' '  {"op":"add","path":"/t/1","value":"y"}' \
+    >"$PATCH_ROOT/expected"
+"$BIN" --store "$PATCH_ROOT/store" diff --content HEAD~2 | cmp -s - "$PATCH_ROOT/expected" ||
+    fail "diff --content did not print a JSON Patch"
+"$BIN" --store "$PATCH_ROOT/store" diff --content HEAD | grep -q 'not JSON' ||
+    fail "diff --content did not note a non-JSON document"
+[ "$("$BIN" --store "$PATCH_ROOT/store" log --oneline -p -- db/users/a | grep -c '"op"')" -eq 2 ] ||
+    fail "log -p did not print the filtered path's patch"
+
+EXPORT_ROOT=$(mktemp -d)
+"$BIN" init "$EXPORT_ROOT/store" >/dev/null
+sed -i 's/^worker_threads = .*/worker_threads = 4/' "$EXPORT_ROOT/store/config"
+{
+    i=1
+    while [ "$i" -le 200 ]; do
+        grep_batch "$i" users "d$i" "{\"v\":$i}"
+        i=$((i + 1))
+    done
+    grep_batch 201 orders o '{"o":1}'
+} | "$BIN" --store "$EXPORT_ROOT/store" commit-batch >/dev/null
+"$BIN" --store "$EXPORT_ROOT/store" ls-tree "$("$BIN" --store "$EXPORT_ROOT/store" log -n 1 | awk 'NR == 1 { print $2 }')" |
+    awk -F '\t' '$1 == "blob" && $3 ~ /^db\/users\// { sub(/.*\/d/, "", $3); print "{\"v\":" $3 "}" }' >"$EXPORT_ROOT/expected"
+"$BIN" --store "$EXPORT_ROOT/store" export HEAD --prefix db/users 2>/dev/null | cmp -s - "$EXPORT_ROOT/expected" ||
+    fail "export did not write documents in path order"
+[ "$("$BIN" --store "$EXPORT_ROOT/store" export HEAD~1..HEAD 2>/dev/null)" = '{"op":"A","path":"db/orders/o","doc":{"o":1}}' ] ||
+    fail "export range did not tag the changed document"
+export_status=0
+"$BIN" --store "$EXPORT_ROOT/store" export HEAD --format bson >"$EXPORT_ROOT/bson.out" 2>"$EXPORT_ROOT/bson.err" ||
+    export_status=$?
+[ "$export_status" != "0" ] || fail "export --format bson accepted a JSON document"
+[ ! -s "$EXPORT_ROOT/bson.out" ] || fail "export --format bson wrote output before refusing a JSON store"
+grep -q 'bson-sorted' "$EXPORT_ROOT/bson.err" || fail "export --format bson did not name the required blob format"
+
+INDEX_ROOT=$(mktemp -d)
+"$BIN" init "$INDEX_ROOT/store" >/dev/null
+echo 'index.users.status = true' >>"$INDEX_ROOT/store/config"
+{
+    grep_batch 1 users a '{"status":"new"}'
+    grep_batch 2 users b '{"status":"new"}'
+    grep_batch 3 users a '{"status":"paid"}'
+    grep_batch 4 orders o '{"status":"new"}'
+    grep_batch 5 users b ''
+    grep_batch 6 users a '{"status":"new"}'
+} | "$BIN" --store "$INDEX_ROOT/store" commit-batch >/dev/null
+"$BIN" --store "$INDEX_ROOT/store" log --oneline | awk '{ print $1 }' >"$INDEX_ROOT/commits"
+index_commit() { sed -n "$1p" "$INDEX_ROOT/commits"; }
+[ "$("$BIN" --store "$INDEX_ROOT/store" index query users.status new)" = 'db/users/a' ] ||
+    fail "index query did not answer at HEAD"
+[ "$("$BIN" --store "$INDEX_ROOT/store" index query users.status paid --rev HEAD~1)" = 'db/users/a' ] ||
+    fail "index query did not answer at an older commit"
+printf '%s %s db/users/a
+%s %s db/users/b
+%s %s db/users/a
+' \
+    "$(index_commit 6)" "$(index_commit 5)" "$(index_commit 5)" "$(index_commit 3)" "$(index_commit 1)" \
+    "$(index_commit 1)" >"$INDEX_ROOT/expected"
+"$BIN" --store "$INDEX_ROOT/store" index query users.status new --rev ..HEAD | cmp -s - "$INDEX_ROOT/expected" ||
+    fail "index query did not map a range to first and last commits"
+cp "$INDEX_ROOT/store/objects/info/field-index/users.status" "$INDEX_ROOT/index"
+rm "$INDEX_ROOT/store/objects/info/field-index/users.status"
+"$BIN" --store "$INDEX_ROOT/store" index update | grep -q '^users.status: indexed 6 new commit' ||
+    fail "index update did not rebuild a deleted index"
+cmp -s "$INDEX_ROOT/index" "$INDEX_ROOT/store/objects/info/field-index/users.status" ||
+    fail "rebuilt index differs from the incremental one"
+{
+    printf 'BATCH\t1\t4\nAUTHOR\ttester\t\ttest\nCOMMITTER\tscribe-test\t\tscribe\n'
+    printf 'PROCESS\tcli-test\t1\t\tgrep\nTIMESTAMP\t7000000000\nMESSAGE\t0\n'
+    for doc in c:aaa d:new e:zzz f:new; do
+        value=${doc#*:}
+        printf 'EVENT\t3\t%s\ndb\nusers\n%s\n{"status":"%s"}' "$((13 + ${#value}))" "${doc%%:*}" "$value"
+    done
+    printf 'END\n'
+} | "$BIN" --store "$INDEX_ROOT/store" commit-batch >/dev/null
+[ "$("$BIN" --store "$INDEX_ROOT/store" index query users.status new | tr '\n' ' ')" = 'db/users/a db/users/d db/users/f ' ] ||
+    fail "index query did not find a value among several in one commit"
+[ "$(ls "$INDEX_ROOT/store/objects/info/field-index/values/users.status" | wc -l)" -eq 2 ] ||
+    fail "field index did not add a value file for new commits"
+"$BIN" --store "$INDEX_ROOT/store" index query users.status new --rev ..HEAD~1 | cmp -s - "$INDEX_ROOT/expected" ||
+    fail "index query over value files did not map a range to first and last commits"
+rm -r "$INDEX_ROOT/store/objects/info/field-index/values"
+[ "$("$BIN" --store "$INDEX_ROOT/store" index query users.status new | tr '\n' ' ')" = 'db/users/a db/users/d db/users/f ' ] ||
+    fail "index query needed the value files"
+index_status=0
+"$BIN" --store "$INDEX_ROOT/store" index query users.email x 2>/dev/null || index_status=$?
+[ "$index_status" != "0" ] || fail "index query accepted an unconfigured index"
+
 echo "test_cli_features: passed"
@@ -2,18 +2,26 @@
  * Unit tests for core Scribe utilities and repository behavior.
  *
  * These tests exercise low-level encoders, hash helpers, arena allocation,
- * canonical tree serialization, the SPSC queue, repository commits, fsck, the
- * pipe protocol, and object iteration without requiring MongoDB.
+ * canonical tree serialization, the SPSC queue, the memory budget, repository
+ * commits, fsck, the pipe protocol, object iteration, adaptive compression and
+ * repack, sharded trees, sorted-BSON rendering, structural JSON diff,
+ * external-sort snapshot assembly, and daemon-hosted sessions without
+ * requiring MongoDB.
  */
 #include "core/internal.h"
 #include "util/arena.h"
+#include "util/error.h"
 #include "util/hex.h"
 #include "util/leb128.h"
+#include "util/membudget.h"
 #include "util/queue.h"
 #include "unity.h"
 
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 /*
@@ -88,10 +96,10 @@ void test_arena_alloc_reset(void) {
 }
 
 /*
- * Verifies that tree serialization sorts entries by name and that parsing
- * preserves that canonical order.
+ * Verifies that tree serialization rejects entries out of canonical order or
+ * duplicated, and that parsing preserves the canonical order of sorted input.
  */
-void test_tree_serialization_is_sorted(void) {
+void test_tree_serialization_requires_sorted_entries(void) {
     scribe_arena arena;
     scribe_tree_entry entries[2];
     uint8_t *payload = NULL;
@@ -110,6 +118,10 @@ void test_tree_serialization_is_sorted(void) {
     memset(entries[1].hash, 2, SCRIBE_HASH_SIZE);
 
     TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_arena_init(&arena, 1024));
+    TEST_ASSERT_EQUAL(SCRIBE_EINVAL, scribe_tree_serialize(entries, 2, &arena, &payload, &payload_len));
+    entries[0].name = "a";
+    TEST_ASSERT_EQUAL(SCRIBE_EINVAL, scribe_tree_serialize(entries, 2, &arena, &payload, &payload_len));
+    entries[1].name = "z";
     TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_serialize(entries, 2, &arena, &payload, &payload_len));
     TEST_ASSERT_GREATER_THAN_size_t(0, payload_len);
     TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_parse(payload, payload_len, &arena, &parsed, &parsed_count));
@@ -140,6 +152,99 @@ void test_queue_fifo_try_pop(void) {
     scribe_spsc_queue_destroy(&q);
 }
 
+/*
+ * Thread body for test_mem_budget_reserve_release: a blocking reservation
+ * that cannot fit until the main thread releases bytes.
+ */
+static void *mem_budget_waiter(void *arg) {
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve((scribe_mem_budget *)arg, 80));
+    return NULL;
+}
+
+/*
+ * Verifies memory budget accounting: try-reserve refuses what does not fit,
+ * a blocking reservation waits for a release, peak usage is tracked, and an
+ * oversized request is admitted once nothing else is reserved.
+ */
+void test_mem_budget_reserve_release(void) {
+    scribe_mem_budget m;
+    scribe_mem_stats stats;
+    pthread_t waiter;
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_budget_init(&m, 100, 0));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve(&m, 60));
+    TEST_ASSERT_FALSE(scribe_mem_try_reserve(&m, 50));
+    TEST_ASSERT_TRUE(scribe_mem_try_reserve(&m, 40));
+    scribe_mem_release(&m, 60);
+
+    TEST_ASSERT_EQUAL(0, pthread_create(&waiter, NULL, mem_budget_waiter, &m));
+    do {
+        usleep(1000);
+        scribe_mem_budget_stats(&m, &stats);
+    } while (stats.waits == 0);
+    TEST_ASSERT_EQUAL_size_t(40, stats.reserved);
+    scribe_mem_release(&m, 40);
+    TEST_ASSERT_EQUAL(0, pthread_join(waiter, NULL));
+
+    scribe_mem_budget_stats(&m, &stats);
+    TEST_ASSERT_EQUAL_size_t(80, stats.reserved);
+    TEST_ASSERT_EQUAL_size_t(100, stats.peak);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.waits);
+    scribe_mem_release(&m, 80);
+    TEST_ASSERT_TRUE(scribe_mem_try_reserve(&m, 500));
+    TEST_ASSERT_FALSE(scribe_mem_try_reserve(&m, 1));
+    scribe_mem_release(&m, 500);
+    scribe_mem_budget_destroy(&m);
+}
+
+/*
+ * Thread body for test_mem_budget_admits_own_growth: grows a 50-byte holding
+ * by 10 while the budget is full.
+ */
+static void *mem_budget_grower(void *arg) {
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve_more((scribe_mem_budget *)arg, 50, 10));
+    return NULL;
+}
+
+/*
+ * Verifies that growing an unsplittable item never waits on itself: a lone
+ * holder is admitted over the limit at once, and of two holders blocked
+ * growing, one goes on instead of both deadlocking and the other follows once
+ * it releases.
+ */
+void test_mem_budget_admits_own_growth(void) {
+    scribe_mem_budget m;
+    scribe_mem_stats stats;
+    pthread_t grower;
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_budget_init(&m, 100, 0));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve(&m, 80));
+    TEST_ASSERT_FALSE(scribe_mem_try_reserve(&m, 30));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve_more(&m, 80, 30));
+    scribe_mem_budget_stats(&m, &stats);
+    TEST_ASSERT_EQUAL_size_t(110, stats.reserved);
+    TEST_ASSERT_EQUAL_UINT64(1, stats.waits);
+    scribe_mem_release(&m, 110);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve(&m, 50));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve(&m, 50));
+    TEST_ASSERT_EQUAL(0, pthread_create(&grower, NULL, mem_budget_grower, &m));
+    do {
+        usleep(1000);
+        scribe_mem_budget_stats(&m, &stats);
+    } while (stats.waits == 1);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mem_reserve_more(&m, 50, 10));
+    scribe_mem_budget_stats(&m, &stats);
+    TEST_ASSERT_EQUAL_size_t(110, stats.reserved);
+    scribe_mem_release(&m, 60);
+    TEST_ASSERT_EQUAL(0, pthread_join(grower, NULL));
+    scribe_mem_budget_stats(&m, &stats);
+    TEST_ASSERT_EQUAL_size_t(60, stats.reserved);
+    scribe_mem_release(&m, 60);
+    TEST_ASSERT_EQUAL(0, m.growing);
+    scribe_mem_budget_destroy(&m);
+}
+
 /*
  * Creates a temporary repository directory in place from an mkdtemp template.
  */
@@ -291,3 +396,1101 @@ void test_object_iterator_and_compressed_size(void) {
     TEST_ASSERT_GREATER_THAN_size_t(0, compressed_size);
     scribe_close(ctx);
 }
+
+/*
+ * Verifies adaptive compression: writes under a reported backlog are listed as
+ * fast, writes after it clears are not, and repack recompresses the listed
+ * objects in place, keeps them readable, and removes the list. A fast write
+ * after the repack starts a new list.
+ */
+void test_adaptive_compression_and_repack(void) {
+    char tmpl[] = "/tmp/scribe-repack-test-XXXXXX";
+    char list_path[sizeof(tmpl) + 32];
+    scribe_ctx *ctx = NULL;
+    uint8_t payload[4096];
+    const uint8_t calm[] = "written at the configured level";
+    uint8_t fast_hash[SCRIBE_HASH_SIZE];
+    uint8_t calm_hash[SCRIBE_HASH_SIZE];
+    uint8_t *list = NULL;
+    size_t list_len = 0;
+    scribe_repack_stats stats;
+    scribe_object obj;
+    size_t i;
+
+    for (i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)"scribe repack "[i % 14u];
+    }
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    ctx->config.adaptive_compression_level = 1;
+    scribe_object_note_queue_depth(ctx, 64, 64);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, payload, sizeof(payload), fast_hash));
+    scribe_object_note_queue_depth(ctx, 0, 64);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, calm, sizeof(calm) - 1u, calm_hash));
+
+    snprintf(list_path, sizeof(list_path), "%s/objects/info/fast-objects", tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_read_file(list_path, &list, &list_len));
+    TEST_ASSERT_EQUAL_size_t(SCRIBE_HEX_HASH_SIZE + 1u, list_len);
+    free(list);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_repack(ctx, &stats));
+    TEST_ASSERT_EQUAL_size_t(1, stats.listed);
+    TEST_ASSERT_TRUE(stats.bytes_after <= stats.bytes_before);
+    TEST_ASSERT_FALSE(scribe_file_exists(list_path));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, fast_hash, &obj));
+    TEST_ASSERT_EQUAL_size_t(sizeof(payload), obj.payload_len);
+    TEST_ASSERT_EQUAL_MEMORY(payload, obj.payload, sizeof(payload));
+    scribe_object_free(&obj);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_repack(ctx, &stats));
+    TEST_ASSERT_EQUAL_size_t(0, stats.listed);
+
+    scribe_object_note_queue_depth(ctx, 64, 64);
+    payload[0] = 'S';
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, payload, sizeof(payload), fast_hash));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_read_file(list_path, &list, &list_len));
+    TEST_ASSERT_EQUAL_size_t(SCRIBE_HEX_HASH_SIZE + 1u, list_len);
+    free(list);
+    scribe_close(ctx);
+}
+
+/*
+ * Commits one batch that writes (or, with payload NULL, deletes) documents
+ * first..last-1 under db/<coll>. Used by the sharded-tree test to build the
+ * same collection through different batch boundaries.
+ */
+static void commit_docs(scribe_ctx *ctx, const char *coll, size_t first, size_t last, int delete_docs) {
+    char names[64][32];
+    const char *paths[64][3];
+    scribe_change_event events[64];
+    scribe_change_batch batch;
+    uint8_t commit[SCRIBE_HASH_SIZE];
+    static const uint8_t payload[] = "{\"v\":1}";
+    size_t i;
+
+    TEST_ASSERT_TRUE(last - first <= 64u);
+    memset(events, 0, sizeof(events));
+    for (i = first; i < last; i++) {
+        size_t k = i - first;
+        snprintf(names[k], sizeof(names[k]), "\"d%zu\"", i);
+        paths[k][0] = "db";
+        paths[k][1] = coll;
+        paths[k][2] = names[k];
+        events[k].path = paths[k];
+        events[k].path_len = 3;
+        events[k].payload = delete_docs ? NULL : payload;
+        events[k].payload_len = delete_docs ? 0u : sizeof(payload) - 1u;
+    }
+    memset(&batch, 0, sizeof(batch));
+    batch.events = events;
+    batch.event_count = last - first;
+    batch.author = (scribe_identity){"tester", "", "test"};
+    batch.committer = (scribe_identity){"scribe-test", "", "scribe"};
+    batch.process = (scribe_process_info){"unit", "1", "", "shard"};
+    batch.timestamp_unix_nanos = 1;
+    batch.message = "docs";
+    batch.message_len = 4;
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_commit_batch(ctx, &batch, commit));
+}
+
+/*
+ * Reads the physical entry count of a tree path at HEAD and reports whether the
+ * stored object is an interior shard level.
+ */
+static size_t physical_tree_entries(scribe_ctx *ctx, const char *path, int *sharded) {
+    uint8_t head[SCRIBE_HASH_SIZE];
+    scribe_path_resolution res;
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+    scribe_tree_entry *entries = NULL;
+    size_t count = 0;
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_resolve_commit(ctx, "HEAD", head));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, head, &obj));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_arena_init(&arena, obj.payload_len + 4096u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, view.root_tree, path, &res));
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    TEST_ASSERT_EQUAL(SCRIBE_PATH_TREE, res.state);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, res.hash, &obj));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_arena_init(&arena, obj.payload_len * 8u + 4096u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_parse(obj.payload, obj.payload_len, &arena, &entries, &count));
+    *sharded = scribe_tree_entries_sharded(entries, count);
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    return count;
+}
+
+/*
+ * Enables a small shard threshold and verifies that large trees are sharded,
+ * that the layout depends only on the entry set, that documents still resolve
+ * through the shard levels, and that a tree shrinking under the threshold
+ * returns to the flat layout.
+ */
+void test_sharded_tree_layout(void) {
+    char tmpl[] = "/tmp/scribe-shard-test-XXXXXX";
+    scribe_ctx *ctx = NULL;
+    uint8_t head[SCRIBE_HASH_SIZE];
+    scribe_path_resolution a;
+    scribe_path_resolution b;
+    scribe_path_resolution doc;
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+    int sharded = 0;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    ctx->config.tree_shard_threshold = 4;
+
+    commit_docs(ctx, "a", 0, 40, 0);
+    commit_docs(ctx, "b", 0, 3, 0);
+    commit_docs(ctx, "b", 3, 25, 0);
+    commit_docs(ctx, "b", 25, 40, 0);
+    TEST_ASSERT_GREATER_THAN_size_t(0, physical_tree_entries(ctx, "db/a", &sharded));
+    TEST_ASSERT_TRUE(sharded);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_resolve_commit(ctx, "HEAD", head));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, head, &obj));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_arena_init(&arena, obj.payload_len + 4096u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, view.root_tree, "db/a", &a));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, view.root_tree, "db/b", &b));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, view.root_tree, "db/b/\"d17\"", &doc));
+    TEST_ASSERT_EQUAL_MEMORY(a.hash, b.hash, SCRIBE_HASH_SIZE);
+    TEST_ASSERT_EQUAL(SCRIBE_PATH_BLOB, doc.state);
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+
+    commit_docs(ctx, "a", 3, 40, 1);
+    TEST_ASSERT_EQUAL_size_t(3, physical_tree_entries(ctx, "db/a", &sharded));
+    TEST_ASSERT_FALSE(sharded);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_cli_fsck(ctx));
+    scribe_close(ctx);
+}
+
+typedef struct {
+    const scribe_reachable *with_bitmaps;
+    const scribe_reachable *extended;
+    const scribe_reachable *full_walk;
+    const uint8_t *stray;
+    size_t reachable;
+} reachable_test_state;
+
+/*
+ * Object-iterator callback for the bitmap test. All reachable sets must agree
+ * on every stored object, and only the stray blob may be unreachable.
+ */
+static scribe_error_t compare_reachable_visit(const uint8_t hash[SCRIBE_HASH_SIZE], void *user) {
+    reachable_test_state *state = (reachable_test_state *)user;
+    int expected = memcmp(hash, state->stray, SCRIBE_HASH_SIZE) != 0;
+
+    TEST_ASSERT_EQUAL_INT(expected, scribe_reachable_has(state->with_bitmaps, hash));
+    TEST_ASSERT_EQUAL_INT(expected, scribe_reachable_has(state->extended, hash));
+    TEST_ASSERT_EQUAL_INT(expected, scribe_reachable_has(state->full_walk, hash));
+    state->reachable += (size_t)expected;
+    return SCRIBE_OK;
+}
+
+/*
+ * Writes reachability bitmaps, commits more history on top of them, and checks
+ * that the bitmap-assisted reachable set matches a full walk and excludes an
+ * object no commit references, both before and after an incremental update.
+ */
+void test_reachability_bitmaps_match_walk(void) {
+    char tmpl[] = "/tmp/scribe-bitmap-test-XXXXXX";
+    char bitmap_path[sizeof(tmpl) + 32];
+    static const uint8_t stray_payload[] = "unreferenced";
+    scribe_ctx *ctx = NULL;
+    scribe_reachable *with_bitmaps = NULL;
+    scribe_reachable *extended = NULL;
+    scribe_reachable *full_walk = NULL;
+    reachable_test_state state;
+    uint8_t stray[SCRIBE_HASH_SIZE];
+    size_t commits = 0;
+    size_t objects = 0;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    ctx->config.tree_shard_threshold = 4;
+    commit_docs(ctx, "a", 0, 20, 0);
+    commit_docs(ctx, "b", 0, 10, 0);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_bitmap_write(ctx, 0, &commits, &objects));
+    TEST_ASSERT_EQUAL_size_t(1, commits);
+    TEST_ASSERT_GREATER_THAN_size_t(0, objects);
+
+    commit_docs(ctx, "a", 20, 30, 0);
+    commit_docs(ctx, "b", 2, 10, 1);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, stray_payload,
+                                                     sizeof(stray_payload) - 1u, stray));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_reachable_compute(ctx, &with_bitmaps));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_bitmap_write(ctx, 1, &commits, &objects));
+    TEST_ASSERT_EQUAL_size_t(1, commits);
+    TEST_ASSERT_GREATER_THAN_size_t(0, objects);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_reachable_compute(ctx, &extended));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_bitmap_write(ctx, 1, &commits, &objects));
+    TEST_ASSERT_EQUAL_size_t(0, commits);
+    snprintf(bitmap_path, sizeof(bitmap_path), "%s/objects/info/bitmaps", tmpl);
+    TEST_ASSERT_EQUAL_INT(0, unlink(bitmap_path));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_reachable_compute(ctx, &full_walk));
+
+    memset(&state, 0, sizeof(state));
+    state.with_bitmaps = with_bitmaps;
+    state.extended = extended;
+    state.full_walk = full_walk;
+    state.stray = stray;
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_iter(ctx, compare_reachable_visit, &state));
+    TEST_ASSERT_GREATER_THAN_size_t(0, state.reachable);
+    scribe_reachable_free(with_bitmaps);
+    scribe_reachable_free(extended);
+    scribe_reachable_free(full_walk);
+    scribe_close(ctx);
+}
+
+/*
+ * Object-iterator callback that only counts hashes.
+ */
+static scribe_error_t count_hashes_visit(const uint8_t hash[SCRIBE_HASH_SIZE], void *user) {
+    (void)hash;
+    (*(size_t *)user)++;
+    return SCRIBE_OK;
+}
+
+/*
+ * Runs commits, reads, and fsck on the in-memory object engine and checks that
+ * no object reaches the loose store on disk.
+ */
+void test_memory_object_backend(void) {
+    char tmpl[] = "/tmp/scribe-memstore-test-XXXXXX";
+    scribe_ctx *ctx = NULL;
+    scribe_object_backend *mem = NULL;
+    scribe_object_backend *loose = NULL;
+    uint8_t head[SCRIBE_HASH_SIZE];
+    scribe_object obj;
+    size_t in_memory = 0;
+    size_t on_disk = 0;
+    size_t stored = 0;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_backend_mem_new(&mem));
+    scribe_object_set_backend(ctx, mem);
+    commit_docs(ctx, "a", 0, 40, 0);
+    commit_docs(ctx, "a", 10, 20, 1);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_resolve_commit(ctx, "HEAD", head));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, head, &obj));
+    TEST_ASSERT_EQUAL_INT(SCRIBE_OBJECT_COMMIT, obj.type);
+    scribe_object_free(&obj);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_compressed_size(ctx, head, &stored));
+    TEST_ASSERT_GREATER_THAN_size_t(0, stored);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_cli_fsck(ctx));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_iter(ctx, count_hashes_visit, &in_memory));
+    TEST_ASSERT_GREATER_THAN_size_t(3, in_memory);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_backend_loose_new(tmpl, &loose));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, loose->ops->iter(loose, count_hashes_visit, &on_disk, 1u));
+    TEST_ASSERT_EQUAL_size_t(0, on_disk);
+    TEST_ASSERT_EQUAL(SCRIBE_ENOT_FOUND, loose->ops->has(loose, head));
+    loose->ops->destroy(loose);
+    scribe_close(ctx);
+}
+
+/*
+ * Concurrent object visitor: folds every hash into an order-independent
+ * checksum so a parallel scan can be compared with a serial one.
+ */
+static scribe_error_t sum_hashes_visit(const uint8_t hash[SCRIBE_HASH_SIZE], void *user) {
+    atomic_ulong *sums = (atomic_ulong *)user;
+    unsigned long word = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(word); i++) {
+        word = (word << 8) | hash[i];
+    }
+    atomic_fetch_add(&sums[0], 1ul);
+    atomic_fetch_xor(&sums[1], word);
+    return SCRIBE_OK;
+}
+
+/*
+ * Writes enough loose objects to populate most fanout directories, then scans
+ * with one thread and with eight and checks that both visit the same set.
+ */
+void test_parallel_object_iteration(void) {
+    char tmpl[] = "/tmp/scribe-iter-test-XXXXXX";
+    scribe_ctx *ctx = NULL;
+    scribe_object_backend *loose = NULL;
+    atomic_ulong serial[2];
+    atomic_ulong parallel[2];
+    uint8_t hash[SCRIBE_HASH_SIZE];
+    char payload[32];
+    int i;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    for (i = 0; i < 600; i++) {
+        int len = snprintf(payload, sizeof(payload), "{\"v\":%d}", i);
+        TEST_ASSERT_EQUAL(SCRIBE_OK,
+                          scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, (const uint8_t *)payload, (size_t)len, hash));
+    }
+    scribe_close(ctx);
+
+    atomic_init(&serial[0], 0ul);
+    atomic_init(&serial[1], 0ul);
+    atomic_init(&parallel[0], 0ul);
+    atomic_init(&parallel[1], 0ul);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_backend_loose_new(tmpl, &loose));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, loose->ops->iter(loose, sum_hashes_visit, serial, 1u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, loose->ops->iter(loose, sum_hashes_visit, parallel, 8u));
+    loose->ops->destroy(loose);
+    TEST_ASSERT_EQUAL_UINT64(600u, atomic_load(&serial[0]));
+    TEST_ASSERT_EQUAL_UINT64(atomic_load(&serial[0]), atomic_load(&parallel[0]));
+    TEST_ASSERT_EQUAL_UINT64(atomic_load(&serial[1]), atomic_load(&parallel[1]));
+}
+
+/*
+ * Reads HEAD's root tree hash.
+ */
+static void head_root_tree(scribe_ctx *ctx, uint8_t out[SCRIBE_HASH_SIZE]) {
+    uint8_t head[SCRIBE_HASH_SIZE];
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_resolve_commit(ctx, "HEAD", head));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, head, &obj));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_arena_init(&arena, obj.payload_len + 4096u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view));
+    memcpy(out, view.root_tree, SCRIBE_HASH_SIZE);
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+}
+
+/*
+ * Checks that tree writes persist leaf counts through shard levels, that a
+ * fresh context reads them back, and that a deleted cache file is rebuilt
+ * lazily with the same answer.
+ */
+void test_tree_leaf_count_cache(void) {
+    char tmpl[] = "/tmp/scribe-leafcount-test-XXXXXX";
+    char cache_path[128];
+    scribe_ctx *ctx = NULL;
+    uint8_t root[SCRIBE_HASH_SIZE];
+    uint64_t leaves = 0;
+    struct stat st;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    ctx->config.tree_shard_threshold = 4;
+    commit_docs(ctx, "a", 0, 40, 0);
+    commit_docs(ctx, "b", 0, 30, 0);
+    commit_docs(ctx, "a", 0, 10, 1);
+    head_root_tree(ctx, root);
+    scribe_close(ctx);
+
+    snprintf(cache_path, sizeof(cache_path), "%s/objects/info/leaf-counts", tmpl);
+    TEST_ASSERT_EQUAL(0, stat(cache_path, &st));
+    TEST_ASSERT_GREATER_THAN(0, st.st_size);
+    TEST_ASSERT_EQUAL(0, st.st_size % (SCRIBE_HASH_SIZE + 8));
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 0, &ctx));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_leaf_count(ctx, root, &leaves));
+    TEST_ASSERT_EQUAL_UINT64(60u, leaves);
+    scribe_close(ctx);
+
+    TEST_ASSERT_EQUAL(0, unlink(cache_path));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 0, &ctx));
+    leaves = 0;
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_leaf_count(ctx, root, &leaves));
+    TEST_ASSERT_EQUAL_UINT64(60u, leaves);
+    scribe_close(ctx);
+    TEST_ASSERT_FALSE(scribe_file_exists(cache_path));
+}
+
+/*
+ * A change batch built from "path=payload" strings, with its storage.
+ */
+typedef struct {
+    char bufs[16][64];
+    const char *paths[16][4];
+    scribe_change_event events[16];
+    scribe_change_batch batch;
+} test_batch;
+
+/*
+ * Builds a batch of events given as "path=payload" strings; a missing "="
+ * makes the event a tombstone. Paths are split on '/'.
+ */
+static void build_events(test_batch *tb, const char *const *specs, size_t count) {
+    size_t i;
+
+    TEST_ASSERT_TRUE(count <= 16u);
+    memset(tb, 0, sizeof(*tb));
+    for (i = 0; i < count; i++) {
+        char *eq;
+        char *part;
+        char *save = NULL;
+        size_t n = 0;
+
+        snprintf(tb->bufs[i], sizeof(tb->bufs[i]), "%s", specs[i]);
+        eq = strchr(tb->bufs[i], '=');
+        if (eq != NULL) {
+            *eq = '\0';
+            tb->events[i].payload = (const uint8_t *)(eq + 1);
+            tb->events[i].payload_len = strlen(eq + 1);
+        }
+        for (part = strtok_r(tb->bufs[i], "/", &save); part != NULL && n < 4u; part = strtok_r(NULL, "/", &save)) {
+            tb->paths[i][n++] = part;
+        }
+        tb->events[i].path = tb->paths[i];
+        tb->events[i].path_len = n;
+    }
+    tb->batch.events = tb->events;
+    tb->batch.event_count = count;
+    tb->batch.author = (scribe_identity){"tester", "", "test"};
+    tb->batch.committer = (scribe_identity){"scribe-test", "", "scribe"};
+    tb->batch.process = (scribe_process_info){"unit", "1", "", "merge"};
+    tb->batch.timestamp_unix_nanos = 1;
+    tb->batch.message = "events";
+    tb->batch.message_len = 6;
+}
+
+/*
+ * Commits one batch of events given as "path=payload" strings.
+ */
+static scribe_error_t commit_events(scribe_ctx *ctx, const char *const *specs, size_t count) {
+    test_batch tb;
+    uint8_t commit[SCRIBE_HASH_SIZE];
+
+    build_events(&tb, specs, count);
+    return scribe_commit_batch(ctx, &tb.batch, commit);
+}
+
+/*
+ * Asserts that a path at HEAD holds a blob with the given payload.
+ */
+static void assert_head_blob(scribe_ctx *ctx, const char *path, const char *payload) {
+    uint8_t root[SCRIBE_HASH_SIZE];
+    uint8_t expected[SCRIBE_HASH_SIZE];
+    scribe_path_resolution res;
+
+    head_root_tree(ctx, root);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, root, path, &res));
+    TEST_ASSERT_EQUAL(SCRIBE_PATH_BLOB, res.state);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, (const uint8_t *)payload,
+                                                     strlen(payload), expected));
+    TEST_ASSERT_EQUAL_MEMORY(expected, res.hash, SCRIBE_HASH_SIZE);
+}
+
+/*
+ * Checks batch application through the sorted merge: events arrive unsorted
+ * across flat and sharded trees, a repeated path keeps its last write, a
+ * deletion and an insertion land in the same shard level, and the result
+ * hashes like the same state built one event per commit. A batch in which one
+ * path extends another is applied in batch order, and a path through a blob
+ * is still rejected.
+ */
+void test_batch_merge_apply(void) {
+    static const char *const batch[] = {
+        "db/b/\"d9\"=x",  "db/a/\"d5\"=old", "db/c/\"k\"=1", "db/a/\"d41\"=new",
+        "db/a/\"d5\"=mid", "db/a/\"d7\"",     "db/b/\"d0\"",  "db/a/\"d5\"=last",
+    };
+    static const char *const ordered[] = {"db/x/y=1", "db/x=2"};
+    static const char *const through_blob[] = {"db/x/z=3"};
+    char tmpl[] = "/tmp/scribe-merge-test-XXXXXX";
+    char other[] = "/tmp/scribe-merge-test-XXXXXX";
+    scribe_ctx *ctx = NULL;
+    uint8_t root[SCRIBE_HASH_SIZE];
+    uint8_t serial_root[SCRIBE_HASH_SIZE];
+    scribe_path_resolution res;
+    size_t i;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    ctx->config.tree_shard_threshold = 4;
+    commit_docs(ctx, "a", 0, 40, 0);
+    commit_docs(ctx, "b", 0, 10, 0);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, commit_events(ctx, batch, sizeof(batch) / sizeof(batch[0])));
+    assert_head_blob(ctx, "db/a/\"d5\"", "last");
+    assert_head_blob(ctx, "db/a/\"d41\"", "new");
+    assert_head_blob(ctx, "db/b/\"d9\"", "x");
+    head_root_tree(ctx, root);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, root, "db/a/\"d7\"", &res));
+    TEST_ASSERT_EQUAL(SCRIBE_PATH_ABSENT, res.state);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_cli_fsck(ctx));
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, commit_events(ctx, ordered, 2));
+    assert_head_blob(ctx, "db/x", "2");
+    TEST_ASSERT_EQUAL(SCRIBE_ECORRUPT, commit_events(ctx, through_blob, 1));
+    scribe_close(ctx);
+
+    make_temp_repo(other);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(other));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(other, 1, &ctx));
+    ctx->config.tree_shard_threshold = 4;
+    commit_docs(ctx, "a", 0, 40, 0);
+    commit_docs(ctx, "b", 0, 10, 0);
+    for (i = 0; i < sizeof(batch) / sizeof(batch[0]); i++) {
+        TEST_ASSERT_EQUAL(SCRIBE_OK, commit_events(ctx, &batch[i], 1));
+    }
+    head_root_tree(ctx, serial_root);
+    TEST_ASSERT_EQUAL_MEMORY(root, serial_root, SCRIBE_HASH_SIZE);
+    scribe_close(ctx);
+}
+
+/*
+ * Commits a group whose middle batch cannot apply and checks that only that
+ * batch fails, and that the others are chained and published around it.
+ */
+void test_commit_group_isolates_failures(void) {
+    static const char *const first[] = {"db/a=1"};
+    static const char *const bad[] = {"db/x/z=3"};
+    static const char *const last[] = {"db/b=2"};
+    static const char *const blob[] = {"db/x=0"};
+    char tmpl[] = "/tmp/scribe-group-test-XXXXXX";
+    test_batch tbs[3];
+    const scribe_change_batch *batches[3];
+    scribe_group_result results[3];
+    uint8_t head[SCRIBE_HASH_SIZE];
+    scribe_ctx *ctx = NULL;
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, commit_events(ctx, blob, 1));
+    build_events(&tbs[0], first, 1);
+    build_events(&tbs[1], bad, 1);
+    build_events(&tbs[2], last, 1);
+    batches[0] = &tbs[0].batch;
+    batches[1] = &tbs[1].batch;
+    batches[2] = &tbs[2].batch;
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_commit_group(ctx, batches, 3, results));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, results[0].err);
+    TEST_ASSERT_EQUAL(SCRIBE_ECORRUPT, results[1].err);
+    TEST_ASSERT_TRUE(results[1].detail[0] != '\0');
+    TEST_ASSERT_EQUAL(SCRIBE_OK, results[2].err);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_resolve_commit(ctx, "HEAD", head));
+    TEST_ASSERT_EQUAL_MEMORY(results[2].commit, head, SCRIBE_HASH_SIZE);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, head, &obj));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_arena_init(&arena, obj.payload_len + 4096u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view));
+    TEST_ASSERT_TRUE(view.has_parent);
+    TEST_ASSERT_EQUAL_MEMORY(results[0].commit, view.parent, SCRIBE_HASH_SIZE);
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+    assert_head_blob(ctx, "db/a", "1");
+    assert_head_blob(ctx, "db/b", "2");
+    assert_head_blob(ctx, "db/x", "0");
+    scribe_close(ctx);
+}
+
+/*
+ * Fake hosted session for the daemon test; the URI names its database. It
+ * bootstraps a snapshot holding `<db>/s` (nothing for "beta"), then commits
+ * `<db>/a=1`. The URI "fail" fails at once. Runs on a daemon thread, so it
+ * reports through its return value instead of asserting.
+ */
+static scribe_error_t fake_session(scribe_ctx *ctx, const char *uri, scribe_session_sink *sink) {
+    static const uint8_t payload[] = "snap";
+    scribe_snapshot_builder *builder = NULL;
+    const char *path[2] = {uri, "s"};
+    char spec[32];
+    const char *specs[1] = {spec};
+    test_batch meta;
+    test_batch tb;
+    uint8_t blob[SCRIBE_HASH_SIZE];
+    uint8_t root[SCRIBE_HASH_SIZE];
+    uint8_t commit[SCRIBE_HASH_SIZE];
+    scribe_error_t err;
+
+    if (strcmp(uri, "fail") == 0) {
+        return scribe_set_error(SCRIBE_EADAPTER, "fake session failed");
+    }
+    if (sink->key == NULL || sink->stopping(sink)) {
+        return scribe_set_error(SCRIBE_ERR, "hosted sink is not keyed or already stopping");
+    }
+    err = scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, payload, sizeof(payload) - 1u, blob);
+    if (err == SCRIBE_OK) {
+        err = scribe_snapshot_builder_new(ctx, 0, &builder);
+    }
+    if (err == SCRIBE_OK && strcmp(uri, "beta") != 0) {
+        err = scribe_snapshot_builder_add(builder, path, 2, blob, 1);
+    }
+    if (err == SCRIBE_OK) {
+        err = scribe_snapshot_builder_finish(builder, root);
+    }
+    scribe_snapshot_builder_free(builder);
+    build_events(&meta, NULL, 0);
+    meta.batch.events = NULL;
+    if (err == SCRIBE_OK) {
+        err = sink->commit_root(sink, root, uri, &meta.batch, commit);
+    }
+    snprintf(spec, sizeof(spec), "%s/a=1", uri);
+    build_events(&tb, specs, 1);
+    if (err == SCRIBE_OK) {
+        err = sink->commit(sink, &tb.batch, commit);
+    }
+    return err;
+}
+
+/*
+ * Runs two hosted sessions in a daemon without a socket. Each bootstrap
+ * replaces only its own database, removing the scoped one when its snapshot is
+ * empty, and every other entry of main survives. The daemon exits once both
+ * sessions return. A failing session is the daemon's error, and an unusable
+ * session name is rejected before anything starts.
+ */
+void test_daemon_hosts_sessions(void) {
+    static const char *const seed[] = {"keep/x=0", "alpha/old=9", "beta/old=9"};
+    const scribe_daemon_source sources[2] = {{"alpha-session", "alpha", fake_session},
+                                             {"beta-session", "beta", fake_session}};
+    const scribe_daemon_source failing = {"broken", "fail", fake_session};
+    const scribe_daemon_source bad_name = {"../x", "alpha", fake_session};
+    char tmpl[] = "/tmp/scribe-daemon-test-XXXXXX";
+    uint8_t root[SCRIBE_HASH_SIZE];
+    scribe_path_resolution res;
+    scribe_ctx *ctx = NULL;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, commit_events(ctx, seed, 3));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_daemon_run(ctx, NULL, sources, 2));
+    assert_head_blob(ctx, "keep/x", "0");
+    assert_head_blob(ctx, "alpha/s", "snap");
+    assert_head_blob(ctx, "alpha/a", "1");
+    assert_head_blob(ctx, "beta/a", "1");
+    head_root_tree(ctx, root);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, root, "alpha/old", &res));
+    TEST_ASSERT_EQUAL(SCRIBE_PATH_ABSENT, res.state);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_tree_resolve_path(ctx, root, "beta/old", &res));
+    TEST_ASSERT_EQUAL(SCRIBE_PATH_ABSENT, res.state);
+    TEST_ASSERT_EQUAL(SCRIBE_EADAPTER, scribe_daemon_run(ctx, NULL, &failing, 1));
+    TEST_ASSERT_EQUAL(SCRIBE_EINVAL, scribe_daemon_run(ctx, NULL, &bad_name, 1));
+    scribe_close(ctx);
+}
+
+/*
+ * Checks that interning returns one stable pointer and id per distinct name,
+ * compares by length as well as bytes, and survives table growth.
+ */
+void test_intern_table(void) {
+    char tmpl[] = "/tmp/scribe-intern-test-XXXXXX";
+    char name[32];
+    scribe_ctx *ctx = NULL;
+    const char *users = NULL;
+    const char *again = NULL;
+    const char *prefix = NULL;
+    uint32_t users_id = 0;
+    uint32_t id = 0;
+    size_t i;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 0, &ctx));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_intern(ctx, "users", 5, &users, &users_id));
+    TEST_ASSERT_EQUAL_STRING("users", users);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_intern(ctx, "users.archive", 5, &again, &id));
+    TEST_ASSERT_EQUAL_PTR(users, again);
+    TEST_ASSERT_EQUAL_UINT(users_id, id);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_intern(ctx, "user", 4, &prefix, &id));
+    TEST_ASSERT_TRUE(prefix != users);
+    TEST_ASSERT_EQUAL_UINT(users_id + 1u, id);
+    for (i = 0; i < 1000u; i++) {
+        snprintf(name, sizeof(name), "coll%zu", i);
+        TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_intern(ctx, name, strlen(name), &again, &id));
+        TEST_ASSERT_EQUAL_UINT(users_id + 2u + i, id);
+    }
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_intern(ctx, "users", 5, &again, &id));
+    TEST_ASSERT_EQUAL_PTR(users, again);
+    TEST_ASSERT_EQUAL_UINT(users_id, id);
+    scribe_close(ctx);
+}
+
+/*
+ * Commits paths deeper than the database and collection levels and checks
+ * that only those two names reached the intern table.
+ */
+void test_intern_skips_deep_components(void) {
+    char tmpl[] = "/tmp/scribe-intern-depth-XXXXXX";
+    static const char *const specs[] = {"shop/orders/a1/total=1", "shop/orders/a2/total=2", "shop/orders/a3=3"};
+    static const char *const update[] = {"shop/orders/a2/total=5", "shop/orders/a3"};
+    scribe_ctx *ctx = NULL;
+    const char *name = NULL;
+    uint32_t first = 0;
+    uint32_t id = 0;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_intern(ctx, "probe0", 6, &name, &first));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, commit_events(ctx, specs, 3u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, commit_events(ctx, update, 2u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_intern(ctx, "probe1", 6, &name, &id));
+    TEST_ASSERT_EQUAL_UINT(first + 3u, id);
+    assert_head_blob(ctx, "shop/orders/a1/total", "1");
+    assert_head_blob(ctx, "shop/orders/a2/total", "5");
+    scribe_close(ctx);
+}
+
+/*
+ * Verifies a change stream uses post-images only when every watched collection
+ * stores them, falls back to updateLookup for mixed or bare sets, and requires
+ * them only as configured.
+ */
+void test_full_document_mode_choice(void) {
+    scribe_config cfg;
+    scribe_full_document mode = SCRIBE_FULL_DOCUMENT_REQUIRED;
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_default_config(&cfg));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_choose_full_document(&cfg, 4, 0, &mode));
+    TEST_ASSERT_EQUAL(SCRIBE_FULL_DOCUMENT_WHEN_AVAILABLE, mode);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_choose_full_document(&cfg, 3, 1, &mode));
+    TEST_ASSERT_EQUAL(SCRIBE_FULL_DOCUMENT_LOOKUP, mode);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_choose_full_document(&cfg, 0, 2, &mode));
+    TEST_ASSERT_EQUAL(SCRIBE_FULL_DOCUMENT_LOOKUP, mode);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_choose_full_document(&cfg, 0, 0, &mode));
+    TEST_ASSERT_EQUAL(SCRIBE_FULL_DOCUMENT_LOOKUP, mode);
+    TEST_ASSERT_EQUAL_STRING("updateLookup", scribe_full_document_name(mode));
+
+    cfg.adapter_require_pre_post_images = true;
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_choose_full_document(&cfg, 4, 0, &mode));
+    TEST_ASSERT_EQUAL(SCRIBE_FULL_DOCUMENT_REQUIRED, mode);
+    TEST_ASSERT_EQUAL_STRING("required", scribe_full_document_name(mode));
+    TEST_ASSERT_EQUAL(SCRIBE_ECONFIG, scribe_choose_full_document(&cfg, 3, 1, &mode));
+}
+
+/*
+ * Renders a hand-encoded sorted-BSON document covering the common scalar
+ * types and checks the canonical Extended JSON spelling used by `show
+ * --format=json`. JSON blobs and truncated BSON must not be accepted.
+ */
+void test_bson_blob_renders_canonical_json(void) {
+    static const uint8_t doc[] = {
+        0x7f, 0x00, 0x00, 0x00, 0x10, 0x61, 0x00, 0x01, 0x00, 0x00, 0x00, 0x02, 0x62, 0x00, 0x04, 0x00, 0x00, 0x00,
+        0x78, 0x22, 0x79, 0x00, 0x04, 0x63, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x08, 0x30, 0x00, 0x01, 0x0a, 0x31, 0x00,
+        0x00, 0x12, 0x64, 0x00, 0xfb, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x01, 0x65, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0xf8, 0x3f, 0x07, 0x66, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+        0x0a, 0x0b, 0x13, 0x67, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x3e, 0x30, 0x05, 0x68, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x61, 0x62, 0x63, 0x09, 0x69, 0x00, 0xe8,
+        0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x11, 0x6a, 0x00, 0x07, 0x00, 0x00, 0x00, 0x2a, 0x00, 0x00, 0x00,
+        0x00};
+    const char *json = "{\"a\":1}";
+    char *out = NULL;
+    size_t out_len = 0;
+
+    TEST_ASSERT_TRUE(scribe_bson_is_document(doc, sizeof(doc)));
+    TEST_ASSERT_FALSE(scribe_bson_is_document((const uint8_t *)json, strlen(json)));
+    TEST_ASSERT_FALSE(scribe_bson_is_document(doc, sizeof(doc) - 1u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_bson_to_json(doc, sizeof(doc), &out, &out_len));
+    TEST_ASSERT_EQUAL_STRING("{\"a\":{\"$numberInt\":\"1\"},\"b\":\"x\\\"y\",\"c\":[true,null],"
+                             "\"d\":{\"$numberLong\":\"-5\"},\"e\":{\"$numberDouble\":\"1.5\"},"
+                             "\"f\":{\"$oid\":\"000102030405060708090a0b\"},\"g\":{\"$numberDecimal\":\"1.5\"},"
+                             "\"h\":{\"$binary\":{\"base64\":\"YWJj\",\"subType\":\"00\"}},"
+                             "\"i\":{\"$date\":{\"$numberLong\":\"1000\"}},\"j\":{\"$timestamp\":{\"t\":42,\"i\":7}}}",
+                             out);
+    TEST_ASSERT_EQUAL_size_t(strlen(out), out_len);
+    free(out);
+}
+
+/*
+ * Appends each JSON Patch operation to a buffer, one per line.
+ */
+static scribe_error_t collect_patch_op(const scribe_json_patch_op *op, void *user) {
+    char *out = (char *)user;
+    size_t used = strlen(out);
+
+    snprintf(out + used, 1024u - used, "%s %.*s%s%.*s\n", op->op, (int)op->path_len, op->path,
+             op->value != NULL ? " " : "", (int)op->value_len, op->value != NULL ? op->value : "");
+    return SCRIBE_OK;
+}
+
+/*
+ * Diffs two versions of a document and checks the JSON Patch: nested replace,
+ * add and remove, array growth and shrink by index, escaped pointer tokens,
+ * and a whole-value replace when keys are not sorted, including after the
+ * walk has already emitted operations. Identical documents emit nothing and
+ * malformed input is rejected.
+ */
+void test_json_diff_emits_patch(void) {
+    const char *a = "{\"a\":1,\"b\":{\"c\":[1,2,3],\"d\":\"x\"},\"e/f\":true,\"l\":[1],\"z\":null}";
+    const char *b = "{\"a\":1,\"b\":{\"c\":[1,5],\"d\":\"y\",\"n\":{}},\"e/f\":false,\"l\":[1,[2]]}";
+    const char *unsorted_a = "{\"k\":{\"b\":1,\"a\":2}}";
+    const char *unsorted_b = "{\"k\":{\"b\":1,\"a\":3}}";
+    const char *late_a = "{\"k\":{\"a\":1,\"c\":2,\"b\":3}}";
+    const char *late_b = "{\"k\":{\"a\":9,\"c\":1,\"b\":3}}";
+    char out[1024] = "";
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_diff(a, strlen(a), b, strlen(b), collect_patch_op, out));
+    TEST_ASSERT_EQUAL_STRING("replace /b/c/1 5\n"
+                             "remove /b/c/2\n"
+                             "replace /b/d \"y\"\n"
+                             "add /b/n {}\n"
+                             "replace /e~1f false\n"
+                             "add /l/1 [2]\n"
+                             "remove /z\n",
+                             out);
+    out[0] = '\0';
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_diff(a, strlen(a), a, strlen(a), collect_patch_op, out));
+    TEST_ASSERT_EQUAL_STRING("", out);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_diff(unsorted_a, strlen(unsorted_a), unsorted_b, strlen(unsorted_b),
+                                                  collect_patch_op, out));
+    TEST_ASSERT_EQUAL_STRING("replace /k {\"b\":1,\"a\":3}\n", out);
+    out[0] = '\0';
+    TEST_ASSERT_EQUAL(SCRIBE_OK,
+                      scribe_json_diff(late_a, strlen(late_a), late_b, strlen(late_b), collect_patch_op, out));
+    TEST_ASSERT_EQUAL_STRING("replace /k/a 9\n"
+                             "replace /k/c 1\n"
+                             "replace /k {\"a\":9,\"c\":1,\"b\":3}\n",
+                             out);
+    TEST_ASSERT_EQUAL(SCRIBE_EMALFORMED, scribe_json_diff(a, strlen(a), a, strlen(a) - 1u, collect_patch_op, out));
+    TEST_ASSERT_EQUAL(SCRIBE_EMALFORMED, scribe_json_diff("", 0, a, strlen(a), collect_patch_op, out));
+    TEST_ASSERT_EQUAL(SCRIBE_EMALFORMED, scribe_json_diff("{\"a\":", 5, a, strlen(a), collect_patch_op, out));
+    TEST_ASSERT_EQUAL(SCRIBE_EMALFORMED, scribe_json_diff(a, strlen(a), "[1] 2", 5, collect_patch_op, out));
+}
+
+/*
+ * Extracts dotted fields from a JSON document as raw value text, reporting a
+ * missing field or a step through a non-object as absent.
+ */
+void test_json_get_field_follows_path(void) {
+    const char *doc = "{\"s\":\"paid\",\"p\":{\"q\":[1, 2],\"r\":null},\"n\":3}";
+    const char *value = NULL;
+    size_t len = 0;
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_get_field(doc, strlen(doc), "s", &value, &len));
+    TEST_ASSERT_EQUAL(6, len);
+    TEST_ASSERT_EQUAL_MEMORY("\"paid\"", value, len);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_get_field(doc, strlen(doc), "p.q", &value, &len));
+    TEST_ASSERT_EQUAL(6, len);
+    TEST_ASSERT_EQUAL_MEMORY("[1, 2]", value, len);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_get_field(doc, strlen(doc), "p.r", &value, &len));
+    TEST_ASSERT_EQUAL(4, len);
+    TEST_ASSERT_EQUAL_MEMORY("null", value, len);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_get_field(doc, strlen(doc), "p.x", &value, &len));
+    TEST_ASSERT_NULL(value);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_json_get_field(doc, strlen(doc), "n.x", &value, &len));
+    TEST_ASSERT_NULL(value);
+    TEST_ASSERT_EQUAL(SCRIBE_EMALFORMED, scribe_json_get_field("{\"s\":", 5, "s", &value, &len));
+}
+
+/*
+ * Builds a collection through a sharded incremental commit and again through a
+ * snapshot builder with a budget small enough to spill several sorted runs,
+ * fed in shuffled order with a stale duplicate, and checks both produce the
+ * same root tree. A path that is both a document and a tree must be rejected.
+ */
+void test_snapshot_builder_matches_commit(void) {
+    char tmpl[] = "/tmp/scribe-snapshot-test-XXXXXX";
+    scribe_ctx *ctx = NULL;
+    scribe_snapshot_builder *builder = NULL;
+    static const uint8_t payload[] = "{\"v\":1}";
+    static const uint8_t stale[] = "{\"v\":0}";
+    const char *clash_blob[2] = {"db", "a"};
+    const char *clash_tree[3] = {"db", "a", "x"};
+    uint8_t blob[SCRIBE_HASH_SIZE];
+    uint8_t old_blob[SCRIBE_HASH_SIZE];
+    uint8_t head[SCRIBE_HASH_SIZE];
+    uint8_t root[SCRIBE_HASH_SIZE];
+    scribe_object obj;
+    scribe_arena arena;
+    scribe_commit_view view;
+    size_t i;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    ctx->config.tree_shard_threshold = 4;
+    commit_docs(ctx, "a", 0, 40, 0);
+    commit_docs(ctx, "b", 0, 40, 0);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, payload, sizeof(payload) - 1u, blob));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, stale, sizeof(stale) - 1u, old_blob));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_snapshot_builder_new(ctx, 0, &builder));
+    for (i = 0; i < 80u; i++) {
+        size_t doc = (i / 2u * 7u) % 40u;
+        char name[32];
+        const char *path[3];
+        snprintf(name, sizeof(name), "\"d%zu\"", doc);
+        path[0] = "db";
+        path[1] = i % 2u == 0 ? "a" : "b";
+        path[2] = name;
+        if (i == 10u) {
+            TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_snapshot_builder_add(builder, path, 3, old_blob, 1000u));
+        }
+        TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_snapshot_builder_add(builder, path, 3, blob, 2000u + i));
+    }
+    TEST_ASSERT_EQUAL_size_t(81, scribe_snapshot_builder_count(builder));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_snapshot_builder_finish(builder, root));
+    scribe_snapshot_builder_free(builder);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_resolve_commit(ctx, "HEAD", head));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, head, &obj));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_arena_init(&arena, obj.payload_len + 4096u));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_commit_parse(obj.payload, obj.payload_len, &arena, &view));
+    TEST_ASSERT_EQUAL_MEMORY(view.root_tree, root, SCRIBE_HASH_SIZE);
+    scribe_arena_destroy(&arena);
+    scribe_object_free(&obj);
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_snapshot_builder_new(ctx, 0, &builder));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_snapshot_builder_add(builder, clash_tree, 3, blob, 1));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_snapshot_builder_add(builder, clash_blob, 2, blob, 2));
+    TEST_ASSERT_EQUAL(SCRIBE_ECORRUPT, scribe_snapshot_builder_finish(builder, root));
+    scribe_snapshot_builder_free(builder);
+    scribe_close(ctx);
+}
+
+/*
+ * Writes one control file of a fake cgroup hierarchy under `root`, creating
+ * its directory.
+ */
+static void write_cgroup_file(const char *root, const char *dir, const char *name, const char *text) {
+    char path[512];
+
+    snprintf(path, sizeof(path), "%s/%s", root, dir);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mkdir_p(path));
+    snprintf(path, sizeof(path), "%s/%s/%s", root, dir, name);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_write_file_atomic(path, (const uint8_t *)text, strlen(text)));
+}
+
+/*
+ * Probes a fake cgroup v2 hierarchy: a fractional quota on the leaf rounds up,
+ * an ancestor's memory.max applies to the leaf, and the CPU count used for
+ * worker pools never exceeds the quota.
+ */
+void test_resources_probe_reads_cgroup(void) {
+    char root[] = "/tmp/scribe-cgroup-XXXXXX";
+    scribe_resources res;
+
+    make_temp_repo(root);
+    write_cgroup_file(root, "proc/self", "cgroup", "0::/pod\n");
+    write_cgroup_file(root, "sys/fs/cgroup", "cpu.max", "max 100000\n");
+    write_cgroup_file(root, "sys/fs/cgroup", "memory.max", "536870912\n");
+    write_cgroup_file(root, "sys/fs/cgroup/pod", "cpu.max", "150000 100000\n");
+    write_cgroup_file(root, "sys/fs/cgroup/pod", "memory.max", "max\n");
+    write_cgroup_file(root, "sys/fs/cgroup/pod", "cpuset.cpus.effective", "0-3,8\n");
+
+    scribe_resources_probe(root, &res);
+    TEST_ASSERT_EQUAL(2, res.quota_cpus);
+    TEST_ASSERT_EQUAL(5, res.cpuset_cpus);
+    TEST_ASSERT_EQUAL(536870912u, res.memory_max);
+    TEST_ASSERT_TRUE(res.cpus >= 1u && res.cpus <= 2u);
+
+    write_cgroup_file(root, "proc/self", "cgroup", "12:cpu:/legacy\n");
+    scribe_resources_probe(root, &res);
+    TEST_ASSERT_EQUAL(0, res.quota_cpus);
+    TEST_ASSERT_EQUAL(0, res.memory_max);
+    TEST_ASSERT_TRUE(res.cpus >= 1u && res.cpus <= res.online_cpus);
+}
+
+/*
+ * Fills a hash map past several resizes, removes every other key, and checks
+ * that the remaining keys are still found through the shifted probe runs.
+ */
+void test_hash_map_add_get_remove(void) {
+    scribe_hash_map map;
+    uint8_t key[SCRIBE_HASH_SIZE];
+    uint64_t *value;
+    uint32_t i;
+    int already;
+
+    memset(&map, 0, sizeof(map));
+    memset(key, 0, sizeof(key));
+    TEST_ASSERT_NULL(scribe_hash_map_get(&map, key));
+    for (i = 0; i < 5000u; i++) {
+        /* Equal leading bytes for runs of keys force long probe sequences. */
+        key[0] = (uint8_t)(i / 64u);
+        key[31] = (uint8_t)i;
+        key[30] = (uint8_t)(i >> 8);
+        TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_hash_map_add(&map, key, i, &already, NULL));
+        TEST_ASSERT_EQUAL(0, already);
+    }
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_hash_map_add(&map, key, 1u, &already, &value));
+    TEST_ASSERT_EQUAL(1, already);
+    TEST_ASSERT_EQUAL(4999u, *value);
+    for (i = 0; i < 5000u; i += 2u) {
+        key[0] = (uint8_t)(i / 64u);
+        key[31] = (uint8_t)i;
+        key[30] = (uint8_t)(i >> 8);
+        TEST_ASSERT_EQUAL(1, scribe_hash_map_remove(&map, key));
+        TEST_ASSERT_EQUAL(0, scribe_hash_map_remove(&map, key));
+    }
+    TEST_ASSERT_EQUAL(2500u, map.count);
+    for (i = 0; i < 5000u; i++) {
+        key[0] = (uint8_t)(i / 64u);
+        key[31] = (uint8_t)i;
+        key[30] = (uint8_t)(i >> 8);
+        value = scribe_hash_map_get(&map, key);
+        if (i % 2u == 0) {
+            TEST_ASSERT_NULL(value);
+        } else {
+            TEST_ASSERT_NOT_NULL(value);
+            TEST_ASSERT_EQUAL(i, *value);
+        }
+    }
+    scribe_hash_map_destroy(&map);
+}
+
+/*
+ * Archives a delta against an object and then tries to turn that base into
+ * the end of a 32-deep chain. The base must stay a plain object, otherwise
+ * the first delta's real chain would exceed SCRIBE_ARCHIVE_MAX_DEPTH and stop
+ * reading.
+ */
+void test_archive_keeps_bases_plain(void) {
+    char tmpl[] = "/tmp/scribe-test-XXXXXX";
+    scribe_ctx *ctx = NULL;
+    scribe_archiver *archiver = NULL;
+    scribe_archive_stats stats;
+    scribe_object obj;
+    uint8_t payload[4096];
+    uint8_t hashes[34][SCRIBE_HASH_SIZE];
+    uint32_t state = 12345u;
+    size_t i;
+    size_t deltas;
+
+    make_temp_repo(tmpl);
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_init_repository(tmpl));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_open(tmpl, 1, &ctx));
+    for (i = 0; i < sizeof(payload); i++) {
+        state = state * 1103515245u + 12345u;
+        payload[i] = (uint8_t)(state >> 16);
+    }
+    for (i = 0; i < 34u; i++) {
+        payload[i * 64u] ^= 0xffu;
+        TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_write(ctx, SCRIBE_OBJECT_BLOB, payload, sizeof(payload), hashes[i]));
+    }
+
+    memset(&stats, 0, sizeof(stats));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_archiver_new(ctx, &archiver));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_archiver_store(archiver, hashes[33], hashes[32], &stats));
+    TEST_ASSERT_EQUAL(1, stats.deltas);
+    scribe_archiver_free(archiver);
+
+    /* A fresh archiver must learn the base from objects/info/archive-deltas. */
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_archiver_new(ctx, &archiver));
+    for (i = 1; i <= 32u; i++) {
+        TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_archiver_store(archiver, hashes[i], hashes[i - 1u], &stats));
+    }
+    scribe_archiver_free(archiver);
+    deltas = stats.deltas;
+    TEST_ASSERT_EQUAL(32, deltas);
+
+    for (i = 0; i < 34u; i++) {
+        TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_object_read(ctx, hashes[i], &obj));
+        scribe_object_free(&obj);
+    }
+    scribe_close(ctx);
+}
@@ -23,14 +23,36 @@ void test_leb128_round_trip(void);
 void test_leb128_rejects_overlong(void);
 void test_hex_round_trip(void);
 void test_arena_alloc_reset(void);
-void test_tree_serialization_is_sorted(void);
+void test_tree_serialization_requires_sorted_entries(void);
 void test_queue_fifo_try_pop(void);
+void test_mem_budget_reserve_release(void);
+void test_mem_budget_admits_own_growth(void);
 void test_repository_commit_and_fsck(void);
 void test_pipe_commit_batch(void);
 void test_object_iterator_and_compressed_size(void);
+void test_adaptive_compression_and_repack(void);
+void test_sharded_tree_layout(void);
+void test_reachability_bitmaps_match_walk(void);
+void test_memory_object_backend(void);
+void test_parallel_object_iteration(void);
+void test_tree_leaf_count_cache(void);
+void test_batch_merge_apply(void);
+void test_commit_group_isolates_failures(void);
+void test_daemon_hosts_sessions(void);
+void test_intern_table(void);
+void test_intern_skips_deep_components(void);
+void test_full_document_mode_choice(void);
+void test_bson_blob_renders_canonical_json(void);
+void test_json_diff_emits_patch(void);
+void test_json_get_field_follows_path(void);
+void test_resources_probe_reads_cgroup(void);
+void test_hash_map_add_get_remove(void);
+void test_archive_keeps_bases_plain(void);
+void test_snapshot_builder_matches_commit(void);
 #ifdef SCRIBE_HAVE_MONGO_ADAPTER
 void test_mongo_canonical_json_sorts_keys(void);
 void test_mongo_canonical_bson_and_id(void);
+void test_mongo_sorted_bson_is_deterministic(void);
 #endif
 
 /*
@@ -43,14 +65,36 @@ int main(void) {
     RUN_TEST(test_leb128_rejects_overlong);
     RUN_TEST(test_hex_round_trip);
     RUN_TEST(test_arena_alloc_reset);
-    RUN_TEST(test_tree_serialization_is_sorted);
+    RUN_TEST(test_tree_serialization_requires_sorted_entries);
     RUN_TEST(test_queue_fifo_try_pop);
+    RUN_TEST(test_mem_budget_reserve_release);
+    RUN_TEST(test_mem_budget_admits_own_growth);
     RUN_TEST(test_repository_commit_and_fsck);
     RUN_TEST(test_pipe_commit_batch);
     RUN_TEST(test_object_iterator_and_compressed_size);
+    RUN_TEST(test_adaptive_compression_and_repack);
+    RUN_TEST(test_sharded_tree_layout);
+    RUN_TEST(test_reachability_bitmaps_match_walk);
+    RUN_TEST(test_memory_object_backend);
+    RUN_TEST(test_parallel_object_iteration);
+    RUN_TEST(test_tree_leaf_count_cache);
+    RUN_TEST(test_batch_merge_apply);
+    RUN_TEST(test_commit_group_isolates_failures);
+    RUN_TEST(test_daemon_hosts_sessions);
+    RUN_TEST(test_intern_table);
+    RUN_TEST(test_intern_skips_deep_components);
+    RUN_TEST(test_full_document_mode_choice);
+    RUN_TEST(test_bson_blob_renders_canonical_json);
+    RUN_TEST(test_json_diff_emits_patch);
+    RUN_TEST(test_json_get_field_follows_path);
+    RUN_TEST(test_resources_probe_reads_cgroup);
+    RUN_TEST(test_hash_map_add_get_remove);
+    RUN_TEST(test_archive_keeps_bases_plain);
+    RUN_TEST(test_snapshot_builder_matches_commit);
 #ifdef SCRIBE_HAVE_MONGO_ADAPTER
     RUN_TEST(test_mongo_canonical_json_sorts_keys);
     RUN_TEST(test_mongo_canonical_bson_and_id);
+    RUN_TEST(test_mongo_sorted_bson_is_deterministic);
 #endif
     return UNITY_END();
 }
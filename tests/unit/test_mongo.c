@@ -2,7 +2,8 @@
  * Unit tests for MongoDB canonicalization helpers.
  *
  * These tests do not connect to MongoDB. They verify that BSON/Extended JSON
- * conversion produces deterministic bytes and document-id path components.
+ * conversion and sorted-BSON encoding produce deterministic bytes and
+ * document-id path components.
  */
 #include "adapter_mongo/mongo_internal.h"
 #include "unity.h"
@@ -57,3 +58,55 @@ void test_mongo_canonical_bson_and_id(void) {
     free(id);
     bson_destroy(&doc);
 }
+
+/*
+ * Verifies that the sorted-BSON blob format is independent of field insertion
+ * order and renders to the same bytes as the canonical JSON blob format.
+ */
+void test_mongo_sorted_bson_is_deterministic(void) {
+    bson_t first;
+    bson_t second;
+    bson_t child;
+    uint8_t *a = NULL;
+    uint8_t *b = NULL;
+    uint8_t *canonical = NULL;
+    size_t a_len = 0;
+    size_t b_len = 0;
+    size_t canonical_len = 0;
+    char *rendered = NULL;
+    size_t rendered_len = 0;
+
+    bson_init(&first);
+    BSON_APPEND_UTF8(&first, "_id", "alice");
+    BSON_APPEND_DOCUMENT_BEGIN(&first, "a", &child);
+    BSON_APPEND_INT32(&child, "b", 2);
+    BSON_APPEND_INT32(&child, "a", 1);
+    bson_append_document_end(&first, &child);
+    BSON_APPEND_DOUBLE(&first, "z", 2.5);
+
+    bson_init(&second);
+    BSON_APPEND_DOUBLE(&second, "z", 2.5);
+    BSON_APPEND_DOCUMENT_BEGIN(&second, "a", &child);
+    BSON_APPEND_INT32(&child, "a", 1);
+    BSON_APPEND_INT32(&child, "b", 2);
+    bson_append_document_end(&second, &child);
+    BSON_APPEND_UTF8(&second, "_id", "alice");
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mongo_encode_document(&first, SCRIBE_BLOB_FORMAT_BSON_SORTED, &a, &a_len));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mongo_encode_document(&second, SCRIBE_BLOB_FORMAT_BSON_SORTED, &b, &b_len));
+    TEST_ASSERT_EQUAL_size_t(a_len, b_len);
+    TEST_ASSERT_EQUAL_MEMORY(a, b, a_len);
+    TEST_ASSERT_TRUE(scribe_bson_is_document(a, a_len));
+
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_mongo_canonicalize_bson(&first, &canonical, &canonical_len));
+    TEST_ASSERT_EQUAL(SCRIBE_OK, scribe_bson_to_json(a, a_len, &rendered, &rendered_len));
+    TEST_ASSERT_EQUAL_size_t(canonical_len, rendered_len);
+    TEST_ASSERT_EQUAL_MEMORY(canonical, rendered, canonical_len);
+
+    free(a);
+    free(b);
+    free(canonical);
+    free(rendered);
+    bson_destroy(&first);
+    bson_destroy(&second);
+}